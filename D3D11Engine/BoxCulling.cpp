@@ -0,0 +1,350 @@
+#include "pch.h"
+#include "BoxCulling.h"
+#include <immintrin.h>
+
+ZCullBoxes CullBoxes = CullBoxes_SSE2;
+
+namespace {
+    /** Squared radius for every distance class */
+    struct SquaredRadii {
+        explicit SquaredRadii( const CullingDistances& distances ) {
+            for ( int i = 0; i < 3; i++ ) {
+                Value[i] = distances.Radius[i] * distances.Radius[i];
+            }
+        }
+
+        float Value[3];
+    };
+
+    /** Tests a single box, the SIMD kernels use this for the boxes left over at the end */
+    inline bool IsBoxVisible( const BoxCullingInput& boxes, unsigned int i, const CullingFrustum& frustum, const CullingDistances& distances, const SquaredRadii& radii ) {
+        const float cx = boxes.CenterX[i];
+        const float cy = boxes.CenterY[i];
+        const float cz = boxes.CenterZ[i];
+        const float ex = boxes.ExtentX[i];
+        const float ey = boxes.ExtentY[i];
+        const float ez = boxes.ExtentZ[i];
+
+        // Closest point of the box to the viewer
+        const float dx = std::max( fabsf( cx - distances.Viewer.x ) - ex, 0.0f );
+        const float dy = std::max( fabsf( cy - distances.Viewer.y ) - ey, 0.0f );
+        const float dz = std::max( fabsf( cz - distances.Viewer.z ) - ez, 0.0f );
+        float maxDistSq = radii.Value[boxes.DistanceClass[i]];
+        if ( distances.DetailScaleSq > 0.0f ) {
+            // Too small on screen once the distance outgrows the bounding sphere of the box
+            maxDistSq = std::min( maxDistSq, (ex * ex + ey * ey + ez * ez) * distances.DetailScaleSq );
+        }
+        if ( !(dx * dx + dy * dy + dz * dz < maxDistSq) ) {
+            return false;
+        }
+
+        // Outside if even the corner furthest along the normal is behind the plane. Written so NaNs
+        // from empty boxes get rejected like in the SIMD kernels
+        for ( unsigned int p = 0; p < frustum.NumPlanes; p++ ) {
+            const XMFLOAT4& plane = frustum.Planes[p];
+            const float d = plane.x * cx + plane.y * cy + plane.z * cz + plane.w;
+            const float r = fabsf( plane.x ) * ex + fabsf( plane.y ) * ey + fabsf( plane.z ) * ez;
+            if ( !(d + r >= 0.0f) ) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    unsigned int CullRemainingBoxes( const BoxCullingInput& boxes, unsigned int first, const CullingFrustum& frustum, const CullingDistances& distances, const SquaredRadii& radii, unsigned int* outIndices ) {
+        unsigned int numVisible = 0;
+        for ( unsigned int i = first; i < boxes.NumBoxes; i++ ) {
+            outIndices[numVisible] = i;
+            numVisible += IsBoxVisible( boxes, i, frustum, distances, radii ) ? 1 : 0;
+        }
+        return numVisible;
+    }
+}
+
+/** Reference implementation, one box at a time */
+unsigned int CullBoxes_Scalar( const BoxCullingInput& boxes, const CullingFrustum& frustum, const CullingDistances& distances, unsigned int* outIndices ) {
+    return CullRemainingBoxes( boxes, 0, frustum, distances, SquaredRadii( distances ), outIndices );
+}
+
+/** Tests 4 boxes at once */
+unsigned int CullBoxes_SSE2( const BoxCullingInput& boxes, const CullingFrustum& frustum, const CullingDistances& distances, unsigned int* outIndices ) {
+    const SquaredRadii radii( distances );
+    const __m128 signMask = _mm_set1_ps( -0.0f );
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 viewerX = _mm_set1_ps( distances.Viewer.x );
+    const __m128 viewerY = _mm_set1_ps( distances.Viewer.y );
+    const __m128 viewerZ = _mm_set1_ps( distances.Viewer.z );
+    const __m128 radiusSq[3] = { _mm_set1_ps( radii.Value[0] ), _mm_set1_ps( radii.Value[1] ), _mm_set1_ps( radii.Value[2] ) };
+    const __m128i classSmall = _mm_set1_epi32( BOX_DISTANCE_OUTDOOR_SMALL );
+    const __m128i classIndoor = _mm_set1_epi32( BOX_DISTANCE_INDOOR );
+    const bool detailCulling = distances.DetailScaleSq > 0.0f;
+    const __m128 detailScaleSq = _mm_set1_ps( distances.DetailScaleSq );
+
+    __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+    __m128 planeAbsX[6], planeAbsY[6], planeAbsZ[6];
+    for ( unsigned int p = 0; p < frustum.NumPlanes; p++ ) {
+        planeX[p] = _mm_set1_ps( frustum.Planes[p].x );
+        planeY[p] = _mm_set1_ps( frustum.Planes[p].y );
+        planeZ[p] = _mm_set1_ps( frustum.Planes[p].z );
+        planeW[p] = _mm_set1_ps( frustum.Planes[p].w );
+        planeAbsX[p] = _mm_andnot_ps( signMask, planeX[p] );
+        planeAbsY[p] = _mm_andnot_ps( signMask, planeY[p] );
+        planeAbsZ[p] = _mm_andnot_ps( signMask, planeZ[p] );
+    }
+
+    unsigned int numVisible = 0;
+    unsigned int i = 0;
+    for ( ; i + 4 <= boxes.NumBoxes; i += 4 ) {
+        const __m128 cx = _mm_loadu_ps( &boxes.CenterX[i] );
+        const __m128 cy = _mm_loadu_ps( &boxes.CenterY[i] );
+        const __m128 cz = _mm_loadu_ps( &boxes.CenterZ[i] );
+        const __m128 ex = _mm_loadu_ps( &boxes.ExtentX[i] );
+        const __m128 ey = _mm_loadu_ps( &boxes.ExtentY[i] );
+        const __m128 ez = _mm_loadu_ps( &boxes.ExtentZ[i] );
+
+        // Pick the radius of every lane by its class
+        int packedClasses;
+        memcpy( &packedClasses, &boxes.DistanceClass[i], sizeof( packedClasses ) );
+        __m128i classes = _mm_unpacklo_epi8( _mm_cvtsi32_si128( packedClasses ), _mm_setzero_si128() );
+        classes = _mm_unpacklo_epi16( classes, _mm_setzero_si128() );
+        const __m128 isSmall = _mm_castsi128_ps( _mm_cmpeq_epi32( classes, classSmall ) );
+        const __m128 isIndoor = _mm_castsi128_ps( _mm_cmpeq_epi32( classes, classIndoor ) );
+        __m128 maxDistSq = _mm_or_ps( _mm_and_ps( isSmall, radiusSq[1] ), _mm_andnot_ps( isSmall, radiusSq[0] ) );
+        maxDistSq = _mm_or_ps( _mm_and_ps( isIndoor, radiusSq[2] ), _mm_andnot_ps( isIndoor, maxDistSq ) );
+        if ( detailCulling ) {
+            const __m128 sphereRadiusSq = _mm_add_ps( _mm_add_ps( _mm_mul_ps( ex, ex ), _mm_mul_ps( ey, ey ) ), _mm_mul_ps( ez, ez ) );
+            maxDistSq = _mm_min_ps( maxDistSq, _mm_mul_ps( sphereRadiusSq, detailScaleSq ) );
+        }
+
+        const __m128 dx = _mm_max_ps( _mm_sub_ps( _mm_andnot_ps( signMask, _mm_sub_ps( cx, viewerX ) ), ex ), zero );
+        const __m128 dy = _mm_max_ps( _mm_sub_ps( _mm_andnot_ps( signMask, _mm_sub_ps( cy, viewerY ) ), ey ), zero );
+        const __m128 dz = _mm_max_ps( _mm_sub_ps( _mm_andnot_ps( signMask, _mm_sub_ps( cz, viewerZ ) ), ez ), zero );
+        const __m128 distSq = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) ), _mm_mul_ps( dz, dz ) );
+        __m128 visible = _mm_cmplt_ps( distSq, maxDistSq );
+
+        for ( unsigned int p = 0; p < frustum.NumPlanes; p++ ) {
+            __m128 d = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( planeX[p], cx ), _mm_mul_ps( planeY[p], cy ) ), _mm_mul_ps( planeZ[p], cz ) ), planeW[p] );
+            __m128 r = _mm_add_ps( _mm_add_ps( _mm_mul_ps( planeAbsX[p], ex ), _mm_mul_ps( planeAbsY[p], ey ) ), _mm_mul_ps( planeAbsZ[p], ez ) );
+            visible = _mm_and_ps( visible, _mm_cmpge_ps( _mm_add_ps( d, r ), zero ) );
+        }
+
+        // Compact the surviving indices without branching on the mask
+        const int mask = _mm_movemask_ps( visible );
+        for ( unsigned int lane = 0; lane < 4; lane++ ) {
+            outIndices[numVisible] = i + lane;
+            numVisible += (mask >> lane) & 1;
+        }
+    }
+
+    return numVisible + CullRemainingBoxes( boxes, i, frustum, distances, radii, outIndices + numVisible );
+}
+
+#ifdef _XM_AVX2_INTRINSICS_
+/** Tests 8 boxes at once */
+unsigned int CullBoxes_AVX2( const BoxCullingInput& boxes, const CullingFrustum& frustum, const CullingDistances& distances, unsigned int* outIndices ) {
+    const SquaredRadii radii( distances );
+    const __m256 signMask = _mm256_set1_ps( -0.0f );
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 viewerX = _mm256_set1_ps( distances.Viewer.x );
+    const __m256 viewerY = _mm256_set1_ps( distances.Viewer.y );
+    const __m256 viewerZ = _mm256_set1_ps( distances.Viewer.z );
+    const bool detailCulling = distances.DetailScaleSq > 0.0f;
+    const __m256 detailScaleSq = _mm256_set1_ps( distances.DetailScaleSq );
+
+    __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+    __m256 planeAbsX[6], planeAbsY[6], planeAbsZ[6];
+    for ( unsigned int p = 0; p < frustum.NumPlanes; p++ ) {
+        planeX[p] = _mm256_set1_ps( frustum.Planes[p].x );
+        planeY[p] = _mm256_set1_ps( frustum.Planes[p].y );
+        planeZ[p] = _mm256_set1_ps( frustum.Planes[p].z );
+        planeW[p] = _mm256_set1_ps( frustum.Planes[p].w );
+        planeAbsX[p] = _mm256_andnot_ps( signMask, planeX[p] );
+        planeAbsY[p] = _mm256_andnot_ps( signMask, planeY[p] );
+        planeAbsZ[p] = _mm256_andnot_ps( signMask, planeZ[p] );
+    }
+
+    unsigned int numVisible = 0;
+    unsigned int i = 0;
+    for ( ; i + 8 <= boxes.NumBoxes; i += 8 ) {
+        const __m256 cx = _mm256_loadu_ps( &boxes.CenterX[i] );
+        const __m256 cy = _mm256_loadu_ps( &boxes.CenterY[i] );
+        const __m256 cz = _mm256_loadu_ps( &boxes.CenterZ[i] );
+        const __m256 ex = _mm256_loadu_ps( &boxes.ExtentX[i] );
+        const __m256 ey = _mm256_loadu_ps( &boxes.ExtentY[i] );
+        const __m256 ez = _mm256_loadu_ps( &boxes.ExtentZ[i] );
+
+        // The class is the index into the radius table
+        const __m256i classes = _mm256_cvtepu8_epi32( _mm_loadl_epi64( reinterpret_cast<const __m128i*>(&boxes.DistanceClass[i]) ) );
+        __m256 maxDistSq = _mm256_i32gather_ps( radii.Value, classes, 4 );
+        if ( detailCulling ) {
+            const __m256 sphereRadiusSq = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( ex, ex ), _mm256_mul_ps( ey, ey ) ), _mm256_mul_ps( ez, ez ) );
+            maxDistSq = _mm256_min_ps( maxDistSq, _mm256_mul_ps( sphereRadiusSq, detailScaleSq ) );
+        }
+
+        const __m256 dx = _mm256_max_ps( _mm256_sub_ps( _mm256_andnot_ps( signMask, _mm256_sub_ps( cx, viewerX ) ), ex ), zero );
+        const __m256 dy = _mm256_max_ps( _mm256_sub_ps( _mm256_andnot_ps( signMask, _mm256_sub_ps( cy, viewerY ) ), ey ), zero );
+        const __m256 dz = _mm256_max_ps( _mm256_sub_ps( _mm256_andnot_ps( signMask, _mm256_sub_ps( cz, viewerZ ) ), ez ), zero );
+        const __m256 distSq = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( dx, dx ), _mm256_mul_ps( dy, dy ) ), _mm256_mul_ps( dz, dz ) );
+        __m256 visible = _mm256_cmp_ps( distSq, maxDistSq, _CMP_LT_OQ );
+
+        for ( unsigned int p = 0; p < frustum.NumPlanes; p++ ) {
+            __m256 d = _mm256_add_ps( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( planeX[p], cx ), _mm256_mul_ps( planeY[p], cy ) ), _mm256_mul_ps( planeZ[p], cz ) ), planeW[p] );
+            __m256 r = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( planeAbsX[p], ex ), _mm256_mul_ps( planeAbsY[p], ey ) ), _mm256_mul_ps( planeAbsZ[p], ez ) );
+            visible = _mm256_and_ps( visible, _mm256_cmp_ps( _mm256_add_ps( d, r ), zero, _CMP_GE_OQ ) );
+        }
+
+        const int mask = _mm256_movemask_ps( visible );
+        for ( unsigned int lane = 0; lane < 8; lane++ ) {
+            outIndices[numVisible] = i + lane;
+            numVisible += (mask >> lane) & 1;
+        }
+    }
+
+    return numVisible + CullRemainingBoxes( boxes, i, frustum, distances, radii, outIndices + numVisible );
+}
+#endif
+
+/** Extracts the planes from a view-projection matrix for row-vectors */
+CullingFrustum CullingFrustum::FromViewProjection( const XMMATRIX& viewProj, unsigned int numPlanes ) {
+    // With row-vectors, column j of the matrix gives clip-space component j. The depth planes are
+    // z >= 0 and z <= w, which works for reversed depth as well, only near and far swap places.
+    XMMATRIX columns = XMMatrixTranspose( viewProj );
+    XMVECTOR planes[6] = {
+        columns.r[3] + columns.r[0], // Left
+        columns.r[3] - columns.r[0], // Right
+        columns.r[3] + columns.r[1], // Bottom
+        columns.r[3] - columns.r[1], // Top
+        columns.r[2],
+        columns.r[3] - columns.r[2],
+    };
+
+    CullingFrustum frustum;
+    frustum.NumPlanes = std::min( numPlanes, 6u );
+    for ( int p = 0; p < 6; p++ ) {
+        // Normalized, so the plane distance is in world units
+        XMStoreFloat4( &frustum.Planes[p], XMPlaneNormalize( planes[p] ) );
+    }
+    return frustum;
+}
+
+/** Tests a box against the planes set in planeMask and clears the planes the box is completely inside of */
+bool CullingFrustum::ClipBox( const zTBBox3D& box, uint32_t& planeMask ) const {
+    const float cx = (box.Min.x + box.Max.x) * 0.5f;
+    const float cy = (box.Min.y + box.Max.y) * 0.5f;
+    const float cz = (box.Min.z + box.Max.z) * 0.5f;
+    const float ex = (box.Max.x - box.Min.x) * 0.5f;
+    const float ey = (box.Max.y - box.Min.y) * 0.5f;
+    const float ez = (box.Max.z - box.Min.z) * 0.5f;
+
+    for ( unsigned int p = 0; p < NumPlanes; p++ ) {
+        if ( !((planeMask >> p) & 1) )
+            continue;
+
+        const XMFLOAT4& plane = Planes[p];
+        const float d = plane.x * cx + plane.y * cy + plane.z * cz + plane.w;
+        const float r = fabsf( plane.x ) * ex + fabsf( plane.y ) * ey + fabsf( plane.z ) * ez;
+        if ( !(d + r >= 0.0f) )
+            return false;
+
+        if ( d - r >= 0.0f )
+            planeMask &= ~(1u << p);
+    }
+    return true;
+}
+
+/** Removes all boxes */
+void BoxCullingSet::Clear() {
+    CenterX.clear();
+    CenterY.clear();
+    CenterZ.clear();
+    ExtentX.clear();
+    ExtentY.clear();
+    ExtentZ.clear();
+    DistanceClass.clear();
+}
+
+/** Reserves memory for the given number of boxes */
+void BoxCullingSet::Reserve( size_t numBoxes ) {
+    CenterX.reserve( numBoxes );
+    CenterY.reserve( numBoxes );
+    CenterZ.reserve( numBoxes );
+    ExtentX.reserve( numBoxes );
+    ExtentY.reserve( numBoxes );
+    ExtentZ.reserve( numBoxes );
+    DistanceClass.reserve( numBoxes );
+}
+
+/** Adds a box and returns its index */
+unsigned int BoxCullingSet::Add( const zTBBox3D& box, EBoxDistanceClass distanceClass ) {
+    unsigned int index = Size();
+    CenterX.push_back( 0.0f );
+    CenterY.push_back( 0.0f );
+    CenterZ.push_back( 0.0f );
+    ExtentX.push_back( 0.0f );
+    ExtentY.push_back( 0.0f );
+    ExtentZ.push_back( 0.0f );
+    DistanceClass.push_back( distanceClass );
+
+    Set( index, box );
+    return index;
+}
+
+/** Replaces the box at the given index */
+void BoxCullingSet::Set( unsigned int index, const zTBBox3D& box ) {
+    CenterX[index] = (box.Min.x + box.Max.x) * 0.5f;
+    CenterY[index] = (box.Min.y + box.Max.y) * 0.5f;
+    CenterZ[index] = (box.Min.z + box.Max.z) * 0.5f;
+    ExtentX[index] = (box.Max.x - box.Min.x) * 0.5f;
+    ExtentY[index] = (box.Max.y - box.Min.y) * 0.5f;
+    ExtentZ[index] = (box.Max.z - box.Min.z) * 0.5f;
+}
+
+/** Replaces the box and the distance class at the given index */
+void BoxCullingSet::Set( unsigned int index, const zTBBox3D& box, EBoxDistanceClass distanceClass ) {
+    Set( index, box );
+    DistanceClass[index] = distanceClass;
+}
+
+/** Returns the box at the given index */
+zTBBox3D BoxCullingSet::GetBox( unsigned int index ) const {
+    zTBBox3D box;
+    box.Min = XMFLOAT3( CenterX[index] - ExtentX[index], CenterY[index] - ExtentY[index], CenterZ[index] - ExtentZ[index] );
+    box.Max = XMFLOAT3( CenterX[index] + ExtentX[index], CenterY[index] + ExtentY[index], CenterZ[index] + ExtentZ[index] );
+    return box;
+}
+
+/** Appends the indices of all boxes inside the frustum and within their draw radius to outIndices */
+void BoxCullingSet::Cull( const CullingFrustum& frustum, const CullingDistances& distances, std::vector<unsigned int>& outIndices ) const {
+    Cull( 0, Size(), frustum, distances, outIndices );
+}
+
+/** Appends the indices of the boxes in the given range which are inside the frustum and within their draw radius to outIndices */
+void BoxCullingSet::Cull( unsigned int first, unsigned int count, const CullingFrustum& frustum, const CullingDistances& distances, std::vector<unsigned int>& outIndices ) const {
+    if ( count == 0 ) {
+        return;
+    }
+
+    BoxCullingInput input;
+    input.CenterX = &CenterX[first];
+    input.CenterY = &CenterY[first];
+    input.CenterZ = &CenterZ[first];
+    input.ExtentX = &ExtentX[first];
+    input.ExtentY = &ExtentY[first];
+    input.ExtentZ = &ExtentZ[first];
+    input.DistanceClass = &DistanceClass[first];
+    input.NumBoxes = count;
+
+    // The kernels write every index before deciding whether to keep it, so they need room for all of them
+    const size_t outFirst = outIndices.size();
+    outIndices.resize( outFirst + count );
+    unsigned int numVisible = CullBoxes( input, frustum, distances, &outIndices[outFirst] );
+    outIndices.resize( outFirst + numVisible );
+
+    // The kernels count from the start of the range
+    if ( first != 0 ) {
+        for ( size_t i = outFirst; i < outIndices.size(); i++ ) {
+            outIndices[i] += first;
+        }
+    }
+}
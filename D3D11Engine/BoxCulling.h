@@ -0,0 +1,108 @@
+#pragma once
+#include "pch.h"
+
+/** Which draw radius applies to a box */
+enum EBoxDistanceClass : uint8_t {
+    BOX_DISTANCE_OUTDOOR = 0,
+    BOX_DISTANCE_OUTDOOR_SMALL = 1,
+    BOX_DISTANCE_INDOOR = 2,
+};
+
+/** Frustum planes with their normals pointing inwards, so dot( normal, p ) + w >= 0 on the inside */
+struct CullingFrustum {
+    /** Extracts the planes from a view-projection matrix for row-vectors (like the transposed matrices of GothicAPI).
+        The four side planes come first, then the two depth planes. Only the first numPlanes are tested, so
+        4 skips near and far like the clip flags 15 of zCCamera::BBox3DInFrustum. */
+    static CullingFrustum FromViewProjection( const XMMATRIX& viewProj, unsigned int numPlanes );
+
+    /** Tests a box against the planes set in planeMask, like zCCamera::BBox3DInFrustum does with its clip flags.
+        Returns false if the box is outside, otherwise clears the planes the box is completely inside of. */
+    bool ClipBox( const zTBBox3D& box, uint32_t& planeMask ) const;
+
+    /** Mask with all planes set */
+    uint32_t GetPlaneMask() const { return (1u << NumPlanes) - 1; }
+
+    XMFLOAT4 Planes[6];
+    unsigned int NumPlanes;
+};
+
+/** Draw distances measured from the viewer to the closest point of a box, one per EBoxDistanceClass */
+struct CullingDistances {
+    /** Scale for DetailScaleSq: the distance a sphere of radius 1 covers minPixels pixels on screen at */
+    static float GetDetailScale( float pixelsPerUnit, float minPixels ) { return 2.0f * pixelsPerUnit / minPixels; }
+
+    XMFLOAT3 Viewer;
+    float Radius[3];
+
+    /** Squared GetDetailScale, or 0 to ignore the size of the boxes. Otherwise a box is also culled once
+        it is further away than the radius of its bounding sphere times the detail scale. */
+    float DetailScaleSq = 0.0f;
+};
+
+/** Boxes in structure-of-arrays form, matching what the kernels read */
+struct BoxCullingInput {
+    const float* CenterX;
+    const float* CenterY;
+    const float* CenterZ;
+    const float* ExtentX;
+    const float* ExtentY;
+    const float* ExtentZ;
+    const uint8_t* DistanceClass;
+    unsigned int NumBoxes;
+};
+
+/** Writes the indices of all boxes which touch the frustum, are closer than their radius and large enough
+    on screen to outIndices, in ascending order. outIndices must have room for NumBoxes entries. Returns how many were written. */
+typedef unsigned int (*ZCullBoxes)(const BoxCullingInput& boxes, const CullingFrustum& frustum, const CullingDistances& distances, unsigned int* outIndices);
+
+/** Best kernel for this CPU, selected in CheckPlatformSupport */
+extern ZCullBoxes CullBoxes;
+
+/** Reference implementation, one box at a time */
+unsigned int CullBoxes_Scalar( const BoxCullingInput& boxes, const CullingFrustum& frustum, const CullingDistances& distances, unsigned int* outIndices );
+
+/** Tests 4 boxes at once */
+unsigned int CullBoxes_SSE2( const BoxCullingInput& boxes, const CullingFrustum& frustum, const CullingDistances& distances, unsigned int* outIndices );
+
+#ifdef _XM_AVX2_INTRINSICS_
+/** Tests 8 boxes at once */
+unsigned int CullBoxes_AVX2( const BoxCullingInput& boxes, const CullingFrustum& frustum, const CullingDistances& distances, unsigned int* outIndices );
+#endif
+
+/** A list of axis aligned boxes kept as separate arrays of centers and extents, so CullBoxes can
+    test several of them with one instruction. Indices match the order the boxes were added in. */
+class BoxCullingSet {
+public:
+    /** Removes all boxes */
+    void Clear();
+
+    /** Reserves memory for the given number of boxes */
+    void Reserve( size_t numBoxes );
+
+    /** Adds a box and returns its index */
+    unsigned int Add( const zTBBox3D& box, EBoxDistanceClass distanceClass );
+
+    /** Replaces the box at the given index */
+    void Set( unsigned int index, const zTBBox3D& box );
+    void Set( unsigned int index, const zTBBox3D& box, EBoxDistanceClass distanceClass );
+
+    /** Returns the box at the given index */
+    zTBBox3D GetBox( unsigned int index ) const;
+
+    unsigned int Size() const { return static_cast<unsigned int>(CenterX.size()); }
+
+    /** Appends the indices of all boxes inside the frustum and within their draw radius to outIndices */
+    void Cull( const CullingFrustum& frustum, const CullingDistances& distances, std::vector<unsigned int>& outIndices ) const;
+
+    /** Same as above, but only tests the count boxes starting at first */
+    void Cull( unsigned int first, unsigned int count, const CullingFrustum& frustum, const CullingDistances& distances, std::vector<unsigned int>& outIndices ) const;
+
+private:
+    std::vector<float> CenterX;
+    std::vector<float> CenterY;
+    std::vector<float> CenterZ;
+    std::vector<float> ExtentX;
+    std::vector<float> ExtentY;
+    std::vector<float> ExtentZ;
+    std::vector<uint8_t> DistanceClass;
+};
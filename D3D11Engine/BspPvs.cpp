@@ -0,0 +1,715 @@
+#include "pch.h"
+#include "BspPvs.h"
+#include "MemoryMappedFile.h"
+#include "MeshCacheFormat.h"
+#include "ParallelFor.h"
+#include "Toolbox.h"
+
+namespace {
+    const uint32_t PVS_FILE_MAGIC = 0x53565047; // "GPVS"
+
+    /** Increase this whenever the file layout or the output of Build changes */
+    const uint32_t PVS_FILE_VERSION = 3;
+
+    /** Leaf boxes closer than this count as touching */
+    const float TOUCH_EPSILON = 1.0f;
+
+    /** Points closer than this to a plane count as lying on it */
+    const float PLANE_EPSILON = 0.5f;
+
+    /** Portal chains longer than this, or leaves which took more than MAX_PORTAL_STEPS portals to walk,
+        see everything that can be reached from where they stopped */
+    const unsigned int MAX_PORTAL_DEPTH = 12;
+    const unsigned int MAX_PORTAL_STEPS = 2048;
+
+    const unsigned int NO_ROOM = 0xFFFFFFFF;
+    const unsigned int NO_PORTAL = 0xFFFFFFFF;
+
+#pragma pack(push, 1)
+    struct PvsFileHeader {
+        uint32_t Magic;
+        uint32_t Version;
+        uint64_t Key;
+        uint64_t FileSize;
+        uint32_t NumLeaves;
+        uint32_t NumRows;
+        uint32_t RowWords;
+    };
+#pragma pack(pop)
+
+    struct Plane {
+        XMFLOAT3 Normal;
+        float Distance;
+
+        float GetDistance( const XMFLOAT3& p ) const {
+            return Normal.x * p.x + Normal.y * p.y + Normal.z * p.z - Distance;
+        }
+    };
+
+    struct PortalPolygon {
+        std::vector<XMFLOAT3> Points;
+        Plane PolyPlane;
+        zTBBox3D Box;
+    };
+
+    /** Portal from one room into another */
+    struct RoomLink {
+        unsigned int Portal;
+        unsigned int Room;
+    };
+
+    /** Memory one thread reuses while walking the portals of many leaves */
+    struct PortalWalkScratch {
+        std::vector<uint8_t> RoomVisible;
+        std::vector<uint8_t> PortalOnStack;
+        std::vector<unsigned int> FloodStack;
+        unsigned int Steps;
+    };
+
+    bool IsBoxEmpty( const zTBBox3D& box ) {
+        return box.Min.x > box.Max.x || box.Min.y > box.Max.y || box.Min.z > box.Max.z;
+    }
+
+    bool BoxesTouch( const zTBBox3D& a, const zTBBox3D& b, float epsilon ) {
+        return a.Min.x <= b.Max.x + epsilon && b.Min.x <= a.Max.x + epsilon
+            && a.Min.y <= b.Max.y + epsilon && b.Min.y <= a.Max.y + epsilon
+            && a.Min.z <= b.Max.z + epsilon && b.Min.z <= a.Max.z + epsilon;
+    }
+
+    /** Returns 1 if the box lies in front of the plane, -1 if it lies behind it and 0 if it spans it */
+    int GetBoxSide( const zTBBox3D& box, const Plane& plane ) {
+        const XMFLOAT3& n = plane.Normal;
+        const float center = n.x * (box.Min.x + box.Max.x) * 0.5f + n.y * (box.Min.y + box.Max.y) * 0.5f + n.z * (box.Min.z + box.Max.z) * 0.5f - plane.Distance;
+        const float extent = (fabsf( n.x ) * (box.Max.x - box.Min.x) + fabsf( n.y ) * (box.Max.y - box.Min.y) + fabsf( n.z ) * (box.Max.z - box.Min.z)) * 0.5f;
+        if ( center - extent >= -PLANE_EPSILON ) {
+            return 1;
+        }
+        if ( center + extent <= PLANE_EPSILON ) {
+            return -1;
+        }
+        return 0;
+    }
+
+    /** Plane through the three points, false if they are (almost) on one line */
+    bool MakePlane( const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c, Plane& outPlane ) {
+        XMVECTOR va = XMLoadFloat3( &a );
+        XMVECTOR n = XMVector3Cross( XMLoadFloat3( &b ) - va, XMLoadFloat3( &c ) - va );
+        float length = XMVectorGetX( XMVector3Length( n ) );
+        if ( length < 1e-3f ) {
+            return false;
+        }
+
+        XMStoreFloat3( &outPlane.Normal, n / length );
+        outPlane.Distance = XMVectorGetX( XMVector3Dot( XMLoadFloat3( &outPlane.Normal ), va ) );
+        return true;
+    }
+
+    /** Keeps the part of the polygon in front of the plane */
+    void ClipPolygon( const std::vector<XMFLOAT3>& in, const Plane& plane, std::vector<XMFLOAT3>& out ) {
+        out.clear();
+        for ( size_t i = 0; i < in.size(); i++ ) {
+            const XMFLOAT3& a = in[i];
+            const XMFLOAT3& b = in[(i + 1) % in.size()];
+            const float da = plane.GetDistance( a );
+            const float db = plane.GetDistance( b );
+
+            if ( da >= 0.0f ) {
+                out.push_back( a );
+            }
+            if ( (da >= 0.0f) != (db >= 0.0f) ) {
+                const float t = da / (da - db);
+                out.emplace_back( a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t );
+            }
+        }
+    }
+
+    /** Convex shape lines start from, given by its corners and edges */
+    struct LineSource {
+        std::vector<XMFLOAT3> Points;
+        std::vector<std::pair<unsigned int, unsigned int>> Edges;
+
+        void SetBox( const zTBBox3D& box ) {
+            Points.resize( 8 );
+            for ( unsigned int i = 0; i < 8; i++ ) {
+                Points[i] = XMFLOAT3( (i & 1) ? box.Max.x : box.Min.x, (i & 2) ? box.Max.y : box.Min.y, (i & 4) ? box.Max.z : box.Min.z );
+            }
+
+            // Corners which differ in one bit share an edge
+            Edges.clear();
+            for ( unsigned int i = 0; i < 8; i++ ) {
+                for ( unsigned int bit = 1; bit < 8; bit <<= 1 ) {
+                    if ( !(i & bit) ) {
+                        Edges.emplace_back( i, i | bit );
+                    }
+                }
+            }
+        }
+
+        void SetPolygon( const std::vector<XMFLOAT3>& points ) {
+            Points = points;
+            Edges.clear();
+            for ( unsigned int i = 0; i < points.size(); i++ ) {
+                Edges.emplace_back( i, (i + 1) % static_cast<unsigned int>(points.size()) );
+            }
+        }
+    };
+
+    /** Adds planes which have the whole source on one side and the whole pass polygon on the other.
+        A line from the source through the pass polygon can't get back to the side of the source, so everything
+        behind the pass polygon it can reach lies in front of all of them. */
+    void AddSeparatingPlanes( const LineSource& source, const std::vector<XMFLOAT3>& pass, std::vector<Plane>& outPlanes ) {
+        auto tryPlane = [&]( const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c ) {
+            Plane plane;
+            if ( !MakePlane( a, b, c, plane ) ) {
+                return;
+            }
+
+            float sourceMin = FLT_MAX, sourceMax = -FLT_MAX;
+            for ( const XMFLOAT3& p : source.Points ) {
+                const float d = plane.GetDistance( p );
+                sourceMin = std::min( sourceMin, d );
+                sourceMax = std::max( sourceMax, d );
+            }
+
+            float passMin = FLT_MAX, passMax = -FLT_MAX;
+            for ( const XMFLOAT3& p : pass ) {
+                const float d = plane.GetDistance( p );
+                passMin = std::min( passMin, d );
+                passMax = std::max( passMax, d );
+            }
+
+            // Lines going from the source through the polygon only get farther from the plane. The epsilon
+            // moves the plane back a bit, so rounding can't clip away something which is visible.
+            if ( sourceMax <= passMin ) {
+                plane.Distance += passMin - PLANE_EPSILON;
+                outPlanes.push_back( plane );
+            } else if ( sourceMin >= passMax ) {
+                plane.Normal = XMFLOAT3( -plane.Normal.x, -plane.Normal.y, -plane.Normal.z );
+                plane.Distance = -plane.Distance - passMax - PLANE_EPSILON;
+                outPlanes.push_back( plane );
+            }
+        };
+
+        for ( auto const& [first, second] : source.Edges ) {
+            for ( const XMFLOAT3& p : pass ) {
+                tryPlane( source.Points[first], source.Points[second], p );
+            }
+        }
+
+        for ( size_t i = 0; i < pass.size(); i++ ) {
+            for ( const XMFLOAT3& p : source.Points ) {
+                tryPlane( pass[i], pass[(i + 1) % pass.size()], p );
+            }
+        }
+    }
+
+    /** Finds the rooms and the portals between them and walks them for every leaf */
+    class PvsBuilder {
+    public:
+        PvsBuilder( const std::vector<zTBBox3D>& leafBoxes, const std::vector<std::vector<XMFLOAT3>>& portals, const std::vector<std::vector<unsigned int>>& leafPortals )
+            : LeafBoxes( leafBoxes ), LeafPortals( leafPortals ) {
+            PortalOfInput.assign( portals.size(), NO_PORTAL );
+            for ( size_t input = 0; input < portals.size(); input++ ) {
+                const std::vector<XMFLOAT3>& points = portals[input];
+                if ( points.size() < 3 ) {
+                    continue;
+                }
+
+                PortalPolygon portal;
+                portal.Points = points;
+
+                // Newell's method, works for slightly bent polygons as well
+                XMFLOAT3 normal( 0, 0, 0 );
+                XMFLOAT3 center( 0, 0, 0 );
+                portal.Box.Min = XMFLOAT3( FLT_MAX, FLT_MAX, FLT_MAX );
+                portal.Box.Max = XMFLOAT3( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+                for ( size_t i = 0; i < points.size(); i++ ) {
+                    const XMFLOAT3& a = points[i];
+                    const XMFLOAT3& b = points[(i + 1) % points.size()];
+                    normal.x += (a.y - b.y) * (a.z + b.z);
+                    normal.y += (a.z - b.z) * (a.x + b.x);
+                    normal.z += (a.x - b.x) * (a.y + b.y);
+                    center.x += a.x;
+                    center.y += a.y;
+                    center.z += a.z;
+
+                    portal.Box.Min = XMFLOAT3( std::min( portal.Box.Min.x, a.x ), std::min( portal.Box.Min.y, a.y ), std::min( portal.Box.Min.z, a.z ) );
+                    portal.Box.Max = XMFLOAT3( std::max( portal.Box.Max.x, a.x ), std::max( portal.Box.Max.y, a.y ), std::max( portal.Box.Max.z, a.z ) );
+                }
+
+                const float length = sqrtf( normal.x * normal.x + normal.y * normal.y + normal.z * normal.z );
+                if ( length < 1e-3f ) {
+                    continue;
+                }
+
+                const float invNum = 1.0f / static_cast<float>(points.size());
+                portal.PolyPlane.Normal = XMFLOAT3( normal.x / length, normal.y / length, normal.z / length );
+                portal.PolyPlane.Distance = (portal.PolyPlane.Normal.x * center.x + portal.PolyPlane.Normal.y * center.y + portal.PolyPlane.Normal.z * center.z) * invNum;
+                PortalOfInput[input] = static_cast<unsigned int>(Portals.size());
+                Portals.push_back( std::move( portal ) );
+            }
+        }
+
+        /** Groups the leaves into rooms. Touching leaves end up in the same room, unless a portal of one
+            of them lies between them with each of them on another side of it. */
+        void FindRooms() {
+            const unsigned int numLeaves = static_cast<unsigned int>(LeafBoxes.size());
+            std::vector<unsigned int> parent( numLeaves );
+            for ( unsigned int i = 0; i < numLeaves; i++ ) {
+                parent[i] = i;
+            }
+
+            auto find = [&]( unsigned int i ) {
+                while ( parent[i] != i ) {
+                    parent[i] = parent[parent[i]];
+                    i = parent[i];
+                }
+                return i;
+            };
+
+            std::vector<unsigned int> sorted;
+            for ( unsigned int i = 0; i < numLeaves; i++ ) {
+                if ( !IsBoxEmpty( LeafBoxes[i] ) ) {
+                    sorted.push_back( i );
+                }
+            }
+            std::sort( sorted.begin(), sorted.end(), [&]( unsigned int a, unsigned int b ) {
+                return LeafBoxes[a].Min.x < LeafBoxes[b].Min.x;
+            } );
+
+            // Links are only known after all rooms were merged, so keep the leaves for now
+            std::vector<std::tuple<unsigned int, unsigned int, unsigned int>> portalLeaves;
+            std::vector<unsigned int> candidates;
+            for ( size_t i = 0; i < sorted.size(); i++ ) {
+                const zTBBox3D& a = LeafBoxes[sorted[i]];
+                for ( size_t j = i + 1; j < sorted.size() && LeafBoxes[sorted[j]].Min.x <= a.Max.x + TOUCH_EPSILON; j++ ) {
+                    const zTBBox3D& b = LeafBoxes[sorted[j]];
+                    if ( !BoxesTouch( a, b, TOUCH_EPSILON ) ) {
+                        continue;
+                    }
+
+                    zTBBox3D overlap;
+                    overlap.Min = XMFLOAT3( std::max( a.Min.x, b.Min.x ), std::max( a.Min.y, b.Min.y ), std::max( a.Min.z, b.Min.z ) );
+                    overlap.Max = XMFLOAT3( std::min( a.Max.x, b.Max.x ), std::min( a.Max.y, b.Max.y ), std::min( a.Max.z, b.Max.z ) );
+
+                    // Leaves which only share an edge or a corner can't see each other through it
+                    const int flatAxes = (overlap.Max.x - overlap.Min.x < TOUCH_EPSILON) + (overlap.Max.y - overlap.Min.y < TOUCH_EPSILON) + (overlap.Max.z - overlap.Min.z < TOUCH_EPSILON);
+                    if ( flatAxes > 1 ) {
+                        continue;
+                    }
+
+                    // A portal between two leaves is in the polygon list of at least one of them
+                    candidates.clear();
+                    for ( unsigned int leaf : { sorted[i], sorted[j] } ) {
+                        for ( unsigned int input : LeafPortals[leaf] ) {
+                            if ( PortalOfInput[input] != NO_PORTAL ) {
+                                candidates.push_back( PortalOfInput[input] );
+                            }
+                        }
+                    }
+                    std::sort( candidates.begin(), candidates.end() );
+                    candidates.erase( std::unique( candidates.begin(), candidates.end() ), candidates.end() );
+
+                    bool separated = false;
+                    for ( unsigned int p : candidates ) {
+                        const PortalPolygon& portal = Portals[p];
+                        if ( !BoxesTouch( portal.Box, overlap, TOUCH_EPSILON ) ) {
+                            continue;
+                        }
+
+                        const int sideA = GetBoxSide( a, portal.PolyPlane );
+                        const int sideB = GetBoxSide( b, portal.PolyPlane );
+                        if ( sideA != 0 && sideA == -sideB ) {
+                            portalLeaves.emplace_back( p, sorted[i], sorted[j] );
+                            separated = true;
+                        }
+                    }
+
+                    if ( !separated ) {
+                        parent[find( sorted[i] )] = find( sorted[j] );
+                    }
+                }
+            }
+
+            LeafRooms.assign( numLeaves, NO_ROOM );
+            std::vector<unsigned int> rootRooms( numLeaves, NO_ROOM );
+            NumRooms = 0;
+            for ( unsigned int leaf : sorted ) {
+                unsigned int& room = rootRooms[find( leaf )];
+                if ( room == NO_ROOM ) {
+                    room = NumRooms++;
+                }
+                LeafRooms[leaf] = room;
+            }
+
+            std::set<std::tuple<unsigned int, unsigned int, unsigned int>> links;
+            for ( auto const& [portal, leafA, leafB] : portalLeaves ) {
+                const unsigned int roomA = LeafRooms[leafA];
+                const unsigned int roomB = LeafRooms[leafB];
+                if ( roomA != roomB ) {
+                    links.emplace( roomA, portal, roomB );
+                    links.emplace( roomB, portal, roomA );
+                }
+            }
+
+            RoomLinks.assign( NumRooms, std::vector<RoomLink>() );
+            for ( auto const& [from, portal, to] : links ) {
+                RoomLinks[from].push_back( { portal, to } );
+            }
+        }
+
+        /** Marks every room which can be seen from the given leaf */
+        void WalkLeaf( unsigned int leaf, PortalWalkScratch& scratch ) const {
+            scratch.RoomVisible.assign( NumRooms, 0 );
+            scratch.PortalOnStack.assign( Portals.size(), 0 );
+            scratch.Steps = 0;
+
+            const unsigned int room = LeafRooms[leaf];
+            scratch.RoomVisible[room] = 1;
+
+            LineSource box;
+            box.SetBox( LeafBoxes[leaf] );
+            WalkRoom( box, nullptr, room, nullptr, 0, scratch );
+        }
+
+        unsigned int GetNumRooms() const { return NumRooms; }
+        unsigned int GetLeafRoom( unsigned int leaf ) const { return LeafRooms[leaf]; }
+
+    private:
+        /** Follows the portals of a room. Lines from the box have to pass through the first portal of the chain
+            and then through pass, which is the part of the portal the room was entered through that is still visible. */
+        void WalkRoom( const LineSource& box, const LineSource* firstPortal, unsigned int room, const std::vector<XMFLOAT3>* pass, unsigned int depth, PortalWalkScratch& scratch ) const {
+            std::vector<Plane> separators;
+            if ( pass ) {
+                AddSeparatingPlanes( box, *pass, separators );
+            }
+            if ( firstPortal && depth > 1 ) {
+                AddSeparatingPlanes( *firstPortal, *pass, separators );
+            }
+
+            std::vector<XMFLOAT3> clipped;
+            std::vector<XMFLOAT3> tmp;
+            LineSource nextFirstPortal;
+            for ( const RoomLink& link : RoomLinks[room] ) {
+                if ( scratch.PortalOnStack[link.Portal] ) {
+                    continue;
+                }
+
+                clipped = Portals[link.Portal].Points;
+                for ( const Plane& plane : separators ) {
+                    ClipPolygon( clipped, plane, tmp );
+                    clipped.swap( tmp );
+                    if ( clipped.size() < 3 ) {
+                        break;
+                    }
+                }
+
+                if ( clipped.size() < 3 ) {
+                    continue;
+                }
+
+                scratch.RoomVisible[link.Room] = 1;
+
+                if ( depth + 1 >= MAX_PORTAL_DEPTH || ++scratch.Steps > MAX_PORTAL_STEPS ) {
+                    Flood( link.Room, scratch );
+                    continue;
+                }
+
+                if ( !firstPortal ) {
+                    nextFirstPortal.SetPolygon( clipped );
+                }
+
+                scratch.PortalOnStack[link.Portal] = 1;
+                WalkRoom( box, firstPortal ? firstPortal : &nextFirstPortal, link.Room, &clipped, depth + 1, scratch );
+                scratch.PortalOnStack[link.Portal] = 0;
+            }
+        }
+
+        /** Marks everything reachable from the given room through any portals. Flooded rooms are marked with 2,
+            so rooms which were only seen still get flooded from. */
+        void Flood( unsigned int room, PortalWalkScratch& scratch ) const {
+            if ( scratch.RoomVisible[room] == 2 ) {
+                return;
+            }
+
+            scratch.RoomVisible[room] = 2;
+            scratch.FloodStack.clear();
+            scratch.FloodStack.push_back( room );
+            while ( !scratch.FloodStack.empty() ) {
+                const unsigned int r = scratch.FloodStack.back();
+                scratch.FloodStack.pop_back();
+
+                for ( const RoomLink& link : RoomLinks[r] ) {
+                    if ( scratch.RoomVisible[link.Room] != 2 ) {
+                        scratch.RoomVisible[link.Room] = 2;
+                        scratch.FloodStack.push_back( link.Room );
+                    }
+                }
+            }
+        }
+
+        const std::vector<zTBBox3D>& LeafBoxes;
+        const std::vector<std::vector<unsigned int>>& LeafPortals;
+        std::vector<PortalPolygon> Portals;
+
+        /** Index in Portals of every input polygon, NO_PORTAL for the ones which were dropped */
+        std::vector<unsigned int> PortalOfInput;
+        std::vector<unsigned int> LeafRooms;
+        std::vector<std::vector<RoomLink>> RoomLinks;
+        unsigned int NumRooms = 0;
+    };
+}
+
+BspPvs::BspPvs() {
+    RowWords = 0;
+    NumColumns = 0;
+}
+
+/** Computes the key of the given input */
+uint64_t BspPvs::ComputeKey( const std::vector<zTBBox3D>& leafBoxes, const std::vector<std::vector<XMFLOAT3>>& portals, const std::vector<std::vector<unsigned int>>& leafPortals ) {
+    std::vector<float> data;
+    data.reserve( leafBoxes.size() * 6 + portals.size() * 13 + 1 );
+    for ( const zTBBox3D& box : leafBoxes ) {
+        data.insert( data.end(), { box.Min.x, box.Min.y, box.Min.z, box.Max.x, box.Max.y, box.Max.z } );
+    }
+
+    // The point counts keep two different splits of the same points apart
+    for ( const std::vector<XMFLOAT3>& points : portals ) {
+        data.push_back( static_cast<float>(points.size()) );
+        for ( const XMFLOAT3& p : points ) {
+            data.insert( data.end(), { p.x, p.y, p.z } );
+        }
+    }
+
+    // Portal indices are small enough to be exact as floats
+    for ( const std::vector<unsigned int>& indices : leafPortals ) {
+        data.push_back( static_cast<float>(indices.size()) );
+        for ( unsigned int index : indices ) {
+            data.push_back( static_cast<float>(index) );
+        }
+    }
+
+    return MeshCacheFormat::ComputeChecksum( reinterpret_cast<const uint8_t*>(data.data()), data.size() * sizeof( float ) ) ^ PVS_FILE_VERSION;
+}
+
+/** Builds the sets for the given leaves and portal polygons */
+void BspPvs::Build( const std::vector<zTBBox3D>& leafBoxes, const std::vector<std::vector<XMFLOAT3>>& portals, const std::vector<std::vector<unsigned int>>& leafPortals ) {
+    Clear();
+
+    const unsigned int numLeaves = static_cast<unsigned int>(leafBoxes.size());
+    if ( numLeaves == 0 ) {
+        return;
+    }
+
+    PvsBuilder builder( leafBoxes, portals, leafPortals );
+    builder.FindRooms();
+
+    // Every leaf gets the set of rooms it can see, leaves without a room see everything
+    std::vector<std::vector<uint8_t>> leafRoomSets( numLeaves );
+    std::vector<PortalWalkScratch> scratches( GetParallelForSlots() );
+    ParallelFor( numLeaves, [&]( size_t leaf, unsigned int slot ) {
+        if ( builder.GetLeafRoom( static_cast<unsigned int>(leaf) ) == NO_ROOM ) {
+            return;
+        }
+
+        PortalWalkScratch& scratch = scratches[slot];
+        builder.WalkLeaf( static_cast<unsigned int>(leaf), scratch );
+        leafRoomSets[leaf].resize( scratch.RoomVisible.size() );
+        for ( size_t room = 0; room < scratch.RoomVisible.size(); room++ ) {
+            leafRoomSets[leaf][room] = scratch.RoomVisible[room] != 0;
+        }
+    } );
+
+    // Only the leaves inside a room get a row and a bit in the rows. The others see everything and are seen from
+    // everywhere, which IsVisible knows without storing it.
+    std::vector<unsigned int> leafOfColumn;
+    std::vector<std::vector<unsigned int>> roomColumns( builder.GetNumRooms() );
+    for ( unsigned int leaf = 0; leaf < numLeaves; leaf++ ) {
+        const unsigned int room = builder.GetLeafRoom( leaf );
+        if ( room != NO_ROOM ) {
+            roomColumns[room].push_back( static_cast<unsigned int>(leafOfColumn.size()) );
+            leafOfColumn.push_back( leaf );
+        }
+    }
+
+    const unsigned int numColumns = static_cast<unsigned int>(leafOfColumn.size());
+    RowWords = (numColumns + 31) / 32;
+    std::vector<uint32_t> bits( static_cast<size_t>(numColumns) * RowWords, 0 );
+    auto getBit = [&]( unsigned int from, unsigned int to ) {
+        return (bits[static_cast<size_t>(from) * RowWords + (to >> 5)] >> (to & 31)) & 1;
+    };
+    auto setBit = [&]( unsigned int from, unsigned int to, bool value ) {
+        uint32_t& word = bits[static_cast<size_t>(from) * RowWords + (to >> 5)];
+        word = value ? (word | (1u << (to & 31))) : (word & ~(1u << (to & 31)));
+    };
+
+    for ( unsigned int column = 0; column < numColumns; column++ ) {
+        const std::vector<uint8_t>& rooms = leafRoomSets[leafOfColumn[column]];
+        for ( unsigned int room = 0; room < rooms.size(); room++ ) {
+            if ( rooms[room] ) {
+                for ( unsigned int visibleColumn : roomColumns[room] ) {
+                    setBit( column, visibleColumn, true );
+                }
+            }
+        }
+    }
+
+    // Visibility goes both ways, so a leaf only counts as visible if the walk from the other side agrees.
+    // Both walks only ever add leaves, so this can't lose one which really is visible. Only the set bits
+    // need to be looked at, clearing one never affects another pair.
+    for ( unsigned int a = 0; a < numColumns; a++ ) {
+        for ( unsigned int w = 0; w < RowWords; w++ ) {
+            uint32_t word = bits[static_cast<size_t>(a) * RowWords + w];
+            while ( word ) {
+                unsigned long bit;
+                _BitScanForward( &bit, word );
+                word &= word - 1;
+
+                const unsigned int b = w * 32 + bit;
+                if ( !getBit( b, a ) ) {
+                    setBit( a, b, false );
+                }
+            }
+        }
+    }
+
+    // Leaves with the same set share a row
+    RowOfLeaf.assign( numLeaves, NO_ROW );
+    std::map<std::vector<uint32_t>, uint32_t> rowOfSet;
+    for ( unsigned int column = 0; column < numColumns; column++ ) {
+        std::vector<uint32_t> row( bits.begin() + static_cast<size_t>(column) * RowWords, bits.begin() + static_cast<size_t>(column + 1) * RowWords );
+
+        auto it = rowOfSet.find( row );
+        if ( it == rowOfSet.end() ) {
+            it = rowOfSet.emplace( row, GetNumRows() ).first;
+            Rows.insert( Rows.end(), row.begin(), row.end() );
+        }
+        RowOfLeaf[leafOfColumn[column]] = it->second;
+    }
+    AssignColumns();
+
+    LogInfo() << "Built PVS for " << numLeaves << " leaves, " << numColumns << " of them in " << builder.GetNumRooms() << " rooms, " << GetNumRows() << " different sets";
+}
+
+/** Fills ColumnOfLeaf from RowOfLeaf */
+void BspPvs::AssignColumns() {
+    NumColumns = 0;
+    ColumnOfLeaf.assign( RowOfLeaf.size(), NO_ROW );
+    for ( size_t leaf = 0; leaf < RowOfLeaf.size(); leaf++ ) {
+        if ( RowOfLeaf[leaf] != NO_ROW ) {
+            ColumnOfLeaf[leaf] = NumColumns++;
+        }
+    }
+}
+
+/** Loads the sets from the given file */
+XRESULT BspPvs::Load( const std::string& file, uint64_t key ) {
+    Clear();
+
+    MemoryMappedFile mapped;
+    if ( XR_SUCCESS != mapped.Open( file ) ) {
+        return XR_FAILED;
+    }
+
+    const uint8_t* data = mapped.GetData();
+    const uint64_t fileSize = mapped.GetSize();
+    if ( fileSize < sizeof( PvsFileHeader ) ) {
+        LogWarn() << "PVS file " << file << " is too small, ignoring it";
+        return XR_FAILED;
+    }
+
+    const PvsFileHeader& header = *reinterpret_cast<const PvsFileHeader*>(data);
+    if ( header.Magic != PVS_FILE_MAGIC || header.Version != PVS_FILE_VERSION ) {
+        LogInfo() << "PVS file " << file << " has an old version, rebuilding it";
+        return XR_FAILED;
+    }
+
+    if ( header.Key != key ) {
+        LogInfo() << "PVS file " << file << " was made for different geometry, rebuilding it";
+        return XR_FAILED;
+    }
+
+    const uint64_t rowsOffset = sizeof( PvsFileHeader ) + static_cast<uint64_t>(header.NumLeaves) * sizeof( uint32_t );
+    if ( header.FileSize != fileSize
+        || !MeshCacheFormat::IsArrayInFile( sizeof( PvsFileHeader ), header.NumLeaves, sizeof( uint32_t ), fileSize )
+        || !MeshCacheFormat::IsArrayInFile( rowsOffset, static_cast<uint64_t>(header.NumRows) * header.RowWords, sizeof( uint32_t ), fileSize ) ) {
+        LogWarn() << "PVS file " << file << " is damaged, ignoring it";
+        return XR_FAILED;
+    }
+
+    // Every leaf inside a room has a row and a bit in the rows
+    const uint32_t* rowOfLeaf = reinterpret_cast<const uint32_t*>(data + sizeof( PvsFileHeader ));
+    const uint32_t* rows = reinterpret_cast<const uint32_t*>(data + rowsOffset);
+    uint32_t numRoomLeaves = 0;
+    for ( uint32_t i = 0; i < header.NumLeaves; i++ ) {
+        if ( rowOfLeaf[i] == NO_ROW ) {
+            continue;
+        }
+
+        if ( rowOfLeaf[i] >= header.NumRows ) {
+            LogWarn() << "PVS file " << file << " is damaged, ignoring it";
+            return XR_FAILED;
+        }
+        numRoomLeaves++;
+    }
+
+    if ( header.RowWords != (numRoomLeaves + 31) / 32 ) {
+        LogWarn() << "PVS file " << file << " is damaged, ignoring it";
+        return XR_FAILED;
+    }
+
+    RowWords = header.RowWords;
+    RowOfLeaf.assign( rowOfLeaf, rowOfLeaf + header.NumLeaves );
+    Rows.assign( rows, rows + static_cast<size_t>(header.NumRows) * header.RowWords );
+    AssignColumns();
+    return XR_SUCCESS;
+}
+
+/** Writes the sets to the given file */
+XRESULT BspPvs::Save( const std::string& file, uint64_t key ) const {
+    PvsFileHeader header = {};
+    header.Magic = PVS_FILE_MAGIC;
+    header.Version = PVS_FILE_VERSION;
+    header.Key = key;
+    header.NumLeaves = GetNumLeaves();
+    header.NumRows = GetNumRows();
+    header.RowWords = RowWords;
+    header.FileSize = sizeof( PvsFileHeader ) + (RowOfLeaf.size() + Rows.size()) * sizeof( uint32_t );
+
+    std::string folder = file.substr( 0, file.find_last_of( "\\/" ) + 1 );
+    if ( !folder.empty() && !Toolbox::FolderExists( folder ) && !Toolbox::CreateDirectoryRecursive( folder ) ) {
+        LogWarn() << "Could not create PVS directory: " << folder;
+        return XR_FAILED;
+    }
+
+    // Write to a temporary file first, so a crash while saving can't leave a broken file behind
+    std::string tmpFile = file + ".tmp";
+    FILE* f;
+    if ( fopen_s( &f, tmpFile.c_str(), "wb" ) != 0 || !f ) {
+        LogWarn() << "Could not open PVS file for writing: " << tmpFile;
+        return XR_FAILED;
+    }
+
+    fwrite( &header, sizeof( header ), 1, f );
+    fwrite( RowOfLeaf.data(), sizeof( uint32_t ), RowOfLeaf.size(), f );
+    fwrite( Rows.data(), sizeof( uint32_t ), Rows.size(), f );
+
+    bool failed = ferror( f ) != 0;
+    fclose( f );
+
+    if ( failed || !MoveFileExA( tmpFile.c_str(), file.c_str(), MOVEFILE_REPLACE_EXISTING ) ) {
+        LogWarn() << "Could not write PVS file: " << file;
+        DeleteFileA( tmpFile.c_str() );
+        return XR_FAILED;
+    }
+
+    return XR_SUCCESS;
+}
+
+void BspPvs::Clear() {
+    RowWords = 0;
+    NumColumns = 0;
+    RowOfLeaf.clear();
+    ColumnOfLeaf.clear();
+    Rows.clear();
+}
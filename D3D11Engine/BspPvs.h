@@ -0,0 +1,70 @@
+#pragma once
+#include "pch.h"
+
+/** Potentially visible set of the BSP leaves of an indoor world, built from its portal polygons.
+    Leaves are grouped into rooms, which are only connected where a portal separates two leaves. A room
+    counts as visible from a leaf if some line from the leafs box can reach it through a chain of portals.
+    Everything uncertain counts as visible, so leaves missing from a set can't be seen from anywhere in the
+    box of the leaf the set belongs to. */
+class BspPvs {
+public:
+    BspPvs();
+
+    /** Computes the key of the given input. A file saved with the same key was built from the same leaves and portals. */
+    static uint64_t ComputeKey( const std::vector<zTBBox3D>& leafBoxes, const std::vector<std::vector<XMFLOAT3>>& portals, const std::vector<std::vector<unsigned int>>& leafPortals );
+
+    /** Builds the sets for the given leaves and portal polygons. leafPortals holds the indices of the portals in the
+        polygon list of every leaf, only those are checked for separating a leaf from the leaves it touches.
+        Leaves with an empty box (Min above Max) are visible from everywhere and see everything. Runs on the worker threads. */
+    void Build( const std::vector<zTBBox3D>& leafBoxes, const std::vector<std::vector<XMFLOAT3>>& portals, const std::vector<std::vector<unsigned int>>& leafPortals );
+
+    /** Loads the sets from the given file. Fails if it doesn't exist or was saved with a different key. */
+    XRESULT Load( const std::string& file, uint64_t key );
+
+    /** Writes the sets to the given file */
+    XRESULT Save( const std::string& file, uint64_t key ) const;
+
+    void Clear();
+
+    bool IsEmpty() const { return RowOfLeaf.empty(); }
+    unsigned int GetNumLeaves() const { return static_cast<unsigned int>(RowOfLeaf.size()); }
+
+    /** Number of leaves inside a room, only those have a set and a bit in the sets */
+    unsigned int GetNumRoomLeaves() const { return NumColumns; }
+
+    /** Number of different sets, leaves with the same set share one row */
+    unsigned int GetNumRows() const { return RowWords ? static_cast<unsigned int>(Rows.size() / RowWords) : 0; }
+
+    /** Memory taken by the sets */
+    size_t GetSizeInBytes() const { return (RowOfLeaf.size() + ColumnOfLeaf.size() + Rows.size()) * sizeof( uint32_t ); }
+
+    /** Returns whether the leaf to may be visible from inside the box of the leaf from */
+    bool IsVisible( unsigned int from, unsigned int to ) const {
+        // Leaves outside of the rooms see everything and are seen from everywhere
+        const uint32_t row = RowOfLeaf[from];
+        const uint32_t column = ColumnOfLeaf[to];
+        if ( row == NO_ROW || column == NO_ROW ) {
+            return true;
+        }
+
+        return (Rows[row * RowWords + (column >> 5)] >> (column & 31)) & 1;
+    }
+
+private:
+    static const uint32_t NO_ROW = 0xFFFFFFFF;
+
+    /** Fills ColumnOfLeaf from RowOfLeaf, the leaves with a row get a column in the same order */
+    void AssignColumns();
+
+    /** Words of one row, one bit per leaf inside a room */
+    unsigned int RowWords;
+    unsigned int NumColumns;
+
+    /** Index of the row of every leaf, NO_ROW outside of the rooms */
+    std::vector<uint32_t> RowOfLeaf;
+
+    /** Bit of every leaf in the rows, NO_ROW outside of the rooms */
+    std::vector<uint32_t> ColumnOfLeaf;
+
+    std::vector<uint32_t> Rows;
+};
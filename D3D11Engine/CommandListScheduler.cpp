@@ -0,0 +1,52 @@
+#include "pch.h"
+#include "CommandListScheduler.h"
+#include "ParallelFor.h"
+
+CommandListScheduler::CommandListScheduler() {
+    Stats = {};
+}
+
+/** Splits the items into consecutive jobs of nearly the same size */
+void CommandListScheduler::Partition( unsigned int numItems, unsigned int maxJobs, std::vector<Job>& outJobs ) {
+    outJobs.clear();
+
+    const unsigned int numJobs = std::max( 1u, std::min( maxJobs, numItems / MIN_ITEMS_PER_JOB ) );
+    const unsigned int itemsPerJob = numItems / numJobs;
+    const unsigned int remainder = numItems % numJobs;
+
+    // The first jobs take one more item each until the remainder is used up
+    unsigned int first = 0;
+    for ( unsigned int i = 0; i < numJobs; i++ ) {
+        const unsigned int count = itemsPerJob + (i < remainder ? 1 : 0);
+        outJobs.push_back( { first, count } );
+        first += count;
+    }
+}
+
+/** Records the jobs in parallel and executes them in order */
+bool CommandListScheduler::Run( BaseCommandListBackend& backend, unsigned int numItems ) {
+    Stats = {};
+
+    Partition( numItems, backend.GetNumContexts(), Jobs );
+    if ( Jobs.size() < 2 ) {
+        Jobs.clear();
+        return false;
+    }
+
+    Recorded.assign( Jobs.size(), 0 );
+    ParallelFor( Jobs.size(), [&]( size_t job, unsigned int ) {
+        Recorded[job] = backend.RecordJob( static_cast<unsigned int>(job), Jobs[job].First, Jobs[job].Count ) ? 1 : 0;
+    } );
+
+    for ( size_t job = 0; job < Jobs.size(); job++ ) {
+        if ( !Recorded[job] ) {
+            Stats.FailedJobs++;
+            continue;
+        }
+
+        backend.ExecuteJob( static_cast<unsigned int>(job) );
+    }
+
+    Stats.Jobs = static_cast<unsigned int>(Jobs.size());
+    return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <vector>
+
+/** Everything CommandListScheduler needs from the renderer. Each context records on one thread at a time,
+    executing happens on the thread that called CommandListScheduler::Run. */
+class BaseCommandListBackend {
+public:
+    virtual ~BaseCommandListBackend() {}
+
+    /** Most jobs that can be recorded at once, like the number of deferred contexts */
+    virtual unsigned int GetNumContexts() = 0;
+
+    /** Records the items [first, first + count) into the context. Returns false if that failed and there is nothing to execute. */
+    virtual bool RecordJob( unsigned int context, unsigned int first, unsigned int count ) = 0;
+
+    /** Executes what the context recorded last */
+    virtual void ExecuteJob( unsigned int context ) = 0;
+};
+
+/** Counters of the last Run */
+struct CommandListStats {
+    unsigned int Jobs;
+    unsigned int FailedJobs;
+};
+
+/** Splits an ordered list of draws into jobs, records them on the worker threads and executes the results in
+    the order of the items. Jobs cover consecutive items, so what was sorted for fewer state changes stays so
+    within a job. Each job starts without any state bound, which costs a few binds at every cut. */
+class CommandListScheduler {
+public:
+    /** Fewest items a job gets. Below that, recording them right away is cheaper than a command list. */
+    static const unsigned int MIN_ITEMS_PER_JOB = 256;
+
+    struct Job {
+        unsigned int First;
+        unsigned int Count;
+    };
+
+    CommandListScheduler();
+
+    /** Splits the items into at most maxJobs consecutive jobs of nearly the same size, each at least MIN_ITEMS_PER_JOB large */
+    static void Partition( unsigned int numItems, unsigned int maxJobs, std::vector<Job>& outJobs );
+
+    /** Records the jobs in parallel, job i into context i, and executes them in order. Returns false without
+        doing anything if the items don't fill two jobs, the caller should draw them directly then. */
+    bool Run( BaseCommandListBackend& backend, unsigned int numItems );
+
+    const std::vector<Job>& GetJobs() const { return Jobs; }
+    const CommandListStats& GetStats() const { return Stats; }
+
+private:
+    std::vector<Job> Jobs;
+
+    /** Whether each job recorded successfully. Not a vector<bool>, the jobs write it from several threads. */
+    std::vector<unsigned char> Recorded;
+
+    CommandListStats Stats;
+};
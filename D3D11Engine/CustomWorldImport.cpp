@@ -0,0 +1,466 @@
+#include "pch.h"
+#include "CustomWorldImport.h"
+#include "Engine.h"
+#include "GothicAPI.h"
+#include "GMesh.h"
+#include "WorldConverter.h"
+#include "ThreadPool.h"
+#include "ParallelFor.h"
+#include "BasicTimer.h"
+#include "zCMaterial.h"
+#include "zCTexture.h"
+#include <set>
+
+namespace {
+    /** Custom world meshes are modelled in meters */
+    const float CUSTOM_WORLD_SCALE = 100.0f;
+}
+
+CustomWorldImport::CustomWorldImport() {
+    Cancelled = false;
+    BuildMeshlets = false;
+    BeginPhase( 0.0f, 0.0f, 0 );
+}
+
+CustomWorldImport::~CustomWorldImport() {
+    Cancel();
+    if ( ImportResult.valid() ) {
+        ImportResult.wait();
+    }
+
+    // Don't leave a half written cache file behind
+    if ( CacheWriter.valid() ) {
+        CacheWriter.wait();
+    }
+}
+
+/** Starts importing the given file */
+XRESULT CustomWorldImport::Start( const std::string& file ) {
+    if ( ImportResult.valid() ) {
+        return XR_FAILED; // Already importing
+    }
+
+    File = file;
+    Cancelled = false;
+    BuildMeshlets = Engine::GAPI->GetRendererState().RendererSettings.EnableWorldMeshletCulling;
+    SectionMeshes.clear();
+    BeginPhase( 0.0f, 0.0f, 0 );
+
+    ImportResult = std::async( std::launch::async, &CustomWorldImport::Run, this );
+    return XR_SUCCESS;
+}
+
+/** Makes the import stop as soon as possible */
+void CustomWorldImport::Cancel() {
+    Cancelled = true;
+}
+
+/** Returns true between Start and Finalize */
+bool CustomWorldImport::IsPending() const {
+    return ImportResult.valid();
+}
+
+/** Returns how far the background part is, from 0 to 1 */
+float CustomWorldImport::GetProgress() const {
+    if ( IsDone() ) {
+        return 1.0f;
+    }
+
+    const size_t steps = PhaseSteps;
+    const float begin = PhaseBegin;
+    const float end = PhaseEnd;
+    const float fraction = steps > 0 ? std::min( 1.0f, static_cast<float>(PhaseStepsDone) / steps ) : 0.0f;
+    return begin + (end - begin) * fraction;
+}
+
+/** Returns true if the background part is finished */
+bool CustomWorldImport::IsDone() const {
+    return WaitUntilDone( 0 );
+}
+
+/** Waits until the background part is finished or the timeout ran out */
+bool CustomWorldImport::WaitUntilDone( unsigned int timeoutMs ) const {
+    if ( !ImportResult.valid() ) {
+        return true;
+    }
+
+    return ImportResult.wait_for( std::chrono::milliseconds( timeoutMs ) ) == std::future_status::ready;
+}
+
+/** Runs all background phases */
+XRESULT CustomWorldImport::Run() {
+    BASIC_TIMING( loadTimer );
+    GMesh mesh;
+    BeginPhase( 0.0f, 0.3f, 1 );
+    if ( XR_SUCCESS != LoadFile( mesh ) ) {
+        return XR_FAILED;
+    }
+    loadTimer.Update();
+
+    BASIC_TIMING( bucketTimer );
+    if ( Cancelled ) {
+        return XR_FAILED;
+    }
+    BucketIntoSections( mesh );
+    bucketTimer.Update();
+
+    if ( Cancelled ) {
+        return XR_FAILED;
+    }
+
+    if ( SectionMeshes.empty() ) {
+        LogWarn() << "Custom world mesh " << File << " doesn't contain any triangles";
+        return XR_FAILED;
+    }
+
+    BASIC_TIMING( processTimer );
+    ProcessSectionMeshes();
+    processTimer.Update();
+
+    if ( Cancelled ) {
+        LogInfo() << "Import of custom world mesh " << File << " was cancelled";
+        return XR_FAILED;
+    }
+
+    LogInfo() << "Imported custom world mesh into " << SectionMeshes.size() << " section meshes: load " << static_cast<int>(loadTimer.GetDelta() * 1000.0f) << "ms"
+        << ", sections " << static_cast<int>(bucketTimer.GetDelta() * 1000.0f) << "ms"
+        << ", indexing " << static_cast<int>(processTimer.GetDelta() * 1000.0f) << "ms";
+
+    return XR_SUCCESS;
+}
+
+/** Phase 1: Loads the cache or the original file */
+XRESULT CustomWorldImport::LoadFile( GMesh& mesh ) {
+    const std::string cacheFile = File + ".mcache";
+    if ( Toolbox::FileExists( cacheFile ) ) {
+        if ( XR_SUCCESS == mesh.LoadMesh( cacheFile, CUSTOM_WORLD_SCALE, false ) ) {
+            return XR_SUCCESS;
+        }
+
+        LogWarn() << "Can't use the cache of the custom world mesh, loading " << File << " instead";
+    }
+
+    if ( XR_SUCCESS != mesh.LoadMesh( File, CUSTOM_WORLD_SCALE, false ) ) {
+        return XR_FAILED;
+    }
+
+    // Write the cache while the import goes on. It holds the meshes as they are in the file.
+    std::vector<MeshInfo*>& meshes = mesh.GetMeshes();
+    std::vector<std::string>& textures = mesh.GetTextures();
+    std::map<std::string, std::vector<std::pair<std::vector<ExVertexStruct>, std::vector<VERTEX_INDEX>>>> geometry;
+    for ( unsigned int m = 0; m < meshes.size(); m++ ) {
+        geometry[textures[m]].emplace_back( std::make_pair( meshes[m]->Vertices, meshes[m]->Indices ) );
+    }
+
+    if ( Engine::WorkerThreadPool ) {
+        CacheWriter = Engine::WorkerThreadPool->enqueue( [cacheFile, geometry = std::move( geometry )]() mutable {
+            WorldConverter::CacheMesh( std::move( geometry ), cacheFile );
+        } );
+    } else {
+        WorldConverter::CacheMesh( std::move( geometry ), cacheFile );
+    }
+
+    return XR_SUCCESS;
+}
+
+/** Phase 2: Fixes the orientation of the meshes and splits their triangles into sections */
+void CustomWorldImport::BucketIntoSections( GMesh& mesh ) {
+    std::vector<MeshInfo*>& meshes = mesh.GetMeshes();
+    std::vector<std::string>& textures = mesh.GetTextures();
+
+    // Every source mesh gets its own buckets, so the result doesn't depend on which thread did what
+    std::vector<std::map<std::pair<int, int>, std::vector<ExVertexStruct>>> buckets( meshes.size() );
+
+    BeginPhase( 0.3f, 0.45f, meshes.size() );
+    ParallelFor( meshes.size(), [&]( size_t m, unsigned int ) {
+        if ( Cancelled ) {
+            return;
+        }
+
+        MeshInfo* source = meshes[m];
+        for ( ExVertexStruct& v : source->Vertices ) {
+            // Mesh needs to be rotated differently
+            v.Position = float3( v.Position.x, v.Position.y, -v.Position.z );
+
+            // Fix disoriented texcoords
+            v.TexCoord = float2( v.TexCoord.x, -v.TexCoord.y );
+        }
+
+        const size_t numVertices = source->Vertices.size();
+        for ( size_t i = 0; i + 2 < source->Indices.size(); i += 3 ) {
+            if ( source->Indices[i] >= numVertices ||
+                source->Indices[i + 1] >= numVertices ||
+                source->Indices[i + 2] >= numVertices )
+                break; // Catch broken meshes
+
+            const ExVertexStruct& v0 = source->Vertices[source->Indices[i]];
+            const ExVertexStruct& v1 = source->Vertices[source->Indices[i + 2]];
+            const ExVertexStruct& v2 = source->Vertices[source->Indices[i + 1]];
+
+            // Calculate midpoint of this triangle to get the section
+            XMFLOAT3 avgPos;
+            XMStoreFloat3( &avgPos, (XMLoadFloat3( v0.Position.toXMFLOAT3() ) + XMLoadFloat3( v1.Position.toXMFLOAT3() ) + XMLoadFloat3( v2.Position.toXMFLOAT3() )) / 3.0f );
+            INT2 sxy = WorldConverter::GetSectionOfPos( avgPos );
+
+            std::vector<ExVertexStruct>& bucket = buckets[m][std::make_pair( sxy.x, sxy.y )];
+            bucket.push_back( v0 );
+            bucket.push_back( v1 );
+            bucket.push_back( v2 );
+        }
+
+        // Dont need that anymore
+        std::vector<ExVertexStruct>().swap( source->Vertices );
+        std::vector<VERTEX_INDEX>().swap( source->Indices );
+        PhaseStepsDone++;
+    } );
+
+    if ( Cancelled ) {
+        return;
+    }
+
+    // Group the buckets by section and texture, in the order of the source meshes
+    std::map<std::pair<std::pair<int, int>, std::string>, std::vector<std::vector<ExVertexStruct>*>> groups;
+    for ( size_t m = 0; m < buckets.size(); m++ ) {
+        for ( auto& [section, vertices] : buckets[m] ) {
+            groups[std::make_pair( section, textures[m] )].push_back( &vertices );
+        }
+    }
+
+    std::vector<std::pair<const std::pair<std::pair<int, int>, std::string>, std::vector<std::vector<ExVertexStruct>*>>*> groupList;
+    groupList.reserve( groups.size() );
+    for ( auto& group : groups ) {
+        groupList.push_back( &group );
+    }
+
+    SectionMeshes.resize( groupList.size() );
+
+    BeginPhase( 0.45f, 0.5f, groupList.size() );
+    ParallelFor( groupList.size(), [&]( size_t g, unsigned int ) {
+        if ( Cancelled ) {
+            return;
+        }
+
+        SectionMesh& sectionMesh = SectionMeshes[g];
+        sectionMesh.Section = INT2( groupList[g]->first.first.first, groupList[g]->first.first.second );
+        sectionMesh.Texture = groupList[g]->first.second;
+
+        size_t numVertices = 0;
+        for ( std::vector<ExVertexStruct>* part : groupList[g]->second ) {
+            numVertices += part->size();
+        }
+
+        sectionMesh.Vertices.reserve( numVertices );
+        for ( std::vector<ExVertexStruct>* part : groupList[g]->second ) {
+            sectionMesh.Vertices.insert( sectionMesh.Vertices.end(), part->begin(), part->end() );
+            std::vector<ExVertexStruct>().swap( *part );
+        }
+        PhaseStepsDone++;
+    } );
+}
+
+/** Phase 3: Indexes, splits and optimizes the section meshes and builds their meshlets if needed */
+void CustomWorldImport::ProcessSectionMeshes() {
+    // Meshes with too many vertices for 16-bit indices are split, every mesh gets its parts here
+    std::vector<std::vector<SectionMesh>> parts( SectionMeshes.size() );
+
+    BeginPhase( 0.5f, 1.0f, SectionMeshes.size() );
+    ParallelFor( SectionMeshes.size(), [&]( size_t s, unsigned int ) {
+        if ( Cancelled ) {
+            return;
+        }
+
+        SectionMesh& mesh = SectionMeshes[s];
+
+        std::vector<ExVertexStruct> indexedVertices;
+        std::vector<unsigned int> indices;
+        WorldConverter::IndexVertices( &mesh.Vertices[0], mesh.Vertices.size(), indexedVertices, indices );
+        std::vector<ExVertexStruct>().swap( mesh.Vertices );
+
+        SplitMesh( mesh, indexedVertices, indices, parts[s] );
+        for ( SectionMesh& part : parts[s] ) {
+            XMVECTOR bbMin = XMVectorReplicate( FLT_MAX );
+            XMVECTOR bbMax = XMVectorReplicate( -FLT_MAX );
+            for ( const ExVertexStruct& v : part.Vertices ) {
+                XMVECTOR p = XMLoadFloat3( v.Position.toXMFLOAT3() );
+                bbMin = XMVectorMin( bbMin, p );
+                bbMax = XMVectorMax( bbMax, p );
+            }
+            XMStoreFloat3( &part.BoundingBox.Min, bbMin );
+            XMStoreFloat3( &part.BoundingBox.Max, bbMax );
+
+            // The buffers themselves are created in Finalize
+            WorldConverter::OptimizeWorldMesh( part.Vertices, part.Indices, BuildMeshlets, part.Meshlets );
+        }
+        PhaseStepsDone++;
+    } );
+
+    if ( Cancelled ) {
+        return;
+    }
+
+    // Parts stay next to each other, so the meshes are still sorted by section and texture
+    std::vector<SectionMesh> meshes;
+    for ( std::vector<SectionMesh>& meshParts : parts ) {
+        for ( SectionMesh& part : meshParts ) {
+            meshes.emplace_back( std::move( part ) );
+        }
+    }
+    SectionMeshes = std::move( meshes );
+}
+
+/** Splits an indexed mesh into parts whose vertices can be addressed with VERTEX_INDEX */
+void CustomWorldImport::SplitMesh( const SectionMesh& source, const std::vector<ExVertexStruct>& vertices, const std::vector<unsigned int>& indices, std::vector<SectionMesh>& outParts ) {
+    const size_t maxVertices = static_cast<size_t>(std::numeric_limits<VERTEX_INDEX>::max()) + 1;
+
+    // Index of every vertex inside the current part, and the vertices the current part holds
+    std::vector<unsigned int> remap( vertices.size(), UINT_MAX );
+    std::vector<unsigned int> partVertices;
+
+    for ( size_t i = 0; i + 2 < indices.size(); i += 3 ) {
+        size_t numNew = 0;
+        for ( size_t v = 0; v < 3; v++ ) {
+            numNew += remap[indices[i + v]] == UINT_MAX ? 1 : 0;
+        }
+
+        if ( outParts.empty() || partVertices.size() + numNew > maxVertices ) {
+            // Only the vertices of the finished part have to be forgotten, not the whole table
+            for ( unsigned int vertex : partVertices ) {
+                remap[vertex] = UINT_MAX;
+            }
+            partVertices.clear();
+
+            outParts.emplace_back();
+            outParts.back().Section = source.Section;
+            outParts.back().Texture = source.Texture;
+        }
+
+        SectionMesh& part = outParts.back();
+        for ( size_t v = 0; v < 3; v++ ) {
+            unsigned int& index = remap[indices[i + v]];
+            if ( index == UINT_MAX ) {
+                index = static_cast<unsigned int>(partVertices.size());
+                partVertices.push_back( indices[i + v] );
+                part.Vertices.push_back( vertices[indices[i + v]] );
+            }
+            part.Indices.push_back( static_cast<VERTEX_INDEX>(index) );
+        }
+    }
+
+    if ( outParts.size() > 1 ) {
+        LogInfo() << "Split texture " << source.Texture << " in section " << source.Section.x << ", " << source.Section.y
+            << " of the custom world mesh into " << outParts.size() << " meshes, it has " << vertices.size() << " vertices";
+    }
+}
+
+/** Starts a new phase covering progress from begin to end in numSteps steps */
+void CustomWorldImport::BeginPhase( float begin, float end, size_t numSteps ) {
+    PhaseSteps = 0;
+    PhaseStepsDone = 0;
+    PhaseBegin = begin;
+    PhaseEnd = end;
+    PhaseSteps = numSteps;
+}
+
+/** Appends the vertices and indices of source to target, as long as the indices still fit */
+bool CustomWorldImport::AppendMesh( WorldMeshInfo& target, SectionMesh& source ) {
+    const size_t baseVertex = target.Vertices.size();
+    if ( baseVertex + source.Vertices.size() > static_cast<size_t>(std::numeric_limits<VERTEX_INDEX>::max()) + 1 ) {
+        return false;
+    }
+
+    target.Vertices.insert( target.Vertices.end(), source.Vertices.begin(), source.Vertices.end() );
+    target.Indices.reserve( target.Indices.size() + source.Indices.size() );
+    for ( VERTEX_INDEX index : source.Indices ) {
+        target.Indices.push_back( static_cast<VERTEX_INDEX>(index + baseVertex) );
+    }
+    return true;
+}
+
+/** Puts the imported meshes into the sections and creates their buffers. Main thread only. */
+XRESULT CustomWorldImport::Finalize( std::map<int, std::map<int, WorldMeshSectionInfo>>* outSections, WorldInfo* info, MeshInfo** outWrappedMesh ) {
+    if ( !ImportResult.valid() || XR_SUCCESS != ImportResult.get() || Cancelled ) {
+        SectionMeshes.clear();
+        return XR_FAILED;
+    }
+
+    BASIC_TIMING( finalizeTimer );
+
+    // Materials belong to the game, so they can only be looked up here
+    std::map<std::string, MeshKey> keys;
+    std::set<std::string> missingTextures;
+
+    // Meshes which got others appended, see below
+    std::vector<WorldMeshInfo*> appendedMeshes;
+
+    // run through meshes and pack them into sections
+    for ( SectionMesh& sectionMesh : SectionMeshes ) {
+        auto key = keys.find( sectionMesh.Texture );
+        if ( key == keys.end() ) {
+            zCMaterial* mat = Engine::GAPI->GetMaterialByTextureName( sectionMesh.Texture );
+            MeshKey newKey;
+            newKey.Material = mat;
+            newKey.Texture = mat != nullptr ? mat->GetTextureSingle() : nullptr;
+            newKey.Info = Engine::GAPI->GetMaterialInfoFrom( newKey.Texture );
+
+            // Save missing textures
+            if ( !mat ) {
+                missingTextures.insert( sectionMesh.Texture );
+            } else if ( mat->GetMatGroup() == zMAT_GROUP_WATER ) {
+                // Give water surfaces a water-shader
+                MaterialInfo* info = Engine::GAPI->GetMaterialInfoFrom( mat->GetTextureSingle() );
+                if ( info ) {
+                    info->PixelShader = "PS_Water";
+                    info->MaterialType = MaterialInfo::MT_Water;
+                }
+            }
+
+            key = keys.emplace( sectionMesh.Texture, newKey ).first;
+        }
+
+        WorldMeshSectionInfo& section = (*outSections)[sectionMesh.Section.x][sectionMesh.Section.y];
+        section.WorldCoordinates = sectionMesh.Section;
+        XMStoreFloat3( &section.BoundingBox.Min, XMVectorMin( XMLoadFloat3( &section.BoundingBox.Min ), XMLoadFloat3( &sectionMesh.BoundingBox.Min ) ) );
+        XMStoreFloat3( &section.BoundingBox.Max, XMVectorMax( XMLoadFloat3( &section.BoundingBox.Max ), XMLoadFloat3( &sectionMesh.BoundingBox.Max ) ) );
+
+        // Several textures can share a material, or have none at all. Goes into the last mesh of the
+        // material if there is still room, otherwise the material gets another mesh.
+        auto existing = section.WorldMeshes.equal_range( key->second );
+        if ( existing.first != existing.second && AppendMesh( *std::prev( existing.second )->second, sectionMesh ) ) {
+            appendedMeshes.push_back( std::prev( existing.second )->second );
+        } else {
+            WorldMeshInfo* mesh = new WorldMeshInfo;
+            mesh->Vertices = std::move( sectionMesh.Vertices );
+            mesh->Indices = std::move( sectionMesh.Indices );
+            mesh->Meshlets = std::move( sectionMesh.Meshlets );
+            section.WorldMeshes.emplace( key->second, mesh );
+        }
+    }
+    SectionMeshes.clear();
+
+    // Appended meshes are still one block of triangles per texture. Optimize them as a whole, which also
+    // rebuilds the meshlets over the combined index list.
+    std::sort( appendedMeshes.begin(), appendedMeshes.end() );
+    appendedMeshes.erase( std::unique( appendedMeshes.begin(), appendedMeshes.end() ), appendedMeshes.end() );
+    ParallelFor( appendedMeshes.size(), [&]( size_t m, unsigned int ) {
+        WorldMeshInfo* mesh = appendedMeshes[m];
+        WorldConverter::OptimizeWorldMesh( mesh->Vertices, mesh->Indices, BuildMeshlets, mesh->Meshlets );
+    } );
+
+    // Print textures we couldn't find any materials for if there are any
+    if ( !missingTextures.empty() ) {
+        std::string ms = "\nMissing materials for custom-mesh:\n";
+
+        for ( auto it = missingTextures.begin(); it != missingTextures.end(); it++ ) {
+            ms += "\t" + (*it) + "\n";
+        }
+
+        LogWarn() << ms;
+    }
+
+    WorldConverter::CreateWorldMeshBuffers( *outSections, info, outWrappedMesh );
+
+    finalizeTimer.Update();
+    LogInfo() << "Created the buffers of the custom world mesh in " << static_cast<int>(finalizeTimer.GetDelta() * 1000.0f) << "ms";
+
+    return XR_SUCCESS;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "pch.h"
+#include "WorldObjects.h"
+#include <atomic>
+#include <future>
+
+class GMesh;
+
+/** Imports a custom world mesh (system\GD3D11\meshes\WLD_*.obj) in the background.
+    Parsing, putting the triangles into sections and indexing run on worker threads. Only Finalize, which
+    looks up the materials and creates the buffers, has to run on the main thread. */
+class CustomWorldImport {
+public:
+    CustomWorldImport();
+    ~CustomWorldImport();
+
+    /** Starts importing the given file. Uses the .mcache next to it if there is a valid one,
+        otherwise the cache gets written in the background once the file is parsed. */
+    XRESULT Start( const std::string& file );
+
+    /** Makes the import stop as soon as possible. Finalize fails afterwards. */
+    void Cancel();
+
+    /** Returns true between Start and Finalize */
+    bool IsPending() const;
+
+    /** Returns how far the background part is, from 0 to 1 */
+    float GetProgress() const;
+
+    /** Returns true if the background part is finished, so Finalize won't block */
+    bool IsDone() const;
+
+    /** Waits until the background part is finished or the timeout ran out. Returns IsDone(). */
+    bool WaitUntilDone( unsigned int timeoutMs ) const;
+
+    /** Waits for the background part, then puts the meshes into the given sections and creates the
+        buffers and the wrapped world mesh. Sections which already exist in outSections are kept. Main thread only. */
+    XRESULT Finalize( std::map<int, std::map<int, WorldMeshSectionInfo>>* outSections, WorldInfo* info, MeshInfo** outWrappedMesh );
+
+private:
+    /** All triangles of one texture inside one section */
+    struct SectionMesh {
+        INT2 Section;
+        std::string Texture;
+        zTBBox3D BoundingBox;
+        std::vector<ExVertexStruct> Vertices;
+        std::vector<VERTEX_INDEX> Indices;
+        std::vector<Meshlet> Meshlets;
+    };
+
+    /** Runs all background phases */
+    XRESULT Run();
+
+    /** Phase 1: Loads the cache or the original file */
+    XRESULT LoadFile( GMesh& mesh );
+
+    /** Phase 2: Fixes the orientation of the meshes and splits their triangles into sections */
+    void BucketIntoSections( GMesh& mesh );
+
+    /** Phase 3: Indexes, splits and optimizes the section meshes and builds their meshlets if needed */
+    void ProcessSectionMeshes();
+
+    /** Starts a new phase covering progress from begin to end in numSteps steps */
+    void BeginPhase( float begin, float end, size_t numSteps );
+
+    /** Splits an indexed mesh into parts whose vertices can be addressed with VERTEX_INDEX. Usually that is only one. */
+    static void SplitMesh( const SectionMesh& source, const std::vector<ExVertexStruct>& vertices, const std::vector<unsigned int>& indices, std::vector<SectionMesh>& outParts );
+
+    /** Appends the vertices and indices of source to target, as long as the indices still fit */
+    static bool AppendMesh( WorldMeshInfo& target, SectionMesh& source );
+
+    std::string File;
+    std::future<XRESULT> ImportResult;
+    std::future<void> CacheWriter;
+    std::atomic<bool> Cancelled;
+
+    /** EnableWorldMeshletCulling at Start, the background part must not read the settings */
+    bool BuildMeshlets;
+
+    /** Progress of the current phase */
+    std::atomic<float> PhaseBegin;
+    std::atomic<float> PhaseEnd;
+    std::atomic<size_t> PhaseSteps;
+    std::atomic<size_t> PhaseStepsDone;
+
+    /** Result of the background part, sorted by section and texture */
+    std::vector<SectionMesh> SectionMeshes;
+};
@@ -1170,7 +1170,7 @@ void D2DEditorView::OnDelete() {
 		XMStoreFloat3( &avgPos, (Position0 + Position1 + Position2) / 3.0f );
 
 		INT2 s = WorldConverter::GetSectionOfPos( avgPos );
-		WorldMeshSectionInfo* section = &Engine::GAPI->GetWorldSections()[s.x][s.y];
+		WorldMeshSectionInfo* section = &Engine::GAPI->GetOrCreateWorldSection( s );
 
 		// Remove the texture from rendering
 		Engine::GAPI->SupressTexture( section, Selection.SelectedMaterial->GetTexture()->GetNameWithoutExt() );
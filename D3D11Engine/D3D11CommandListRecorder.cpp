@@ -0,0 +1,170 @@
+#include "pch.h"
+#include "D3D11CommandListRecorder.h"
+
+D3D11CommandListRecorder::D3D11CommandListRecorder() {
+    Immediate = nullptr;
+    State = {};
+    HasState = false;
+}
+
+D3D11CommandListRecorder::~D3D11CommandListRecorder() {
+    End();
+}
+
+/** Creates the deferred contexts */
+XRESULT D3D11CommandListRecorder::Init( ID3D11Device* device, unsigned int numContexts ) {
+    End();
+    Contexts.clear();
+    CommandLists.clear();
+
+    // Without driver support the runtime still records on the calling threads, only executing gets slower
+    D3D11_FEATURE_DATA_THREADING threading = {};
+    device->CheckFeatureSupport( D3D11_FEATURE_THREADING, &threading, sizeof( threading ) );
+    LogInfo() << "Recording draws into " << numContexts << " deferred contexts, driver command lists: " << (threading.DriverCommandLists ? "yes" : "no");
+
+    for ( unsigned int i = 0; i < numContexts; i++ ) {
+        Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+        HRESULT hr = device->CreateDeferredContext( 0, context.GetAddressOf() );
+        if ( FAILED( hr ) ) {
+            LogError() << "Failed to create deferred context: " << hr;
+            Contexts.clear();
+            return XR_FAILED;
+        }
+        Contexts.push_back( context );
+    }
+
+    CommandLists.resize( numContexts );
+    return XR_SUCCESS;
+}
+
+/** Takes the state of the immediate context for all jobs and sets what they record */
+void D3D11CommandListRecorder::Begin( ID3D11DeviceContext* immediate, const RecordFunction& record ) {
+    End();
+
+    Immediate = immediate;
+    CaptureState( Immediate, State );
+    HasState = true;
+    Record = record;
+}
+
+/** Lets go of the state taken by Begin */
+void D3D11CommandListRecorder::End() {
+    if ( HasState ) {
+        ReleaseState( State );
+        HasState = false;
+    }
+
+    Record = nullptr;
+    for ( auto& list : CommandLists ) {
+        list.Reset();
+    }
+}
+
+bool D3D11CommandListRecorder::RecordJob( unsigned int context, unsigned int first, unsigned int count ) {
+    ID3D11DeviceContext* deferred = Contexts[context].Get();
+    ApplyState( deferred, State );
+    Record( deferred, context, first, count );
+
+    // The immediate context gets its state back after executing, so nothing needs to be kept in here
+    HRESULT hr = deferred->FinishCommandList( FALSE, CommandLists[context].ReleaseAndGetAddressOf() );
+    return SUCCEEDED( hr );
+}
+
+void D3D11CommandListRecorder::ExecuteJob( unsigned int context ) {
+    Immediate->ExecuteCommandList( CommandLists[context].Get(), TRUE );
+    CommandLists[context].Reset();
+}
+
+/** Reads the state from the context */
+void D3D11CommandListRecorder::CaptureState( ID3D11DeviceContext* context, ContextState& state ) {
+    context->IAGetInputLayout( &state.InputLayout );
+    context->IAGetPrimitiveTopology( &state.Topology );
+    context->IAGetVertexBuffers( 0, 1, &state.VertexBuffer, &state.VertexStride, &state.VertexOffset );
+    context->IAGetIndexBuffer( &state.IndexBuffer, &state.IndexFormat, &state.IndexOffset );
+
+    context->VSGetShader( &state.VertexShader, nullptr, nullptr );
+    context->HSGetShader( &state.HullShader, nullptr, nullptr );
+    context->DSGetShader( &state.DomainShader, nullptr, nullptr );
+    context->GSGetShader( &state.GeometryShader, nullptr, nullptr );
+    context->PSGetShader( &state.PixelShader, nullptr, nullptr );
+    context->VSGetConstantBuffers( 0, ContextState::NUM_CONSTANT_BUFFERS, state.VSConstantBuffers );
+    context->PSGetConstantBuffers( 0, ContextState::NUM_CONSTANT_BUFFERS, state.PSConstantBuffers );
+    context->VSGetShaderResources( 0, ContextState::NUM_SHADER_RESOURCES, state.VSShaderResources );
+    context->PSGetShaderResources( 0, ContextState::NUM_SHADER_RESOURCES, state.PSShaderResources );
+    context->VSGetSamplers( 0, ContextState::NUM_SAMPLERS, state.VSSamplers );
+    context->PSGetSamplers( 0, ContextState::NUM_SAMPLERS, state.PSSamplers );
+
+    context->RSGetState( &state.RasterizerState );
+    state.NumViewports = D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE;
+    context->RSGetViewports( &state.NumViewports, state.Viewports );
+    state.NumScissorRects = D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE;
+    context->RSGetScissorRects( &state.NumScissorRects, state.ScissorRects );
+
+    context->OMGetBlendState( &state.BlendState, state.BlendFactor, &state.SampleMask );
+    context->OMGetDepthStencilState( &state.DepthStencilState, &state.StencilRef );
+    context->OMGetRenderTargets( D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, state.RenderTargets, &state.DepthStencil );
+}
+
+void D3D11CommandListRecorder::ApplyState( ID3D11DeviceContext* context, const ContextState& state ) {
+    context->IASetInputLayout( state.InputLayout );
+    context->IASetPrimitiveTopology( state.Topology );
+    context->IASetVertexBuffers( 0, 1, &state.VertexBuffer, &state.VertexStride, &state.VertexOffset );
+    context->IASetIndexBuffer( state.IndexBuffer, state.IndexFormat, state.IndexOffset );
+
+    context->VSSetShader( state.VertexShader, nullptr, 0 );
+    context->HSSetShader( state.HullShader, nullptr, 0 );
+    context->DSSetShader( state.DomainShader, nullptr, 0 );
+    context->GSSetShader( state.GeometryShader, nullptr, 0 );
+    context->PSSetShader( state.PixelShader, nullptr, 0 );
+    context->VSSetConstantBuffers( 0, ContextState::NUM_CONSTANT_BUFFERS, state.VSConstantBuffers );
+    context->PSSetConstantBuffers( 0, ContextState::NUM_CONSTANT_BUFFERS, state.PSConstantBuffers );
+    context->VSSetShaderResources( 0, ContextState::NUM_SHADER_RESOURCES, state.VSShaderResources );
+    context->PSSetShaderResources( 0, ContextState::NUM_SHADER_RESOURCES, state.PSShaderResources );
+    context->VSSetSamplers( 0, ContextState::NUM_SAMPLERS, state.VSSamplers );
+    context->PSSetSamplers( 0, ContextState::NUM_SAMPLERS, state.PSSamplers );
+
+    context->RSSetState( state.RasterizerState );
+    context->RSSetViewports( state.NumViewports, state.Viewports );
+    context->RSSetScissorRects( state.NumScissorRects, state.ScissorRects );
+
+    context->OMSetBlendState( state.BlendState, state.BlendFactor, state.SampleMask );
+    context->OMSetDepthStencilState( state.DepthStencilState, state.StencilRef );
+    context->OMSetRenderTargets( D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, state.RenderTargets, state.DepthStencil );
+}
+
+void D3D11CommandListRecorder::ReleaseState( ContextState& state ) {
+    auto release = []( auto*& object ) {
+        if ( object ) {
+            object->Release();
+            object = nullptr;
+        }
+    };
+
+    release( state.InputLayout );
+    release( state.VertexBuffer );
+    release( state.IndexBuffer );
+    release( state.VertexShader );
+    release( state.HullShader );
+    release( state.DomainShader );
+    release( state.GeometryShader );
+    release( state.PixelShader );
+    for ( unsigned int i = 0; i < ContextState::NUM_CONSTANT_BUFFERS; i++ ) {
+        release( state.VSConstantBuffers[i] );
+        release( state.PSConstantBuffers[i] );
+    }
+    for ( unsigned int i = 0; i < ContextState::NUM_SHADER_RESOURCES; i++ ) {
+        release( state.VSShaderResources[i] );
+        release( state.PSShaderResources[i] );
+    }
+    for ( unsigned int i = 0; i < ContextState::NUM_SAMPLERS; i++ ) {
+        release( state.VSSamplers[i] );
+        release( state.PSSamplers[i] );
+    }
+    release( state.RasterizerState );
+    release( state.BlendState );
+    release( state.DepthStencilState );
+    for ( unsigned int i = 0; i < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT; i++ ) {
+        release( state.RenderTargets[i] );
+    }
+    release( state.DepthStencil );
+}
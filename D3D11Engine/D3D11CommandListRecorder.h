@@ -0,0 +1,84 @@
+#pragma once
+#include "pch.h"
+#include "CommandListScheduler.h"
+
+/** Records jobs of a CommandListScheduler into deferred contexts. Deferred contexts start out without any state,
+    so every job first gets the state the immediate context had when Begin was called. */
+class D3D11CommandListRecorder : public BaseCommandListBackend {
+public:
+    /** Records the items [first, first + count) into the context, which is the contextIndex-th one */
+    typedef std::function<void( ID3D11DeviceContext* context, unsigned int contextIndex, unsigned int first, unsigned int count )> RecordFunction;
+
+    D3D11CommandListRecorder();
+    ~D3D11CommandListRecorder();
+
+    /** Creates the deferred contexts */
+    XRESULT Init( ID3D11Device* device, unsigned int numContexts );
+
+    /** Takes the state of the immediate context for all jobs and sets what they record */
+    void Begin( ID3D11DeviceContext* immediate, const RecordFunction& record );
+
+    /** Lets go of the state taken by Begin */
+    void End();
+
+    /** BaseCommandListBackend */
+    unsigned int GetNumContexts() override { return static_cast<unsigned int>(Contexts.size()); }
+    bool RecordJob( unsigned int context, unsigned int first, unsigned int count ) override;
+    void ExecuteJob( unsigned int context ) override;
+
+private:
+    /** Pipeline state as far as the opaque passes use it */
+    struct ContextState {
+        static const unsigned int NUM_CONSTANT_BUFFERS = D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT;
+        static const unsigned int NUM_SHADER_RESOURCES = 16;
+        static const unsigned int NUM_SAMPLERS = D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT;
+
+        ID3D11InputLayout* InputLayout;
+        D3D11_PRIMITIVE_TOPOLOGY Topology;
+        ID3D11Buffer* VertexBuffer;
+        UINT VertexStride;
+        UINT VertexOffset;
+        ID3D11Buffer* IndexBuffer;
+        DXGI_FORMAT IndexFormat;
+        UINT IndexOffset;
+
+        ID3D11VertexShader* VertexShader;
+        ID3D11HullShader* HullShader;
+        ID3D11DomainShader* DomainShader;
+        ID3D11GeometryShader* GeometryShader;
+        ID3D11PixelShader* PixelShader;
+        ID3D11Buffer* VSConstantBuffers[NUM_CONSTANT_BUFFERS];
+        ID3D11Buffer* PSConstantBuffers[NUM_CONSTANT_BUFFERS];
+        ID3D11ShaderResourceView* VSShaderResources[NUM_SHADER_RESOURCES];
+        ID3D11ShaderResourceView* PSShaderResources[NUM_SHADER_RESOURCES];
+        ID3D11SamplerState* VSSamplers[NUM_SAMPLERS];
+        ID3D11SamplerState* PSSamplers[NUM_SAMPLERS];
+
+        ID3D11RasterizerState* RasterizerState;
+        D3D11_VIEWPORT Viewports[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+        UINT NumViewports;
+        D3D11_RECT ScissorRects[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+        UINT NumScissorRects;
+
+        ID3D11BlendState* BlendState;
+        FLOAT BlendFactor[4];
+        UINT SampleMask;
+        ID3D11DepthStencilState* DepthStencilState;
+        UINT StencilRef;
+        ID3D11RenderTargetView* RenderTargets[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
+        ID3D11DepthStencilView* DepthStencil;
+    };
+
+    /** Reads the state from the context, everything in there holds a reference until ReleaseState */
+    static void CaptureState( ID3D11DeviceContext* context, ContextState& state );
+    static void ApplyState( ID3D11DeviceContext* context, const ContextState& state );
+    static void ReleaseState( ContextState& state );
+
+    std::vector<Microsoft::WRL::ComPtr<ID3D11DeviceContext>> Contexts;
+    std::vector<Microsoft::WRL::ComPtr<ID3D11CommandList>> CommandLists;
+
+    ID3D11DeviceContext* Immediate;
+    ContextState State;
+    bool HasState;
+    RecordFunction Record;
+};
@@ -10,6 +10,9 @@
 #include "D3D11HDShader.h"
 #include "D3D11LineRenderer.h"
 #include "D3D11OcclusionQuerry.h"
+#include "D3D11RenderQueueBackend.h"
+#include "D3D11CommandListRecorder.h"
+#include "ParallelFor.h"
 #include "D3D11PShader.h"
 #include "D3D11PfxRenderer.h"
 #include "D3D11PipelineStates.h"
@@ -48,6 +51,8 @@
 
 #include "ImGuiShim.h"
 #include "zCModel.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
 
 namespace wrl = Microsoft::WRL;
 
@@ -57,6 +62,9 @@ const float DEFAULT_NORMALMAP_STRENGTH = 0.10f;
 const float DEFAULT_FAR_PLANE = 50000.0f;
 const XMFLOAT4 UNDERWATER_COLOR_MOD = XMFLOAT4( 0.5f, 0.7f, 1.0f, 1.0f );
 
+/** Largest error in pixels a vob LOD may show on screen */
+const float VOB_LOD_MAX_PIXEL_ERROR = 1.0f;
+
 static const GUID IID_IDXGIVkInteropAdapter = { 0x3A6D8F2C, 0xB0E8, 0x4AB4, { 0xB4, 0xDC, 0x4F, 0xD2, 0x48, 0x91, 0xBF, 0xA5 } };
 static const GUID IID_IDXGIDeviceRenderDoc = { 0xa7aa6116, 0x9c8d, 0x4bba, { 0x90, 0x83, 0xb4, 0xd8, 0x16, 0xb7, 0x1b, 0x78 } };
 
@@ -86,6 +94,53 @@ static std::unique_ptr<D3D11AGS> agsDevice;
 
 extern bool userHaveAMDGPU;
 
+/** Returns the distance to the closest instance, divided by its scale so it can be compared to object space errors.
+    The inverse of that is how large the visual is on screen, so this also picks the instance which decides the LOD. */
+static float GetClosestInstanceDistance( const std::vector<VobInstanceLodInfo>& instances, FXMVECTOR cameraPosition ) {
+    static_assert(sizeof( VobInstanceLodInfo ) == sizeof( XMFLOAT4 ), "VobInstanceLodInfo has to load as one vector");
+
+    // Four instances at once, transposed so every lane is one instance
+    const XMVECTOR camX = XMVectorSplatX( cameraPosition );
+    const XMVECTOR camY = XMVectorSplatY( cameraPosition );
+    const XMVECTOR camZ = XMVectorSplatZ( cameraPosition );
+    XMVECTOR closestSq = XMVectorReplicate( FLT_MAX );
+    size_t i = 0;
+    for ( ; i + 4 <= instances.size(); i += 4 ) {
+        const XMMATRIX lanes = XMMatrixTranspose( XMMATRIX(
+            XMLoadFloat4( reinterpret_cast<const XMFLOAT4*>(&instances[i]) ),
+            XMLoadFloat4( reinterpret_cast<const XMFLOAT4*>(&instances[i + 1]) ),
+            XMLoadFloat4( reinterpret_cast<const XMFLOAT4*>(&instances[i + 2]) ),
+            XMLoadFloat4( reinterpret_cast<const XMFLOAT4*>(&instances[i + 3]) ) ) );
+
+        const XMVECTOR dx = lanes.r[0] - camX;
+        const XMVECTOR dy = lanes.r[1] - camY;
+        const XMVECTOR dz = lanes.r[2] - camZ;
+        closestSq = XMVectorMin( closestSq, (dx * dx + dy * dy + dz * dz) * lanes.r[3] );
+    }
+
+    XMFLOAT4 lanesClosestSq;
+    XMStoreFloat4( &lanesClosestSq, closestSq );
+    float closest = std::min( { lanesClosestSq.x, lanesClosestSq.y, lanesClosestSq.z, lanesClosestSq.w } );
+    for ( ; i < instances.size(); i++ ) {
+        float distanceSq;
+        XMStoreFloat( &distanceSq, XMVector3LengthSq( XMLoadFloat3( &instances[i].Position ) - cameraPosition ) );
+        closest = std::min( closest, distanceSq * instances[i].InvScaleSq );
+    }
+    return sqrtf( closest );
+}
+
+/** Returns the LOD of the mesh to draw at the given distance */
+static MeshInfo* SelectVobLod( MeshInfo* mesh, float distance, float pixelsPerUnit ) {
+    float errors[8];
+    size_t numLevels = std::min( mesh->LodLevels.size(), _countof( errors ) );
+    for ( size_t i = 0; i < numLevels; i++ ) {
+        errors[i] = mesh->LodLevels[i].Error;
+    }
+
+    int level = MeshSimplifier::SelectLod( errors, numLevels, distance, pixelsPerUnit, VOB_LOD_MAX_PIXEL_ERROR );
+    return level == 0 ? mesh : mesh->LodLevels[level - 1].Mesh;
+}
+
 D3D11GraphicsEngine::D3D11GraphicsEngine() {
     DebugPointlight = nullptr;
     OutputWindow = nullptr;
@@ -98,8 +153,10 @@ D3D11GraphicsEngine::D3D11GraphicsEngine() {
     RenderingStage = DES_MAIN;
     PresentPending = false;
     SaveScreenshotNextFrame = false;
+    WorldMeshDrawsCompact = false;
     LineRenderer = std::make_unique<D3D11LineRenderer>();
     Occlusion = std::make_unique<D3D11OcclusionQuerry>();
+    WorldMeshQueueBackends.push_back( std::make_unique<D3D11RenderQueueBackend>( this ) );
 
     m_FrameLimiter = std::make_unique<FpsLimiter>();
     m_LastFrameLimit = 0;
@@ -2335,6 +2392,7 @@ XRESULT D3D11GraphicsEngine::SetActivePixelShader( const std::string& shader ) {
 
 XRESULT D3D11GraphicsEngine::SetActiveVertexShader( const std::string& shader ) {
     ActiveVS = ShaderManager->GetVShader( shader );
+    ActiveVSName = shader;
 
     return XR_SUCCESS;
 }
@@ -2779,6 +2837,51 @@ void D3D11GraphicsEngine::SetupVS_ExPerInstanceConstantBuffer() {
     ActiveVS->GetConstantBuffer()[1]->BindToVertexShader( 1 );
 }
 
+/** Binds the buffers of the wrapped world mesh */
+void D3D11GraphicsEngine::BeginWorldMeshDraws() {
+    // Only some shaders have a variant reading compact vertices, the others get the world with full ones
+    const WorldInfo* world = Engine::GAPI->GetLoadedWorldInfo();
+    const std::string compactVSName = ActiveVSName + "Compact";
+    WorldMeshDrawsCompact = world->CompactVertices && ShaderManager->GetVShader( compactVSName ) != nullptr;
+
+    MeshInfo* meshInfo = GetWorldMeshDrawGeometry();
+
+    UINT offset = 0;
+    UINT stride = GetWorldMeshVertexStride();
+    GetContext()->IASetVertexBuffers( 0, 1, meshInfo->MeshVertexBuffer->GetVertexBuffer().GetAddressOf(), &stride, &offset );
+    GetContext()->IASetIndexBuffer( meshInfo->MeshIndexBuffer->GetVertexBuffer().Get(), DXGI_FORMAT_R32_UINT, 0 );
+
+    if ( !WorldMeshDrawsCompact )
+        return;
+
+    // The constant buffers bound so far stay, only the grid of the positions is new
+    VertexShaderBeforeWorldMesh = ActiveVSName;
+    SetActiveVertexShader( compactVSName );
+    ActiveVS->Apply();
+    ActiveVS->GetConstantBuffer()[2]->UpdateBuffer( &world->CompactQuantization );
+    ActiveVS->GetConstantBuffer()[2]->BindToVertexShader( 2 );
+}
+
+/** Switches back to the vertex shader BeginWorldMeshDraws replaced */
+void D3D11GraphicsEngine::EndWorldMeshDraws() {
+    if ( !WorldMeshDrawsCompact )
+        return;
+
+    WorldMeshDrawsCompact = false;
+    SetActiveVertexShader( VertexShaderBeforeWorldMesh );
+    ActiveVS->Apply();
+}
+
+/** Wrapped world mesh BeginWorldMeshDraws bound */
+MeshInfo* D3D11GraphicsEngine::GetWorldMeshDrawGeometry() const {
+    return WorldMeshDrawsCompact ? Engine::GAPI->GetWrappedWorldMesh() : Engine::GAPI->GetFullWrappedWorldMesh();
+}
+
+/** Size of a vertex in the vertex buffers of the world mesh BeginWorldMeshDraws bound */
+unsigned int D3D11GraphicsEngine::GetWorldMeshVertexStride() const {
+    return WorldMeshDrawsCompact ? sizeof( ExVertexStructCompact ) : sizeof( ExVertexStruct );
+}
+
 /** Puts the current world matrix into a CB and binds it to the given slot */
 void D3D11GraphicsEngine::SetupPerInstanceConstantBuffer( int slot ) {
     auto world = Engine::GAPI->GetRendererState().TransformState.TransformWorld;
@@ -2883,9 +2986,7 @@ XRESULT D3D11GraphicsEngine::DrawMeshInfoListAlphablended(
     InfiniteRangeConstantBuffer->BindToPixelShader( 3 );
 
     // Bind wrapped mesh vertex buffers
-    DrawVertexBufferIndexedUINT(
-        Engine::GAPI->GetWrappedWorldMesh()->MeshVertexBuffer,
-        Engine::GAPI->GetWrappedWorldMesh()->MeshIndexBuffer, 0, 0 );
+    BeginWorldMeshDraws();
 
     int lastAlphaFunc = 0;
 
@@ -2963,6 +3064,7 @@ XRESULT D3D11GraphicsEngine::DrawMeshInfoListAlphablended(
         }
     }
 
+    EndWorldMeshDraws();
     return XR_SUCCESS;
 }
 
@@ -3010,8 +3112,7 @@ XRESULT D3D11GraphicsEngine::DrawWorldMesh_Indirect( bool noTextures ) {
     static std::vector<WorldMeshSectionInfo*> renderList; renderList.clear();
     Engine::GAPI->CollectVisibleSections( renderList );
 
-    MeshInfo* meshInfo = Engine::GAPI->GetWrappedWorldMesh();
-    DrawVertexBufferIndexedUINT( meshInfo->MeshVertexBuffer, meshInfo->MeshIndexBuffer, 0, 0 );
+    BeginWorldMeshDraws();
 
     auto& context = GetContext();
     context->IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
@@ -3217,6 +3318,8 @@ XRESULT D3D11GraphicsEngine::DrawWorldMesh_Indirect( bool noTextures ) {
         }
     }
 
+    EndWorldMeshDraws();
+
     UpdateOcclusion();
     return XR_SUCCESS;
 }
@@ -3237,6 +3340,7 @@ XRESULT D3D11GraphicsEngine::DrawWorldMesh( bool noTextures ) {
 
     SetupVS_ExMeshDrawCall();
     SetupVS_ExConstantBuffer();
+    BeginWorldMeshDraws();
 
     // Bind reflection-cube to slot 4
     GetContext()->PSSetShaderResources( 4, 1, ReflectionCube.GetAddressOf() );
@@ -3258,17 +3362,40 @@ XRESULT D3D11GraphicsEngine::DrawWorldMesh( bool noTextures ) {
     static std::vector<WorldMeshSectionInfo*> renderList; renderList.clear();
     Engine::GAPI->CollectVisibleSections( renderList );
 
-    MeshInfo* meshInfo = Engine::GAPI->GetWrappedWorldMesh();
-    DrawVertexBufferIndexedUINT( meshInfo->MeshVertexBuffer, meshInfo->MeshIndexBuffer, 0, 0 );
-
-    static std::vector<std::pair<MeshKey, WorldMeshInfo*>> meshList;
-    auto CompareMesh = []( std::pair<MeshKey, WorldMeshInfo*>& a, std::pair<MeshKey, WorldMeshInfo*>& b ) -> bool { return a.first.Texture < b.first.Texture; };
+    MeshInfo* meshInfo = GetWorldMeshDrawGeometry();
 
     GetContext()->IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
     GetContext()->DSSetShader( nullptr, nullptr, 0 );
     GetContext()->HSSetShader( nullptr, nullptr, 0 );
 
+    // Visible meshlets are collected once per mesh and used by both the z-prepass and the color pass
+    const bool meshletCulling = Engine::GAPI->GetRendererState().RendererSettings.EnableWorldMeshletCulling;
+    const bool zPrepass = Engine::GAPI->GetRendererState().RendererSettings.DoZPrepass;
+    const XMFLOAT3 cameraPosition = Engine::GAPI->GetCameraPosition();
+    static std::vector<MeshletRange> meshletRanges;
+
+    WorldMeshQueue.Clear();
+
+    // One packet per draw, the queue sorts them by shader and texture and the z-prepass front to back
+    auto AddWorldMeshDraws = [&]( RenderPacket packet, WorldMeshInfo* mesh, bool culled ) {
+        if ( !culled ) {
+            packet.NumIndices = static_cast<unsigned int>(mesh->Indices.size());
+            packet.FirstIndex = mesh->BaseIndexLocation;
+            WorldMeshQueue.Add( packet );
+            return;
+        }
+
+        for ( const MeshletRange& range : meshletRanges ) {
+            packet.NumIndices = range.NumIndices;
+            packet.FirstIndex = mesh->BaseIndexLocation + range.FirstIndex;
+            WorldMeshQueue.Add( packet );
+        }
+    };
+
     for ( auto const& renderItem : renderList ) {
+        const zTBBox3D& sectionBox = renderItem->BoundingBox;
+        const float sectionDistance = XMVectorGetX( XMVector3Length( (XMLoadFloat3( &sectionBox.Min ) + XMLoadFloat3( &sectionBox.Max )) * 0.5f - XMLoadFloat3( &cameraPosition ) ) );
+
         for ( auto const& worldMesh : renderItem->WorldMeshes ) {
             if ( worldMesh.first.Material ) {
                 zCTexture* aniTex = worldMesh.first.Material->GetTexture();
@@ -3284,13 +3411,6 @@ XRESULT D3D11GraphicsEngine::DrawWorldMesh( bool noTextures ) {
                     continue;
                 }
 
-                // Check if the animated texture and the registered textures are the
-                // same
-                MeshKey key = worldMesh.first;
-                if ( worldMesh.first.Texture != aniTex ) {
-                    key.Texture = aniTex;
-                }
-
                 if ( worldMesh.first.Info->MaterialType == MaterialInfo::MT_Portal ) {
                     FrameTransparencyMeshesPortal.push_back( worldMesh );
                     continue;
@@ -3304,93 +3424,89 @@ XRESULT D3D11GraphicsEngine::DrawWorldMesh( bool noTextures ) {
                     worldMesh.first.Material->GetAlphaFunc() != zMAT_ALPHA_FUNC_TEST ) {
                     FrameTransparencyMeshes.push_back( worldMesh );
                 } else {
-                    // Create a new pair using the animated texture
-                    meshList.emplace_back( key, worldMesh.second );
-                    std::push_heap( meshList.begin(), meshList.end(), CompareMesh );
-                }
-            }
-        }
-    }
-
-    // Draw depth only
-    if ( Engine::GAPI->GetRendererState().RendererSettings.DoZPrepass ) {
-        GetContext()->PSSetShader( nullptr, nullptr, 0 );
-
-        for ( auto const& mesh : meshList ) {
-            zCTexture* texture;
-            if ( ( texture = mesh.first.Texture ) == nullptr ) continue;
+                    bool culled = false;
+                    if ( meshletCulling && !worldMesh.second->Meshlets.empty() ) {
+                        // The world is drawn without backface culling, so only the frustum is checked
+                        meshletRanges.clear();
+                        MeshletBuilder::CullMeshlets( worldMesh.second->Meshlets, cameraPosition, false, []( const zTBBox3D& box ) {
+                            int flags = 15; // Frustum check, no farplane
+                            return zCCamera::GetCamera()->BBox3DInFrustum( box, flags ) != ZTCAM_CLIPTYPE_OUT;
+                        }, meshletRanges );
+
+                        if ( meshletRanges.empty() ) {
+                            continue;
+                        }
+                        culled = true;
+                    }
 
-            if ( texture->HasAlphaChannel() )
-                continue;  // Don't pre-render stuff with alpha channel
+                    RenderPacket packet = {};
+                    packet.Geometry = meshInfo;
+                    packet.Depth = sectionDistance;
 
-            if ( mesh.first.Info->MaterialType == MaterialInfo::MT_Water )
-                continue;  // Don't pre-render water
+                    // Draw depth only, but not stuff with alpha channel
+                    if ( zPrepass && !aniTex->HasAlphaChannel() ) {
+                        packet.Pass = D3D11RenderQueueBackend::PASS_DEPTH;
+                        AddWorldMeshDraws( packet, worldMesh.second, culled );
+                    }
 
-            DrawVertexBufferIndexedUINT( nullptr, nullptr, mesh.second->Indices.size(), mesh.second->BaseIndexLocation );
+                    // The animated texture is bound instead of the registered one
+                    packet.Pass = D3D11RenderQueueBackend::PASS_COLOR;
+                    packet.Shader = GetShaderForTexture( aniTex, false, worldMesh.first.Material->GetAlphaFunc() ).get();
+                    packet.Material = aniTex;
+                    packet.Data = &worldMesh.first;
+                    AddWorldMeshDraws( packet, worldMesh.second, culled );
+                }
+            }
         }
     }
 
-    SetActivePixelShader( "PS_Diffuse" );
-    ActivePS->Apply();
-
-    // Now draw the actual pixels
-    zCTexture* bound = nullptr;
-    MaterialInfo* boundInfo = nullptr;
-    while ( !meshList.empty() ) {
-        auto const& mesh = meshList.front();
-
-        int indicesNumMod = 1;
-        if ( mesh.first.Texture != bound &&
-            Engine::GAPI->GetRendererState().RendererSettings.DrawWorldMesh > 1 ) {
-            MyDirectDrawSurface7* surface = mesh.first.Texture->GetSurface();
-            ID3D11ShaderResourceView* srv[3];
-            MaterialInfo* info = mesh.first.Info;
-
-            // Get diffuse and normalmap
-            srv[0] = surface->GetEngineTexture()->GetShaderResourceView().Get();
-            srv[1] = surface->GetNormalmap()
-                ? surface->GetNormalmap()->GetShaderResourceView().Get()
-                : nullptr;
-            srv[2] = surface->GetFxMap()
-                ? surface->GetFxMap()->GetShaderResourceView().Get()
-                : nullptr;
-
-            // Bind a default normalmap in case the scene is wet and we currently have
-            // none
-            if ( !srv[1] ) {
-                // Modify the strength of that default normalmap for the material info
-                if ( info && info->buffer.NormalmapStrength != DEFAULT_NORMALMAP_STRENGTH ) {
-                    info->buffer.NormalmapStrength = DEFAULT_NORMALMAP_STRENGTH;
-                    info->UpdateConstantbuffer();
-                }
-                srv[1] = DistortionTexture->GetShaderResourceView().Get();
-            }
+    WorldMeshQueue.Sort();
 
-            // Bind both
-            GetContext()->PSSetShaderResources( 0, 3, srv );
+    // Material infos are updated on the immediate context, so before any recording job binds them
+    RenderQueueStats prepareStats = {};
+    D3D11RenderQueuePrepareBackend prepareBackend( this );
+    WorldMeshQueue.Replay( prepareBackend, 0, WorldMeshQueue.GetNumPackets(), prepareStats );
 
-            // Get the right shader for it
-            BindShaderForTexture( mesh.first.Texture, false,
-                mesh.first.Material->GetAlphaFunc() );
+    SetActivePixelShader( "PS_Diffuse" );
+    D3D11PShader* colorPassShader = ActivePS.get();
 
-            if ( info ) {
-                if ( !info->Constantbuffer ) info->UpdateConstantbuffer();
+    // Large queues are cut into jobs recorded on the worker threads, each with its own backend and stats
+    static std::vector<RenderQueueStats> jobStats;
+    bool recorded = false;
+    D3D11CommandListRecorder* recorder = WorldMeshQueue.GetNumPackets() >= 2 * CommandListScheduler::MIN_ITEMS_PER_JOB
+        ? GetCommandListRecorder() : nullptr;
+    if ( recorder ) {
+        while ( WorldMeshQueueBackends.size() < recorder->GetNumContexts() ) {
+            WorldMeshQueueBackends.push_back( std::make_unique<D3D11RenderQueueBackend>( this ) );
+        }
 
-                info->Constantbuffer->BindToPixelShader( 2 );
+        jobStats.assign( recorder->GetNumContexts(), RenderQueueStats() );
+        recorder->Begin( GetContext().Get(), [&]( ID3D11DeviceContext* context, unsigned int contextIndex, unsigned int first, unsigned int count ) {
+            WorldMeshQueueBackends[contextIndex]->Begin( context, colorPassShader );
+            WorldMeshQueue.Replay( *WorldMeshQueueBackends[contextIndex], first, count, jobStats[contextIndex] );
+        } );
+        recorded = CommandListJobs.Run( *recorder, WorldMeshQueue.GetNumPackets() );
+        recorder->End();
+    }
 
-                // Don't let the game unload the texture after some time
-                //mesh.first.Texture->CacheIn( 0.6f );
-                boundInfo = info;
-            }
-            bound = mesh.first.Texture;
-        }
+    if ( !recorded ) {
+        jobStats.assign( 1, RenderQueueStats() );
+        WorldMeshQueueBackends[0]->Begin( GetContext().Get(), colorPassShader );
+        WorldMeshQueue.Replay( *WorldMeshQueueBackends[0], 0, WorldMeshQueue.GetNumPackets(), jobStats[0] );
+    }
 
-        if ( Engine::GAPI->GetRendererState().RendererSettings.DrawWorldMesh > 2 ) {
-            DrawVertexBufferIndexedUINT( nullptr, nullptr, mesh.second->Indices.size(), mesh.second->BaseIndexLocation );
-        }
+    // The packets bound their shaders without going through ActivePS
+    ActivePS->Apply();
+    EndWorldMeshDraws();
 
-        std::pop_heap( meshList.begin(), meshList.end(), CompareMesh );
-        meshList.pop_back();
+    GothicRendererInfo& info = Engine::GAPI->GetRendererState().RendererInfo;
+    info.FrameWorldMeshPackets = WorldMeshQueue.GetNumPackets();
+    info.FrameWorldMeshMaterialChanges = 0;
+    info.FrameWorldMeshJobs = recorded ? CommandListJobs.GetStats().Jobs : 0;
+    const size_t numJobs = recorded ? CommandListJobs.GetJobs().size() : 1;
+    for ( size_t job = 0; job < numJobs; job++ ) {
+        info.FrameWorldMeshMaterialChanges += jobStats[job].MaterialChanges;
+        info.FrameDrawnTriangles += WorldMeshQueueBackends[job]->GetDrawnTriangles();
     }
 
     UpdateOcclusion();
@@ -3436,9 +3552,7 @@ void D3D11GraphicsEngine::DrawWaterSurfaces() {
         DepthStencilBuffer->GetDepthStencilView().Get() );
 
     // Bind wrapped mesh vertex buffers
-    DrawVertexBufferIndexedUINT(
-        Engine::GAPI->GetWrappedWorldMesh()->MeshVertexBuffer,
-        Engine::GAPI->GetWrappedWorldMesh()->MeshIndexBuffer, 0, 0 );
+    BeginWorldMeshDraws();
     for ( const auto& [texture, meshes] : FrameWaterSurfaces ) {
         // Draw surfaces
         for ( const auto& mesh : meshes ) {
@@ -3496,6 +3610,8 @@ void D3D11GraphicsEngine::DrawWaterSurfaces() {
         }
     }
 
+    EndWorldMeshDraws();
+
     GetContext()->OMSetRenderTargets( 1, HDRBackBuffer->GetRenderTargetView().GetAddressOf(),
         DepthStencilBuffer->GetDepthStencilView().Get() );
 }
@@ -3573,8 +3689,7 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAround(
     auto rangeSquared = range * range;
     if ( Engine::GAPI->GetRendererState().RendererSettings.DrawWorldMesh ) {
         // Bind wrapped mesh vertex buffers
-        DrawVertexBufferIndexedUINT( Engine::GAPI->GetWrappedWorldMesh()->MeshVertexBuffer,
-            Engine::GAPI->GetWrappedWorldMesh()->MeshIndexBuffer, 0, 0 );
+        BeginWorldMeshDraws();
 
         ActiveVS->GetConstantBuffer()[1]->UpdateBuffer( &XMMatrixIdentity() );
         ActiveVS->GetConstantBuffer()[1]->BindToVertexShader( 1 );
@@ -3615,56 +3730,56 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAround(
                     meshInfoByKey->second->Indices.size(), meshInfoByKey->second->BaseIndexLocation );
             }
         } else {
-            for ( auto&& itx : Engine::GAPI->GetWorldSections() ) {
-                for ( auto&& ity : itx.second ) {
-                    float vLen; XMStoreFloat( &vLen, XMVector3Length( XMVectorSet( static_cast<float>(itx.first - s.x), static_cast<float>(ity.first - s.y), 0, 0 ) ) );
-
-                    if ( vLen < 2 ) {
-                        WorldMeshSectionInfo& section = ity.second;
-                        drawnSections.emplace_back( &section );
-
-                        if ( Engine::GAPI->GetRendererState().RendererSettings.FastShadows ) {
-                            // Draw world mesh
-                            if ( section.FullStaticMesh )
-                                Engine::GAPI->DrawMeshInfo( nullptr, section.FullStaticMesh );
-                        } else {
-                            for ( auto&& meshInfoByKey = section.WorldMeshes.begin();
-                                meshInfoByKey != section.WorldMeshes.end(); ++meshInfoByKey ) {
-                                // Check surface type
-                                if ( meshInfoByKey->first.Info->MaterialType != MaterialInfo::MT_None ) {
-                                    continue;
-                                }
+            // The full meshes of the sections are always ExVertexStruct
+            if ( Engine::GAPI->GetRendererState().RendererSettings.FastShadows ) {
+                EndWorldMeshDraws();
+            }
 
-                                // Bind texture
-                                if ( meshInfoByKey->first.Material && meshInfoByKey->first.Material->GetTexture() ) {
-                                    if ( meshInfoByKey->first.Material->GetTexture()->HasAlphaChannel() ||
-                                        colorWritesEnabled ) {
-                                        if ( alphaRef > 0.0f &&
-                                            meshInfoByKey->first.Material->GetTexture()->CacheIn( 0.6f ) ==
-                                            zRES_CACHED_IN ) {
-                                            meshInfoByKey->first.Material->GetTexture()->Bind( 0 );
-                                            ActivePS->Apply();
-                                        } else
-                                            continue;  // Don't render if not loaded
-                                    } else {
-                                        if ( !linearDepth )  // Only unbind when not rendering linear
-                                                           // depth
-                                        {
-                                            // Unbind PS
-                                            Context->PSSetShader( nullptr, nullptr, 0 );
-                                        }
-                                    }
-                                }
+            Engine::GAPI->GetWorldSectionGrid().ForEachAround( s, 1, [&]( const INT2&, WorldMeshSectionInfo& section ) {
+                drawnSections.emplace_back( &section );
 
-                                // Draw from wrapped mesh
-                                DrawVertexBufferIndexedUINT( nullptr, nullptr,
-                                    meshInfoByKey->second->Indices.size(), meshInfoByKey->second->BaseIndexLocation );
+                if ( Engine::GAPI->GetRendererState().RendererSettings.FastShadows ) {
+                    // Draw world mesh
+                    if ( section.FullStaticMesh )
+                        Engine::GAPI->DrawMeshInfo( nullptr, section.FullStaticMesh );
+                } else {
+                    for ( auto&& meshInfoByKey = section.WorldMeshes.begin();
+                        meshInfoByKey != section.WorldMeshes.end(); ++meshInfoByKey ) {
+                        // Check surface type
+                        if ( meshInfoByKey->first.Info->MaterialType != MaterialInfo::MT_None ) {
+                            continue;
+                        }
+
+                        // Bind texture
+                        if ( meshInfoByKey->first.Material && meshInfoByKey->first.Material->GetTexture() ) {
+                            if ( meshInfoByKey->first.Material->GetTexture()->HasAlphaChannel() ||
+                                colorWritesEnabled ) {
+                                if ( alphaRef > 0.0f &&
+                                    meshInfoByKey->first.Material->GetTexture()->CacheIn( 0.6f ) ==
+                                    zRES_CACHED_IN ) {
+                                    meshInfoByKey->first.Material->GetTexture()->Bind( 0 );
+                                    ActivePS->Apply();
+                                } else
+                                    continue;  // Don't render if not loaded
+                            } else {
+                                if ( !linearDepth )  // Only unbind when not rendering linear
+                                                   // depth
+                                {
+                                    // Unbind PS
+                                    Context->PSSetShader( nullptr, nullptr, 0 );
+                                }
                             }
                         }
+
+                        // Draw from wrapped mesh
+                        DrawVertexBufferIndexedUINT( nullptr, nullptr,
+                            meshInfoByKey->second->Indices.size(), meshInfoByKey->second->BaseIndexLocation );
                     }
                 }
-            }
+            } );
         }
+
+        EndWorldMeshDraws();
     }
     
     if ( Engine::GAPI->GetRendererState().RendererSettings.DrawVOBs ) {
@@ -3887,8 +4002,7 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAround_Layered(
 
     if ( Engine::GAPI->GetRendererState().RendererSettings.DrawWorldMesh ) {
         // Bind wrapped mesh vertex buffers
-        DrawVertexBufferInstancedIndexedUINT( Engine::GAPI->GetWrappedWorldMesh()->MeshVertexBuffer,
-            Engine::GAPI->GetWrappedWorldMesh()->MeshIndexBuffer, 0, 0, 0 );
+        BeginWorldMeshDraws();
 
         ActiveVS->GetConstantBuffer()[1]->UpdateBuffer( &XMMatrixIdentity() );
         ActiveVS->GetConstantBuffer()[1]->BindToVertexShader( 1 );
@@ -3929,56 +4043,56 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAround_Layered(
                     meshInfoByKey->second->Indices.size(), 6, meshInfoByKey->second->BaseIndexLocation );
             }
         } else {
-            for ( auto&& itx : Engine::GAPI->GetWorldSections() ) {
-                for ( auto&& ity : itx.second ) {
-                    float vLen; XMStoreFloat( &vLen, XMVector3Length( XMVectorSet( static_cast<float>(itx.first - s.x), static_cast<float>(ity.first - s.y), 0, 0 ) ) );
-
-                    if ( vLen < 2 ) {
-                        WorldMeshSectionInfo& section = ity.second;
-                        drawnSections.emplace_back( &section );
-
-                        if ( Engine::GAPI->GetRendererState().RendererSettings.FastShadows ) {
-                            // Draw world mesh
-                            if ( section.FullStaticMesh )
-                                Engine::GAPI->DrawMeshInfo( nullptr, section.FullStaticMesh );
-                        } else {
-                            for ( auto&& meshInfoByKey = section.WorldMeshes.begin();
-                                meshInfoByKey != section.WorldMeshes.end(); ++meshInfoByKey ) {
-                                // Check surface type
-                                if ( meshInfoByKey->first.Info->MaterialType != MaterialInfo::MT_None ) {
-                                    continue;
-                                }
+            // The full meshes of the sections are always ExVertexStruct
+            if ( Engine::GAPI->GetRendererState().RendererSettings.FastShadows ) {
+                EndWorldMeshDraws();
+            }
 
-                                // Bind texture
-                                if ( meshInfoByKey->first.Material && meshInfoByKey->first.Material->GetTexture() ) {
-                                    if ( meshInfoByKey->first.Material->GetTexture()->HasAlphaChannel() ||
-                                        colorWritesEnabled ) {
-                                        if ( alphaRef > 0.0f &&
-                                            meshInfoByKey->first.Material->GetTexture()->CacheIn( 0.6f ) ==
-                                            zRES_CACHED_IN ) {
-                                            meshInfoByKey->first.Material->GetTexture()->Bind( 0 );
-                                            ActivePS->Apply();
-                                        } else
-                                            continue;  // Don't render if not loaded
-                                    } else {
-                                        if ( !linearDepth )  // Only unbind when not rendering linear
-                                                           // depth
-                                        {
-                                            // Unbind PS
-                                            Context->PSSetShader( nullptr, nullptr, 0 );
-                                        }
-                                    }
-                                }
+            Engine::GAPI->GetWorldSectionGrid().ForEachAround( s, 1, [&]( const INT2&, WorldMeshSectionInfo& section ) {
+                drawnSections.emplace_back( &section );
+
+                if ( Engine::GAPI->GetRendererState().RendererSettings.FastShadows ) {
+                    // Draw world mesh
+                    if ( section.FullStaticMesh )
+                        Engine::GAPI->DrawMeshInfo( nullptr, section.FullStaticMesh );
+                } else {
+                    for ( auto&& meshInfoByKey = section.WorldMeshes.begin();
+                        meshInfoByKey != section.WorldMeshes.end(); ++meshInfoByKey ) {
+                        // Check surface type
+                        if ( meshInfoByKey->first.Info->MaterialType != MaterialInfo::MT_None ) {
+                            continue;
+                        }
 
-                                // Draw from wrapped mesh
-                                DrawVertexBufferInstancedIndexedUINT( nullptr, nullptr,
-                                    meshInfoByKey->second->Indices.size(), 6, meshInfoByKey->second->BaseIndexLocation );
+                        // Bind texture
+                        if ( meshInfoByKey->first.Material && meshInfoByKey->first.Material->GetTexture() ) {
+                            if ( meshInfoByKey->first.Material->GetTexture()->HasAlphaChannel() ||
+                                colorWritesEnabled ) {
+                                if ( alphaRef > 0.0f &&
+                                    meshInfoByKey->first.Material->GetTexture()->CacheIn( 0.6f ) ==
+                                    zRES_CACHED_IN ) {
+                                    meshInfoByKey->first.Material->GetTexture()->Bind( 0 );
+                                    ActivePS->Apply();
+                                } else
+                                    continue;  // Don't render if not loaded
+                            } else {
+                                if ( !linearDepth )  // Only unbind when not rendering linear
+                                                   // depth
+                                {
+                                    // Unbind PS
+                                    Context->PSSetShader( nullptr, nullptr, 0 );
+                                }
                             }
                         }
+
+                        // Draw from wrapped mesh
+                        DrawVertexBufferInstancedIndexedUINT( nullptr, nullptr,
+                            meshInfoByKey->second->Indices.size(), 6, meshInfoByKey->second->BaseIndexLocation );
                     }
                 }
-            }
+            } );
         }
+
+        EndWorldMeshDraws();
     }
     
     if ( Engine::GAPI->GetRendererState().RendererSettings.DrawVOBs ) {
@@ -4127,11 +4241,39 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAround_Layered(
     }
 }
 
-/** Draws everything around the given position */
+/** Calls f for every section the world shadow around section s draws */
+template<typename F>
+static void ForEachShadowSection( const INT2& s, float sectionRange, F&& f ) {
+    Engine::GAPI->GetWorldSectionGrid().ForEachAround( s, static_cast<int>(ceilf( sectionRange )), [&]( const INT2& coords, WorldMeshSectionInfo& section ) {
+        float dx = static_cast<float>(coords.x - s.x);
+        float dy = static_cast<float>(coords.y - s.y);
+        float lenSq = dx * dx + dy * dy;
+
+        if ( lenSq < sectionRange * sectionRange ) {
+            f( section );
+        }
+    } );
+}
+
+/** Returns whether the given skeletal vob throws a shadow into the world shadow around position */
+static bool XM_CALLCONV IsSkeletalShadowCaster( SkeletalVobInfo* skeletalMeshVob, FXMVECTOR position, float radiusSq ) {
+    if ( !skeletalMeshVob->VisualInfo ) return false;
+
+    // Ghosts shouldn't have shadows
+    if ( skeletalMeshVob->Vob->GetVisualAlpha() && skeletalMeshVob->Vob->GetVobTransparency() < 0.7f ) {
+        return false;
+    }
+
+    float distSq;
+    XMStoreFloat( &distSq, XMVector3LengthSq( skeletalMeshVob->Vob->GetPositionWorldXM() - position ) );
+    return distSq <= radiusSq;
+}
+
+/** Draws everything around the given position, or only the given casters of a shadow cascade */
 void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAroundForWorldShadow( FXMVECTOR position,
     float sectionRange,
     bool cullFront, bool dontCull,
-    const Frustum& frustum ) {
+    const ShadowCascadeCasters* casters ) {
     // Setup renderstates
     Engine::GAPI->GetRendererState().RasterizerState.SetDefault();
     Engine::GAPI->GetRendererState().RasterizerState.CullMode =
@@ -4210,9 +4352,7 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAroundForWorldShadow( FXMVECTOR p
 
     if ( Engine::GAPI->GetRendererState().RendererSettings.DrawWorldMesh ) {
         // Bind wrapped mesh vertex buffers
-        DrawVertexBufferIndexedUINT(
-            Engine::GAPI->GetWrappedWorldMesh()->MeshVertexBuffer,
-            Engine::GAPI->GetWrappedWorldMesh()->MeshIndexBuffer, 0, 0 );
+        BeginWorldMeshDraws();
 
         ActiveVS->GetConstantBuffer()[1]->UpdateBuffer( &XMMatrixIdentity() );
         ActiveVS->GetConstantBuffer()[1]->BindToVertexShader( 1 );
@@ -4220,16 +4360,12 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAroundForWorldShadow( FXMVECTOR p
         static thread_local std::vector<const WorldMeshSectionInfo*> visibleSections;
         visibleSections.clear();
 
-        for ( const auto& itx : Engine::GAPI->GetWorldSections() ) {
-            for ( const auto& ity : itx.second ) {
-                float dx = static_cast<float>(itx.first - s.x);
-                float dy = static_cast<float>(ity.first - s.y);
-                float lenSq = dx * dx + dy * dy;
-
-                if ( lenSq < sectionRange * sectionRange ) {
-                    visibleSections.push_back( &ity.second );
-                }
-            }
+        if ( casters ) {
+            visibleSections.assign( casters->Sections.begin(), casters->Sections.end() );
+        } else {
+            ForEachShadowSection( s, sectionRange, [&]( WorldMeshSectionInfo& section ) {
+                visibleSections.push_back( &section );
+            } );
         }
 
         if ( Engine::GAPI->GetRendererState().RendererSettings.FastShadows ) {
@@ -4239,6 +4375,9 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAroundForWorldShadow( FXMVECTOR p
                 Context->PSSetShader( nullptr, nullptr, 0 );
             }
 
+            // The full meshes of the sections are always ExVertexStruct
+            EndWorldMeshDraws();
+
             for ( const WorldMeshSectionInfo* section : visibleSections ) {
                 if ( section->FullStaticMesh ) {
                     Engine::GAPI->DrawMeshInfo( nullptr, section->FullStaticMesh );
@@ -4328,28 +4467,88 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAroundForWorldShadow( FXMVECTOR p
                 }
             }
         }
+
+        EndWorldMeshDraws();
     }
 
     if ( Engine::GAPI->GetRendererState().RendererSettings.DrawVOBs ) {
-        // Reset instances
         const std::unordered_map<zCProgMeshProto*, MeshVisualInfo*>& staticMeshVisuals =
             Engine::GAPI->GetStaticMeshVisuals();
 
-        for ( auto const& it : RenderedVobs ) {
-            if ( !it->IsIndoorVob ) {
-                //VobInstanceInfo vii;
-                //vii.world = it->WorldMatrix;
-                //static_cast<MeshVisualInfo*>(it->VisualInfo)->Instances.emplace_back( vii );
+        // Range of instances to draw for every visual
+        struct ShadowVisualBatch {
+            MeshVisualInfo* Visual;
+            unsigned int StartInstance;
+            unsigned int NumInstances;
+        };
+        static thread_local std::vector<ShadowVisualBatch> visualBatches;
+        visualBatches.clear();
+
+        // Without own casters this draws what the camera sees, whose slots are already in the buffer
+        D3D11VertexBuffer* instanceBuffer = StaticInstanceSlotBuffer.get();
+        UINT instanceStride = sizeof( unsigned int );
+        bool instanceSlots = true;
+        if ( casters ) {
+            // The instancing buffer only holds what the camera sees, so a cascade puts its casters into its own
+            static thread_local std::vector<VobInfo*> casterVobs;
+            casterVobs.assign( casters->Vobs.begin(), casters->Vobs.end() );
+            std::sort( casterVobs.begin(), casterVobs.end(), []( const VobInfo* a, const VobInfo* b ) { return a->VisualInfo < b->VisualInfo; } );
+
+            if ( !casterVobs.empty() ) {
+                const size_t requiredSize = sizeof( VobInstanceInfo ) * casterVobs.size();
+                if ( !ShadowInstancingBuffer || ShadowInstancingBuffer->GetSizeInBytes() < requiredSize ) {
+                    ShadowInstancingBuffer = std::make_unique<D3D11VertexBuffer>();
+                    ShadowInstancingBuffer->Init(
+                        nullptr, requiredSize,
+                        D3D11VertexBuffer::B_VERTEXBUFFER, D3D11VertexBuffer::U_DYNAMIC,
+                        D3D11VertexBuffer::CA_WRITE );
+
+                    SetDebugName( ShadowInstancingBuffer->GetVertexBuffer().Get(), "ShadowInstancingBuffer->VertexBuffer" );
+                }
+
+                VobInstanceInfo* data;
+                UINT size;
+                ShadowInstancingBuffer->Map( D3D11VertexBuffer::M_WRITE_DISCARD,
+                    reinterpret_cast<void**>(&data), &size );
+                for ( unsigned int i = 0; i < casterVobs.size(); i++ ) {
+                    GothicAPI::GetVobInstanceInfo( casterVobs[i], data[i] );
+
+                    MeshVisualInfo* visual = static_cast<MeshVisualInfo*>(casterVobs[i]->VisualInfo);
+                    if ( visualBatches.empty() || visualBatches.back().Visual != visual ) {
+                        visualBatches.push_back( { visual, i, 0 } );
+                    }
+                    visualBatches.back().NumInstances++;
+                }
+                ShadowInstancingBuffer->Unmap();
+
+                instanceBuffer = ShadowInstancingBuffer.get();
+                instanceStride = sizeof( VobInstanceInfo );
+                instanceSlots = false;
+            }
+        } else if ( instanceBuffer ) {
+            // Reset instances
+            for ( auto const& it : RenderedVobs ) {
+                if ( !it->IsIndoorVob ) {
+                    // We don't need vob world matrix because the data is already in buffer
+                    static_cast<MeshVisualInfo*>(it->VisualInfo)->InstanceSlots.push_back( it->InstanceSlot );
+                }
+            }
 
-                // We don't need vob world matrix because the data is already in buffer
-                static_cast<MeshVisualInfo*>(it->VisualInfo)->Instances.emplace_back();
+            for ( auto const& staticMeshVisual : staticMeshVisuals ) {
+                if ( staticMeshVisual.second->InstanceSlots.empty() ) continue;
+
+                visualBatches.push_back( { staticMeshVisual.second, staticMeshVisual.second->StartInstanceNum,
+                    static_cast<unsigned int>(staticMeshVisual.second->InstanceSlots.size()) } );
             }
         }
 
         // Apply instancing shader
-        SetActiveVertexShader( "VS_ExInstancedObj" );
+        SetActiveVertexShader( instanceSlots ? "VS_ExInstancedObjSlots" : "VS_ExInstancedObj" );
         // SetActivePixelShader("PS_DiffuseAlphaTest");
         ActiveVS->Apply();
+        if ( instanceSlots ) {
+            BindStaticInstances();
+        }
 
         if ( !linearDepth )  // Only unbind when not rendering linear depth
         {
@@ -4361,43 +4560,28 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAroundForWorldShadow( FXMVECTOR p
             ActiveVS->GetConstantBuffer()[1]->BindToVertexShader( 1 );
         }
 
-        // Static meshes should already be in buffer from main stage rendering
-        /*size_t ByteWidth = DynamicInstancingBuffer->GetSizeInBytes();
-        byte* data;
-        UINT size;
-        UINT loc = 0;
-        DynamicInstancingBuffer->Map( D3D11VertexBuffer::M_WRITE_DISCARD,
-            reinterpret_cast<void**>(&data), &size );
-        for ( auto const& staticMeshVisual : staticMeshVisuals ) {
-            if ( staticMeshVisual.second->Instances.empty() ) continue;
-
-            if ( (loc + staticMeshVisual.second->Instances.size()) * sizeof( VobInstanceInfo ) >= ByteWidth )
-                break;  // Should never happen
-
-            staticMeshVisual.second->StartInstanceNum = loc;
-            memcpy( data + loc * sizeof( VobInstanceInfo ), &staticMeshVisual.second->Instances[0],
-                sizeof( VobInstanceInfo ) * staticMeshVisual.second->Instances.size() );
-            loc += staticMeshVisual.second->Instances.size();
-        }
-        DynamicInstancingBuffer->Unmap();*/
-
         XMFLOAT3 vPlayerPosition = Engine::GAPI->GetPlayerVob() ? Engine::GAPI->GetPlayerVob()->GetPositionWorld() : XMFLOAT3( 0, 0, 0 );
         g_windBuffer.playerPos = float3( vPlayerPosition.x, vPlayerPosition.y, vPlayerPosition.z );
 
+        // Everything the draws bind is prepared here, the draws themselves may get recorded on the worker threads
+        static thread_local std::vector<InstancedVobDraw> vobDraws;
+        vobDraws.clear();
+        unsigned int numVisualBuffers = 0;
+        const unsigned int maxIndices = Engine::GAPI->GetRendererState().RendererSettings.MaxNumFaces * 3;
+
         // Draw all vobs the player currently sees
-        for ( auto const& staticMeshVisual : staticMeshVisuals ) {
-            if ( staticMeshVisual.second->Instances.empty() ) continue;
+        for ( const ShadowVisualBatch& batch : visualBatches ) {
+            MeshVisualInfo* visual = batch.Visual;
 
-            g_windBuffer.minHeight = staticMeshVisual.second->BBox.Min.y;
-            g_windBuffer.maxHeight = staticMeshVisual.second->BBox.Max.y;
+            g_windBuffer.minHeight = visual->BBox.Min.y;
+            g_windBuffer.maxHeight = visual->BBox.Max.y;
 
-            if ( ActiveVS ) {
-                ActiveVS->GetConstantBuffer()[1]->UpdateBuffer( &g_windBuffer );
-            }
+            // Filled with the first draw of the visual
+            D3D11ConstantBuffer* windBuffer = nullptr;
 
             bool doReset = true;
-            for ( auto const& itt : staticMeshVisual.second->MeshesByTexture ) {
-                std::vector<MeshInfo*>& mlist = staticMeshVisual.second->MeshesByTexture[itt.first];
+            for ( auto const& itt : visual->MeshesByTexture ) {
+                std::vector<MeshInfo*>& mlist = visual->MeshesByTexture[itt.first];
                 if ( mlist.empty() ) continue;
 
                 for ( unsigned int i = 0; i < mlist.size(); i++ ) {
@@ -4414,75 +4598,63 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAroundForWorldShadow( FXMVECTOR p
                         continue;
                     }
 
+                    InstancedVobDraw draw = {};
+
                     // Bind texture
                     if ( tx && (tx->HasAlphaChannel() || colorWritesEnabled) ) {
                         if ( alphaRef > 0.0f && tx->CacheIn( 0.6f ) == zRES_CACHED_IN ) {
-                            tx->Bind( 0 );
-                            ActivePS->Apply();
+                            draw.TextureViews[0] = tx->GetSurface()->GetEngineTexture()->GetShaderResourceView().Get();
+                            draw.NumTextureViews = 1;
+                            draw.Shader = ActivePS.get();
                         } else
                             continue;
                     } else {
-                        if ( !linearDepth )  // Only unbind when not rendering linear depth
-                        {
-                            // Unbind PS
-                            Context->PSSetShader( nullptr, nullptr, 0 );
-                        }
+                        // Depth only, unless rendering linear depth
+                        draw.Shader = linearDepth ? ActivePS.get() : nullptr;
+                    }
+
+                    if ( !windBuffer ) {
+                        windBuffer = FillPooledConstantBuffer( VobWindConstantBuffers, numVisualBuffers++, &g_windBuffer, sizeof( g_windBuffer ) );
                     }
 
                     MeshInfo* mi = mlist[i];
 
-                    // Draw batch
-                    DrawInstanced( mi->MeshVertexBuffer, mi->MeshIndexBuffer,
-                        mi->Indices.size(), DynamicInstancingBuffer.get(),
-                        sizeof( VobInstanceInfo ), staticMeshVisual.second->Instances.size(),
-                        sizeof( ExVertexStruct ), staticMeshVisual.second->StartInstanceNum );
+                    draw.Mesh = mi;
+                    draw.WindBuffer = windBuffer;
+                    draw.NumIndices = static_cast<unsigned int>(mi->Indices.size());
+                    draw.NumIndices = maxIndices != 0 ? std::min( draw.NumIndices, maxIndices ) : draw.NumIndices;
+                    draw.NumInstances = batch.NumInstances;
+                    draw.StartInstance = batch.StartInstance;
+                    vobDraws.push_back( draw );
 
-                    Engine::GAPI->GetRendererState().RendererInfo.FrameDrawnVobs +=
-                        staticMeshVisual.second->Instances.size();
+                    Engine::GAPI->GetRendererState().RendererInfo.FrameDrawnTriangles += (draw.NumIndices / 3) * draw.NumInstances;
+                    Engine::GAPI->GetRendererState().RendererInfo.FrameDrawnVobs += batch.NumInstances;
                 }
             }
 
-            // Reset visual
-            if ( doReset ) staticMeshVisual.second->StartNewFrame();
+            // Reset visual. Cascades with their own casters never added any instances to it.
+            if ( doReset && !casters ) visual->StartNewFrame();
+        }
+
+        if ( instanceBuffer ) {
+            DrawInstancedVobs( vobDraws, instanceBuffer, instanceStride );
         }
     }
 
     if ( Engine::GAPI->GetRendererState().RendererSettings.DrawSkeletalMeshes ) {
-        auto indorRadiusSq = Engine::GAPI->GetRendererState().RendererSettings.SkeletalMeshDrawRadius
-            * Engine::GAPI->GetRendererState().RendererSettings.SkeletalMeshDrawRadius;
-
-        auto enableCulling = Engine::GAPI->GetRendererState().RendererSettings.IsShadowFrustumCullingEnabled();
-
-        // Draw skeletal meshes
-        for ( auto const& skeletalMeshVob : Engine::GAPI->GetSkeletalMeshVobs() ) {
-            if ( !skeletalMeshVob->VisualInfo ) continue;
-
-            // Ghosts shouldn't have shadows
-            if ( skeletalMeshVob->Vob->GetVisualAlpha() && skeletalMeshVob->Vob->GetVobTransparency() < 0.7f ) {
-                continue;
-            }
-            
-            XMVECTOR vobPos = skeletalMeshVob->Vob->GetPositionWorldXM();
-            float distSq;
-            XMStoreFloat( &distSq, XMVector3LengthSq( vobPos - position ) );
-            if ( distSq > indorRadiusSq ) {
-                continue;  // Skip out of range
+        if ( casters ) {
+            for ( SkeletalVobInfo* skeletalMeshVob : casters->SkeletalVobs ) {
+                Engine::GAPI->DrawSkeletalMeshVob( skeletalMeshVob, FLT_MAX );
             }
+        } else {
+            const float radius = Engine::GAPI->GetRendererState().RendererSettings.SkeletalMeshDrawRadius;
 
-            if ( enableCulling ) {
-                // Frustum culling using a bounding sphere
-                // Use the mesh size as radius, centered at the vob position
-                float radius = skeletalMeshVob->VisualInfo->MeshSize * 0.5f;
-                XMFLOAT3 center;
-                XMStoreFloat3( &center, vobPos );
-                BoundingSphere vobSphere( center, radius );
-
-                if ( !frustum.Intersects( vobSphere ) ) {
-                    continue;  // Skip if not visible in the shadow frustum
+            // Draw skeletal meshes
+            for ( auto const& skeletalMeshVob : Engine::GAPI->GetSkeletalMeshVobs() ) {
+                if ( IsSkeletalShadowCaster( skeletalMeshVob, position, radius * radius ) ) {
+                    Engine::GAPI->DrawSkeletalMeshVob( skeletalMeshVob, FLT_MAX );
                 }
             }
-
-            Engine::GAPI->DrawSkeletalMeshVob( skeletalMeshVob, FLT_MAX );
         }
     }
 
@@ -4490,6 +4662,35 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAroundForWorldShadow( FXMVECTOR p
     Engine::GAPI->GetRendererState().BlendState.SetDirty();
 }
 
+/** Adds everything DrawWorldAroundForWorldShadow would draw around the given position to the caster culling */
+void XM_CALLCONV D3D11GraphicsEngine::CollectShadowCasters( FXMVECTOR position, float sectionRange, ShadowCasterCulling& culling ) {
+    const GothicRendererSettings& settings = Engine::GAPI->GetRendererState().RendererSettings;
+
+    if ( settings.DrawWorldMesh ) {
+        float3 fPosition; XMStoreFloat3( fPosition.toXMFLOAT3(), position );
+        ForEachShadowSection( WorldConverter::GetSectionOfPos( fPosition ), sectionRange, [&]( WorldMeshSectionInfo& section ) {
+            culling.AddSection( &section, section.BoundingBox );
+        } );
+    }
+
+    if ( settings.DrawVOBs ) {
+        for ( VobInfo* vob : RenderedVobs ) {
+            if ( !vob->IsIndoorVob ) {
+                culling.AddVob( vob, vob->Vob->GetBBox() );
+            }
+        }
+    }
+
+    if ( settings.DrawSkeletalMeshes ) {
+        const float radiusSq = settings.SkeletalMeshDrawRadius * settings.SkeletalMeshDrawRadius;
+        for ( SkeletalVobInfo* skeletalMeshVob : Engine::GAPI->GetSkeletalMeshVobs() ) {
+            if ( IsSkeletalShadowCaster( skeletalMeshVob, position, radiusSq ) ) {
+                culling.AddSkeletalVob( skeletalMeshVob, skeletalMeshVob->Vob->GetBBox() );
+            }
+        }
+    }
+}
+
 /** Update morph mesh visual */
 void D3D11GraphicsEngine::UpdateMorphMeshVisual() {
     const std::unordered_map<zCProgMeshProto*, MeshVisualInfo*>& staticMeshVisuals =
@@ -4497,11 +4698,206 @@ void D3D11GraphicsEngine::UpdateMorphMeshVisual() {
 
     for ( auto const& staticMeshVisual : staticMeshVisuals ) {
         if ( !staticMeshVisual.second->MorphMeshVisual ) continue;
-        if ( staticMeshVisual.second->Instances.empty() ) continue;
+        if ( staticMeshVisual.second->InstanceSlots.empty() ) continue;
         WorldConverter::UpdateMorphMeshVisual( staticMeshVisual.second->MorphMeshVisual, staticMeshVisual.second );
     }
 }
 
+/** Brings StaticInstanceBuffer up to date with the static instance store and puts the slots of this frames
+    instances into StaticInstanceSlotBuffer */
+void D3D11GraphicsEngine::UploadStaticInstances( const std::unordered_map<zCProgMeshProto*, MeshVisualInfo*>& staticMeshVisuals ) {
+    // Changed slots closer than this get uploaded together, with the unchanged ones in between
+    const unsigned int UPLOAD_RANGE_GAP = 8;
+    // Both buffers start out with room for as many instances as the dynamic instancing buffer
+    const unsigned int MIN_BUFFER_INSTANCES = INSTANCING_BUFFER_SIZE / sizeof( VobInstanceInfo );
+
+    StaticInstanceStore& store = Engine::GAPI->GetStaticInstanceStore();
+    const unsigned int numSlots = store.GetNumSlots();
+    const UINT stride = sizeof( VobInstanceInfo );
+
+    unsigned int uploadedSlots = 0;
+    if ( numSlots > 0 ) {
+        if ( !StaticInstanceBuffer || StaticInstanceBuffer->GetSizeInBytes() < numSlots * stride ) {
+            // Leave room for vobs added later on, since the new buffer needs every slot uploaded again
+            const unsigned int capacity = std::max( numSlots + numSlots / 2, MIN_BUFFER_INSTANCES );
+            if ( Engine::GAPI->GetRendererState().RendererSettings.EnableDebugLog )
+                LogInfo() << "Static instance buffer too small, recreating it for " << capacity << " instances";
+
+            StaticInstanceBuffer = std::make_unique<D3D11VertexBuffer>();
+            StaticInstanceBuffer->Init(
+                nullptr, capacity * stride,
+                D3D11VertexBuffer::B_SHADER_RESOURCE, D3D11VertexBuffer::U_DEFAULT,
+                D3D11VertexBuffer::CA_NONE, "", stride );
+
+            SetDebugName( StaticInstanceBuffer->GetShaderResourceView().Get(), "StaticInstanceBuffer->ShaderResourceView" );
+            SetDebugName( StaticInstanceBuffer->GetVertexBuffer().Get(), "StaticInstanceBuffer->VertexBuffer" );
+
+            StaticInstanceUploadRanges.assign( 1, { 0, numSlots } );
+            store.ClearDirty();
+        } else {
+            store.TakeDirtyRanges( StaticInstanceUploadRanges, UPLOAD_RANGE_GAP );
+        }
+
+        for ( const StaticInstanceStore::SlotRange& range : StaticInstanceUploadRanges ) {
+            D3D11_BOX box = {};
+            box.left = range.First * stride;
+            box.right = (range.First + range.Count) * stride;
+            box.bottom = 1;
+            box.back = 1;
+
+            GetContext()->UpdateSubresource( StaticInstanceBuffer->GetVertexBuffer().Get(), 0, &box,
+                store.GetInstances() + range.First, 0, 0 );
+            uploadedSlots += range.Count;
+        }
+    }
+    Engine::GAPI->GetRendererState().RendererInfo.FrameStaticInstanceUploads = uploadedSlots;
+
+    // Only the slots of the visible instances change every frame
+    size_t numInstances = 0;
+    for ( auto const& staticMeshVisual : staticMeshVisuals ) {
+        numInstances += staticMeshVisual.second->InstanceSlots.size();
+    }
+    if ( numInstances == 0 )
+        return;
+
+    if ( !StaticInstanceSlotBuffer || StaticInstanceSlotBuffer->GetSizeInBytes() < sizeof( unsigned int ) * numInstances ) {
+        const size_t capacity = std::max<size_t>( numInstances + numInstances / 2, MIN_BUFFER_INSTANCES );
+        StaticInstanceSlotBuffer = std::make_unique<D3D11VertexBuffer>();
+        StaticInstanceSlotBuffer->Init(
+            nullptr, static_cast<unsigned int>(sizeof( unsigned int ) * capacity),
+            D3D11VertexBuffer::B_VERTEXBUFFER, D3D11VertexBuffer::U_DYNAMIC,
+            D3D11VertexBuffer::CA_WRITE );
+
+        SetDebugName( StaticInstanceSlotBuffer->GetVertexBuffer().Get(), "StaticInstanceSlotBuffer->VertexBuffer" );
+    }
+
+    unsigned int* data;
+    UINT size;
+    unsigned int loc = 0;
+    StaticInstanceSlotBuffer->Map( D3D11VertexBuffer::M_WRITE_DISCARD,
+        reinterpret_cast<void**>(&data), &size );
+    for ( auto const& staticMeshVisual : staticMeshVisuals ) {
+        const std::vector<unsigned int>& slots = staticMeshVisual.second->InstanceSlots;
+        staticMeshVisual.second->StartInstanceNum = loc;
+        if ( slots.empty() ) continue;
+
+        memcpy( data + loc, &slots[0], sizeof( unsigned int ) * slots.size() );
+        loc += static_cast<unsigned int>(slots.size());
+    }
+    StaticInstanceSlotBuffer->Unmap();
+}
+
+/** Binds StaticInstanceBuffer for VS_ExInstancedObjSlots */
+void D3D11GraphicsEngine::BindStaticInstances() {
+    ID3D11ShaderResourceView* srv = StaticInstanceBuffer ? StaticInstanceBuffer->GetShaderResourceView().Get() : nullptr;
+    GetContext()->VSSetShaderResources( 0, 1, &srv );
+}
+
+/** Deferred contexts for EnableParallelDrawRecording, created when it is first used */
+D3D11CommandListRecorder* D3D11GraphicsEngine::GetCommandListRecorder() {
+    if ( !Engine::GAPI->GetRendererState().RendererSettings.EnableParallelDrawRecording )
+        return nullptr;
+
+    if ( !CommandListRecorder ) {
+        CommandListRecorder = std::make_unique<D3D11CommandListRecorder>();
+        if ( XR_SUCCESS != CommandListRecorder->Init( GetDevice().Get(), GetParallelForSlots() ) ) {
+            LogWarn() << "Parallel draw recording not available, drawing everything on the main thread";
+        }
+    }
+
+    return CommandListRecorder.get();
+}
+
+/** Fills the index-th buffer of the pool, which gets created when it is first used */
+D3D11ConstantBuffer* D3D11GraphicsEngine::FillPooledConstantBuffer( std::vector<std::unique_ptr<D3D11ConstantBuffer>>& pool, unsigned int index, const void* data, UINT size ) {
+    while ( pool.size() <= index ) {
+        D3D11ConstantBuffer* buffer;
+        CreateConstantBuffer( &buffer, nullptr, size );
+        pool.emplace_back( buffer );
+    }
+
+    pool[index]->UpdateBuffer( data, size );
+    return pool[index].get();
+}
+
+/** Draws the vob draws in order, recorded on the worker threads if there are enough of them */
+void D3D11GraphicsEngine::DrawInstancedVobs( const std::vector<InstancedVobDraw>& draws, D3D11VertexBuffer* instanceBuffer, UINT instanceStride ) {
+    if ( draws.empty() )
+        return;
+
+    // The recording contexts start out with the render states of the immediate context
+    UpdateRenderStates();
+
+    ID3D11Buffer* instances = instanceBuffer->GetVertexBuffer().Get();
+    const unsigned int numDraws = static_cast<unsigned int>(draws.size());
+
+    bool recorded = false;
+    D3D11CommandListRecorder* recorder = numDraws >= 2 * CommandListScheduler::MIN_ITEMS_PER_JOB ? GetCommandListRecorder() : nullptr;
+    if ( recorder ) {
+        recorder->Begin( GetContext().Get(), [&]( ID3D11DeviceContext* context, unsigned int, unsigned int first, unsigned int count ) {
+            RecordInstancedVobDraws( context, &draws[first], count, instances, instanceStride );
+        } );
+        recorded = CommandListJobs.Run( *recorder, numDraws );
+        recorder->End();
+    }
+
+    if ( !recorded ) {
+        RecordInstancedVobDraws( GetContext().Get(), draws.data(), numDraws, instances, instanceStride );
+    }
+}
+
+/** Records the draws into the context, binding only what changed from the draw before */
+void D3D11GraphicsEngine::RecordInstancedVobDraws( ID3D11DeviceContext* context, const InstancedVobDraw* draws, unsigned int count,
+    ID3D11Buffer* instanceBuffer, UINT instanceStride ) {
+    const InstancedVobDraw* shader = nullptr;
+    const InstancedVobDraw* textures = nullptr;
+    const InstancedVobDraw* mesh = nullptr;
+    D3D11ConstantBuffer* material = nullptr;
+    D3D11ConstantBuffer* radius = nullptr;
+    D3D11ConstantBuffer* wind = nullptr;
+
+    for ( unsigned int i = 0; i < count; i++ ) {
+        const InstancedVobDraw& draw = draws[i];
+
+        if ( !shader || shader->Shader != draw.Shader ) {
+            context->PSSetShader( draw.Shader ? draw.Shader->GetShader().Get() : nullptr, nullptr, 0 );
+            shader = &draw;
+        }
+
+        if ( draw.NumTextureViews && (!textures || textures->NumTextureViews != draw.NumTextureViews
+            || !std::equal( draw.TextureViews, draw.TextureViews + draw.NumTextureViews, textures->TextureViews )) ) {
+            context->PSSetShaderResources( 0, draw.NumTextureViews, draw.TextureViews );
+            textures = &draw;
+        }
+
+        if ( draw.MaterialBuffer && draw.MaterialBuffer != material ) {
+            context->PSSetConstantBuffers( 2, 1, draw.MaterialBuffer->Get().GetAddressOf() );
+            material = draw.MaterialBuffer;
+        }
+
+        if ( draw.RadiusBuffer && draw.RadiusBuffer != radius ) {
+            context->PSSetConstantBuffers( 3, 1, draw.RadiusBuffer->Get().GetAddressOf() );
+            radius = draw.RadiusBuffer;
+        }
+
+        if ( draw.WindBuffer != wind ) {
+            context->VSSetConstantBuffers( 1, 1, draw.WindBuffer->Get().GetAddressOf() );
+            wind = draw.WindBuffer;
+        }
+
+        if ( !mesh || mesh->Mesh != draw.Mesh ) {
+            UINT offset[] = { 0, 0 };
+            UINT stride[] = { sizeof( ExVertexStruct ), instanceStride };
+            ID3D11Buffer* buffers[2] = { draw.Mesh->MeshVertexBuffer->GetVertexBuffer().Get(), instanceBuffer };
+            context->IASetVertexBuffers( 0, 2, buffers, stride, offset );
+            context->IASetIndexBuffer( draw.Mesh->MeshIndexBuffer->GetVertexBuffer().Get(), VERTEX_INDEX_DXGI_FORMAT, 0 );
+            mesh = &draw;
+        }
+
+        context->DrawIndexedInstanced( draw.NumIndices, draw.NumInstances, 0, 0, draw.StartInstance );
+    }
+}
+
 /** Updates wind direction and set time for shader */
 void D3D11GraphicsEngine::ApplyWindProps( VS_ExConstantBuffer_Wind& windBuff ) {
     // Changing wind direction settings
@@ -4574,7 +4970,7 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
     SetDefaultStates();
 
     SetActivePixelShader( "PS_Diffuse" );
-    SetActiveVertexShader( "VS_ExInstancedObj" );
+    SetActiveVertexShader( "VS_ExInstancedObjSlots" );
 
     // Set constant buffer
     ActivePS->GetConstantBuffer()[0]->UpdateBuffer(
@@ -4630,37 +5026,9 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
         AlphaMeshes;
 
     if ( Engine::GAPI->GetRendererState().RendererSettings.DrawVOBs ) {
-        // Create instancebuffer for this frame
-        size_t ByteWidth = DynamicInstancingBuffer->GetSizeInBytes();
-
-        if ( ByteWidth < sizeof( VobInstanceInfo ) * vobs.size() ) {
-            if ( Engine::GAPI->GetRendererState().RendererSettings.EnableDebugLog )
-                LogInfo() << "Instancing buffer too small (" << ByteWidth
-                << "), need " << sizeof( VobInstanceInfo ) * vobs.size()
-                << " bytes. Recreating buffer.";
-
-            // Buffer too small, recreate it
-            DynamicInstancingBuffer->Init(
-                nullptr, sizeof( VobInstanceInfo ) * vobs.size(),
-                D3D11VertexBuffer::B_VERTEXBUFFER, D3D11VertexBuffer::U_DYNAMIC,
-                D3D11VertexBuffer::CA_WRITE );
-
-            SetDebugName( DynamicInstancingBuffer->GetShaderResourceView().Get(), "DynamicInstancingBuffer->ShaderResourceView" );
-            SetDebugName( DynamicInstancingBuffer->GetVertexBuffer().Get(), "DynamicInstancingBuffer->VertexBuffer" );
-        }
-
-        byte* data;
-        UINT size;
-        UINT loc = 0;
-        DynamicInstancingBuffer->Map( D3D11VertexBuffer::M_WRITE_DISCARD,
-            reinterpret_cast<void**>(&data), &size );
-        for ( auto const& staticMeshVisual : staticMeshVisuals ) {
-            staticMeshVisual.second->StartInstanceNum = loc;
-            memcpy( data + loc * sizeof( VobInstanceInfo ), &staticMeshVisual.second->Instances[0],
-                sizeof( VobInstanceInfo ) * staticMeshVisual.second->Instances.size() );
-            loc += staticMeshVisual.second->Instances.size();
-        }
-        DynamicInstancingBuffer->Unmap();
+        // Only instances which changed get uploaded, the visible ones are just sent as their slots
+        UploadStaticInstances( staticMeshVisuals );
+        BindStaticInstances();
 
         for ( unsigned int i = 0; i < vobs.size(); i++ ) {
             vobs[i]->VisibleInRenderPass = false;  // Reset this for the next frame
@@ -4670,30 +5038,47 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
         XMFLOAT3 vPlayerPosition = Engine::GAPI->GetPlayerVob() ? Engine::GAPI->GetPlayerVob()->GetPositionWorld() : XMFLOAT3( 0, 0, 0 );
         g_windBuffer.playerPos = float3( vPlayerPosition.x, vPlayerPosition.y, vPlayerPosition.z );
 
+        bool vobLods = Engine::GAPI->GetRendererState().RendererSettings.EnableVobLods;
+        float lodPixelsPerUnit = Engine::GAPI->GetProjectionMatrix()._22 * GetResolution().y * 0.5f;
+        const CullingDistances& vobCullingDistances = Engine::GAPI->GetVobCullingDistances();
+        const float vobDetailScale = sqrtf( vobCullingDistances.DetailScaleSq );
+
+        // Everything the draws bind is prepared here, the draws themselves may get recorded on the worker threads
+        static std::vector<InstancedVobDraw> vobDraws;
+        vobDraws.clear();
+        unsigned int numVisualBuffers = 0;
+        unsigned int numHelperBuffers = 0;
+        const unsigned int maxIndices = Engine::GAPI->GetRendererState().RendererSettings.MaxNumFaces * 3;
+
         for ( auto const& staticMeshVisual : staticMeshVisuals ) {
-            if ( staticMeshVisual.second->Instances.empty() ) continue;
+            if ( staticMeshVisual.second->InstanceSlots.empty() ) continue;
+
+            // All instances share one draw call, so the closest one decides the LOD
+            float lodDistance = 0.0f;
+            if ( vobLods ) {
+                lodDistance = GetClosestInstanceDistance( staticMeshVisual.second->InstanceLods, XMLoadFloat3( camPos.toXMFLOAT3() ) );
+            }
 
-            if ( staticMeshVisual.second->MeshSize <
+            float drawRadius;
+            if ( vobDetailScale > 0.0f ) {
+                // Each visual fades out where it got too small on screen, see CullingDistances::DetailScaleSq
+                drawRadius = std::min( vobCullingDistances.Radius[BOX_DISTANCE_OUTDOOR], staticMeshVisual.second->MeshSize * 0.5f * vobDetailScale ) -
+                    staticMeshVisual.second->MeshSize;
+            } else if ( staticMeshVisual.second->MeshSize <
                 Engine::GAPI->GetRendererState().RendererSettings.SmallVobSize ) {
-                OutdoorSmallVobsConstantBuffer->UpdateBuffer(
-                    float4( Engine::GAPI->GetRendererState().RendererSettings.OutdoorSmallVobDrawRadius -
-                        staticMeshVisual.second->MeshSize,
-                        0, 0, 0 ).toPtr() );
-                OutdoorSmallVobsConstantBuffer->BindToPixelShader( 3 );
+                drawRadius = Engine::GAPI->GetRendererState().RendererSettings.OutdoorSmallVobDrawRadius -
+                    staticMeshVisual.second->MeshSize;
             } else {
-                OutdoorVobsConstantBuffer->UpdateBuffer(
-                    float4( Engine::GAPI->GetRendererState().RendererSettings.OutdoorVobDrawRadius -
-                        staticMeshVisual.second->MeshSize,
-                        0, 0, 0 ).toPtr() );
-                OutdoorVobsConstantBuffer->BindToPixelShader( 3 );
+                drawRadius = Engine::GAPI->GetRendererState().RendererSettings.OutdoorVobDrawRadius -
+                    staticMeshVisual.second->MeshSize;
             }
 
             g_windBuffer.minHeight = staticMeshVisual.second->BBox.Min.y;
             g_windBuffer.maxHeight = staticMeshVisual.second->BBox.Max.y;
 
-            if ( ActiveVS ) {
-                ActiveVS->GetConstantBuffer()[1]->UpdateBuffer( &g_windBuffer );
-            }
+            // Filled with the first draw of the visual
+            D3D11ConstantBuffer* windBuffer = nullptr;
+            D3D11ConstantBuffer* radiusBuffer = nullptr;
 
             bool doReset = true;  // Don't reset alpha-vobs here
             for ( auto const& itt : staticMeshVisual.second->MeshesByTexture ) {
@@ -4707,7 +5092,7 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
                         MeshVisualInfo* info = staticMeshVisual.second;
                         for ( MeshInfo* mesh : mlist ) {
                             AlphaMeshes.emplace_back(
-                                itt.first, info, mesh, staticMeshVisual.second->Instances.size() );
+                                itt.first, info, mesh, staticMeshVisual.second->InstanceSlots.size() );
                         }
 
                         doReset = false;
@@ -4719,21 +5104,17 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
                     zCTexture* tx = itt.first.Material->GetAniTexture();
                     MeshInfo* mi = mlist[i];
 
+                    InstancedVobDraw draw = {};
+
                     if ( !tx ) {
 #ifndef BUILD_SPACER_NET
 #ifndef BUILD_SPACER
                         continue;  // Don't render meshes without texture if not in spacer
 #else
                         // This is most likely some spacer helper-vob
-                        WhiteTexture->BindToPixelShader( 0 );
-                        PS_Diffuse->Apply();
-
-                        /*// Apply colors for these meshes
-                        MaterialInfo::Buffer b;
-                        ZeroMemory(&b, sizeof(b));
-                        b.Color = itt->first.Material->GetColor();
-                        PS_Diffuse->GetConstantBuffer()[2]->UpdateBuffer(&b);
-                        PS_Diffuse->GetConstantBuffer()[2]->BindToPixelShader(2);*/
+                        draw.TextureViews[0] = WhiteTexture->GetShaderResourceView().Get();
+                        draw.NumTextureViews = 1;
+                        draw.Shader = PS_Diffuse.get();
 #endif
 #else
                         if ( !Engine::GAPI->GetRendererState().RendererSettings.RunInSpacerNet ) {
@@ -4742,14 +5123,14 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
                         bool showHelpers = *reinterpret_cast<int*>(GothicMemoryLocations::zCVob::s_ShowHelperVisuals) != 0;
 
                         if ( showHelpers ) {
-                            WhiteTexture->BindToPixelShader( 0 );
-                            PS_DiffuseAlphatest->Apply();
+                            draw.TextureViews[0] = WhiteTexture->GetShaderResourceView().Get();
+                            draw.NumTextureViews = 1;
+                            draw.Shader = PS_DiffuseAlphatest.get();
 
                             MaterialInfo::Buffer b = {};
 
                             b.Color = itt.first.Material->GetColor();
-                            PS_DiffuseAlphatest->GetConstantBuffer()[2]->UpdateBuffer( &b );
-                            PS_DiffuseAlphatest->GetConstantBuffer()[2]->BindToPixelShader( 2 );
+                            draw.MaterialBuffer = FillPooledConstantBuffer( VobHelperConstantBuffers, numHelperBuffers++, &b, sizeof( b ) );
 
                         } else {
                             continue;
@@ -4757,51 +5138,67 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
 
 #endif
                     } else {
-                        // Bind texture
-                        if ( tx->CacheIn( 0.6f ) == zRES_CACHED_IN ) {
-                            MyDirectDrawSurface7* surface = tx->GetSurface();
-                            ID3D11ShaderResourceView* srv[3];
-                            MaterialInfo* info = itt.first.Info;
-
-                            // Get diffuse and normalmap
-                            srv[0] = surface->GetEngineTexture()->GetShaderResourceView().Get();
-                            srv[1] = surface->GetNormalmap()
-                                ? surface->GetNormalmap()->GetShaderResourceView().Get()
-                                : nullptr;
-                            srv[2] = surface->GetFxMap()
-                                ? surface->GetFxMap()->GetShaderResourceView().Get()
-                                : nullptr;
-
-                            // Bind a default normalmap in case the scene is wet and we
-                            // currently have none
-                            if ( !srv[1] ) {
-                                // Modify the strength of that default normalmap for the
-                                // material info
-                                if ( info->buffer.NormalmapStrength /* *
-                                                          Engine::GAPI->GetSceneWetness()*/
-                                    != DEFAULT_NORMALMAP_STRENGTH ) {
-                                    info->buffer.NormalmapStrength = DEFAULT_NORMALMAP_STRENGTH;
-                                    info->UpdateConstantbuffer();
-                                }
-                                srv[1] = DistortionTexture->GetShaderResourceView().Get();
+                        // Textures which aren't there yet are skipped, like on the world mesh
+                        if ( tx->CacheIn( 0.6f ) != zRES_CACHED_IN ) {
+                            continue;
+                        }
+
+                        MyDirectDrawSurface7* surface = tx->GetSurface();
+                        MaterialInfo* info = itt.first.Info;
+
+                        // Get diffuse and normalmap
+                        draw.TextureViews[0] = surface->GetEngineTexture()->GetShaderResourceView().Get();
+                        draw.TextureViews[1] = surface->GetNormalmap()
+                            ? surface->GetNormalmap()->GetShaderResourceView().Get()
+                            : nullptr;
+                        draw.TextureViews[2] = surface->GetFxMap()
+                            ? surface->GetFxMap()->GetShaderResourceView().Get()
+                            : nullptr;
+                        draw.NumTextureViews = 3;
+
+                        // Bind a default normalmap in case the scene is wet and we
+                        // currently have none
+                        if ( !draw.TextureViews[1] ) {
+                            // Modify the strength of that default normalmap for the
+                            // material info
+                            if ( info->buffer.NormalmapStrength /* *
+                                                      Engine::GAPI->GetSceneWetness()*/
+                                != DEFAULT_NORMALMAP_STRENGTH ) {
+                                info->buffer.NormalmapStrength = DEFAULT_NORMALMAP_STRENGTH;
+                                info->UpdateConstantbuffer();
                             }
-                            // Bind both
-                            GetContext()->PSSetShaderResources( 0, 3, srv );
+                            draw.TextureViews[1] = DistortionTexture->GetShaderResourceView().Get();
+                        }
 
-                            // Force alphatest on vobs for now
-                            BindShaderForTexture( tx, true, 0 );
+                        // Force alphatest on vobs for now
+                        draw.Shader = GetShaderForTexture( tx, true, 0 ).get();
 
-                            if ( !info->Constantbuffer ) info->UpdateConstantbuffer();
+                        if ( !info->Constantbuffer ) info->UpdateConstantbuffer();
+                        draw.MaterialBuffer = info->Constantbuffer;
+                    }
 
-                            info->Constantbuffer->BindToPixelShader( 2 );
-                        }
+                    if ( !mi->LodLevels.empty() ) {
+                        mi = SelectVobLod( mi, lodDistance, lodPixelsPerUnit );
+                    }
+
+                    if ( !windBuffer ) {
+                        float4 radius( drawRadius, 0, 0, 0 );
+                        windBuffer = FillPooledConstantBuffer( VobWindConstantBuffers, numVisualBuffers, &g_windBuffer, sizeof( g_windBuffer ) );
+                        radiusBuffer = FillPooledConstantBuffer( VobRadiusConstantBuffers, numVisualBuffers, &radius, sizeof( radius ) );
+                        numVisualBuffers++;
                     }
 
-                    // Draw batch
-                    DrawInstanced( mi->MeshVertexBuffer, mi->MeshIndexBuffer,
-                        mi->Indices.size(), DynamicInstancingBuffer.get(),
-                        sizeof( VobInstanceInfo ), staticMeshVisual.second->Instances.size(),
-                        sizeof( ExVertexStruct ), staticMeshVisual.second->StartInstanceNum );
+                    draw.Mesh = mi;
+                    draw.WindBuffer = windBuffer;
+                    draw.RadiusBuffer = radiusBuffer;
+                    draw.NumIndices = static_cast<unsigned int>(mi->Indices.size());
+                    draw.NumIndices = maxIndices != 0 ? std::min( draw.NumIndices, maxIndices ) : draw.NumIndices;
+                    draw.NumInstances = static_cast<unsigned int>(staticMeshVisual.second->InstanceSlots.size());
+                    draw.StartInstance = staticMeshVisual.second->StartInstanceNum;
+                    vobDraws.push_back( draw );
+
+                    Engine::GAPI->GetRendererState().RendererInfo.FrameDrawnTriangles += (draw.NumIndices / 3) * draw.NumInstances;
+                    Engine::GAPI->GetRendererState().RendererInfo.FrameDrawnVobs++;
                 }
             }
 
@@ -4811,6 +5208,11 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
                 staticMeshVisual.second->StartNewFrame();
             }
         }
+
+        DrawInstancedVobs( vobDraws, StaticInstanceSlotBuffer.get(), sizeof( unsigned int ) );
+
+        // The draws bound their shaders without going through ActivePS
+        ActivePS->Apply();
     }
 
     // Draw mobs
@@ -4857,10 +5259,16 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
     SetDefaultStates();
 
     SetActivePixelShader( "PS_Simple" );
-    SetActiveVertexShader( "VS_ExInstancedObj" );
+    SetActiveVertexShader( "VS_ExInstancedObjSlots" );
 
     SetupVS_ExMeshDrawCall();
     SetupVS_ExConstantBuffer();
+    BindStaticInstances();
+
+    // The opaque draws left the wind buffer of their last visual bound
+    if ( ActiveVS ) {
+        ActiveVS->GetConstantBuffer()[1]->BindToVertexShader( 1 );
+    }
 
     GetContext()->OMSetRenderTargets( 1, HDRBackBuffer->GetRenderTargetView().GetAddressOf(),
         DepthStencilBuffer->GetDepthStencilView().Get() );
@@ -4925,7 +5333,7 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
 
         // Draw batch
         DrawInstanced( mi->MeshVertexBuffer, mi->MeshIndexBuffer, mi->Indices.size(),
-            DynamicInstancingBuffer.get(), sizeof( VobInstanceInfo ),
+            StaticInstanceSlotBuffer.get(), sizeof( unsigned int ),
             instances, sizeof( ExVertexStruct ),
             vi->StartInstanceNum );
 
@@ -5279,8 +5687,7 @@ void XM_CALLCONV D3D11GraphicsEngine::RenderShadowmaps( FXMVECTOR cameraPosition
     renderParams.DSVOverwrite = dsvOverwrite;
     renderParams.DebugRTV = debugRTV;
     renderParams.CascadeIndex = -1;
-    renderParams.CascadeSplits = std::vector<float>();
-    renderParams.CascadeCameraReplacements = nullptr;
+    renderParams.Casters = nullptr;
 
     ShadowMaps->RenderShadowmaps( renderParams );
 }
@@ -5566,8 +5973,21 @@ void D3D11GraphicsEngine::BindShaderForTexture( zCTexture* texture,
     bool forceAlphaTest,
     int zMatAlphaFunc,
     MaterialInfo::EMaterialType materialInfo ) {
-    auto active = ActivePS;
-    auto newShader = ActivePS;
+    auto newShader = GetShaderForTexture( texture, forceAlphaTest, zMatAlphaFunc, materialInfo );
+
+    // Bind, if changed
+    if ( ActivePS != newShader ) {
+        ActivePS = newShader;
+        ActivePS->Apply();
+    }
+}
+
+/** Returns the shader BindShaderForTexture would bind */
+std::shared_ptr<D3D11PShader> D3D11GraphicsEngine::GetShaderForTexture( zCTexture* texture,
+    bool forceAlphaTest,
+    int zMatAlphaFunc,
+    MaterialInfo::EMaterialType materialInfo ) {
+    std::shared_ptr<D3D11PShader> newShader;
 
     bool blendAdd = zMatAlphaFunc == zMAT_ALPHA_FUNC_ADD;
     bool blendBlend = zMatAlphaFunc == zMAT_ALPHA_FUNC_BLEND;
@@ -5595,10 +6015,49 @@ void D3D11GraphicsEngine::BindShaderForTexture( zCTexture* texture,
         }
     }
 
-    // Bind, if changed
-    if ( active != newShader ) {
-        ActivePS = newShader;
-        ActivePS->Apply();
+    return newShader;
+}
+
+/** Gets the material info of a world mesh texture ready for BindWorldMeshTextures */
+void D3D11GraphicsEngine::PrepareWorldMeshTextures( zCTexture* texture, MaterialInfo* info ) {
+    if ( !info )
+        return;
+
+    // A default normalmap gets bound in case the scene is wet and we currently have none.
+    // Modify the strength of that default normalmap for the material info
+    if ( !texture->GetSurface()->GetNormalmap() && info->buffer.NormalmapStrength != DEFAULT_NORMALMAP_STRENGTH ) {
+        info->buffer.NormalmapStrength = DEFAULT_NORMALMAP_STRENGTH;
+        info->UpdateConstantbuffer();
+    }
+
+    if ( !info->Constantbuffer ) info->UpdateConstantbuffer();
+}
+
+/** Binds diffuse-, normal- and fx-map of a world mesh texture and its material info */
+void D3D11GraphicsEngine::BindWorldMeshTextures( ID3D11DeviceContext* context, zCTexture* texture, MaterialInfo* info ) {
+    MyDirectDrawSurface7* surface = texture->GetSurface();
+    ID3D11ShaderResourceView* srv[3];
+
+    // Get diffuse and normalmap
+    srv[0] = surface->GetEngineTexture()->GetShaderResourceView().Get();
+    srv[1] = surface->GetNormalmap()
+        ? surface->GetNormalmap()->GetShaderResourceView().Get()
+        : nullptr;
+    srv[2] = surface->GetFxMap()
+        ? surface->GetFxMap()->GetShaderResourceView().Get()
+        : nullptr;
+
+    // Bind a default normalmap in case the scene is wet and we currently have
+    // none
+    if ( !srv[1] ) {
+        srv[1] = DistortionTexture->GetShaderResourceView().Get();
+    }
+
+    // Bind both
+    context->PSSetShaderResources( 0, 3, srv );
+
+    if ( info ) {
+        context->PSSetConstantBuffers( 2, 1, info->Constantbuffer->Get().GetAddressOf() );
     }
 }
 
@@ -6206,6 +6665,10 @@ void D3D11GraphicsEngine::UpdateOcclusion() {
     if ( !Engine::GAPI->GetRendererState().RendererSettings.EnableOcclusionCulling )
         return;
 
+    // The software occlusion buffer is drawn in CollectVisibleVobs instead
+    if ( Engine::GAPI->GetRendererState().RendererSettings.EnableSoftwareOcclusionCulling )
+        return;
+
     // Set up states
     Engine::GAPI->GetRendererState().RasterizerState.SetDefault();
     Engine::GAPI->GetRendererState().RasterizerState.CullMode = GothicRasterizerStateInfo::CM_CULL_NONE;
@@ -6224,7 +6687,6 @@ void D3D11GraphicsEngine::UpdateOcclusion() {
     UpdateRenderStates();
 
     // Set up occlusion pass
-    Occlusion->AdvanceFrameCounter();
     Occlusion->BeginOcclusionPass();
 
     // Do occlusiontests for the BSP-Tree
@@ -6232,6 +6694,11 @@ void D3D11GraphicsEngine::UpdateOcclusion() {
     
     Occlusion->EndOcclusionPass();
 
+    GothicRendererInfo& info = Engine::GAPI->GetRendererState().RendererInfo;
+    info.FrameOcclusionQueries = Occlusion->GetStats().Queries;
+    info.FrameOcclusionMultiQueries = Occlusion->GetStats().MultiQueries;
+    info.FrameOcclusionResultsPending = Occlusion->GetStats().ResultsPending;
+
     // Setup default renderstates
     SetDefaultStates();
 }
@@ -4,6 +4,8 @@
 #include "GothicAPI.h"
 #include "D3D11ShadowMap.h"
 #include "D3D11ShaderManager.h"
+#include "RenderQueue.h"
+#include "CommandListScheduler.h"
 
 struct RenderToDepthStencilBuffer;
 
@@ -44,6 +46,8 @@ struct VobLightInfo;
 class GMesh;
 class D3D11HDShader;
 class D3D11OcclusionQuerry;
+class D3D11RenderQueueBackend;
+class D3D11CommandListRecorder;
 struct MeshInfo;
 struct RenderToTextureBuffer;
 class D3D11Effect;
@@ -134,6 +138,18 @@ public:
     /** Puts the current world matrix into a CB and binds it to the given slot */
     void SetupPerInstanceConstantBuffer( int slot = 1 );
 
+    /** Binds the buffers of the wrapped world mesh. If they hold ExVertexStructCompact and the active vertex shader
+        has a variant reading those, it is replaced by that until EndWorldMeshDraws. Other shaders get the world
+        with full vertices, see GothicAPI::GetFullWrappedWorldMesh. */
+    void BeginWorldMeshDraws();
+    void EndWorldMeshDraws();
+
+    /** Wrapped world mesh BeginWorldMeshDraws bound */
+    MeshInfo* GetWorldMeshDrawGeometry() const;
+
+    /** Size of a vertex in the vertex buffers of the world mesh BeginWorldMeshDraws bound */
+    unsigned int GetWorldMeshVertexStride() const;
+
     /** Colorspace for HDR-Monitors on Windows 10 */
     void UpdateColorSpace_SwapChain();
 
@@ -228,9 +244,12 @@ public:
     /** Draws a VOB (used for inventory) */
     virtual void DrawVobSingle( VobInfo* vob, zCCamera& camera ) override;
 
-    /** Draws everything around the given position */
+    /** Draws everything around the given position, or only the given casters of a shadow cascade */
     void XM_CALLCONV DrawWorldAroundForWorldShadow( FXMVECTOR position, float sectionRange, bool cullFront, bool dontCull,
-        const Frustum& frustum);
+        const ShadowCascadeCasters* casters = nullptr );
+
+    /** Adds everything DrawWorldAroundForWorldShadow would draw around the given position to the caster culling */
+    void XM_CALLCONV CollectShadowCasters( FXMVECTOR position, float sectionRange, ShadowCasterCulling& culling );
     void XM_CALLCONV DrawWorldAround( FXMVECTOR position,
         float range,
         bool cullFront = true,
@@ -250,6 +269,13 @@ public:
     /** Draws the static vobs instanced */
     XRESULT DrawVOBsInstanced();
 
+    /** Brings StaticInstanceBuffer up to date with the static instance store and puts the slots of this frames
+        instances into StaticInstanceSlotBuffer, setting the StartInstanceNum of every visual */
+    void UploadStaticInstances( const std::unordered_map<zCProgMeshProto*, MeshVisualInfo*>& staticMeshVisuals );
+
+    /** Binds StaticInstanceBuffer for VS_ExInstancedObjSlots */
+    void BindStaticInstances();
+
     /** Set wind props in const buffer */
     void ApplyWindProps( VS_ExConstantBuffer_Wind& buf );
 
@@ -320,6 +346,15 @@ public:
     /** Binds the right shader for the given texture */
     void BindShaderForTexture( zCTexture* texture, bool forceAlphaTest = false, int zMatAlphaFunc = 0, MaterialInfo::EMaterialType materialInfo = MaterialInfo::MT_None );
 
+    /** Returns the shader BindShaderForTexture would bind */
+    std::shared_ptr<D3D11PShader> GetShaderForTexture( zCTexture* texture, bool forceAlphaTest = false, int zMatAlphaFunc = 0, MaterialInfo::EMaterialType materialInfo = MaterialInfo::MT_None );
+
+    /** Gets the material info of a world mesh texture ready for BindWorldMeshTextures, which can't update it */
+    void PrepareWorldMeshTextures( zCTexture* texture, MaterialInfo* info );
+
+    /** Binds diffuse-, normal- and fx-map of a world mesh texture to slots 0 to 2 and its material info to constant buffer 2 */
+    void BindWorldMeshTextures( ID3D11DeviceContext* context, zCTexture* texture, MaterialInfo* info );
+
     /** Copies the depth stencil buffer to DepthStencilBufferCopy */
     void CopyDepthStencil();
 
@@ -341,6 +376,9 @@ public:
     /** Returns a dummy cube-rendertarget used for pointlight shadowmaps */
     RenderToTextureBuffer* GetDummyCubeRT() { return ShadowMaps ? ShadowMaps->GetDummyCubeRT() : nullptr; }
 
+    /** Returns the point light clusters of the last lighting pass */
+    const LightClusterGrid* GetLightClusters() const { return ShadowMaps ? &ShadowMaps->GetLightClusters() : nullptr; }
+
     void EnsureTempVertexBufferSize( std::unique_ptr<D3D11VertexBuffer>& buffer, UINT size );
 
     float UpdateCustomFontMultiplierFontRendering( float multiplier );
@@ -388,6 +426,20 @@ protected:
     float2 Temp2Float2[2];
     std::unique_ptr<D3D11VertexBuffer> DynamicInstancingBuffer;
 
+    /** Instances of the static vobs a shadow cascade draws, refilled for every cascade */
+    std::unique_ptr<D3D11VertexBuffer> ShadowInstancingBuffer;
+
+    /** Instance data of all static vobs at their slot in the static instance store, only updated where it changed */
+    std::unique_ptr<D3D11VertexBuffer> StaticInstanceBuffer;
+
+    /** Slots of the static vob instances drawn this frame, grouped by visual */
+    std::unique_ptr<D3D11VertexBuffer> StaticInstanceSlotBuffer;
+    std::vector<StaticInstanceStore::SlotRange> StaticInstanceUploadRanges;
+
+    /** Vertex shader to go back to in EndWorldMeshDraws, if BeginWorldMeshDraws switched to a compact variant */
+    std::string VertexShaderBeforeWorldMesh;
+    bool WorldMeshDrawsCompact;
+
     /** Post processing */
     std::unique_ptr<D3D11PfxRenderer> PfxRenderer;
 
@@ -428,6 +480,44 @@ public:
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ReflectionCube;
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ReflectionCube2;
 private:
+    /** One instanced draw of a static vob mesh. Collected on the main thread together with everything it binds,
+        so it can be recorded into any context. */
+    struct InstancedVobDraw {
+        MeshInfo* Mesh;
+
+        /** Pixel shader to bind, none for depth only */
+        D3D11PShader* Shader;
+
+        /** Bound to the pixel shader from slot 0. Without any, the textures bound before are kept. */
+        ID3D11ShaderResourceView* TextureViews[3];
+        unsigned int NumTextureViews;
+
+        /** Material info for slot 2 of the pixel shader and draw radius for slot 3, kept from before if not set */
+        D3D11ConstantBuffer* MaterialBuffer;
+        D3D11ConstantBuffer* RadiusBuffer;
+
+        /** Wind parameters of the visual for slot 1 of the vertex shader */
+        D3D11ConstantBuffer* WindBuffer;
+
+        unsigned int NumIndices;
+        unsigned int NumInstances;
+        unsigned int StartInstance;
+    };
+
+    /** Deferred contexts for EnableParallelDrawRecording, created when it is first used. nullptr while it is off. */
+    D3D11CommandListRecorder* GetCommandListRecorder();
+
+    /** Fills the index-th buffer of the pool, which gets created when it is first used */
+    D3D11ConstantBuffer* FillPooledConstantBuffer( std::vector<std::unique_ptr<D3D11ConstantBuffer>>& pool, unsigned int index, const void* data, UINT size );
+
+    /** Draws the vob draws in order, recorded on the worker threads if there are enough of them. Everything they
+        use must already be uploaded. Leaves the state of the context undefined for the bindings of the draws. */
+    void DrawInstancedVobs( const std::vector<InstancedVobDraw>& draws, D3D11VertexBuffer* instanceBuffer, UINT instanceStride );
+
+    /** Records the draws into the context, binding only what changed from the draw before */
+    static void RecordInstancedVobDraws( ID3D11DeviceContext* context, const InstancedVobDraw* draws, unsigned int count,
+        ID3D11Buffer* instanceBuffer, UINT instanceStride );
+
     /** World-Mesh indirect buffer */
     std::unique_ptr<D3D11IndirectBuffer> WorldMeshIndirectBuffer;
 
@@ -443,6 +533,19 @@ private:
     /** Occlusion query manager */
     std::unique_ptr<D3D11OcclusionQuerry> Occlusion;
 
+    /** Draws of the world mesh, collected and replayed every frame. One backend per recording context. */
+    RenderQueue WorldMeshQueue;
+    std::vector<std::unique_ptr<D3D11RenderQueueBackend>> WorldMeshQueueBackends;
+
+    std::unique_ptr<D3D11CommandListRecorder> CommandListRecorder;
+    CommandListScheduler CommandListJobs;
+
+    /** Wind parameters and draw radius of every visual drawn by DrawInstancedVobs, refilled for each pass.
+        Spacer helper vobs get their color from a material buffer each. */
+    std::vector<std::unique_ptr<D3D11ConstantBuffer>> VobWindConstantBuffers;
+    std::vector<std::unique_ptr<D3D11ConstantBuffer>> VobRadiusConstantBuffers;
+    std::vector<std::unique_ptr<D3D11ConstantBuffer>> VobHelperConstantBuffers;
+
     /** Temporary vertex buffers */
     std::unique_ptr<D3D11VertexBuffer> TempPolysVertexBuffer;
     std::unique_ptr<D3D11VertexBuffer> TempParticlesVertexBuffer;
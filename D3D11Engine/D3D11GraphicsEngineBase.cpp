@@ -405,6 +405,7 @@ XRESULT D3D11GraphicsEngineBase::SetActivePixelShader( const std::string& shader
 
 XRESULT D3D11GraphicsEngineBase::SetActiveVertexShader( const std::string& shader ) {
     ActiveVS = ShaderManager->GetVShader( shader );
+    ActiveVSName = shader;
     return XR_SUCCESS;
 }
 
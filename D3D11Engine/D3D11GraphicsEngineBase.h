@@ -192,6 +192,7 @@ protected:
     std::shared_ptr<D3D11PShader> PS_WaterfallFoam;
 
     std::shared_ptr<D3D11VShader> ActiveVS;
+    std::string ActiveVSName;
     std::shared_ptr<D3D11PShader> ActivePS;
     std::shared_ptr<D3D11HDShader> ActiveHDS;
     std::shared_ptr<D3D11GShader> ActiveGS;
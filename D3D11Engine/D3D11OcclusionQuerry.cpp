@@ -7,11 +7,7 @@
 #include "Toolbox.h"
 #include "zCCamera.h"
 
-// Delay to recheck visible objects for occlusion
-const int VISIBLE_RECHECK_FRAME_DELAY = 1;
-
 D3D11OcclusionQuerry::D3D11OcclusionQuerry() {
-    FrameID = 0;
 }
 
 D3D11OcclusionQuerry::~D3D11OcclusionQuerry() {
@@ -38,100 +34,129 @@ unsigned int D3D11OcclusionQuerry::AddPredicationObject() {
     return Predicates.size() - 1;
 }
 
+/** Numbers the nodes of the given tree for the scheduler */
+void D3D11OcclusionQuerry::BuildSchedulerTree( BspInfo* root ) {
+    SchedulerNodes.clear();
+    std::vector<OcclusionQueryScheduler::TreeNode> tree;
+
+    // Depth first, so the scheduler walks the nodes of a subtree one after another
+    std::vector<std::pair<BspInfo*, unsigned int>> stack;
+    stack.emplace_back( root, OcclusionQueryScheduler::NO_NODE );
+    while ( !stack.empty() ) {
+        BspInfo* node = stack.back().first;
+        const unsigned int parent = stack.back().second;
+        stack.pop_back();
+
+        if ( !node || !node->OriginalNode )
+            continue;
+
+        const unsigned int index = static_cast<unsigned int>(tree.size());
+        node->OcclusionInfo.QueryID = static_cast<int>(index);
+        SchedulerNodes.push_back( node );
+        tree.push_back( { parent, OcclusionQueryScheduler::NO_NODE, OcclusionQueryScheduler::NO_NODE, node->OriginalNode->IsLeaf() } );
+
+        if ( parent != OcclusionQueryScheduler::NO_NODE ) {
+            if ( SchedulerNodes[parent]->Front == node )
+                tree[parent].Front = index;
+            else
+                tree[parent].Back = index;
+        }
+
+        stack.emplace_back( node->Back, index );
+        stack.emplace_back( node->Front, index );
+    }
+
+    Scheduler.SetTree( tree );
+
+    // Queries in flight belonged to the old tree, their results aren't needed anymore
+    FreePredicates.clear();
+    for ( unsigned int i = 0; i < Predicates.size(); i++ ) {
+        FreePredicates.push_back( i );
+    }
+}
+
 /** Checks the BSP-Tree for visibility */
 void D3D11OcclusionQuerry::DoOcclusionForBSP( BspInfo* root ) {
     if ( !root || !root->OriginalNode )
         return;
 
-    D3D11GraphicsEngine* g = reinterpret_cast<D3D11GraphicsEngine*>(Engine::GraphicsEngine);
+    // Nodes of a new tree don't have their index yet
+    if ( SchedulerNodes.empty() || SchedulerNodes[0] != root || root->OcclusionInfo.QueryID != 0 ) {
+        BuildSchedulerTree( root );
+    }
 
-    // Check if this node has it's queryID
-    if ( root->OcclusionInfo.QueryID == -1 ) {
-        // Add new object
-        root->OcclusionInfo.QueryID = AddPredicationObject();
+    Scheduler.Update( *this );
 
-        // Create the occlusion-mesh for the node
-        CreateOcclusionNodeMeshFor( root );
+    for ( unsigned int i = 0; i < SchedulerNodes.size(); i++ ) {
+        SchedulerNodes[i]->OcclusionInfo.VisibleLastFrame = Scheduler.IsNodeVisible( i );
     }
+}
+
+/** Classifies the node for the current frame */
+EOcclusionNodeState D3D11OcclusionQuerry::GetNodeState( unsigned int node ) {
+    BspInfo* info = SchedulerNodes[node];
 
-    // Check last frustum-culling state
+    // Save the frustum-culling state, vob collection uses it instead of testing again
     int clipFlags = 63;
-    int fstate = zCCamera::GetCamera()->BBox3DInFrustum( root->OriginalNode->BBox3D, clipFlags );
+    const int fstate = zCCamera::GetCamera()->BBox3DInFrustum( info->OriginalNode->BBox3D, clipFlags );
+    info->OcclusionInfo.LastCameraClipType = fstate;
+    if ( fstate == ZTCAM_CLIPTYPE_OUT )
+        return OCCLUSION_NODE_OUTSIDE;
+
+    // Take those which have the camera inside as visible
+    // Also make leafs which don't contain anything just visible so we can save the draw-call
+    if ( Toolbox::PositionInsideBox( Engine::GAPI->GetCameraPosition(), info->OriginalNode->BBox3D.Min, info->OriginalNode->BBox3D.Max ) ||
+        (info->IsEmpty() && info->OriginalNode->IsLeaf()) ) {
+        return OCCLUSION_NODE_ALWAYS_VISIBLE;
+    }
 
-    // If this node wasn't inside the frustum last frame, but got inside it this frame, just draw it
-    // to reduce the popping in dialogs where the camera switches heavily between targets
-    // This may introduce a little framedrop when the camera switches targets, but it has to be ok.
-    if ( root->OcclusionInfo.LastCameraClipType == ZTCAM_CLIPTYPE_OUT && fstate != ZTCAM_CLIPTYPE_OUT ) {
-        // Mark entire subtree visible
-        MarkTreeVisible( root->Front, true );
-        MarkTreeVisible( root->Back, true );
+    return OCCLUSION_NODE_TESTABLE;
+}
 
-        root->OcclusionInfo.VisibleLastFrame = true;
-        root->OcclusionInfo.LastVisitedFrameID = FrameID;
+/** Starts one query drawing the boxes of all given nodes */
+unsigned int D3D11OcclusionQuerry::IssueQuery( const unsigned int* nodes, unsigned int numNodes ) {
+    D3D11GraphicsEngine* g = reinterpret_cast<D3D11GraphicsEngine*>(Engine::GraphicsEngine);
 
-        // Save this for the next frame
-        root->OcclusionInfo.LastCameraClipType = fstate;
-        return;
+    unsigned int query;
+    if ( !FreePredicates.empty() ) {
+        query = FreePredicates.back();
+        FreePredicates.pop_back();
+    } else {
+        query = AddPredicationObject();
     }
 
-    // Save this
-    root->OcclusionInfo.LastCameraClipType = fstate;
-
-    // If the node wasn't visible last frame, we need to test it again
-    // Invisible nodes need to be tested each frame in case they go visible
-    // Visible nodes don't need to be tested every frame
-    if ( !root->OcclusionInfo.VisibleLastFrame ||
-        (root->OcclusionInfo.LastVisitedFrameID + VISIBLE_RECHECK_FRAME_DELAY <= FrameID && root->OcclusionInfo.VisibleLastFrame) ) {
-
-        // Take those which have the camera inside as visible
-        // Also make leafs which don't contain anything just visible so we can save the draw-call
-        if ( Toolbox::PositionInsideBox( Engine::GAPI->GetCameraPosition(), root->OriginalNode->BBox3D.Min, root->OriginalNode->BBox3D.Max ) ||
-            (root->IsEmpty() && root->OriginalNode->IsLeaf()) ) {
-            DoOcclusionForBSP( root->Front );
-            DoOcclusionForBSP( root->Back );
-
-            root->OcclusionInfo.VisibleLastFrame = true;
-            root->OcclusionInfo.LastVisitedFrameID = FrameID;
-            return;
-        }
-        
-        ID3D11Predicate* p = Predicates[root->OcclusionInfo.QueryID];
-        
-        // Query is done. Save the result!
-        UINT32 data = 0;
-        if ( g->GetContext()->GetData( p, &data, sizeof( UINT32 ), D3D11_ASYNC_GETDATA_DONOTFLUSH ) == S_OK ) {
-            root->OcclusionInfo.VisibleLastFrame = (data > 0); // data contains visible pixels of the object
-
-            if ( data == 0 ) {
-                // Mark entire subtree invisible and don't waste draw-calls for it
-                MarkTreeVisible( root->Front, false );
-                MarkTreeVisible( root->Back, false );
-            } else {
-                // Try to check the next nodes as well
-                DoOcclusionForBSP( root->Front );
-                DoOcclusionForBSP( root->Back );
-            }
-
-            root->OcclusionInfo.QueryInProgress = false;
-        } else {
-            // Try to check the next nodes as well
-            DoOcclusionForBSP( root->Front );
-            DoOcclusionForBSP( root->Back );
+    ID3D11Predicate* p = Predicates[query];
+    g->GetContext()->Begin( p );
+    for ( unsigned int i = 0; i < numNodes; i++ ) {
+        BspInfo* node = SchedulerNodes[nodes[i]];
+        if ( !node->OcclusionInfo.NodeMesh ) {
+            // Create the occlusion-mesh for the node
+            CreateOcclusionNodeMeshFor( node );
         }
 
-        if ( !root->OcclusionInfo.QueryInProgress ) {
-            // Issue the new query
-            MeshInfo* mi = root->OcclusionInfo.NodeMesh;
+        MeshInfo* mi = node->OcclusionInfo.NodeMesh;
+        g->DrawVertexBufferIndexed( mi->MeshVertexBuffer, mi->MeshIndexBuffer, mi->Indices.size() );
+    }
+    g->GetContext()->End( p );
 
-            g->GetContext()->Begin( p );
-            g->DrawVertexBufferIndexed( mi->MeshVertexBuffer, mi->MeshIndexBuffer, mi->Indices.size() );
-            g->GetContext()->End( p );
+    return query;
+}
 
-            root->OcclusionInfo.QueryInProgress = true;
-        }
+/** Returns true and whether any sample passed if the result of the query is there */
+bool D3D11OcclusionQuerry::GetQueryResult( unsigned int query, bool& outVisible ) {
+    D3D11GraphicsEngine* g = reinterpret_cast<D3D11GraphicsEngine*>(Engine::GraphicsEngine);
 
-        root->OcclusionInfo.LastVisitedFrameID = FrameID;
-    }
+    UINT32 data = 0;
+    if ( g->GetContext()->GetData( Predicates[query], &data, sizeof( UINT32 ), D3D11_ASYNC_GETDATA_DONOTFLUSH ) != S_OK )
+        return false;
+
+    outVisible = data > 0; // data contains visible pixels of the object
+    return true;
+}
+
+/** The predicate can be given out again */
+void D3D11OcclusionQuerry::ReleaseQuery( unsigned int query ) {
+    FreePredicates.push_back( query );
 }
 
 /** Begins the occlusion-checks */
@@ -153,11 +178,6 @@ void D3D11OcclusionQuerry::EndOcclusionPass() {
 
 }
 
-/** Advances the frame counter of this */
-void D3D11OcclusionQuerry::AdvanceFrameCounter() {
-    FrameID++;
-}
-
 /** Creates the occlusion-node-mesh for the specific bsp-node */
 void D3D11OcclusionQuerry::CreateOcclusionNodeMeshFor( BspInfo* node ) {
     MeshInfo* mi = new MeshInfo;
@@ -224,15 +244,3 @@ void D3D11OcclusionQuerry::DebugVisualizeNodeMesh( MeshInfo* m, const XMFLOAT4&
 
     }
 }
-
-/** Marks the entire subtree visible */
-void D3D11OcclusionQuerry::MarkTreeVisible( BspInfo* root, bool visible ) {
-    if ( !root || !root->OriginalNode )
-        return;
-
-    root->OcclusionInfo.LastVisitedFrameID = FrameID;
-    root->OcclusionInfo.VisibleLastFrame = visible;
-
-    MarkTreeVisible( root->Front, visible );
-    MarkTreeVisible( root->Back, visible );
-}
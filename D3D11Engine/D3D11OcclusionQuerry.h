@@ -1,17 +1,16 @@
 #pragma once
 #include "pch.h"
+#include "OcclusionQueryScheduler.h"
 
-/** This class can handle the occlusion-querrys for the BSP-Tree */
+/** This class can handle the occlusion-querrys for the BSP-Tree. Which nodes get a query is up to
+    the OcclusionQueryScheduler, this draws the queries and keeps the visibility of the nodes. */
 struct BspInfo;
 struct MeshInfo;
-class D3D11OcclusionQuerry {
+class D3D11OcclusionQuerry : public BaseOcclusionQueryBackend {
 public:
     D3D11OcclusionQuerry();
     ~D3D11OcclusionQuerry();
 
-    /** Advances the frame counter of this */
-    void AdvanceFrameCounter();
-
     /** Begins the occlusion-checks */
     void BeginOcclusionPass();
 
@@ -26,17 +25,29 @@ public:
 
     /** Creates the occlusion-node-mesh for the specific bsp-node */
     void CreateOcclusionNodeMeshFor( BspInfo* node );
-private:
 
-    /** Marks the entire subtree visible */
-    void MarkTreeVisible( BspInfo* root, bool visible );
+    /** Counters of the last DoOcclusionForBSP */
+    const OcclusionQueryStats& GetStats() const { return Scheduler.GetStats(); }
+
+    /** BaseOcclusionQueryBackend */
+    EOcclusionNodeState GetNodeState( unsigned int node ) override;
+    unsigned int IssueQuery( const unsigned int* nodes, unsigned int numNodes ) override;
+    bool GetQueryResult( unsigned int query, bool& outVisible ) override;
+    void ReleaseQuery( unsigned int query ) override;
+
+private:
+    /** Numbers the nodes of the given tree for the scheduler */
+    void BuildSchedulerTree( BspInfo* root );
 
     void DebugVisualizeNodeMesh( MeshInfo* m, const XMFLOAT4& color );
 
     /** Simple box predicate */
     std::vector<ID3D11Predicate*> Predicates;
 
-    /** Current frame */
-    unsigned int FrameID;
-};
+    /** Predicates not in use by any query */
+    std::vector<unsigned int> FreePredicates;
 
+    /** Node of every index the scheduler knows, their QueryID is that index */
+    std::vector<BspInfo*> SchedulerNodes;
+    OcclusionQueryScheduler Scheduler;
+};
@@ -0,0 +1,93 @@
+#include "pch.h"
+#include "D3D11RenderQueueBackend.h"
+#include "Engine.h"
+#include "D3D11GraphicsEngine.h"
+#include "D3D11PShader.h"
+#include "D3D11VertexBuffer.h"
+#include "GothicAPI.h"
+
+D3D11RenderQueueBackend::D3D11RenderQueueBackend( D3D11GraphicsEngine* engine ) {
+    GraphicsEngine = engine;
+    Context = nullptr;
+    ColorPassShader = nullptr;
+    Pass = PASS_COLOR;
+    DrawnTriangles = 0;
+}
+
+/** Sets the context to record into and the shader the color pass starts with */
+void D3D11RenderQueueBackend::Begin( ID3D11DeviceContext* context, D3D11PShader* colorPassShader ) {
+    Context = context;
+    ColorPassShader = colorPassShader;
+    DrawnTriangles = 0;
+}
+
+void D3D11RenderQueueBackend::BeginPass( unsigned int pass ) {
+    Pass = pass;
+
+    ID3D11PixelShader* shader = Pass == PASS_DEPTH ? nullptr : ColorPassShader->GetShader().Get();
+    Context->PSSetShader( shader, nullptr, 0 );
+}
+
+void D3D11RenderQueueBackend::BindShader( const RenderPacket& packet ) {
+    if ( Pass == PASS_DEPTH || Engine::GAPI->GetRendererState().RendererSettings.DrawWorldMesh <= 1 )
+        return;
+
+    Context->PSSetShader( static_cast<D3D11PShader*>(packet.Shader)->GetShader().Get(), nullptr, 0 );
+}
+
+void D3D11RenderQueueBackend::BindMaterial( const RenderPacket& packet ) {
+    if ( Pass == PASS_DEPTH || Engine::GAPI->GetRendererState().RendererSettings.DrawWorldMesh <= 1 )
+        return;
+
+    const MeshKey* key = static_cast<const MeshKey*>(packet.Data);
+    GraphicsEngine->BindWorldMeshTextures( Context, static_cast<zCTexture*>(packet.Material), key->Info );
+}
+
+void D3D11RenderQueueBackend::BindGeometry( const RenderPacket& packet ) {
+    MeshInfo* mesh = static_cast<MeshInfo*>(packet.Geometry);
+
+    UINT offset = 0;
+    UINT stride = GraphicsEngine->GetWorldMeshVertexStride();
+    Context->IASetVertexBuffers( 0, 1, mesh->MeshVertexBuffer->GetVertexBuffer().GetAddressOf(), &stride, &offset );
+    Context->IASetIndexBuffer( mesh->MeshIndexBuffer->GetVertexBuffer().Get(), DXGI_FORMAT_R32_UINT, 0 );
+}
+
+void D3D11RenderQueueBackend::Draw( const RenderPacket& packet ) {
+    if ( Pass == PASS_COLOR && Engine::GAPI->GetRendererState().RendererSettings.DrawWorldMesh <= 2 )
+        return;
+
+    Context->DrawIndexed( packet.NumIndices, packet.FirstIndex, 0 );
+    DrawnTriangles += packet.NumIndices / 3;
+}
+
+D3D11RenderQueuePrepareBackend::D3D11RenderQueuePrepareBackend( D3D11GraphicsEngine* engine ) {
+    GraphicsEngine = engine;
+    Pass = D3D11RenderQueueBackend::PASS_COLOR;
+    LastInfo = nullptr;
+}
+
+void D3D11RenderQueuePrepareBackend::BeginPass( unsigned int pass ) {
+    Pass = pass;
+    LastInfo = nullptr;
+}
+
+void D3D11RenderQueuePrepareBackend::BindMaterial( const RenderPacket& packet ) {
+    if ( Pass == D3D11RenderQueueBackend::PASS_DEPTH )
+        return;
+
+    LastInfo = static_cast<const MeshKey*>(packet.Data)->Info;
+    GraphicsEngine->PrepareWorldMeshTextures( static_cast<zCTexture*>(packet.Material), LastInfo );
+}
+
+void D3D11RenderQueuePrepareBackend::Draw( const RenderPacket& packet ) {
+    if ( Pass == D3D11RenderQueueBackend::PASS_DEPTH )
+        return;
+
+    // Meshes sharing an animated texture can come with different material infos. A recording job starting
+    // in the middle of such a run binds the info of its first packet, so every one of them gets prepared.
+    MaterialInfo* info = static_cast<const MeshKey*>(packet.Data)->Info;
+    if ( info != LastInfo ) {
+        LastInfo = info;
+        GraphicsEngine->PrepareWorldMeshTextures( static_cast<zCTexture*>(packet.Material), info );
+    }
+}
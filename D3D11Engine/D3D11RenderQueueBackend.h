@@ -0,0 +1,58 @@
+#pragma once
+#include "pch.h"
+#include "RenderQueue.h"
+
+class D3D11GraphicsEngine;
+class D3D11PShader;
+struct MaterialInfo;
+
+/** Draws world mesh packets of a RenderQueue into any context, so ranges of the queue can be recorded on several
+    threads. Geometry is the MeshInfo holding the world mesh buffers, Shader the D3D11PShader, Material the zCTexture to bind
+    and Data the MeshKey of the mesh, whose material info has to be prepared by D3D11RenderQueuePrepareBackend. */
+class D3D11RenderQueueBackend : public BaseRenderQueueBackend {
+public:
+    enum EPass {
+        /** Depth only, without pixel shader and textures */
+        PASS_DEPTH,
+        PASS_COLOR,
+    };
+
+    D3D11RenderQueueBackend( D3D11GraphicsEngine* engine );
+
+    /** Sets the context to record into and the shader the color pass starts with, and resets the counters */
+    void Begin( ID3D11DeviceContext* context, D3D11PShader* colorPassShader );
+
+    /** Triangles drawn since Begin */
+    unsigned int GetDrawnTriangles() const { return DrawnTriangles; }
+
+    void BeginPass( unsigned int pass ) override;
+    void BindShader( const RenderPacket& packet ) override;
+    void BindMaterial( const RenderPacket& packet ) override;
+    void BindGeometry( const RenderPacket& packet ) override;
+    void Draw( const RenderPacket& packet ) override;
+
+private:
+    D3D11GraphicsEngine* GraphicsEngine;
+    ID3D11DeviceContext* Context;
+    D3D11PShader* ColorPassShader;
+    unsigned int Pass;
+    unsigned int DrawnTriangles;
+};
+
+/** Replays a sorted world mesh queue on the main thread before it is drawn, to call PrepareWorldMeshTextures once per
+    material instead of once per mesh. Draws nothing. */
+class D3D11RenderQueuePrepareBackend : public BaseRenderQueueBackend {
+public:
+    D3D11RenderQueuePrepareBackend( D3D11GraphicsEngine* engine );
+
+    void BeginPass( unsigned int pass ) override;
+    void BindShader( const RenderPacket& packet ) override {}
+    void BindMaterial( const RenderPacket& packet ) override;
+    void BindGeometry( const RenderPacket& packet ) override {}
+    void Draw( const RenderPacket& packet ) override;
+
+private:
+    D3D11GraphicsEngine* GraphicsEngine;
+    unsigned int Pass;
+    MaterialInfo* LastInfo;
+};
@@ -203,6 +203,19 @@ XRESULT D3D11ShaderManager::Init() {
     Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerFrame ) );
     Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerInstance ) );
 
+    // Variants of the world mesh shaders reading ExVertexStructCompact, see D3D11GraphicsEngine::BeginWorldMeshDraws
+    makros.push_back( D3D_SHADER_MACRO{ "COMPACT_VERTICES", "1" } );
+    Shaders.push_back( ShaderInfo( "VS_ExCompact", "VS_Ex.hlsl", "v", 14, makros ) );
+    Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerFrame ) );
+    Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerInstance ) );
+    Shaders.back().cBufferSizes.push_back( sizeof( CompactVertexQuantization ) );
+
+    Shaders.push_back( ShaderInfo( "VS_ExWaterCompact", "VS_ExWater.hlsl", "v", 14, makros ) );
+    Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerFrame ) );
+    Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerInstance ) );
+    Shaders.back().cBufferSizes.push_back( sizeof( CompactVertexQuantization ) );
+    makros.clear();
+
     Shaders.push_back( ShaderInfo( "VS_ParticlePoint", "VS_ParticlePoint.hlsl", "v", 11 ) );
     Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerFrame ) );
     Shaders.back().cBufferSizes.push_back( sizeof( ParticleGSInfoConstantBuffer ) );
@@ -240,6 +253,13 @@ XRESULT D3D11ShaderManager::Init() {
     Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerFrame ) );
     Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_Wind ) );
 
+    // Same as VS_ExInstancedObj, but only gets the slots of the instances in the static instance buffer
+    makros.push_back( D3D_SHADER_MACRO{ "INSTANCE_SLOTS", "1" } );
+    Shaders.push_back( ShaderInfo( "VS_ExInstancedObjSlots", "VS_ExInstancedObj.hlsl", "v", 12, makros ) );
+    Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerFrame ) );
+    Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_Wind ) );
+    makros.clear();
+
 
     Shaders.push_back( ShaderInfo( "VS_ExInstanced", "VS_ExInstanced.hlsl", "v", 4 ) );
     Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerFrame ) );
@@ -518,6 +538,13 @@ XRESULT D3D11ShaderManager::Init() {
         Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerFrame ) );
         Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerInstance ) );
 
+        makros.push_back( D3D_SHADER_MACRO{ "COMPACT_VERTICES", "1" } );
+        Shaders.push_back( ShaderInfo( "VS_ExLayeredCompact", "VS_ExLayered.hlsl", "v", 14, makros ) );
+        Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerFrame ) );
+        Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerInstance ) );
+        Shaders.back().cBufferSizes.push_back( sizeof( CompactVertexQuantization ) );
+        makros.clear();
+
         Shaders.push_back( ShaderInfo( "VS_ExNodeLayered", "VS_ExNodeLayered.hlsl", "v", 1 ) );
         Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerFrame ) );
         Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerInstanceNode ) );
@@ -534,6 +561,13 @@ XRESULT D3D11ShaderManager::Init() {
         Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerFrame ) );
         Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerInstance ) );
 
+        makros.push_back( D3D_SHADER_MACRO{ "COMPACT_VERTICES", "1" } );
+        Shaders.push_back( ShaderInfo( "VS_ExCubeCompact", "VS_ExCube.hlsl", "v", 14, makros ) );
+        Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerFrame ) );
+        Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerInstance ) );
+        Shaders.back().cBufferSizes.push_back( sizeof( CompactVertexQuantization ) );
+        makros.clear();
+
         Shaders.push_back( ShaderInfo( "VS_ExNodeCube", "VS_ExNodeCube.hlsl", "v", 1 ) );
         Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerFrame ) );
         Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerInstanceNode ) );
@@ -25,6 +25,8 @@ extern bool FeatureRTArrayIndexFromAnyShader;
 const float NUM_FRAME_SHADOW_UPDATES = 2;  // Fraction of lights to update per frame
 const int NUM_MIN_FRAME_SHADOW_UPDATES = 4;  // Minimum lights to update per frame
 const int MAX_IMPORTANT_LIGHT_UPDATES = 1;
+const float CASCADE_NEAR_Z = 1.0f; // Depth range of the cascade projections in light space
+const float CASCADE_FAR_Z = 20000.0f;
 
 D3D11ShadowMap::D3D11ShadowMap() {}
 
@@ -290,13 +292,17 @@ XRESULT D3D11ShadowMap::DrawLighting( std::vector<VobLightInfo*>& lights ) {
         for ( size_t i = 0; i < numCascades; ++i ) {
             XMStoreFloat4x4( &cascadeCRs[i].ViewReplacement, XMMatrixTranspose( XMMatrixLookAtLH( p, lookAt, c_XM_Up ) ) );
             XMStoreFloat4x4( &cascadeCRs[i].ProjectionReplacement, XMMatrixTranspose( XMMatrixOrthographicLH(
-                farPlane, farPlane, 1.0f, 20000.f ) ) );
+                farPlane, farPlane, CASCADE_NEAR_Z, CASCADE_FAR_Z ) ) );
             XMStoreFloat3( &cascadeCRs[i].PositionReplacement, p );
             XMStoreFloat3( &cascadeCRs[i].LookAtReplacement, lookAt );
         }
     } else {
         lastBspMode = zBSP_MODE_OUTDOOR;
 
+        XMFLOAT3 cascadeMin[MAX_CSM_CASCADES];
+        XMFLOAT3 cascadeMax[MAX_CSM_CASCADES];
+        float cascadeTexelSize[MAX_CSM_CASCADES];
+
         // *** RENDER EACH CASCADE mit korrekter Matrix ***
         for ( size_t cascadeIdx = 0; cascadeIdx < numCascades; ++cascadeIdx ) {
             // Cascade-spezifische Größe basierend auf Split-Verhältnis
@@ -335,13 +341,64 @@ XRESULT D3D11ShadowMap::DrawLighting( std::vector<VobLightInfo*>& lights ) {
 
             const XMMATRIX crViewRepl = XMMatrixTranspose( snappedLightView );
             const XMMATRIX crProjRepl = XMMatrixTranspose( XMMatrixOrthographicLH(
-                cascadeSize, cascadeSize, 1.0f, 20000.f ) );
+                cascadeSize, cascadeSize, CASCADE_NEAR_Z, CASCADE_FAR_Z ) );
 
             XMStoreFloat4x4( &cascadeCRs[cascadeIdx].ViewReplacement, crViewRepl );
             XMStoreFloat4x4( &cascadeCRs[cascadeIdx].ProjectionReplacement, crProjRepl );
             XMStoreFloat3( &cascadeCRs[cascadeIdx].PositionReplacement, p );
             XMStoreFloat3( &cascadeCRs[cascadeIdx].LookAtReplacement, lookAt );
 
+            // The box this cascade renders, in the unsnapped light space all cascades share
+            cascadeMin[cascadeIdx] = XMFLOAT3( -0.5f * cascadeSize - snapOffsetF.x, -0.5f * cascadeSize - snapOffsetF.y, CASCADE_NEAR_Z );
+            cascadeMax[cascadeIdx] = XMFLOAT3( 0.5f * cascadeSize - snapOffsetF.x, 0.5f * cascadeSize - snapOffsetF.y, CASCADE_FAR_Z );
+            cascadeTexelSize[cascadeIdx] = texelSize;
+        }
+
+        // Sort the casters into the cascades once, instead of culling everything again for every cascade
+        const bool cullCasters = Engine::GAPI->GetRendererState().RendererSettings.IsShadowFrustumCullingEnabled();
+        if ( cullCasters ) {
+            const XMMATRIX lightView = XMMatrixLookAtLH( p, lookAt, c_XM_Up );
+            m_casterCulling.Begin( lightView, numCascades );
+
+            // Aggressive culling only keeps receivers the camera can see. Anything a cascade covers counts otherwise.
+            XMFLOAT3 viewMin( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+            XMFLOAT3 viewMax( FLT_MAX, FLT_MAX, FLT_MAX );
+            if ( Engine::GAPI->GetRendererState().RendererSettings.ShadowFrustumCullingMode == GothicRendererSettings::E_ShadowFrustumCulling::SHD_FRUSTUM_CULLING_AGGRESSIVE ) {
+                const XMFLOAT4X4& proj = Engine::GAPI->GetProjectionMatrix();
+                const XMMATRIX cameraToLight = XMMatrixInverse( nullptr, XMMatrixTranspose( Engine::GAPI->GetViewMatrixXM() ) ) * lightView;
+
+                XMVECTOR cornerMin = g_XMFltMax;
+                XMVECTOR cornerMax = -g_XMFltMax;
+                for ( int i = 0; i < 8; i++ ) {
+                    const float z = (i & 4) ? splits[numCascades] : nearPlane;
+                    const XMVECTOR corner = XMVectorSet( ((i & 1) ? z : -z) / proj._11, ((i & 2) ? z : -z) / proj._22, z, 1.0f );
+                    const XMVECTOR cornerLight = XMVector3TransformCoord( corner, cameraToLight );
+                    cornerMin = XMVectorMin( cornerMin, cornerLight );
+                    cornerMax = XMVectorMax( cornerMax, cornerLight );
+                }
+                XMStoreFloat3( &viewMin, cornerMin );
+                XMStoreFloat3( &viewMax, cornerMax );
+            }
+
+            for ( size_t cascadeIdx = 0; cascadeIdx < numCascades; ++cascadeIdx ) {
+                // Filtering reads a few texels around the receivers
+                const float border = cascadeTexelSize[cascadeIdx] * 4.0f;
+                const XMFLOAT3 receiverMin(
+                    std::max( cascadeMin[cascadeIdx].x, viewMin.x ) - border,
+                    std::max( cascadeMin[cascadeIdx].y, viewMin.y ) - border,
+                    std::max( cascadeMin[cascadeIdx].z, viewMin.z ) );
+                const XMFLOAT3 receiverMax(
+                    std::min( cascadeMax[cascadeIdx].x, viewMax.x ) + border,
+                    std::min( cascadeMax[cascadeIdx].y, viewMax.y ) + border,
+                    std::min( cascadeMax[cascadeIdx].z, viewMax.z ) );
+
+                m_casterCulling.SetCascade( static_cast<unsigned int>(cascadeIdx), receiverMin, receiverMax, CASCADE_NEAR_Z );
+            }
+
+            graphicsEngine->CollectShadowCasters( WorldShadowCP, 2, m_casterCulling );
+        }
+
+        for ( size_t cascadeIdx = 0; cascadeIdx < numCascades; ++cascadeIdx ) {
             // Render diese Cascade using the new CascadedShadowMap
             Engine::GAPI->SetCameraReplacementPtr( &cascadeCRs[cascadeIdx] );
 
@@ -354,8 +411,7 @@ XRESULT D3D11ShadowMap::DrawLighting( std::vector<VobLightInfo*>& lights ) {
             renderParams.DSVOverwrite = GetCascadeDSV( static_cast<UINT>(cascadeIdx) );
             renderParams.DebugRTV = nullptr;
             renderParams.CascadeIndex = static_cast<int>(cascadeIdx);
-            renderParams.CascadeSplits = splits;
-            renderParams.CascadeCameraReplacements = &cascadeCRs;
+            renderParams.Casters = cullCasters ? &m_casterCulling.GetCasters( static_cast<unsigned int>(cascadeIdx) ) : nullptr;
 
             RenderShadowmaps( renderParams );
 
@@ -425,8 +481,34 @@ XRESULT D3D11ShadowMap::DrawLighting( std::vector<VobLightInfo*>& lights ) {
     graphicsEngine->GetGBuffer2().BindToPixelShader( m_context.Get(), 7 );
     graphicsEngine->GetDepthBufferCopy()->BindToPixelShader( m_context.Get(), 2 );
 
+    // Bin the lights into the clusters of the view frustum first. A light touching none of them can't reach
+    // any pixel on screen. Animating them here already, since that can change the range.
+    const bool lightClusters = Engine::GAPI->GetRendererState().RendererSettings.EnableLightClusters;
+    if ( lightClusters ) {
+        m_lightSpheres.resize( lights.size() );
+        for ( size_t i = 0; i < lights.size(); i++ ) {
+            zCVobLight* vob = lights[i]->Vob;
+            if ( !vob->IsEnabled() ) {
+                m_lightSpheres[i] = XMFLOAT4( 0, 0, 0, 0 );
+                continue;
+            }
+
+            vob->DoAnimation();
+
+            XMStoreFloat4( &m_lightSpheres[i], XMVector3TransformCoord( vob->GetPositionWorldXM(), view ) );
+            m_lightSpheres[i].w = vob->GetLightRange();
+        }
+
+        const XMFLOAT4X4& proj = Engine::GAPI->GetProjectionMatrix();
+        m_lightClusters.SetFrustum( proj._11, proj._22, Engine::GAPI->GetNearPlane(), Engine::GAPI->GetFarPlane() );
+        m_lightClusters.AssignLights( m_lightSpheres.data(), static_cast<unsigned int>(m_lightSpheres.size()) );
+
+        Engine::GAPI->GetRendererState().RendererInfo.FrameClusterCulledLights = m_lightClusters.GetNumLightsOutside();
+    }
+
     // Draw all lights
-    for ( auto const& light : lights ) {
+    for ( size_t lightIndex = 0; lightIndex < lights.size(); lightIndex++ ) {
+        VobLightInfo* light = lights[lightIndex];
         zCVobLight* vob = light->Vob;
 
         // Reset state from CollectVisibleVobs
@@ -434,6 +516,8 @@ XRESULT D3D11ShadowMap::DrawLighting( std::vector<VobLightInfo*>& lights ) {
 
         if ( !vob->IsEnabled() ) continue;
 
+        if ( lightClusters && !m_lightClusters.GetLightClusterCount( static_cast<unsigned int>(lightIndex) ) ) continue;
+
         // Set right shader
         if ( Engine::GAPI->GetRendererState().RendererSettings.EnablePointlightShadows > 0 ) {
             if ( light->LightShadowBuffers && static_cast<D3D11PointLight*>(light->LightShadowBuffers)->IsInited() ) {
@@ -447,8 +531,9 @@ XRESULT D3D11ShadowMap::DrawLighting( std::vector<VobLightInfo*>& lights ) {
             }
         }
 
-        // Animate the light
-        vob->DoAnimation();
+        // Animate the light, unless the clustering did so already
+        if ( !lightClusters )
+            vob->DoAnimation();
 
         plcb.PL_Color = float4( vob->GetLightColor() );
         plcb.PL_Range = vob->GetLightRange();
@@ -716,58 +801,9 @@ void D3D11ShadowMap::RenderShadowmaps( const RenderShadowmapsParams& params ) {
         const auto oldRadius = Engine::GAPI->GetRendererState().RendererSettings.OutdoorSmallVobDrawRadius;
         const auto oldVobRadius = Engine::GAPI->GetRendererState().RendererSettings.OutdoorVobDrawRadius;
 
-        // Build frustum from the light's view/projection matrices (cascade shadow map perspective)
-        // The view/projection matrices are already set via CameraReplacement before this call
-        // We use the light-space matrices to build the frustum for proper CSM culling
-        Frustum f = {};
-
-        // Calculate expansion values based on cascade size
-        // Shadow casters behind the camera (in light direction) need to be included
-        // Expand more for larger cascades to catch distant shadow casters
-        float expandBack = 0.0f;
-        float expandSides = 0.0f;
-        if ( Engine::GAPI->GetRendererState().RendererSettings.IsShadowFrustumCullingEnabled() ) {
-            const GothicRendererSettings::E_ShadowFrustumCulling cullingMode = Engine::GAPI->GetRendererState().RendererSettings.ShadowFrustumCullingMode;
-
-            // Get the cascade's view and projection matrices
-            // If CascadeCameraReplacements is provided, use it directly; otherwise fall back to current camera replacement
-            XMMATRIX lightView, lightProj;
-
-            if ( params.CascadeCameraReplacements
-                && params.CascadeIndex >= 0
-                && params.CascadeIndex < MAX_CSM_CASCADES
-                && params.CascadeSplits.size() > 1 ) {
-                // Use the provided cascade camera replacement (already transposed for GPU, so transpose back)
-
-                const auto cullingCascadeIndex = cullingMode == GothicRendererSettings::E_ShadowFrustumCulling::SHD_FRUSTUM_CULLING_CONSERVATIVE 
-                    ? params.CascadeSplits.size() > 2
-                        ? params.CascadeSplits.size() - 2 // second last cascade if we have more than 1
-                        : params.CascadeIndex // not more than 2 ? then use current as thats the last
-                    : params.CascadeIndex; // Use current cascade for aggressive mode
-                const CameraReplacement& cr = params.CascadeCameraReplacements->at( cullingCascadeIndex );
-                lightView = XMMatrixTranspose( XMLoadFloat4x4( &cr.ViewReplacement ) );
-                lightProj = XMMatrixTranspose( XMLoadFloat4x4( &cr.ProjectionReplacement ) );
-            } else {
-                // Fall back to current camera replacement (already transposed, so transpose back)
-                lightView = XMMatrixTranspose( Engine::GAPI->GetViewMatrixXM() );
-                lightProj = XMMatrixTranspose( XMLoadFloat4x4( &Engine::GAPI->GetProjectionMatrix() ) );
-            }
-
-            if ( params.CascadeIndex >= 0 && params.CascadeIndex < static_cast<int>( params.CascadeSplits.size() ) - 1 ) {
-                const float cascadeSize = params.CascadeSplits[params.CascadeIndex + 1];
-
-                // When SHD_FRUSTUM_CULLING_AGGRESSIVE is used, the lightView/proj matrices are from the current cascade
-                // else when CONSERVATIVE, they are from the (second-)last cascade
-
-                const int inverseCount = (params.CascadeSplits.size() - params.CascadeIndex);
-                expandBack = cascadeSize * (0.5f * inverseCount);
-                expandSides = cascadeSize * (0.1f * inverseCount);
-            }
-            f.BuildOrthographic( lightView, lightProj, expandBack, expandSides );
-        }
-
+        // Cascades of the world shadowmap come with their casters already culled
         XMVECTOR cameraPosition = XMLoadFloat3( &params.CameraPosition );
-        graphicsEngine->DrawWorldAroundForWorldShadow( cameraPosition, 2, params.CullFront, params.DontCull, f );
+        graphicsEngine->DrawWorldAroundForWorldShadow( cameraPosition, 2, params.CullFront, params.DontCull, params.Casters );
 
         Engine::GAPI->GetRendererState().RendererSettings.OutdoorSmallVobDrawRadius = oldRadius;
         Engine::GAPI->GetRendererState().RendererSettings.OutdoorVobDrawRadius = oldVobRadius;
@@ -14,7 +14,8 @@
 #include "Engine.h"
 #include "GothicAPI.h"
 #include "GSky.h"
-#include "Frustum.h"
+#include "LightClusterGrid.h"
+#include "ShadowCasterCulling.h"
 
 struct RenderToDepthStencilBuffer;
 struct RenderToTextureBuffer;
@@ -56,13 +57,9 @@ struct RenderShadowmapsParams {
     
     // Cascade index (-1 = not a cascade render)
     int CascadeIndex = -1;
-    
-    // Cascade split distances (size = numCascades + 1)
-    std::vector<float> CascadeSplits = {};
-    
-    // Optional array of camera replacements for all cascades
-    // Used to build frustums for culling without requiring CameraReplacement to be set externally
-    const std::array<CameraReplacement, MAX_CSM_CASCADES>* CascadeCameraReplacements = nullptr;
+
+    // Optional casters of this cascade from the shadow caster culling (nullptr = everything in range)
+    const ShadowCascadeCasters* Casters = nullptr;
 };
 
 class D3D11ShadowMap {
@@ -79,6 +76,9 @@ public:
 
     RenderToTextureBuffer* GetDummyCubeRT() { return m_dummyCubeRT.get(); }
 
+    // Get the light clusters of the last lighting pass
+    const LightClusterGrid& GetLightClusters() const { return m_lightClusters; }
+
     // Get the cascaded shadow map
     D3D11CascadedShadowMapBuffer* GetCascadedShadowMap() { return m_cascadedShadowMap.get(); }
 
@@ -134,4 +134,11 @@ private:
     std::unique_ptr<RenderToTextureBuffer> m_dummyCubeRT;
 
     Microsoft::WRL::ComPtr<ID3D11SamplerState> m_shadowmapSampler;
+
+    // Shadow casters of the current frame, sorted into the cascades
+    ShadowCasterCulling m_casterCulling;
+
+    // Point lights binned into the view frustum, and their view space spheres
+    LightClusterGrid m_lightClusters;
+    std::vector<DirectX::XMFLOAT4> m_lightSpheres;
 };
@@ -165,6 +165,15 @@ XRESULT D3D11VShader::LoadShader( const char* vertexShader, int layout, const st
         { "VELOCITY", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
     };
 
+    const D3D11_INPUT_ELEMENT_DESC layout14[] =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R32G32_UINT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "TEXCOORD", 1, DXGI_FORMAT_R16G16_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "DIFFUSE", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+    };
+
     switch ( layout ) {
     case 1:
         LE( engine->GetDevice()->CreateInputLayout( layout1, ARRAYSIZE( layout1 ), vsBlob->GetBufferPointer(),
@@ -230,6 +239,11 @@ XRESULT D3D11VShader::LoadShader( const char* vertexShader, int layout, const st
         LE( engine->GetDevice()->CreateInputLayout( layout13, ARRAYSIZE( layout13 ), vsBlob->GetBufferPointer(),
             vsBlob->GetBufferSize(), InputLayout.ReleaseAndGetAddressOf() ) );
         break;
+
+    case 14:
+        LE( engine->GetDevice()->CreateInputLayout( layout14, ARRAYSIZE( layout14 ), vsBlob->GetBufferPointer(),
+            vsBlob->GetBufferSize(), InputLayout.ReleaseAndGetAddressOf() ) );
+        break;
     }
 
     return XR_SUCCESS;
@@ -10,6 +10,8 @@
 #include <signal.h>
 #include "VersionCheck.h"
 #include "InstructionSet.h"
+#include "VertexNormals.h"
+#include "BoxCulling.h"
 #include "D3D11GraphicsEngine.h"
 
 #include <shlwapi.h>
@@ -435,6 +437,17 @@ void CheckPlatformSupport() {
         UnquantizeHalfFloat_X4 = UnquantizeHalfFloat_X4_SSE2;
         UnquantizeHalfFloat_X8 = UnquantizeHalfFloat_X8_SSE2;
     }
+
+#ifdef _XM_AVX2_INTRINSICS_
+    if ( InstructionSet::AVX2() ) {
+        AccumulateVertexNormals = AccumulateVertexNormals_AVX2;
+        CullBoxes = CullBoxes_AVX2;
+    } else
+#endif
+    {
+        AccumulateVertexNormals = AccumulateVertexNormals_SSE2;
+        CullBoxes = CullBoxes_SSE2;
+    }
 }
 
 #if defined(BUILD_GOTHIC_2_6_fix)
@@ -0,0 +1,427 @@
+#include "pch.h"
+#include "DynamicAabbTree.h"
+
+namespace {
+    zTBBox3D UnionBox( const zTBBox3D& a, const zTBBox3D& b ) {
+        zTBBox3D box;
+        box.Min = XMFLOAT3( std::min( a.Min.x, b.Min.x ), std::min( a.Min.y, b.Min.y ), std::min( a.Min.z, b.Min.z ) );
+        box.Max = XMFLOAT3( std::max( a.Max.x, b.Max.x ), std::max( a.Max.y, b.Max.y ), std::max( a.Max.z, b.Max.z ) );
+        return box;
+    }
+
+    zTBBox3D GrowBox( const zTBBox3D& box, float margin ) {
+        zTBBox3D grown;
+        grown.Min = XMFLOAT3( box.Min.x - margin, box.Min.y - margin, box.Min.z - margin );
+        grown.Max = XMFLOAT3( box.Max.x + margin, box.Max.y + margin, box.Max.z + margin );
+        return grown;
+    }
+
+    bool ContainsBox( const zTBBox3D& outer, const zTBBox3D& inner ) {
+        return outer.Min.x <= inner.Min.x && outer.Min.y <= inner.Min.y && outer.Min.z <= inner.Min.z &&
+            outer.Max.x >= inner.Max.x && outer.Max.y >= inner.Max.y && outer.Max.z >= inner.Max.z;
+    }
+
+    /** Half the surface area, which is what the cost of descending into a box is proportional to */
+    float BoxCost( const zTBBox3D& box ) {
+        const float dx = box.Max.x - box.Min.x;
+        const float dy = box.Max.y - box.Min.y;
+        const float dz = box.Max.z - box.Min.z;
+        return dx * dy + dy * dz + dz * dx;
+    }
+
+    /** Squared distances from a point to the closest and to the furthest point of a box */
+    void GetBoxDistancesSq( const zTBBox3D& box, const XMFLOAT3& p, float& outClosest, float& outFurthest ) {
+        const float* min = &box.Min.x;
+        const float* max = &box.Max.x;
+        const float* pos = &p.x;
+
+        outClosest = 0.0f;
+        outFurthest = 0.0f;
+        for ( int i = 0; i < 3; i++ ) {
+            const float toMin = pos[i] - min[i];
+            const float toMax = max[i] - pos[i];
+            const float outside = std::max( std::max( -toMin, -toMax ), 0.0f );
+            const float furthest = std::max( fabsf( toMin ), fabsf( toMax ) );
+            outClosest += outside * outside;
+            outFurthest += furthest * furthest;
+        }
+    }
+}
+
+DynamicAabbTree::DynamicAabbTree( float margin ) {
+    Margin = margin;
+    Clear();
+}
+
+/** Removes all boxes */
+void DynamicAabbTree::Clear() {
+    Nodes.clear();
+    Root = NO_PROXY;
+    FreeList = NO_PROXY;
+    NumProxies = 0;
+    MaintenanceStats = {};
+}
+
+unsigned int DynamicAabbTree::AllocateNode() {
+    unsigned int node;
+    if ( FreeList != NO_PROXY ) {
+        node = FreeList;
+        FreeList = Nodes[node].Parent;
+    } else {
+        node = static_cast<unsigned int>(Nodes.size());
+        Nodes.emplace_back();
+    }
+
+    Node& n = Nodes[node];
+    n.UserData = nullptr;
+    n.Parent = NO_PROXY;
+    n.Child1 = NO_PROXY;
+    n.Child2 = NO_PROXY;
+    n.Height = 0;
+    return node;
+}
+
+void DynamicAabbTree::FreeNode( unsigned int node ) {
+    Nodes[node].Parent = FreeList;
+    FreeList = node;
+}
+
+/** Adds a box and returns the proxy to refer to it with */
+unsigned int DynamicAabbTree::Insert( const zTBBox3D& box, void* userData ) {
+    const unsigned int proxy = AllocateNode();
+    Nodes[proxy].Box = GrowBox( box, Margin );
+    Nodes[proxy].UserData = userData;
+
+    InsertLeaf( proxy );
+    NumProxies++;
+    MaintenanceStats.Inserts++;
+    return proxy;
+}
+
+/** Removes the box of the given proxy */
+void DynamicAabbTree::Remove( unsigned int proxy ) {
+    RemoveLeaf( proxy );
+    FreeNode( proxy );
+    NumProxies--;
+    MaintenanceStats.Removes++;
+}
+
+/** Updates the box of the given proxy */
+bool DynamicAabbTree::Refit( unsigned int proxy, const zTBBox3D& box ) {
+    MaintenanceStats.Refits++;
+
+    // Also reinsert boxes which shrank a lot, their fat box would keep catching queries for nothing
+    const zTBBox3D& fatBox = Nodes[proxy].Box;
+    if ( ContainsBox( fatBox, box ) && ContainsBox( GrowBox( box, Margin * 4.0f ), fatBox ) )
+        return false;
+
+    RemoveLeaf( proxy );
+    Nodes[proxy].Box = GrowBox( box, Margin );
+    InsertLeaf( proxy );
+
+    MaintenanceStats.Reinserts++;
+    return true;
+}
+
+void DynamicAabbTree::InsertLeaf( unsigned int leaf ) {
+    if ( Root == NO_PROXY ) {
+        Root = leaf;
+        Nodes[leaf].Parent = NO_PROXY;
+        return;
+    }
+
+    // Walk down to the cheapest sibling. Every node the new box gets added to grows, which is paid
+    // for all the way down, so stop as soon as pairing with the current node is cheaper.
+    const zTBBox3D leafBox = Nodes[leaf].Box;
+    unsigned int index = Root;
+    while ( !Nodes[index].IsLeaf() ) {
+        const Node& node = Nodes[index];
+        const float combinedCost = BoxCost( UnionBox( node.Box, leafBox ) );
+        const float siblingCost = 2.0f * combinedCost;
+        const float inheritedCost = 2.0f * (combinedCost - BoxCost( node.Box ));
+
+        float childCost[2];
+        const unsigned int children[2] = { node.Child1, node.Child2 };
+        for ( int i = 0; i < 2; i++ ) {
+            const Node& child = Nodes[children[i]];
+            const float grownCost = BoxCost( UnionBox( child.Box, leafBox ) );
+            childCost[i] = (child.IsLeaf() ? grownCost : grownCost - BoxCost( child.Box )) + inheritedCost;
+        }
+
+        if ( siblingCost < childCost[0] && siblingCost < childCost[1] )
+            break;
+
+        index = childCost[0] < childCost[1] ? children[0] : children[1];
+    }
+
+    // Pair the leaf with the sibling under a new parent
+    const unsigned int sibling = index;
+    const unsigned int oldParent = Nodes[sibling].Parent;
+    const unsigned int newParent = AllocateNode();
+
+    Node& parent = Nodes[newParent];
+    parent.Parent = oldParent;
+    parent.Box = UnionBox( leafBox, Nodes[sibling].Box );
+    parent.Height = Nodes[sibling].Height + 1;
+    parent.Child1 = sibling;
+    parent.Child2 = leaf;
+
+    if ( oldParent != NO_PROXY ) {
+        if ( Nodes[oldParent].Child1 == sibling )
+            Nodes[oldParent].Child1 = newParent;
+        else
+            Nodes[oldParent].Child2 = newParent;
+    } else {
+        Root = newParent;
+    }
+
+    Nodes[sibling].Parent = newParent;
+    Nodes[leaf].Parent = newParent;
+
+    RefitAncestors( oldParent );
+}
+
+void DynamicAabbTree::RemoveLeaf( unsigned int leaf ) {
+    if ( leaf == Root ) {
+        Root = NO_PROXY;
+        return;
+    }
+
+    // The sibling takes the place of the parent
+    const unsigned int parent = Nodes[leaf].Parent;
+    const unsigned int grandParent = Nodes[parent].Parent;
+    const unsigned int sibling = Nodes[parent].Child1 == leaf ? Nodes[parent].Child2 : Nodes[parent].Child1;
+
+    Nodes[sibling].Parent = grandParent;
+    FreeNode( parent );
+
+    if ( grandParent == NO_PROXY ) {
+        Root = sibling;
+        return;
+    }
+
+    if ( Nodes[grandParent].Child1 == parent )
+        Nodes[grandParent].Child1 = sibling;
+    else
+        Nodes[grandParent].Child2 = sibling;
+
+    RefitAncestors( grandParent );
+}
+
+/** Refits the boxes and heights from the given node up to the root */
+void DynamicAabbTree::RefitAncestors( unsigned int node ) {
+    while ( node != NO_PROXY ) {
+        node = Balance( node );
+
+        Node& n = Nodes[node];
+        const Node& child1 = Nodes[n.Child1];
+        const Node& child2 = Nodes[n.Child2];
+        n.Height = 1 + std::max( child1.Height, child2.Height );
+        n.Box = UnionBox( child1.Box, child2.Box );
+
+        node = n.Parent;
+    }
+}
+
+/** Rotates the higher grandchild up if the children of the given node are out of balance */
+unsigned int DynamicAabbTree::Balance( unsigned int a ) {
+    if ( Nodes[a].IsLeaf() || Nodes[a].Height < 2 )
+        return a;
+
+    const unsigned int b = Nodes[a].Child1;
+    const unsigned int c = Nodes[a].Child2;
+    const int balance = static_cast<int>(Nodes[c].Height) - static_cast<int>(Nodes[b].Height);
+    if ( balance >= -1 && balance <= 1 )
+        return a;
+
+    // The higher child moves up into the place of a, a becomes its child and takes over its lower child
+    const unsigned int up = balance > 1 ? c : b;
+    const unsigned int stay = balance > 1 ? b : c;
+    const unsigned int upChild1 = Nodes[up].Child1;
+    const unsigned int upChild2 = Nodes[up].Child2;
+    const unsigned int higher = Nodes[upChild1].Height > Nodes[upChild2].Height ? upChild1 : upChild2;
+    const unsigned int lower = higher == upChild1 ? upChild2 : upChild1;
+
+    Nodes[up].Parent = Nodes[a].Parent;
+    Nodes[a].Parent = up;
+    if ( Nodes[up].Parent != NO_PROXY ) {
+        Node& parent = Nodes[Nodes[up].Parent];
+        if ( parent.Child1 == a )
+            parent.Child1 = up;
+        else
+            parent.Child2 = up;
+    } else {
+        Root = up;
+    }
+
+    Nodes[up].Child1 = a;
+    Nodes[up].Child2 = higher;
+    Nodes[a].Child1 = stay;
+    Nodes[a].Child2 = lower;
+    Nodes[lower].Parent = a;
+
+    Nodes[a].Box = UnionBox( Nodes[stay].Box, Nodes[lower].Box );
+    Nodes[a].Height = 1 + std::max( Nodes[stay].Height, Nodes[lower].Height );
+    Nodes[up].Box = UnionBox( Nodes[a].Box, Nodes[higher].Box );
+    Nodes[up].Height = 1 + std::max( Nodes[a].Height, Nodes[higher].Height );
+
+    MaintenanceStats.Rotations++;
+    return up;
+}
+
+/** Calls f( proxy ) for every leaf below the given node */
+template<typename F>
+void DynamicAabbTree::ForEachLeaf( unsigned int node, F&& f ) const {
+    unsigned int stack[MAX_QUERY_DEPTH];
+    unsigned int stackSize = 0;
+    stack[stackSize++] = node;
+
+    while ( stackSize ) {
+        const unsigned int index = stack[--stackSize];
+        const Node& n = Nodes[index];
+        if ( n.IsLeaf() ) {
+            f( index );
+            continue;
+        }
+
+        stack[stackSize++] = n.Child1;
+        stack[stackSize++] = n.Child2;
+    }
+}
+
+/** Appends all leaves touching the frustum and the sphere */
+void DynamicAabbTree::Query( const CullingFrustum* frustum, const XMFLOAT3* center, float radius, std::vector<unsigned int>& outProxies ) const {
+    if ( Root == NO_PROXY )
+        return;
+
+    // Every entry carries the planes its box still crosses and whether it still crosses the sphere.
+    // Once a box is completely inside of everything, its whole subtree is taken without further tests.
+    struct Entry {
+        unsigned int Node;
+        uint32_t PlaneMask;
+        bool TestSphere;
+    };
+
+    const float radiusSq = radius * radius;
+    Entry stack[MAX_QUERY_DEPTH];
+    unsigned int stackSize = 0;
+    stack[stackSize++] = { Root, frustum ? (1u << frustum->NumPlanes) - 1 : 0u, center != nullptr };
+
+    while ( stackSize ) {
+        Entry entry = stack[--stackSize];
+        const Node& node = Nodes[entry.Node];
+
+        if ( entry.TestSphere ) {
+            float closestSq, furthestSq;
+            GetBoxDistancesSq( node.Box, *center, closestSq, furthestSq );
+            if ( !(closestSq < radiusSq) )
+                continue;
+
+            entry.TestSphere = furthestSq >= radiusSq;
+        }
+
+        if ( entry.PlaneMask ) {
+            const float cx = (node.Box.Min.x + node.Box.Max.x) * 0.5f;
+            const float cy = (node.Box.Min.y + node.Box.Max.y) * 0.5f;
+            const float cz = (node.Box.Min.z + node.Box.Max.z) * 0.5f;
+            const float ex = (node.Box.Max.x - node.Box.Min.x) * 0.5f;
+            const float ey = (node.Box.Max.y - node.Box.Min.y) * 0.5f;
+            const float ez = (node.Box.Max.z - node.Box.Min.z) * 0.5f;
+
+            bool outside = false;
+            for ( unsigned int p = 0; p < frustum->NumPlanes; p++ ) {
+                if ( !((entry.PlaneMask >> p) & 1) )
+                    continue;
+
+                // Same test as BoxCulling, and planes the box is completely in front of are done for the subtree
+                const XMFLOAT4& plane = frustum->Planes[p];
+                const float d = plane.x * cx + plane.y * cy + plane.z * cz + plane.w;
+                const float r = fabsf( plane.x ) * ex + fabsf( plane.y ) * ey + fabsf( plane.z ) * ez;
+                if ( !(d + r >= 0.0f) ) {
+                    outside = true;
+                    break;
+                }
+
+                if ( d - r >= 0.0f )
+                    entry.PlaneMask &= ~(1u << p);
+            }
+
+            if ( outside )
+                continue;
+        }
+
+        if ( node.IsLeaf() ) {
+            outProxies.push_back( entry.Node );
+        } else if ( !entry.PlaneMask && !entry.TestSphere ) {
+            ForEachLeaf( entry.Node, [&]( unsigned int proxy ) { outProxies.push_back( proxy ); } );
+        } else {
+            stack[stackSize++] = { node.Child1, entry.PlaneMask, entry.TestSphere };
+            stack[stackSize++] = { node.Child2, entry.PlaneMask, entry.TestSphere };
+        }
+    }
+}
+
+/** Appends the proxies of all boxes touching the frustum */
+void DynamicAabbTree::QueryFrustum( const CullingFrustum& frustum, std::vector<unsigned int>& outProxies ) const {
+    Query( &frustum, nullptr, 0.0f, outProxies );
+}
+
+/** Appends the proxies of all boxes touching the frustum which are closer than radius to center */
+void DynamicAabbTree::QueryFrustum( const CullingFrustum& frustum, const XMFLOAT3& center, float radius, std::vector<unsigned int>& outProxies ) const {
+    Query( &frustum, &center, radius, outProxies );
+}
+
+/** Appends the proxies of all boxes closer than radius to center */
+void DynamicAabbTree::QuerySphere( const XMFLOAT3& center, float radius, std::vector<unsigned int>& outProxies ) const {
+    Query( nullptr, &center, radius, outProxies );
+}
+
+/** Appends all boxes hit by the ray before maxDistance */
+void DynamicAabbTree::QueryRay( const XMFLOAT3& origin, const XMFLOAT3& dir, float maxDistance, std::vector<RayHit>& outHits ) const {
+    if ( Root == NO_PROXY )
+        return;
+
+    const float* o = &origin.x;
+    const float* d = &dir.x;
+    float invDir[3];
+    for ( int i = 0; i < 3; i++ ) {
+        invDir[i] = d[i] != 0.0f ? 1.0f / d[i] : 0.0f;
+    }
+
+    unsigned int stack[MAX_QUERY_DEPTH];
+    unsigned int stackSize = 0;
+    stack[stackSize++] = Root;
+
+    while ( stackSize ) {
+        const unsigned int index = stack[--stackSize];
+        const Node& node = Nodes[index];
+        const float* min = &node.Box.Min.x;
+        const float* max = &node.Box.Max.x;
+
+        // Slab test, axes the ray runs parallel to only have to contain the origin
+        float tEnter = 0.0f;
+        float tExit = maxDistance;
+        for ( int i = 0; i < 3 && tEnter <= tExit; i++ ) {
+            if ( d[i] == 0.0f ) {
+                if ( o[i] < min[i] || o[i] > max[i] )
+                    tEnter = FLT_MAX;
+                continue;
+            }
+
+            const float t1 = (min[i] - o[i]) * invDir[i];
+            const float t2 = (max[i] - o[i]) * invDir[i];
+            tEnter = std::max( tEnter, std::min( t1, t2 ) );
+            tExit = std::min( tExit, std::max( t1, t2 ) );
+        }
+
+        if ( tEnter > tExit )
+            continue;
+
+        if ( node.IsLeaf() ) {
+            outHits.push_back( { index, tEnter } );
+        } else {
+            stack[stackSize++] = node.Child1;
+            stack[stackSize++] = node.Child2;
+        }
+    }
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include "pch.h"
+#include "BoxCulling.h"
+
+/** Bounding volume hierarchy over boxes which come and go or move around while the world is loaded.
+    Every box is stored enlarged by a margin (its fat box), so small movements don't touch the tree at
+    all and only a box leaving its fat box gets reinserted. Insertion picks the sibling with the lowest
+    surface area cost and rotations keep the tree balanced, so queries stay logarithmic no matter in
+    which order boxes arrive. Queries test the fat boxes, the caller does the exact test if needed. */
+class DynamicAabbTree {
+public:
+    static const unsigned int NO_PROXY = 0xFFFFFFFF;
+
+    /** Margin boxes get enlarged by on every side, in world units */
+    static constexpr float DEFAULT_MARGIN = 50.0f;
+
+    explicit DynamicAabbTree( float margin = DEFAULT_MARGIN );
+
+    /** Removes all boxes */
+    void Clear();
+
+    /** Adds a box and returns the proxy to refer to it with */
+    unsigned int Insert( const zTBBox3D& box, void* userData );
+
+    /** Removes the box of the given proxy */
+    void Remove( unsigned int proxy );
+
+    /** Updates the box of the given proxy. Returns true if it left its fat box and had to be reinserted. */
+    bool Refit( unsigned int proxy, const zTBBox3D& box );
+
+    void* GetUserData( unsigned int proxy ) const { return Nodes[proxy].UserData; }
+    const zTBBox3D& GetFatBox( unsigned int proxy ) const { return Nodes[proxy].Box; }
+
+    unsigned int GetNumProxies() const { return NumProxies; }
+
+    /** Length of the longest path from the root to a box, 0 if there are none */
+    unsigned int GetHeight() const { return Root == NO_PROXY ? 0 : Nodes[Root].Height; }
+
+    /** Counters since the last ResetStats */
+    struct Stats {
+        unsigned int Inserts;
+        unsigned int Removes;
+        unsigned int Refits;
+        unsigned int Reinserts;
+        unsigned int Rotations;
+    };
+    const Stats& GetStats() const { return MaintenanceStats; }
+    void ResetStats() { MaintenanceStats = {}; }
+
+    /** Appends the proxies of all boxes touching the frustum */
+    void QueryFrustum( const CullingFrustum& frustum, std::vector<unsigned int>& outProxies ) const;
+
+    /** Appends the proxies of all boxes touching the frustum which are closer than radius to center */
+    void QueryFrustum( const CullingFrustum& frustum, const XMFLOAT3& center, float radius, std::vector<unsigned int>& outProxies ) const;
+
+    /** Appends the proxies of all boxes closer than radius to center */
+    void QuerySphere( const XMFLOAT3& center, float radius, std::vector<unsigned int>& outProxies ) const;
+
+    struct RayHit {
+        unsigned int Proxy;
+
+        /** Distance along the ray where it enters the box, in multiples of dir. 0 if the origin is inside. */
+        float Distance;
+    };
+
+    /** Appends all boxes hit by the ray from origin along dir before maxDistance (in multiples of dir), unsorted */
+    void QueryRay( const XMFLOAT3& origin, const XMFLOAT3& dir, float maxDistance, std::vector<RayHit>& outHits ) const;
+
+private:
+    struct Node {
+        bool IsLeaf() const { return Child1 == NO_PROXY; }
+
+        zTBBox3D Box;
+        void* UserData;
+
+        /** Parent while in use, next free node while on the free list */
+        unsigned int Parent;
+        unsigned int Child1;
+        unsigned int Child2;
+
+        /** 0 for leaves */
+        unsigned int Height;
+    };
+
+    unsigned int AllocateNode();
+    void FreeNode( unsigned int node );
+
+    void InsertLeaf( unsigned int leaf );
+    void RemoveLeaf( unsigned int leaf );
+
+    /** Refits the boxes and heights from the given node up to the root, rotating where it got out of balance */
+    void RefitAncestors( unsigned int node );
+
+    /** Rotates the higher grandchild up if the children of the given node differ in height by more than one.
+        Returns the node now in its place. */
+    unsigned int Balance( unsigned int node );
+
+    /** Appends all leaves touching the frustum and the sphere, either one may be nullptr to skip it */
+    void Query( const CullingFrustum* frustum, const XMFLOAT3* center, float radius, std::vector<unsigned int>& outProxies ) const;
+
+    /** Calls f( proxy ) for every leaf below the given node */
+    template<typename F>
+    void ForEachLeaf( unsigned int node, F&& f ) const;
+
+    /** Deepest a query can go, the balancing keeps the height far below this for any number of boxes */
+    static const unsigned int MAX_QUERY_DEPTH = 128;
+
+    std::vector<Node> Nodes;
+    unsigned int Root;
+    unsigned int FreeList;
+    unsigned int NumProxies;
+    float Margin;
+    Stats MaintenanceStats;
+};
@@ -5,6 +5,8 @@
 #include "assimp\scene.h"
 #include "Engine.h"
 #include "GothicAPI.h"
+#include "MemoryMappedFile.h"
+#include "MeshCacheFormat.h"
 
 #pragma comment(lib, "assimp-vc143-mt.lib")
 
@@ -20,7 +22,7 @@ GMesh::~GMesh() {
 }
 
 /** Load a mesh from file */
-XRESULT GMesh::LoadMesh( const std::string& file, float scale ) {
+XRESULT GMesh::LoadMesh( const std::string& file, float scale, bool createBuffers ) {
     char dir[260];
     GetCurrentDirectoryA( 260, dir );
     LogInfo() << "Loading custom mesh " << dir << "\\" << file;
@@ -117,7 +119,12 @@ XRESULT GMesh::LoadMesh( const std::string& file, float scale ) {
             //LogInfo() << "Got file name: " << name;
         }
 
-        mi->Create( vertices, s->mMeshes[i]->mNumVertices, indices, s->mMeshes[i]->mNumFaces * 3 );
+        if ( createBuffers ) {
+            mi->Create( vertices, s->mMeshes[i]->mNumVertices, indices, s->mMeshes[i]->mNumFaces * 3 );
+        } else {
+            mi->Vertices.assign( vertices, vertices + s->mMeshes[i]->mNumVertices );
+            mi->Indices.assign( indices, indices + s->mMeshes[i]->mNumFaces * 3 );
+        }
         Meshes.push_back( mi );
 
         Textures.push_back( name );
@@ -140,62 +147,44 @@ void GMesh::DrawMesh() {
 
 /** Loads the cache-file-format */
 XRESULT GMesh::LoadCached( const std::string& file ) {
-    FILE* f = fopen( file.c_str(), "rb" );
-
     LogInfo() << "Loading cached mesh: " << file;
 
-    if ( !f ) {
+    MemoryMappedFile mapped;
+    if ( XR_SUCCESS != mapped.Open( file ) ) {
         LogWarn() << "Failed to find cache file: " << file;
         return XR_FAILED;
     }
 
-    // Read version
-    int Version;
-    fread( &Version, sizeof( Version ), 1, f );
-
-    // Read num textures
-    int numTextures;
-    fread( &numTextures, sizeof( numTextures ), 1, f );
-
-    for ( int t = 0; t < numTextures; t++ ) {
-        // Read texture name
-        unsigned char numTxNameChars;
-        fread( &numTxNameChars, sizeof( numTxNameChars ), 1, f );
-
-        char tx[256] = {};
-        if ( numTxNameChars > 255 ) {
-            fread( tx, 255, 1, f );
-            fseek( f, static_cast<long>(numTxNameChars - 255), SEEK_CUR );
-        } else {
-            fread( tx, numTxNameChars, 1, f );
-        }
-
-        // Read num submeshes
-        unsigned char numSubmeshes;
-        fread( &numSubmeshes, sizeof( numSubmeshes ), 1, f );
+    // Both versions start with the version number
+    uint32_t version = 0;
+    if ( mapped.GetSize() >= sizeof( version ) ) {
+        memcpy( &version, mapped.GetData(), sizeof( version ) );
+    }
 
-        for ( int i = 0; i < numSubmeshes; i++ ) {
-            MeshInfo* mi = new MeshInfo;
+    std::vector<MeshCacheFormat::MeshCacheEntry> entries;
+    XRESULT result;
+    switch ( version ) {
+        case MeshCacheFormat::VERSION_1: result = MeshCacheFormat::ReadVersion1( mapped.GetData(), mapped.GetSize(), entries ); break;
+        case MeshCacheFormat::VERSION_2: result = MeshCacheFormat::ReadVersion2( mapped.GetData(), mapped.GetSize(), entries ); break;
+        default:
+            LogWarn() << "Unknown version " << version << " of cache file: " << file;
+            return XR_FAILED;
+    }
 
-            // Read vertices
-            int numVertices;
-            fread( &numVertices, sizeof( numVertices ), 1, f );
-            mi->Vertices.resize( numVertices );
-            fread( &mi->Vertices[0], sizeof( ExVertexStruct ) * numVertices, 1, f );
+    if ( result != XR_SUCCESS ) {
+        LogWarn() << "Cache file is damaged: " << file;
+        return result;
+    }
 
-            // Read indices
-            int numIndices;
-            fread( &numIndices, sizeof( numIndices ), 1, f );
-            mi->Indices.resize( numIndices );
-            fread( &mi->Indices[0], sizeof( VERTEX_INDEX ) * mi->Indices.size(), 1, f );
+    for ( MeshCacheFormat::MeshCacheEntry& entry : entries ) {
+        MeshInfo* mi = new MeshInfo;
+        mi->Vertices = std::move( entry.Vertices );
+        mi->Indices = std::move( entry.Indices );
 
-            // Add to GMesh
-            Meshes.push_back( mi );
-            Textures.push_back( std::string( tx ) );
-        }
+        // Add to GMesh
+        Meshes.push_back( mi );
+        Textures.push_back( std::move( entry.Texture ) );
     }
 
-    fclose( f );
-
     return XR_SUCCESS;
 }
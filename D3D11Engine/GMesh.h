@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -15,8 +16,9 @@ public:
         LT_SIMPLEOBJ
     };
 
-    /** Load a mesh from file  */
-    XRESULT LoadMesh( const std::string& file, float scale = 1.0f );
+    /** Load a mesh from file. Without createBuffers only the vertices and indices are filled,
+        which is safe to do from any thread. */
+    XRESULT LoadMesh( const std::string& file, float scale = 1.0f, bool createBuffers = true );
 
     /** Draws all buffers this holds */
     void DrawMesh();
@@ -10,6 +10,7 @@
 #include "D3D11Texture.h"
 #include "D3D11GraphicsEngine.h"
 #include "zCMaterial.h"
+#include "ParallelFor.h"
 
 GVegetationBox::GVegetationBox() {
     VegetationMesh = nullptr;
@@ -255,6 +256,8 @@ void GVegetationBox::InitSpotsRandom( const std::vector<XMFLOAT3>& trisInside, E
         }
     }
 
+    RemoveCoveredSpots( spots );
+
     // Create the transformation matrices for every spot
     for ( unsigned int i = 0; i < spots.size(); i++ ) {
         XMMATRIX w = XMMatrixTranslation( spots[i].x, spots[i].y, spots[i].z );
@@ -284,6 +287,45 @@ void GVegetationBox::InitSpotsRandom( const std::vector<XMFLOAT3>& trisInside, E
     return;
 }
 
+/** Removes the spots which have other parts of the world mesh above them, like the ground under a bridge or rock */
+void GVegetationBox::RemoveCoveredSpots( std::vector<XMFLOAT3>& spots ) {
+    // How far above a spot to look for cover, and how close to the spot a hit counts as the spot itself
+    const float COVER_HEIGHT = 2000.0f;
+    const float SURFACE_TOLERANCE = 1.0f;
+    // Rays traced in one go by a thread, enough for the packets to stay coherent
+    const unsigned int RAYS_PER_TASK = 4096;
+
+    if ( spots.empty() )
+        return;
+
+    // Trace straight down onto each spot, all at once
+    Engine::GAPI->UpdateWorldMeshBvh();
+
+    std::vector<XMFLOAT3> traceOrigins;
+    traceOrigins.reserve( spots.size() );
+    for ( const XMFLOAT3& spot : spots ) {
+        traceOrigins.emplace_back( spot.x, spot.y + COVER_HEIGHT, spot.z );
+    }
+
+    const unsigned int numRays = static_cast<unsigned int>(traceOrigins.size());
+    std::vector<XMFLOAT3> traceDirs( numRays, XMFLOAT3( 0, -1, 0 ) );
+    std::vector<TriangleBvh::RayHit> traceHits( numRays );
+    ParallelFor( (numRays + RAYS_PER_TASK - 1) / RAYS_PER_TASK, [&]( size_t task, unsigned int ) {
+        const unsigned int first = static_cast<unsigned int>(task) * RAYS_PER_TASK;
+        Engine::GAPI->TraceWorldMeshRays( &traceOrigins[first], &traceDirs[first], std::min( RAYS_PER_TASK, numRays - first ),
+            COVER_HEIGHT - SURFACE_TOLERANCE, &traceHits[first] );
+    } );
+
+    // Anything hit before reaching the spot covers it. Spots on surfaces which aren't in the world mesh hit nothing and stay.
+    size_t numKept = 0;
+    for ( unsigned int i = 0; i < numRays; i++ ) {
+        if ( traceHits[i].Triangle == TriangleBvh::NO_TRIANGLE ) {
+            spots[numKept++] = spots[i];
+        }
+    }
+    spots.resize( numKept );
+}
+
 /** Draws this vegetation box */
 void GVegetationBox::RenderVegetation( const XMFLOAT3& eye ) {
     float drawRadius = Engine::GAPI->GetRendererState().RendererSettings.OutdoorSmallVobDrawRadius;
@@ -551,20 +593,26 @@ void GVegetationBox::LoadFromFILE( FILE* f, int version ) {
     // n without population size (see law of large numbers):
     // float n = pow(1.6448f, 2) * 95 * (100 - 95) / pow(10, 2);
     float n = 12.85f;
-    int j = floor( spots.size() / n );
+    int j = std::max( 1, static_cast<int>(floor( spots.size() / n )) );
 
+    // Use grass-pieces and trace straight down, all at once
+    std::vector<XMFLOAT3> traceOrigins;
     for ( unsigned int i = 0; i < spots.size(); i += j ) {
-        // Use grass-piece and trace straight down
-        XMFLOAT3 spot = XMFLOAT3( spots[i].x, spots[i].y, spots[i].z );
-
         // Little offset
-        spot.y += 1.0f;
+        traceOrigins.emplace_back( spots[i].x, spots[i].y + 1.0f, spots[i].z );
+    }
+
+    std::vector<XMFLOAT3> traceDirs( traceOrigins.size(), XMFLOAT3( 0, -1, 0 ) );
+    std::vector<TriangleBvh::RayHit> traceHits( traceOrigins.size() );
+    Engine::GAPI->TraceWorldMeshRays( traceOrigins.data(), traceDirs.data(), static_cast<unsigned int>(traceOrigins.size()), FLT_MAX, traceHits.data() );
+
+    for ( const TriangleBvh::RayHit& traceHit : traceHits ) {
+        if ( traceHit.Triangle == TriangleBvh::NO_TRIANGLE )
+            continue;
 
         // Try to find meshpart and texture
-        XMFLOAT3 hit;
-        MeshInfo* hitMeshTrace = nullptr;
-        zCMaterial* hitMaterialTrace = nullptr;
-        Engine::GAPI->TraceWorldMesh( spot, XMFLOAT3( 0, -1, 0 ), hit, nullptr, nullptr, &hitMeshTrace, &hitMaterialTrace );
+        zCMaterial* hitMaterialTrace;
+        MeshInfo* hitMeshTrace = Engine::GAPI->GetWorldMeshTriangleOwner( traceHit.Triangle, &hitMaterialTrace );
 
         // Save results
         if ( hitMeshTrace != nullptr )
@@ -83,6 +83,9 @@ private:
     /** Puts trasformation for the given spots */
     void InitSpotsRandom( const std::vector<XMFLOAT3>& trisInside, EShape shape = S_None, float density = 1.0f );
 
+    /** Removes the spots which have other parts of the world mesh above them */
+    void RemoveCoveredSpots( std::vector<XMFLOAT3>& spots );
+
     std::vector<XMFLOAT3> TrisInside;
     std::vector<XMFLOAT4X4> VegetationSpots;
     GMeshSimple* VegetationMesh;
@@ -7,6 +7,8 @@
 #include "BaseGraphicsEngine.h"
 #include "zCPolygon.h"
 #include "WorldConverter.h"
+#include "CustomWorldImport.h"
+#include "ParallelFor.h"
 #include "HookedFunctions.h"
 #include "zCMaterial.h"
 #include "zCTexture.h"
@@ -45,6 +47,7 @@
 #include "win32ClipboardWrapper.h"
 #include "zCSoundSystem.h"
 #include "zCView.h"
+#include "WorldMeshCache.h"
 
 // TODO: REMOVE THIS!
 #include "D3D11GraphicsEngine.h"
@@ -129,8 +132,16 @@ GothicAPI::GothicAPI() {
 
     CameraReplacementPtr = nullptr;
     WrappedWorldMesh = nullptr;
+    FullWrappedWorldMesh = nullptr;
     CurrentCamera = nullptr;
 
+    VobCollectionStamp = 0;
+    NumVobCollectionIds = 0;
+    NumFlatBspLeaves = 0;
+    VobCullingPvsLeaf = FlatBspNode::NO_NODE;
+    PickingVobTreeBuilt = false;
+    WorldMeshBvhBuilt = false;
+
     MainThreadID = GetCurrentThreadId();
 
     _canRain = false;
@@ -140,6 +151,7 @@ GothicAPI::GothicAPI() {
 GothicAPI::~GothicAPI() {
     //ResetWorld(); // Just let it leak for now. // TODO: Do this properly
     SAFE_DELETE( WrappedWorldMesh );
+    SAFE_DELETE( FullWrappedWorldMesh );
 }
 
 namespace
@@ -725,11 +737,22 @@ void GothicAPI::RemoveVegetationBox( GVegetationBox* box ) {
 
 /** Resets the object, like at level load */
 void GothicAPI::ResetWorld() {
+    // Stop importing the previous world, if it didn't get that far
+    CustomWorldImporter.reset();
+
+    WorldSectionIndex.Clear();
     WorldSections.clear();
+    WorldMeshBvh.Clear();
+    WorldMeshBvhRanges.clear();
+    WorldMeshBvhBuilt = false;
+    CustomPolygonBvh.Clear();
+    CustomPolygons.clear();
 
     ResetVobs();
 
     SAFE_DELETE( WrappedWorldMesh );
+    SAFE_DELETE( FullWrappedWorldMesh );
+    LoadedWorldInfo->CompactVertices = false;
 
     // Clear inventory too?
 }
@@ -769,7 +792,15 @@ void GothicAPI::ResetVobs() {
     ParticleEffectVobs.clear();
     RegisteredVobs.clear();
     BspLeafVobLists.clear();
-    DynamicallyAddedVobs.clear();
+    FlatBspNodes.clear();
+    FlatBspVobBounds.Clear();
+    FlatBspVobOwners.clear();
+    FlatBspMobs.clear();
+    NumFlatBspLeaves = 0;
+    LeafPvs.Clear();
+    DynamicVobTree.Clear();
+    PickingVobTree.Clear();
+    PickingVobTreeBuilt = false;
     DecalVobs.clear();
     VobsByVisual.clear();
     SkeletalVobMap.clear();
@@ -795,6 +826,7 @@ void GothicAPI::ResetVobs() {
         delete it.second;
     }
     VobMap.clear();
+    StaticInstances.Clear();
 
     // Delete skeletal mesh vobs
     for ( auto it : SkeletalMeshVobs ) {
@@ -811,6 +843,33 @@ void GothicAPI::ResetVobs() {
     VobLightMap.clear();
 }
 
+/** Loads the world sections from the world cache, or converts and caches them if the cache doesn't match */
+void GothicAPI::LoadOrConvertWorldMesh( std::vector<zCPolygon*>& polys, bool indoorLocation ) {
+    auto gameName = GetGameName();
+    std::string cacheFile;
+    if ( gameName == "Original" ) {
+        cacheFile = "system\\GD3D11\\Cache\\";
+    } else {
+        cacheFile = "system\\GD3D11\\Cache\\" + gameName + "\\";
+    }
+    cacheFile += LoadedWorldInfo->WorldName + ".wcache";
+
+    BASIC_TIMING( t );
+    uint64_t key = WorldMeshCache::ComputeKey( &polys[0], polys.size(), indoorLocation );
+    bool compactVertices = RendererState.RendererSettings.CompactWorldCache;
+    bool meshlets = RendererState.RendererSettings.EnableWorldMeshletCulling;
+    if ( XR_SUCCESS == WorldMeshCache::LoadSections( cacheFile, key, compactVertices, meshlets, &polys[0], polys.size(), indoorLocation, &WorldSections, LoadedWorldInfo.get(), &WrappedWorldMesh ) ) {
+        t.Update();
+        LogInfo() << "Loaded world from cache " << cacheFile << " in " << static_cast<int>(t.GetDelta() * 1000.0f) << "ms";
+        return;
+    }
+
+    WorldConverter::ConvertWorldMesh( &polys[0], polys.size(), &WorldSections, LoadedWorldInfo.get(), &WrappedWorldMesh, indoorLocation );
+    if ( XR_SUCCESS == WorldMeshCache::SaveSections( cacheFile, key, compactVertices, meshlets, WorldSections ) ) {
+        LogInfo() << "Saved world cache " << cacheFile;
+    }
+}
+
 /** Called when the game loaded a new level */
 void GothicAPI::OnGeometryLoaded( zCBspTree* tree ) {
     LogInfo() << "World loaded, getting Levelmesh now!";
@@ -828,18 +887,45 @@ void GothicAPI::OnGeometryLoaded( zCBspTree* tree ) {
     std::string worldStr = "system\\GD3D11\\meshes\\WLD_" + LoadedWorldInfo->WorldName + ".obj";
     // Convert world to our own format
 #ifdef BUILD_GOTHIC_2_6_fix
-    WorldConverter::ConvertWorldMesh( &polys[0], polys.size(), &WorldSections, LoadedWorldInfo.get(), &WrappedWorldMesh, indoorLocation );
+    LoadOrConvertWorldMesh( polys, indoorLocation );
 #else
     if ( Toolbox::FileExists( worldStr ) ) {
-        WorldConverter::LoadWorldMeshFromFile( worldStr, &WorldSections, LoadedWorldInfo.get(), &WrappedWorldMesh );
-        LoadedWorldInfo->CustomWorldLoaded = true;
+        // Import in the background while the game loads the vobs, see FinishCustomWorldImport
+        CustomWorldImporter = std::make_unique<CustomWorldImport>();
+        CustomWorldImporter->Start( worldStr );
     } else {
-        WorldConverter::ConvertWorldMesh( &polys[0], polys.size(), &WorldSections, LoadedWorldInfo.get(), &WrappedWorldMesh, indoorLocation );
+        LoadOrConvertWorldMesh( polys, indoorLocation );
     }
 #endif
+    WorldSectionIndex.Build( WorldSections );
     LogInfo() << "Done extracting world!";
 }
 
+/** Waits for the custom world import started in OnGeometryLoaded and creates its sections */
+void GothicAPI::FinishCustomWorldImport() {
+    if ( !CustomWorldImporter || !CustomWorldImporter->IsPending() ) {
+        return;
+    }
+
+    // Usually done by now, the game spent that time on loading the vobs
+    while ( !CustomWorldImporter->WaitUntilDone( 500 ) ) {
+        LogInfo() << "Importing custom world mesh: " << static_cast<int>(CustomWorldImporter->GetProgress() * 100.0f) << "%";
+    }
+
+    if ( XR_SUCCESS == CustomWorldImporter->Finalize( &WorldSections, LoadedWorldInfo.get(), &WrappedWorldMesh ) ) {
+        LoadedWorldInfo->CustomWorldLoaded = true;
+    } else {
+        LogWarn() << "Failed to import the custom world mesh, using the world of the game instead";
+
+        std::vector<zCPolygon*> polys;
+        LoadedWorldInfo->BspTree->GetLOD0Polygons( polys );
+        LoadOrConvertWorldMesh( polys, LoadedWorldInfo->BspTree->GetBspTreeMode() == zBSP_MODE_INDOOR );
+    }
+
+    // Vobs may have created sections in the meantime, so index all of them again
+    WorldSectionIndex.Build( WorldSections );
+}
+
 /** Called when the game is about to load a new level */
 void GothicAPI::OnLoadWorld( const std::string& levelName, int loadMode ) {
     _canClearVobsByVisual = true;
@@ -872,6 +958,8 @@ void GothicAPI::OnLoadWorld( const std::string& levelName, int loadMode ) {
 void GothicAPI::OnWorldLoaded() {
     _canRain = false;
 
+    FinishCustomWorldImport();
+
     LoadCustomZENResources();
 
     LogInfo() << "Collecting vobs...";
@@ -896,10 +984,15 @@ void GothicAPI::OnWorldLoaded() {
     // Build vob info cache for the bsp-leafs
     BuildBspVobMapCache();
 
+    if ( !WorldMeshBvhBuilt ) {
+        BuildWorldMeshBvh();
+    }
+
 #ifdef BUILD_GOTHIC_1_08k
     if ( LoadedWorldInfo->CustomWorldLoaded ) {
         CreatezCPolygonsForSections();
         PutCustomPolygonsIntoBspTree();
+        BuildCustomPolygonBvh();
     }
 #endif
 
@@ -1606,6 +1699,7 @@ void GothicAPI::OnVobMoved( zCVob* vob ) {
             MoveVobFromBspToDynamic( vi );
         }
 
+        RefitVobTrees( vi );
         vi->UpdateVobConstantBuffer();
         Engine::GAPI->GetRendererState().RendererInfo.FrameVobUpdates++;
     } else {
@@ -1650,6 +1744,7 @@ void GothicAPI::OnVisualDeleted( zCVisual* visual ) {
             // Clear the visual from all vobs (TODO: This may be slow!)
             for ( auto it = VobMap.begin(); it != VobMap.end();) {
                 if ( !it->second->VisualInfo ) { // This happens sometimes, so get rid of it
+                    StaticInstances.Release( it->second->InstanceSlot );
                     delete it->second;
                     it = VobMap.erase( it );
                     continue;
@@ -1672,6 +1767,7 @@ void GothicAPI::OnVisualDeleted( zCVisual* visual ) {
                 // Clear the visual from all vobs (TODO: This may be slow!)
                 for ( auto it = VobMap.begin(); it != VobMap.end();) {
                     if ( !it->second->VisualInfo ) { // This happens sometimes, so get rid of it
+                        StaticInstances.Release( it->second->InstanceSlot );
                         delete it->second;
                         it = VobMap.erase( it );
                         continue;
@@ -1890,6 +1986,7 @@ void GothicAPI::OnRemovedVob( zCVob* vob, zCWorld* world ) {
         for ( unsigned int i = 0; i < nodes->size(); i++ ) {
             BspInfo* node = (*nodes)[i];
             if ( vi ) {
+                node->LeafRangesDirty = true;
                 for ( auto bit = node->IndoorVobs.begin(); bit != node->IndoorVobs.end(); ++bit ) {
                     if ( (*bit) == vi ) {
                         (*bit) = node->IndoorVobs.back();
@@ -1934,6 +2031,7 @@ void GothicAPI::OnRemovedVob( zCVob* vob, zCWorld* world ) {
             }
 
             if ( svi && nodes ) {
+                node->LeafRangesDirty = true;
                 for ( auto bit = node->Mobs.begin(); bit != node->Mobs.end(); ++bit ) {
                     if ( (*bit)->Vob == vob ) {
                         (*bit) = node->Mobs.back();
@@ -1967,16 +2065,14 @@ void GothicAPI::OnRemovedVob( zCVob* vob, zCWorld* world ) {
     }
 
     // Erase it from dynamically loaded vobs
-    for ( auto& vit = DynamicallyAddedVobs.begin(); vit != DynamicallyAddedVobs.end(); ++vit ) {
-        if ( (*vit)->Vob == vob ) {
-            DynamicallyAddedVobs.erase( vit );
-            break;
-        }
+    if ( vi ) {
+        RemoveVobFromTrees( vi );
     }
 
     // Erase it from vob-map
     auto vit = VobMap.find( vob );
     if ( vit != VobMap.end() ) {
+        StaticInstances.Release( (*vit).second->InstanceSlot );
         delete (*vit).second;
         VobMap.erase( vit );
     }
@@ -2080,7 +2176,7 @@ void GothicAPI::OnAddVob( zCVob* vob, zCWorld* world ) {
             if ( world == oCGame::GetGame()->_zCSession_world ) {
                 VobMap[vob] = vi;
 
-                vi->VobSection = &WorldSections[section.x][section.y];
+                vi->VobSection = &GetOrCreateWorldSection( section );
                 vi->VobSection->Vobs.push_back( vi );
 
                 // Create this constantbuffer only for non-inventory vobs because it would be recreated for each vob every frame
@@ -2089,7 +2185,11 @@ void GothicAPI::OnAddVob( zCVob* vob, zCWorld* world ) {
 
                 if ( !BspLeafVobLists.empty() ) { // Check if this is the initial loading
                     // It's not, chose this as a dynamically added vob
-                    DynamicallyAddedVobs.push_back( vi );
+                    AddDynamicVob( vi );
+                }
+
+                if ( PickingVobTreeBuilt ) {
+                    vi->PickingTreeProxy = PickingVobTree.Insert( GetVobTreeBox( vi ), vi );
                 }
             } else {
                 // Must be inventory
@@ -3147,47 +3247,102 @@ MeshInfo* GothicAPI::GetWrappedWorldMesh() {
     return WrappedWorldMesh;
 }
 
+/** Returns the wrapped world mesh with ExVertexStruct vertices, at the same index locations */
+MeshInfo* GothicAPI::GetFullWrappedWorldMesh() {
+    if ( !LoadedWorldInfo->CompactVertices )
+        return WrappedWorldMesh;
+
+    if ( FullWrappedWorldMesh )
+        return FullWrappedWorldMesh;
+
+    // The CPU copies of the meshes are never compact. Every mesh has to keep its BaseIndexLocation, including the
+    // hidden ones, since they can be put back later.
+    std::vector<MeshInfo*> meshes;
+    for ( auto const& itx : WorldSections ) {
+        for ( auto const& ity : itx.second ) {
+            for ( auto const& it : ity.second.WorldMeshes ) {
+                meshes.push_back( it.second );
+            }
+            for ( auto const& it : ity.second.SuppressedMeshes ) {
+                meshes.push_back( it.second );
+            }
+        }
+    }
+
+    size_t numVertices = 0;
+    unsigned int numIndices = 0;
+    for ( MeshInfo* mesh : meshes ) {
+        numIndices = std::max( numIndices, mesh->BaseIndexLocation + static_cast<unsigned int>(mesh->Indices.size()) );
+        numVertices += mesh->Vertices.size();
+    }
+
+    std::vector<ExVertexStruct> vertices;
+    vertices.reserve( numVertices );
+    std::vector<unsigned int> indices( numIndices, 0 );
+    for ( MeshInfo* mesh : meshes ) {
+        const unsigned int baseVertex = static_cast<unsigned int>(vertices.size());
+        vertices.insert( vertices.end(), mesh->Vertices.begin(), mesh->Vertices.end() );
+        for ( size_t i = 0; i < mesh->Indices.size(); i++ ) {
+            indices[mesh->BaseIndexLocation + i] = mesh->Indices[i] + baseVertex;
+        }
+    }
+
+    LogInfo() << "Creating the world mesh with full vertices for a shader without compact variant, " << vertices.size() << " vertices";
+
+    FullWrappedWorldMesh = new MeshInfo();
+    Engine::GraphicsEngine->CreateVertexBuffer( &FullWrappedWorldMesh->MeshVertexBuffer );
+    Engine::GraphicsEngine->CreateVertexBuffer( &FullWrappedWorldMesh->MeshIndexBuffer );
+    FullWrappedWorldMesh->MeshVertexBuffer->Init( vertices.data(), vertices.size() * sizeof( ExVertexStruct ), D3D11VertexBuffer::B_VERTEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
+    FullWrappedWorldMesh->MeshIndexBuffer->Init( indices.data(), indices.size() * sizeof( unsigned int ), D3D11VertexBuffer::B_INDEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
+    return FullWrappedWorldMesh;
+}
+
 /** Returns the loaded sections */
 std::map<int, std::map<int, WorldMeshSectionInfo>>& GothicAPI::GetWorldSections() {
     return WorldSections;
 }
 
-static bool TraceWorldMeshBoxCmp( const std::pair<WorldMeshSectionInfo*, float>& a, const std::pair<WorldMeshSectionInfo*, float>& b ) {
-    return a.second > b.second;
+/** Returns the grid indexing the loaded sections */
+const WorldSectionGrid& GothicAPI::GetWorldSectionGrid() const {
+    return WorldSectionIndex;
 }
 
-/** Traces vobs with static mesh visual */
-VobInfo* GothicAPI::TraceStaticMeshVobsBB( const XMFLOAT3& origin, const XMFLOAT3& dir, XMFLOAT3& hit, zCMaterial** hitMaterial ) {
-    float closest = FLT_MAX;
-
-    std::list<VobInfo*> hitBBs;
-
-    XMFLOAT3 min;
-    XMFLOAT3 max;
+/** Returns the section at the given coordinates, creates it if it doesn't exist yet */
+WorldMeshSectionInfo& GothicAPI::GetOrCreateWorldSection( const INT2& coords ) {
+    if ( WorldMeshSectionInfo* section = WorldSectionIndex.Get( coords ) ) {
+        return *section;
+    }
 
-    for ( auto& [vob, vobInfo] : VobMap ) {
-        XMMATRIX world = XMMatrixTranspose( XMLoadFloat4x4( vob->GetWorldMatrixPtr() ) );
-        XMStoreFloat3( &min, XMVector3TransformCoord( XMLoadFloat3( &vobInfo->VisualInfo->BBox.Min ), world ) );
-        XMStoreFloat3( &max, XMVector3TransformCoord( XMLoadFloat3( &vobInfo->VisualInfo->BBox.Max ), world ) );
+    WorldMeshSectionInfo& section = WorldSections[coords.x][coords.y];
+    WorldSectionIndex.Insert( coords, &section );
+    return section;
+}
 
-        float t = 0;
-        if ( Toolbox::IntersectBox( min, max, origin, dir, t ) ) {
-            if ( t < closest ) {
-                closest = t;
-                hitBBs.push_back( vobInfo );
-            }
-        }
+/** Traces vobs with static mesh visual */
+VobInfo* GothicAPI::TraceStaticMeshVobsBB( const XMFLOAT3& origin, const XMFLOAT3& dir, XMFLOAT3& hit, zCMaterial** hitMaterial ) {
+    if ( !PickingVobTreeBuilt ) {
+        BuildPickingVobTree();
     }
 
-    // Now trace the actual triangles to find the real hit
+    std::vector<DynamicAabbTree::RayHit> hitBBs;
+    PickingVobTree.QueryRay( origin, dir, FLT_MAX, hitBBs );
+    std::sort( hitBBs.begin(), hitBBs.end(), []( const DynamicAabbTree::RayHit& a, const DynamicAabbTree::RayHit& b ) {
+        return a.Distance < b.Distance;
+    } );
+
+    // Now trace the actual triangles to find the real hit, closest box first
 
-    closest = FLT_MAX;
+    float closest = FLT_MAX;
     zCMaterial* closestMaterial = nullptr;
     VobInfo* closestVob = nullptr;
     XMFLOAT3 localOrigin;
     XMFLOAT3 localDir;
 
-    for ( VobInfo* vobInfo : hitBBs ) {
+    for ( const DynamicAabbTree::RayHit& bbHit : hitBBs ) {
+        if ( bbHit.Distance > closest )
+            break; // Everything from here on starts behind the closest hit
+
+        VobInfo* vobInfo = reinterpret_cast<VobInfo*>(PickingVobTree.GetUserData( bbHit.Proxy ));
         XMMATRIX invWorld = XMMatrixInverse( nullptr, XMMatrixTranspose( XMLoadFloat4x4( vobInfo->Vob->GetWorldMatrixPtr() ) ) );
         XMStoreFloat3( &localOrigin, XMVector3TransformCoord( XMLoadFloat3( &origin ), invWorld ) );
         XMStoreFloat3( &localDir, XMVector3TransformNormal( XMLoadFloat3( &dir ), invWorld ) );
@@ -3267,74 +3422,95 @@ float GothicAPI::TraceVisualInfo( const XMFLOAT3& origin, const XMFLOAT3& dir, B
 
 /** Traces the worldmesh and returns the hit-location */
 bool GothicAPI::TraceWorldMesh( const XMFLOAT3& origin, const XMFLOAT3& dir, XMFLOAT3& hit, std::string* hitTextureName, XMFLOAT3* hitTriangle, MeshInfo** hitMesh, zCMaterial** hitMaterial ) {
-    const int maxSections = 2;
-    float closest = FLT_MAX;
-    std::list<std::pair<WorldMeshSectionInfo*, float>> hitSections;
+    if ( !WorldMeshBvhBuilt ) {
+        BuildWorldMeshBvh();
+    }
 
-    // Trace bounding-boxes first
-    for ( auto&& itx : WorldSections ) {
-        for ( auto&& ity : itx.second ) {
-            WorldMeshSectionInfo& section = ity.second;
+    TriangleBvh::RayHit bvhHit;
+    if ( !WorldMeshBvh.TraceRay( origin, dir, FLT_MAX, bvhHit ) )
+        return false;
 
-            if ( section.WorldMeshes.empty() )
-                continue;
+    zCMaterial* material;
+    unsigned int firstIndex;
+    WorldMeshInfo* mesh = GetWorldMeshTriangleOwner( bvhHit.Triangle, &material, &firstIndex );
 
-            float t = 0;
-            if ( Toolbox::PositionInsideBox( origin, section.BoundingBox.Min, section.BoundingBox.Max ) || Toolbox::IntersectBox( section.BoundingBox.Min, section.BoundingBox.Max, origin, dir, t ) ) {
-                if ( t < maxSections * WORLD_SECTION_SIZE )
-                    hitSections.push_back( std::make_pair( &section, t ) );
-            }
+    if ( hitTriangle ) {
+        for ( int i = 0; i < 3; i++ ) {
+            hitTriangle[i] = *mesh->Vertices[mesh->Indices[firstIndex + i]].Position.toXMFLOAT3();
         }
     }
-    // Distance-sort
-    hitSections.sort( TraceWorldMeshBoxCmp );
 
-    int numProcessed = 0;
-    for ( auto const& bit : hitSections ) {
-        for ( std::map<MeshKey, WorldMeshInfo*>::iterator it = bit.first->WorldMeshes.begin(); it != bit.first->WorldMeshes.end(); ++it ) {
-            float u, v, t;
+    if ( hitMesh ) {
+        *hitMesh = mesh;
+    }
 
-            for ( unsigned int i = 0; i < it->second->Indices.size(); i += 3 ) {
-                if ( Toolbox::IntersectTri( *it->second->Vertices[it->second->Indices[i]].Position.toXMFLOAT3(),
-                    *it->second->Vertices[it->second->Indices[i + 1]].Position.toXMFLOAT3(),
-                    *it->second->Vertices[it->second->Indices[i + 2]].Position.toXMFLOAT3(),
-                    origin, dir, u, v, t ) ) {
-                    if ( t > 0 && t < closest ) {
-                        closest = t;
+    if ( hitMaterial ) {
+        *hitMaterial = material;
+    }
 
-                        if ( hitTriangle ) {
-                            hitTriangle[0] = *it->second->Vertices[it->second->Indices[i]].Position.toXMFLOAT3();
-                            hitTriangle[1] = *it->second->Vertices[it->second->Indices[i + 1]].Position.toXMFLOAT3();
-                            hitTriangle[2] = *it->second->Vertices[it->second->Indices[i + 2]].Position.toXMFLOAT3();
-                        }
+    if ( hitTextureName && material && material->GetTexture() )
+        *hitTextureName = material->GetTexture()->GetNameWithoutExt();
 
-                        if ( hitMesh ) {
-                            *hitMesh = it->second;
-                        }
+    XMStoreFloat3( &hit, XMLoadFloat3( &origin ) + XMLoadFloat3( &dir ) * bvhHit.Distance );
 
-                        if ( hitMaterial ) {
-                            *hitMaterial = it->first.Material;
-                        }
+    return true;
+}
+
+/** Traces many rays against the worldmesh at once */
+void GothicAPI::TraceWorldMeshRays( const XMFLOAT3* origins, const XMFLOAT3* dirs, unsigned int numRays, float maxDistance, TriangleBvh::RayHit* outHits ) const {
+    WorldMeshBvh.TraceRays( origins, dirs, numRays, maxDistance, outHits );
+}
+
+/** Rebuilds the BVH of the worldmesh if meshes were hidden or put back since it was built */
+void GothicAPI::UpdateWorldMeshBvh() {
+    if ( !WorldMeshBvhBuilt ) {
+        BuildWorldMeshBvh();
+    }
+}
+
+/** Returns the mesh a triangle from a trace belongs to */
+WorldMeshInfo* GothicAPI::GetWorldMeshTriangleOwner( unsigned int triangle, zCMaterial** outMaterial, unsigned int* outFirstIndex ) const {
+    // Last range starting at or before the triangle
+    auto range = std::upper_bound( WorldMeshBvhRanges.begin(), WorldMeshBvhRanges.end(), triangle, []( unsigned int t, const WorldMeshBvhRange& r ) {
+        return t < r.FirstTriangle;
+    } ) - 1;
+
+    if ( outMaterial ) {
+        *outMaterial = range->Material;
+    }
 
-                        if ( hitTextureName && it->first.Material && it->first.Material->GetTexture() )
-                            *hitTextureName = it->first.Material->GetTexture()->GetNameWithoutExt();
+    if ( outFirstIndex ) {
+        *outFirstIndex = (triangle - range->FirstTriangle) * 3;
+    }
+
+    return range->Mesh;
+}
+
+/** Builds WorldMeshBvh from the meshes of all sections */
+void GothicAPI::BuildWorldMeshBvh() {
+    BASIC_TIMING( t );
+
+    std::vector<XMFLOAT3> positions;
+    WorldMeshBvhRanges.clear();
+    for ( auto const& itx : WorldSections ) {
+        for ( auto const& ity : itx.second ) {
+            for ( auto const& it : ity.second.WorldMeshes ) {
+                WorldMeshInfo* mesh = it.second;
+                WorldMeshBvhRanges.push_back( { static_cast<unsigned int>(positions.size() / 3), mesh, it.first.Material } );
+                for ( unsigned int i = 0; i + 3 <= mesh->Indices.size(); i += 3 ) {
+                    for ( int v = 0; v < 3; v++ ) {
+                        positions.push_back( *mesh->Vertices[mesh->Indices[i + v]].Position.toXMFLOAT3() );
                     }
                 }
             }
-
-            numProcessed++;
-
-            if ( numProcessed == maxSections && closest != FLT_MAX )
-                break;
         }
     }
-    if ( closest == FLT_MAX )
-        return false;
 
+    WorldMeshBvh.Build( positions );
+    WorldMeshBvhBuilt = true;
 
-    XMStoreFloat3( &hit, XMLoadFloat3( &origin ) + XMLoadFloat3( &dir ) * closest );
-
-    return true;
+    t.Update();
+    LogInfo() << "Built world mesh BVH over " << WorldMeshBvh.GetNumTriangles() << " triangles in " << static_cast<int>(t.GetDelta() * 1000.0f) << "ms";
 }
 
 /** Unprojects a pixel-position on the screen */
@@ -3432,6 +3608,13 @@ XMFLOAT4X4& GothicAPI::GetProjectionMatrix() {
     return RendererState.TransformState.TransformProj;
 }
 
+/** Returns the planes of the current view frustum */
+CullingFrustum GothicAPI::GetCullingFrustum( unsigned int numPlanes ) {
+    XMMATRIX view = GetViewMatrixXM();
+    XMMATRIX proj = XMLoadFloat4x4( &GetProjectionMatrix() );
+    return CullingFrustum::FromViewProjection( XMMatrixTranspose( XMMatrixMultiply( proj, view ) ), numPlanes );
+}
+
 /** Returns the GSky-Object */
 GSky* GothicAPI::GetSky() const {
     return SkyRenderer.get();
@@ -3701,33 +3884,82 @@ void GothicAPI::DebugDrawBSPTree() {
 
 /** Collects vobs using gothics BSP-Tree */
 void GothicAPI::CollectVisibleVobs( std::vector<VobInfo*>& vobs, std::vector<VobLightInfo*>& lights, std::vector<SkeletalVobInfo*>& mobs ) {
-    zCBspTree* tree = LoadedWorldInfo->BspTree;
-
-    zCBspBase* rootBsp = tree->GetRootNode();
-    BspInfo* root = &BspLeafVobLists[rootBsp];
     if ( zCCamera::GetCamera() ) {
         zCCamera::GetCamera()->Activate();
     }
 
-    // Recursively go through the tree and draw all nodes
-    CollectVisibleVobsHelper( root, root->OriginalNode->BBox3D, 63, vobs, lights, mobs );
+    // Vobs are tested against the side planes, the far plane is covered by the draw radii
+    VobCullingFrustum = GetCullingFrustum( 4 );
+    VobCullingDistances.Viewer = GetCameraPosition();
+    VobCullingDistances.Radius[BOX_DISTANCE_OUTDOOR] = RendererState.RendererSettings.OutdoorVobDrawRadius;
+    VobCullingDistances.Radius[BOX_DISTANCE_OUTDOOR_SMALL] = RendererState.RendererSettings.OutdoorSmallVobDrawRadius;
+    VobCullingDistances.Radius[BOX_DISTANCE_INDOOR] = RendererState.RendererSettings.IndoorVobDrawRadius;
+    VobCullingDistances.DetailScaleSq = 0.0f;
+
+    // The size on screen replaces the radii, large vobs only end where the world mesh does
+    if ( RendererState.RendererSettings.EnableScreenSizeCulling ) {
+        const float maxDistance = std::max( RendererState.RendererSettings.OutdoorVobDrawRadius, RendererState.RendererSettings.SectionDrawRadius * WORLD_SECTION_SIZE );
+        for ( float& radius : VobCullingDistances.Radius ) {
+            radius = maxDistance;
+        }
+
+        const float pixelsPerUnit = GetProjectionMatrix()._22 * Engine::GraphicsEngine->GetResolution().y * 0.5f;
+        const float detailScale = CullingDistances::GetDetailScale( pixelsPerUnit, RendererState.RendererSettings.MinVobScreenSize );
+        VobCullingDistances.DetailScaleSq = detailScale * detailScale;
+    }
+
+    // Indoor worlds are closed apart from their portals, so leaves the camera can't see through them can be skipped
+    VobCullingPvsLeaf = FlatBspNode::NO_NODE;
+    if ( RendererState.RendererSettings.EnablePortalPvs ) {
+        VobCullingPvsLeaf = FindPvsLeaf( VobCullingDistances.Viewer );
+    }
+
+    if ( RendererState.RendererSettings.EnableSoftwareOcclusionCulling ) {
+        UpdateSoftwareOcclusion();
+    }
+
+    // Go through the tree and draw all nodes
+    CollectVisibleVobsHelper( vobs, lights, mobs );
 
     FXMVECTOR camPos = GetCameraPositionXM();
     const float vobIndoorDist = Engine::GAPI->GetRendererState().RendererSettings.IndoorVobDrawRadius;
     const float vobOutdoorDist = Engine::GAPI->GetRendererState().RendererSettings.OutdoorVobDrawRadius;
     const float vobOutdoorSmallDist = Engine::GAPI->GetRendererState().RendererSettings.OutdoorSmallVobDrawRadius;
     const float vobSmallSize = Engine::GAPI->GetRendererState().RendererSettings.SmallVobSize;
+    const bool screenSizeCulling = VobCullingDistances.DetailScaleSq > 0.0f;
+    const float vobMaxDist = std::max( { VobCullingDistances.Radius[BOX_DISTANCE_OUTDOOR], VobCullingDistances.Radius[BOX_DISTANCE_OUTDOOR_SMALL], VobCullingDistances.Radius[BOX_DISTANCE_INDOOR] } );
 
     std::list<VobInfo*> removeList; // TODO: This should not be needed!
     
     // Add visible dynamically added vobs
     if ( Engine::GAPI->GetRendererState().RendererSettings.DrawVOBs ) {
+        // The tree only finds the ones in front of the camera within the largest radius, the radius of each vob is checked below
+        std::vector<unsigned int>& candidates = VobTreeQueryResults;
+        candidates.clear();
+        DynamicVobTree.QueryFrustum( VobCullingFrustum, VobCullingDistances.Viewer, vobMaxDist, candidates );
+
+        // Same rule as in the culling kernels, with the sphere around the box of the vob
+        auto isLargeEnough = [&]( VobInfo* vob, float dist ) {
+            const zTBBox3D box = vob->Vob->GetBBox();
+            float sphereRadiusSq;
+            XMStoreFloat( &sphereRadiusSq, XMVector3LengthSq( (XMLoadFloat3( &box.Max ) - XMLoadFloat3( &box.Min )) * 0.5f ) );
+            return dist < vobMaxDist && dist * dist < sphereRadiusSq * VobCullingDistances.DetailScaleSq;
+        };
+
         float dist;
-        for ( VobInfo* it : DynamicallyAddedVobs ) {
+        for ( unsigned int proxy : candidates ) {
+            VobInfo* it = reinterpret_cast<VobInfo*>(DynamicVobTree.GetUserData( proxy ));
             // Get distance to this vob
             XMStoreFloat( &dist, XMVector3Length( camPos - it->Vob->GetPositionWorldXM() ) );
+            if ( !it->VisualInfo ) {
+                continue;
+            }
+
             // Draw, if in range
-            if ( it->VisualInfo && ((dist < vobIndoorDist && it->IsIndoorVob) || (dist < vobOutdoorSmallDist && it->VisualInfo->MeshSize < vobSmallSize) || (dist < vobOutdoorDist)) ) {
+            const bool inRange = screenSizeCulling
+                ? isLargeEnough( it, dist )
+                : ((dist < vobIndoorDist && it->IsIndoorVob) || (dist < vobOutdoorSmallDist && it->VisualInfo->MeshSize < vobSmallSize) || (dist < vobOutdoorDist));
+            if ( inRange ) {
 #ifdef BUILD_GOTHIC_1_08k
                 // TODO: This is sometimes nullptr, suggesting that the Vob is invalid. Why does this happen?
                 if ( !it->VobConstantBuffer ) {
@@ -3745,19 +3977,7 @@ void GothicAPI::CollectVisibleVobs( std::vector<VobInfo*>& vobs, std::vector<Vob
                     continue;
                 }
 
-                VobInstanceInfo vii;
-                vii.world = it->WorldMatrix;
-                vii.color = it->GroundColor;
-                vii.windStrenth = 0.0f;
-                vii.canBeAffectedByPlayer = 0;
-
-                zTAnimationMode aniMode = it->Vob->GetVisualAniMode();
-                if ( aniMode != zVISUAL_ANIMODE_NONE ) {
-                    vii.canBeAffectedByPlayer = (!it->Vob->GetDynColl() ? 1.0f : 0.0f);
-                    ProcessVobAnimation( it->Vob, aniMode, vii );
-                }
-
-                reinterpret_cast<MeshVisualInfo*>(it->VisualInfo)->Instances.push_back( vii );
+                AddStaticMeshInstance( it );
 
                 vobs.push_back( it );
                 it->VisibleInRenderPass = true;
@@ -3768,7 +3988,8 @@ void GothicAPI::CollectVisibleVobs( std::vector<VobInfo*>& vobs, std::vector<Vob
 #ifdef BUILD_GOTHIC_1_08k
     // TODO: See above for info on this
     for ( VobInfo* vi : removeList ) {
-        RegisteredVobs.insert( vi->Vob ); // This vob isn't in this set anymore, but still in DynamicallyAddedVobs??
+        RemoveVobFromTrees( vi ); // OnRemovedVob only finds it if it is still in the vob map
+        RegisteredVobs.insert( vi->Vob ); // This vob isn't in this set anymore, but still in the dynamic vob tree??
         OnRemovedVob( vi->Vob, oCGame::GetGame()->_zCSession_world );
     }
 #endif
@@ -3779,51 +4000,102 @@ void GothicAPI::CollectVisibleSections( std::vector<WorldMeshSectionInfo*>& sect
     const XMFLOAT3 camPos = Engine::GAPI->GetCameraPosition();
     const INT2 camSection = WorldConverter::GetSectionOfPos( camPos );
 
+    const CullingFrustum frustum = GetCullingFrustum( 4 ); // Frustum check, no farplane
+    CullingDistances distances;
+    distances.Viewer = camPos;
+
+    std::vector<unsigned int>& visible = VisibleSectionIndices;
+    visible.clear();
+
+    const std::vector<WorldMeshSectionInfo*>& allSections = WorldSectionIndex.GetSections();
     if ( Engine::GAPI->GetRendererState().RendererSettings.DrawSectionIntersections ) {
         extern const float WORLD_SECTION_SIZE;
-        const float sectionViewDist = Engine::GAPI->GetRendererState().RendererSettings.SectionDrawRadius * WORLD_SECTION_SIZE;
-        for ( auto& itx : WorldSections ) {
-            for ( auto& ity : itx.second ) {
-                WorldMeshSectionInfo& section = ity.second;
-
-                float dist = Toolbox::ComputePointAABBDistance( camPos, section.BoundingBox.Min, section.BoundingBox.Max );
-                if ( dist < sectionViewDist ) {
-                    int flags = 15; // Frustum check, no farplane
-                    if ( zCCamera::GetCamera()->BBox3DInFrustum( section.BoundingBox, flags ) == ZTCAM_CLIPTYPE_OUT )
-                        continue;
+        distances.Radius[BOX_DISTANCE_OUTDOOR] = Engine::GAPI->GetRendererState().RendererSettings.SectionDrawRadius * WORLD_SECTION_SIZE;
+        WorldSectionIndex.Cull( frustum, distances, visible );
 
-                    sections.push_back( &section );
-                }
-            }
+        for ( unsigned int idx : visible ) {
+            sections.push_back( allSections[idx] );
         }
     } else {
-        // run through every section and check for range and frustum
-        const int sectionViewDist = Engine::GAPI->GetRendererState().RendererSettings.SectionDrawRadius;
-        for ( auto& itx : WorldSections ) {
-            if ( abs( itx.first - camSection.x ) >= sectionViewDist ) {
-                continue;
+        // Every section in range of the camera cell that passes the frustum check
+        distances.Radius[BOX_DISTANCE_OUTDOOR] = FLT_MAX;
+        WorldSectionIndex.Cull( frustum, distances, visible );
+
+        const int sectionViewDist = Engine::GAPI->GetRendererState().RendererSettings.SectionDrawRadius - 1;
+        const std::vector<INT2>& coords = WorldSectionIndex.GetCoords();
+        for ( unsigned int idx : visible ) {
+            if ( abs( coords[idx].x - camSection.x ) <= sectionViewDist && abs( coords[idx].y - camSection.y ) <= sectionViewDist ) {
+                sections.push_back( allSections[idx] );
             }
+        }
+    }
+}
 
-            for ( auto& ity : itx.second ) {
-                WorldMeshSectionInfo& section = ity.second;
+/** Draws the world sections around the camera into SoftwareOcclusion */
+void GothicAPI::UpdateSoftwareOcclusion() {
+    // Enough to hide most of what is behind hills and buildings, while staying cheap to draw
+    const unsigned int OCCLUSION_BUFFER_WIDTH = 256;
+    const unsigned int OCCLUDER_TRIANGLE_BUDGET = 30000;
 
-                // Simple range-check
-                if ( abs( ity.first - camSection.y ) < sectionViewDist ) {
-                    int flags = 15; // Frustum check, no farplane
-                    if ( zCCamera::GetCamera()->BBox3DInFrustum( section.BoundingBox, flags ) == ZTCAM_CLIPTYPE_OUT )
-                        continue;
+    INT2 res = Engine::GraphicsEngine->GetResolution();
+    if ( res.x <= 0 || res.y <= 0 ) {
+        res = INT2( 16, 9 );
+    }
+    SoftwareOcclusion.Resize( OCCLUSION_BUFFER_WIDTH, std::max( 1u, OCCLUSION_BUFFER_WIDTH * res.y / res.x ) );
 
-                    sections.push_back( &section );
-                }
+    XMMATRIX view = GetViewMatrixXM();
+    XMMATRIX proj = XMLoadFloat4x4( &GetProjectionMatrix() );
+    SoftwareOcclusion.BeginFrame( XMMatrixTranspose( XMMatrixMultiply( proj, view ) ) );
+
+    const XMFLOAT3 camPos = GetCameraPosition();
+    CullingDistances distances;
+    distances.Viewer = camPos;
+    distances.Radius[BOX_DISTANCE_OUTDOOR] = RendererState.RendererSettings.OutdoorVobDrawRadius;
+
+    OccluderSectionIndices.clear();
+    WorldSectionIndex.Cull( VobCullingFrustum, distances, OccluderSectionIndices );
+
+    // Closest sections first, since they hide the most and the budget may run out
+    const std::vector<WorldMeshSectionInfo*>& allSections = WorldSectionIndex.GetSections();
+    std::sort( OccluderSectionIndices.begin(), OccluderSectionIndices.end(), [&]( unsigned int a, unsigned int b ) {
+        return Toolbox::ComputePointAABBDistance( camPos, allSections[a]->BoundingBox.Min, allSections[a]->BoundingBox.Max )
+            < Toolbox::ComputePointAABBDistance( camPos, allSections[b]->BoundingBox.Min, allSections[b]->BoundingBox.Max );
+    } );
+
+    unsigned int numTriangles = 0;
+    for ( unsigned int idx : OccluderSectionIndices ) {
+        for ( auto const& [key, mesh] : allSections[idx]->WorldMeshes ) {
+            // Only solid surfaces hide what is behind them
+            if ( !key.Material || !key.Info || key.Info->MaterialType != MaterialInfo::MT_None
+                || key.Material->GetAlphaFunc() > zMAT_ALPHA_FUNC_NONE || mesh->Vertices.empty() ) {
+                continue;
+            }
+
+            // The mesh which reaches the budget only gets its first triangles drawn
+            const unsigned int meshTriangles = std::min( OCCLUDER_TRIANGLE_BUDGET - numTriangles, static_cast<unsigned int>(mesh->Indices.size() / 3) );
+            SoftwareOcclusion.AddOccluder( mesh->Vertices[0].Position.toXMFLOAT3(), sizeof( ExVertexStruct ),
+                static_cast<unsigned int>(mesh->Vertices.size()), mesh->Indices.data(), meshTriangles * 3 );
+
+            numTriangles += meshTriangles;
+            if ( numTriangles >= OCCLUDER_TRIANGLE_BUDGET ) {
+                break;
             }
         }
+
+        if ( numTriangles >= OCCLUDER_TRIANGLE_BUDGET ) {
+            break;
+        }
     }
+
+    SoftwareOcclusion.Rasterize();
 }
 
 /** Moves the given vob from a BSP-Node to the dynamic vob list */
 void GothicAPI::MoveVobFromBspToDynamic( SkeletalVobInfo* vob ) {
     auto& parentBspNodes = vob->ParentBSPNodes;
     for ( auto const& node : parentBspNodes ) {
+        node->LeafRangesDirty = true;
+
         // Remove from possible lists
         for ( std::vector<SkeletalVobInfo*>::iterator it = node->Mobs.begin(); it != node->Mobs.end(); ++it ) {
             if ( (*it) == vob ) {
@@ -3844,6 +4116,7 @@ void GothicAPI::MoveVobFromBspToDynamic( VobInfo* vob ) {
     // Remove from all nodes
     for ( size_t i = 0; i < vob->ParentBSPNodes.size(); i++ ) {
         BspInfo* node = vob->ParentBSPNodes[i];
+        node->LeafRangesDirty = true;
 
         // Remove from possible lists
         for ( std::vector<VobInfo*>::iterator it = node->IndoorVobs.begin(); it != node->IndoorVobs.end(); ++it ) {
@@ -3873,7 +4146,7 @@ void GothicAPI::MoveVobFromBspToDynamic( VobInfo* vob ) {
     vob->ParentBSPNodes.clear();
 
     // Add to dynamic vob list
-    DynamicallyAddedVobs.push_back( vob );
+    AddDynamicVob( vob );
 }
 
 std::vector<VobInfo*>::iterator GothicAPI::MoveVobFromBspToDynamic( VobInfo* vob, std::vector<VobInfo*>* source ) {
@@ -3883,6 +4156,7 @@ std::vector<VobInfo*>::iterator GothicAPI::MoveVobFromBspToDynamic( VobInfo* vob
     // Remove from all nodes
     for ( size_t i = 0; i < vob->ParentBSPNodes.size(); i++ ) {
         BspInfo* node = vob->ParentBSPNodes[i];
+        node->LeafRangesDirty = true;
 
         // Remove from possible lists
         for ( auto it = node->IndoorVobs.begin(); it != node->IndoorVobs.end(); ++it ) {
@@ -3917,11 +4191,87 @@ std::vector<VobInfo*>::iterator GothicAPI::MoveVobFromBspToDynamic( VobInfo* vob
     }
 
     // Add to dynamic vob list
-    DynamicallyAddedVobs.push_back( vob );
+    AddDynamicVob( vob );
 
     return itn;
 }
 
+/** Box of the given vob in the vob trees */
+zTBBox3D GothicAPI::GetVobTreeBox( VobInfo* vob ) {
+    const XMFLOAT3 position = vob->Vob->GetPositionWorld();
+    zTBBox3D box = vob->Vob->GetBBox();
+    if ( !(box.Min.x <= box.Max.x && box.Min.y <= box.Max.y && box.Min.z <= box.Max.z) ) {
+        box.Min = box.Max = position; // Not set up yet
+    }
+
+    box.Min = XMFLOAT3( std::min( box.Min.x, position.x ), std::min( box.Min.y, position.y ), std::min( box.Min.z, position.z ) );
+    box.Max = XMFLOAT3( std::max( box.Max.x, position.x ), std::max( box.Max.y, position.y ), std::max( box.Max.z, position.z ) );
+    return box;
+}
+
+/** Adds the vob to the dynamic vob tree, or updates its box if it already is in there */
+void GothicAPI::AddDynamicVob( VobInfo* vob ) {
+    if ( vob->DynamicTreeProxy != VobInfo::NO_TREE_PROXY ) {
+        RefitVobTrees( vob );
+        return;
+    }
+
+    VobTreeTimer.Update();
+    vob->DynamicTreeProxy = DynamicVobTree.Insert( GetVobTreeBox( vob ), vob );
+    VobTreeTimer.Update();
+    RendererState.RendererInfo.FrameVobTreeMS += VobTreeTimer.GetDelta() * 1000.0f;
+}
+
+/** Updates the boxes of the vob in all vob trees it is in */
+void GothicAPI::RefitVobTrees( VobInfo* vob ) {
+    if ( vob->DynamicTreeProxy == VobInfo::NO_TREE_PROXY && vob->PickingTreeProxy == VobInfo::NO_TREE_PROXY )
+        return;
+
+    VobTreeTimer.Update();
+    const zTBBox3D box = GetVobTreeBox( vob );
+    if ( vob->DynamicTreeProxy != VobInfo::NO_TREE_PROXY && DynamicVobTree.Refit( vob->DynamicTreeProxy, box ) ) {
+        RendererState.RendererInfo.FrameVobTreeReinserts++;
+    }
+
+    if ( vob->PickingTreeProxy != VobInfo::NO_TREE_PROXY && PickingVobTree.Refit( vob->PickingTreeProxy, box ) ) {
+        RendererState.RendererInfo.FrameVobTreeReinserts++;
+    }
+    VobTreeTimer.Update();
+    RendererState.RendererInfo.FrameVobTreeMS += VobTreeTimer.GetDelta() * 1000.0f;
+}
+
+/** Removes the vob from all vob trees it is in */
+void GothicAPI::RemoveVobFromTrees( VobInfo* vob ) {
+    if ( vob->DynamicTreeProxy == VobInfo::NO_TREE_PROXY && vob->PickingTreeProxy == VobInfo::NO_TREE_PROXY )
+        return;
+
+    VobTreeTimer.Update();
+    if ( vob->DynamicTreeProxy != VobInfo::NO_TREE_PROXY ) {
+        DynamicVobTree.Remove( vob->DynamicTreeProxy );
+        vob->DynamicTreeProxy = VobInfo::NO_TREE_PROXY;
+    }
+
+    if ( vob->PickingTreeProxy != VobInfo::NO_TREE_PROXY ) {
+        PickingVobTree.Remove( vob->PickingTreeProxy );
+        vob->PickingTreeProxy = VobInfo::NO_TREE_PROXY;
+    }
+    VobTreeTimer.Update();
+    RendererState.RendererInfo.FrameVobTreeMS += VobTreeTimer.GetDelta() * 1000.0f;
+}
+
+/** Fills PickingVobTree with all vobs of VobMap */
+void GothicAPI::BuildPickingVobTree() {
+    PickingVobTree.Clear();
+    for ( auto& [vob, vobInfo] : VobMap ) {
+        if ( vobInfo ) {
+            vobInfo->PickingTreeProxy = PickingVobTree.Insert( GetVobTreeBox( vobInfo ), vobInfo );
+        }
+    }
+
+    PickingVobTreeBuilt = true;
+    LogInfo() << "Built picking tree for " << PickingVobTree.GetNumProxies() << " vobs, height " << PickingVobTree.GetHeight();
+}
+
 static void ProcessVobAnimation( zCVob* vob, zTAnimationMode aniMode, VobInstanceInfo& vobInstance ) {
     if ( Engine::GAPI->GetRendererState().RendererSettings.WindQuality == GothicRendererSettings::EWindQuality::WIND_QUALITY_ADVANCED ) {
         extern float vobAnimation_WindStrength;
@@ -3929,38 +4279,59 @@ static void ProcessVobAnimation( zCVob* vob, zTAnimationMode aniMode, VobInstanc
     }
 }
 
-static void CVVH_AddNotDrawnVobToList( std::vector<VobInfo*>& target, std::vector<VobInfo*>& source, float dist ) {
-    std::vector<VobInfo*> remVobs;
+/** Fills the instance data the given vob is drawn with */
+void GothicAPI::GetVobInstanceInfo( VobInfo* vob, VobInstanceInfo& outInstance ) {
+    outInstance.world = vob->WorldMatrix;
+    outInstance.color = vob->GroundColor;
+    outInstance.windStrenth = 0.0f;
+    outInstance.canBeAffectedByPlayer = 0;
+    outInstance.GP_Slot = 0;
 
-    const auto& camPos = Engine::GAPI->GetCameraPositionXM();
+    zTAnimationMode aniMode = vob->Vob->GetVisualAniMode();
+    if ( aniMode != zVISUAL_ANIMODE_NONE ) {
+        outInstance.canBeAffectedByPlayer = (!vob->Vob->GetDynColl() ? 1.0f : 0.0f);
+        ProcessVobAnimation( vob->Vob, aniMode, outInstance );
+    }
+}
 
-    for ( auto const& it : source ) {
-        if ( !it->VisibleInRenderPass ) {
-            float vd;
-            XMStoreFloat( &vd, XMVector3Length( camPos - XMLoadFloat3( &it->LastRenderPosition ) ) );
-            if ( vd < dist && it->Vob->GetShowVisual() ) {
-                if ( it->Vob->GetVisualAlpha() ) {
-                    Engine::GAPI->TransparencyVobs.emplace_back( vd, it->Vob->GetVobTransparency(), nullptr, it );
-                    std::push_heap( Engine::GAPI->TransparencyVobs.begin(), Engine::GAPI->TransparencyVobs.end(), CompareGhostDistance );
-                    continue;
-                }
+/** Adds the vob as an instance of its visual for this frame and updates its slot in the static instance store */
+void GothicAPI::AddStaticMeshInstance( VobInfo* vob ) {
+    VobInstanceInfo vii;
+    GetVobInstanceInfo( vob, vii );
 
-                VobInstanceInfo vii;
-                vii.world = it->WorldMatrix;
-                vii.color = it->GroundColor;
-                vii.windStrenth = 0.0f;
-                vii.canBeAffectedByPlayer = 0;
+    // Most vobs never move, so their slot stays clean and nothing of them gets uploaded again
+    StaticInstances.Update( vob->InstanceSlot, vii );
 
-                zTAnimationMode aniMode = it->Vob->GetVisualAniMode();
-                if ( aniMode != zVISUAL_ANIMODE_NONE ) {
-                    vii.canBeAffectedByPlayer = (!it->Vob->GetDynColl() ? 1.0f : 0.0f);
-                    ProcessVobAnimation( it->Vob, aniMode, vii );
-                }
+    // The draws only need the slot, the LOD selection only the position and scale
+    const XMFLOAT4X4& m = vob->WorldMatrix;
+    const float scaleSq = std::max( {
+        m._11 * m._11 + m._21 * m._21 + m._31 * m._31,
+        m._12 * m._12 + m._22 * m._22 + m._32 * m._32,
+        m._13 * m._13 + m._23 * m._23 + m._33 * m._33,
+        FLT_MIN } );
 
-                reinterpret_cast<MeshVisualInfo*>(it->VisualInfo)->Instances.push_back( vii );
-                target.push_back( it );
-                it->VisibleInRenderPass = true;
+    MeshVisualInfo* visual = reinterpret_cast<MeshVisualInfo*>(vob->VisualInfo);
+    visual->InstanceSlots.push_back( vob->InstanceSlot );
+    visual->InstanceLods.push_back( { XMFLOAT3( m._14, m._24, m._34 ), 1.0f / scaleSq } );
+}
+
+static void CVVH_AddNotDrawnVobToList( std::vector<VobInfo*>& target, const std::vector<VobInfo*>& source ) {
+    const auto& camPos = Engine::GAPI->GetCameraPositionXM();
+
+    // Distance and frustum were already checked while collecting the candidates
+    for ( VobInfo* it : source ) {
+        if ( !it->VisibleInRenderPass && it->Vob->GetShowVisual() ) {
+            if ( it->Vob->GetVisualAlpha() ) {
+                float vd;
+                XMStoreFloat( &vd, XMVector3Length( camPos - XMLoadFloat3( &it->LastRenderPosition ) ) );
+                Engine::GAPI->TransparencyVobs.emplace_back( vd, it->Vob->GetVobTransparency(), nullptr, it );
+                std::push_heap( Engine::GAPI->TransparencyVobs.begin(), Engine::GAPI->TransparencyVobs.end(), CompareGhostDistance );
+                continue;
             }
+
+            Engine::GAPI->AddStaticMeshInstance( it );
+            target.push_back( it );
+            it->VisibleInRenderPass = true;
         }
     }
 }
@@ -3981,12 +4352,13 @@ static void CVVH_AddNotDrawnVobToList( std::vector<VobLightInfo*>& target, std::
     }
 }
 
-static void CVVH_AddNotDrawnVobToList( std::vector<SkeletalVobInfo*>& target, std::vector<SkeletalVobInfo*>& source, float dist ) {
+static void CVVH_AddNotDrawnVobToList( std::vector<SkeletalVobInfo*>& target, SkeletalVobInfo* const* source, unsigned int count, float dist ) {
     float vd;
 
     const auto& camPos = Engine::GAPI->GetCameraPositionXM();
 
-    for ( auto const& it : source ) {
+    for ( unsigned int i = 0; i < count; i++ ) {
+        SkeletalVobInfo* it = source[i];
         if ( !it->VisibleInRenderPass ) {
             XMStoreFloat( &vd, XMVector3Length( camPos - it->Vob->GetPositionWorldXM() ) );
             if ( vd < dist && it->Vob->GetShowVisual() ) {
@@ -3997,173 +4369,282 @@ static void CVVH_AddNotDrawnVobToList( std::vector<SkeletalVobInfo*>& target, st
     }
 }
 
-/** Recursive helper function to draw collect the vobs */
-void GothicAPI::CollectVisibleVobsHelper( BspInfo* base, zTBBox3D boxCell, int clipFlags, std::vector<VobInfo*>& vobs, std::vector<VobLightInfo*>& lights, std::vector<SkeletalVobInfo*>& mobs ) {
-    const float vobIndoorDist = Engine::GAPI->GetRendererState().RendererSettings.IndoorVobDrawRadius;
-    const float vobOutdoorDist = Engine::GAPI->GetRendererState().RendererSettings.OutdoorVobDrawRadius;
-    const float vobOutdoorSmallDist = Engine::GAPI->GetRendererState().RendererSettings.OutdoorSmallVobDrawRadius;
-    const float vobSmallSize = Engine::GAPI->GetRendererState().RendererSettings.SmallVobSize;
-    const float visualFXDrawRadius = Engine::GAPI->GetRendererState().RendererSettings.VisualFXDrawRadius;
+/** Splits the BSP-tree into subtrees of the given depth, in the order CollectVisibleVobsHelper would visit them */
+void GothicAPI::SplitVobCollectionTasks( unsigned int splitDepth ) {
     const XMFLOAT3 camPos = Engine::GAPI->GetCameraPosition();
-    const FXMVECTOR cameraPosition = Engine::GAPI->GetCameraPositionXM();
 
-    while ( base->OriginalNode ) {
-        // Check for occlusion-culling
-        if ( Engine::GAPI->GetRendererState().RendererSettings.EnableOcclusionCulling && !base->OcclusionInfo.VisibleLastFrame ) {
-            return;
+    unsigned int numTasks = 0;
+    auto addTask = [&]( unsigned int node ) {
+        if ( numTasks == VobCollectionTasks.size() ) {
+            VobCollectionTasks.emplace_back();
         }
 
-        if ( clipFlags > 0 ) {
-            float yMaxWorld = Engine::GAPI->GetLoadedWorldInfo()->BspTree->GetRootNode()->BBox3D.Max.y;
+        VobCollectionTask& task = VobCollectionTasks[numTasks++];
+        task.Node = node;
+        task.Vobs.clear();
+        task.Mobs.clear();
+        task.LightLeaves.clear();
+
+        // Stamps only have to be unique between the tasks of a few frames, start over when they run out
+        if ( ++VobCollectionStamp == 0 ) {
+            for ( VobCollectionScratch& scratch : VobCollectionScratches ) {
+                std::fill( scratch.Stamps.begin(), scratch.Stamps.end(), 0 );
+            }
+            VobCollectionStamp = 1;
+        }
+        task.Stamp = VobCollectionStamp;
+    };
+
+    // Nodes above the split depth aren't culled here, every subtree checks its own root
+    std::vector<std::pair<unsigned int, int>>& stack = VobCollectionScratches[0].Stack;
+    stack.clear();
+    stack.emplace_back( 0, 0 );
+    while ( !stack.empty() ) {
+        const unsigned int index = stack.back().first;
+        const int depth = stack.back().second;
+        stack.pop_back();
+
+        const FlatBspNode& node = FlatBspNodes[index];
+        if ( depth >= static_cast<int>(splitDepth) || node.Leaf ) {
+            addTask( index );
+            continue;
+        }
+
+        // Pushed far side first, so the near side gets split first
+        const float planeDist = node.PlaneNormal.x * camPos.x + node.PlaneNormal.y * camPos.y + node.PlaneNormal.z * camPos.z;
+        const unsigned int nearChild = planeDist > node.PlaneDistance ? node.Front : node.Back;
+        const unsigned int farChild = planeDist > node.PlaneDistance ? node.Back : node.Front;
+        if ( farChild != FlatBspNode::NO_NODE ) {
+            stack.emplace_back( farChild, depth + 1 );
+        }
+        if ( nearChild != FlatBspNode::NO_NODE ) {
+            stack.emplace_back( nearChild, depth + 1 );
+        }
+    }
 
-            zTBBox3D nodeBox = base->OriginalNode->BBox3D;
+    VobCollectionTasks.resize( numTasks );
+}
+
+/** Collects the candidates of one subtree. Only reads the flat tree and the culling state prepared on the main thread,
+    never the game objects, so tasks can run on any thread. */
+void GothicAPI::CollectVobCollectionTask( VobCollectionTask& task, VobCollectionScratch& scratch ) {
+    const float vobOutdoorDist = Engine::GAPI->GetRendererState().RendererSettings.OutdoorVobDrawRadius;
+    const float vobOutdoorSmallDist = Engine::GAPI->GetRendererState().RendererSettings.OutdoorSmallVobDrawRadius;
+    const float vobMaxDist = std::max( { VobCullingDistances.Radius[BOX_DISTANCE_OUTDOOR], VobCullingDistances.Radius[BOX_DISTANCE_OUTDOOR_SMALL], VobCullingDistances.Radius[BOX_DISTANCE_INDOOR] } );
+    const float visualFXDrawRadius = Engine::GAPI->GetRendererState().RendererSettings.VisualFXDrawRadius;
+    const XMFLOAT3 camPos = VobCullingDistances.Viewer;
+    const bool drawVobs = Engine::GAPI->GetRendererState().RendererSettings.DrawVOBs;
+    const bool drawMobs = Engine::GAPI->GetRendererState().RendererSettings.DrawMobs;
+    const bool dynamicLighting = RendererState.RendererSettings.EnableDynamicLighting;
+
+    // The software occlusion buffer replaces the queries, which aren't updated while it is used
+    const bool softwareOcclusion = Engine::GAPI->GetRendererState().RendererSettings.EnableSoftwareOcclusionCulling;
+    const bool queryOcclusion = Engine::GAPI->GetRendererState().RendererSettings.EnableOcclusionCulling && !softwareOcclusion;
+    const unsigned int pvsLeaf = VobCullingPvsLeaf;
+
+    const float yMaxWorld = FlatBspNodes[0].BBox3D.Max.y;
+
+    // The far side of every node is pushed, the near side is walked right away, so the nodes are visited
+    // front to back. Both sides start with the frustum planes left over from their parent.
+    std::vector<std::pair<unsigned int, int>>& stack = scratch.Stack;
+    stack.clear();
+    stack.emplace_back( task.Node, static_cast<int>(VobCullingFrustum.GetPlaneMask()) );
+    while ( !stack.empty() ) {
+        unsigned int index = stack.back().first;
+        uint32_t planeMask = static_cast<uint32_t>(stack.back().second);
+        stack.pop_back();
+
+        while ( index != FlatBspNode::NO_NODE ) {
+            FlatBspNode& node = FlatBspNodes[index];
+
+            // Check for occlusion-culling
+            if ( queryOcclusion && !node.Info->OcclusionInfo.VisibleLastFrame ) {
+                break;
+            }
+
+            zTBBox3D nodeBox = node.BBox3D;
             float nodeYMax = std::min( yMaxWorld, camPos.y );
-            nodeYMax = std::max( nodeYMax, base->OriginalNode->BBox3D.Max.y );
+            nodeYMax = std::max( nodeYMax, node.BBox3D.Max.y );
             nodeBox.Max.y = nodeYMax;
 
-            float dist = Toolbox::ComputePointAABBDistance( camPos, base->OriginalNode->BBox3D.Min, base->OriginalNode->BBox3D.Max );
-            if ( dist < vobOutdoorDist ) {
-                zTCam_ClipType nodeClip;
-                if ( !Engine::GAPI->GetRendererState().RendererSettings.EnableOcclusionCulling ) {
-                    nodeClip = zCCamera::GetCamera()->BBox3DInFrustum( nodeBox, clipFlags );
+            const float dist = Toolbox::ComputePointAABBDistance( camPos, node.BBox3D.Min, node.BBox3D.Max );
+            if ( planeMask > 0 ) {
+                if ( dist >= std::max( vobOutdoorDist, VobCullingDistances.Radius[BOX_DISTANCE_OUTDOOR] ) ) {
+                    break; // Too far
+                }
+
+                bool nodeVisible;
+                if ( !queryOcclusion ) {
+                    nodeVisible = VobCullingFrustum.ClipBox( nodeBox, planeMask );
                 } else {
-                    nodeClip = static_cast<zTCam_ClipType>(base->OcclusionInfo.LastCameraClipType); // If we are using occlusion-clipping, this test has already been done
+                    nodeVisible = node.Info->OcclusionInfo.LastCameraClipType != ZTCAM_CLIPTYPE_OUT; // If we are using occlusion-clipping, this test has already been done
                 }
 
-                if ( nodeClip == ZTCAM_CLIPTYPE_OUT ) {
-                    return; // Nothig to see here. Discard this node and the subtree}
+                if ( !nodeVisible ) {
+                    break; // Nothig to see here. Discard this node and the subtree
                 }
-            } else {
-                // Too far
-                return;
             }
-        }
 
-        if ( base->OriginalNode->IsLeaf() ) {
-            // Check if this leaf is inside the frustum
-        
+            if ( softwareOcclusion && !SoftwareOcclusion.IsBoxVisible( nodeBox ) ) {
+                break; // Hidden behind the world mesh
+            }
 
-            zCBspLeaf* leaf = static_cast<zCBspLeaf*>(base->OriginalNode);
-            std::vector<VobInfo*>& listA = base->IndoorVobs;
-            std::vector<VobInfo*>& listB = base->SmallVobs;
-            std::vector<VobInfo*>& listC = base->Vobs;
-            std::vector<SkeletalVobInfo*>& listD = base->Mobs;
+            if ( !node.Leaf ) {
+                const float planeDist = node.PlaneNormal.x * camPos.x + node.PlaneNormal.y * camPos.y + node.PlaneNormal.z * camPos.z;
+                if ( planeDist > node.PlaneDistance ) {
+                    stack.emplace_back( node.Back, static_cast<int>(planeMask) );
+                    index = node.Front;
+                } else {
+                    stack.emplace_back( node.Front, static_cast<int>(planeMask) );
+                    index = node.Back;
+                }
+                continue;
+            }
 
-            // Concat the lists
-            const float dist = Toolbox::ComputePointAABBDistance( camPos, base->OriginalNode->BBox3D.Min, base->OriginalNode->BBox3D.Max );
-            // float dist = XMVector3Length(XMLoadFloat3(&base->BBox3D.Min) - XMLoadFloat3(&camPos));
+            // Lights of hidden leaves can still reach into visible ones, so only vobs and mobs are skipped
+            const bool inPvs = pvsLeaf == FlatBspNode::NO_NODE || LeafPvs.IsVisible( pvsLeaf, node.LeafIndex );
 
-           
-                if ( Engine::GAPI->GetRendererState().RendererSettings.DrawVOBs ) {
-                    if ( dist < vobIndoorDist ) {
-                        CVVH_AddNotDrawnVobToList( vobs, listA, vobIndoorDist );
-                    }
+            if ( inPvs && drawVobs && dist < vobMaxDist ) {
+                std::vector<unsigned int>& visible = scratch.VisibleIndices;
+                visible.clear();
+                FlatBspVobBounds.Cull( node.FirstVob, node.NumVobs, VobCullingFrustum, VobCullingDistances, visible );
 
-                    if ( dist < vobOutdoorSmallDist ) {
-                        CVVH_AddNotDrawnVobToList( vobs, listB, vobOutdoorSmallDist );
+                for ( unsigned int idx : visible ) {
+                    VobInfo* vob = FlatBspVobOwners[idx];
+
+                    // Vobs are in every leaf they touch, look at them only once per task
+                    if ( scratch.Stamps[vob->CollectionId] == task.Stamp ) {
+                        continue;
                     }
+                    scratch.Stamps[vob->CollectionId] = task.Stamp;
 
-                    if ( dist < vobOutdoorDist ) {
-                        CVVH_AddNotDrawnVobToList( vobs, listC, vobOutdoorDist );
+                    if ( softwareOcclusion && !SoftwareOcclusion.IsBoxVisible( FlatBspVobBounds.GetBox( idx ) ) ) {
+                        continue;
                     }
+                    task.Vobs.push_back( vob );
                 }
+            }
 
-                
+            if ( inPvs && drawMobs && dist < vobOutdoorSmallDist ) {
+                task.Mobs.insert( task.Mobs.end(), FlatBspMobs.begin() + node.FirstMob, FlatBspMobs.begin() + node.FirstMob + node.NumMobs );
+            }
 
-                if ( Engine::GAPI->GetRendererState().RendererSettings.DrawMobs && dist < vobOutdoorSmallDist ) {
-                    CVVH_AddNotDrawnVobToList( mobs, listD, vobOutdoorDist );
-                }
+            // The lights are only kept by the game, so they are looked at in the merge
+            if ( dynamicLighting && dist < visualFXDrawRadius ) {
+                task.LightLeaves.push_back( index );
+            }
 
-                if ( RendererState.RendererSettings.EnableDynamicLighting && dist < visualFXDrawRadius ) {
-                    // Add dynamic lights
-                    float minDynamicUpdateLightRange = Engine::GAPI->GetRendererState().RendererSettings.MinLightShadowUpdateRange;
-                    XMVECTOR playerPosition = Engine::GAPI->GetPlayerVob() != nullptr ? Engine::GAPI->GetPlayerVob()->GetPositionWorldXM() : XMVectorSet( FLT_MAX, FLT_MAX, FLT_MAX, 0 );
-                    
+            break;
+        }
+    }
+}
 
-                    // Take cameraposition if we are freelooking
-                    if ( zCCamera::IsFreeLookActive() ) {
-                        playerPosition = cameraPosition;
-                    }
+/** Collects the visible vobs, mobs and lights from FlatBspNodes */
+void GothicAPI::CollectVisibleVobsHelper( std::vector<VobInfo*>& vobs, std::vector<VobLightInfo*>& lights, std::vector<SkeletalVobInfo*>& mobs ) {
+    if ( FlatBspNodes.empty() ) {
+        return;
+    }
 
-                    for ( int i = 0; i < leaf->LightVobList.NumInArray; i++ ) {
-                        zCVobLight* vob = leaf->LightVobList.Array[i];
-
-                        float lightCameraDist;
-                        XMStoreFloat( &lightCameraDist, XMVector3Length( cameraPosition - vob->GetPositionWorldXM() ) );
-                        if ( lightCameraDist + vob->GetLightRange() < visualFXDrawRadius ) {
-                            // Check if we already have this light
-                            auto vit = VobLightMap.find( vob );
-                            if ( vit == VobLightMap.end() ) {
-                                bool PFXVobLight = false;
-                                if ( zCVob* parent = vob->GetVobParent() ) {
-                                    if ( parent->As<oCVisualFX>() ) {
-                                        PFXVobLight = true;
-                                    }
-                                }
-
-                                // Add if not. This light must have been added during gameplay
-                                VobLightInfo* vi = new VobLightInfo;
-                                vi->Vob = vob;
-                                vi->IsPFXVobLight = PFXVobLight;
-                                vi->UpdateShadows = !PFXVobLight;
-                                vit = VobLightMap.emplace( vob, vi ).first;
-
-                                // Create shadow-buffers for these lights since it was dynamically added to the world
-                                if ( !vi->IsPFXVobLight && RendererState.RendererSettings.EnablePointlightShadows >= GothicRendererSettings::PLS_STATIC_ONLY )
-                                    Engine::GraphicsEngine->CreateShadowedPointLight( &vi->LightShadowBuffers, vi, true ); // Also flag as dynamic
-                            }
-
-                            VobLightInfo* vi = vit->second;
-                            if ( !vi->VisibleInRenderPass && vob->IsEnabled() /*&& vob->GetShowVisual()*/ ) {
-                                vi->VisibleInRenderPass = true;
-
-                                // Update the lights shadows if: Light is dynamic or full shadow-updates are set
-                                if ( !vi->IsPFXVobLight ) {
-                                    if ( RendererState.RendererSettings.EnablePointlightShadows >= GothicRendererSettings::PLS_FULL
-                                        || (RendererState.RendererSettings.EnablePointlightShadows >= GothicRendererSettings::PLS_UPDATE_DYNAMIC && !vob->IsStatic()) ) {
-                                        // Now check for distances, etc
-                                        float lightPlayerDist;
-                                        XMStoreFloat( &lightPlayerDist, XMVector3Length( playerPosition - vob->GetPositionWorldXM() ) );
-                                        if ( vob->GetLightRange() > minDynamicUpdateLightRange && lightPlayerDist < vob->GetLightRange() * 1.5f )
-                                            vi->UpdateShadows = true;
-                                    }
-                                }
-
-                                // Render it
-                                lights.push_back( vi );
-                            }
-                        }
-                    }
-                }
-            
-            return;
-        } else {
-            zCBspNode* node = static_cast<zCBspNode*>(base->OriginalNode);
+    const unsigned int numSlots = GetParallelForSlots();
+    if ( VobCollectionScratches.size() < numSlots ) {
+        VobCollectionScratches.resize( numSlots );
+    }
+    for ( VobCollectionScratch& scratch : VobCollectionScratches ) {
+        if ( scratch.Stamps.size() != NumVobCollectionIds ) {
+            scratch.Stamps.assign( NumVobCollectionIds, 0 );
+        }
+    }
 
-            int	planeAxis = node->PlaneSignbits;
+    // Refresh the ranges of the leaves whose vobs changed, the tasks only read them
+    for ( FlatBspNode& node : FlatBspNodes ) {
+        if ( node.Leaf && node.Info->LeafRangesDirty ) {
+            UpdateFlatBspLeaf( node );
+        }
+    }
 
-            boxCell.Min.y = node->BBox3D.Min.y;
-            boxCell.Max.y = node->BBox3D.Min.y;
+    // A split depth of 0 puts the whole tree into one task, which runs right here
+    const unsigned int splitDepth = RendererState.RendererSettings.EnableParallelVobCollection ? RendererState.RendererSettings.ParallelVobCollectionDepth : 0;
+    SplitVobCollectionTasks( splitDepth );
 
-            zTBBox3D tmpbox = boxCell;
-            float plane_normal;
-            XMStoreFloat( &plane_normal, XMVector3Dot( XMLoadFloat3( &node->Plane.Normal ), cameraPosition ) );
-            if ( plane_normal > node->Plane.Distance ) {
-                if ( node->Front ) {
-                    reinterpret_cast<float*>(&tmpbox.Min)[planeAxis] = node->Plane.Distance;
-                    CollectVisibleVobsHelper( base->Front, tmpbox, clipFlags, vobs, lights, mobs );
+    if ( VobCollectionTasks.size() > 1 ) {
+        ParallelFor( VobCollectionTasks.size(), [this]( size_t i, unsigned int slot ) {
+            CollectVobCollectionTask( VobCollectionTasks[i], VobCollectionScratches[slot] );
+        } );
+    } else {
+        for ( VobCollectionTask& task : VobCollectionTasks ) {
+            CollectVobCollectionTask( task, VobCollectionScratches[0] );
+        }
+    }
+
+    // Merge in task order, which is the order the tree would have been walked in on one thread.
+    // Everything touching shared state happens here.
+    const float vobOutdoorDist = Engine::GAPI->GetRendererState().RendererSettings.OutdoorVobDrawRadius;
+    const FXMVECTOR cameraPosition = Engine::GAPI->GetCameraPositionXM();
+    const float minDynamicUpdateLightRange = Engine::GAPI->GetRendererState().RendererSettings.MinLightShadowUpdateRange;
+    const float visualFXDrawRadius = Engine::GAPI->GetRendererState().RendererSettings.VisualFXDrawRadius;
+    XMVECTOR playerPosition = Engine::GAPI->GetPlayerVob() != nullptr ? Engine::GAPI->GetPlayerVob()->GetPositionWorldXM() : XMVectorSet( FLT_MAX, FLT_MAX, FLT_MAX, 0 );
+
+    // Take cameraposition if we are freelooking
+    if ( zCCamera::IsFreeLookActive() ) {
+        playerPosition = cameraPosition;
+    }
+
+    for ( VobCollectionTask& task : VobCollectionTasks ) {
+        CVVH_AddNotDrawnVobToList( vobs, task.Vobs );
+        CVVH_AddNotDrawnVobToList( mobs, task.Mobs.data(), static_cast<unsigned int>(task.Mobs.size()), vobOutdoorDist );
+
+        for ( unsigned int leafNode : task.LightLeaves ) {
+            zCBspLeaf* leaf = FlatBspNodes[leafNode].Leaf;
+            for ( int i = 0; i < leaf->LightVobList.NumInArray; i++ ) {
+                zCVobLight* vob = leaf->LightVobList.Array[i];
+
+                float lightCameraDist;
+                XMStoreFloat( &lightCameraDist, XMVector3Length( cameraPosition - vob->GetPositionWorldXM() ) );
+                if ( lightCameraDist + vob->GetLightRange() >= visualFXDrawRadius ) {
+                    continue;
                 }
 
-                reinterpret_cast<float*>(&boxCell.Max)[planeAxis] = node->Plane.Distance;
-                base = base->Back;
-            } else {
-                if ( node->Back ) {
-                    reinterpret_cast<float*>(&tmpbox.Max)[planeAxis] = node->Plane.Distance;
-                    CollectVisibleVobsHelper( base->Back, tmpbox, clipFlags, vobs, lights, mobs );
+                // Check if we already have this light
+                auto vit = VobLightMap.find( vob );
+                if ( vit == VobLightMap.end() ) {
+                    bool PFXVobLight = false;
+                    if ( zCVob* parent = vob->GetVobParent() ) {
+                        if ( parent->As<oCVisualFX>() ) {
+                            PFXVobLight = true;
+                        }
+                    }
+
+                    // Add if not. This light must have been added during gameplay
+                    VobLightInfo* vi = new VobLightInfo;
+                    vi->Vob = vob;
+                    vi->IsPFXVobLight = PFXVobLight;
+                    vi->UpdateShadows = !PFXVobLight;
+                    vit = VobLightMap.emplace( vob, vi ).first;
+
+                    // Create shadow-buffers for these lights since it was dynamically added to the world
+                    if ( !vi->IsPFXVobLight && RendererState.RendererSettings.EnablePointlightShadows >= GothicRendererSettings::PLS_STATIC_ONLY )
+                        Engine::GraphicsEngine->CreateShadowedPointLight( &vi->LightShadowBuffers, vi, true ); // Also flag as dynamic
                 }
 
-                reinterpret_cast<float*>(&boxCell.Min)[planeAxis] = node->Plane.Distance;
-                base = base->Front;
+                VobLightInfo* vi = vit->second;
+                if ( !vi->VisibleInRenderPass && vob->IsEnabled() /*&& vob->GetShowVisual()*/ ) {
+                    vi->VisibleInRenderPass = true;
+
+                    // Update the lights shadows if: Light is dynamic or full shadow-updates are set
+                    if ( !vi->IsPFXVobLight ) {
+                        if ( RendererState.RendererSettings.EnablePointlightShadows >= GothicRendererSettings::PLS_FULL
+                            || (RendererState.RendererSettings.EnablePointlightShadows >= GothicRendererSettings::PLS_UPDATE_DYNAMIC && !vob->IsStatic()) ) {
+                            // Now check for distances, etc
+                            float lightPlayerDist;
+                            XMStoreFloat( &lightPlayerDist, XMVector3Length( playerPosition - vob->GetPositionWorldXM() ) );
+                            if ( vob->GetLightRange() > minDynamicUpdateLightRange && lightPlayerDist < vob->GetLightRange() * 1.5f )
+                                vi->UpdateShadows = true;
+                        }
+                    }
+
+                    // Render it
+                    lights.push_back( vi );
+                }
             }
         }
     }
@@ -4274,6 +4755,257 @@ void GothicAPI::BuildBspVobMapCacheHelper( zCBspBase* base ) {
 /** Builds our BspTreeVobMap */
 void GothicAPI::BuildBspVobMapCache() {
     BuildBspVobMapCacheHelper( LoadedWorldInfo->BspTree->GetRootNode() );
+    BuildFlatBspTree();
+
+    // Done here, so switching EnablePortalPvs on later doesn't stall a frame
+    if ( LoadedWorldInfo->BspTree->GetBspTreeMode() == zBSP_MODE_INDOOR ) {
+        LoadOrBuildLeafPvs();
+    }
+}
+
+/** Builds FlatBspNodes from BspLeafVobLists */
+void GothicAPI::BuildFlatBspTree() {
+    FlatBspNodes.clear();
+    FlatBspVobBounds.Clear();
+    FlatBspVobOwners.clear();
+    FlatBspMobs.clear();
+    NumFlatBspLeaves = 0;
+    LeafPvs.Clear();
+
+    NumVobCollectionIds = 0;
+    for ( auto const& [vob, info] : VobMap ) {
+        info->CollectionId = VobInfo::NO_COLLECTION_ID;
+    }
+
+    zCBspBase* rootBsp = LoadedWorldInfo->BspTree->GetRootNode();
+    if ( !rootBsp ) {
+        return;
+    }
+
+    // Children are linked after they were added, so keep the parent and which side it was on
+    struct PendingNode {
+        BspInfo* Info;
+        unsigned int Parent;
+        bool IsFront;
+    };
+    std::vector<PendingNode> pending;
+    pending.push_back( { &BspLeafVobLists[rootBsp], FlatBspNode::NO_NODE, false } );
+
+    while ( !pending.empty() ) {
+        PendingNode p = pending.back();
+        pending.pop_back();
+
+        const unsigned int index = static_cast<unsigned int>(FlatBspNodes.size());
+        if ( p.Parent != FlatBspNode::NO_NODE ) {
+            if ( p.IsFront ) {
+                FlatBspNodes[p.Parent].Front = index;
+            } else {
+                FlatBspNodes[p.Parent].Back = index;
+            }
+        }
+
+        BspInfo* info = p.Info;
+
+        FlatBspNode node = {};
+        node.BBox3D = info->OriginalNode->BBox3D;
+        node.Front = FlatBspNode::NO_NODE;
+        node.Back = FlatBspNode::NO_NODE;
+        node.Info = info;
+        node.LeafIndex = FlatBspNode::NO_NODE;
+
+        if ( info->OriginalNode->IsLeaf() ) {
+            node.Leaf = static_cast<zCBspLeaf*>(info->OriginalNode);
+            node.LeafIndex = NumFlatBspLeaves++;
+
+            // Reserve the ranges, UpdateFlatBspLeaf fills them
+            node.FirstVob = FlatBspVobBounds.Size();
+            node.VobCapacity = static_cast<unsigned int>(info->IndoorVobs.size() + info->SmallVobs.size() + info->Vobs.size());
+            for ( unsigned int i = 0; i < node.VobCapacity; i++ ) {
+                FlatBspVobBounds.Add( zTBBox3D(), BOX_DISTANCE_OUTDOOR );
+            }
+            FlatBspVobOwners.resize( FlatBspVobBounds.Size(), nullptr );
+
+            node.FirstMob = static_cast<unsigned int>(FlatBspMobs.size());
+            node.MobCapacity = static_cast<unsigned int>(info->Mobs.size());
+            FlatBspMobs.resize( FlatBspMobs.size() + node.MobCapacity, nullptr );
+
+            FlatBspNodes.push_back( node );
+            UpdateFlatBspLeaf( FlatBspNodes.back() );
+
+            // Vobs get numbered the first time they are seen, so collecting can dedupe them by index
+            for ( unsigned int i = node.FirstVob; i < node.FirstVob + node.VobCapacity; i++ ) {
+                VobInfo* vob = FlatBspVobOwners[i];
+                if ( vob && vob->CollectionId == VobInfo::NO_COLLECTION_ID ) {
+                    vob->CollectionId = NumVobCollectionIds++;
+                }
+            }
+        } else {
+            zCBspNode* bspNode = static_cast<zCBspNode*>(info->OriginalNode);
+            node.PlaneNormal = bspNode->Plane.Normal;
+            node.PlaneDistance = bspNode->Plane.Distance;
+            FlatBspNodes.push_back( node );
+
+            // Back is pushed first, so the front subtree directly follows its parent
+            if ( bspNode->Back ) {
+                pending.push_back( { &BspLeafVobLists[bspNode->Back], index, false } );
+            }
+            if ( bspNode->Front ) {
+                pending.push_back( { &BspLeafVobLists[bspNode->Front], index, true } );
+            }
+        }
+    }
+}
+
+/** Copies the current vob and mob lists of a leaf into its ranges */
+void GothicAPI::UpdateFlatBspLeaf( FlatBspNode& node ) {
+    BspInfo* info = node.Info;
+    info->LeafRangesDirty = false;
+
+    node.NumVobs = 0;
+    auto addList = [&]( const std::vector<VobInfo*>& list, EBoxDistanceClass distanceClass ) {
+        for ( VobInfo* vob : list ) {
+            if ( node.NumVobs == node.VobCapacity ) {
+                return; // Vobs are never added to leaves after the tree was built
+            }
+
+            const unsigned int index = node.FirstVob + node.NumVobs++;
+            FlatBspVobBounds.Set( index, vob->Vob->GetBBox(), distanceClass );
+            FlatBspVobOwners[index] = vob;
+        }
+    };
+    addList( info->IndoorVobs, BOX_DISTANCE_INDOOR );
+    addList( info->SmallVobs, BOX_DISTANCE_OUTDOOR_SMALL );
+    addList( info->Vobs, BOX_DISTANCE_OUTDOOR );
+
+    node.NumMobs = static_cast<unsigned int>(std::min<size_t>( info->Mobs.size(), node.MobCapacity ));
+    std::copy( info->Mobs.begin(), info->Mobs.begin() + node.NumMobs, FlatBspMobs.begin() + node.FirstMob );
+}
+
+/** Loads the PVS of the current world from its cache file, or builds and caches it */
+void GothicAPI::LoadOrBuildLeafPvs() {
+    LeafPvs.Clear();
+
+    // Leaves without polygons get an empty box, so they stay visible from everywhere
+    std::vector<zTBBox3D> leafBoxes( NumFlatBspLeaves );
+    std::vector<std::vector<XMFLOAT3>> portals;
+    std::vector<std::vector<unsigned int>> leafPortals( NumFlatBspLeaves );
+    std::unordered_map<zCPolygon*, unsigned int> portalIndices;
+    for ( const FlatBspNode& node : FlatBspNodes ) {
+        if ( !node.Leaf ) {
+            continue;
+        }
+
+        zTBBox3D& box = leafBoxes[node.LeafIndex];
+        if ( node.Leaf->NumPolys > 0 ) {
+            box = node.BBox3D;
+        } else {
+            box.Min = XMFLOAT3( FLT_MAX, FLT_MAX, FLT_MAX );
+            box.Max = XMFLOAT3( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+        }
+
+        // Portals are in the lists of the leaves they touch, which tells the builder where to look for them
+        for ( int i = 0; i < node.Leaf->NumPolys; i++ ) {
+            zCPolygon* poly = node.Leaf->PolyList[i];
+            if ( !poly->GetPolyFlags()->PortalPoly ) {
+                continue;
+            }
+
+            auto it = portalIndices.find( poly );
+            if ( it == portalIndices.end() ) {
+                zCTexture* tex = poly->GetMaterial() ? poly->GetMaterial()->GetTextureSingle() : nullptr;
+                if ( tex && WorldConverter::IsFakePortalTexture( tex->GetNameWithoutExt() ) ) {
+                    continue;
+                }
+
+                it = portalIndices.emplace( poly, static_cast<unsigned int>(portals.size()) ).first;
+                std::vector<XMFLOAT3>& points = portals.emplace_back();
+                for ( int v = 0; v < poly->GetNumPolyVertices(); v++ ) {
+                    points.push_back( *poly->getVertices()[v]->Position.toXMFLOAT3() );
+                }
+            }
+            leafPortals[node.LeafIndex].push_back( it->second );
+        }
+    }
+
+    if ( portals.empty() ) {
+        LogInfo() << "World has no portals, not using a PVS";
+        return;
+    }
+
+    auto gameName = GetGameName();
+    std::string cacheFile;
+    if ( gameName == "Original" ) {
+        cacheFile = "system\\GD3D11\\Cache\\";
+    } else {
+        cacheFile = "system\\GD3D11\\Cache\\" + gameName + "\\";
+    }
+    cacheFile += LoadedWorldInfo->WorldName + ".pvs";
+
+    BASIC_TIMING( t );
+    uint64_t key = BspPvs::ComputeKey( leafBoxes, portals, leafPortals );
+    if ( XR_SUCCESS == LeafPvs.Load( cacheFile, key ) ) {
+        t.Update();
+        LogInfo() << "Loaded PVS from " << cacheFile << " in " << static_cast<int>(t.GetDelta() * 1000.0f) << "ms, "
+            << LeafPvs.GetNumRows() << " sets over " << LeafPvs.GetNumRoomLeaves() << " of " << LeafPvs.GetNumLeaves() << " leaves, "
+            << LeafPvs.GetSizeInBytes() / 1024 << " KB";
+        return;
+    }
+
+    LeafPvs.Build( leafBoxes, portals, leafPortals );
+    t.Update();
+    LogInfo() << "Built PVS from " << portals.size() << " portals in " << static_cast<int>(t.GetDelta() * 1000.0f) << "ms, "
+        << LeafPvs.GetSizeInBytes() / 1024 << " KB";
+
+    if ( XR_SUCCESS == LeafPvs.Save( cacheFile, key ) ) {
+        LogInfo() << "Saved PVS " << cacheFile;
+    }
+}
+
+/** Returns the leaf whose PVS can be used at the given position */
+unsigned int GothicAPI::FindPvsLeaf( const XMFLOAT3& position ) const {
+    if ( FlatBspNodes.empty() || LeafPvs.GetNumLeaves() != NumFlatBspLeaves ) {
+        return FlatBspNode::NO_NODE;
+    }
+
+    auto contains = []( const zTBBox3D& box, const XMFLOAT3& p ) {
+        return p.x >= box.Min.x && p.x <= box.Max.x && p.y >= box.Min.y && p.y <= box.Max.y && p.z >= box.Min.z && p.z <= box.Max.z;
+    };
+
+    // The sets only hold for positions inside the box of their leaf. Any leaf containing the position will do,
+    // the smallest one usually sees the least.
+    unsigned int bestLeaf = FlatBspNode::NO_NODE;
+    float bestVolume = FLT_MAX;
+    std::vector<unsigned int> stack = { 0 };
+    while ( !stack.empty() ) {
+        const FlatBspNode& node = FlatBspNodes[stack.back()];
+        stack.pop_back();
+
+        if ( !contains( node.BBox3D, position ) ) {
+            continue;
+        }
+
+        if ( !node.Leaf ) {
+            if ( node.Front != FlatBspNode::NO_NODE ) {
+                stack.push_back( node.Front );
+            }
+            if ( node.Back != FlatBspNode::NO_NODE ) {
+                stack.push_back( node.Back );
+            }
+            continue;
+        }
+
+        if ( node.Leaf->NumPolys == 0 ) {
+            continue;
+        }
+
+        const float volume = (node.BBox3D.Max.x - node.BBox3D.Min.x) * (node.BBox3D.Max.y - node.BBox3D.Min.y) * (node.BBox3D.Max.z - node.BBox3D.Min.z);
+        if ( volume < bestVolume ) {
+            bestVolume = volume;
+            bestLeaf = node.LeafIndex;
+        }
+    }
+
+    return bestLeaf;
 }
 
 /** Cleans empty BSPNodes */
@@ -4514,16 +5246,24 @@ void GothicAPI::ApplySuppressedSectionTextures() {
         WorldMeshSectionInfo* section = it.first;
 
         // Look into each mesh of this section and find the texture
-        for ( std::map<MeshKey, WorldMeshInfo*>::iterator mit = section->WorldMeshes.begin(); mit != section->WorldMeshes.end(); mit++ ) {
+        for ( auto mit = section->WorldMeshes.begin(); mit != section->WorldMeshes.end(); ) {
+            bool suppressed = false;
             for ( unsigned int i = 0; i < it.second.size(); i++ ) {
                 // Is this the texture we are looking for?
                 if ( (*mit).first.Material && (*mit).first.Material->GetTexture() && (*mit).first.Material->GetTexture()->GetNameWithoutExt() == it.second[i] ) {
-                    // Yes, move it to the suppressed map
-                    section->SuppressedMeshes[(*mit).first] = (*mit).second;
-                    section->WorldMeshes.erase( mit );
+                    suppressed = true;
                     break;
                 }
             }
+
+            if ( suppressed ) {
+                // Yes, move it to the suppressed map. A material can have several meshes, so keep looking.
+                section->SuppressedMeshes.emplace( (*mit).first, (*mit).second );
+                mit = section->WorldMeshes.erase( mit );
+                WorldMeshBvhBuilt = false;
+            } else {
+                ++mit;
+            }
         }
     }
 }
@@ -4533,13 +5273,15 @@ void GothicAPI::ResetSupressedTextures() {
     for ( auto const& it : SuppressedTexturesBySection ) {
         WorldMeshSectionInfo* section = it.first;
 
-        // Look into each mesh of this section and find the texture
-        for ( auto const& mit : section->WorldMeshes ) {
-            section->WorldMeshes[mit.first] = mit.second;
+        // Put the meshes back, only world meshes get suppressed
+        for ( auto const& mit : section->SuppressedMeshes ) {
+            section->WorldMeshes.emplace( mit.first, static_cast<WorldMeshInfo*>(mit.second) );
         }
+        section->SuppressedMeshes.clear();
     }
 
     SuppressedTexturesBySection.clear();
+    WorldMeshBvhBuilt = false;
 }
 
 /** Resets the vegetation */
@@ -4640,7 +5382,7 @@ XRESULT GothicAPI::LoadSuppressedTextures( const std::string& file ) {
             }
 
             // Add to map
-            SuppressedTexturesBySection[&WorldSections[coords.x][coords.y]].push_back( std::string( name ) );
+            SuppressedTexturesBySection[&GetOrCreateWorldSection( coords )].push_back( std::string( name ) );
         }
     }
 
@@ -4694,6 +5436,11 @@ XRESULT GothicAPI::LoadVegetation( const std::string& file ) {
     size_t num = VegetationBoxes.size();
     fread( &num, sizeof( num ), 1, f );
 
+    // The boxes trace the world mesh to find what they grow on
+    if ( num ) {
+        UpdateWorldMeshBvh();
+    }
+
     for ( size_t i = 0; i < num; i++ ) {
         GVegetationBox* b = new GVegetationBox;
         b->LoadFromFILE( f, version );
@@ -4736,6 +5483,17 @@ XRESULT GothicAPI::SaveMenuSettings( const std::string& file ) {
     WritePrivateProfileStringA( "General", "SunLightStrength", std::to_string( s.SunLightStrength ).c_str(), ini.c_str() );
     WritePrivateProfileStringA( "General", "DrawG1ForestPortals", std::to_string( s.DrawG1ForestPortals ? TRUE : FALSE ).c_str(), ini.c_str() );
     WritePrivateProfileStringA( "General", "DrawRainThroughTransformFeedback", std::to_string( s.DrawRainThroughTransformFeedback ? TRUE : FALSE ).c_str(), ini.c_str() );
+    WritePrivateProfileStringA( "General", "CompactWorldCache", std::to_string( s.CompactWorldCache ? TRUE : FALSE ).c_str(), ini.c_str() );
+    WritePrivateProfileStringA( "General", "EnableVobLods", std::to_string( s.EnableVobLods ? TRUE : FALSE ).c_str(), ini.c_str() );
+    WritePrivateProfileStringA( "General", "EnableWorldMeshletCulling", std::to_string( s.EnableWorldMeshletCulling ? TRUE : FALSE ).c_str(), ini.c_str() );
+    WritePrivateProfileStringA( "General", "EnableSoftwareOcclusionCulling", std::to_string( s.EnableSoftwareOcclusionCulling ? TRUE : FALSE ).c_str(), ini.c_str() );
+    WritePrivateProfileStringA( "General", "EnableParallelVobCollection", std::to_string( s.EnableParallelVobCollection ? TRUE : FALSE ).c_str(), ini.c_str() );
+    WritePrivateProfileStringA( "General", "ParallelVobCollectionDepth", std::to_string( s.ParallelVobCollectionDepth ).c_str(), ini.c_str() );
+    WritePrivateProfileStringA( "General", "EnablePortalPvs", std::to_string( s.EnablePortalPvs ? TRUE : FALSE ).c_str(), ini.c_str() );
+    WritePrivateProfileStringA( "General", "EnableLightClusters", std::to_string( s.EnableLightClusters ? TRUE : FALSE ).c_str(), ini.c_str() );
+    WritePrivateProfileStringA( "General", "EnableScreenSizeCulling", std::to_string( s.EnableScreenSizeCulling ? TRUE : FALSE ).c_str(), ini.c_str() );
+    WritePrivateProfileStringA( "General", "MinVobScreenSize", std::to_string( s.MinVobScreenSize ).c_str(), ini.c_str() );
+    WritePrivateProfileStringA( "General", "EnableParallelDrawRecording", std::to_string( s.EnableParallelDrawRecording ? TRUE : FALSE ).c_str(), ini.c_str() );
 
     /*
     * Draw-distance is saved on a per World basis using SaveRendererWorldSettings
@@ -4837,6 +5595,17 @@ XRESULT GothicAPI::LoadMenuSettings( const std::string& file ) {
         s.SunLightStrength = GetPrivateProfileFloatA( "General", "SunLightStrength", defaultRendererSettings.SunLightStrength, ini );
         s.DrawG1ForestPortals = GetPrivateProfileBoolA( "General", "DrawG1ForestPortals", defaultRendererSettings.DrawG1ForestPortals, ini );
         s.DrawRainThroughTransformFeedback = GetPrivateProfileBoolA( "General", "DrawRainThroughTransformFeedback", defaultRendererSettings.DrawRainThroughTransformFeedback, ini );
+        s.CompactWorldCache = GetPrivateProfileBoolA( "General", "CompactWorldCache", defaultRendererSettings.CompactWorldCache, ini );
+        s.EnableVobLods = GetPrivateProfileBoolA( "General", "EnableVobLods", defaultRendererSettings.EnableVobLods, ini );
+        s.EnableWorldMeshletCulling = GetPrivateProfileBoolA( "General", "EnableWorldMeshletCulling", defaultRendererSettings.EnableWorldMeshletCulling, ini );
+        s.EnableSoftwareOcclusionCulling = GetPrivateProfileBoolA( "General", "EnableSoftwareOcclusionCulling", defaultRendererSettings.EnableSoftwareOcclusionCulling, ini );
+        s.EnableParallelVobCollection = GetPrivateProfileBoolA( "General", "EnableParallelVobCollection", defaultRendererSettings.EnableParallelVobCollection, ini );
+        s.ParallelVobCollectionDepth = std::min( 16u, static_cast<unsigned int>(GetPrivateProfileIntA( "General", "ParallelVobCollectionDepth", defaultRendererSettings.ParallelVobCollectionDepth, ini.c_str() )) );
+        s.EnablePortalPvs = GetPrivateProfileBoolA( "General", "EnablePortalPvs", defaultRendererSettings.EnablePortalPvs, ini );
+        s.EnableLightClusters = GetPrivateProfileBoolA( "General", "EnableLightClusters", defaultRendererSettings.EnableLightClusters, ini );
+        s.EnableScreenSizeCulling = GetPrivateProfileBoolA( "General", "EnableScreenSizeCulling", defaultRendererSettings.EnableScreenSizeCulling, ini );
+        s.MinVobScreenSize = std::max( 0.1f, GetPrivateProfileFloatA( "General", "MinVobScreenSize", defaultRendererSettings.MinVobScreenSize, ini ) );
+        s.EnableParallelDrawRecording = GetPrivateProfileBoolA( "General", "EnableParallelDrawRecording", defaultRendererSettings.EnableParallelDrawRecording, ini );
 
         /*
         * Draw-distance is Loaded on a per World basis using LoadRendererWorldSettings
@@ -5347,15 +6116,14 @@ void GothicAPI::PutCustomPolygonsIntoBspTreeRec( BspInfo* base ) {
 
 /** Returns the sections intersecting the given boundingboxes */
 void GothicAPI::GetIntersectingSections( const XMFLOAT3& min, const XMFLOAT3& max, std::vector<WorldMeshSectionInfo*>& sections ) {
-    for ( std::map<int, std::map<int, WorldMeshSectionInfo>>::iterator itx = Engine::GAPI->GetWorldSections().begin(); itx != Engine::GAPI->GetWorldSections().end(); itx++ ) {
-        for ( std::map<int, WorldMeshSectionInfo>::iterator ity = itx->second.begin(); ity != itx->second.end(); ity++ ) {
-            WorldMeshSectionInfo& section = ity->second;
+    INT2 minCell, maxCell;
+    WorldSectionIndex.GetCellRangeOfBox( min, max, minCell, maxCell );
 
-            if ( Toolbox::AABBsOverlapping( section.BoundingBox.Min, section.BoundingBox.Max, min, max ) ) {
-                sections.push_back( &section );
-            }
+    WorldSectionIndex.ForEachInRange( minCell, maxCell, [&]( const INT2&, WorldMeshSectionInfo& section ) {
+        if ( Toolbox::AABBsOverlapping( section.BoundingBox.Min, section.BoundingBox.Max, min, max ) ) {
+            sections.push_back( &section );
         }
-    }
+    } );
 }
 
 /** Generates zCPolygons for the loaded sections */
@@ -5383,56 +6151,35 @@ void GothicAPI::CollectPolygonsInAABB( const zTBBox3D& bbox, zCPolygon**& polyLi
                                          // This is ugly, but that's how they do it.
     list.clear();
 
-    CollectPolygonsInAABBRec( &BspLeafVobLists[LoadedWorldInfo->BspTree->GetRootNode()], bbox, list );
+    CustomPolygonQueryResults.clear();
+    CustomPolygonBvh.QueryBox( bbox, CustomPolygonQueryResults );
+    for ( unsigned int polygon : CustomPolygonQueryResults ) {
+        list.push_back( CustomPolygons[polygon] );
+    }
 
     // Give out data to calling function
-    polyList = &list[0];
+    polyList = list.data();
     numFound = list.size();
 }
 
-/** Collects polygons in the given AABB */
-void GothicAPI::CollectPolygonsInAABBRec( BspInfo* base, const zTBBox3D& bbox, std::vector<zCPolygon*>& list ) {
-    zCBspNode* node = static_cast<zCBspNode*>(base->OriginalNode);
-
-    while ( node ) {
-        if ( node->IsLeaf() ) {
-            zCBspLeaf* leaf = reinterpret_cast<zCBspLeaf*>(node);
-            if ( leaf->NumPolys > 0 ) {
-                // Cancel search in this subtree if this doesn't overlap with our AABB
-                if ( !Toolbox::AABBsOverlapping( bbox.Min, bbox.Max, leaf->BBox3D.Min, leaf->BBox3D.Max ) )
-                    return;
-
-                // Insert all polygons we got here
-                list.insert( list.end(), base->NodePolygons.begin(), base->NodePolygons.end() );
+/** Builds CustomPolygonBvh from the SectionPolygons of all sections */
+void GothicAPI::BuildCustomPolygonBvh() {
+    std::vector<XMFLOAT3> positions;
+    CustomPolygons.clear();
+    for ( auto const& itx : WorldSections ) {
+        for ( auto const& ity : itx.second ) {
+            for ( zCPolygon* poly : ity.second.SectionPolygons ) {
+                // The sections only have triangles, see WorldConverter::ConvertExVerticesTozCPolygons
+                zCVertex** vx = poly->getVertices();
+                for ( int v = 0; v < 3; v++ ) {
+                    positions.push_back( *vx[v]->Position.toXMFLOAT3() );
+                }
+                CustomPolygons.push_back( poly );
             }
-
-            // Got all the polygons and this is a leaf, don't need to do tests for more searches
-            return;
-        }
-
-        // Get next tree to look at
-        int sides = bbox.ClassifyToPlane( node->Plane.Distance, node->PlaneSignbits );
-
-        switch ( sides ) {
-        case zTBBox3D::zPLANE_INFRONT:
-            node = static_cast<zCBspNode*>(node->Front);
-            base = base->Front;
-            break;
-
-        case zTBBox3D::zPLANE_BEHIND:
-            node = static_cast<zCBspNode*>(node->Back);
-            base = base->Back;
-            break;
-
-        case zTBBox3D::zPLANE_SPANNING:
-            if ( base->Front )
-                CollectPolygonsInAABBRec( base->Front, bbox, list );
-
-            node = static_cast<zCBspNode*>(node->Back);
-            base = base->Back;
-            break;
         }
     }
+
+    CustomPolygonBvh.Build( positions );
 }
 
 /** Returns our bsp-root-node */
@@ -2,6 +2,13 @@
 #include "pch.h"
 #include "GothicGraphicsState.h"
 #include "WorldConverter.h"
+#include "WorldSectionGrid.h"
+#include "BoxCulling.h"
+#include "DynamicAabbTree.h"
+#include "TriangleBvh.h"
+#include "StaticInstanceStore.h"
+#include "SoftwareOcclusionBuffer.h"
+#include "BspPvs.h"
 #include "zCTree.h"
 #include "zCPolyStrip.h"
 #include "zTypes.h"
@@ -14,6 +21,7 @@ const float INDOOR_LIGHT_DISTANCE_SCALE_FACTOR = 0.5f;
 
 class zCFlash;
 class zCBspBase;
+class zCBspLeaf;
 class zCModelPrototype;
 struct ScreenSpaceLine;
 struct LineVertex;
@@ -21,14 +29,13 @@ struct LineVertex;
 struct BspInfo {
     BspInfo() {
         NumStaticLights = 0;
+        LeafRangesDirty = true;
         OriginalNode = nullptr;
         Front = nullptr;
         Back = nullptr;
 
         OcclusionInfo.VisibleLastFrame = false;
-        OcclusionInfo.LastVisitedFrameID = 0;
         OcclusionInfo.QueryID = -1;
-        OcclusionInfo.QueryInProgress = false;
         OcclusionInfo.LastCameraClipType = ZTCAM_CLIPTYPE_OUT;
 
         OcclusionInfo.NodeMesh = nullptr;
@@ -49,6 +56,10 @@ struct BspInfo {
     std::vector<VobLightInfo*> IndoorLights;
     std::vector<SkeletalVobInfo*> Mobs;
 
+    /** The ranges of this leaf in GothicAPI::FlatBspNodes are refreshed on the next use when this is set,
+        which has to happen whenever a vob or mob gets removed from the lists */
+    bool LeafRangesDirty;
+
     // This is filled in case we have loaded a custom worldmesh
     std::vector<zCPolygon*> NodePolygons;
 
@@ -57,11 +68,11 @@ struct BspInfo {
     /** Occlusion info for this node */
     struct OcclusionInfo_s {
         MeshInfo* NodeMesh;
-        unsigned int LastVisitedFrameID;
         int LastCameraClipType;
+
+        /** Index of the node in the occlusion query scheduler, -1 until it got one */
         int QueryID;
         bool VisibleLastFrame;
-        bool QueryInProgress;
     } OcclusionInfo;
 
     // Original bsp-node
@@ -70,6 +81,70 @@ struct BspInfo {
     BspInfo* Back;
 };
 
+/** Node of the BSP-tree, copied into one array in depth-first order so collecting the visible vobs doesn't
+    need to look anything up in the map or in the game's nodes */
+struct FlatBspNode {
+    static const unsigned int NO_NODE = 0xFFFFFFFF;
+
+    zTBBox3D BBox3D;
+    XMFLOAT3 PlaneNormal;
+    float PlaneDistance;
+
+    /** Children, NO_NODE for leaves and missing children */
+    unsigned int Front;
+    unsigned int Back;
+
+    /** Ranges of a leaf in GothicAPI::FlatBspVobBounds and FlatBspMobs. Removing vobs only shrinks them,
+        so the capacity is what was reserved when the tree was built. */
+    unsigned int FirstVob;
+    unsigned int NumVobs;
+    unsigned int VobCapacity;
+    unsigned int FirstMob;
+    unsigned int NumMobs;
+    unsigned int MobCapacity;
+
+    BspInfo* Info;
+
+    /** The game keeps the lights of its leaves up to date, so they are still read from there */
+    zCBspLeaf* Leaf;
+
+    /** Number of this leaf in GothicAPI::LeafPvs */
+    unsigned int LeafIndex;
+};
+
+/** One subtree of the BSP-tree and what was found in it while collecting the visible vobs. Candidates are only
+    checked against the frustum and the draw distances, the rest happens when the tasks are merged. */
+struct VobCollectionTask {
+    unsigned int Node;
+
+    /** Unique among the tasks of the last frames, marks the vobs this task has already seen */
+    unsigned int Stamp;
+
+    std::vector<VobInfo*> Vobs;
+    std::vector<SkeletalVobInfo*> Mobs;
+
+    /** Leaves close enough for their lights, which are only checked in the merge */
+    std::vector<unsigned int> LightLeaves;
+};
+
+/** Triangles of GothicAPI::WorldMeshBvh from one world mesh, up to where the next range starts */
+struct WorldMeshBvhRange {
+    unsigned int FirstTriangle;
+    WorldMeshInfo* Mesh;
+    zCMaterial* Material;
+};
+
+/** Memory one thread reuses for all the tasks it collects */
+struct VobCollectionScratch {
+    /** Nodes still to visit, with their clip flags */
+    std::vector<std::pair<unsigned int, int>> Stack;
+
+    std::vector<unsigned int> VisibleIndices;
+
+    /** Stamp of the last task which saw a vob, indexed by VobInfo::CollectionId */
+    std::vector<unsigned int> Stamps;
+};
+
 
 struct CameraReplacement {
     XMFLOAT4X4 ViewReplacement;
@@ -158,6 +233,7 @@ class GSky;
 class GMesh;
 class zCBspBase;
 class GInventory;
+class CustomWorldImport;
 class zCVobLight;
 class MyDirectDrawSurface7;
 class GVegetationBox;
@@ -176,9 +252,9 @@ struct TransparencyVobInfo {
 
 class GothicAPI {
     friend static void ProcessVobAnimation( zCVob* vob, zTAnimationMode aniMode, VobInstanceInfo& vobInstance );
-    friend void CVVH_AddNotDrawnVobToList( std::vector<VobInfo*>& target, std::vector<VobInfo*>& source, float dist );
+    friend void CVVH_AddNotDrawnVobToList( std::vector<VobInfo*>& target, const std::vector<VobInfo*>& source );
     friend void CVVH_AddNotDrawnVobToList( std::vector<VobLightInfo*>& target, std::vector<VobLightInfo*>& source, float dist );
-    friend void CVVH_AddNotDrawnVobToList( std::vector<SkeletalVobInfo*>& target, std::vector<SkeletalVobInfo*>& source, float dist );
+    friend void CVVH_AddNotDrawnVobToList( std::vector<SkeletalVobInfo*>& target, SkeletalVobInfo* const* source, unsigned int count, float dist );
 
 public:
     GothicAPI();
@@ -372,9 +448,19 @@ public:
     /** Returns the loaded sections */
     std::map<int, std::map<int, WorldMeshSectionInfo>>& GetWorldSections();
 
+    /** Returns the grid indexing the loaded sections */
+    const WorldSectionGrid& GetWorldSectionGrid() const;
+
+    /** Returns the section at the given coordinates, creates it if it doesn't exist yet */
+    WorldMeshSectionInfo& GetOrCreateWorldSection( const INT2& coords );
+
     /** Returns the wrapped world mesh */
     MeshInfo* GetWrappedWorldMesh();
 
+    /** Returns the wrapped world mesh with ExVertexStruct vertices, at the same index locations. Unless the loaded
+        world draws from ExVertexStructCompact this is the wrapped world mesh, otherwise it is made on first use. */
+    MeshInfo* GetFullWrappedWorldMesh();
+
     /** Returns the loaded skeletal mesh vobs */
     std::list<SkeletalVobInfo*>& GetSkeletalMeshVobs();
     std::list<SkeletalVobInfo*>& GetAnimatedSkeletalMeshVobs();
@@ -393,6 +479,12 @@ public:
     /** Returns the projection-matrix */
     XMFLOAT4X4& GetProjectionMatrix();
 
+    /** Returns the planes of the current view frustum, see CullingFrustum::FromViewProjection */
+    CullingFrustum GetCullingFrustum( unsigned int numPlanes );
+
+    /** Draw distances the vobs of this frame were collected with */
+    const CullingDistances& GetVobCullingDistances() const { return VobCullingDistances; }
+
     /** Unprojects a pixel-position on the screen */
     void XM_CALLCONV UnprojectXM( FXMVECTOR p, XMVECTOR& worldPos, XMVECTOR& worldDir );
 
@@ -402,6 +494,19 @@ public:
     /** Traces the worldmesh and returns the hit-location */
     bool TraceWorldMesh( const XMFLOAT3& origin, const XMFLOAT3& dir, XMFLOAT3& hit, std::string* hitTextureName = nullptr, XMFLOAT3* hitTriangle = nullptr, MeshInfo** hitMesh = nullptr, zCMaterial** hitMaterial = nullptr );
 
+    /** Traces many rays against the worldmesh at once, see TriangleBvh::TraceRays. Uses the BVH as it is and never
+        rebuilds it, everything misses if it wasn't built yet. Only reads the BVH, so worker threads may call this
+        while the main thread waits for them. The BVH only ever gets rebuilt on the main thread, by UpdateWorldMeshBvh
+        and TraceWorldMesh. */
+    void TraceWorldMeshRays( const XMFLOAT3* origins, const XMFLOAT3* dirs, unsigned int numRays, float maxDistance, TriangleBvh::RayHit* outHits ) const;
+
+    /** Rebuilds the BVH of the worldmesh if meshes were hidden or put back since it was built. Main thread only. */
+    void UpdateWorldMeshBvh();
+
+    /** Returns the mesh a triangle from a trace belongs to, and optionally its material and the first of its indices in the mesh.
+        Only valid until the BVH is rebuilt. */
+    WorldMeshInfo* GetWorldMeshTriangleOwner( unsigned int triangle, zCMaterial** outMaterial = nullptr, unsigned int* outFirstIndex = nullptr ) const;
+
     /** Traces vobs with static mesh visual */
     VobInfo* TraceStaticMeshVobsBB( const XMFLOAT3& origin, const XMFLOAT3& dir, XMFLOAT3& hit, zCMaterial** hitMaterial = nullptr );
     SkeletalVobInfo* TraceSkeletalMeshVobsBB( const XMFLOAT3& origin, const XMFLOAT3& dir, XMFLOAT3& hit );
@@ -482,6 +587,15 @@ public:
 
     std::vector<VobInfo*>::iterator MoveVobFromBspToDynamic( VobInfo* vob, std::vector<VobInfo*>* source );
 
+    /** Fills the instance data the given vob is drawn with */
+    static void GetVobInstanceInfo( VobInfo* vob, VobInstanceInfo& outInstance );
+
+    /** Adds the vob as an instance of its visual for this frame and updates its slot in the static instance store */
+    void AddStaticMeshInstance( VobInfo* vob );
+
+    /** Returns the instance data of all static vobs at their slots */
+    StaticInstanceStore& GetStaticInstanceStore() { return StaticInstances; }
+
     /** Collects vobs using gothics BSP-Tree */
     void CollectVisibleVobs( std::vector<VobInfo*>& vobs, std::vector<VobLightInfo*>& lights, std::vector<SkeletalVobInfo*>& mobs );
 
@@ -702,8 +816,12 @@ public:
     float GetSkyTimeScale();
 
 private:
-    /** Collects polygons in the given AABB */
-    void CollectPolygonsInAABBRec( BspInfo* base, const zTBBox3D& bbox, std::vector<zCPolygon*>& list );
+    /** Loads the world sections from the world cache, or converts and caches them if the cache doesn't match */
+    void LoadOrConvertWorldMesh( std::vector<zCPolygon*>& polys, bool indoorLocation );
+
+    /** Waits for the custom world import started in OnGeometryLoaded and creates its sections.
+        Converts the games world mesh instead if the import failed. */
+    void FinishCustomWorldImport();
 
     /** Cleans empty BSPNodes */
     void CleanBSPNodes();
@@ -711,8 +829,58 @@ private:
     /** Helper function for going through the bsp-tree */
     void BuildBspVobMapCacheHelper( zCBspBase* base );
 
-    /** Recursive helper function to draw collect the vobs */
-    void CollectVisibleVobsHelper( BspInfo* base, zTBBox3D boxCell, int clipFlags, std::vector<VobInfo*>& vobs, std::vector<VobLightInfo*>& lights, std::vector<SkeletalVobInfo*>& mobs );
+    /** Builds FlatBspNodes from BspLeafVobLists */
+    void BuildFlatBspTree();
+
+    /** Copies the current vob and mob lists of a leaf into its ranges */
+    void UpdateFlatBspLeaf( FlatBspNode& node );
+
+    /** Collects the visible vobs, mobs and lights from FlatBspNodes */
+    void CollectVisibleVobsHelper( std::vector<VobInfo*>& vobs, std::vector<VobLightInfo*>& lights, std::vector<SkeletalVobInfo*>& mobs );
+
+    /** Splits the BSP-tree into subtrees of the given depth, in the order CollectVisibleVobsHelper would visit them */
+    void SplitVobCollectionTasks( unsigned int splitDepth );
+
+    /** Collects the candidates of one subtree. Only reads the flat tree and the culling state prepared on the main thread,
+        never the game objects, so tasks can run on any thread. */
+    void CollectVobCollectionTask( VobCollectionTask& task, VobCollectionScratch& scratch );
+
+    /** Frustum and draw distances of the current CollectVisibleVobs call */
+    CullingFrustum VobCullingFrustum;
+    CullingDistances VobCullingDistances;
+
+    /** Depth-first copy of the BSP-tree. The vobs of every leaf are kept in one consecutive range, in the order
+        IndoorVobs, SmallVobs, Vobs, with the vob of every box in FlatBspVobOwners. */
+    std::vector<FlatBspNode> FlatBspNodes;
+    BoxCullingSet FlatBspVobBounds;
+    std::vector<VobInfo*> FlatBspVobOwners;
+    std::vector<SkeletalVobInfo*> FlatBspMobs;
+    unsigned int NumFlatBspLeaves;
+
+    /** Loads the PVS of the current world from its cache file, or builds and caches it */
+    void LoadOrBuildLeafPvs();
+
+    /** Returns the leaf whose PVS can be used at the given position, FlatBspNode::NO_NODE if there is none */
+    unsigned int FindPvsLeaf( const XMFLOAT3& position ) const;
+
+    /** Leaf visibility through the portals of indoor worlds, loaded or built with the BSP-tree and used when EnablePortalPvs is set */
+    BspPvs LeafPvs;
+
+    /** Leaf the camera is in for the current CollectVisibleVobs call, NO_NODE if the PVS isn't used */
+    unsigned int VobCullingPvsLeaf;
+
+    /** Subtrees of the current CollectVisibleVobs call, and scratch memory for every thread working on them */
+    std::vector<VobCollectionTask> VobCollectionTasks;
+    std::vector<VobCollectionScratch> VobCollectionScratches;
+    unsigned int VobCollectionStamp;
+    unsigned int NumVobCollectionIds;
+
+    /** Draws the world sections around the camera into SoftwareOcclusion */
+    void UpdateSoftwareOcclusion();
+
+    /** Depth buffer BSP nodes and vobs are tested against when EnableSoftwareOcclusionCulling is set */
+    SoftwareOcclusionBuffer SoftwareOcclusion;
+    std::vector<unsigned int> OccluderSectionIndices;
 
     /** Applys the suppressed textures */
     void ApplySuppressedSectionTextures();
@@ -744,7 +912,13 @@ private:
 
     /** Loaded game sections */
     std::map<int, std::map<int, WorldMeshSectionInfo>> WorldSections;
+    WorldSectionGrid WorldSectionIndex;
+    std::vector<unsigned int> VisibleSectionIndices;
     MeshInfo* WrappedWorldMesh;
+    MeshInfo* FullWrappedWorldMesh;
+
+    /** Custom world mesh being imported while the game loads the rest of the level */
+    std::unique_ptr<CustomWorldImport> CustomWorldImporter;
 
     /** List of vobs with skeletal meshes (Having a zCModel-Visual) */
     std::list<SkeletalVobInfo*> SkeletalMeshVobs;
@@ -786,8 +960,53 @@ private:
     /** Set of all vobs we registered by now */
     std::unordered_set<zCVob*> RegisteredVobs;
 
-    /** List of dynamically added vobs */
-    std::list<VobInfo*> DynamicallyAddedVobs;
+    /** Vobs added or moved after the world was loaded, which the BSP-tree doesn't know about */
+    DynamicAabbTree DynamicVobTree;
+
+    /** All vobs of VobMap for picking. Only built once TraceStaticMeshVobsBB is used, kept up to date from then on. */
+    DynamicAabbTree PickingVobTree;
+    bool PickingVobTreeBuilt;
+
+    /** Instance data of the vobs in VobMap, at the slot every vob keeps while it exists */
+    StaticInstanceStore StaticInstances;
+
+    /** Scratch memory for queries on the vob trees */
+    std::vector<unsigned int> VobTreeQueryResults;
+
+    /** Measures the time spent keeping the vob trees up to date */
+    BasicTimer VobTreeTimer;
+
+    /** Box of the given vob in the vob trees, also covering its position the draw distance is measured from */
+    static zTBBox3D GetVobTreeBox( VobInfo* vob );
+
+    /** Adds the vob to the dynamic vob tree, or updates its box if it already is in there */
+    void AddDynamicVob( VobInfo* vob );
+
+    /** Updates the boxes of the vob in all vob trees it is in */
+    void RefitVobTrees( VobInfo* vob );
+
+    /** Removes the vob from all vob trees it is in */
+    void RemoveVobFromTrees( VobInfo* vob );
+
+    /** Fills PickingVobTree with all vobs of VobMap */
+    void BuildPickingVobTree();
+
+    /** All triangles of the world meshes, for TraceWorldMesh. Built when the world is loaded and again
+        once the editor hid some of the meshes. */
+    TriangleBvh WorldMeshBvh;
+    std::vector<WorldMeshBvhRange> WorldMeshBvhRanges;
+    bool WorldMeshBvhBuilt;
+
+    /** Builds WorldMeshBvh from the meshes of all sections */
+    void BuildWorldMeshBvh();
+
+    /** SectionPolygons of all sections and the tree over them, for CollectPolygonsInAABB */
+    TriangleBvh CustomPolygonBvh;
+    std::vector<zCPolygon*> CustomPolygons;
+    std::vector<unsigned int> CustomPolygonQueryResults;
+
+    /** Builds CustomPolygonBvh from the SectionPolygons of all sections */
+    void BuildCustomPolygonBvh();
 
     /** Map of vobs and VobIndfos */
     std::unordered_map<zCVob*, VobInfo*> VobMap;
@@ -709,6 +709,17 @@ struct GothicRendererSettings {
         RunInSpacerNet = false;
         BinkVideoRunning = false;
         EnableWaterAnimation = false;
+        CompactWorldCache = false;
+        EnableVobLods = false;
+        EnableWorldMeshletCulling = false;
+        EnableSoftwareOcclusionCulling = false;
+        EnableParallelVobCollection = false;
+        ParallelVobCollectionDepth = 6;
+        EnablePortalPvs = false;
+        EnableLightClusters = false;
+        EnableScreenSizeCulling = false;
+        MinVobScreenSize = 2.0f;
+        EnableParallelDrawRecording = false;
     }
 
     void SetupOldWorldSpecificValues() {
@@ -868,6 +879,40 @@ struct GothicRendererSettings {
     bool RunInSpacerNet;
     bool BinkVideoRunning;
     bool EnableWaterAnimation;
+
+    /** Stores the world cache with ExVertexStructCompact and draws the world from that, trading a little
+        precision for a smaller file and vertex buffers */
+    bool CompactWorldCache;
+
+    /** Generates simplified versions of static vob meshes while loading and draws them in the distance */
+    bool EnableVobLods;
+
+    /** Frustum culls the world meshes per meshlet instead of drawing whole sections. The meshlets are built
+        when the world gets loaded, so changing this only has an effect on the next world. */
+    bool EnableWorldMeshletCulling;
+
+    /** Tests BSP nodes and vobs against a small depth buffer drawn on the CPU, instead of using occlusion queries */
+    bool EnableSoftwareOcclusionCulling;
+
+    /** Collects the visible vobs on the worker threads, one task per BSP subtree at ParallelVobCollectionDepth */
+    bool EnableParallelVobCollection;
+    unsigned int ParallelVobCollectionDepth;
+
+    /** Skips vobs in BSP leaves of indoor worlds which the camera can't see through the portals.
+        The leaf visibility is built when an indoor world is loaded and cached per world. */
+    bool EnablePortalPvs;
+
+    /** Bins the point lights into clusters of the view frustum and skips the ones touching none of them */
+    bool EnableLightClusters;
+
+    /** Culls vobs by how large they are on screen instead of the vob draw radii. Vobs are drawn as long as their
+        bounding sphere covers at least MinVobScreenSize pixels, up to the world draw distance. */
+    bool EnableScreenSizeCulling;
+    float MinVobScreenSize;
+
+    /** Records the draws of the world mesh, and of the static vobs in the main pass and the shadow cascades, on the
+        worker threads into deferred contexts, once there are enough of them */
+    bool EnableParallelDrawRecording;
     E_AntiAliasingMode AntiAliasingMode;
     E_SharpeningMode SharpeningMode;
 };
@@ -943,7 +988,17 @@ struct GothicRendererInfo {
         FarPlane = 0;
         NearPlane = 0;
         FrameDrawnLights = 0;
+        FrameClusterCulledLights = 0;
+        FrameVobTreeReinserts = 0;
+        FrameVobTreeMS = 0;
+        FrameOcclusionQueries = 0;
+        FrameOcclusionMultiQueries = 0;
+        FrameOcclusionResultsPending = 0;
         WorldMeshDrawCalls = 0;
+        FrameWorldMeshPackets = 0;
+        FrameWorldMeshMaterialChanges = 0;
+        FrameWorldMeshJobs = 0;
+        FrameStaticInstanceUploads = 0;
         FramePipelineStates = 0;
 
         StateChanges = 0;
@@ -981,8 +1036,29 @@ struct GothicRendererInfo {
     float FarPlane;
     float NearPlane;
     int FrameDrawnLights;
+    int FrameClusterCulledLights;
     int WorldMeshDrawCalls;
 
+    /** Maintenance of the dynamic vob trees since the last frame */
+    int FrameVobTreeReinserts;
+    float FrameVobTreeMS;
+
+    /** Occlusion queries issued in the last frame, how many of them covered several nodes, and how many
+        results of earlier frames weren't there yet */
+    int FrameOcclusionQueries;
+    int FrameOcclusionMultiQueries;
+    int FrameOcclusionResultsPending;
+
+    /** Draws the render queue of the world mesh got in the last frame, and how often it had to switch textures for them */
+    int FrameWorldMeshPackets;
+    int FrameWorldMeshMaterialChanges;
+
+    /** Command lists the world mesh was recorded into, 0 if it was drawn directly */
+    int FrameWorldMeshJobs;
+
+    /** Static vob instances whose data had to be sent to the GPU in the last frame */
+    int FrameStaticInstanceUploads;
+
     GothicRendererTiming Timing;
 
     unsigned int VOBVerticesDataSize;
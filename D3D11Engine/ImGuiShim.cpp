@@ -408,6 +408,27 @@ void ImGuiShim::RenderSettingsWindow()
             ImGui::Checkbox( "Occlusion Culling", &settings.EnableOcclusionCulling );
             if ( ImGui::IsItemHovered() )
                 ImGui::SetTooltip( "Hides objects that are not visible by camera. Doesn't work properly, turn off if you don't play on potato." );
+            ImGui::Checkbox( "Software Occlusion Culling", &settings.EnableSoftwareOcclusionCulling );
+            if ( ImGui::IsItemHovered() )
+                ImGui::SetTooltip( "Hides objects behind the world mesh using a small depth buffer drawn on the CPU. Replaces the occlusion culling above." );
+            ImGui::Checkbox( "Parallel Object Collection", &settings.EnableParallelVobCollection );
+            if ( ImGui::IsItemHovered() )
+                ImGui::SetTooltip( "Finds the visible objects on all CPU cores instead of just one." );
+            ImGui::Checkbox( "Portal Visibility (Indoor)", &settings.EnablePortalPvs );
+            if ( ImGui::IsItemHovered() )
+                ImGui::SetTooltip( "Hides objects in indoor worlds which can't be seen through the portals. Computed once per world, which can take a moment." );
+            ImGui::Checkbox( "Light Clustering", &settings.EnableLightClusters );
+            if ( ImGui::IsItemHovered() )
+                ImGui::SetTooltip( "Skips point lights which can't reach anything on screen. Shows how many lights touch each part of the screen in the frame stats." );
+            ImGui::Checkbox( "Screen Size Culling", &settings.EnableScreenSizeCulling );
+            if ( ImGui::IsItemHovered() )
+                ImGui::SetTooltip( "Hides objects once they get smaller on screen than the size below, instead of using the object draw distances. Large objects stay visible up to the world draw distance." );
+            ImGui::BeginDisabled( !settings.EnableScreenSizeCulling );
+            ImGui::SliderFloat( "Min. Object Size (px)", &settings.MinVobScreenSize, 0.5f, 16.0f, "%.1f", ImGuiSliderFlags_::ImGuiSliderFlags_ClampOnInput );
+            ImGui::EndDisabled();
+            ImGui::Checkbox( "Parallel Draw Recording", &settings.EnableParallelDrawRecording );
+            if ( ImGui::IsItemHovered() )
+                ImGui::SetTooltip( "Prepares the draw calls of the world mesh on all CPU cores. Helps when the CPU can't keep up with the draw calls, may be slower on drivers without command list support." );
 
 
             ImGui::EndGroup();
@@ -871,9 +892,19 @@ void RenderAdvancedColumn3( GothicRendererSettings& settings, GothicAPI* gapi )
         ImGui::InputInt( "DrawnVobs", &rendererInfo.FrameDrawnVobs, 1, 100, ImGuiInputTextFlags_ReadOnly );
         ImGui::InputInt( "DrawnTriangles", &rendererInfo.FrameDrawnTriangles, 1, 100, ImGuiInputTextFlags_ReadOnly );
         ImGui::InputInt( "VobUpdates", &rendererInfo.FrameVobUpdates, 1, 100, ImGuiInputTextFlags_ReadOnly );
+        ImGui::InputInt( "VobTreeReinserts", &rendererInfo.FrameVobTreeReinserts, 1, 100, ImGuiInputTextFlags_ReadOnly );
+        ImGui::InputFloat( "VobTreeMS", &rendererInfo.FrameVobTreeMS, 1, 100, "%.6f", ImGuiInputTextFlags_ReadOnly );
+        ImGui::InputInt( "OcclusionQueries", &rendererInfo.FrameOcclusionQueries, 1, 100, ImGuiInputTextFlags_ReadOnly );
+        ImGui::InputInt( "OcclusionMultiQueries", &rendererInfo.FrameOcclusionMultiQueries, 1, 100, ImGuiInputTextFlags_ReadOnly );
+        ImGui::InputInt( "OcclusionResultsPending", &rendererInfo.FrameOcclusionResultsPending, 1, 100, ImGuiInputTextFlags_ReadOnly );
         ImGui::InputInt( "DrawnLights", &rendererInfo.FrameDrawnLights, 1, 100, ImGuiInputTextFlags_ReadOnly );
+        ImGui::InputInt( "ClusterCulledLights", &rendererInfo.FrameClusterCulledLights, 1, 100, ImGuiInputTextFlags_ReadOnly );
         ImGui::InputInt( "SectionsDrawn", &rendererInfo.FrameNumSectionsDrawn, 1, 100, ImGuiInputTextFlags_ReadOnly );
         ImGui::InputInt( "WorldMeshDrawCalls", &rendererInfo.WorldMeshDrawCalls, 1, 100, ImGuiInputTextFlags_ReadOnly );
+        ImGui::InputInt( "WorldMeshPackets", &rendererInfo.FrameWorldMeshPackets, 1, 100, ImGuiInputTextFlags_ReadOnly );
+        ImGui::InputInt( "WorldMeshMaterialChanges", &rendererInfo.FrameWorldMeshMaterialChanges, 1, 100, ImGuiInputTextFlags_ReadOnly );
+        ImGui::InputInt( "WorldMeshJobs", &rendererInfo.FrameWorldMeshJobs, 1, 100, ImGuiInputTextFlags_ReadOnly );
+        ImGui::InputInt( "StaticInstanceUploads", &rendererInfo.FrameStaticInstanceUploads, 1, 100, ImGuiInputTextFlags_ReadOnly );
         ImGui::InputFloat( "FarPlane", &rendererInfo.FarPlane, 1, 100, "%.0f", ImGuiInputTextFlags_ReadOnly );
         ImGui::InputFloat( "NearPlane", &rendererInfo.NearPlane, 1, 100, "%.0f", ImGuiInputTextFlags_ReadOnly );
         ImGui::InputFloat( "WorldMeshMS", &rendererInfo.Timing.WorldMeshMS, 1, 100, "%.6f", ImGuiInputTextFlags_ReadOnly );
@@ -898,6 +929,32 @@ void RenderAdvancedColumn3( GothicRendererSettings& settings, GothicAPI* gapi )
         ImGui::InputInt( "SC_SamplerState", (int*)&rendererInfo.StateChangesByState[GothicRendererInfo::SC_SMPL], 1, 100, ImGuiInputTextFlags_ReadOnly );
         ImGui::InputInt( "SC_BlendState", (int*)&rendererInfo.StateChangesByState[GothicRendererInfo::SC_BS], 1, 100, ImGuiInputTextFlags_ReadOnly );
 
+        // Light count of every screen tile, the most lights any cluster behind it has
+        const LightClusterGrid* lightClusters = reinterpret_cast<D3D11GraphicsEngine*>(Engine::GraphicsEngine)->GetLightClusters();
+        if ( settings.EnableLightClusters && lightClusters ) {
+            ImGui::SeparatorText( "Light Clusters" );
+            ImGui::Text( "Most lights in a cluster: %u", lightClusters->GetMaxClusterLights() );
+
+            static std::vector<uint32_t> heatmap;
+            lightClusters->GetTileHeatmap( heatmap );
+
+            const float cellSize = 12.0f;
+            const float maxLights = static_cast<float>(std::max( lightClusters->GetMaxClusterLights(), 1u ));
+            const ImVec2 origin = ImGui::GetCursorScreenPos();
+            ImDrawList* drawList = ImGui::GetWindowDrawList();
+            for ( unsigned int y = 0; y < lightClusters->GetTilesY(); y++ ) {
+                for ( unsigned int x = 0; x < lightClusters->GetTilesX(); x++ ) {
+                    const uint32_t count = heatmap[y * lightClusters->GetTilesX() + x];
+                    const float heat = count / maxLights;
+                    const ImU32 color = count ? IM_COL32( static_cast<int>(255 * heat), static_cast<int>(255 * (1.0f - heat)), 0, 255 ) : IM_COL32( 40, 40, 40, 255 );
+
+                    const ImVec2 min( origin.x + x * cellSize, origin.y + y * cellSize );
+                    drawList->AddRectFilled( min, ImVec2( min.x + cellSize - 1.0f, min.y + cellSize - 1.0f ), color );
+                }
+            }
+            ImGui::Dummy( ImVec2( lightClusters->GetTilesX() * cellSize, lightClusters->GetTilesY() * cellSize ) );
+        }
+
     }
     ImGui::End();
 }
@@ -0,0 +1,204 @@
+#include "pch.h"
+#include "LightClusterGrid.h"
+#include <immintrin.h>
+
+LightClusterGrid::LightClusterGrid() {
+    ProjScaleX = 0.0f;
+    ProjScaleY = 0.0f;
+    NearZ = 0.0f;
+    FarZ = 0.0f;
+    MaxClusterLights = 0;
+    NumLightsOutside = 0;
+
+    Resize( DEFAULT_TILES_X, DEFAULT_TILES_Y, DEFAULT_SLICES );
+}
+
+/** Sets the number of tiles and depth slices. Clears the assigned lights. */
+void LightClusterGrid::Resize( unsigned int tilesX, unsigned int tilesY, unsigned int numSlices ) {
+    TilesX = std::max( tilesX, 1u );
+    TilesY = std::max( tilesY, 1u );
+    NumSlices = std::max( numSlices, 1u );
+    PaddedTiles = (TilesX * TilesY + 3) & ~3u;
+
+    const size_t numBounds = static_cast<size_t>(PaddedTiles) * NumSlices;
+    BoundsMinX.assign( numBounds, 0.0f );
+    BoundsMinY.assign( numBounds, 0.0f );
+    BoundsMinZ.assign( numBounds, 0.0f );
+    BoundsMaxX.assign( numBounds, 0.0f );
+    BoundsMaxY.assign( numBounds, 0.0f );
+    BoundsMaxZ.assign( numBounds, 0.0f );
+    BoundsDirty = true;
+
+    ClusterOffsets.assign( GetNumClusters(), 0 );
+    ClusterCounts.assign( GetNumClusters(), 0 );
+    LightIndices.clear();
+    LightClusterCounts.clear();
+    MaxClusterLights = 0;
+    NumLightsOutside = 0;
+}
+
+/** Sets the frustum to split */
+void LightClusterGrid::SetFrustum( float projScaleX, float projScaleY, float nearZ, float farZ ) {
+    // Keep the slicing valid for odd input, a near plane at 0 would put every slice at the eye
+    nearZ = std::max( nearZ, 0.01f );
+    farZ = std::max( farZ, nearZ * 2.0f );
+
+    if ( projScaleX == ProjScaleX && projScaleY == ProjScaleY && nearZ == NearZ && farZ == FarZ && !BoundsDirty )
+        return;
+
+    ProjScaleX = projScaleX;
+    ProjScaleY = projScaleY;
+    NearZ = nearZ;
+    FarZ = farZ;
+    UpdateClusterBounds();
+}
+
+/** Recomputes the view space boxes of all clusters */
+void LightClusterGrid::UpdateClusterBounds() {
+    const unsigned int numTiles = TilesX * TilesY;
+    const float invScaleX = 1.0f / ProjScaleX;
+    const float invScaleY = 1.0f / ProjScaleY;
+    const float depthRatio = FarZ / NearZ;
+
+    for ( unsigned int s = 0; s < NumSlices; s++ ) {
+        const float z0 = NearZ * powf( depthRatio, static_cast<float>(s) / NumSlices );
+        const float z1 = s + 1 == NumSlices ? FarZ : NearZ * powf( depthRatio, static_cast<float>(s + 1) / NumSlices );
+        const size_t base = static_cast<size_t>(s) * PaddedTiles;
+
+        for ( unsigned int ty = 0; ty < TilesY; ty++ ) {
+            // Tile row 0 is at the top of the screen, where y in NDC is 1
+            const float ndcMaxY = 1.0f - 2.0f * ty / TilesY;
+            const float ndcMinY = 1.0f - 2.0f * (ty + 1) / TilesY;
+
+            for ( unsigned int tx = 0; tx < TilesX; tx++ ) {
+                const float ndcMinX = -1.0f + 2.0f * tx / TilesX;
+                const float ndcMaxX = -1.0f + 2.0f * (tx + 1) / TilesX;
+
+                // The cluster is a frustum piece, its corners lie on the near and far plane of the slice
+                const size_t i = base + ty * TilesX + tx;
+                BoundsMinX[i] = std::min( ndcMinX * z0, ndcMinX * z1 ) * invScaleX;
+                BoundsMaxX[i] = std::max( ndcMaxX * z0, ndcMaxX * z1 ) * invScaleX;
+                BoundsMinY[i] = std::min( ndcMinY * z0, ndcMinY * z1 ) * invScaleY;
+                BoundsMaxY[i] = std::max( ndcMaxY * z0, ndcMaxY * z1 ) * invScaleY;
+                BoundsMinZ[i] = z0;
+                BoundsMaxZ[i] = z1;
+            }
+        }
+
+        // Padding boxes are inside out, so nothing can touch them
+        for ( unsigned int t = numTiles; t < PaddedTiles; t++ ) {
+            BoundsMinX[base + t] = BoundsMinY[base + t] = BoundsMinZ[base + t] = FLT_MAX;
+            BoundsMaxX[base + t] = BoundsMaxY[base + t] = BoundsMaxZ[base + t] = -FLT_MAX;
+        }
+    }
+
+    BoundsDirty = false;
+}
+
+/** Slice the given view space depth falls into, may be outside of the valid range */
+int LightClusterGrid::GetSliceOfDepth( float z ) const {
+    if ( z <= NearZ )
+        return z < NearZ ? -1 : 0;
+
+    if ( z >= FarZ )
+        return z > FarZ ? static_cast<int>(NumSlices) : static_cast<int>(NumSlices) - 1;
+
+    return static_cast<int>(floorf( logf( z / NearZ ) / logf( FarZ / NearZ ) * NumSlices ));
+}
+
+/** Bins the given view space spheres into the clusters */
+void LightClusterGrid::AssignLights( const XMFLOAT4* spheres, unsigned int numLights ) {
+    if ( BoundsDirty )
+        UpdateClusterBounds();
+
+    const unsigned int numTiles = TilesX * TilesY;
+    LightClusterCounts.assign( numLights, 0 );
+    std::fill( ClusterCounts.begin(), ClusterCounts.end(), 0 );
+    HitClusters.clear();
+    HitLights.clear();
+    NumLightsOutside = 0;
+
+    const __m128 zero = _mm_setzero_ps();
+    for ( unsigned int l = 0; l < numLights; l++ ) {
+        const XMFLOAT4& sphere = spheres[l];
+        if ( !(sphere.w > 0.0f) )
+            continue;
+
+        // Only the slices overlapping the depth range of the sphere can be touched. One more on each side
+        // makes up for rounding differences to the slice bounds, the box test sorts them out again.
+        const int firstSlice = std::max( GetSliceOfDepth( sphere.z - sphere.w ) - 1, 0 );
+        const int lastSlice = std::min( GetSliceOfDepth( sphere.z + sphere.w ) + 1, static_cast<int>(NumSlices) - 1 );
+
+        const __m128 cx = _mm_set1_ps( sphere.x );
+        const __m128 cy = _mm_set1_ps( sphere.y );
+        const __m128 cz = _mm_set1_ps( sphere.z );
+        const __m128 radiusSq = _mm_set1_ps( sphere.w * sphere.w );
+
+        unsigned int numHits = 0;
+        for ( int s = firstSlice; s <= lastSlice; s++ ) {
+            const size_t base = static_cast<size_t>(s) * PaddedTiles;
+            for ( unsigned int t = 0; t < PaddedTiles; t += 4 ) {
+                const size_t i = base + t;
+
+                // Distance from the center to the box, summed per axis from the part outside of the slab
+                const __m128 dx = _mm_add_ps( _mm_max_ps( _mm_sub_ps( _mm_loadu_ps( &BoundsMinX[i] ), cx ), zero ),
+                    _mm_max_ps( _mm_sub_ps( cx, _mm_loadu_ps( &BoundsMaxX[i] ) ), zero ) );
+                const __m128 dy = _mm_add_ps( _mm_max_ps( _mm_sub_ps( _mm_loadu_ps( &BoundsMinY[i] ), cy ), zero ),
+                    _mm_max_ps( _mm_sub_ps( cy, _mm_loadu_ps( &BoundsMaxY[i] ) ), zero ) );
+                const __m128 dz = _mm_add_ps( _mm_max_ps( _mm_sub_ps( _mm_loadu_ps( &BoundsMinZ[i] ), cz ), zero ),
+                    _mm_max_ps( _mm_sub_ps( cz, _mm_loadu_ps( &BoundsMaxZ[i] ) ), zero ) );
+                const __m128 distSq = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) ), _mm_mul_ps( dz, dz ) );
+
+                const int mask = _mm_movemask_ps( _mm_cmple_ps( distSq, radiusSq ) );
+                if ( !mask )
+                    continue;
+
+                for ( unsigned int lane = 0; lane < 4; lane++ ) {
+                    if ( !((mask >> lane) & 1) )
+                        continue;
+
+                    const unsigned int cluster = s * numTiles + t + lane;
+                    HitClusters.push_back( cluster );
+                    HitLights.push_back( l );
+                    ClusterCounts[cluster]++;
+                    numHits++;
+                }
+            }
+        }
+
+        LightClusterCounts[l] = numHits;
+        if ( !numHits )
+            NumLightsOutside++;
+    }
+
+    // Lay the lists out back to back. The pairs are in light order, so every list ends up sorted.
+    uint32_t offset = 0;
+    MaxClusterLights = 0;
+    for ( size_t c = 0; c < ClusterCounts.size(); c++ ) {
+        ClusterOffsets[c] = offset;
+        offset += ClusterCounts[c];
+        MaxClusterLights = std::max( MaxClusterLights, ClusterCounts[c] );
+    }
+
+    LightIndices.resize( HitClusters.size() );
+    for ( size_t h = 0; h < HitClusters.size(); h++ ) {
+        LightIndices[ClusterOffsets[HitClusters[h]]++] = HitLights[h];
+    }
+
+    // Filling moved every offset to the end of its list
+    for ( size_t c = 0; c < ClusterCounts.size(); c++ ) {
+        ClusterOffsets[c] -= ClusterCounts[c];
+    }
+}
+
+/** Fills outCounts with the highest light count over all slices, for every tile */
+void LightClusterGrid::GetTileHeatmap( std::vector<uint32_t>& outCounts ) const {
+    const unsigned int numTiles = TilesX * TilesY;
+    outCounts.assign( numTiles, 0 );
+
+    for ( unsigned int s = 0; s < NumSlices; s++ ) {
+        for ( unsigned int t = 0; t < numTiles; t++ ) {
+            outCounts[t] = std::max( outCounts[t], ClusterCounts[s * numTiles + t] );
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "pch.h"
+
+/** Splits the view frustum into clusters, a grid of screen tiles with exponentially spaced depth slices,
+    and bins point lights into them. Every cluster gets a compact list of the lights touching it, which
+    is also the count the debug heatmap shows. Clusters are tested as view space boxes enclosing them,
+    so a light may end up in a few clusters it only touches with the corner of the box. */
+class LightClusterGrid {
+public:
+    static const unsigned int DEFAULT_TILES_X = 16;
+    static const unsigned int DEFAULT_TILES_Y = 9;
+    static const unsigned int DEFAULT_SLICES = 24;
+
+    LightClusterGrid();
+
+    /** Sets the number of tiles and depth slices. Clears the assigned lights. */
+    void Resize( unsigned int tilesX, unsigned int tilesY, unsigned int numSlices );
+
+    /** Sets the frustum to split, for a symmetric perspective projection with the given x and y scale (the
+        first two diagonal entries of the projection matrix) between nearZ and farZ in view space. The cluster
+        bounds are only recomputed if something changed. */
+    void SetFrustum( float projScaleX, float projScaleY, float nearZ, float farZ );
+
+    /** Bins the given view space spheres (xyz = center, w = radius) into the clusters. Spheres with a radius
+        of 0 or less are skipped. */
+    void AssignLights( const XMFLOAT4* spheres, unsigned int numLights );
+
+    unsigned int GetTilesX() const { return TilesX; }
+    unsigned int GetTilesY() const { return TilesY; }
+    unsigned int GetNumSlices() const { return NumSlices; }
+    unsigned int GetNumClusters() const { return TilesX * TilesY * NumSlices; }
+
+    /** Index of the cluster of the given tile (0, 0 is the top left one) and slice */
+    unsigned int GetClusterIndex( unsigned int tileX, unsigned int tileY, unsigned int slice ) const {
+        return (slice * TilesY + tileY) * TilesX + tileX;
+    }
+
+    /** Returns the indices of the lights touching the given cluster, sorted ascending */
+    const uint32_t* GetClusterLights( unsigned int cluster, unsigned int& outCount ) const {
+        outCount = ClusterCounts[cluster];
+        return LightIndices.data() + ClusterOffsets[cluster];
+    }
+
+    /** Number of clusters the given light touches. Lights touching none can't reach any visible pixel. */
+    unsigned int GetLightClusterCount( unsigned int light ) const { return LightClusterCounts[light]; }
+
+    /** Highest number of lights in any cluster */
+    unsigned int GetMaxClusterLights() const { return MaxClusterLights; }
+
+    /** Number of lights of the last AssignLights call which touch no cluster, not counting skipped ones */
+    unsigned int GetNumLightsOutside() const { return NumLightsOutside; }
+
+    /** Fills outCounts with the highest light count over all slices, for every tile row by row */
+    void GetTileHeatmap( std::vector<uint32_t>& outCounts ) const;
+
+private:
+    /** Recomputes the view space boxes of all clusters */
+    void UpdateClusterBounds();
+
+    /** Slice the given view space depth falls into, may be outside of the valid range */
+    int GetSliceOfDepth( float z ) const;
+
+    unsigned int TilesX;
+    unsigned int TilesY;
+    unsigned int NumSlices;
+
+    float ProjScaleX;
+    float ProjScaleY;
+    float NearZ;
+    float FarZ;
+    bool BoundsDirty;
+
+    /** Tiles of a slice rounded up to a multiple of 4, so they can be tested 4 at a time */
+    unsigned int PaddedTiles;
+
+    /** Cluster boxes as separate arrays per component, PaddedTiles entries per slice.
+        Padding boxes are empty and never touched. */
+    std::vector<float> BoundsMinX;
+    std::vector<float> BoundsMinY;
+    std::vector<float> BoundsMinZ;
+    std::vector<float> BoundsMaxX;
+    std::vector<float> BoundsMaxY;
+    std::vector<float> BoundsMaxZ;
+
+    /** Light lists of all clusters, each one is Count entries starting at its offset into LightIndices */
+    std::vector<uint32_t> ClusterOffsets;
+    std::vector<uint32_t> ClusterCounts;
+    std::vector<uint32_t> LightIndices;
+
+    std::vector<uint32_t> LightClusterCounts;
+
+    /** Cluster of every light-cluster pair found, in light order */
+    std::vector<uint32_t> HitClusters;
+    std::vector<uint32_t> HitLights;
+
+    unsigned int MaxClusterLights;
+    unsigned int NumLightsOutside;
+};
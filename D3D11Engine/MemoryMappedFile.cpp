@@ -0,0 +1,65 @@
+#include "pch.h"
+#include "MemoryMappedFile.h"
+
+MemoryMappedFile::MemoryMappedFile() {
+    File = INVALID_HANDLE_VALUE;
+    Mapping = nullptr;
+    Data = nullptr;
+    Size = 0;
+}
+
+MemoryMappedFile::~MemoryMappedFile() {
+    Close();
+}
+
+/** Maps the given file into memory */
+XRESULT MemoryMappedFile::Open( const std::string& file ) {
+    Close();
+
+    File = CreateFileA( file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+    if ( File == INVALID_HANDLE_VALUE ) {
+        return XR_FAILED;
+    }
+
+    LARGE_INTEGER fileSize;
+    if ( !GetFileSizeEx( File, &fileSize ) || fileSize.QuadPart == 0 || static_cast<unsigned long long>(fileSize.QuadPart) > SIZE_MAX ) {
+        // Empty files can't be mapped, and we can't address more than SIZE_MAX anyways
+        Close();
+        return XR_FAILED;
+    }
+
+    Mapping = CreateFileMappingA( File, nullptr, PAGE_READONLY, 0, 0, nullptr );
+    if ( !Mapping ) {
+        Close();
+        return XR_FAILED;
+    }
+
+    Data = reinterpret_cast<const uint8_t*>(MapViewOfFile( Mapping, FILE_MAP_READ, 0, 0, 0 ));
+    if ( !Data ) {
+        Close();
+        return XR_FAILED;
+    }
+
+    Size = static_cast<size_t>(fileSize.QuadPart);
+    return XR_SUCCESS;
+}
+
+/** Unmaps the file */
+void MemoryMappedFile::Close() {
+    if ( Data ) {
+        UnmapViewOfFile( Data );
+        Data = nullptr;
+    }
+
+    if ( Mapping ) {
+        CloseHandle( Mapping );
+        Mapping = nullptr;
+    }
+
+    if ( File != INVALID_HANDLE_VALUE ) {
+        CloseHandle( File );
+        File = INVALID_HANDLE_VALUE;
+    }
+
+    Size = 0;
+}
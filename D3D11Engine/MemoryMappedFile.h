@@ -0,0 +1,30 @@
+#pragma once
+#include "pch.h"
+
+/** Read-only view of a whole file. The data stays valid until the file is closed. */
+class MemoryMappedFile {
+public:
+    MemoryMappedFile();
+    ~MemoryMappedFile();
+
+    MemoryMappedFile( const MemoryMappedFile& ) = delete;
+    MemoryMappedFile& operator=( const MemoryMappedFile& ) = delete;
+
+    /** Maps the given file into memory */
+    XRESULT Open( const std::string& file );
+
+    /** Unmaps the file */
+    void Close();
+
+    /** Returns the start of the mapped file */
+    const uint8_t* GetData() const { return Data; }
+
+    /** Returns the size of the mapped file in bytes */
+    size_t GetSize() const { return Size; }
+
+private:
+    HANDLE File;
+    HANDLE Mapping;
+    const uint8_t* Data;
+    size_t Size;
+};
@@ -0,0 +1,221 @@
+#include "pch.h"
+#include "MeshCacheFormat.h"
+
+namespace MeshCacheFormat {
+    /** 64-bit checksum of the given data */
+    uint64_t ComputeChecksum( const uint8_t* data, size_t size ) {
+        const uint64_t prime = 0x100000001B3ull;
+        uint64_t h = 0xCBF29CE484222325ull ^ size;
+
+        size_t i = 0;
+        for ( ; i + sizeof( uint64_t ) <= size; i += sizeof( uint64_t ) ) {
+            uint64_t word;
+            memcpy( &word, data + i, sizeof( word ) );
+            h = (h ^ word) * prime;
+            h ^= h >> 29;
+        }
+
+        for ( ; i < size; i++ ) {
+            h = (h ^ data[i]) * prime;
+        }
+
+        // Finalizer of splitmix64
+        h ^= h >> 30;
+        h *= 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 27;
+        h *= 0x94D049BB133111EBull;
+        h ^= h >> 31;
+        return h;
+    }
+
+    /** Lays out the geometry as a version 2 file */
+    void WriteVersion2( const MeshCacheGeometry& geometry, std::vector<uint8_t>& outData ) {
+        std::vector<MeshCacheTexture> textures;
+        std::vector<MeshCacheSubmesh> submeshes;
+        std::string strings;
+
+        for ( auto const& it : geometry ) {
+            MeshCacheTexture texture = {};
+            texture.NameOffset = strings.size();
+            texture.NameLength = static_cast<uint32_t>(it.first.size());
+            texture.FirstSubmesh = static_cast<uint32_t>(submeshes.size());
+            texture.NumSubmeshes = static_cast<uint32_t>(it.second.size());
+            textures.emplace_back( texture );
+            strings += it.first;
+
+            submeshes.resize( submeshes.size() + it.second.size() );
+        }
+
+        // Lay out the file: header, tables, then all geometry blobs
+        MeshCacheHeader header = {};
+        header.Version = VERSION_2;
+        header.HeaderSize = sizeof( MeshCacheHeader );
+        header.NumTextures = static_cast<uint32_t>(textures.size());
+        header.NumSubmeshes = static_cast<uint32_t>(submeshes.size());
+        header.TexturesOffset = AlignBlob( sizeof( MeshCacheHeader ) );
+        header.SubmeshesOffset = AlignBlob( header.TexturesOffset + textures.size() * sizeof( MeshCacheTexture ) );
+        header.StringTableOffset = header.SubmeshesOffset + submeshes.size() * sizeof( MeshCacheSubmesh );
+        header.StringTableSize = strings.size();
+
+        uint64_t offset = header.StringTableOffset + header.StringTableSize;
+        size_t s = 0;
+        for ( auto const& it : geometry ) {
+            for ( auto const& submesh : it.second ) {
+                submeshes[s].VerticesOffset = AlignBlob( offset );
+                submeshes[s].NumVertices = submesh.first.size();
+                offset = submeshes[s].VerticesOffset + submesh.first.size() * sizeof( ExVertexStruct );
+
+                submeshes[s].IndicesOffset = AlignBlob( offset );
+                submeshes[s].NumIndices = submesh.second.size();
+                offset = submeshes[s].IndicesOffset + submesh.second.size() * sizeof( VERTEX_INDEX );
+                s++;
+            }
+        }
+        header.FileSize = offset;
+
+        // Assemble the file in memory, so the checksum can be computed before writing it
+        outData.assign( static_cast<size_t>(header.FileSize), 0 );
+        memcpy( outData.data() + header.TexturesOffset, textures.data(), textures.size() * sizeof( MeshCacheTexture ) );
+        memcpy( outData.data() + header.SubmeshesOffset, submeshes.data(), submeshes.size() * sizeof( MeshCacheSubmesh ) );
+        memcpy( outData.data() + header.StringTableOffset, strings.data(), strings.size() );
+
+        s = 0;
+        for ( auto const& it : geometry ) {
+            for ( auto const& submesh : it.second ) {
+                memcpy( outData.data() + submeshes[s].VerticesOffset, submesh.first.data(), submesh.first.size() * sizeof( ExVertexStruct ) );
+                memcpy( outData.data() + submeshes[s].IndicesOffset, submesh.second.data(), submesh.second.size() * sizeof( VERTEX_INDEX ) );
+                s++;
+            }
+        }
+
+        header.Checksum = ComputeChecksum( outData.data() + header.HeaderSize, outData.size() - header.HeaderSize );
+        memcpy( outData.data(), &header, sizeof( header ) );
+    }
+
+    /** Reads all submeshes of a version 1 file */
+    XRESULT ReadVersion1( const uint8_t* data, size_t size, std::vector<MeshCacheEntry>& outEntries ) {
+        outEntries.clear();
+
+        size_t pos = 0;
+        auto read = [&]( void* out, size_t numBytes ) {
+            if ( numBytes > size - pos ) {
+                return false;
+            }
+
+            memcpy( out, data + pos, numBytes );
+            pos += numBytes;
+            return true;
+        };
+
+        // Read version and num textures
+        int version;
+        int numTextures;
+        if ( !read( &version, sizeof( version ) ) || !read( &numTextures, sizeof( numTextures ) ) ) {
+            return XR_FAILED;
+        }
+
+        std::vector<MeshCacheEntry> entries;
+        for ( int t = 0; t < numTextures; t++ ) {
+            // Read texture name
+            unsigned char numTxNameChars;
+            if ( !read( &numTxNameChars, sizeof( numTxNameChars ) ) || numTxNameChars > size - pos ) {
+                return XR_FAILED;
+            }
+            std::string tx( reinterpret_cast<const char*>(data + pos), numTxNameChars );
+            pos += numTxNameChars;
+
+            // Read num submeshes
+            unsigned char numSubmeshes;
+            if ( !read( &numSubmeshes, sizeof( numSubmeshes ) ) ) {
+                return XR_FAILED;
+            }
+
+            for ( int i = 0; i < numSubmeshes; i++ ) {
+                entries.emplace_back();
+                MeshCacheEntry& entry = entries.back();
+                entry.Texture = tx;
+
+                // Read vertices
+                int numVertices;
+                if ( !read( &numVertices, sizeof( numVertices ) ) || numVertices < 0
+                    || static_cast<size_t>(numVertices) > (size - pos) / sizeof( ExVertexStruct ) ) {
+                    return XR_FAILED;
+                }
+
+                const ExVertexStruct* vertices = reinterpret_cast<const ExVertexStruct*>(data + pos);
+                entry.Vertices.assign( vertices, vertices + numVertices );
+                pos += numVertices * sizeof( ExVertexStruct );
+
+                // Read indices
+                int numIndices;
+                if ( !read( &numIndices, sizeof( numIndices ) ) || numIndices < 0
+                    || static_cast<size_t>(numIndices) > (size - pos) / sizeof( VERTEX_INDEX ) ) {
+                    return XR_FAILED;
+                }
+
+                const VERTEX_INDEX* indices = reinterpret_cast<const VERTEX_INDEX*>(data + pos);
+                entry.Indices.assign( indices, indices + numIndices );
+                pos += numIndices * sizeof( VERTEX_INDEX );
+            }
+        }
+
+        outEntries = std::move( entries );
+        return XR_SUCCESS;
+    }
+
+    /** Reads all submeshes of a version 2 file */
+    XRESULT ReadVersion2( const uint8_t* data, size_t size, std::vector<MeshCacheEntry>& outEntries ) {
+        outEntries.clear();
+
+        if ( size < sizeof( MeshCacheHeader ) ) {
+            return XR_FAILED;
+        }
+
+        const MeshCacheHeader& header = *reinterpret_cast<const MeshCacheHeader*>(data);
+        if ( header.FileSize != size || header.HeaderSize < sizeof( MeshCacheHeader ) || header.HeaderSize > size
+            || !IsArrayInFile( header.TexturesOffset, header.NumTextures, sizeof( MeshCacheTexture ), size )
+            || !IsArrayInFile( header.SubmeshesOffset, header.NumSubmeshes, sizeof( MeshCacheSubmesh ), size )
+            || !IsArrayInFile( header.StringTableOffset, header.StringTableSize, 1, size ) ) {
+            return XR_FAILED;
+        }
+
+        if ( ComputeChecksum( data + header.HeaderSize, size - header.HeaderSize ) != header.Checksum ) {
+            return XR_FAILED;
+        }
+
+        const MeshCacheTexture* textures = reinterpret_cast<const MeshCacheTexture*>(data + header.TexturesOffset);
+        const MeshCacheSubmesh* submeshes = reinterpret_cast<const MeshCacheSubmesh*>(data + header.SubmeshesOffset);
+        const char* strings = reinterpret_cast<const char*>(data + header.StringTableOffset);
+
+        std::vector<MeshCacheEntry> entries;
+        for ( uint32_t t = 0; t < header.NumTextures; t++ ) {
+            const MeshCacheTexture& texture = textures[t];
+            if ( texture.NameOffset > header.StringTableSize || texture.NameLength > header.StringTableSize - texture.NameOffset
+                || texture.FirstSubmesh > header.NumSubmeshes || texture.NumSubmeshes > header.NumSubmeshes - texture.FirstSubmesh ) {
+                return XR_FAILED;
+            }
+
+            std::string tx( strings + texture.NameOffset, texture.NameLength );
+            for ( uint32_t i = texture.FirstSubmesh; i < texture.FirstSubmesh + texture.NumSubmeshes; i++ ) {
+                const MeshCacheSubmesh& submesh = submeshes[i];
+                if ( !IsArrayInFile( submesh.VerticesOffset, submesh.NumVertices, sizeof( ExVertexStruct ), size )
+                    || !IsArrayInFile( submesh.IndicesOffset, submesh.NumIndices, sizeof( VERTEX_INDEX ), size ) ) {
+                    return XR_FAILED;
+                }
+
+                // The blobs are laid out just like the vectors, so this is a single copy each
+                const ExVertexStruct* vertices = reinterpret_cast<const ExVertexStruct*>(data + submesh.VerticesOffset);
+                const VERTEX_INDEX* indices = reinterpret_cast<const VERTEX_INDEX*>(data + submesh.IndicesOffset);
+
+                entries.emplace_back();
+                MeshCacheEntry& entry = entries.back();
+                entry.Texture = tx;
+                entry.Vertices.assign( vertices, vertices + submesh.NumVertices );
+                entry.Indices.assign( indices, indices + submesh.NumIndices );
+            }
+        }
+
+        outEntries = std::move( entries );
+        return XR_SUCCESS;
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "pch.h"
+
+/** Layout of the .mcache files written by WorldConverter::CacheMesh and read by GMesh.
+
+    Version 1 is a plain stream of fields (int version, int numTextures, then per texture
+    a uchar name length, the name, a uchar submesh count and per submesh int-prefixed
+    vertex and index arrays).
+
+    Version 2 starts with MeshCacheHeader. All offsets are absolute and 64-bit, texture
+    names live in one string table and every vertex and index blob starts 16-byte aligned,
+    so the file can be used straight from a memory mapping. */
+namespace MeshCacheFormat {
+    const uint32_t VERSION_1 = 1;
+    const uint32_t VERSION_2 = 2;
+
+    /** Alignment of the vertex and index blobs */
+    const uint64_t BLOB_ALIGNMENT = 16;
+
+#pragma pack(push, 1)
+    struct MeshCacheHeader {
+        /** Shares the position with the version of v1 files */
+        uint32_t Version;
+        uint32_t HeaderSize;
+        uint64_t FileSize;
+
+        /** Checksum over everything behind the header, see ComputeChecksum */
+        uint64_t Checksum;
+
+        uint32_t NumTextures;
+        uint32_t NumSubmeshes;
+        uint64_t TexturesOffset;
+        uint64_t SubmeshesOffset;
+        uint64_t StringTableOffset;
+        uint64_t StringTableSize;
+    };
+
+    struct MeshCacheTexture {
+        uint64_t NameOffset;
+        uint32_t NameLength;
+        uint32_t FirstSubmesh;
+        uint32_t NumSubmeshes;
+        uint32_t Reserved;
+    };
+
+    struct MeshCacheSubmesh {
+        uint64_t VerticesOffset;
+        uint64_t NumVertices;
+        uint64_t IndicesOffset;
+        uint64_t NumIndices;
+    };
+#pragma pack(pop)
+
+    /** Rounds the given offset up to BLOB_ALIGNMENT */
+    inline uint64_t AlignBlob( uint64_t offset ) {
+        return (offset + BLOB_ALIGNMENT - 1) & ~(BLOB_ALIGNMENT - 1);
+    }
+
+    /** Checks whether the given array lies completely inside a file of the given size */
+    inline bool IsArrayInFile( uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t fileSize ) {
+        return offset <= fileSize && count <= (fileSize - offset) / elementSize;
+    }
+
+    /** 64-bit checksum of the given data. Goes 8 bytes at a time, so it's about as fast as reading the file. */
+    uint64_t ComputeChecksum( const uint8_t* data, size_t size );
+
+    /** Vertices and indices of the submeshes per texture, like WorldConverter::CacheMesh gets them */
+    typedef std::map<std::string, std::vector<std::pair<std::vector<ExVertexStruct>, std::vector<VERTEX_INDEX>>>> MeshCacheGeometry;
+
+    /** A submesh read from a cache file */
+    struct MeshCacheEntry {
+        std::string Texture;
+        std::vector<ExVertexStruct> Vertices;
+        std::vector<VERTEX_INDEX> Indices;
+    };
+
+    /** Lays out the geometry as a version 2 file */
+    void WriteVersion2( const MeshCacheGeometry& geometry, std::vector<uint8_t>& outData );
+
+    /** Reads all submeshes of a file of the given version. Damaged files fail and leave outEntries empty. */
+    XRESULT ReadVersion1( const uint8_t* data, size_t size, std::vector<MeshCacheEntry>& outEntries );
+    XRESULT ReadVersion2( const uint8_t* data, size_t size, std::vector<MeshCacheEntry>& outEntries );
+}
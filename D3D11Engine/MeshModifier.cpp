@@ -1,5 +1,6 @@
 #include "pch.h"
 #include "MeshModifier.h"
+#include "MeshSimplifier.h"
 /*#include "include\OpenMesh\Tools\Subdivider\Uniform\CatmullClarkT.hh"
 #include "include\OpenMesh\Tools\Subdivider\Uniform\LoopT.hh"
 #include "include\OpenMesh\Tools\Decimater\DecimaterT.hh"
@@ -189,35 +190,8 @@ void MeshModifier::DropTexcoords( const std::vector<ExVertexStruct>& inVertices,
 
 /** Decimates the mesh, reducing its complexity */
 void MeshModifier::Decimate( const std::vector<ExVertexStruct>& inVertices, const std::vector<unsigned short>& inIndices, std::vector<ExVertexStruct>& outVertices, std::vector<VERTEX_INDEX>& outIndices ) {
-    /*MyMesh mesh;
-
-    PutVertexData(mesh, inVertices, inIndices);
-
-    Decimater decimater(mesh); // a decimater object, connected to a mesh
-
-    //HModQuadric hModQuadric; // use a quadric module
-    HModRoundnessT hModRoundness;
-
-    decimater.add(hModRoundness); // register module at the decimater
-
-    //
-    //since we need exactly one priority module (non-binary)
-    //we have to call set_binary(false) for our priority module
-    //in the case of HModQuadric, unset_max_err() calls set_binary(false) internally
-    //
-    //decimater.module(hModRoundness).set_binary(false);//.unset_max_err();
-    decimater.module(hModRoundness).set_min_roundness(0.05f);
-    //decimater.module(hModRoundness).set_min_angle(
-    decimater.module(hModRoundness).initialize();
-    decimater.initialize(); // let the decimater initialize the mesh and the
-    // modules
-    decimater.decimate(); // do decimation
-
-    mesh.update_normals();
-    mesh.triangulate();
-
-    // Get data out of the openmesh
-    PullVertexData(mesh, outVertices, outIndices);*/
+    // Halve the triangle count, without any error limit
+    MeshSimplifier::Simplify( inVertices, inIndices, inIndices.size() / 6 * 3, FLT_MAX, outVertices, outIndices );
 }
 
 struct PNAENEdge {
@@ -0,0 +1,415 @@
+#include "pch.h"
+#include "MeshSimplifier.h"
+
+namespace {
+    /** Meshes with fewer triangles than this don't get any LODs */
+    const size_t MIN_LOD_TRIANGLES = 64;
+
+    /** A level has to get rid of at least 20% of the triangles of the level before */
+    const float MAX_LOD_KEPT_FRACTION = 0.8f;
+
+    /** Error limit of the LOD levels, relative to the size of the mesh */
+    const float MAX_LOD_ERROR = 0.05f;
+
+    const uint32_t INVALID_INDEX = 0xFFFFFFFF;
+
+    /** Symmetric 4x4 matrix of the summed up plane equations, weighted by triangle area */
+    struct Quadric {
+        double A2 = 0, B2 = 0, C2 = 0, D2 = 0;
+        double AB = 0, AC = 0, AD = 0, BC = 0, BD = 0, CD = 0;
+        double Weight = 0;
+
+        void AddPlane( double a, double b, double c, double d, double weight ) {
+            A2 += a * a * weight; B2 += b * b * weight; C2 += c * c * weight; D2 += d * d * weight;
+            AB += a * b * weight; AC += a * c * weight; AD += a * d * weight;
+            BC += b * c * weight; BD += b * d * weight; CD += c * d * weight;
+            Weight += weight;
+        }
+
+        void Add( const Quadric& q ) {
+            A2 += q.A2; B2 += q.B2; C2 += q.C2; D2 += q.D2;
+            AB += q.AB; AC += q.AC; AD += q.AD;
+            BC += q.BC; BD += q.BD; CD += q.CD;
+            Weight += q.Weight;
+        }
+
+        /** Mean squared distance of p to the planes */
+        double Evaluate( const XMFLOAT3& p ) const {
+            double x = p.x, y = p.y, z = p.z;
+            double e = A2 * x * x + B2 * y * y + C2 * z * z + D2
+                + 2.0 * (AB * x * y + AC * x * z + AD * x + BC * y * z + BD * y + CD * z);
+            return Weight > 0.0 ? std::max( e, 0.0 ) / Weight : 0.0;
+        }
+    };
+
+    struct Collapse {
+        uint32_t From;
+        uint32_t To;
+        double Error;
+
+        bool operator < ( const Collapse& o ) const {
+            return Error < o.Error;
+        }
+    };
+
+    struct PositionKey {
+        uint32_t Bits[3];
+
+        bool operator == ( const PositionKey& o ) const {
+            return Bits[0] == o.Bits[0] && Bits[1] == o.Bits[1] && Bits[2] == o.Bits[2];
+        }
+    };
+
+    struct PositionKeyHasher {
+        size_t operator()( const PositionKey& k ) const {
+            uint64_t h = 0xCBF29CE484222325ull;
+            for ( uint32_t b : k.Bits ) {
+                h = (h ^ b) * 0x100000001B3ull;
+            }
+            return static_cast<size_t>(h ^ (h >> 32));
+        }
+    };
+
+    PositionKey MakePositionKey( const float3& p ) {
+        // Adding 0 turns -0 into +0, so both end up at the same position
+        float c[3] = { p.x + 0.0f, p.y + 0.0f, p.z + 0.0f };
+
+        PositionKey key;
+        memcpy( key.Bits, c, sizeof( key.Bits ) );
+        return key;
+    }
+
+    XMVECTOR XM_CALLCONV TriangleNormal( FXMVECTOR p0, FXMVECTOR p1, FXMVECTOR p2 ) {
+        return XMVector3Cross( p1 - p0, p2 - p0 );
+    }
+
+    /** Returns the largest side of the bounding box of the given vertices */
+    float ComputeExtent( const std::vector<ExVertexStruct>& vertices, XMFLOAT3& outMin ) {
+        XMVECTOR bbmin = XMVectorReplicate( FLT_MAX );
+        XMVECTOR bbmax = XMVectorReplicate( -FLT_MAX );
+        for ( const ExVertexStruct& v : vertices ) {
+            XMVECTOR p = XMLoadFloat3( v.Position.toXMFLOAT3() );
+            bbmin = XMVectorMin( bbmin, p );
+            bbmax = XMVectorMax( bbmax, p );
+        }
+
+        XMFLOAT3 size;
+        XMStoreFloat3( &outMin, bbmin );
+        XMStoreFloat3( &size, bbmax - bbmin );
+        return std::max( std::max( size.x, size.y ), size.z );
+    }
+}
+
+/** Simplifies the given triangle list down to about targetIndexCount indices */
+float MeshSimplifier::Simplify( const std::vector<ExVertexStruct>& vertices, const std::vector<VERTEX_INDEX>& indices, size_t targetIndexCount, float maxError,
+    std::vector<ExVertexStruct>& outVertices, std::vector<VERTEX_INDEX>& outIndices ) {
+    outVertices.clear();
+    outIndices.clear();
+
+    size_t numVertices = vertices.size();
+    if ( numVertices == 0 || indices.size() < 3 ) {
+        return 0.0f;
+    }
+
+    // Work in a unit cube, so the quadrics stay in a sane range
+    XMFLOAT3 bbmin;
+    float extent = ComputeExtent( vertices, bbmin );
+    if ( extent <= 0.0f ) {
+        extent = 1.0f;
+    }
+
+    XMVECTOR origin = XMLoadFloat3( &bbmin );
+    float invExtent = 1.0f / extent;
+    std::vector<XMFLOAT3> positions( numVertices );
+    for ( size_t i = 0; i < numVertices; i++ ) {
+        XMStoreFloat3( &positions[i], (XMLoadFloat3( vertices[i].Position.toXMFLOAT3() ) - origin) * invExtent );
+    }
+
+    // Vertices at the same position are wedges of one position, differing in their normal or texcoords
+    std::vector<uint32_t> positionIds( numVertices );
+    uint32_t numPositions = 0;
+    {
+        std::unordered_map<PositionKey, uint32_t, PositionKeyHasher> positionMap;
+        positionMap.reserve( numVertices );
+        for ( size_t i = 0; i < numVertices; i++ ) {
+            auto it = positionMap.emplace( MakePositionKey( vertices[i].Position ), numPositions ).first;
+            if ( it->second == numPositions ) {
+                numPositions++;
+            }
+            positionIds[i] = it->second;
+        }
+    }
+
+    // Throw out triangles which are already degenerate
+    std::vector<uint32_t> tris;
+    tris.reserve( indices.size() );
+    for ( size_t i = 0; i + 2 < indices.size(); i += 3 ) {
+        uint32_t p0 = positionIds[indices[i]], p1 = positionIds[indices[i + 1]], p2 = positionIds[indices[i + 2]];
+        if ( p0 != p1 && p1 != p2 && p0 != p2 ) {
+            tris.insert( tris.end(), { indices[i], indices[i + 1], indices[i + 2] } );
+        }
+    }
+
+    // Lock everything with more than one wedge (seams, hard edges) and everything on an edge which
+    // isn't shared by exactly two triangles (borders, non-manifold geometry)
+    std::vector<bool> locked( numPositions, false );
+    {
+        std::vector<uint32_t> firstWedge( numPositions, INVALID_INDEX );
+        std::unordered_map<uint64_t, uint32_t> edgeUsage;
+        edgeUsage.reserve( tris.size() );
+        for ( size_t i = 0; i < tris.size(); i++ ) {
+            uint32_t p = positionIds[tris[i]];
+            if ( firstWedge[p] == INVALID_INDEX ) {
+                firstWedge[p] = tris[i];
+            } else if ( firstWedge[p] != tris[i] ) {
+                locked[p] = true;
+            }
+
+            uint32_t q = positionIds[tris[i - i % 3 + (i + 1) % 3]];
+            edgeUsage[(static_cast<uint64_t>(std::min( p, q )) << 32) | std::max( p, q )]++;
+        }
+
+        for ( auto const& it : edgeUsage ) {
+            if ( it.second != 2 ) {
+                locked[static_cast<uint32_t>(it.first >> 32)] = true;
+                locked[static_cast<uint32_t>(it.first)] = true;
+            }
+        }
+    }
+
+    std::vector<Quadric> quadrics( numPositions );
+    for ( size_t i = 0; i < tris.size(); i += 3 ) {
+        XMVECTOR p0 = XMLoadFloat3( &positions[tris[i]] );
+        XMVECTOR n = TriangleNormal( p0, XMLoadFloat3( &positions[tris[i + 1]] ), XMLoadFloat3( &positions[tris[i + 2]] ) );
+        float doubleArea = XMVectorGetX( XMVector3Length( n ) );
+        if ( doubleArea <= 0.0f ) {
+            continue;
+        }
+
+        XMFLOAT3 plane;
+        XMStoreFloat3( &plane, n / doubleArea );
+        double d = -XMVectorGetX( XMVector3Dot( XMLoadFloat3( &plane ), p0 ) );
+        for ( int v = 0; v < 3; v++ ) {
+            quadrics[positionIds[tris[i + v]]].AddPlane( plane.x, plane.y, plane.z, d, doubleArea * 0.5 );
+        }
+    }
+
+    double maxErrorSq = static_cast<double>(maxError * invExtent) * (maxError * invExtent);
+    double resultError = 0.0;
+
+    std::vector<uint32_t> remap( numVertices );
+    for ( size_t i = 0; i < numVertices; i++ ) {
+        remap[i] = static_cast<uint32_t>(i);
+    }
+
+    std::vector<uint32_t> adjacencyOffsets;
+    std::vector<uint32_t> adjacency;
+    std::vector<Collapse> candidates;
+    std::vector<uint8_t> touched;
+    std::vector<uint32_t> ringA, ringB;
+
+    while ( tris.size() > targetIndexCount ) {
+        // Triangles around every position
+        adjacencyOffsets.assign( numPositions + 1, 0 );
+        for ( uint32_t index : tris ) {
+            adjacencyOffsets[positionIds[index] + 1]++;
+        }
+        for ( uint32_t p = 0; p < numPositions; p++ ) {
+            adjacencyOffsets[p + 1] += adjacencyOffsets[p];
+        }
+        adjacency.resize( tris.size() );
+        {
+            std::vector<uint32_t> fill( adjacencyOffsets.begin(), adjacencyOffsets.end() - 1 );
+            for ( size_t i = 0; i < tris.size(); i++ ) {
+                adjacency[fill[positionIds[tris[i]]]++] = static_cast<uint32_t>(i / 3);
+            }
+        }
+
+        // Every edge can be collapsed in both directions, as long as the moving side isn't locked
+        candidates.clear();
+        for ( size_t i = 0; i < tris.size(); i++ ) {
+            uint32_t a = tris[i];
+            uint32_t b = tris[i - i % 3 + (i + 1) % 3];
+            uint32_t pa = positionIds[a], pb = positionIds[b];
+
+            Quadric q = quadrics[pa];
+            q.Add( quadrics[pb] );
+            if ( !locked[pa] ) {
+                candidates.push_back( { a, b, q.Evaluate( positions[b] ) } );
+            }
+            if ( !locked[pb] ) {
+                candidates.push_back( { b, a, q.Evaluate( positions[a] ) } );
+            }
+        }
+        std::sort( candidates.begin(), candidates.end() );
+
+        // Every collapse moves its neighbours, so each one only gets one per pass
+        touched.assign( numPositions, 0 );
+        size_t trianglesToRemove = (tris.size() - targetIndexCount) / 3;
+        size_t removed = 0;
+        size_t numCollapses = 0;
+
+        for ( const Collapse& c : candidates ) {
+            if ( c.Error > maxErrorSq || removed >= trianglesToRemove ) {
+                break;
+            }
+
+            uint32_t pa = positionIds[c.From], pb = positionIds[c.To];
+            if ( touched[pa] || touched[pb] ) {
+                continue;
+            }
+
+            XMVECTOR target = XMLoadFloat3( &positions[c.To] );
+            bool valid = true;
+            size_t sharedTriangles = 0;
+            ringA.clear();
+            ringB.clear();
+
+            for ( uint32_t t = adjacencyOffsets[pa]; valid && t < adjacencyOffsets[pa + 1]; t++ ) {
+                const uint32_t* tri = &tris[adjacency[t] * 3];
+
+                int corner = 0;
+                bool hasB = false, hasWedgeB = false;
+                for ( int v = 0; v < 3; v++ ) {
+                    uint32_t p = positionIds[tri[v]];
+                    if ( p == pa ) {
+                        corner = v;
+                    } else {
+                        ringA.emplace_back( p );
+                    }
+                    hasB |= p == pb;
+                    hasWedgeB |= tri[v] == c.To;
+                }
+
+                if ( hasB ) {
+                    // These get removed. If they use another wedge of b, their neighbours would get the wrong attributes.
+                    valid = hasWedgeB;
+                    sharedTriangles++;
+                    continue;
+                }
+
+                // Moving a must not flip any of the remaining triangles
+                XMVECTOR p[3] = { XMLoadFloat3( &positions[tri[0]] ), XMLoadFloat3( &positions[tri[1]] ), XMLoadFloat3( &positions[tri[2]] ) };
+                XMVECTOR before = TriangleNormal( p[0], p[1], p[2] );
+                p[corner] = target;
+                XMVECTOR after = TriangleNormal( p[0], p[1], p[2] );
+                valid = XMVectorGetX( XMVector3Dot( before, after ) ) > 0.0f;
+            }
+
+            if ( !valid || sharedTriangles == 0 ) {
+                continue;
+            }
+
+            // Both sides may only share the neighbours of the collapsed edge, or the mesh would fold onto itself
+            for ( uint32_t t = adjacencyOffsets[pb]; t < adjacencyOffsets[pb + 1]; t++ ) {
+                const uint32_t* tri = &tris[adjacency[t] * 3];
+                for ( int v = 0; v < 3; v++ ) {
+                    ringB.emplace_back( positionIds[tri[v]] );
+                }
+            }
+            std::sort( ringA.begin(), ringA.end() );
+            ringA.erase( std::unique( ringA.begin(), ringA.end() ), ringA.end() );
+            std::sort( ringB.begin(), ringB.end() );
+            ringB.erase( std::unique( ringB.begin(), ringB.end() ), ringB.end() );
+
+            size_t sharedNeighbours = 0;
+            for ( uint32_t p : ringA ) {
+                if ( p != pb && std::binary_search( ringB.begin(), ringB.end(), p ) ) {
+                    sharedNeighbours++;
+                }
+            }
+            if ( sharedNeighbours != sharedTriangles ) {
+                continue;
+            }
+
+            // a has only one wedge, since it isn't locked
+            remap[c.From] = c.To;
+            quadrics[pb].Add( quadrics[pa] );
+
+            touched[pb] = 1;
+            for ( uint32_t p : ringA ) {
+                touched[p] = 1;
+            }
+            touched[pa] = 1;
+
+            removed += sharedTriangles;
+            resultError = std::max( resultError, c.Error );
+            numCollapses++;
+        }
+
+        if ( numCollapses == 0 ) {
+            break;
+        }
+
+        size_t numTris = 0;
+        for ( size_t i = 0; i < tris.size(); i += 3 ) {
+            uint32_t i0 = remap[tris[i]], i1 = remap[tris[i + 1]], i2 = remap[tris[i + 2]];
+            uint32_t p0 = positionIds[i0], p1 = positionIds[i1], p2 = positionIds[i2];
+            if ( p0 != p1 && p1 != p2 && p0 != p2 ) {
+                tris[numTris++] = i0;
+                tris[numTris++] = i1;
+                tris[numTris++] = i2;
+            }
+        }
+        tris.resize( numTris );
+    }
+
+    // Only keep the vertices which are still used, in the order of their first use
+    std::vector<uint32_t> newIndices( numVertices, INVALID_INDEX );
+    outIndices.reserve( tris.size() );
+    for ( uint32_t index : tris ) {
+        if ( newIndices[index] == INVALID_INDEX ) {
+            newIndices[index] = static_cast<uint32_t>(outVertices.size());
+            outVertices.emplace_back( vertices[index] );
+        }
+        outIndices.emplace_back( static_cast<VERTEX_INDEX>(newIndices[index]) );
+    }
+
+    return static_cast<float>(sqrt( resultError )) * extent;
+}
+
+/** Builds up to maxLevels levels, each with about half the triangles of the one before */
+void MeshSimplifier::BuildLodChain( const std::vector<ExVertexStruct>& vertices, const std::vector<VERTEX_INDEX>& indices, int maxLevels, std::vector<LodLevel>& outLevels ) {
+    outLevels.clear();
+    if ( indices.size() < MIN_LOD_TRIANGLES * 3 ) {
+        return;
+    }
+
+    XMFLOAT3 bbmin;
+    float maxError = ComputeExtent( vertices, bbmin ) * MAX_LOD_ERROR;
+
+    size_t previousIndices = indices.size();
+    float previousError = 0.0f;
+    for ( int level = 1; level <= maxLevels; level++ ) {
+        // Always start from the full mesh, so the errors don't add up
+        size_t target = (indices.size() / 3 >> level) * 3;
+
+        LodLevel lod;
+        lod.Error = Simplify( vertices, indices, target, maxError, lod.Vertices, lod.Indices );
+        if ( lod.Indices.empty() || lod.Indices.size() > previousIndices * MAX_LOD_KEPT_FRACTION ) {
+            break;
+        }
+
+        // SelectLod expects the errors to grow with the level
+        lod.Error = std::max( lod.Error, previousError );
+
+        previousIndices = lod.Indices.size();
+        previousError = lod.Error;
+        outLevels.emplace_back( std::move( lod ) );
+    }
+}
+
+/** Selects the coarsest level whose error is at most maxPixelError on screen */
+int MeshSimplifier::SelectLod( const float* levelErrors, size_t numLevels, float distance, float pixelsPerUnit, float maxPixelError ) {
+    if ( distance <= 0.0f ) {
+        return 0;
+    }
+
+    float maxError = maxPixelError * distance / pixelsPerUnit;
+
+    int level = 0;
+    while ( static_cast<size_t>(level) < numLevels && levelErrors[level] <= maxError ) {
+        level++;
+    }
+    return level;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "pch.h"
+
+/** Quadric error metric simplifier working directly on indexed ExVertexStruct meshes.
+    Only collapses edges onto existing vertices, so attributes are never interpolated. Vertices on
+    borders, texture seams and non-manifold edges are never moved, which keeps them intact. */
+class MeshSimplifier {
+public:
+    /** One simplified version of a mesh */
+    struct LodLevel {
+        std::vector<ExVertexStruct> Vertices;
+        std::vector<VERTEX_INDEX> Indices;
+
+        /** Geometric error in the units of the positions */
+        float Error;
+    };
+
+    /** Simplifies the given triangle list down to about targetIndexCount indices. Stops early when a collapse
+        would introduce more than maxError (in the units of the positions). Returns the error of the result. */
+    static float Simplify( const std::vector<ExVertexStruct>& vertices, const std::vector<VERTEX_INDEX>& indices, size_t targetIndexCount, float maxError,
+        std::vector<ExVertexStruct>& outVertices, std::vector<VERTEX_INDEX>& outIndices );
+
+    /** Builds up to maxLevels levels, each with about half the triangles of the one before. Stops once
+        a level doesn't save enough triangles to be worth it. */
+    static void BuildLodChain( const std::vector<ExVertexStruct>& vertices, const std::vector<VERTEX_INDEX>& indices, int maxLevels, std::vector<LodLevel>& outLevels );
+
+    /** Selects the coarsest level whose error is at most maxPixelError on screen. Returns 0 for the
+        full mesh and i for levelErrors[i - 1]. pixelsPerUnit is the size of one unit at a distance of 1. */
+    static int SelectLod( const float* levelErrors, size_t numLevels, float distance, float pixelsPerUnit, float maxPixelError );
+};
@@ -0,0 +1,206 @@
+#include "pch.h"
+#include "MeshletBuilder.h"
+
+namespace {
+    /** Spreads the lower 10 bits of v so there are two zero bits between each of them */
+    inline uint32_t SpreadBits10( uint32_t v ) {
+        v &= 0x3FF;
+        v = (v | (v << 16)) & 0x030000FF;
+        v = (v | (v << 8)) & 0x0300F00F;
+        v = (v | (v << 4)) & 0x030C30C3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    }
+
+    /** Cone cutoff that no viewer can reach, used if the normals spread too far */
+    const float MESHLET_NO_CONE = 2.0f;
+
+    /** Normals must stay within about 84 degrees of the axis to get a usable cone */
+    const float MESHLET_MIN_CONE_DOT = 0.1f;
+
+    void ComputeMeshletBounds( const std::vector<ExVertexStruct>& vertices, const std::vector<VERTEX_INDEX>& indices, Meshlet& meshlet ) {
+        XMVECTOR bbMin = XMVectorReplicate( FLT_MAX );
+        XMVECTOR bbMax = XMVectorReplicate( -FLT_MAX );
+        for ( unsigned int i = meshlet.FirstIndex; i < meshlet.FirstIndex + meshlet.NumIndices; i++ ) {
+            XMVECTOR p = XMLoadFloat3( vertices[indices[i]].Position.toXMFLOAT3() );
+            bbMin = XMVectorMin( bbMin, p );
+            bbMax = XMVectorMax( bbMax, p );
+        }
+        XMStoreFloat3( &meshlet.BoundingBox.Min, bbMin );
+        XMStoreFloat3( &meshlet.BoundingBox.Max, bbMax );
+
+        // Sphere around the box center, but only as large as the vertices need
+        XMVECTOR center = (bbMin + bbMax) * 0.5f;
+        float radiusSq = 0.0f;
+        for ( unsigned int i = meshlet.FirstIndex; i < meshlet.FirstIndex + meshlet.NumIndices; i++ ) {
+            XMVECTOR p = XMLoadFloat3( vertices[indices[i]].Position.toXMFLOAT3() );
+            radiusSq = std::max( radiusSq, XMVectorGetX( XMVector3LengthSq( p - center ) ) );
+        }
+        XMStoreFloat3( &meshlet.SphereCenter, center );
+        meshlet.SphereRadius = sqrtf( radiusSq );
+
+        // Normal cone: average direction and the widest angle any face has to it
+        std::vector<XMFLOAT3> normals;
+        normals.reserve( meshlet.NumIndices / 3 );
+        XMVECTOR axis = XMVectorZero();
+        for ( unsigned int i = meshlet.FirstIndex; i + 2 < meshlet.FirstIndex + meshlet.NumIndices; i += 3 ) {
+            XMVECTOR p0 = XMLoadFloat3( vertices[indices[i]].Position.toXMFLOAT3() );
+            XMVECTOR p1 = XMLoadFloat3( vertices[indices[i + 1]].Position.toXMFLOAT3() );
+            XMVECTOR p2 = XMLoadFloat3( vertices[indices[i + 2]].Position.toXMFLOAT3() );
+            XMVECTOR n = XMVector3Cross( p1 - p0, p2 - p0 );
+
+            float lenSq = XMVectorGetX( XMVector3LengthSq( n ) );
+            if ( lenSq <= 0.0f ) {
+                // Degenerate triangles can't be seen from either side
+                continue;
+            }
+
+            n = n / sqrtf( lenSq );
+            axis += n;
+
+            XMFLOAT3 stored;
+            XMStoreFloat3( &stored, n );
+            normals.push_back( stored );
+        }
+
+        meshlet.ConeApex = meshlet.SphereCenter;
+        meshlet.ConeAxis = XMFLOAT3( 0, 0, 0 );
+        meshlet.ConeCutoff = MESHLET_NO_CONE;
+
+        float axisLength = XMVectorGetX( XMVector3Length( axis ) );
+        if ( normals.empty() || axisLength <= 0.0f ) {
+            return;
+        }
+        axis = axis / axisLength;
+
+        float minDot = 1.0f;
+        for ( const XMFLOAT3& n : normals ) {
+            minDot = std::min( minDot, XMVectorGetX( XMVector3Dot( axis, XMLoadFloat3( &n ) ) ) );
+        }
+
+        if ( minDot <= MESHLET_MIN_CONE_DOT ) {
+            return;
+        }
+
+        // Move the apex behind every triangle plane, so the test stays conservative for viewers close to the meshlet
+        float maxT = 0.0f;
+        size_t t = 0;
+        for ( unsigned int i = meshlet.FirstIndex; i + 2 < meshlet.FirstIndex + meshlet.NumIndices && t < normals.size(); i += 3 ) {
+            XMVECTOR p0 = XMLoadFloat3( vertices[indices[i]].Position.toXMFLOAT3() );
+            XMVECTOR p1 = XMLoadFloat3( vertices[indices[i + 1]].Position.toXMFLOAT3() );
+            XMVECTOR p2 = XMLoadFloat3( vertices[indices[i + 2]].Position.toXMFLOAT3() );
+            if ( XMVectorGetX( XMVector3LengthSq( XMVector3Cross( p1 - p0, p2 - p0 ) ) ) <= 0.0f ) {
+                continue;
+            }
+
+            XMVECTOR n = XMLoadFloat3( &normals[t++] );
+            float dc = XMVectorGetX( XMVector3Dot( center - p0, n ) );
+            float dn = XMVectorGetX( XMVector3Dot( axis, n ) );
+            maxT = std::max( maxT, dc / dn );
+        }
+
+        XMStoreFloat3( &meshlet.ConeApex, center - axis * maxT );
+        XMStoreFloat3( &meshlet.ConeAxis, axis );
+        meshlet.ConeCutoff = sqrtf( 1.0f - minDot * minDot );
+    }
+}
+
+/** Reorders the triangles so that neighbouring triangles follow each other */
+void MeshletBuilder::SortTrianglesSpatially( const std::vector<ExVertexStruct>& vertices, std::vector<VERTEX_INDEX>& indices ) {
+    const size_t numTriangles = indices.size() / 3;
+    if ( numTriangles <= MESHLET_MAX_TRIANGLES ) {
+        return; // Ends up as a single meshlet anyway
+    }
+
+    XMVECTOR bbMin = XMVectorReplicate( FLT_MAX );
+    XMVECTOR bbMax = XMVectorReplicate( -FLT_MAX );
+    for ( const ExVertexStruct& v : vertices ) {
+        XMVECTOR p = XMLoadFloat3( v.Position.toXMFLOAT3() );
+        bbMin = XMVectorMin( bbMin, p );
+        bbMax = XMVectorMax( bbMax, p );
+    }
+
+    // Map the centers onto a 1024^3 grid inside the bounding box
+    XMVECTOR extent = XMVectorMax( bbMax - bbMin, XMVectorReplicate( 1e-6f ) );
+    XMVECTOR scale = XMVectorReplicate( 1023.0f ) / extent;
+
+    std::vector<std::pair<uint32_t, uint32_t>> keys( numTriangles );
+    for ( size_t t = 0; t < numTriangles; t++ ) {
+        XMVECTOR p0 = XMLoadFloat3( vertices[indices[t * 3]].Position.toXMFLOAT3() );
+        XMVECTOR p1 = XMLoadFloat3( vertices[indices[t * 3 + 1]].Position.toXMFLOAT3() );
+        XMVECTOR p2 = XMLoadFloat3( vertices[indices[t * 3 + 2]].Position.toXMFLOAT3() );
+        XMVECTOR cell = ((p0 + p1 + p2) * (1.0f / 3.0f) - bbMin) * scale;
+
+        XMFLOAT3 c;
+        XMStoreFloat3( &c, XMVectorClamp( cell, XMVectorZero(), XMVectorReplicate( 1023.0f ) ) );
+        uint32_t morton = SpreadBits10( static_cast<uint32_t>(c.x) )
+            | (SpreadBits10( static_cast<uint32_t>(c.y) ) << 1)
+            | (SpreadBits10( static_cast<uint32_t>(c.z) ) << 2);
+
+        keys[t] = std::make_pair( morton, static_cast<uint32_t>(t) );
+    }
+
+    // The triangle index breaks ties, so the order is the same on every run
+    std::sort( keys.begin(), keys.end() );
+
+    std::vector<VERTEX_INDEX> sorted( numTriangles * 3 );
+    for ( size_t t = 0; t < numTriangles; t++ ) {
+        const VERTEX_INDEX* src = &indices[keys[t].second * 3];
+        sorted[t * 3] = src[0];
+        sorted[t * 3 + 1] = src[1];
+        sorted[t * 3 + 2] = src[2];
+    }
+
+    std::copy( sorted.begin(), sorted.end(), indices.begin() );
+}
+
+/** Index ranges of the meshlets BuildMeshlets splits the given number of triangles into */
+void MeshletBuilder::GetMeshletRanges( unsigned int numTriangles, std::vector<MeshletRange>& outRanges ) {
+    outRanges.clear();
+    if ( numTriangles == 0 ) {
+        return;
+    }
+
+    // Split evenly, so there is no tiny meshlet left at the end
+    const unsigned int numMeshlets = (numTriangles + MESHLET_MAX_TRIANGLES - 1) / MESHLET_MAX_TRIANGLES;
+    const unsigned int baseSize = numTriangles / numMeshlets;
+    const unsigned int numLarger = numTriangles % numMeshlets;
+
+    outRanges.resize( numMeshlets );
+    unsigned int firstTriangle = 0;
+    for ( unsigned int m = 0; m < numMeshlets; m++ ) {
+        unsigned int size = baseSize + (m < numLarger ? 1 : 0);
+        outRanges[m] = { firstTriangle * 3, size * 3 };
+        firstTriangle += size;
+    }
+}
+
+/** Splits the triangle list into meshlets of consecutive triangles and computes their culling data */
+void MeshletBuilder::BuildMeshlets( const std::vector<ExVertexStruct>& vertices, const std::vector<VERTEX_INDEX>& indices, std::vector<Meshlet>& outMeshlets ) {
+    std::vector<MeshletRange> ranges;
+    GetMeshletRanges( static_cast<unsigned int>(indices.size() / 3), ranges );
+
+    outMeshlets.clear();
+    outMeshlets.resize( ranges.size() );
+    for ( size_t m = 0; m < ranges.size(); m++ ) {
+        Meshlet& meshlet = outMeshlets[m];
+        meshlet.FirstIndex = ranges[m].FirstIndex;
+        meshlet.NumIndices = ranges[m].NumIndices;
+        ComputeMeshletBounds( vertices, indices, meshlet );
+    }
+}
+
+/** Returns true if every triangle of the meshlet faces away from the given position */
+bool MeshletBuilder::IsBackfacing( const Meshlet& meshlet, const XMFLOAT3& viewer ) {
+    if ( meshlet.ConeCutoff > 1.0f ) {
+        return false;
+    }
+
+    XMVECTOR toApex = XMLoadFloat3( &meshlet.ConeApex ) - XMLoadFloat3( &viewer );
+    float lenSq = XMVectorGetX( XMVector3LengthSq( toApex ) );
+    if ( lenSq <= 0.0f ) {
+        return false;
+    }
+
+    return XMVectorGetX( XMVector3Dot( toApex, XMLoadFloat3( &meshlet.ConeAxis ) ) ) >= meshlet.ConeCutoff * sqrtf( lenSq );
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "pch.h"
+#include "WorldObjects.h"
+
+/** Most triangles a single meshlet can hold. Meshes are split evenly, so meshlets have between half and all of this. */
+const unsigned int MESHLET_MAX_TRIANGLES = 128;
+
+/** Indices to draw, relative to the start of the meshes indices */
+struct MeshletRange {
+    unsigned int FirstIndex;
+    unsigned int NumIndices;
+};
+
+/** Splits world meshes into meshlets, so parts of a section can be culled without touching the rest */
+class MeshletBuilder {
+public:
+    /** Reorders the triangles so that neighbouring triangles follow each other (Morton order of their centers).
+        Needs to run before BuildMeshlets and before the indices get wrapped into the world index buffer.
+        Reordering triangles within the ranges of GetMeshletRanges afterwards keeps the meshlets the same. */
+    static void SortTrianglesSpatially( const std::vector<ExVertexStruct>& vertices, std::vector<VERTEX_INDEX>& indices );
+
+    /** Index ranges of the meshlets BuildMeshlets splits the given number of triangles into */
+    static void GetMeshletRanges( unsigned int numTriangles, std::vector<MeshletRange>& outRanges );
+
+    /** Splits the triangle list into meshlets of consecutive triangles and computes their culling data.
+        Only depends on the order of the indices, so it gives the same meshlets for a mesh loaded from the cache. */
+    static void BuildMeshlets( const std::vector<ExVertexStruct>& vertices, const std::vector<VERTEX_INDEX>& indices, std::vector<Meshlet>& outMeshlets );
+
+    /** Returns true if every triangle of the meshlet faces away from the given position */
+    static bool IsBackfacing( const Meshlet& meshlet, const XMFLOAT3& viewer );
+
+    /** Appends the index ranges of the meshlets passing boxVisible( const zTBBox3D& ) and, if cullBackfaces is set,
+        the cone test. Neighbouring survivors are merged into one range. Only use cullBackfaces when the
+        mesh is drawn with backface culling. */
+    template<typename F>
+    static void CullMeshlets( const std::vector<Meshlet>& meshlets, const XMFLOAT3& viewer, bool cullBackfaces, F&& boxVisible, std::vector<MeshletRange>& outRanges ) {
+        bool extendLast = false;
+        for ( const Meshlet& meshlet : meshlets ) {
+            if ( (cullBackfaces && IsBackfacing( meshlet, viewer )) || !boxVisible( meshlet.BoundingBox ) ) {
+                extendLast = false;
+                continue;
+            }
+
+            if ( extendLast ) {
+                outRanges.back().NumIndices += meshlet.NumIndices;
+            } else {
+                outRanges.push_back( { meshlet.FirstIndex, meshlet.NumIndices } );
+                extendLast = true;
+            }
+        }
+    }
+};
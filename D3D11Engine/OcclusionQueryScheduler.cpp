@@ -0,0 +1,250 @@
+#include "OcclusionQueryScheduler.h"
+#include <cmath>
+#include <cstddef>
+
+namespace {
+    /** Chance that a node which was invisible for the given number of queries in a row still is, as estimated by CHC++ */
+    float GetStayInvisibleProbability( unsigned int invisibleQueries ) {
+        return 0.99f - 0.7f * expf( -static_cast<float>(invisibleQueries) );
+    }
+}
+
+OcclusionQueryScheduler::OcclusionQueryScheduler() {
+    FrameID = 0;
+    RandomState = 0x9E3779B9;
+    Stats = {};
+}
+
+/** Replaces the tree, node 0 is the root */
+void OcclusionQueryScheduler::SetTree( const std::vector<TreeNode>& nodes ) {
+    Nodes = nodes;
+
+    // Everything starts out of sight, so it gets marked visible once it gets into the frustum
+    NodeState initial = {};
+    initial.WasOutside = true;
+    States.assign( Nodes.size(), initial );
+
+    Pending.clear();
+    PendingNodes.clear();
+}
+
+/** Frames until a visible leaf gets queried again */
+unsigned int OcclusionQueryScheduler::GetRandomRecheckDelay() {
+    // xorshift, it only needs to spread the queries
+    RandomState ^= RandomState << 13;
+    RandomState ^= RandomState >> 17;
+    RandomState ^= RandomState << 5;
+    return VISIBLE_RECHECK_FRAMES + RandomState % (VISIBLE_RECHECK_RANDOM_FRAMES + 1);
+}
+
+/** Collects finished queries, walks the tree and issues the queries for this frame */
+void OcclusionQueryScheduler::Update( BaseOcclusionQueryBackend& backend ) {
+    FrameID++;
+    Stats = {};
+
+    if ( Nodes.empty() )
+        return;
+
+    CollectResults( backend );
+
+    VisibleLeafQueue.clear();
+    InvisibleQueue.clear();
+    StableInvisibleQueue.clear();
+    Traverse( 0, backend );
+
+    // Issue everything at once, so the backend can keep its states for all of them
+    for ( unsigned int node : VisibleLeafQueue ) {
+        IssueQuery( backend, &node, 1 );
+        Stats.VisibleLeafQueries++;
+    }
+
+    for ( unsigned int node : InvisibleQueue ) {
+        IssueQuery( backend, &node, 1 );
+    }
+
+    IssueMultiQueries( backend );
+}
+
+/** Picks up the results of all finished queries */
+void OcclusionQueryScheduler::CollectResults( BaseOcclusionQueryBackend& backend ) {
+    size_t numKept = 0;
+    size_t numKeptNodes = 0;
+    for ( size_t i = 0; i < Pending.size(); i++ ) {
+        const PendingQuery& query = Pending[i];
+
+        bool visible;
+        if ( !backend.GetQueryResult( query.Query, visible ) ) {
+            // Keep it for the next frame, its nodes move to the front like the query
+            Stats.ResultsPending++;
+            for ( unsigned int n = 0; n < query.NumNodes; n++ ) {
+                PendingNodes[numKeptNodes + n] = PendingNodes[query.FirstNode + n];
+            }
+
+            Pending[numKept++] = { query.Query, static_cast<unsigned int>(numKeptNodes), query.NumNodes };
+            numKeptNodes += query.NumNodes;
+            continue;
+        }
+
+        backend.ReleaseQuery( query.Query );
+
+        const bool multiQuery = query.NumNodes > 1;
+        if ( multiQuery && visible ) {
+            Stats.MultiQueryFailures++;
+        }
+
+        for ( unsigned int n = 0; n < query.NumNodes; n++ ) {
+            const unsigned int node = PendingNodes[query.FirstNode + n];
+            NodeState& state = States[node];
+            state.QueryPending = false;
+
+            if ( !visible ) {
+                state.Visible = false;
+                state.InvisibleQueries++;
+                continue;
+            }
+
+            // Nodes coming back into sight get everything below them drawn until their own queries are back.
+            // A failed multi-query can't tell which of its nodes are visible, so that applies to all of them.
+            if ( !state.Visible ) {
+                MarkSubtreeVisible( node );
+            }
+
+            // Nodes of a failed multi-query get their own queries right away to find the visible ones
+            state.InvisibleQueries = 0;
+            state.NextQueryFrame = multiQuery ? FrameID : FrameID + GetRandomRecheckDelay();
+            PullUpVisibility( node );
+        }
+    }
+
+    Pending.resize( numKept );
+    PendingNodes.resize( numKeptNodes );
+}
+
+/** Takes the node and everything below it as visible */
+void OcclusionQueryScheduler::MarkSubtreeVisible( unsigned int node ) {
+    if ( node == NO_NODE )
+        return;
+
+    NodeState& state = States[node];
+    state.Visible = true;
+    state.WasOutside = false;
+    state.InvisibleQueries = 0;
+    state.NextQueryFrame = FrameID; // Check right away whether that was too much
+
+    MarkSubtreeVisible( Nodes[node].Front );
+    MarkSubtreeVisible( Nodes[node].Back );
+}
+
+/** Marks the node and all of its parents visible */
+void OcclusionQueryScheduler::PullUpVisibility( unsigned int node ) {
+    // Parents which aren't visible anymore may still have visible flags further up, so this goes all the way
+    while ( node != NO_NODE ) {
+        States[node].Visible = true;
+        States[node].InvisibleQueries = 0;
+        node = Nodes[node].Parent;
+    }
+}
+
+/** Walks the subtree and sorts the nodes which need a query into the queues */
+bool OcclusionQueryScheduler::Traverse( unsigned int node, BaseOcclusionQueryBackend& backend ) {
+    if ( node == NO_NODE )
+        return false;
+
+    const TreeNode& treeNode = Nodes[node];
+    NodeState& state = States[node];
+
+    const EOcclusionNodeState nodeState = backend.GetNodeState( node );
+    if ( nodeState == OCCLUSION_NODE_OUTSIDE ) {
+        state.WasOutside = true;
+        return false;
+    }
+
+    // Nodes getting into the frustum are drawn right away, so there is no popping when the camera turns
+    if ( state.WasOutside ) {
+        MarkSubtreeVisible( node );
+    }
+
+    if ( nodeState == OCCLUSION_NODE_ALWAYS_VISIBLE ) {
+        state.Visible = true;
+        state.InvisibleQueries = 0;
+        Traverse( treeNode.Front, backend );
+        Traverse( treeNode.Back, backend );
+
+        Stats.VisibleNodes++;
+        return true;
+    }
+
+    if ( !state.Visible ) {
+        // Its subtree is hidden, only the node itself gets queried
+        if ( !state.QueryPending ) {
+            if ( state.InvisibleQueries >= STABLE_INVISIBLE_QUERIES )
+                StableInvisibleQueue.push_back( node );
+            else
+                InvisibleQueue.push_back( node );
+        }
+        return false;
+    }
+
+    if ( treeNode.Leaf ) {
+        if ( !state.QueryPending && FrameID >= state.NextQueryFrame ) {
+            VisibleLeafQueue.push_back( node );
+        }
+
+        Stats.VisibleNodes++;
+        return true;
+    }
+
+    // Interior nodes are visible through their children
+    const bool frontVisible = Traverse( treeNode.Front, backend );
+    const bool backVisible = Traverse( treeNode.Back, backend );
+    state.Visible = frontVisible || backVisible;
+    state.InvisibleQueries = 0;
+
+    Stats.VisibleNodes += state.Visible ? 1 : 0;
+    return state.Visible;
+}
+
+/** Groups the stable invisible nodes into multi-queries */
+void OcclusionQueryScheduler::IssueMultiQueries( BaseOcclusionQueryBackend& backend ) {
+    // The queue is in traversal order, so nodes next to each other are close by and likely to turn visible together.
+    // A group grows as long as that raises the number of nodes per query it is expected to cost, counting the
+    // queries all of its nodes need on their own if any of them turns out visible.
+    size_t first = 0;
+    while ( first < StableInvisibleQueue.size() ) {
+        float stayInvisible = 1.0f;
+        float bestValue = 0.0f;
+        size_t count = 0;
+        while ( first + count < StableInvisibleQueue.size() && count < MAX_MULTI_QUERY_NODES ) {
+            const unsigned int node = StableInvisibleQueue[first + count];
+            const float groupStayInvisible = stayInvisible * GetStayInvisibleProbability( States[node].InvisibleQueries );
+            const float groupSize = static_cast<float>(count + 1);
+            const float value = groupSize / (1.0f + (1.0f - groupStayInvisible) * groupSize);
+            if ( count > 0 && value <= bestValue )
+                break;
+
+            stayInvisible = groupStayInvisible;
+            bestValue = value;
+            count++;
+        }
+
+        IssueQuery( backend, &StableInvisibleQueue[first], static_cast<unsigned int>(count) );
+        if ( count > 1 ) {
+            Stats.MultiQueries++;
+            Stats.MultiQueryNodes += static_cast<unsigned int>(count);
+        }
+
+        first += count;
+    }
+}
+
+void OcclusionQueryScheduler::IssueQuery( BaseOcclusionQueryBackend& backend, const unsigned int* nodes, unsigned int numNodes ) {
+    const unsigned int query = backend.IssueQuery( nodes, numNodes );
+    Pending.push_back( { query, static_cast<unsigned int>(PendingNodes.size()), numNodes } );
+
+    for ( unsigned int i = 0; i < numNodes; i++ ) {
+        PendingNodes.push_back( nodes[i] );
+        States[nodes[i]].QueryPending = true;
+    }
+
+    Stats.Queries++;
+}
@@ -0,0 +1,150 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+/** How a node relates to the camera in the current frame */
+enum EOcclusionNodeState {
+    /** Outside of the view frustum, neither it nor its children need a query */
+    OCCLUSION_NODE_OUTSIDE,
+
+    /** Has to be taken as visible without a query, like a node the camera is in */
+    OCCLUSION_NODE_ALWAYS_VISIBLE,
+
+    /** In the view frustum, a query decides */
+    OCCLUSION_NODE_TESTABLE,
+};
+
+/** Everything OcclusionQueryScheduler needs from the renderer. Queries are asynchronous, their results
+    are picked up in one of the following frames. */
+class BaseOcclusionQueryBackend {
+public:
+    virtual ~BaseOcclusionQueryBackend() {}
+
+    /** Classifies the node for the current frame */
+    virtual EOcclusionNodeState GetNodeState( unsigned int node ) = 0;
+
+    /** Starts one query drawing the boxes of all given nodes and returns its handle */
+    virtual unsigned int IssueQuery( const unsigned int* nodes, unsigned int numNodes ) = 0;
+
+    /** Returns true and whether any sample passed if the result of the query is there. Doesn't wait for it. */
+    virtual bool GetQueryResult( unsigned int query, bool& outVisible ) = 0;
+
+    /** The handle isn't used anymore after this and can be given out again */
+    virtual void ReleaseQuery( unsigned int query ) = 0;
+};
+
+/** Counters of the last Update */
+struct OcclusionQueryStats {
+    unsigned int Queries;
+    unsigned int VisibleLeafQueries;
+    unsigned int MultiQueries;
+    unsigned int MultiQueryNodes;
+    unsigned int MultiQueryFailures;
+
+    /** Queries polled whose result wasn't there yet. Each one would have been a stall if waited for. */
+    unsigned int ResultsPending;
+
+    unsigned int VisibleNodes;
+};
+
+/** Decides which nodes of a tree get occlusion queries, after coherent hierarchical culling (CHC++):
+    - Visible interior nodes are never queried, they are visible as long as any of their children is.
+    - Visible leaves are assumed to stay visible for a randomized number of frames before they are queried
+      again, which spreads the queries over the frames instead of bunching them up.
+    - Invisible nodes are queried every frame. Ones that stayed invisible for a while are likely to stay so
+      and get grouped into a single query drawing all of their boxes. Only if that finds anything visible,
+      all of them are taken as visible and get queried on their own again.
+    Results are used as soon as they arrive without waiting, until then the last known visibility applies.
+    All queries of a frame are issued together after the traversal. */
+class OcclusionQueryScheduler {
+public:
+    static const unsigned int NO_NODE = 0xFFFFFFFF;
+
+    /** Frames a visible leaf goes without a query at least, and how many may be added at random */
+    static const unsigned int VISIBLE_RECHECK_FRAMES = 4;
+    static const unsigned int VISIBLE_RECHECK_RANDOM_FRAMES = 8;
+
+    /** Queries in a row a node has to be invisible in to be grouped with others */
+    static const unsigned int STABLE_INVISIBLE_QUERIES = 3;
+
+    /** Most nodes drawn by one multi-query */
+    static const unsigned int MAX_MULTI_QUERY_NODES = 32;
+
+    struct TreeNode {
+        unsigned int Parent;
+        unsigned int Front;
+        unsigned int Back;
+        bool Leaf;
+    };
+
+    OcclusionQueryScheduler();
+
+    /** Replaces the tree, node 0 is the root. Everything in flight is dropped without releasing
+        its query, so the backend has to start over with its queries as well. */
+    void SetTree( const std::vector<TreeNode>& nodes );
+
+    unsigned int GetNumNodes() const { return static_cast<unsigned int>(Nodes.size()); }
+
+    /** Collects finished queries, walks the tree and issues the queries for this frame */
+    void Update( BaseOcclusionQueryBackend& backend );
+
+    /** Whether the node is taken as visible. Nodes below an invisible one aren't updated. */
+    bool IsNodeVisible( unsigned int node ) const { return States[node].Visible; }
+
+    const OcclusionQueryStats& GetStats() const { return Stats; }
+
+private:
+    struct NodeState {
+        /** Frame a visible leaf gets its next query in */
+        unsigned int NextQueryFrame;
+
+        /** Number of queries in a row that found the node invisible */
+        unsigned int InvisibleQueries;
+
+        bool Visible;
+        bool WasOutside;
+        bool QueryPending;
+    };
+
+    struct PendingQuery {
+        unsigned int Query;
+        unsigned int FirstNode;
+        unsigned int NumNodes;
+    };
+
+    /** Picks up the results of all finished queries */
+    void CollectResults( BaseOcclusionQueryBackend& backend );
+
+    /** Takes the node and everything below it as visible, like something that was out of sight for a while */
+    void MarkSubtreeVisible( unsigned int node );
+
+    /** Marks the node and all of its parents visible */
+    void PullUpVisibility( unsigned int node );
+
+    /** Walks the subtree and sorts the nodes which need a query into the queues. Returns whether anything in it is visible. */
+    bool Traverse( unsigned int node, BaseOcclusionQueryBackend& backend );
+
+    /** Groups the stable invisible nodes into multi-queries */
+    void IssueMultiQueries( BaseOcclusionQueryBackend& backend );
+
+    void IssueQuery( BaseOcclusionQueryBackend& backend, const unsigned int* nodes, unsigned int numNodes );
+
+    /** Frames until a visible leaf gets queried again */
+    unsigned int GetRandomRecheckDelay();
+
+    std::vector<TreeNode> Nodes;
+    std::vector<NodeState> States;
+
+    /** Queries in flight and the nodes they draw, back to back in the order of the queries */
+    std::vector<PendingQuery> Pending;
+    std::vector<unsigned int> PendingNodes;
+
+    /** Nodes that need a query, filled during the traversal */
+    std::vector<unsigned int> VisibleLeafQueue;
+    std::vector<unsigned int> InvisibleQueue;
+    std::vector<unsigned int> StableInvisibleQueue;
+
+    unsigned int FrameID;
+    uint32_t RandomState;
+    OcclusionQueryStats Stats;
+};
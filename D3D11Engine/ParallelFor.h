@@ -0,0 +1,53 @@
+#pragma once
+#include "Engine.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+/** Returns how many threads ParallelFor may run on at once, so callers can size per-thread scratch memory */
+inline unsigned int GetParallelForSlots() {
+    return Engine::WorkerThreadPool ? static_cast<unsigned int>(Engine::WorkerThreadPool->getNumThreads()) + 1 : 1;
+}
+
+/** Runs f( index, slot ) for every index below count on the calling thread and the worker threads.
+    slot is below GetParallelForSlots() and no two threads use the same one at once.
+    Returns as soon as all indices are done, without waiting for workers which are still busy with other jobs
+    and never got to help. */
+template<typename F>
+void ParallelFor( size_t count, F&& f ) {
+    struct State {
+        std::atomic<size_t> Next;
+        std::atomic<size_t> Done;
+        std::atomic<unsigned int> Slots;
+    };
+
+    auto state = std::make_shared<State>();
+    state->Next = 0;
+    state->Done = 0;
+    state->Slots = 1;
+
+    // Helpers may only start after this returned, so they must not touch f before they claimed an index
+    auto* func = &f;
+    auto work = [state, func, count]( unsigned int slot ) {
+        for ( size_t i = state->Next++; i < count; i = state->Next++ ) {
+            (*func)( i, slot );
+            state->Done++;
+        }
+    };
+
+    if ( Engine::WorkerThreadPool && count > 1 ) {
+        const size_t numHelpers = std::min( Engine::WorkerThreadPool->getNumThreads(), count - 1 );
+        for ( size_t h = 0; h < numHelpers; h++ ) {
+            Engine::WorkerThreadPool->enqueue( [state, work]() {
+                work( state->Slots++ );
+            } );
+        }
+    }
+
+    work( 0 );
+    while ( state->Done < count ) {
+        std::this_thread::yield();
+    }
+}
@@ -0,0 +1,125 @@
+#include "RenderQueue.h"
+#include <algorithm>
+#include <cstring>
+
+RenderQueue::RenderQueue() {
+    Stats = {};
+}
+
+/** Drops all packets, call before collecting the next frame */
+void RenderQueue::Clear() {
+    Packets.clear();
+    Keys.clear();
+    ShaderIDs.clear();
+    MaterialIDs.clear();
+}
+
+/** Adds a draw and builds its sort key */
+void RenderQueue::Add( const RenderPacket& packet ) {
+    const uint64_t pass = std::min( packet.Pass, MAX_PASSES - 1 );
+    const uint64_t shader = GetHandleID( ShaderIDs, packet.Shader, SHADER_BITS );
+    const uint64_t material = GetHandleID( MaterialIDs, packet.Material, MATERIAL_BITS );
+    const uint64_t depth = QuantizeDepth( packet.Depth );
+
+    const uint64_t key = (pass << (SHADER_BITS + MATERIAL_BITS + DEPTH_BITS))
+        | (shader << (MATERIAL_BITS + DEPTH_BITS))
+        | (material << DEPTH_BITS)
+        | depth;
+
+    Keys.emplace_back( key, static_cast<unsigned int>(Packets.size()) );
+    Packets.push_back( packet );
+}
+
+/** Number for the handle, given out in order of the first Add using it */
+unsigned int RenderQueue::GetHandleID( std::unordered_map<void*, unsigned int>& ids, void* handle, unsigned int numBits ) {
+    const unsigned int maxID = (1u << numBits) - 1;
+    auto it = ids.emplace( handle, std::min( static_cast<unsigned int>(ids.size()), maxID ) );
+    return it.first->second;
+}
+
+/** Keeps the order of positive depths in the top bits of their float representation */
+uint32_t RenderQueue::QuantizeDepth( float depth ) {
+    // Also catches NaN
+    if ( !(depth > 0.0f) )
+        return 0;
+
+    uint32_t bits;
+    memcpy( &bits, &depth, sizeof( bits ) );
+    return bits >> (32 - DEPTH_BITS);
+}
+
+/** Sorts the packets, least significant digit first radix sort of the keys skipping bytes all keys share */
+void RenderQueue::Sort() {
+    const size_t count = Keys.size();
+    if ( count < 2 )
+        return;
+
+    // All 8 histograms in one go
+    unsigned int histograms[8][256] = {};
+    for ( const auto& key : Keys ) {
+        for ( int digit = 0; digit < 8; digit++ ) {
+            histograms[digit][(key.first >> (digit * 8)) & 0xFF]++;
+        }
+    }
+
+    SortScratch.resize( count );
+    for ( int digit = 0; digit < 8; digit++ ) {
+        unsigned int* histogram = histograms[digit];
+        if ( histogram[(Keys[0].first >> (digit * 8)) & 0xFF] == count )
+            continue;
+
+        unsigned int offset = 0;
+        for ( int i = 0; i < 256; i++ ) {
+            const unsigned int n = histogram[i];
+            histogram[i] = offset;
+            offset += n;
+        }
+
+        for ( const auto& key : Keys ) {
+            SortScratch[histogram[(key.first >> (digit * 8)) & 0xFF]++] = key;
+        }
+        Keys.swap( SortScratch );
+    }
+}
+
+/** Sorts the packets and replays them through the backend */
+void RenderQueue::Submit( BaseRenderQueueBackend& backend ) {
+    Stats = {};
+
+    Sort();
+    Replay( backend, 0, GetNumPackets(), Stats );
+}
+
+/** Replays the sorted packets [first, first + count) through the backend */
+void RenderQueue::Replay( BaseRenderQueueBackend& backend, unsigned int first, unsigned int count, RenderQueueStats& stats ) const {
+    stats.Packets += count;
+
+    const RenderPacket* last = nullptr;
+    for ( unsigned int i = first; i < first + count; i++ ) {
+        const RenderPacket& packet = Packets[Keys[i].second];
+
+        if ( !last || packet.Pass != last->Pass ) {
+            backend.BeginPass( packet.Pass );
+            stats.Passes++;
+            last = nullptr;
+        }
+
+        if ( !last || packet.Shader != last->Shader ) {
+            backend.BindShader( packet );
+            stats.ShaderChanges++;
+        }
+
+        if ( !last || packet.Material != last->Material ) {
+            backend.BindMaterial( packet );
+            stats.MaterialChanges++;
+        }
+
+        if ( !last || packet.Geometry != last->Geometry ) {
+            backend.BindGeometry( packet );
+            stats.GeometryChanges++;
+        }
+
+        backend.Draw( packet );
+        last = &packet;
+    }
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/** One draw call for the RenderQueue. The handles only identify the state, what they point to is up to the backend. */
+struct RenderPacket {
+    /** Passes are replayed in ascending order, at most RenderQueue::MAX_PASSES */
+    unsigned int Pass;
+
+    /** Packets with the same handle share that state, nullptr is a state as well */
+    void* Shader;
+    void* Material;
+    void* Geometry;
+
+    /** Whatever else the backend needs to bind the state. Taken from the first packet after a change. */
+    const void* Data;
+
+    /** Distance to the camera, draws with the same pass, shader and material go front to back */
+    float Depth;
+
+    unsigned int NumIndices;
+    unsigned int FirstIndex;
+};
+
+/** Everything RenderQueue needs from the renderer. Only state that changed from the packet before gets bound. */
+class BaseRenderQueueBackend {
+public:
+    virtual ~BaseRenderQueueBackend() {}
+
+    /** Starts a pass. Everything bound before is taken as unknown afterwards. */
+    virtual void BeginPass( unsigned int pass ) = 0;
+
+    virtual void BindShader( const RenderPacket& packet ) = 0;
+    virtual void BindMaterial( const RenderPacket& packet ) = 0;
+    virtual void BindGeometry( const RenderPacket& packet ) = 0;
+
+    virtual void Draw( const RenderPacket& packet ) = 0;
+};
+
+/** Counters of the last Submit */
+struct RenderQueueStats {
+    unsigned int Packets;
+    unsigned int Passes;
+    unsigned int ShaderChanges;
+    unsigned int MaterialChanges;
+    unsigned int GeometryChanges;
+};
+
+/** Collects the draws of a frame, sorts them so draws sharing state follow each other and replays them through
+    a backend. Sort keys are 64 bits: pass, shader, material and depth, from the highest bits down.
+    Shaders and materials get small numbers in the order they are first added, handles past the last number
+    share it. That only makes the order worse, the backend still gets called for every change. */
+class RenderQueue {
+public:
+    static const unsigned int PASS_BITS = 4;
+    static const unsigned int SHADER_BITS = 12;
+    static const unsigned int MATERIAL_BITS = 24;
+    static const unsigned int DEPTH_BITS = 24;
+    static const unsigned int MAX_PASSES = 1 << PASS_BITS;
+
+    RenderQueue();
+
+    /** Drops all packets, call before collecting the next frame */
+    void Clear();
+
+    /** Adds a draw and builds its sort key */
+    void Add( const RenderPacket& packet );
+
+    unsigned int GetNumPackets() const { return static_cast<unsigned int>(Packets.size()); }
+
+    /** Sorts the packets and replays them through the backend. They are kept until Clear, so this can run again. */
+    void Submit( BaseRenderQueueBackend& backend );
+
+    /** Sorts the packets, for Replay */
+    void Sort();
+
+    /** Replays the sorted packets [first, first + count) through the backend, starting without any state bound.
+        Only reads the queue, so several ranges can be replayed on different threads. Adds to the stats. */
+    void Replay( BaseRenderQueueBackend& backend, unsigned int first, unsigned int count, RenderQueueStats& stats ) const;
+
+    const RenderQueueStats& GetStats() const { return Stats; }
+
+private:
+    /** Number for the handle, given out in order of the first Add using it */
+    static unsigned int GetHandleID( std::unordered_map<void*, unsigned int>& ids, void* handle, unsigned int numBits );
+
+    /** Keeps the order of positive depths in the top bits of their float representation */
+    static uint32_t QuantizeDepth( float depth );
+
+    std::vector<RenderPacket> Packets;
+
+    /** Sort key and packet index */
+    std::vector<std::pair<uint64_t, unsigned int>> Keys;
+    std::vector<std::pair<uint64_t, unsigned int>> SortScratch;
+
+    std::unordered_map<void*, unsigned int> ShaderIDs;
+    std::unordered_map<void*, unsigned int> MaterialIDs;
+
+    RenderQueueStats Stats;
+};
+
+/** Backend that only writes down what it was asked to do, to count and compare state changes without a device */
+class RecordingRenderQueueBackend : public BaseRenderQueueBackend {
+public:
+    enum ECommand {
+        CMD_BEGIN_PASS,
+        CMD_BIND_SHADER,
+        CMD_BIND_MATERIAL,
+        CMD_BIND_GEOMETRY,
+        CMD_DRAW,
+    };
+
+    struct Command {
+        ECommand Type;
+
+        unsigned int Pass;
+
+        /** The packet that caused the command, none for CMD_BEGIN_PASS. Points into the queue until it is cleared. */
+        const RenderPacket* Packet;
+    };
+
+    void Clear() { Commands.clear(); }
+    const std::vector<Command>& GetCommands() const { return Commands; }
+
+    void BeginPass( unsigned int pass ) override { Commands.push_back( { CMD_BEGIN_PASS, pass, nullptr } ); }
+    void BindShader( const RenderPacket& packet ) override { Commands.push_back( { CMD_BIND_SHADER, packet.Pass, &packet } ); }
+    void BindMaterial( const RenderPacket& packet ) override { Commands.push_back( { CMD_BIND_MATERIAL, packet.Pass, &packet } ); }
+    void BindGeometry( const RenderPacket& packet ) override { Commands.push_back( { CMD_BIND_GEOMETRY, packet.Pass, &packet } ); }
+    void Draw( const RenderPacket& packet ) override { Commands.push_back( { CMD_DRAW, packet.Pass, &packet } ); }
+
+private:
+    std::vector<Command> Commands;
+};
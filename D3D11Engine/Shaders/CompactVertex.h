@@ -0,0 +1,43 @@
+//--------------------------------------------------------------------------------------
+// Reading ExVertexStructCompact, see WorldConverter::EncodeCompactVertices
+//--------------------------------------------------------------------------------------
+
+cbuffer CompactVertexQuantization : register( b2 )
+{
+	float3 CV_Offset;
+	float CV_Scale;
+};
+
+struct VS_INPUT_COMPACT
+{
+	uint2 vPosition		: POSITION;
+	float2 vNormal		: NORMAL;
+	float2 vTex1		: TEXCOORD0;
+	float2 vTex2		: TEXCOORD1;
+	float4 vDiffuse		: DIFFUSE;
+};
+
+// Cell of the world grid, 21 bits per axis
+float3 DecodeCompactPosition( uint2 p )
+{
+	uint3 cell = uint3( p.x & 0x1FFFFF, ((p.x >> 21) | (p.y << 11)) & 0x1FFFFF, p.y >> 10 );
+	return CV_Offset + (float3)cell * CV_Scale;
+}
+
+float3 DecodeOctahedral( float2 e )
+{
+	float3 n = float3( e, 1 - abs( e.x ) - abs( e.y ) );
+
+	// Unfold the lower hemisphere
+	float t = saturate( -n.z );
+	n.xy += n.xy >= 0 ? -t : t;
+	return normalize( n );
+}
+
+// Fills the members every VS_INPUT of the ExVertexStruct shaders has
+#define DECODE_COMPACT_VERTEX( input, compact ) \
+	input.vPosition = DecodeCompactPosition( compact.vPosition ); \
+	input.vNormal = DecodeOctahedral( compact.vNormal ); \
+	input.vTex1 = compact.vTex1; \
+	input.vTex2 = compact.vTex2; \
+	input.vDiffuse = compact.vDiffuse
@@ -27,6 +27,10 @@ struct VS_INPUT
 	float4 vDiffuse		: DIFFUSE;
 };
 
+#if COMPACT_VERTICES
+#include <CompactVertex.h>
+#endif
+
 struct VS_OUTPUT
 {
 	float2 vTexcoord		: TEXCOORD0;
@@ -40,8 +44,15 @@ struct VS_OUTPUT
 //--------------------------------------------------------------------------------------
 // Vertex Shader
 //--------------------------------------------------------------------------------------
+#if COMPACT_VERTICES
+VS_OUTPUT VSMain( VS_INPUT_COMPACT Compact )
+{
+	VS_INPUT Input;
+	DECODE_COMPACT_VERTEX( Input, Compact );
+#else
 VS_OUTPUT VSMain( VS_INPUT Input )
 {
+#endif
 	VS_OUTPUT Output;
 	
 	//Input.vPosition = float3(-Input.vPosition.x, Input.vPosition.y, -Input.vPosition.z);
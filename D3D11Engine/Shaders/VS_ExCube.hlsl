@@ -27,6 +27,10 @@ struct VS_INPUT
 	float4 vDiffuse		: DIFFUSE;
 };
 
+#if COMPACT_VERTICES
+#include <CompactVertex.h>
+#endif
+
 struct VS_OUTPUT
 {
 	float2 vTexcoord		: TEXCOORD0;
@@ -39,8 +43,15 @@ struct VS_OUTPUT
 //--------------------------------------------------------------------------------------
 // Vertex Shader
 //--------------------------------------------------------------------------------------
+#if COMPACT_VERTICES
+VS_OUTPUT VSMain( VS_INPUT_COMPACT Compact )
+{
+	VS_INPUT Input;
+	DECODE_COMPACT_VERTEX( Input, Compact );
+#else
 VS_OUTPUT VSMain( VS_INPUT Input )
 {
+#endif
 	VS_OUTPUT Output;
 	
 	float3 positionWorld = mul(float4(Input.vPosition,1), M_World).xyz;
@@ -30,11 +30,30 @@ struct VS_INPUT
 	float2 vTex1		: TEXCOORD0;
 	float2 vTex2		: TEXCOORD1;
 	float4 vDiffuse		: DIFFUSE;
+#if INSTANCE_SLOTS
+	uint InstanceSlot : INSTANCE_REMAP_INDEX;
+#else
 	float4x4 InstanceWorldMatrix : INSTANCE_WORLD_MATRIX;
     float4 InstanceColor : INSTANCE_COLOR;
     float2 InstanceWind : INSTANCE_WINDFLUENCE;
+#endif
+};
+
+#if INSTANCE_SLOTS
+// Instance data of all static vobs, which only gets updated where it changed. The vertex stream
+// just holds the slots of the visible ones.
+struct VobInstance
+{
+	float4x4 World;
+	uint Color;
+	float WindStrength;
+	float CanBeAffectedByPlayer;
+	uint GP_Slot;
 };
 
+StructuredBuffer<VobInstance> VobInstances : register( t0 );
+#endif
+
 struct VS_OUTPUT
 {
 	float2 vTexcoord		: TEXCOORD0;
@@ -144,22 +163,34 @@ float3 CalculatePlayerInfluence(
 VS_OUTPUT VSMain( VS_INPUT Input )
 {
     VS_OUTPUT Output;
+
+#if INSTANCE_SLOTS
+	// Unpack like the input layout would have done it
+	VobInstance instance = VobInstances[Input.InstanceSlot];
+	float4x4 instanceWorldMatrix = instance.World;
+	float4 instanceColor = float4( instance.Color & 0xFF, (instance.Color >> 8) & 0xFF, (instance.Color >> 16) & 0xFF, instance.Color >> 24 ) / 255.0f;
+	float2 instanceWind = float2( instance.WindStrength, instance.CanBeAffectedByPlayer );
+#else
+	float4x4 instanceWorldMatrix = Input.InstanceWorldMatrix;
+	float4 instanceColor = Input.InstanceColor;
+	float2 instanceWind = Input.InstanceWind;
+#endif
 			
 	// Base vertex position (local)
     float3 position = Input.vPosition;
 
 #if SHD_INFLUENCE
 	
-    if (Input.InstanceWind.y > 0)
+    if (instanceWind.y > 0)
     {
 		// HERO MOVING BUSHES SHADER
-		position += CalculatePlayerInfluence(playerPos, position, minHeight, maxHeight, Input.InstanceWorldMatrix);
+		position += CalculatePlayerInfluence(playerPos, position, minHeight, maxHeight, instanceWorldMatrix);
     }
 #endif
 	
 #if SHD_WIND
 	
-    if (Input.InstanceWind.x > 0)
+    if (instanceWind.x > 0)
     {
 		// WIND SHADER
         // Protect 0 height
@@ -172,20 +203,20 @@ VS_OUTPUT VSMain( VS_INPUT Input )
             normalize(windDir),
             vertexHeightNorm,
             globalTime,
-            Input.InstanceWorldMatrix,
-            Input.InstanceWind.x
+            instanceWorldMatrix,
+            instanceWind.x
         );
     }
 #endif
 	
     // Common processing for both cases
-    float3 worldPos = mul(float4(position, 1.0), Input.InstanceWorldMatrix).xyz;
+    float3 worldPos = mul(float4(position, 1.0), instanceWorldMatrix).xyz;
 
     Output.vPosition = mul(float4(worldPos, 1.0), M_ViewProj);
     Output.vTexcoord = Input.vTex1;
     Output.vTexcoord2 = Input.vTex2;
-    Output.vDiffuse = Input.InstanceColor;
-    Output.vNormalVS = mul(Input.vNormal, mul((float3x3)Input.InstanceWorldMatrix, (float3x3)M_View));
+    Output.vDiffuse = instanceColor;
+    Output.vNormalVS = mul(Input.vNormal, mul((float3x3)instanceWorldMatrix, (float3x3)M_View));
     Output.vViewPosition = mul(float4(worldPos, 1.0), M_View);
     
     return Output;
@@ -33,6 +33,10 @@ struct VS_INPUT
 	float4 vDiffuse : DIFFUSE;
 };
 
+#if COMPACT_VERTICES
+#include <CompactVertex.h>
+#endif
+
 struct VS_OUTPUT
 {
     float2 vTexcoord : TEXCOORD0;
@@ -47,8 +51,16 @@ struct VS_OUTPUT
 //--------------------------------------------------------------------------------------
 // Vertex Shader
 //--------------------------------------------------------------------------------------
+#if COMPACT_VERTICES
+VS_OUTPUT VSMain( VS_INPUT_COMPACT Compact, uint instanceID : SV_InstanceID )
+{
+	VS_INPUT Input;
+	DECODE_COMPACT_VERTEX( Input, Compact );
+	Input.instanceID = instanceID;
+#else
 VS_OUTPUT VSMain( VS_INPUT Input )
 {
+#endif
 	VS_OUTPUT Output;
 	
     float3 positionWorld = mul(float4(Input.vPosition, 1), M_World).xyz;
@@ -26,6 +26,10 @@ struct VS_INPUT
 	float4 vDiffuse		: DIFFUSE;
 };
 
+#if COMPACT_VERTICES
+#include <CompactVertex.h>
+#endif
+
 struct VS_OUTPUT
 {
 	float2 vTexcoord		: TEXCOORD0;
@@ -113,8 +117,15 @@ Wave wave(float3 pos, float minLength, const float waveSpeed, const float amplit
     return w;
 }
 #endif
+#if COMPACT_VERTICES
+VS_OUTPUT VSMain( VS_INPUT_COMPACT Compact )
+{
+	VS_INPUT Input;
+	DECODE_COMPACT_VERTEX( Input, Compact );
+#else
 VS_OUTPUT VSMain( VS_INPUT Input )
 {
+#endif
 	VS_OUTPUT Output;
 	
 	//Input.vPosition = float3(-Input.vPosition.x, Input.vPosition.y, -Input.vPosition.z);
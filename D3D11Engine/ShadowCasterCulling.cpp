@@ -0,0 +1,100 @@
+#include "pch.h"
+#include "ShadowCasterCulling.h"
+
+ShadowCasterCulling::ShadowCasterCulling() {
+    XMStoreFloat4x4( &LightView, XMMatrixIdentity() );
+    NumCascades = 0;
+    NumCulled = 0;
+}
+
+/** Starts a new frame */
+void ShadowCasterCulling::Begin( const XMMATRIX& lightView, unsigned int numCascades ) {
+    XMStoreFloat4x4( &LightView, lightView );
+    NumCascades = std::min( numCascades, static_cast<unsigned int>(MAX_CSM_CASCADES) );
+    NumCulled = 0;
+
+    for ( unsigned int i = 0; i < MAX_CSM_CASCADES; i++ ) {
+        Casters[i].Clear();
+
+        // Reach nothing until the volume is set
+        Volumes[i].Min = XMFLOAT3( FLT_MAX, FLT_MAX, FLT_MAX );
+        Volumes[i].Max = XMFLOAT3( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+    }
+}
+
+/** Sets the volume of the receivers of a cascade in light space */
+void ShadowCasterCulling::SetCascade( unsigned int cascade, const XMFLOAT3& receiverMin, const XMFLOAT3& receiverMax, float nearZ ) {
+    if ( cascade >= NumCascades )
+        return;
+
+    // Anything between the light and the receivers can shadow them, as long as it isn't clipped
+    Volumes[cascade].Min = XMFLOAT3( receiverMin.x, receiverMin.y, nearZ );
+    Volumes[cascade].Max = receiverMax;
+}
+
+/** Returns a bit for every cascade the given world space box could throw a shadow into */
+uint32_t ShadowCasterCulling::GetCascadeMask( const zTBBox3D& worldBox ) const {
+    const uint32_t allCascades = (1u << NumCascades) - 1;
+    if ( worldBox.Min.x > worldBox.Max.x || worldBox.Min.y > worldBox.Max.y || worldBox.Min.z > worldBox.Max.z )
+        return allCascades; // Unknown extent, can't rule anything out
+
+    // Light space box around the world box, the extents spread over the absolute rotated axes
+    const XMMATRIX view = XMLoadFloat4x4( &LightView );
+    const XMVECTOR min = XMLoadFloat3( &worldBox.Min );
+    const XMVECTOR max = XMLoadFloat3( &worldBox.Max );
+    const XMVECTOR center = XMVector3Transform( (min + max) * 0.5f, view );
+    const XMVECTOR extents = (max - min) * 0.5f;
+    const XMVECTOR lightExtents =
+        XMVectorAbs( view.r[0] ) * XMVectorSplatX( extents ) +
+        XMVectorAbs( view.r[1] ) * XMVectorSplatY( extents ) +
+        XMVectorAbs( view.r[2] ) * XMVectorSplatZ( extents );
+
+    XMFLOAT3 lightMin, lightMax;
+    XMStoreFloat3( &lightMin, center - lightExtents );
+    XMStoreFloat3( &lightMax, center + lightExtents );
+
+    uint32_t mask = 0;
+    for ( unsigned int i = 0; i < NumCascades; i++ ) {
+        const CascadeVolume& v = Volumes[i];
+        const bool overlaps =
+            lightMax.x >= v.Min.x && lightMin.x <= v.Max.x &&
+            lightMax.y >= v.Min.y && lightMin.y <= v.Max.y &&
+            lightMax.z >= v.Min.z && lightMin.z <= v.Max.z;
+        mask |= overlaps ? (1u << i) : 0u;
+    }
+
+    return mask;
+}
+
+bool ShadowCasterCulling::AddSection( const WorldMeshSectionInfo* section, const zTBBox3D& worldBox ) {
+    const uint32_t mask = GetCascadeMask( worldBox );
+    for ( unsigned int i = 0; i < NumCascades; i++ ) {
+        if ( (mask >> i) & 1 )
+            Casters[i].Sections.push_back( section );
+    }
+
+    NumCulled += mask ? 0 : 1;
+    return mask != 0;
+}
+
+bool ShadowCasterCulling::AddVob( VobInfo* vob, const zTBBox3D& worldBox ) {
+    const uint32_t mask = GetCascadeMask( worldBox );
+    for ( unsigned int i = 0; i < NumCascades; i++ ) {
+        if ( (mask >> i) & 1 )
+            Casters[i].Vobs.push_back( vob );
+    }
+
+    NumCulled += mask ? 0 : 1;
+    return mask != 0;
+}
+
+bool ShadowCasterCulling::AddSkeletalVob( SkeletalVobInfo* vob, const zTBBox3D& worldBox ) {
+    const uint32_t mask = GetCascadeMask( worldBox );
+    for ( unsigned int i = 0; i < NumCascades; i++ ) {
+        if ( (mask >> i) & 1 )
+            Casters[i].SkeletalVobs.push_back( vob );
+    }
+
+    NumCulled += mask ? 0 : 1;
+    return mask != 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "pch.h"
+#include "ConstantBufferStructs.h"
+
+struct WorldMeshSectionInfo;
+struct VobInfo;
+struct SkeletalVobInfo;
+
+/** Everything one shadow cascade has to draw */
+struct ShadowCascadeCasters {
+    void Clear() {
+        Sections.clear();
+        Vobs.clear();
+        SkeletalVobs.clear();
+    }
+
+    std::vector<const WorldMeshSectionInfo*> Sections;
+    std::vector<VobInfo*> Vobs;
+    std::vector<SkeletalVobInfo*> SkeletalVobs;
+};
+
+/** Sorts the shadow casters of a frame into the cascades of the sun shadow map. Every caster is brought into
+    light space once, then compared against the receiver volume of all cascades at the same time. A receiver
+    volume is stretched towards the light up to the near plane of its cascade, since anything in between
+    throws its shadow onto it. */
+class ShadowCasterCulling {
+public:
+    ShadowCasterCulling();
+
+    /** Starts a new frame. lightView takes world space to light space (row vectors, z pointing away from the light)
+        and is shared by all cascades, which may only differ by a translation. */
+    void Begin( const XMMATRIX& lightView, unsigned int numCascades );
+
+    /** Sets the volume of the receivers of a cascade in light space, and the near plane casters get clipped at */
+    void SetCascade( unsigned int cascade, const XMFLOAT3& receiverMin, const XMFLOAT3& receiverMax, float nearZ );
+
+    /** Returns a bit for every cascade the given world space box could throw a shadow into */
+    uint32_t GetCascadeMask( const zTBBox3D& worldBox ) const;
+
+    /** Adds a caster to the lists of all cascades it can reach. Returns whether there was any. */
+    bool AddSection( const WorldMeshSectionInfo* section, const zTBBox3D& worldBox );
+    bool AddVob( VobInfo* vob, const zTBBox3D& worldBox );
+    bool AddSkeletalVob( SkeletalVobInfo* vob, const zTBBox3D& worldBox );
+
+    unsigned int GetNumCascades() const { return NumCascades; }
+    const ShadowCascadeCasters& GetCasters( unsigned int cascade ) const { return Casters[cascade]; }
+
+    /** Number of casters added since Begin which reach no cascade at all */
+    unsigned int GetNumCulled() const { return NumCulled; }
+
+private:
+    /** Receiver volume of a cascade, already stretched to the near plane */
+    struct CascadeVolume {
+        XMFLOAT3 Min;
+        XMFLOAT3 Max;
+    };
+
+    XMFLOAT4X4 LightView;
+    unsigned int NumCascades;
+    CascadeVolume Volumes[MAX_CSM_CASCADES];
+    ShadowCascadeCasters Casters[MAX_CSM_CASCADES];
+    unsigned int NumCulled;
+};
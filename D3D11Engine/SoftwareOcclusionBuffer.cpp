@@ -0,0 +1,392 @@
+#include "pch.h"
+#include "SoftwareOcclusionBuffer.h"
+#include "ParallelFor.h"
+#include <immintrin.h>
+
+namespace {
+    /** Tiles are 8x8 pixels, one row of tiles is drawn by one thread */
+    const unsigned int TILE_SIZE = 8;
+
+    /** Vertices closer than this (in w) get clipped away, so the divide by w stays well behaved */
+    const float NEAR_CLIP_W = 1.0f;
+
+    /** Triangles may reach this far outside the screen (in multiples of it) before they get clipped.
+        Keeps the edge functions small enough for float precision. */
+    const float GUARD_BAND = 4.0f;
+
+    /** Below this many triangles, spreading the bands over the worker threads costs more than it saves */
+    const size_t PARALLEL_MIN_TRIANGLES = 1024;
+
+    /** Most vertices a triangle can have after being clipped against the 5 planes */
+    const int MAX_CLIPPED_VERTICES = 3 + 5;
+
+    /** Signed distance of a clip-space position to one of the clip planes, inside is positive */
+    inline float ClipDistance( const XMFLOAT4& v, int plane ) {
+        switch ( plane ) {
+            case 0: return v.w - NEAR_CLIP_W;
+            case 1: return GUARD_BAND * v.w - v.x;
+            case 2: return GUARD_BAND * v.w + v.x;
+            case 3: return GUARD_BAND * v.w - v.y;
+            default: return GUARD_BAND * v.w + v.y;
+        }
+    }
+
+    inline XMFLOAT4 Lerp( const XMFLOAT4& a, const XMFLOAT4& b, float t ) {
+        return XMFLOAT4( a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t );
+    }
+}
+
+SoftwareOcclusionBuffer::SoftwareOcclusionBuffer() {
+    XMStoreFloat4x4( &ViewProj, XMMatrixIdentity() );
+    Width = 0;
+    Height = 0;
+    TilesX = 0;
+    TilesY = 0;
+}
+
+/** Sets the resolution, rounded up to whole tiles */
+void SoftwareOcclusionBuffer::Resize( unsigned int width, unsigned int height ) {
+    const unsigned int tilesX = std::max( 1u, (width + TILE_SIZE - 1) / TILE_SIZE );
+    const unsigned int tilesY = std::max( 1u, (height + TILE_SIZE - 1) / TILE_SIZE );
+    if ( tilesX == TilesX && tilesY == TilesY ) {
+        return;
+    }
+
+    TilesX = tilesX;
+    TilesY = tilesY;
+    Width = TilesX * TILE_SIZE;
+    Height = TilesY * TILE_SIZE;
+
+    RawDepth.assign( Width * Height, 0.0f );
+    Depth.assign( Width * Height, 0.0f );
+    TileMinDepth.assign( TilesX * TilesY, 0.0f );
+    BandTriangles.resize( TilesY );
+}
+
+/** Clears the depth and the queued occluders and sets the view-projection matrix to use */
+void SoftwareOcclusionBuffer::BeginFrame( const XMMATRIX& viewProj ) {
+    XMStoreFloat4x4( &ViewProj, viewProj );
+
+    std::fill( RawDepth.begin(), RawDepth.end(), 0.0f );
+    std::fill( Depth.begin(), Depth.end(), 0.0f );
+    std::fill( TileMinDepth.begin(), TileMinDepth.end(), 0.0f );
+    Triangles.clear();
+    for ( std::vector<unsigned int>& band : BandTriangles ) {
+        band.clear();
+    }
+}
+
+/** Transforms, clips and queues the given triangles */
+void SoftwareOcclusionBuffer::AddOccluder( const XMFLOAT3* positions, unsigned int stride, unsigned int numVertices, const VERTEX_INDEX* indices, unsigned int numIndices ) {
+    if ( Width == 0 ) {
+        return;
+    }
+
+    const XMMATRIX viewProj = XMLoadFloat4x4( &ViewProj );
+    ClipPositions.resize( numVertices );
+
+    const char* position = reinterpret_cast<const char*>(positions);
+    for ( unsigned int i = 0; i < numVertices; i++, position += stride ) {
+        XMStoreFloat4( &ClipPositions[i], XMVector3Transform( XMLoadFloat3( reinterpret_cast<const XMFLOAT3*>(position) ), viewProj ) );
+    }
+
+    for ( unsigned int i = 0; i + 2 < numIndices; i += 3 ) {
+        if ( indices[i] >= numVertices || indices[i + 1] >= numVertices || indices[i + 2] >= numVertices ) {
+            continue;
+        }
+
+        ClipAndQueueTriangle( ClipPositions[indices[i]], ClipPositions[indices[i + 1]], ClipPositions[indices[i + 2]] );
+    }
+}
+
+/** Clips a clip-space triangle against the near plane and the guard band and queues what's left */
+void SoftwareOcclusionBuffer::ClipAndQueueTriangle( const XMFLOAT4& v0, const XMFLOAT4& v1, const XMFLOAT4& v2 ) {
+    // Throw away triangles completely outside one of the frustum planes
+    if ( (v0.x > v0.w && v1.x > v1.w && v2.x > v2.w) || (v0.x < -v0.w && v1.x < -v1.w && v2.x < -v2.w)
+        || (v0.y > v0.w && v1.y > v1.w && v2.y > v2.w) || (v0.y < -v0.w && v1.y < -v1.w && v2.y < -v2.w)
+        || (v0.w < NEAR_CLIP_W && v1.w < NEAR_CLIP_W && v2.w < NEAR_CLIP_W) ) {
+        return;
+    }
+
+    XMFLOAT4 polygon[2][MAX_CLIPPED_VERTICES];
+    int numVertices = 3;
+    polygon[0][0] = v0;
+    polygon[0][1] = v1;
+    polygon[0][2] = v2;
+
+    // Most triangles are inside all planes and skip the polygon clipper
+    int current = 0;
+    for ( int plane = 0; plane < 5; plane++ ) {
+        const XMFLOAT4* in = polygon[current];
+        if ( ClipDistance( in[0], plane ) >= 0.0f && ClipDistance( in[1], plane ) >= 0.0f && ClipDistance( in[2], plane ) >= 0.0f && numVertices == 3 ) {
+            continue;
+        }
+
+        // Sutherland-Hodgman against this plane
+        XMFLOAT4* out = polygon[current ^ 1];
+        int numOut = 0;
+        for ( int i = 0; i < numVertices; i++ ) {
+            const XMFLOAT4& a = in[i];
+            const XMFLOAT4& b = in[(i + 1) % numVertices];
+            const float da = ClipDistance( a, plane );
+            const float db = ClipDistance( b, plane );
+
+            if ( da >= 0.0f ) {
+                out[numOut++] = a;
+            }
+
+            if ( (da >= 0.0f) != (db >= 0.0f) ) {
+                out[numOut++] = Lerp( a, b, da / (da - db) );
+            }
+        }
+
+        numVertices = numOut;
+        current ^= 1;
+        if ( numVertices < 3 ) {
+            return;
+        }
+    }
+
+    for ( int i = 1; i + 1 < numVertices; i++ ) {
+        QueueTriangle( polygon[current][0], polygon[current][i], polygon[current][i + 1] );
+    }
+}
+
+/** Projects a clipped triangle to the screen and queues it */
+void SoftwareOcclusionBuffer::QueueTriangle( const XMFLOAT4& v0, const XMFLOAT4& v1, const XMFLOAT4& v2 ) {
+    const XMFLOAT4* v[3] = { &v0, &v1, &v2 };
+
+    ScreenTriangle tri;
+    for ( int i = 0; i < 3; i++ ) {
+        const float invW = 1.0f / v[i]->w;
+        tri.X[i] = (v[i]->x * invW * 0.5f + 0.5f) * Width;
+        tri.Y[i] = (0.5f - v[i]->y * invW * 0.5f) * Height;
+        tri.InvW[i] = invW;
+    }
+
+    // Make it counter clockwise, so the inside is where all edge functions are positive
+    const float area = (tri.X[1] - tri.X[0]) * (tri.Y[2] - tri.Y[0]) - (tri.Y[1] - tri.Y[0]) * (tri.X[2] - tri.X[0]);
+    if ( area == 0.0f ) {
+        return;
+    }
+
+    if ( area < 0.0f ) {
+        std::swap( tri.X[1], tri.X[2] );
+        std::swap( tri.Y[1], tri.Y[2] );
+        std::swap( tri.InvW[1], tri.InvW[2] );
+    }
+
+    const float minY = std::min( tri.Y[0], std::min( tri.Y[1], tri.Y[2] ) );
+    const float maxY = std::max( tri.Y[0], std::max( tri.Y[1], tri.Y[2] ) );
+    const float minX = std::min( tri.X[0], std::min( tri.X[1], tri.X[2] ) );
+    const float maxX = std::max( tri.X[0], std::max( tri.X[1], tri.X[2] ) );
+    if ( maxY <= 0.0f || minY >= Height || maxX <= 0.0f || minX >= Width ) {
+        return;
+    }
+
+    const unsigned int firstBand = static_cast<unsigned int>(std::max( 0.0f, minY )) / TILE_SIZE;
+    const unsigned int lastBand = std::min( static_cast<unsigned int>(std::max( 0.0f, maxY )) / TILE_SIZE, TilesY - 1 );
+
+    const unsigned int index = static_cast<unsigned int>(Triangles.size());
+    Triangles.push_back( tri );
+    for ( unsigned int band = firstBand; band <= lastBand; band++ ) {
+        BandTriangles[band].push_back( index );
+    }
+}
+
+/** Draws all queued triangles */
+void SoftwareOcclusionBuffer::Rasterize() {
+    if ( Triangles.size() < PARALLEL_MIN_TRIANGLES ) {
+        for ( unsigned int band = 0; band < TilesY; band++ ) {
+            RasterizeBand( band );
+        }
+        for ( unsigned int band = 0; band < TilesY; band++ ) {
+            FilterBand( band );
+        }
+        return;
+    }
+
+    // Bands don't share any pixels, so they can be drawn without locking. Filtering reads the rows next to
+    // the band, so it has to wait until all bands are drawn.
+    ParallelFor( TilesY, [this]( size_t band, unsigned int ) {
+        RasterizeBand( static_cast<unsigned int>(band) );
+    } );
+    ParallelFor( TilesY, [this]( size_t band, unsigned int ) {
+        FilterBand( static_cast<unsigned int>(band) );
+    } );
+}
+
+/** Draws all triangles touching the given band into RawDepth */
+void SoftwareOcclusionBuffer::RasterizeBand( unsigned int band ) {
+    const unsigned int bandY0 = band * TILE_SIZE;
+    const unsigned int bandY1 = bandY0 + TILE_SIZE - 1;
+    const __m128 laneOffsets = _mm_setr_ps( 0.5f, 1.5f, 2.5f, 3.5f );
+    const __m128 zero = _mm_setzero_ps();
+
+    for ( unsigned int index : BandTriangles[band] ) {
+        const ScreenTriangle& tri = Triangles[index];
+
+        // Edge functions A * x + B * y + C, positive on the inside
+        float edgeA[3], edgeB[3], edgeC[3];
+        for ( int e = 0; e < 3; e++ ) {
+            const int a = e;
+            const int b = (e + 1) % 3;
+            edgeA[e] = tri.Y[a] - tri.Y[b];
+            edgeB[e] = tri.X[b] - tri.X[a];
+            edgeC[e] = -(edgeA[e] * tri.X[a] + edgeB[e] * tri.Y[a]);
+        }
+
+        // 1/w as a plane over the screen. Edge e lies opposite of vertex (e + 2) % 3.
+        const float area = edgeA[0] * tri.X[2] + edgeB[0] * tri.Y[2] + edgeC[0];
+        const float depthA = (edgeA[1] * tri.InvW[0] + edgeA[2] * tri.InvW[1] + edgeA[0] * tri.InvW[2]) / area;
+        const float depthB = (edgeB[1] * tri.InvW[0] + edgeB[2] * tri.InvW[1] + edgeB[0] * tri.InvW[2]) / area;
+        const float depthC = (edgeC[1] * tri.InvW[0] + edgeC[2] * tri.InvW[1] + edgeC[0] * tri.InvW[2]) / area;
+
+        const float minX = std::min( tri.X[0], std::min( tri.X[1], tri.X[2] ) );
+        const float maxX = std::max( tri.X[0], std::max( tri.X[1], tri.X[2] ) );
+        const float minY = std::min( tri.Y[0], std::min( tri.Y[1], tri.Y[2] ) );
+        const float maxY = std::max( tri.Y[0], std::max( tri.Y[1], tri.Y[2] ) );
+
+        // Pixels are sampled at their centers, start on a multiple of 4 for the SIMD loop
+        const unsigned int x0 = static_cast<unsigned int>(std::max( 0.0f, minX )) & ~3u;
+        const unsigned int x1 = std::min( static_cast<unsigned int>(std::max( 0.0f, maxX )), Width - 1 );
+        const unsigned int y0 = std::max( static_cast<unsigned int>(std::max( 0.0f, minY )), bandY0 );
+        const unsigned int y1 = std::min( static_cast<unsigned int>(std::max( 0.0f, maxY )), bandY1 );
+
+        const __m128 a0 = _mm_set1_ps( edgeA[0] ), a1 = _mm_set1_ps( edgeA[1] ), a2 = _mm_set1_ps( edgeA[2] );
+        const __m128 dA = _mm_set1_ps( depthA );
+        const __m128 px0 = _mm_add_ps( _mm_set1_ps( static_cast<float>(x0) ), laneOffsets );
+
+        for ( unsigned int y = y0; y <= y1; y++ ) {
+            const float py = y + 0.5f;
+            const __m128 row0 = _mm_set1_ps( edgeB[0] * py + edgeC[0] );
+            const __m128 row1 = _mm_set1_ps( edgeB[1] * py + edgeC[1] );
+            const __m128 row2 = _mm_set1_ps( edgeB[2] * py + edgeC[2] );
+            const __m128 rowDepth = _mm_set1_ps( depthB * py + depthC );
+
+            float* depthRow = &RawDepth[y * Width];
+            __m128 px = px0;
+            for ( unsigned int x = x0; x <= x1; x += 4 ) {
+                const __m128 e0 = _mm_add_ps( _mm_mul_ps( a0, px ), row0 );
+                const __m128 e1 = _mm_add_ps( _mm_mul_ps( a1, px ), row1 );
+                const __m128 e2 = _mm_add_ps( _mm_mul_ps( a2, px ), row2 );
+                const __m128 inside = _mm_and_ps( _mm_and_ps( _mm_cmpge_ps( e0, zero ), _mm_cmpge_ps( e1, zero ) ), _mm_cmpge_ps( e2, zero ) );
+
+                if ( _mm_movemask_ps( inside ) ) {
+                    const __m128 depth = _mm_add_ps( _mm_mul_ps( dA, px ), rowDepth );
+                    const __m128 old = _mm_loadu_ps( &depthRow[x] );
+                    const __m128 closest = _mm_max_ps( old, depth );
+                    _mm_storeu_ps( &depthRow[x], _mm_or_ps( _mm_and_ps( inside, closest ), _mm_andnot_ps( inside, old ) ) );
+                }
+
+                px = _mm_add_ps( px, _mm_set1_ps( 4.0f ) );
+            }
+        }
+    }
+}
+
+/** Fills Depth and TileMinDepth of the given band from RawDepth */
+void SoftwareOcclusionBuffer::FilterBand( unsigned int band ) {
+    const unsigned int bandY0 = band * TILE_SIZE;
+    const unsigned int bandY1 = bandY0 + TILE_SIZE - 1;
+
+    // Pixels are only kept as far as the farthest of their 3x3 neighbours. If an occluder edge runs through a
+    // pixel, the center of one of the neighbours lies on the uncovered side, so a box peeking out from behind
+    // the edge by less than a pixel still finds a far enough pixel. Edges between two triangles of the same
+    // occluder don't leave cracks like with conservative coverage.
+    for ( unsigned int y = bandY0; y <= bandY1; y++ ) {
+        const float* above = &RawDepth[(y > 0 ? y - 1 : y) * Width];
+        const float* row = &RawDepth[y * Width];
+        const float* below = &RawDepth[(y + 1 < Height ? y + 1 : y) * Width];
+        float* out = &Depth[y * Width];
+
+        // Vertical minimum first, then the horizontal one. Outside the screen counts as covered, since nothing
+        // can peek out from there.
+        for ( unsigned int x = 0; x < Width; x += 4 ) {
+            _mm_storeu_ps( &out[x], _mm_min_ps( _mm_loadu_ps( &row[x] ), _mm_min_ps( _mm_loadu_ps( &above[x] ), _mm_loadu_ps( &below[x] ) ) ) );
+        }
+
+        float left = out[0];
+        for ( unsigned int x = 0; x < Width; x++ ) {
+            const float center = out[x];
+            const float right = x + 1 < Width ? out[x + 1] : center;
+            out[x] = std::min( center, std::min( left, right ) );
+            left = center;
+        }
+    }
+
+    // Farthest depth per tile, so most boxes can be rejected without looking at single pixels
+    for ( unsigned int tx = 0; tx < TilesX; tx++ ) {
+        __m128 tileMin = _mm_set1_ps( FLT_MAX );
+        for ( unsigned int y = bandY0; y <= bandY1; y++ ) {
+            const float* depthRow = &Depth[y * Width + tx * TILE_SIZE];
+            tileMin = _mm_min_ps( tileMin, _mm_min_ps( _mm_loadu_ps( depthRow ), _mm_loadu_ps( depthRow + 4 ) ) );
+        }
+
+        float lanes[4];
+        _mm_storeu_ps( lanes, tileMin );
+        TileMinDepth[band * TilesX + tx] = std::min( std::min( lanes[0], lanes[1] ), std::min( lanes[2], lanes[3] ) );
+    }
+}
+
+/** Returns false only if the box is completely hidden behind what Rasterize has drawn */
+bool SoftwareOcclusionBuffer::IsBoxVisible( const zTBBox3D& box ) const {
+    if ( Width == 0 ) {
+        return true;
+    }
+
+    const XMMATRIX viewProj = XMLoadFloat4x4( &ViewProj );
+
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    float closest = 0.0f;
+    for ( int c = 0; c < 8; c++ ) {
+        XMFLOAT3 corner( (c & 1) ? box.Max.x : box.Min.x, (c & 2) ? box.Max.y : box.Min.y, (c & 4) ? box.Max.z : box.Min.z );
+
+        XMFLOAT4 clip;
+        XMStoreFloat4( &clip, XMVector3Transform( XMLoadFloat3( &corner ), viewProj ) );
+        if ( clip.w < NEAR_CLIP_W ) {
+            return true; // Reaches up to the camera, nothing can be in front of it
+        }
+
+        const float invW = 1.0f / clip.w;
+        const float x = (clip.x * invW * 0.5f + 0.5f) * Width;
+        const float y = (0.5f - clip.y * invW * 0.5f) * Height;
+        minX = std::min( minX, x );
+        maxX = std::max( maxX, x );
+        minY = std::min( minY, y );
+        maxY = std::max( maxY, y );
+        closest = std::max( closest, invW );
+    }
+
+    if ( maxX <= 0.0f || minX >= Width || maxY <= 0.0f || minY >= Height ) {
+        return true; // Not on the screen, leave it to frustum culling
+    }
+
+    // Every pixel the box touches, not only the ones whose center it covers
+    const unsigned int x0 = static_cast<unsigned int>(std::max( 0.0f, minX ));
+    const unsigned int y0 = static_cast<unsigned int>(std::max( 0.0f, minY ));
+    const unsigned int x1 = std::max( x0, std::min( static_cast<unsigned int>(ceilf( maxX )), Width ) - 1 );
+    const unsigned int y1 = std::max( y0, std::min( static_cast<unsigned int>(ceilf( maxY )), Height ) - 1 );
+
+    for ( unsigned int ty = y0 / TILE_SIZE; ty <= y1 / TILE_SIZE; ty++ ) {
+        for ( unsigned int tx = x0 / TILE_SIZE; tx <= x1 / TILE_SIZE; tx++ ) {
+            if ( TileMinDepth[ty * TilesX + tx] > closest ) {
+                continue; // Whole tile is in front of the box
+            }
+
+            const unsigned int px0 = std::max( x0, tx * TILE_SIZE );
+            const unsigned int px1 = std::min( x1, tx * TILE_SIZE + TILE_SIZE - 1 );
+            const unsigned int py0 = std::max( y0, ty * TILE_SIZE );
+            const unsigned int py1 = std::min( y1, ty * TILE_SIZE + TILE_SIZE - 1 );
+            for ( unsigned int y = py0; y <= py1; y++ ) {
+                for ( unsigned int x = px0; x <= px1; x++ ) {
+                    if ( Depth[y * Width + x] <= closest ) {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "pch.h"
+
+/** Low resolution depth buffer drawn on the CPU from a few large occluders. BSP nodes and vobs can be tested
+    against it in the same frame they are drawn in, without waiting for GPU queries.
+    Stores 1/w per pixel (larger is closer, 0 where nothing was drawn), which interpolates linearly in screen
+    space and doesn't depend on how the projection maps depth. */
+class SoftwareOcclusionBuffer {
+public:
+    SoftwareOcclusionBuffer();
+
+    /** Sets the resolution, rounded up to whole tiles. Clears the buffer if it changes. */
+    void Resize( unsigned int width, unsigned int height );
+
+    /** Clears the depth and the queued occluders and sets the view-projection matrix (for row-vectors) to use */
+    void BeginFrame( const XMMATRIX& viewProj );
+
+    /** Transforms, clips and queues the given triangles. positions points at the first world space position and
+        stride is the distance between two positions in bytes, so vertex arrays can be used directly. */
+    void AddOccluder( const XMFLOAT3* positions, unsigned int stride, unsigned int numVertices, const VERTEX_INDEX* indices, unsigned int numIndices );
+
+    /** Draws all queued triangles. The buffer is split into bands of tiles, which are drawn on the worker threads. */
+    void Rasterize();
+
+    /** Returns false only if the box is completely hidden behind what Rasterize has drawn. Gaps narrower than
+        a pixel between two separate occluders count as closed. */
+    bool IsBoxVisible( const zTBBox3D& box ) const;
+
+    unsigned int GetWidth() const { return Width; }
+    unsigned int GetHeight() const { return Height; }
+
+    /** Number of triangles queued since BeginFrame, after clipping */
+    unsigned int GetNumTriangles() const { return static_cast<unsigned int>(Triangles.size()); }
+
+    /** Returns the stored 1/w of the given pixel */
+    float GetDepth( unsigned int x, unsigned int y ) const { return Depth[y * Width + x]; }
+
+private:
+    /** Triangle in pixel coordinates, counter clockwise */
+    struct ScreenTriangle {
+        float X[3];
+        float Y[3];
+        float InvW[3];
+    };
+
+    /** Clips a clip-space triangle against the near plane and the guard band and queues what's left */
+    void ClipAndQueueTriangle( const XMFLOAT4& v0, const XMFLOAT4& v1, const XMFLOAT4& v2 );
+
+    /** Projects a clipped triangle to the screen and queues it */
+    void QueueTriangle( const XMFLOAT4& v0, const XMFLOAT4& v1, const XMFLOAT4& v2 );
+
+    /** Draws all triangles touching the given band into RawDepth */
+    void RasterizeBand( unsigned int band );
+
+    /** Fills Depth and TileMinDepth of the given band from RawDepth */
+    void FilterBand( unsigned int band );
+
+    XMFLOAT4X4 ViewProj;
+
+    unsigned int Width;
+    unsigned int Height;
+    unsigned int TilesX;
+    unsigned int TilesY;
+
+    /** 1/w for every pixel as drawn, row by row */
+    std::vector<float> RawDepth;
+
+    /** RawDepth with every pixel replaced by the smallest value of its 3x3 neighbourhood */
+    std::vector<float> Depth;
+
+    /** Smallest (farthest) value of Depth inside every tile */
+    std::vector<float> TileMinDepth;
+
+    std::vector<ScreenTriangle> Triangles;
+
+    /** Triangles touching each row of tiles */
+    std::vector<std::vector<unsigned int>> BandTriangles;
+
+    /** Clip-space positions of the occluder currently being added */
+    std::vector<XMFLOAT4> ClipPositions;
+};
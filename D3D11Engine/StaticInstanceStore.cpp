@@ -0,0 +1,90 @@
+#include "pch.h"
+#include "StaticInstanceStore.h"
+
+StaticInstanceStore::StaticInstanceStore() {}
+
+/** Removes all slots */
+void StaticInstanceStore::Clear() {
+    Instances.clear();
+    FreeSlots.clear();
+    DirtySlots.clear();
+    SlotIsDirty.clear();
+}
+
+/** Gives out a slot, reusing released ones first */
+unsigned int StaticInstanceStore::Acquire() {
+    if ( !FreeSlots.empty() ) {
+        const unsigned int slot = FreeSlots.back();
+        FreeSlots.pop_back();
+        return slot;
+    }
+
+    Instances.emplace_back();
+    memset( &Instances.back(), 0, sizeof( VobInstanceInfo ) );
+    SlotIsDirty.push_back( 0 );
+    return static_cast<unsigned int>(Instances.size() - 1);
+}
+
+/** Makes the slot free for the next Acquire, NO_SLOT is ignored */
+void StaticInstanceStore::Release( unsigned int slot ) {
+    if ( slot == NO_SLOT )
+        return;
+
+    FreeSlots.push_back( slot );
+}
+
+void StaticInstanceStore::MarkDirty( unsigned int slot ) {
+    if ( SlotIsDirty[slot] )
+        return;
+
+    SlotIsDirty[slot] = 1;
+    DirtySlots.push_back( slot );
+}
+
+/** Stores the instance at the slot, acquiring one first if it is NO_SLOT */
+void StaticInstanceStore::Update( unsigned int& slot, const VobInstanceInfo& instance ) {
+    // A slot given out just now may hold anything on the GPU, like what the last world left there
+    const bool acquired = slot == NO_SLOT;
+    if ( acquired ) {
+        slot = Acquire();
+    }
+
+    // Otherwise the GPU has the same as what is stored here, as long as all dirty slots get uploaded
+    if ( !acquired && memcmp( &Instances[slot], &instance, sizeof( VobInstanceInfo ) ) == 0 )
+        return;
+
+    Instances[slot] = instance;
+    MarkDirty( slot );
+}
+
+/** Moves the dirty slots into ranges and cleans them */
+void StaticInstanceStore::TakeDirtyRanges( std::vector<SlotRange>& outRanges, unsigned int maxGap ) {
+    outRanges.clear();
+    if ( DirtySlots.empty() )
+        return;
+
+    std::sort( DirtySlots.begin(), DirtySlots.end() );
+
+    SlotRange range = { DirtySlots[0], 1 };
+    for ( size_t i = 1; i < DirtySlots.size(); i++ ) {
+        const unsigned int slot = DirtySlots[i];
+        if ( slot - (range.First + range.Count) <= maxGap ) {
+            range.Count = slot - range.First + 1;
+            continue;
+        }
+
+        outRanges.push_back( range );
+        range = { slot, 1 };
+    }
+    outRanges.push_back( range );
+
+    ClearDirty();
+}
+
+/** Cleans all slots, for when the whole store got uploaded at once */
+void StaticInstanceStore::ClearDirty() {
+    for ( unsigned int slot : DirtySlots ) {
+        SlotIsDirty[slot] = 0;
+    }
+    DirtySlots.clear();
+}
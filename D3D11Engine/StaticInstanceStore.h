@@ -0,0 +1,54 @@
+#pragma once
+#include "pch.h"
+#include "ConstantBufferStructs.h"
+
+/** Instance data of the static vobs, every vob keeping the same slot for as long as it exists. This mirrors a
+    buffer on the GPU which only needs the slots updated whose data changed, so a frame just has to send the
+    slots of the visible instances instead of all of their data. */
+class StaticInstanceStore {
+public:
+    static const unsigned int NO_SLOT = 0xFFFFFFFF;
+
+    /** Consecutive slots to upload */
+    struct SlotRange {
+        unsigned int First;
+        unsigned int Count;
+    };
+
+    StaticInstanceStore();
+
+    /** Removes all slots */
+    void Clear();
+
+    /** Gives out a slot, reusing released ones first */
+    unsigned int Acquire();
+
+    /** Makes the slot free for the next Acquire, NO_SLOT is ignored */
+    void Release( unsigned int slot );
+
+    /** Stores the instance at the slot, acquiring one first if it is NO_SLOT. An existing slot only gets dirty if
+        the data differs from what it held, so the instance has to be fully initialized. */
+    void Update( unsigned int& slot, const VobInstanceInfo& instance );
+
+    /** Moves the dirty slots into ranges and cleans them. Ranges closer than maxGap slots get merged, as one
+        larger upload is cheaper than several small ones. */
+    void TakeDirtyRanges( std::vector<SlotRange>& outRanges, unsigned int maxGap = 0 );
+
+    /** Cleans all slots, for when the whole store got uploaded at once */
+    void ClearDirty();
+
+    const VobInstanceInfo* GetInstances() const { return Instances.data(); }
+    unsigned int GetNumSlots() const { return static_cast<unsigned int>(Instances.size()); }
+    unsigned int GetNumFreeSlots() const { return static_cast<unsigned int>(FreeSlots.size()); }
+    unsigned int GetNumDirtySlots() const { return static_cast<unsigned int>(DirtySlots.size()); }
+
+private:
+    void MarkDirty( unsigned int slot );
+
+    std::vector<VobInstanceInfo> Instances;
+    std::vector<unsigned int> FreeSlots;
+
+    /** Dirty slots in the order they got dirty, and a flag for every slot to add each one only once */
+    std::vector<unsigned int> DirtySlots;
+    std::vector<unsigned char> SlotIsDirty;
+};
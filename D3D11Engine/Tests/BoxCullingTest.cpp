@@ -0,0 +1,302 @@
+#include "TestPch.h"
+#include "BoxCulling.h"
+#include "InstructionSet.h"
+#include "TestCheck.h"
+#include <random>
+
+namespace {
+    /** Boxes closer than this to a plane or their draw radius may go either way through float rounding */
+    const double BORDER_TOLERANCE = 0.05;
+
+    struct Kernel {
+        const char* Name;
+        ZCullBoxes Cull;
+    };
+
+    /** All kernels this build has and the CPU can run */
+    std::vector<Kernel> GetKernels() {
+        std::vector<Kernel> kernels = { { "Scalar", CullBoxes_Scalar }, { "SSE2", CullBoxes_SSE2 } };
+#ifdef _XM_AVX2_INTRINSICS_
+        if ( InstructionSet::AVX2() ) {
+            kernels.push_back( { "AVX2", CullBoxes_AVX2 } );
+        } else {
+            std::printf( "CPU has no AVX2, only testing the scalar and SSE2 kernels\n" );
+        }
+#endif
+        return kernels;
+    }
+
+    /** Boxes in the arrays BoxCullingInput points into */
+    struct BoxArrays {
+        std::vector<float> CenterX, CenterY, CenterZ;
+        std::vector<float> ExtentX, ExtentY, ExtentZ;
+        std::vector<uint8_t> DistanceClass;
+
+        BoxCullingInput GetInput( unsigned int numBoxes ) const {
+            BoxCullingInput input;
+            input.CenterX = CenterX.data();
+            input.CenterY = CenterY.data();
+            input.CenterZ = CenterZ.data();
+            input.ExtentX = ExtentX.data();
+            input.ExtentY = ExtentY.data();
+            input.ExtentZ = ExtentZ.data();
+            input.DistanceClass = DistanceClass.data();
+            input.NumBoxes = numBoxes;
+            return input;
+        }
+    };
+
+    /** Random boxes of all sizes and distance classes around the viewer, many of them outside the frustum
+        or the draw radius */
+    BoxArrays MakeBoxes( std::mt19937& rng, unsigned int numBoxes ) {
+        std::uniform_real_distribution<float> position( -9000.0f, 9000.0f );
+        std::uniform_real_distribution<float> extent( 0.0f, 400.0f );
+
+        BoxArrays boxes;
+        for ( unsigned int i = 0; i < numBoxes; i++ ) {
+            boxes.CenterX.push_back( position( rng ) );
+            boxes.CenterY.push_back( position( rng ) * 0.2f );
+            boxes.CenterZ.push_back( position( rng ) );
+
+            // Some are flat, like the boxes of decals and floor tiles
+            const float scale = (i % 7 == 0) ? 0.0f : 1.0f;
+            boxes.ExtentX.push_back( extent( rng ) );
+            boxes.ExtentY.push_back( extent( rng ) * scale );
+            boxes.ExtentZ.push_back( extent( rng ) );
+            boxes.DistanceClass.push_back( static_cast<uint8_t>(rng() % 3) );
+        }
+        return boxes;
+    }
+
+    /** Camera at the viewer looking along the given yaw, with the four side planes of a 90 degree frustum and
+        near and far planes */
+    CullingFrustum MakeFrustum( const XMFLOAT3& viewer, float yaw, unsigned int numPlanes ) {
+        const float forward[3] = { std::sin( yaw ), 0.0f, std::cos( yaw ) };
+        const float right[3] = { std::cos( yaw ), 0.0f, -std::sin( yaw ) };
+        const float up[3] = { 0.0f, 1.0f, 0.0f };
+        const float s = 1.0f / std::sqrt( 2.0f );
+
+        // Inward normals in camera space, as factors of forward, right and up, and the distance from the viewer
+        const float camera[6][4] = {
+            { s, s, 0.0f, 0.0f },      // Left
+            { s, -s, 0.0f, 0.0f },     // Right
+            { s, 0.0f, s, 0.0f },      // Bottom
+            { s, 0.0f, -s, 0.0f },     // Top
+            { 1.0f, 0.0f, 0.0f, -10.0f },  // Near
+            { -1.0f, 0.0f, 0.0f, 7000.0f }, // Far
+        };
+
+        CullingFrustum frustum;
+        frustum.NumPlanes = numPlanes;
+        for ( int p = 0; p < 6; p++ ) {
+            float n[3];
+            for ( int a = 0; a < 3; a++ ) {
+                n[a] = camera[p][0] * forward[a] + camera[p][1] * right[a] + camera[p][2] * up[a];
+            }
+
+            const float w = camera[p][3] - (n[0] * viewer.x + n[1] * viewer.y + n[2] * viewer.z);
+            frustum.Planes[p] = XMFLOAT4( n[0], n[1], n[2], w );
+        }
+        return frustum;
+    }
+
+    enum EReferenceResult {
+        REFERENCE_CULLED,
+        REFERENCE_VISIBLE,
+        REFERENCE_BORDER,
+    };
+
+    /** Brute force in double precision: the box is outside a plane if all of its 8 corners are behind it, and
+        too far if its closest point to the viewer is. Boxes within BORDER_TOLERANCE of deciding otherwise
+        are reported as being on the border. */
+    EReferenceResult CullBruteForce( const BoxArrays& boxes, unsigned int i, const CullingFrustum& frustum, const CullingDistances& distances ) {
+        const double center[3] = { boxes.CenterX[i], boxes.CenterY[i], boxes.CenterZ[i] };
+        const double extent[3] = { boxes.ExtentX[i], boxes.ExtentY[i], boxes.ExtentZ[i] };
+        const double viewer[3] = { distances.Viewer.x, distances.Viewer.y, distances.Viewer.z };
+
+        bool border = false;
+        double distSq = 0.0;
+        double sphereRadiusSq = 0.0;
+        for ( int a = 0; a < 3; a++ ) {
+            const double d = std::max( std::fabs( center[a] - viewer[a] ) - extent[a], 0.0 );
+            distSq += d * d;
+            sphereRadiusSq += extent[a] * extent[a];
+        }
+
+        double maxDist = distances.Radius[boxes.DistanceClass[i]];
+        if ( distances.DetailScaleSq > 0.0f ) {
+            maxDist = std::min( maxDist, std::sqrt( sphereRadiusSq * distances.DetailScaleSq ) );
+        }
+
+        const double dist = std::sqrt( distSq );
+        if ( std::fabs( dist - maxDist ) <= BORDER_TOLERANCE ) {
+            border = true;
+        } else if ( dist > maxDist ) {
+            return REFERENCE_CULLED;
+        }
+
+        for ( unsigned int p = 0; p < frustum.NumPlanes; p++ ) {
+            const XMFLOAT4& plane = frustum.Planes[p];
+            double furthest = -DBL_MAX;
+            for ( int corner = 0; corner < 8; corner++ ) {
+                const double x = center[0] + ((corner & 1) ? extent[0] : -extent[0]);
+                const double y = center[1] + ((corner & 2) ? extent[1] : -extent[1]);
+                const double z = center[2] + ((corner & 4) ? extent[2] : -extent[2]);
+                furthest = std::max( furthest, plane.x * x + plane.y * y + plane.z * z + plane.w );
+            }
+
+            if ( std::fabs( furthest ) <= BORDER_TOLERANCE ) {
+                border = true;
+            } else if ( furthest < 0.0 ) {
+                return REFERENCE_CULLED;
+            }
+        }
+
+        return border ? REFERENCE_BORDER : REFERENCE_VISIBLE;
+    }
+
+    /** The kernel returns ascending indices and agrees with the brute force on every box not on the border.
+        Counts the boxes the reference keeps per distance class to visible. */
+    void CheckKernel( const Kernel& kernel, const BoxArrays& boxes, unsigned int numBoxes, const CullingFrustum& frustum,
+        const CullingDistances& distances, unsigned int* visiblePerClass = nullptr ) {
+        std::vector<unsigned int> indices( numBoxes + 1, UINT_MAX );
+        const unsigned int numVisible = kernel.Cull( boxes.GetInput( numBoxes ), frustum, distances, indices.data() );
+        TEST_CHECK( numVisible <= numBoxes );
+        TEST_CHECK( indices[numBoxes] == UINT_MAX );
+
+        std::vector<bool> visible( numBoxes, false );
+        for ( unsigned int i = 0; i < numVisible && i < numBoxes; i++ ) {
+            TEST_CHECK( i == 0 || indices[i - 1] < indices[i] );
+            if ( indices[i] < numBoxes ) {
+                visible[indices[i]] = true;
+            }
+        }
+
+        unsigned int numWrong = 0;
+        for ( unsigned int i = 0; i < numBoxes; i++ ) {
+            const EReferenceResult expected = CullBruteForce( boxes, i, frustum, distances );
+            if ( expected != REFERENCE_BORDER && visible[i] != (expected == REFERENCE_VISIBLE) ) {
+                numWrong++;
+            }
+            if ( visiblePerClass && expected == REFERENCE_VISIBLE ) {
+                visiblePerClass[boxes.DistanceClass[i]]++;
+            }
+        }
+
+        if ( numWrong ) {
+            std::printf( "%s: %u of %u boxes culled differently than the brute force\n", kernel.Name, numWrong, numBoxes );
+        }
+        TEST_CHECK( numWrong == 0 );
+    }
+
+    CullingDistances MakeDistances( const XMFLOAT3& viewer, float detailScaleSq ) {
+        CullingDistances distances;
+        distances.Viewer = viewer;
+        distances.Radius[BOX_DISTANCE_OUTDOOR] = 6000.0f;
+        distances.Radius[BOX_DISTANCE_OUTDOOR_SMALL] = 2500.0f;
+        distances.Radius[BOX_DISTANCE_INDOOR] = 1200.0f;
+        distances.DetailScaleSq = detailScaleSq;
+        return distances;
+    }
+
+    /** Every box count up to a few batches, so all tails of the 4 and 8 wide kernels are covered */
+    void TestTails() {
+        std::mt19937 rng( 11 );
+        const XMFLOAT3 viewer( 0.0f, 0.0f, 0.0f );
+        const BoxArrays boxes = MakeBoxes( rng, 3 * 8 + 1 );
+        const CullingFrustum frustum = MakeFrustum( viewer, 0.3f, 6 );
+        const CullingDistances distances = MakeDistances( viewer, 0.0f );
+
+        for ( const Kernel& kernel : GetKernels() ) {
+            for ( unsigned int numBoxes = 0; numBoxes <= boxes.CenterX.size(); numBoxes++ ) {
+                CheckKernel( kernel, boxes, numBoxes, frustum, distances );
+            }
+        }
+    }
+
+    /** Many boxes, with 4 and 6 planes, with and without detail culling, and with each distance class
+        deciding about some of the boxes */
+    void TestAgainstBruteForce() {
+        std::mt19937 rng( 12 );
+        const XMFLOAT3 viewer( 300.0f, 150.0f, -700.0f );
+        const BoxArrays boxes = MakeBoxes( rng, 20003 );
+
+        for ( const Kernel& kernel : GetKernels() ) {
+            for ( unsigned int numPlanes : { 4u, 6u } ) {
+                for ( float detailScaleSq : { 0.0f, 30.0f * 30.0f } ) {
+                    const CullingFrustum frustum = MakeFrustum( viewer, -2.1f, numPlanes );
+                    unsigned int visiblePerClass[3] = {};
+                    CheckKernel( kernel, boxes, static_cast<unsigned int>(boxes.CenterX.size()), frustum,
+                        MakeDistances( viewer, detailScaleSq ), visiblePerClass );
+
+                    for ( unsigned int count : visiblePerClass ) {
+                        TEST_CHECK( count > 0 );
+                    }
+                }
+            }
+        }
+    }
+
+    /** Each class is only drawn up to its own radius. The boxes are within both outdoor radii, but outside the
+        indoor one. */
+    void TestDistanceClasses() {
+        const XMFLOAT3 viewer( 0.0f, 0.0f, 0.0f );
+        const CullingFrustum frustum = MakeFrustum( viewer, 0.0f, 6 );
+        const CullingDistances distances = MakeDistances( viewer, 0.0f );
+
+        // Straight ahead at 2000, more of them than fit into two batches of the AVX2 kernel
+        BoxArrays boxes;
+        for ( unsigned int i = 0; i < 19; i++ ) {
+            boxes.CenterX.push_back( 0.0f );
+            boxes.CenterY.push_back( 0.0f );
+            boxes.CenterZ.push_back( 2010.0f );
+            boxes.ExtentX.push_back( 10.0f );
+            boxes.ExtentY.push_back( 10.0f );
+            boxes.ExtentZ.push_back( 10.0f );
+            boxes.DistanceClass.push_back( static_cast<uint8_t>(i % 3) );
+        }
+
+        for ( const Kernel& kernel : GetKernels() ) {
+            std::vector<unsigned int> indices( boxes.CenterX.size() );
+            const unsigned int numVisible = kernel.Cull( boxes.GetInput( 19 ), frustum, distances, indices.data() );
+
+            unsigned int numExpected = 0;
+            for ( unsigned int i = 0; i < 19; i++ ) {
+                numExpected += boxes.DistanceClass[i] == BOX_DISTANCE_INDOOR ? 0 : 1;
+            }
+            TEST_CHECK( numVisible == numExpected );
+            for ( unsigned int i = 0; i < numVisible; i++ ) {
+                TEST_CHECK( boxes.DistanceClass[indices[i]] != BOX_DISTANCE_INDOOR );
+            }
+        }
+    }
+
+    /** Prints how long each kernel takes for a world's worth of vob boxes */
+    void BenchmarkKernels() {
+        std::mt19937 rng( 13 );
+        const XMFLOAT3 viewer( 0.0f, 0.0f, 0.0f );
+        const BoxArrays boxes = MakeBoxes( rng, 100000 );
+        const CullingFrustum frustum = MakeFrustum( viewer, 1.0f, 6 );
+        const CullingDistances distances = MakeDistances( viewer, 30.0f * 30.0f );
+        const BoxCullingInput input = boxes.GetInput( static_cast<unsigned int>(boxes.CenterX.size()) );
+
+        std::vector<unsigned int> indices( input.NumBoxes );
+        double scalarMs = 0.0;
+        for ( const Kernel& kernel : GetKernels() ) {
+            const double ms = MeasureMilliseconds( 10, [&]() {
+                kernel.Cull( input, frustum, distances, indices.data() );
+            } );
+
+            scalarMs = scalarMs > 0.0 ? scalarMs : ms;
+            std::printf( "Culling %u boxes: %s %.3f ms (%.1fx)\n", input.NumBoxes, kernel.Name, ms, scalarMs / ms );
+        }
+    }
+}
+
+int main() {
+    TestTails();
+    TestAgainstBruteForce();
+    TestDistanceClasses();
+    BenchmarkKernels();
+    return TestResult();
+}
@@ -0,0 +1,233 @@
+#include "TestPch.h"
+#include "CommandListScheduler.h"
+#include "RenderQueue.h"
+#include "Engine.h"
+#include "ThreadPool.h"
+#include "TestCheck.h"
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
+
+namespace {
+    /** Stands in for the deferred contexts. Each context replays its job of the queue into its own recording,
+        executing appends that recording to the one of the immediate context. */
+    class FakeCommandListBackend : public BaseCommandListBackend {
+    public:
+        FakeCommandListBackend( const RenderQueue& queue, unsigned int numContexts )
+            : Queue( queue ), Contexts( numContexts ), Busy( numContexts ) {
+            for ( auto& busy : Busy ) {
+                busy = false;
+            }
+        }
+
+        unsigned int GetNumContexts() override { return static_cast<unsigned int>(Contexts.size()); }
+
+        bool RecordJob( unsigned int context, unsigned int first, unsigned int count ) override {
+            // Two jobs must never record into the same context at once
+            TEST_CHECK( !Busy[context].exchange( true ) );
+
+            {
+                std::lock_guard<std::mutex> lock( Mutex );
+                RecordingThreads.insert( std::this_thread::get_id() );
+            }
+
+            RenderQueueStats stats = {};
+            Contexts[context].Clear();
+            Queue.Replay( Contexts[context], first, count, stats );
+            Recorded++;
+
+            // Long enough for the other threads to pick up jobs too
+            volatile unsigned int work = 0;
+            for ( unsigned int i = 0; i < 20000; i++ ) {
+                work += i;
+            }
+
+            Busy[context] = false;
+            return static_cast<int>(context) != FailingContext;
+        }
+
+        void ExecuteJob( unsigned int context ) override {
+            TEST_CHECK( std::this_thread::get_id() == MainThread );
+
+            Executed.push_back( context );
+            const auto& commands = Contexts[context].GetCommands();
+            Immediate.insert( Immediate.end(), commands.begin(), commands.end() );
+        }
+
+        /** Recording of this context fails */
+        int FailingContext = -1;
+
+        std::vector<unsigned int> Executed;
+        std::vector<RecordingRenderQueueBackend::Command> Immediate;
+        std::set<std::thread::id> RecordingThreads;
+        std::atomic<unsigned int> Recorded{ 0 };
+        std::thread::id MainThread = std::this_thread::get_id();
+
+    private:
+        const RenderQueue& Queue;
+        std::vector<RecordingRenderQueueBackend> Contexts;
+        std::vector<std::atomic<bool>> Busy;
+        std::mutex Mutex;
+    };
+
+    /** A sorted queue of random packets, NumIndices is the number of the packet */
+    void FillQueue( RenderQueue& queue, std::mt19937& rng, unsigned int numPackets ) {
+        static char shaders[6];
+        static char materials[300];
+
+        queue.Clear();
+        for ( unsigned int i = 0; i < numPackets; i++ ) {
+            RenderPacket packet = {};
+            packet.Pass = rng() % 2;
+            packet.Shader = packet.Pass ? &shaders[rng() % 6] : nullptr;
+            packet.Material = packet.Pass ? &materials[rng() % 300] : nullptr;
+            packet.Depth = static_cast<float>(rng() % 1000);
+            packet.NumIndices = i;
+            queue.Add( packet );
+        }
+        queue.Sort();
+    }
+
+    std::vector<const RenderPacket*> GetDraws( const std::vector<RecordingRenderQueueBackend::Command>& commands ) {
+        std::vector<const RenderPacket*> draws;
+        for ( const auto& command : commands ) {
+            if ( command.Type == RecordingRenderQueueBackend::CMD_DRAW ) {
+                draws.push_back( command.Packet );
+            }
+        }
+        return draws;
+    }
+
+    /** Jobs cover all items in order, are nearly the same size and only get cut below MIN_ITEMS_PER_JOB if there is one */
+    void TestPartition() {
+        for ( unsigned int numItems : { 0u, 1u, 255u, 256u, 511u, 512u, 1000u, 4097u, 100000u } ) {
+            for ( unsigned int maxJobs : { 0u, 1u, 3u, 8u, 64u } ) {
+                std::vector<CommandListScheduler::Job> jobs;
+                CommandListScheduler::Partition( numItems, maxJobs, jobs );
+
+                TEST_CHECK( !jobs.empty() );
+                TEST_CHECK( jobs.size() <= std::max( 1u, maxJobs ) );
+
+                unsigned int next = 0;
+                unsigned int smallest = UINT_MAX;
+                unsigned int largest = 0;
+                for ( const auto& job : jobs ) {
+                    TEST_CHECK( job.First == next );
+                    next += job.Count;
+                    smallest = std::min( smallest, job.Count );
+                    largest = std::max( largest, job.Count );
+                }
+
+                TEST_CHECK( next == numItems );
+                TEST_CHECK( largest - smallest <= 1 );
+                TEST_CHECK( jobs.size() == 1 || smallest >= CommandListScheduler::MIN_ITEMS_PER_JOB );
+            }
+        }
+    }
+
+    /** Too few items for two jobs are left to the caller, without touching the backend */
+    void TestTooFewItems() {
+        std::mt19937 rng( 24 );
+        RenderQueue queue;
+        FillQueue( queue, rng, 2 * CommandListScheduler::MIN_ITEMS_PER_JOB - 1 );
+
+        FakeCommandListBackend backend( queue, 8 );
+        CommandListScheduler scheduler;
+        TEST_CHECK( !scheduler.Run( backend, queue.GetNumPackets() ) );
+        TEST_CHECK( scheduler.GetJobs().empty() );
+        TEST_CHECK( backend.Recorded == 0 );
+        TEST_CHECK( backend.Executed.empty() );
+
+        // Neither with a single context
+        FakeCommandListBackend single( queue, 1 );
+        FillQueue( queue, rng, 10000 );
+        TEST_CHECK( !scheduler.Run( single, queue.GetNumPackets() ) );
+        TEST_CHECK( single.Recorded == 0 );
+    }
+
+    /** The jobs, recorded in any order on any thread, execute into exactly the draws of a single replay */
+    void CheckRuns( unsigned int numRuns, unsigned int numContexts ) {
+        std::mt19937 rng( 25 );
+        RenderQueue queue;
+        CommandListScheduler scheduler;
+        for ( unsigned int run = 0; run < numRuns; run++ ) {
+            FillQueue( queue, rng, 2 * CommandListScheduler::MIN_ITEMS_PER_JOB + rng() % 20000 );
+
+            RecordingRenderQueueBackend reference;
+            RenderQueueStats stats = {};
+            queue.Replay( reference, 0, queue.GetNumPackets(), stats );
+
+            FakeCommandListBackend backend( queue, numContexts );
+            TEST_CHECK( scheduler.Run( backend, queue.GetNumPackets() ) );
+
+            const unsigned int numJobs = static_cast<unsigned int>(scheduler.GetJobs().size());
+            TEST_CHECK( numJobs >= 2 && numJobs <= numContexts );
+            TEST_CHECK( scheduler.GetStats().Jobs == numJobs );
+            TEST_CHECK( scheduler.GetStats().FailedJobs == 0 );
+            TEST_CHECK( backend.Recorded == numJobs );
+
+            TEST_CHECK( backend.Executed.size() == numJobs );
+            for ( unsigned int i = 0; i < backend.Executed.size(); i++ ) {
+                TEST_CHECK( backend.Executed[i] == i );
+            }
+
+            const std::vector<const RenderPacket*> draws = GetDraws( backend.Immediate );
+            TEST_CHECK( draws == GetDraws( reference.GetCommands() ) );
+
+            std::vector<unsigned int> timesDrawn( queue.GetNumPackets(), 0 );
+            for ( const RenderPacket* packet : draws ) {
+                timesDrawn[packet->NumIndices]++;
+            }
+            TEST_CHECK( std::all_of( timesDrawn.begin(), timesDrawn.end(), []( unsigned int n ) { return n == 1; } ) );
+
+            if ( !Engine::WorkerThreadPool ) {
+                TEST_CHECK( backend.RecordingThreads == std::set<std::thread::id>( { backend.MainThread } ) );
+            }
+        }
+    }
+
+    /** Without worker threads everything is recorded on the calling thread */
+    void TestRunWithoutWorkers() {
+        Engine::WorkerThreadPool = nullptr;
+        CheckRuns( 5, 4 );
+    }
+
+    void TestRunOnWorkers() {
+        Engine::WorkerThreadPool = new ThreadPool( 3 );
+        CheckRuns( 30, 4 );
+        CheckRuns( 10, 16 );
+        delete Engine::WorkerThreadPool;
+        Engine::WorkerThreadPool = nullptr;
+    }
+
+    /** A job failing to record is skipped, the others still execute in order */
+    void TestFailedJob() {
+        Engine::WorkerThreadPool = new ThreadPool( 3 );
+
+        std::mt19937 rng( 26 );
+        RenderQueue queue;
+        FillQueue( queue, rng, 5000 );
+
+        FakeCommandListBackend backend( queue, 4 );
+        backend.FailingContext = 1;
+        CommandListScheduler scheduler;
+        TEST_CHECK( scheduler.Run( backend, queue.GetNumPackets() ) );
+        TEST_CHECK( scheduler.GetStats().Jobs == 4 );
+        TEST_CHECK( scheduler.GetStats().FailedJobs == 1 );
+        TEST_CHECK( backend.Executed == std::vector<unsigned int>( { 0, 2, 3 } ) );
+
+        delete Engine::WorkerThreadPool;
+        Engine::WorkerThreadPool = nullptr;
+    }
+}
+
+int main() {
+    TestPartition();
+    TestTooFewItems();
+    TestRunWithoutWorkers();
+    TestRunOnWorkers();
+    TestFailedJob();
+    return TestResult();
+}
@@ -0,0 +1,245 @@
+#include "TestPch.h"
+#include "MeshCacheFormat.h"
+#include "MemoryMappedFile.h"
+#include "TestCheck.h"
+#include <cstdio>
+#include <random>
+
+namespace {
+    /** Textures and submesh counts of Data/MeshCacheV1.mcache, which was written in the layout of the old
+        WorldConverter::CacheMesh. Its vertices and indices follow MakeFixtureVertex and MakeFixtureIndex. */
+    const char* FIXTURE_TEXTURES[] = { "GRASS_01.TGA", "OW_MISC_WALL_01.TGA", "WOOD_PLANKS.TGA" };
+    const unsigned int FIXTURE_SUBMESHES[] = { 2, 1, 3 };
+
+    unsigned int GetFixtureNumVertices( unsigned int t, unsigned int s ) {
+        return 10 + 7 * s + 3 * t;
+    }
+
+    ExVertexStruct MakeFixtureVertex( unsigned int t, unsigned int s, unsigned int i ) {
+        ExVertexStruct v;
+        v.Position = float3( static_cast<float>(t * 1000 + s * 100 + i), i * 0.5f, static_cast<float>(-static_cast<int>(i)) );
+        v.Normal = float3( 0.0f, 1.0f, 0.0f );
+        v.TexCoord = float2( i * 0.25f, static_cast<float>(s) );
+        v.TexCoord2 = float2( 0.5f, 0.5f );
+        v.Color = 0xFF000000 | i;
+        return v;
+    }
+
+    VERTEX_INDEX MakeFixtureIndex( unsigned int numVertices, unsigned int i ) {
+        return static_cast<VERTEX_INDEX>((i * 7) % numVertices);
+    }
+
+    std::vector<uint8_t> ReadFile( const std::string& file ) {
+        MemoryMappedFile mapped;
+        if ( XR_SUCCESS != mapped.Open( file ) ) {
+            return std::vector<uint8_t>();
+        }
+        return std::vector<uint8_t>( mapped.GetData(), mapped.GetData() + mapped.GetSize() );
+    }
+
+    bool WriteFile( const std::string& file, const std::vector<uint8_t>& data ) {
+        FILE* f = fopen( file.c_str(), "wb" );
+        if ( !f ) {
+            return false;
+        }
+
+        const bool written = fwrite( &data[0], data.size(), 1, f ) == 1;
+        fclose( f );
+        return written;
+    }
+
+    /** Random submeshes per texture, including an empty one */
+    MeshCacheFormat::MeshCacheGeometry MakeGeometry( std::mt19937& rng, unsigned int numTextures, unsigned int maxVertices ) {
+        std::uniform_real_distribution<float> value( -50000.0f, 50000.0f );
+
+        MeshCacheFormat::MeshCacheGeometry geometry;
+        for ( unsigned int t = 0; t < numTextures; t++ ) {
+            auto& submeshes = geometry["TEXTURE_" + std::to_string( t ) + ".TGA"];
+            submeshes.resize( 1 + rng() % 4 );
+            for ( auto& submesh : submeshes ) {
+                // Odd sizes, so the blobs behind them need padding
+                submesh.first.resize( rng() % maxVertices );
+                for ( ExVertexStruct& v : submesh.first ) {
+                    v.Position = float3( value( rng ), value( rng ), value( rng ) );
+                    v.Normal = float3( value( rng ), value( rng ), value( rng ) );
+                    v.TexCoord = float2( value( rng ), value( rng ) );
+                    v.TexCoord2 = float2( value( rng ), value( rng ) );
+                    v.Color = rng();
+                }
+
+                submesh.second.resize( submesh.first.size() * 3 + 1 );
+                for ( VERTEX_INDEX& index : submesh.second ) {
+                    index = static_cast<VERTEX_INDEX>(rng());
+                }
+            }
+        }
+        geometry["EMPTY.TGA"].resize( 1 );
+        return geometry;
+    }
+
+    /** The entries hold exactly the geometry, in the order of the map */
+    void CheckSameAsGeometry( const std::vector<MeshCacheFormat::MeshCacheEntry>& entries, const MeshCacheFormat::MeshCacheGeometry& geometry ) {
+        size_t e = 0;
+        for ( auto const& it : geometry ) {
+            for ( auto const& submesh : it.second ) {
+                if ( e >= entries.size() ) {
+                    TEST_CHECK( false );
+                    return;
+                }
+
+                const MeshCacheFormat::MeshCacheEntry& entry = entries[e++];
+                TEST_CHECK( entry.Texture == it.first );
+                TEST_CHECK( entry.Vertices.size() == submesh.first.size() );
+                TEST_CHECK( entry.Indices.size() == submesh.second.size() );
+                TEST_CHECK( entry.Vertices.empty()
+                    || memcmp( &entry.Vertices[0], &submesh.first[0], submesh.first.size() * sizeof( ExVertexStruct ) ) == 0 );
+                TEST_CHECK( entry.Indices == submesh.second );
+            }
+        }
+        TEST_CHECK( e == entries.size() );
+    }
+
+    /** A written v2 file reads back bit-exact, with every blob aligned */
+    void TestVersion2RoundTrip() {
+        std::mt19937 rng( 4 );
+        const MeshCacheFormat::MeshCacheGeometry geometry = MakeGeometry( rng, 20, 500 );
+
+        std::vector<uint8_t> data;
+        MeshCacheFormat::WriteVersion2( geometry, data );
+        TEST_CHECK( WriteFile( "MeshCacheFormatTest.mcache", data ) );
+
+        const std::vector<uint8_t> file = ReadFile( "MeshCacheFormatTest.mcache" );
+        TEST_CHECK( file == data );
+        remove( "MeshCacheFormatTest.mcache" );
+
+        std::vector<MeshCacheFormat::MeshCacheEntry> entries;
+        TEST_CHECK( MeshCacheFormat::ReadVersion2( &file[0], file.size(), entries ) == XR_SUCCESS );
+        CheckSameAsGeometry( entries, geometry );
+
+        MeshCacheFormat::MeshCacheHeader header;
+        memcpy( &header, &file[0], sizeof( header ) );
+        TEST_CHECK( header.Version == MeshCacheFormat::VERSION_2 );
+        TEST_CHECK( header.FileSize == file.size() );
+
+        for ( uint32_t i = 0; i < header.NumSubmeshes; i++ ) {
+            MeshCacheFormat::MeshCacheSubmesh submesh;
+            memcpy( &submesh, &file[static_cast<size_t>(header.SubmeshesOffset) + i * sizeof( submesh )], sizeof( submesh ) );
+            TEST_CHECK( submesh.VerticesOffset % MeshCacheFormat::BLOB_ALIGNMENT == 0 );
+            TEST_CHECK( submesh.IndicesOffset % MeshCacheFormat::BLOB_ALIGNMENT == 0 );
+        }
+
+        // Writing the same geometry again gives the same file
+        std::vector<uint8_t> again;
+        MeshCacheFormat::WriteVersion2( geometry, again );
+        TEST_CHECK( again == data );
+    }
+
+    /** The shipped v1 file still loads */
+    void TestVersion1Fixture() {
+        const std::vector<uint8_t> file = ReadFile( std::string( TEST_DATA_DIR ) + "/MeshCacheV1.mcache" );
+        TEST_CHECK( !file.empty() );
+        if ( file.empty() ) {
+            return;
+        }
+
+        std::vector<MeshCacheFormat::MeshCacheEntry> entries;
+        TEST_CHECK( MeshCacheFormat::ReadVersion1( &file[0], file.size(), entries ) == XR_SUCCESS );
+        TEST_CHECK( entries.size() == 6 );
+
+        size_t e = 0;
+        for ( unsigned int t = 0; t < 3; t++ ) {
+            for ( unsigned int s = 0; s < FIXTURE_SUBMESHES[t] && e < entries.size(); s++ ) {
+                const MeshCacheFormat::MeshCacheEntry& entry = entries[e++];
+                const unsigned int numVertices = GetFixtureNumVertices( t, s );
+                TEST_CHECK( entry.Texture == FIXTURE_TEXTURES[t] );
+                TEST_CHECK( entry.Vertices.size() == numVertices );
+                TEST_CHECK( entry.Indices.size() == 3 * (numVertices - 2) );
+
+                for ( unsigned int i = 0; i < entry.Vertices.size(); i++ ) {
+                    const ExVertexStruct expected = MakeFixtureVertex( t, s, i );
+                    TEST_CHECK( memcmp( &entry.Vertices[i], &expected, sizeof( ExVertexStruct ) ) == 0 );
+                }
+                for ( unsigned int i = 0; i < entry.Indices.size(); i++ ) {
+                    TEST_CHECK( entry.Indices[i] == MakeFixtureIndex( numVertices, i ) );
+                }
+            }
+        }
+    }
+
+    /** Flipped bits fail the checksum and leave nothing behind */
+    void TestChecksum() {
+        std::mt19937 rng( 5 );
+        std::vector<uint8_t> data;
+        MeshCacheFormat::WriteVersion2( MakeGeometry( rng, 5, 100 ), data );
+
+        MeshCacheFormat::MeshCacheHeader header;
+        memcpy( &header, &data[0], sizeof( header ) );
+
+        const size_t checksumOffset = offsetof( MeshCacheFormat::MeshCacheHeader, Checksum );
+        const size_t positions[] = { checksumOffset, checksumOffset + 7, sizeof( header ), data.size() / 2, data.size() - 1 };
+        for ( size_t position : positions ) {
+            for ( unsigned int bit = 0; bit < 8; bit += 3 ) {
+                std::vector<uint8_t> damaged = data;
+                damaged[position] ^= 1 << bit;
+
+                std::vector<MeshCacheFormat::MeshCacheEntry> entries( 1 );
+                TEST_CHECK( MeshCacheFormat::ReadVersion2( &damaged[0], damaged.size(), entries ) == XR_FAILED );
+                TEST_CHECK( entries.empty() );
+            }
+        }
+    }
+
+    /** Files cut off anywhere fail, in both versions */
+    void TestTruncated() {
+        std::mt19937 rng( 6 );
+        std::vector<uint8_t> data;
+        MeshCacheFormat::WriteVersion2( MakeGeometry( rng, 5, 100 ), data );
+
+        for ( size_t size : { size_t( 0 ), size_t( 3 ), sizeof( MeshCacheFormat::MeshCacheHeader ) - 1,
+            sizeof( MeshCacheFormat::MeshCacheHeader ), data.size() / 2, data.size() - 1 } ) {
+            std::vector<MeshCacheFormat::MeshCacheEntry> entries;
+            TEST_CHECK( MeshCacheFormat::ReadVersion2( &data[0], size, entries ) == XR_FAILED );
+            TEST_CHECK( entries.empty() );
+        }
+
+        const std::vector<uint8_t> v1 = ReadFile( std::string( TEST_DATA_DIR ) + "/MeshCacheV1.mcache" );
+        if ( v1.empty() ) {
+            return;
+        }
+
+        for ( size_t size : { size_t( 0 ), size_t( 6 ), size_t( 9 ), size_t( 40 ), v1.size() / 2, v1.size() - 1 } ) {
+            std::vector<MeshCacheFormat::MeshCacheEntry> entries;
+            TEST_CHECK( MeshCacheFormat::ReadVersion1( &v1[0], size, entries ) == XR_FAILED );
+            TEST_CHECK( entries.empty() );
+        }
+    }
+
+    /** Prints how fast a world sized v2 file is written and read back */
+    void BenchmarkThroughput() {
+        std::mt19937 rng( 7 );
+        const MeshCacheFormat::MeshCacheGeometry geometry = MakeGeometry( rng, 200, 5000 );
+
+        std::vector<uint8_t> data;
+        const double writeMs = MeasureMilliseconds( 3, [&]() {
+            MeshCacheFormat::WriteVersion2( geometry, data );
+        } );
+
+        std::vector<MeshCacheFormat::MeshCacheEntry> entries;
+        const double readMs = MeasureMilliseconds( 5, [&]() {
+            MeshCacheFormat::ReadVersion2( &data[0], data.size(), entries );
+        } );
+
+        const double megabytes = data.size() / (1024.0 * 1024.0);
+        std::printf( "Mesh cache of %.1f MB: writing %.2f ms (%.0f MB/s), reading %.2f ms (%.0f MB/s)\n",
+            megabytes, writeMs, megabytes / writeMs * 1000.0, readMs, megabytes / readMs * 1000.0 );
+    }
+}
+
+int main() {
+    TestVersion2RoundTrip();
+    TestVersion1Fixture();
+    TestChecksum();
+    TestTruncated();
+    BenchmarkThroughput();
+    return TestResult();
+}
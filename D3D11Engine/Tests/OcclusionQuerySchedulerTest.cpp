@@ -0,0 +1,295 @@
+#include "TestPch.h"
+#include "OcclusionQueryScheduler.h"
+#include "TestCheck.h"
+#include <algorithm>
+
+namespace {
+    /** Answers the queries from a script instead of the GPU. NodeVisible is set for the leaves, a query finds
+        its nodes visible if any leaf below them was when it was issued. Its result arrives ResultDelay frames
+        after the one following the issue. */
+    class ScriptedOcclusionBackend : public BaseOcclusionQueryBackend {
+    public:
+        struct Query {
+            std::vector<unsigned int> Nodes;
+            unsigned int IssueFrame;
+            bool Visible;
+            bool Active;
+        };
+
+        explicit ScriptedOcclusionBackend( const std::vector<OcclusionQueryScheduler::TreeNode>& tree ) : Tree( tree ) {
+            NodeStates.assign( tree.size(), OCCLUSION_NODE_TESTABLE );
+            NodeVisible.assign( tree.size(), true );
+        }
+
+        void BeginFrame() {
+            Frame++;
+            IssuedThisFrame.clear();
+        }
+
+        EOcclusionNodeState GetNodeState( unsigned int node ) override {
+            return NodeStates[node];
+        }
+
+        unsigned int IssueQuery( const unsigned int* nodes, unsigned int numNodes ) override {
+            Query query;
+            query.Nodes.assign( nodes, nodes + numNodes );
+            query.IssueFrame = Frame;
+            query.Visible = false;
+            query.Active = true;
+            for ( unsigned int i = 0; i < numNodes; i++ ) {
+                query.Visible = query.Visible || IsSubtreeVisible( nodes[i] );
+            }
+
+            Queries.push_back( query );
+            IssuedThisFrame.push_back( static_cast<unsigned int>(Queries.size() - 1) );
+            return static_cast<unsigned int>(Queries.size() - 1);
+        }
+
+        bool GetQueryResult( unsigned int query, bool& outVisible ) override {
+            if ( query >= Queries.size() || !Queries[query].Active ) {
+                Errors++;
+                return false;
+            }
+
+            if ( Frame <= Queries[query].IssueFrame + ResultDelay ) {
+                return false;
+            }
+
+            outVisible = Queries[query].Visible;
+            return true;
+        }
+
+        void ReleaseQuery( unsigned int query ) override {
+            if ( query >= Queries.size() || !Queries[query].Active ) {
+                Errors++;
+                return;
+            }
+            Queries[query].Active = false;
+        }
+
+        /** Number of issued queries drawing the given node in the current frame */
+        unsigned int CountIssued( unsigned int node ) const {
+            unsigned int count = 0;
+            for ( unsigned int query : IssuedThisFrame ) {
+                count += static_cast<unsigned int>(std::count( Queries[query].Nodes.begin(), Queries[query].Nodes.end(), node ));
+            }
+            return count;
+        }
+
+        unsigned int CountActive() const {
+            return static_cast<unsigned int>(std::count_if( Queries.begin(), Queries.end(), []( const Query& q ) { return q.Active; } ));
+        }
+
+        bool IsSubtreeVisible( unsigned int node ) const {
+            if ( node == OcclusionQueryScheduler::NO_NODE )
+                return false;
+            if ( Tree[node].Leaf )
+                return NodeVisible[node];
+            return IsSubtreeVisible( Tree[node].Front ) || IsSubtreeVisible( Tree[node].Back );
+        }
+
+        std::vector<OcclusionQueryScheduler::TreeNode> Tree;
+        std::vector<EOcclusionNodeState> NodeStates;
+        std::vector<bool> NodeVisible;
+        unsigned int ResultDelay = 0;
+
+        std::vector<Query> Queries;
+        std::vector<unsigned int> IssuedThisFrame;
+        unsigned int Frame = 0;
+        unsigned int Errors = 0;
+    };
+
+    /** Complete binary tree with the children of node i at 2i + 1 and 2i + 2 */
+    std::vector<OcclusionQueryScheduler::TreeNode> MakeTree( unsigned int depth ) {
+        const unsigned int numNodes = (2u << depth) - 1;
+        const unsigned int firstLeaf = (1u << depth) - 1;
+
+        std::vector<OcclusionQueryScheduler::TreeNode> nodes( numNodes );
+        for ( unsigned int i = 0; i < numNodes; i++ ) {
+            nodes[i].Parent = i ? (i - 1) / 2 : OcclusionQueryScheduler::NO_NODE;
+            nodes[i].Leaf = i >= firstLeaf;
+            nodes[i].Front = nodes[i].Leaf ? OcclusionQueryScheduler::NO_NODE : 2 * i + 1;
+            nodes[i].Back = nodes[i].Leaf ? OcclusionQueryScheduler::NO_NODE : 2 * i + 2;
+        }
+        return nodes;
+    }
+
+    void RunFrame( OcclusionQueryScheduler& scheduler, ScriptedOcclusionBackend& backend ) {
+        backend.BeginFrame();
+        scheduler.Update( backend );
+    }
+
+    /** Leaves going out of sight and coming back, and their parent following them */
+    void TestVisibilityTransitions() {
+        // Root, two interior nodes 1 and 2, leaves 3 to 6. The camera is in the root.
+        OcclusionQueryScheduler scheduler;
+        scheduler.SetTree( MakeTree( 2 ) );
+        ScriptedOcclusionBackend backend( MakeTree( 2 ) );
+        backend.NodeStates[0] = OCCLUSION_NODE_ALWAYS_VISIBLE;
+        backend.NodeVisible[5] = false;
+
+        // Everything entering the frustum is visible right away and its leaves get queried
+        RunFrame( scheduler, backend );
+        for ( unsigned int node = 0; node < 7; node++ ) {
+            TEST_CHECK( scheduler.IsNodeVisible( node ) );
+        }
+        TEST_CHECK( backend.IssuedThisFrame.size() == 4 );
+        for ( unsigned int leaf = 3; leaf <= 6; leaf++ ) {
+            TEST_CHECK( backend.CountIssued( leaf ) == 1 );
+        }
+
+        // Leaf 5 turns out hidden and is queried again right away, the visible leaves wait
+        RunFrame( scheduler, backend );
+        TEST_CHECK( !scheduler.IsNodeVisible( 5 ) );
+        TEST_CHECK( scheduler.IsNodeVisible( 6 ) );
+        TEST_CHECK( scheduler.IsNodeVisible( 2 ) );
+        TEST_CHECK( backend.IssuedThisFrame.size() == 1 && backend.CountIssued( 5 ) == 1 );
+
+        // Leaf 6 goes as well once its next query is due, which takes node 2 with it
+        backend.NodeVisible[6] = false;
+        const unsigned int maxDelay = OcclusionQueryScheduler::VISIBLE_RECHECK_FRAMES + OcclusionQueryScheduler::VISIBLE_RECHECK_RANDOM_FRAMES + 2;
+        for ( unsigned int frame = 0; frame < maxDelay && scheduler.IsNodeVisible( 6 ); frame++ ) {
+            RunFrame( scheduler, backend );
+            TEST_CHECK( backend.CountIssued( 5 ) == 1 );
+        }
+        TEST_CHECK( !scheduler.IsNodeVisible( 6 ) );
+        TEST_CHECK( !scheduler.IsNodeVisible( 2 ) );
+        TEST_CHECK( scheduler.IsNodeVisible( 0 ) );
+        TEST_CHECK( scheduler.IsNodeVisible( 1 ) );
+
+        // From now on the hidden subtree is only queried through its root
+        RunFrame( scheduler, backend );
+        TEST_CHECK( backend.CountIssued( 2 ) == 1 );
+        TEST_CHECK( backend.CountIssued( 5 ) == 0 );
+        TEST_CHECK( backend.CountIssued( 6 ) == 0 );
+
+        // Once leaf 6 is back, node 2 finds it and draws its whole subtree until the leaves had their own queries
+        backend.NodeVisible[6] = true;
+        RunFrame( scheduler, backend );
+        TEST_CHECK( backend.CountIssued( 2 ) == 1 );
+        RunFrame( scheduler, backend );
+        TEST_CHECK( scheduler.IsNodeVisible( 2 ) );
+        TEST_CHECK( scheduler.IsNodeVisible( 5 ) );
+        TEST_CHECK( scheduler.IsNodeVisible( 6 ) );
+        TEST_CHECK( backend.CountIssued( 5 ) == 1 );
+        TEST_CHECK( backend.CountIssued( 6 ) == 1 );
+
+        RunFrame( scheduler, backend );
+        TEST_CHECK( !scheduler.IsNodeVisible( 5 ) );
+        TEST_CHECK( scheduler.IsNodeVisible( 6 ) );
+        TEST_CHECK( scheduler.IsNodeVisible( 2 ) );
+
+        TEST_CHECK( backend.Errors == 0 );
+    }
+
+    /** Leaves which stay hidden get grouped into multi-queries, and a group finding something splits up again */
+    void TestQueryBatching() {
+        // The interior nodes are always traversed, the 16 leaves are hidden
+        OcclusionQueryScheduler scheduler;
+        scheduler.SetTree( MakeTree( 4 ) );
+        ScriptedOcclusionBackend backend( MakeTree( 4 ) );
+        const unsigned int firstLeaf = 15;
+        const unsigned int numLeaves = 16;
+        for ( unsigned int node = 0; node < firstLeaf; node++ ) {
+            backend.NodeStates[node] = OCCLUSION_NODE_ALWAYS_VISIBLE;
+        }
+        for ( unsigned int leaf = firstLeaf; leaf < firstLeaf + numLeaves; leaf++ ) {
+            backend.NodeVisible[leaf] = false;
+        }
+
+        // One query per leaf until they were hidden often enough
+        for ( unsigned int frame = 0; frame < OcclusionQueryScheduler::STABLE_INVISIBLE_QUERIES; frame++ ) {
+            RunFrame( scheduler, backend );
+            TEST_CHECK( backend.IssuedThisFrame.size() == numLeaves );
+            TEST_CHECK( scheduler.GetStats().MultiQueries == 0 );
+        }
+
+        // Then fewer queries cover all of them, every leaf in exactly one
+        for ( unsigned int frame = 0; frame < 4; frame++ ) {
+            RunFrame( scheduler, backend );
+            const OcclusionQueryStats& stats = scheduler.GetStats();
+            TEST_CHECK( stats.MultiQueries > 0 );
+            TEST_CHECK( stats.Queries < numLeaves );
+            TEST_CHECK( stats.Queries == backend.IssuedThisFrame.size() );
+            for ( unsigned int leaf = firstLeaf; leaf < firstLeaf + numLeaves; leaf++ ) {
+                TEST_CHECK( backend.CountIssued( leaf ) == 1 );
+                TEST_CHECK( !scheduler.IsNodeVisible( leaf ) );
+            }
+            for ( unsigned int query : backend.IssuedThisFrame ) {
+                TEST_CHECK( backend.Queries[query].Nodes.size() <= OcclusionQueryScheduler::MAX_MULTI_QUERY_NODES );
+            }
+        }
+
+        // A leaf becoming visible makes its whole group visible, as the query can't tell which one it was
+        const unsigned int visibleLeaf = firstLeaf + 5;
+        std::vector<unsigned int> group;
+        for ( unsigned int query : backend.IssuedThisFrame ) {
+            const std::vector<unsigned int>& nodes = backend.Queries[query].Nodes;
+            if ( std::find( nodes.begin(), nodes.end(), visibleLeaf ) != nodes.end() ) {
+                group = nodes;
+            }
+        }
+        TEST_CHECK( group.size() > 1 );
+
+        backend.NodeVisible[visibleLeaf] = true;
+        RunFrame( scheduler, backend );
+        RunFrame( scheduler, backend );
+        TEST_CHECK( scheduler.GetStats().MultiQueryFailures == 1 );
+        for ( unsigned int leaf : group ) {
+            TEST_CHECK( scheduler.IsNodeVisible( leaf ) );
+            TEST_CHECK( backend.CountIssued( leaf ) == 1 );
+        }
+
+        // Their own queries sort it out
+        for ( unsigned int query : backend.IssuedThisFrame ) {
+            const std::vector<unsigned int>& nodes = backend.Queries[query].Nodes;
+            for ( unsigned int leaf : group ) {
+                if ( std::find( nodes.begin(), nodes.end(), leaf ) != nodes.end() ) {
+                    TEST_CHECK( nodes.size() == 1 );
+                }
+            }
+        }
+
+        RunFrame( scheduler, backend );
+        for ( unsigned int leaf : group ) {
+            TEST_CHECK( scheduler.IsNodeVisible( leaf ) == (leaf == visibleLeaf) );
+        }
+
+        TEST_CHECK( backend.Errors == 0 );
+    }
+
+    /** Results arriving late are waited for without stalling and without querying the same node twice */
+    void TestPendingResults() {
+        OcclusionQueryScheduler scheduler;
+        scheduler.SetTree( MakeTree( 2 ) );
+        ScriptedOcclusionBackend backend( MakeTree( 2 ) );
+        backend.NodeStates[0] = OCCLUSION_NODE_ALWAYS_VISIBLE;
+        backend.NodeVisible[4] = false;
+        backend.ResultDelay = 2;
+
+        RunFrame( scheduler, backend );
+        TEST_CHECK( scheduler.GetStats().Queries == 4 );
+
+        for ( unsigned int frame = 0; frame < backend.ResultDelay; frame++ ) {
+            RunFrame( scheduler, backend );
+            TEST_CHECK( scheduler.GetStats().ResultsPending == 4 );
+            TEST_CHECK( scheduler.GetStats().Queries == 0 );
+            TEST_CHECK( scheduler.IsNodeVisible( 4 ) );
+        }
+
+        RunFrame( scheduler, backend );
+        TEST_CHECK( scheduler.GetStats().ResultsPending == 0 );
+        TEST_CHECK( !scheduler.IsNodeVisible( 4 ) );
+        TEST_CHECK( backend.CountIssued( 4 ) == 1 );
+        TEST_CHECK( backend.CountActive() == 1 );
+
+        TEST_CHECK( backend.Errors == 0 );
+    }
+}
+
+int main() {
+    TestVisibilityTransitions();
+    TestQueryBatching();
+    TestPendingResults();
+    return TestResult();
+}
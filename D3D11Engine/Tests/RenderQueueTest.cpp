@@ -0,0 +1,253 @@
+#include "TestPch.h"
+#include "RenderQueue.h"
+#include "TestCheck.h"
+#include <map>
+#include <random>
+#include <set>
+#include <tuple>
+
+namespace {
+    const unsigned int NUM_SHADERS = 5;
+    const unsigned int NUM_MATERIALS = 40;
+    const unsigned int NUM_GEOMETRIES = 3;
+
+    /** Only the addresses are used as handles */
+    char Shaders[NUM_SHADERS];
+    char Materials[NUM_MATERIALS];
+    char Geometries[NUM_GEOMETRIES];
+
+    /** Random packets in two passes. Every material belongs to one shader, like textures do in the world mesh.
+        FirstIndex is the number of the packet, to find it again. Depths are whole numbers, which the quantized
+        sort key keeps apart. */
+    std::vector<RenderPacket> MakePackets( std::mt19937& rng, unsigned int count ) {
+        std::vector<RenderPacket> packets( count );
+        for ( unsigned int i = 0; i < count; i++ ) {
+            const unsigned int material = rng() % NUM_MATERIALS;
+
+            RenderPacket& packet = packets[i];
+            packet.Pass = rng() % 2;
+            packet.Shader = &Shaders[material % NUM_SHADERS];
+            packet.Material = &Materials[material];
+            packet.Geometry = &Geometries[rng() % NUM_GEOMETRIES];
+            packet.Data = nullptr;
+            packet.Depth = static_cast<float>(1 + rng() % 10000);
+            packet.NumIndices = 3;
+            packet.FirstIndex = i;
+        }
+        return packets;
+    }
+
+    /** The draws of a replay, in order */
+    std::vector<const RenderPacket*> GetDraws( const RecordingRenderQueueBackend& backend ) {
+        std::vector<const RenderPacket*> draws;
+        for ( const auto& command : backend.GetCommands() ) {
+            if ( command.Type == RecordingRenderQueueBackend::CMD_DRAW ) {
+                draws.push_back( command.Packet );
+            }
+        }
+        return draws;
+    }
+
+    unsigned int CountCommands( const RecordingRenderQueueBackend& backend, RecordingRenderQueueBackend::ECommand type ) {
+        unsigned int count = 0;
+        for ( const auto& command : backend.GetCommands() ) {
+            count += command.Type == type ? 1 : 0;
+        }
+        return count;
+    }
+
+    /** Every packet added is drawn exactly once */
+    void CheckDrawnOnce( const std::vector<const RenderPacket*>& draws, unsigned int numPackets ) {
+        TEST_CHECK( draws.size() == numPackets );
+
+        std::vector<unsigned int> timesDrawn( numPackets, 0 );
+        for ( const RenderPacket* packet : draws ) {
+            if ( packet->FirstIndex < numPackets ) {
+                timesDrawn[packet->FirstIndex]++;
+            }
+        }
+
+        for ( unsigned int n : timesDrawn ) {
+            TEST_CHECK( n == 1 );
+        }
+    }
+
+    /** Draws are ordered by pass, shader and material, handles numbered in the order they were first added,
+        and front to back where all of those are the same */
+    void TestSortOrder() {
+        std::mt19937 rng( 23 );
+        const std::vector<RenderPacket> packets = MakePackets( rng, 5000 );
+
+        std::map<void*, unsigned int> shaderIDs;
+        std::map<void*, unsigned int> materialIDs;
+        RenderQueue queue;
+        for ( const RenderPacket& packet : packets ) {
+            shaderIDs.emplace( packet.Shader, static_cast<unsigned int>(shaderIDs.size()) );
+            materialIDs.emplace( packet.Material, static_cast<unsigned int>(materialIDs.size()) );
+            queue.Add( packet );
+        }
+
+        RecordingRenderQueueBackend backend;
+        queue.Submit( backend );
+
+        const std::vector<const RenderPacket*> draws = GetDraws( backend );
+        CheckDrawnOnce( draws, queue.GetNumPackets() );
+
+        for ( size_t i = 1; i < draws.size(); i++ ) {
+            const RenderPacket& a = *draws[i - 1];
+            const RenderPacket& b = *draws[i];
+            const auto keyA = std::make_tuple( a.Pass, shaderIDs[a.Shader], materialIDs[a.Material] );
+            const auto keyB = std::make_tuple( b.Pass, shaderIDs[b.Shader], materialIDs[b.Material] );
+            TEST_CHECK( keyA <= keyB );
+            if ( keyA == keyB ) {
+                TEST_CHECK( a.Depth <= b.Depth );
+            }
+        }
+    }
+
+    /** State is bound once per run of packets sharing it, and the stats count the same */
+    void TestStateChanges() {
+        std::mt19937 rng( 24 );
+        const std::vector<RenderPacket> packets = MakePackets( rng, 3000 );
+
+        RenderQueue queue;
+        std::set<std::pair<unsigned int, void*>> passMaterials;
+        std::set<unsigned int> passes;
+        for ( const RenderPacket& packet : packets ) {
+            passMaterials.emplace( packet.Pass, packet.Material );
+            passes.insert( packet.Pass );
+            queue.Add( packet );
+        }
+
+        RecordingRenderQueueBackend backend;
+        queue.Submit( backend );
+        const RenderQueueStats& stats = queue.GetStats();
+
+        // Materials belong to one shader, so every material of a pass is one run
+        TEST_CHECK( stats.Packets == packets.size() );
+        TEST_CHECK( stats.Passes == passes.size() );
+        TEST_CHECK( stats.MaterialChanges == passMaterials.size() );
+        TEST_CHECK( stats.ShaderChanges == 2 * NUM_SHADERS );
+        TEST_CHECK( CountCommands( backend, RecordingRenderQueueBackend::CMD_BEGIN_PASS ) == stats.Passes );
+        TEST_CHECK( CountCommands( backend, RecordingRenderQueueBackend::CMD_BIND_SHADER ) == stats.ShaderChanges );
+        TEST_CHECK( CountCommands( backend, RecordingRenderQueueBackend::CMD_BIND_MATERIAL ) == stats.MaterialChanges );
+        TEST_CHECK( CountCommands( backend, RecordingRenderQueueBackend::CMD_BIND_GEOMETRY ) == stats.GeometryChanges );
+
+        // Each draw comes after the binds of its own state, and nothing is bound twice in a row
+        const RenderPacket* shader = nullptr;
+        const RenderPacket* material = nullptr;
+        const RenderPacket* geometry = nullptr;
+        for ( const auto& command : backend.GetCommands() ) {
+            switch ( command.Type ) {
+            case RecordingRenderQueueBackend::CMD_BEGIN_PASS:
+                shader = material = geometry = nullptr;
+                break;
+            case RecordingRenderQueueBackend::CMD_BIND_SHADER:
+                TEST_CHECK( !shader || shader->Shader != command.Packet->Shader );
+                shader = command.Packet;
+                break;
+            case RecordingRenderQueueBackend::CMD_BIND_MATERIAL:
+                TEST_CHECK( !material || material->Material != command.Packet->Material );
+                material = command.Packet;
+                break;
+            case RecordingRenderQueueBackend::CMD_BIND_GEOMETRY:
+                TEST_CHECK( !geometry || geometry->Geometry != command.Packet->Geometry );
+                geometry = command.Packet;
+                break;
+            case RecordingRenderQueueBackend::CMD_DRAW:
+                TEST_CHECK( shader && shader->Shader == command.Packet->Shader );
+                TEST_CHECK( material && material->Material == command.Packet->Material );
+                TEST_CHECK( geometry && geometry->Geometry == command.Packet->Geometry );
+                break;
+            }
+        }
+
+        // Submitting again without Clear gives the same stats
+        backend.Clear();
+        queue.Submit( backend );
+        TEST_CHECK( queue.GetStats().MaterialChanges == passMaterials.size() );
+        TEST_CHECK( GetDraws( backend ).size() == packets.size() );
+    }
+
+    /** Ranges replayed on their own draw the same packets in the same order as the whole queue, each starting
+        with all of its state bound */
+    void TestReplayRanges() {
+        std::mt19937 rng( 25 );
+        const std::vector<RenderPacket> packets = MakePackets( rng, 1000 );
+
+        RenderQueue queue;
+        for ( const RenderPacket& packet : packets ) {
+            queue.Add( packet );
+        }
+        queue.Sort();
+
+        RecordingRenderQueueBackend whole;
+        RenderQueueStats wholeStats = {};
+        queue.Replay( whole, 0, queue.GetNumPackets(), wholeStats );
+
+        std::vector<const RenderPacket*> draws;
+        RenderQueueStats rangeStats = {};
+        for ( unsigned int first = 0; first < queue.GetNumPackets(); first += 77 ) {
+            const unsigned int count = std::min( 77u, queue.GetNumPackets() - first );
+
+            RecordingRenderQueueBackend backend;
+            queue.Replay( backend, first, count, rangeStats );
+
+            const auto& commands = backend.GetCommands();
+            TEST_CHECK( commands.size() >= 5 );
+            TEST_CHECK( commands[0].Type == RecordingRenderQueueBackend::CMD_BEGIN_PASS );
+            TEST_CHECK( commands[1].Type == RecordingRenderQueueBackend::CMD_BIND_SHADER );
+            TEST_CHECK( commands[2].Type == RecordingRenderQueueBackend::CMD_BIND_MATERIAL );
+            TEST_CHECK( commands[3].Type == RecordingRenderQueueBackend::CMD_BIND_GEOMETRY );
+
+            const std::vector<const RenderPacket*> rangeDraws = GetDraws( backend );
+            draws.insert( draws.end(), rangeDraws.begin(), rangeDraws.end() );
+        }
+
+        TEST_CHECK( draws == GetDraws( whole ) );
+        TEST_CHECK( rangeStats.Packets == wholeStats.Packets );
+        TEST_CHECK( rangeStats.MaterialChanges >= wholeStats.MaterialChanges );
+    }
+
+    /** Null handles, depths behind the camera or NaN and more materials than the key has bits for still draw
+        everything once */
+    void TestEdgeCases() {
+        RenderQueue queue;
+        RecordingRenderQueueBackend backend;
+        queue.Submit( backend );
+        TEST_CHECK( backend.GetCommands().empty() );
+        TEST_CHECK( queue.GetStats().Packets == 0 );
+
+        const float depths[] = { 0.0f, -5.0f, NAN, INFINITY, 1e-30f, 3.0f };
+        const unsigned int numPackets = 6000;
+        std::vector<char> manyShaders( numPackets );
+        for ( unsigned int i = 0; i < numPackets; i++ ) {
+            RenderPacket packet = {};
+            packet.Pass = i % 3 == 0 ? 100 : 0;
+            packet.Shader = i % 7 ? &manyShaders[i] : nullptr;
+            packet.Material = i % 5 ? nullptr : &Materials[i % NUM_MATERIALS];
+            packet.Depth = depths[i % 6];
+            packet.FirstIndex = i;
+            queue.Add( packet );
+        }
+
+        queue.Submit( backend );
+        CheckDrawnOnce( GetDraws( backend ), numPackets );
+
+        // Passes past the last one are clamped in the key only, the packet keeps its pass
+        TEST_CHECK( GetDraws( backend ).back()->Pass == 100 );
+
+        queue.Clear();
+        backend.Clear();
+        queue.Submit( backend );
+        TEST_CHECK( backend.GetCommands().empty() );
+    }
+}
+
+int main() {
+    TestSortOrder();
+    TestStateChanges();
+    TestReplayRanges();
+    TestEdgeCases();
+    return TestResult();
+}
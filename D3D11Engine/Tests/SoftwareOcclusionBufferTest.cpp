@@ -0,0 +1,197 @@
+#include "TestPch.h"
+#include "SoftwareOcclusionBuffer.h"
+#include "Engine.h"
+#include "ThreadPool.h"
+#include "TestCheck.h"
+
+namespace {
+    const unsigned int BUFFER_SIZE = 256;
+
+    /** Rasterize spreads the bands over the worker threads from this many triangles on, like in SoftwareOcclusionBuffer.cpp */
+    const unsigned int PARALLEL_MIN_TRIANGLES = 1024;
+
+    /** Camera at the origin looking along +z with a 90 degree field of view, for row-vectors. Screen x
+        is (x / z * 0.5 + 0.5) * BUFFER_SIZE. */
+    XMMATRIX MakeViewProj() {
+        const float nearPlane = 1.0f;
+        const float farPlane = 20000.0f;
+        const float a = farPlane / (farPlane - nearPlane);
+        return XMMATRIX(
+            1.0f, 0.0f, 0.0f, 0.0f,
+            0.0f, 1.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, a, 1.0f,
+            0.0f, 0.0f, -nearPlane * a, 0.0f );
+    }
+
+    /** World space x at depth z which lands on the given screen x */
+    float ScreenToWorldX( float screenX, float z ) {
+        return (screenX / BUFFER_SIZE - 0.5f) * 2.0f * z;
+    }
+
+    /** A square wall of size x size quads facing the camera, centered on the view axis at depth z. Each row of
+        quads leans back a bit, so the depth isn't the same everywhere. */
+    void AddWall( SoftwareOcclusionBuffer& buffer, float halfSize, float z, unsigned int size ) {
+        std::vector<XMFLOAT3> positions;
+        for ( unsigned int y = 0; y <= size; y++ ) {
+            for ( unsigned int x = 0; x <= size; x++ ) {
+                const float px = -halfSize + 2.0f * halfSize * x / size;
+                const float py = -halfSize + 2.0f * halfSize * y / size;
+                positions.push_back( XMFLOAT3( px, py, z + py * 0.25f ) );
+            }
+        }
+
+        std::vector<VERTEX_INDEX> indices;
+        for ( unsigned int y = 0; y < size; y++ ) {
+            for ( unsigned int x = 0; x < size; x++ ) {
+                const VERTEX_INDEX i = static_cast<VERTEX_INDEX>(y * (size + 1) + x);
+                const VERTEX_INDEX right = static_cast<VERTEX_INDEX>(i + 1);
+                const VERTEX_INDEX up = static_cast<VERTEX_INDEX>(i + size + 1);
+                indices.insert( indices.end(), { i, up, right, right, up, static_cast<VERTEX_INDEX>(up + 1) } );
+            }
+        }
+
+        buffer.AddOccluder( &positions[0], sizeof( XMFLOAT3 ), static_cast<unsigned int>(positions.size()),
+            &indices[0], static_cast<unsigned int>(indices.size()) );
+    }
+
+    zTBBox3D MakeBox( float minX, float minY, float minZ, float maxX, float maxY, float maxZ ) {
+        zTBBox3D box;
+        box.Min = XMFLOAT3( minX, minY, minZ );
+        box.Max = XMFLOAT3( maxX, maxY, maxZ );
+        return box;
+    }
+
+    /** A flat wall at depth 100, covering screen x and y from 102.4 to 153.6 */
+    void DrawFlatWall( SoftwareOcclusionBuffer& buffer ) {
+        buffer.Resize( BUFFER_SIZE, BUFFER_SIZE );
+        buffer.BeginFrame( MakeViewProj() );
+
+        const XMFLOAT3 positions[] = {
+            XMFLOAT3( -20.0f, -20.0f, 100.0f ), XMFLOAT3( 20.0f, -20.0f, 100.0f ),
+            XMFLOAT3( -20.0f, 20.0f, 100.0f ), XMFLOAT3( 20.0f, 20.0f, 100.0f ),
+        };
+        const VERTEX_INDEX indices[] = { 0, 2, 1, 1, 2, 3 };
+        buffer.AddOccluder( positions, sizeof( XMFLOAT3 ), 4, indices, 6 );
+        buffer.Rasterize();
+    }
+
+    /** Boxes completely behind the wall are hidden, ones reaching a pixel past its edge are not */
+    void TestWallEdges() {
+        SoftwareOcclusionBuffer buffer;
+        DrawFlatWall( buffer );
+        TEST_CHECK( buffer.GetNumTriangles() == 2 );
+
+        const float z0 = 190.0f;
+        const float z1 = 210.0f;
+        const float inside = ScreenToWorldX( 151.5f, z0 );
+        const float pastEdge = ScreenToWorldX( 154.6f, z0 );
+        const float justPastEdge = ScreenToWorldX( 153.8f, z0 );
+
+        // Well inside, and up to a pixel and a half from the edge, on all four sides
+        TEST_CHECK( !buffer.IsBoxVisible( MakeBox( -5.0f, -5.0f, z0, 5.0f, 5.0f, z1 ) ) );
+        TEST_CHECK( !buffer.IsBoxVisible( MakeBox( 0.0f, -5.0f, z0, inside, 5.0f, z1 ) ) );
+        TEST_CHECK( !buffer.IsBoxVisible( MakeBox( -inside, -5.0f, z0, 0.0f, 5.0f, z1 ) ) );
+        TEST_CHECK( !buffer.IsBoxVisible( MakeBox( -5.0f, 0.0f, z0, 5.0f, inside, z1 ) ) );
+        TEST_CHECK( !buffer.IsBoxVisible( MakeBox( -5.0f, -inside, z0, 5.0f, 0.0f, z1 ) ) );
+
+        // Peeking out by a pixel on any side
+        TEST_CHECK( buffer.IsBoxVisible( MakeBox( 0.0f, -5.0f, z0, pastEdge, 5.0f, z1 ) ) );
+        TEST_CHECK( buffer.IsBoxVisible( MakeBox( -pastEdge, -5.0f, z0, 0.0f, 5.0f, z1 ) ) );
+        TEST_CHECK( buffer.IsBoxVisible( MakeBox( -5.0f, 0.0f, z0, 5.0f, pastEdge, z1 ) ) );
+        TEST_CHECK( buffer.IsBoxVisible( MakeBox( -5.0f, -pastEdge, z0, 5.0f, 0.0f, z1 ) ) );
+
+        // Peeking out by less than a pixel, the covered pixel center of the edge pixel must not hide it
+        TEST_CHECK( buffer.IsBoxVisible( MakeBox( 0.0f, -5.0f, z0, justPastEdge, 5.0f, z1 ) ) );
+        TEST_CHECK( buffer.IsBoxVisible( MakeBox( -justPastEdge, -5.0f, z0, 0.0f, 5.0f, z1 ) ) );
+        TEST_CHECK( buffer.IsBoxVisible( MakeBox( -5.0f, 0.0f, z0, 5.0f, justPastEdge, z1 ) ) );
+        TEST_CHECK( buffer.IsBoxVisible( MakeBox( -5.0f, -justPastEdge, z0, 5.0f, 0.0f, z1 ) ) );
+
+        // In front of the wall, reaching into it, and beside it
+        TEST_CHECK( buffer.IsBoxVisible( MakeBox( -5.0f, -5.0f, 50.0f, 5.0f, 5.0f, 60.0f ) ) );
+        TEST_CHECK( buffer.IsBoxVisible( MakeBox( -5.0f, -5.0f, 95.0f, 5.0f, 5.0f, 150.0f ) ) );
+        TEST_CHECK( buffer.IsBoxVisible( MakeBox( 60.0f, -5.0f, z0, 80.0f, 5.0f, z1 ) ) );
+
+        // Off the screen, left to frustum culling
+        TEST_CHECK( buffer.IsBoxVisible( MakeBox( -5.0f, -5.0f, -60.0f, 5.0f, 5.0f, -50.0f ) ) );
+    }
+
+    /** Boxes reaching behind the near plane are always visible, even where they are behind the wall elsewhere */
+    void TestNearPlane() {
+        SoftwareOcclusionBuffer buffer;
+        DrawFlatWall( buffer );
+
+        TEST_CHECK( buffer.IsBoxVisible( MakeBox( -1.0f, -1.0f, -10.0f, 1.0f, 1.0f, 500.0f ) ) );
+        TEST_CHECK( buffer.IsBoxVisible( MakeBox( -1.0f, -1.0f, 0.5f, 1.0f, 1.0f, 500.0f ) ) );
+        TEST_CHECK( !buffer.IsBoxVisible( MakeBox( -1.0f, -1.0f, 150.0f, 1.0f, 1.0f, 500.0f ) ) );
+
+        // A wall crossing the near plane is clipped, what's left still hides things
+        buffer.BeginFrame( MakeViewProj() );
+        const XMFLOAT3 positions[] = {
+            XMFLOAT3( -2000.0f, -2000.0f, -50.0f ), XMFLOAT3( 2000.0f, -2000.0f, -50.0f ),
+            XMFLOAT3( -2000.0f, 2000.0f, 350.0f ), XMFLOAT3( 2000.0f, 2000.0f, 350.0f ),
+        };
+        const VERTEX_INDEX indices[] = { 0, 2, 1, 1, 2, 3 };
+        buffer.AddOccluder( positions, sizeof( XMFLOAT3 ), 4, indices, 6 );
+        buffer.Rasterize();
+
+        TEST_CHECK( buffer.GetNumTriangles() > 0 );
+        TEST_CHECK( !buffer.IsBoxVisible( MakeBox( -5.0f, 95.0f, 1000.0f, 5.0f, 105.0f, 1010.0f ) ) );
+        TEST_CHECK( buffer.IsBoxVisible( MakeBox( -5.0f, -5.0f, 0.0f, 5.0f, 5.0f, 1010.0f ) ) );
+    }
+
+    /** Draws a tessellated wall, optionally with a second one hidden behind it. The hidden one doesn't change a
+        single pixel, but gets the triangle count past PARALLEL_MIN_TRIANGLES. */
+    void DrawTessellatedWalls( SoftwareOcclusionBuffer& buffer, bool hiddenWall ) {
+        buffer.Resize( BUFFER_SIZE, BUFFER_SIZE );
+        buffer.BeginFrame( MakeViewProj() );
+        AddWall( buffer, 30.0f, 100.0f, 20 );
+        if ( hiddenWall ) {
+            AddWall( buffer, 900.0f, 5000.0f, 24 );
+        }
+        buffer.Rasterize();
+    }
+
+    bool IsSameDepth( const SoftwareOcclusionBuffer& a, const SoftwareOcclusionBuffer& b ) {
+        for ( unsigned int y = 0; y < a.GetHeight(); y++ ) {
+            for ( unsigned int x = 0; x < a.GetWidth(); x++ ) {
+                const float da = a.GetDepth( x, y );
+                const float db = b.GetDepth( x, y );
+                if ( memcmp( &da, &db, sizeof( float ) ) != 0 ) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    /** Drawing the bands on the worker threads gives exactly the same depth as drawing them one after another */
+    void TestSerialAndParallel() {
+        Engine::WorkerThreadPool = nullptr;
+        SoftwareOcclusionBuffer serial;
+        DrawTessellatedWalls( serial, false );
+        TEST_CHECK( serial.GetNumTriangles() < PARALLEL_MIN_TRIANGLES );
+
+        Engine::WorkerThreadPool = new ThreadPool( 3 );
+        for ( unsigned int run = 0; run < 20; run++ ) {
+            SoftwareOcclusionBuffer parallel;
+            DrawTessellatedWalls( parallel, true );
+            TEST_CHECK( parallel.GetNumTriangles() >= PARALLEL_MIN_TRIANGLES );
+            TEST_CHECK( IsSameDepth( serial, parallel ) );
+        }
+
+        // Not a trivial comparison: the wall covers the middle, the corners are empty
+        const unsigned int center = BUFFER_SIZE / 2;
+        TEST_CHECK( serial.GetDepth( center, center ) > 0.0f );
+        TEST_CHECK( serial.GetDepth( 0, 0 ) == 0.0f );
+
+        delete Engine::WorkerThreadPool;
+        Engine::WorkerThreadPool = nullptr;
+    }
+}
+
+int main() {
+    TestWallEdges();
+    TestNearPlane();
+    TestSerialAndParallel();
+    return TestResult();
+}
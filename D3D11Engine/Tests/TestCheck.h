@@ -0,0 +1,43 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+/** Number of failed TEST_CHECKs so far */
+inline int& GetFailedTestChecks() {
+    static int failed = 0;
+    return failed;
+}
+
+/** Reports the expression if it is false. Testing goes on, main returns TestResult() at the end. */
+#define TEST_CHECK( x ) \
+    do { \
+        if ( !(x) ) { \
+            std::printf( "%s(%d): check failed: %s\n", __FILE__, __LINE__, #x ); \
+            GetFailedTestChecks()++; \
+        } \
+    } while ( false )
+
+/** Exit code of a test executable */
+inline int TestResult() {
+    if ( GetFailedTestChecks() ) {
+        std::printf( "%d checks failed\n", GetFailedTestChecks() );
+        return 1;
+    }
+
+    std::printf( "All checks passed\n" );
+    return 0;
+}
+
+/** Fastest of the given number of runs of f in milliseconds, for the benchmarks the tests print */
+template<typename F>
+double MeasureMilliseconds( unsigned int runs, F&& f ) {
+    double fastest = 0.0;
+    for ( unsigned int i = 0; i < runs; i++ ) {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        const double ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+        fastest = i == 0 ? ms : std::min( fastest, ms );
+    }
+    return fastest;
+}
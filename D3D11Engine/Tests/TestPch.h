@@ -0,0 +1,18 @@
+#pragma once
+
+/** Included by the tests instead of the engine's pch.h, which needs Windows and Direct3D. Engine headers which
+    are tested on every platform include what they need themselves. */
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if __has_include( <DirectXMath.h> )
+#include <DirectXMath.h>
+using namespace DirectX;
+#endif
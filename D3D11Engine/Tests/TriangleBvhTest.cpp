@@ -0,0 +1,201 @@
+#include "TestPch.h"
+#include "TriangleBvh.h"
+#include "TestCheck.h"
+#include <random>
+
+namespace {
+    /** Closest hit by testing every triangle, with the same test the tree uses */
+    struct BruteForceHit {
+        unsigned int Triangle = TriangleBvh::NO_TRIANGLE;
+        float Distance = FLT_MAX;
+    };
+
+    BruteForceHit TraceBruteForce( const std::vector<XMFLOAT3>& positions, const XMFLOAT3& origin, const XMFLOAT3& dir, float maxDistance ) {
+        auto sub = []( const XMFLOAT3& a, const XMFLOAT3& b ) { return XMFLOAT3( a.x - b.x, a.y - b.y, a.z - b.z ); };
+        auto cross = []( const XMFLOAT3& a, const XMFLOAT3& b ) { return XMFLOAT3( a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x ); };
+        auto dot = []( const XMFLOAT3& a, const XMFLOAT3& b ) { return a.x * b.x + a.y * b.y + a.z * b.z; };
+
+        BruteForceHit hit;
+        float closest = maxDistance;
+        for ( unsigned int i = 0; i < positions.size() / 3; i++ ) {
+            const XMFLOAT3& v0 = positions[i * 3];
+            const XMFLOAT3 edge1 = sub( positions[i * 3 + 1], v0 );
+            const XMFLOAT3 edge2 = sub( positions[i * 3 + 2], v0 );
+
+            const XMFLOAT3 pvec = cross( dir, edge2 );
+            const float det = dot( edge1, pvec );
+            if ( det > -0.00001f && det < 0.00001f )
+                continue;
+
+            const float invDet = 1.0f / det;
+            const XMFLOAT3 tvec = sub( origin, v0 );
+            const float u = dot( tvec, pvec ) * invDet;
+            if ( u < 0.0f || u > 1.0f )
+                continue;
+
+            const XMFLOAT3 qvec = cross( tvec, edge1 );
+            const float v = dot( dir, qvec ) * invDet;
+            if ( v < 0.0f || u + v > 1.0f )
+                continue;
+
+            const float t = dot( edge2, qvec ) * invDet;
+            if ( t > 0.0f && t < closest ) {
+                closest = t;
+                hit.Triangle = i;
+                hit.Distance = t;
+            }
+        }
+        return hit;
+    }
+
+    /** Random triangles of very different sizes, with duplicates, slivers and triangles collapsed into points */
+    std::vector<XMFLOAT3> MakeSoup( std::mt19937& rng, unsigned int numTriangles ) {
+        std::uniform_real_distribution<float> unit( 0.0f, 1.0f );
+        std::vector<XMFLOAT3> positions;
+        for ( unsigned int i = 0; i < numTriangles; i++ ) {
+            const XMFLOAT3 center( unit( rng ) * 10000.0f, unit( rng ) * 2000.0f, unit( rng ) * 10000.0f );
+            const float size = 10.0f + unit( rng ) * (i % 50 == 0 ? 3000.0f : 300.0f);
+            for ( int k = 0; k < 3; k++ ) {
+                positions.emplace_back( center.x + (unit( rng ) - 0.5f) * size, center.y + (unit( rng ) - 0.5f) * size, center.z + (unit( rng ) - 0.5f) * size );
+            }
+        }
+
+        for ( unsigned int i = 0; i < 20; i++ ) {
+            positions.insert( positions.end(), positions.begin(), positions.begin() + 3 );
+        }
+        for ( unsigned int i = 0; i < 10; i++ ) {
+            const XMFLOAT3 p( unit( rng ) * 10000.0f, unit( rng ) * 2000.0f, unit( rng ) * 10000.0f );
+            positions.insert( positions.end(), { p, p, p } );
+            positions.insert( positions.end(), { p, XMFLOAT3( p.x + 500.0f, p.y, p.z ), XMFLOAT3( p.x + 1000.0f, p.y, p.z ) } );
+        }
+        return positions;
+    }
+
+    /** Flat and tilted quads on a grid, so axis-parallel rays run along edges and through shared corners */
+    std::vector<XMFLOAT3> MakeGrid( unsigned int size ) {
+        std::vector<XMFLOAT3> positions;
+        auto height = []( unsigned int x, unsigned int z ) { return ((x / 4 + z / 3) % 2) ? 0.0f : static_cast<float>(x % 5) * 20.0f; };
+        for ( unsigned int z = 0; z < size; z++ ) {
+            for ( unsigned int x = 0; x < size; x++ ) {
+                const XMFLOAT3 a( x * 100.0f, height( x, z ), z * 100.0f );
+                const XMFLOAT3 b( (x + 1) * 100.0f, height( x + 1, z ), z * 100.0f );
+                const XMFLOAT3 c( x * 100.0f, height( x, z + 1 ), (z + 1) * 100.0f );
+                const XMFLOAT3 d( (x + 1) * 100.0f, height( x + 1, z + 1 ), (z + 1) * 100.0f );
+                positions.insert( positions.end(), { a, b, c, b, d, c } );
+            }
+        }
+        return positions;
+    }
+
+    struct TestRay {
+        XMFLOAT3 Origin;
+        XMFLOAT3 Dir;
+        float MaxDistance;
+    };
+
+    /** Random rays, axis-parallel ones starting on grid lines, short ones and ones without a direction */
+    std::vector<TestRay> MakeRays( std::mt19937& rng, unsigned int numRays, float extent ) {
+        std::uniform_real_distribution<float> unit( 0.0f, 1.0f );
+        const XMFLOAT3 axes[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+
+        std::vector<TestRay> rays( numRays );
+        for ( unsigned int i = 0; i < numRays; i++ ) {
+            TestRay& ray = rays[i];
+            ray.Origin = XMFLOAT3( unit( rng ) * extent, unit( rng ) * 2500.0f - 250.0f, unit( rng ) * extent );
+            ray.Dir = XMFLOAT3( unit( rng ) - 0.5f, unit( rng ) - 0.5f, unit( rng ) - 0.5f );
+            ray.MaxDistance = (i % 3 == 0) ? 3000.0f : FLT_MAX;
+
+            switch ( i % 8 ) {
+            case 1:
+                ray.Dir = axes[i / 8 % 6];
+                break;
+            case 2:
+                // On a grid line, so it meets edges and corners exactly
+                ray.Origin.x = floorf( ray.Origin.x / 100.0f ) * 100.0f;
+                ray.Origin.z = floorf( ray.Origin.z / 100.0f ) * 100.0f;
+                ray.Dir = axes[i / 8 % 6];
+                break;
+            case 3:
+                ray.Dir = XMFLOAT3( 0.0f, 0.0f, 0.0f );
+                break;
+            case 4:
+                ray.MaxDistance = unit( rng ) * 50.0f;
+                break;
+            }
+        }
+        return rays;
+    }
+
+    /** Triangles sharing a corner a ray passes through give distances a few ulps apart there. The tree may
+        skip the one brute force finds, if its box starts just behind the hit it already has. */
+    bool IsSameDistance( float a, float b ) {
+        return fabsf( a - b ) <= 1e-5f * std::max( a, b );
+    }
+
+    void CheckAgainstBruteForce( const std::vector<XMFLOAT3>& positions, const std::vector<TestRay>& rays ) {
+        TriangleBvh bvh;
+        bvh.Build( positions );
+        TEST_CHECK( bvh.GetNumTriangles() == positions.size() / 3 );
+        TEST_CHECK( bvh.GetDepth() <= TriangleBvh::MAX_DEPTH );
+
+        for ( const TestRay& ray : rays ) {
+            const BruteForceHit expected = TraceBruteForce( positions, ray.Origin, ray.Dir, ray.MaxDistance );
+
+            TriangleBvh::RayHit hit;
+            const bool found = bvh.TraceRay( ray.Origin, ray.Dir, ray.MaxDistance, hit );
+            TEST_CHECK( found == (expected.Triangle != TriangleBvh::NO_TRIANGLE) );
+            if ( found && expected.Triangle != TriangleBvh::NO_TRIANGLE ) {
+                // Duplicates are hit at the same distance, either of them will do
+                TEST_CHECK( IsSameDistance( hit.Distance, expected.Distance ) );
+                TEST_CHECK( hit.Triangle < positions.size() / 3 );
+            }
+
+            TEST_CHECK( bvh.TraceRayAny( ray.Origin, ray.Dir, ray.MaxDistance ) == found );
+        }
+
+        // The packets have to find the same hits, only grouped differently
+        std::vector<XMFLOAT3> origins;
+        std::vector<XMFLOAT3> dirs;
+        for ( const TestRay& ray : rays ) {
+            origins.push_back( ray.Origin );
+            dirs.push_back( ray.Dir );
+        }
+
+        std::vector<TriangleBvh::RayHit> hits( rays.size() );
+        bvh.TraceRays( origins.data(), dirs.data(), static_cast<unsigned int>(rays.size()), FLT_MAX, hits.data() );
+        for ( size_t i = 0; i < rays.size(); i++ ) {
+            const BruteForceHit expected = TraceBruteForce( positions, origins[i], dirs[i], FLT_MAX );
+            TEST_CHECK( hits[i].Triangle == TriangleBvh::NO_TRIANGLE || IsSameDistance( hits[i].Distance, expected.Distance ) );
+            TEST_CHECK( (hits[i].Triangle != TriangleBvh::NO_TRIANGLE) == (expected.Triangle != TriangleBvh::NO_TRIANGLE) );
+        }
+    }
+
+    void TestRandomSoups() {
+        std::mt19937 rng( 21 );
+        for ( unsigned int numTriangles : { 1u, 7u, 100u, 3000u } ) {
+            CheckAgainstBruteForce( MakeSoup( rng, numTriangles ), MakeRays( rng, 800, 10000.0f ) );
+        }
+    }
+
+    void TestGrid() {
+        std::mt19937 rng( 22 );
+        CheckAgainstBruteForce( MakeGrid( 40 ), MakeRays( rng, 1600, 4000.0f ) );
+    }
+
+    void TestEmpty() {
+        TriangleBvh bvh;
+        bvh.Build( {} );
+        TEST_CHECK( bvh.IsEmpty() );
+
+        TriangleBvh::RayHit hit;
+        TEST_CHECK( !bvh.TraceRay( XMFLOAT3( 0, 0, 0 ), XMFLOAT3( 0, -1, 0 ), FLT_MAX, hit ) );
+        TEST_CHECK( !bvh.TraceRayAny( XMFLOAT3( 0, 0, 0 ), XMFLOAT3( 0, -1, 0 ), FLT_MAX ) );
+    }
+}
+
+int main() {
+    TestRandomSoups();
+    TestGrid();
+    TestEmpty();
+    return TestResult();
+}
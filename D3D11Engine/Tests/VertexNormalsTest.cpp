@@ -0,0 +1,208 @@
+#include "TestPch.h"
+#include "VertexNormals.h"
+#include "InstructionSet.h"
+#include "TestCheck.h"
+#include <random>
+
+namespace {
+    /** Largest error of FastACos, as documented in VertexNormals.h */
+    const double FAST_ACOS_MAX_ERROR = 7e-5;
+
+    /** Allowed difference of a corner weight between the SIMD kernels and the scalar one. Covers the acos
+        approximation and the cosine being computed slightly differently. */
+    const float MAX_WEIGHT_ERROR = 2e-4f;
+
+    struct Kernel {
+        const char* Name;
+        ZAccumulateVertexNormals Accumulate;
+    };
+
+    /** The SIMD kernels this build has and the CPU can run */
+    std::vector<Kernel> GetSimdKernels() {
+        std::vector<Kernel> kernels = { { "SSE2", AccumulateVertexNormals_SSE2 } };
+#ifdef _XM_AVX2_INTRINSICS_
+        if ( InstructionSet::AVX2() ) {
+            kernels.push_back( { "AVX2", AccumulateVertexNormals_AVX2 } );
+        } else {
+            std::printf( "CPU has no AVX2, only testing the SSE2 kernel\n" );
+        }
+#endif
+        return kernels;
+    }
+
+    /** Heightfield of size x size vertices with random heights, so all triangles are reasonably shaped.
+        Every 5th triangle is replaced by a degenerate one: repeated corners, collinear corners or all three
+        corners the same. Those use the extra vertices at the end. */
+    void MakeMesh( std::mt19937& rng, unsigned int size, std::vector<ExVertexStruct>& vertices, std::vector<VERTEX_INDEX>& indices ) {
+        std::uniform_real_distribution<float> height( -40.0f, 40.0f );
+
+        vertices.assign( size * size + 3, ExVertexStruct() );
+        for ( unsigned int z = 0; z < size; z++ ) {
+            for ( unsigned int x = 0; x < size; x++ ) {
+                vertices[z * size + x].Position = float3( x * 100.0f, height( rng ), z * 100.0f );
+            }
+        }
+
+        const VERTEX_INDEX line = static_cast<VERTEX_INDEX>(size * size);
+        vertices[line + 0].Position = float3( 0.0f, 0.0f, 0.0f );
+        vertices[line + 1].Position = float3( 1.0f, 1.0f, 1.0f );
+        vertices[line + 2].Position = float3( 2.0f, 2.0f, 2.0f );
+
+        indices.clear();
+        unsigned int numTriangles = 0;
+        auto addTriangle = [&]( unsigned int a, unsigned int b, unsigned int c ) {
+            switch ( numTriangles++ % 15 ) {
+            case 4: indices.insert( indices.end(), { static_cast<VERTEX_INDEX>(a), static_cast<VERTEX_INDEX>(a), static_cast<VERTEX_INDEX>(b) } ); break;
+            case 9: indices.insert( indices.end(), { line, static_cast<VERTEX_INDEX>(line + 2), static_cast<VERTEX_INDEX>(line + 1) } ); break;
+            case 14: indices.insert( indices.end(), { static_cast<VERTEX_INDEX>(c), static_cast<VERTEX_INDEX>(c), static_cast<VERTEX_INDEX>(c) } ); break;
+            default: indices.insert( indices.end(), { static_cast<VERTEX_INDEX>(a), static_cast<VERTEX_INDEX>(b), static_cast<VERTEX_INDEX>(c) } ); break;
+            }
+        };
+
+        for ( unsigned int z = 0; z + 1 < size; z++ ) {
+            for ( unsigned int x = 0; x + 1 < size; x++ ) {
+                const unsigned int i = z * size + x;
+                addTriangle( i, i + size, i + 1 );
+                addTriangle( i + 1, i + size, i + size + 1 );
+            }
+        }
+    }
+
+    /** Per vertex, the sum of the face normal lengths of all triangles using it */
+    std::vector<float> GetFaceNormalSums( const std::vector<ExVertexStruct>& vertices, const VERTEX_INDEX* indices, unsigned int numIndices ) {
+        std::vector<float> sums( vertices.size(), 0.0f );
+        for ( unsigned int i = 0; i + 2 < numIndices; i += 3 ) {
+            const float3& p0 = vertices[indices[i]].Position;
+            const float3& p1 = vertices[indices[i + 1]].Position;
+            const float3& p2 = vertices[indices[i + 2]].Position;
+            const double e1[3] = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+            const double e2[3] = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+            const double nx = e1[1] * e2[2] - e1[2] * e2[1];
+            const double ny = e1[2] * e2[0] - e1[0] * e2[2];
+            const double nz = e1[0] * e2[1] - e1[1] * e2[0];
+            const float length = static_cast<float>(std::sqrt( nx * nx + ny * ny + nz * nz ));
+
+            for ( unsigned int c = 0; c < 3; c++ ) {
+                sums[indices[i + c]] += length;
+            }
+        }
+        return sums;
+    }
+
+    /** The kernel's normals are within MAX_WEIGHT_ERROR of the scalar ones, scaled by the face normals adding up */
+    void CheckAgainstScalar( const Kernel& kernel, const std::vector<ExVertexStruct>& vertices, const VERTEX_INDEX* indices, unsigned int numIndices ) {
+        std::vector<XMFLOAT3> expected( vertices.size(), XMFLOAT3( 0.0f, 0.0f, 0.0f ) );
+        std::vector<XMFLOAT3> normals( vertices.size(), XMFLOAT3( 0.0f, 0.0f, 0.0f ) );
+        AccumulateVertexNormals_Scalar( &vertices[0], indices, numIndices, &expected[0] );
+        kernel.Accumulate( &vertices[0], indices, numIndices, &normals[0] );
+
+        const std::vector<float> sums = GetFaceNormalSums( vertices, indices, numIndices );
+        unsigned int numFailed = 0;
+        for ( size_t v = 0; v < vertices.size(); v++ ) {
+            const float tolerance = sums[v] * MAX_WEIGHT_ERROR + 1e-3f;
+            const bool same = std::fabs( normals[v].x - expected[v].x ) <= tolerance
+                && std::fabs( normals[v].y - expected[v].y ) <= tolerance
+                && std::fabs( normals[v].z - expected[v].z ) <= tolerance;
+            numFailed += same ? 0 : 1;
+        }
+
+        if ( numFailed ) {
+            std::printf( "%s: %u of %u normals differ from the scalar kernel for %u triangles\n",
+                kernel.Name, numFailed, static_cast<unsigned int>(vertices.size()), numIndices / 3 );
+        }
+        TEST_CHECK( numFailed == 0 );
+    }
+
+    /** FastACos stays within its documented error over the whole input range */
+    void TestFastACosBound() {
+        double maxError = 0.0;
+        const int steps = 200000;
+        for ( int i = 0; i <= steps; i++ ) {
+            const float x = -1.0f + 2.0f * i / steps;
+            maxError = std::max( maxError, std::fabs( FastACos( x ) - std::acos( static_cast<double>(x) ) ) );
+        }
+
+        TEST_CHECK( maxError <= FAST_ACOS_MAX_ERROR );
+        TEST_CHECK( std::fabs( FastACos( 1.0f ) ) <= FAST_ACOS_MAX_ERROR );
+        TEST_CHECK( std::fabs( FastACos( -1.0f ) - XM_PI ) <= FAST_ACOS_MAX_ERROR );
+    }
+
+    /** Every triangle count up to a few batches, so all tail sizes of the 4 and 8 wide kernels are covered */
+    void TestTails() {
+        std::mt19937 rng( 8 );
+        std::vector<ExVertexStruct> vertices;
+        std::vector<VERTEX_INDEX> indices;
+        MakeMesh( rng, 6, vertices, indices );
+
+        for ( const Kernel& kernel : GetSimdKernels() ) {
+            for ( unsigned int numTriangles = 0; numTriangles <= 3 * 8 + 1; numTriangles++ ) {
+                CheckAgainstScalar( kernel, vertices, &indices[0], numTriangles * 3 );
+            }
+
+            // Indices past the last whole triangle are ignored
+            CheckAgainstScalar( kernel, vertices, &indices[0], 3 * 5 + 2 );
+        }
+    }
+
+    void TestLargeMesh() {
+        std::mt19937 rng( 9 );
+        std::vector<ExVertexStruct> vertices;
+        std::vector<VERTEX_INDEX> indices;
+        MakeMesh( rng, 64, vertices, indices );
+
+        for ( const Kernel& kernel : GetSimdKernels() ) {
+            CheckAgainstScalar( kernel, vertices, &indices[0], static_cast<unsigned int>(indices.size()) );
+        }
+    }
+
+    /** Degenerate triangles add nothing, and in particular no NaN */
+    void TestDegenerateOnly() {
+        std::vector<ExVertexStruct> vertices( 3 );
+        vertices[1].Position = float3( 1.0f, 1.0f, 1.0f );
+        vertices[2].Position = float3( 2.0f, 2.0f, 2.0f );
+        const std::vector<VERTEX_INDEX> indices = { 0, 0, 1, 0, 2, 1, 2, 2, 2, 1, 0, 0, 0, 1, 2 };
+
+        std::vector<Kernel> kernels = GetSimdKernels();
+        kernels.push_back( { "Scalar", AccumulateVertexNormals_Scalar } );
+        for ( const Kernel& kernel : kernels ) {
+            std::vector<XMFLOAT3> normals( vertices.size(), XMFLOAT3( 0.0f, 0.0f, 0.0f ) );
+            kernel.Accumulate( &vertices[0], &indices[0], static_cast<unsigned int>(indices.size()), &normals[0] );
+            for ( const XMFLOAT3& n : normals ) {
+                TEST_CHECK( n.x == 0.0f && n.y == 0.0f && n.z == 0.0f );
+            }
+        }
+    }
+
+    /** Prints how long each kernel takes for a world section sized mesh */
+    void BenchmarkKernels() {
+        std::mt19937 rng( 10 );
+        std::vector<ExVertexStruct> vertices;
+        std::vector<VERTEX_INDEX> indices;
+        MakeMesh( rng, 250, vertices, indices );
+        const unsigned int numIndices = static_cast<unsigned int>(indices.size());
+
+        std::vector<Kernel> kernels = GetSimdKernels();
+        kernels.insert( kernels.begin(), { "Scalar", AccumulateVertexNormals_Scalar } );
+
+        std::vector<XMFLOAT3> normals( vertices.size() );
+        double scalarMs = 0.0;
+        for ( const Kernel& kernel : kernels ) {
+            const double ms = MeasureMilliseconds( 5, [&]() {
+                std::fill( normals.begin(), normals.end(), XMFLOAT3( 0.0f, 0.0f, 0.0f ) );
+                kernel.Accumulate( &vertices[0], &indices[0], numIndices, &normals[0] );
+            } );
+
+            scalarMs = scalarMs > 0.0 ? scalarMs : ms;
+            std::printf( "Vertex normals of %u triangles: %s %.2f ms (%.1fx)\n", numIndices / 3, kernel.Name, ms, scalarMs / ms );
+        }
+    }
+}
+
+int main() {
+    TestFastACosBound();
+    TestTails();
+    TestLargeMesh();
+    TestDegenerateOnly();
+    BenchmarkKernels();
+    return TestResult();
+}
@@ -0,0 +1,203 @@
+#include "TestPch.h"
+#include "VertexWelder.h"
+#include "TestCheck.h"
+#include <random>
+#include <set>
+#include <tuple>
+
+namespace {
+    const float WELD_EPSILON = 0.001f;
+
+    /** Comparison of the std::set WorldConverter::IndexVertices used before VertexWelder */
+    struct SetVertexCompare {
+        bool operator()( const std::pair<ExVertexStruct, int>& p1, const std::pair<ExVertexStruct, int>& p2 ) const {
+            if ( fabs( p1.first.Position.x - p2.first.Position.x ) > WELD_EPSILON ) return p1.first.Position.x < p2.first.Position.x;
+            if ( fabs( p1.first.Position.y - p2.first.Position.y ) > WELD_EPSILON ) return p1.first.Position.y < p2.first.Position.y;
+            if ( fabs( p1.first.Position.z - p2.first.Position.z ) > WELD_EPSILON ) return p1.first.Position.z < p2.first.Position.z;
+
+            if ( fabs( p1.first.TexCoord.x - p2.first.TexCoord.x ) > WELD_EPSILON ) return p1.first.TexCoord.x < p2.first.TexCoord.x;
+            if ( fabs( p1.first.TexCoord.y - p2.first.TexCoord.y ) > WELD_EPSILON ) return p1.first.TexCoord.y < p2.first.TexCoord.y;
+
+            return false;
+        }
+    };
+
+    /** The old std::set path of WorldConverter::IndexVertices, without removing duplicate triangles */
+    template<typename T>
+    void IndexVerticesWithSet( const ExVertexStruct* input, unsigned int numInputVertices, std::vector<ExVertexStruct>& outVertices, std::vector<T>& outIndices ) {
+        std::set<std::pair<ExVertexStruct, int>, SetVertexCompare> vertices;
+        int index = 0;
+
+        for ( unsigned int i = 0; i < numInputVertices; i++ ) {
+            auto it = vertices.find( std::make_pair( input[i], 0 ) );
+            if ( it != vertices.end() ) {
+                outIndices.emplace_back( static_cast<T>(it->second) );
+            } else {
+                vertices.insert( std::make_pair( input[i], index ) );
+                outIndices.emplace_back( static_cast<T>(index++) );
+            }
+        }
+
+        outVertices.clear();
+        outVertices.resize( vertices.size() );
+        for ( const auto& it : vertices ) {
+            outVertices[it.second] = it.first;
+        }
+    }
+
+    /** The old removal of duplicate triangles, through a std::set of index tuples */
+    void RemoveDuplicateTrianglesWithSet( std::vector<VERTEX_INDEX>& indices ) {
+        std::set<std::tuple<VERTEX_INDEX, VERTEX_INDEX, VERTEX_INDEX>> triangles;
+        for ( size_t i = 0; i < indices.size(); i += 3 ) {
+            triangles.insert( std::make_tuple( indices[i + 0], indices[i + 1], indices[i + 2] ) );
+        }
+
+        indices.clear();
+        for ( const auto& it : triangles ) {
+            indices.emplace_back( std::get<0>( it ) );
+            indices.emplace_back( std::get<1>( it ) );
+            indices.emplace_back( std::get<2>( it ) );
+        }
+    }
+
+    /** Unindexed triangles of a size x size grid of quads, every corner is emitted up to 6 times.
+        With jitter every copy moves by up to a quarter epsilon, which keeps the copies of a corner within epsilon
+        of each other and far from all other corners, so both paths have to end up with the same mesh.
+        Jittered grids stay close to the origin, further out floats are too coarse for the jitter.
+        Some triangles are emitted twice and the corners of the first column are at -0 and +0. */
+    std::vector<ExVertexStruct> MakeGridTriangles( std::mt19937& rng, unsigned int size, bool jitter ) {
+        std::uniform_real_distribution<float> offset( -WELD_EPSILON * 0.25f, WELD_EPSILON * 0.25f );
+        const float spacing = jitter ? 1.0f : 100.0f;
+        auto corner = [&]( unsigned int x, unsigned int z ) {
+            ExVertexStruct v = {};
+            v.Position.x = x == 0 ? ((z % 2) ? -0.0f : 0.0f) : 5.0f * spacing + x * spacing;
+            v.Position.y = static_cast<float>((x * 7 + z * 3) % 11) * 0.25f * spacing;
+            v.Position.z = -50.0f * spacing + z * spacing;
+            v.TexCoord.x = x * 0.25f;
+            v.TexCoord.y = z * 0.25f;
+            v.Normal.y = 1.0f;
+            v.Color = 0xFF000000 | (x << 8) | z;
+
+            if ( jitter ) {
+                v.Position.x += offset( rng );
+                v.Position.y += offset( rng );
+                v.Position.z += offset( rng );
+                v.TexCoord.x += offset( rng );
+                v.TexCoord.y += offset( rng );
+            }
+            return v;
+        };
+
+        std::vector<ExVertexStruct> vertices;
+        for ( unsigned int z = 0; z < size; z++ ) {
+            for ( unsigned int x = 0; x < size; x++ ) {
+                vertices.insert( vertices.end(), { corner( x, z ), corner( x + 1, z ), corner( x + 1, z + 1 ) } );
+                vertices.insert( vertices.end(), { corner( x, z ), corner( x + 1, z + 1 ), corner( x, z + 1 ) } );
+
+                // Some mods put the same polygon into the world twice
+                if ( (x + z) % 37 == 0 ) {
+                    vertices.insert( vertices.end(), vertices.end() - 6, vertices.end() - 3 );
+                }
+            }
+        }
+        return vertices;
+    }
+
+    bool IsSameVertices( const std::vector<ExVertexStruct>& a, const std::vector<ExVertexStruct>& b ) {
+        return a.size() == b.size() && (a.empty() || memcmp( &a[0], &b[0], a.size() * sizeof( ExVertexStruct ) ) == 0);
+    }
+
+    /** Welded vertices, their order and the indices match the std::set path, for 16 and 32 bit indices */
+    void CheckSameAsSet( const std::vector<ExVertexStruct>& input ) {
+        const unsigned int numInput = static_cast<unsigned int>(input.size());
+        VertexWelder welder;
+
+        std::vector<ExVertexStruct> vertices, referenceVertices;
+        std::vector<VERTEX_INDEX> indices, referenceIndices;
+        welder.Weld( &input[0], numInput, vertices, indices );
+        welder.RemoveDuplicateTriangles( indices );
+        IndexVerticesWithSet( &input[0], numInput, referenceVertices, referenceIndices );
+        RemoveDuplicateTrianglesWithSet( referenceIndices );
+
+        TEST_CHECK( vertices.size() < input.size() );
+        TEST_CHECK( indices.size() < input.size() );
+        TEST_CHECK( IsSameVertices( vertices, referenceVertices ) );
+        TEST_CHECK( indices == referenceIndices );
+
+        std::vector<ExVertexStruct> vertices32, referenceVertices32;
+        std::vector<unsigned int> indices32, referenceIndices32;
+        welder.Weld( &input[0], numInput, vertices32, indices32 );
+        IndexVerticesWithSet( &input[0], numInput, referenceVertices32, referenceIndices32 );
+
+        TEST_CHECK( indices32.size() == input.size() );
+        TEST_CHECK( IsSameVertices( vertices32, referenceVertices32 ) );
+        TEST_CHECK( indices32 == referenceIndices32 );
+    }
+
+    void TestExactDuplicates() {
+        std::mt19937 rng( 1 );
+        CheckSameAsSet( MakeGridTriangles( rng, 40, false ) );
+    }
+
+    void TestJitteredDuplicates() {
+        std::mt19937 rng( 2 );
+        CheckSameAsSet( MakeGridTriangles( rng, 40, true ) );
+
+        // In bit-exact mode the jittered copies all stay apart
+        const std::vector<ExVertexStruct> input = MakeGridTriangles( rng, 10, true );
+        VertexWelder welder( VertexWelder::WM_BIT_EXACT );
+        std::vector<ExVertexStruct> vertices;
+        std::vector<unsigned int> indices;
+        welder.Weld( &input[0], static_cast<unsigned int>(input.size()), vertices, indices );
+        TEST_CHECK( vertices.size() > 11 * 11 * 3 );
+    }
+
+    /** Vertices just outside of epsilon are kept apart, just inside merged into the first one */
+    void TestEpsilonBorder() {
+        std::vector<ExVertexStruct> input( 4 );
+        input[0].Position.x = 1000.0f;
+        input[1].Position.x = 1000.0f + WELD_EPSILON * 0.5f;
+        input[2].Position.x = 1000.0f + WELD_EPSILON * 3.0f;
+        input[3].TexCoord.y = WELD_EPSILON * 3.0f;
+
+        VertexWelder welder;
+        std::vector<ExVertexStruct> vertices;
+        std::vector<unsigned int> indices;
+        welder.Weld( &input[0], 4, vertices, indices );
+        TEST_CHECK( vertices.size() == 3 );
+        TEST_CHECK( indices == std::vector<unsigned int>( { 0, 0, 1, 2 } ) );
+    }
+
+    /** Prints how long both paths take for a world section sized mesh */
+    void BenchmarkAgainstSet( bool jitter ) {
+        std::mt19937 rng( 3 );
+        const std::vector<ExVertexStruct> input = MakeGridTriangles( rng, 150, jitter );
+        const unsigned int numInput = static_cast<unsigned int>(input.size());
+
+        VertexWelder welder;
+        std::vector<ExVertexStruct> vertices;
+        std::vector<VERTEX_INDEX> indices;
+        const double welderMs = MeasureMilliseconds( 5, [&]() {
+            indices.clear();
+            welder.Weld( &input[0], numInput, vertices, indices );
+            welder.RemoveDuplicateTriangles( indices );
+        } );
+        const double setMs = MeasureMilliseconds( 5, [&]() {
+            indices.clear();
+            IndexVerticesWithSet( &input[0], numInput, vertices, indices );
+            RemoveDuplicateTrianglesWithSet( indices );
+        } );
+
+        std::printf( "Welding %u %s vertices: VertexWelder %.2f ms, std::set %.2f ms (%.1fx)\n",
+            numInput, jitter ? "jittered" : "exact", welderMs, setMs, setMs / welderMs );
+    }
+}
+
+int main() {
+    TestExactDuplicates();
+    TestJitteredDuplicates();
+    TestEpsilonBorder();
+    BenchmarkAgainstSet( false );
+    BenchmarkAgainstSet( true );
+    return TestResult();
+}
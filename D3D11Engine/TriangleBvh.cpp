@@ -0,0 +1,557 @@
+#include "pch.h"
+#include "TriangleBvh.h"
+#include <immintrin.h>
+
+namespace {
+    /** Bins the centroids are sorted into along each axis when looking for a split */
+    const unsigned int NUM_BINS = 16;
+
+    /** Cost of visiting a node compared to testing one triangle */
+    const float TRAVERSAL_COST = 1.0f;
+
+    /** Same as in Toolbox::IntersectTri */
+    const float PARALLEL_EPSILON = 0.00001f;
+
+    XMFLOAT3 Sub( const XMFLOAT3& a, const XMFLOAT3& b ) {
+        return XMFLOAT3( a.x - b.x, a.y - b.y, a.z - b.z );
+    }
+
+    XMFLOAT3 Cross( const XMFLOAT3& a, const XMFLOAT3& b ) {
+        return XMFLOAT3( a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x );
+    }
+
+    float Dot( const XMFLOAT3& a, const XMFLOAT3& b ) {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    zTBBox3D EmptyBox() {
+        zTBBox3D box;
+        box.Min = XMFLOAT3( FLT_MAX, FLT_MAX, FLT_MAX );
+        box.Max = XMFLOAT3( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+        return box;
+    }
+
+    void GrowBox( zTBBox3D& box, const zTBBox3D& other ) {
+        box.Min = XMFLOAT3( std::min( box.Min.x, other.Min.x ), std::min( box.Min.y, other.Min.y ), std::min( box.Min.z, other.Min.z ) );
+        box.Max = XMFLOAT3( std::max( box.Max.x, other.Max.x ), std::max( box.Max.y, other.Max.y ), std::max( box.Max.z, other.Max.z ) );
+    }
+
+    /** Half the surface area, which is what the chance of a ray passing through a box is proportional to */
+    float BoxCost( const zTBBox3D& box ) {
+        const float dx = box.Max.x - box.Min.x;
+        const float dy = box.Max.y - box.Min.y;
+        const float dz = box.Max.z - box.Min.z;
+        return dx * dy + dy * dz + dz * dx;
+    }
+
+    /** Spreads the lower 10 bits of x out to every third bit, for Morton codes */
+    uint32_t SpreadBits10( uint32_t x ) {
+        x &= 0x3FF;
+        x = (x | (x << 16)) & 0x030000FF;
+        x = (x | (x << 8)) & 0x0300F00F;
+        x = (x | (x << 4)) & 0x030C30C3;
+        x = (x | (x << 2)) & 0x09249249;
+        return x;
+    }
+
+    inline __m128 Select( __m128 mask, __m128 a, __m128 b ) {
+        return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) );
+    }
+
+    /** Ray with what the slab test needs precomputed */
+    struct BvhRay {
+        BvhRay( const XMFLOAT3& origin, const XMFLOAT3& dir ) : Origin( origin ), Dir( dir ) {
+            const float* d = &dir.x;
+            for ( int i = 0; i < 3; i++ ) {
+                InvDir[i] = d[i] != 0.0f ? 1.0f / d[i] : 0.0f;
+            }
+        }
+
+        /** Slab test, axes the ray runs parallel to only have to contain the origin. Returns the entry distance or FLT_MAX. */
+        float IntersectBox( const XMFLOAT3& boxMin, const XMFLOAT3& boxMax, float maxDistance ) const {
+            const float* o = &Origin.x;
+            const float* d = &Dir.x;
+            const float* min = &boxMin.x;
+            const float* max = &boxMax.x;
+
+            float tEnter = 0.0f;
+            float tExit = maxDistance;
+            for ( int i = 0; i < 3; i++ ) {
+                if ( d[i] == 0.0f ) {
+                    if ( o[i] < min[i] || o[i] > max[i] )
+                        return FLT_MAX;
+                    continue;
+                }
+
+                const float t1 = (min[i] - o[i]) * InvDir[i];
+                const float t2 = (max[i] - o[i]) * InvDir[i];
+                tEnter = std::max( tEnter, std::min( t1, t2 ) );
+                tExit = std::min( tExit, std::max( t1, t2 ) );
+            }
+            return tEnter <= tExit ? tEnter : FLT_MAX;
+        }
+
+        XMFLOAT3 Origin;
+        XMFLOAT3 Dir;
+        float InvDir[3];
+    };
+}
+
+TriangleBvh::TriangleBvh() {
+    Depth = 0;
+}
+
+/** Removes all triangles */
+void TriangleBvh::Clear() {
+    Nodes.clear();
+    Triangles.clear();
+    Depth = 0;
+}
+
+/** Builds the tree, every three positions are one triangle */
+void TriangleBvh::Build( const std::vector<XMFLOAT3>& positions ) {
+    Clear();
+
+    const unsigned int numTriangles = static_cast<unsigned int>(positions.size() / 3);
+    if ( numTriangles == 0 )
+        return;
+
+    std::vector<zTBBox3D> bounds( numTriangles );
+    std::vector<XMFLOAT3> centroids( numTriangles );
+    std::vector<unsigned int> order( numTriangles );
+    for ( unsigned int i = 0; i < numTriangles; i++ ) {
+        const XMFLOAT3& v0 = positions[i * 3];
+        const XMFLOAT3& v1 = positions[i * 3 + 1];
+        const XMFLOAT3& v2 = positions[i * 3 + 2];
+        bounds[i].Min = XMFLOAT3( std::min( { v0.x, v1.x, v2.x } ), std::min( { v0.y, v1.y, v2.y } ), std::min( { v0.z, v1.z, v2.z } ) );
+        bounds[i].Max = XMFLOAT3( std::max( { v0.x, v1.x, v2.x } ), std::max( { v0.y, v1.y, v2.y } ), std::max( { v0.z, v1.z, v2.z } ) );
+        centroids[i] = XMFLOAT3( (bounds[i].Min.x + bounds[i].Max.x) * 0.5f, (bounds[i].Min.y + bounds[i].Max.y) * 0.5f, (bounds[i].Min.z + bounds[i].Max.z) * 0.5f );
+        order[i] = i;
+    }
+
+    // A binary tree with at least one triangle per leaf never has more nodes than this
+    Nodes.reserve( numTriangles * 2 - 1 );
+    Nodes.push_back( { XMFLOAT3(), 0, XMFLOAT3(), numTriangles } );
+
+    std::vector<std::pair<unsigned int, unsigned int>> stack;
+    stack.emplace_back( 0, 1 );
+    while ( !stack.empty() ) {
+        const unsigned int node = stack.back().first;
+        const unsigned int depth = stack.back().second;
+        stack.pop_back();
+
+        Depth = std::max( Depth, depth );
+        if ( SplitNode( node, depth, bounds, centroids, order ) ) {
+            stack.emplace_back( Nodes[node].LeftOrFirst, depth + 1 );
+            stack.emplace_back( Nodes[node].LeftOrFirst + 1, depth + 1 );
+        }
+    }
+
+    // Store the triangles in leaf order, so a leaf reads one block of memory
+    Triangles.resize( numTriangles );
+    for ( unsigned int i = 0; i < numTriangles; i++ ) {
+        const unsigned int t = order[i];
+        Triangle& triangle = Triangles[i];
+        triangle.V0 = positions[t * 3];
+        triangle.Edge1 = Sub( positions[t * 3 + 1], triangle.V0 );
+        triangle.Edge2 = Sub( positions[t * 3 + 2], triangle.V0 );
+        triangle.Index = t;
+    }
+}
+
+/** Splits the node where the surface area heuristic says so */
+bool TriangleBvh::SplitNode( unsigned int nodeIndex, unsigned int depth, const std::vector<zTBBox3D>& bounds, const std::vector<XMFLOAT3>& centroids, std::vector<unsigned int>& order ) {
+    const unsigned int first = Nodes[nodeIndex].LeftOrFirst;
+    const unsigned int count = Nodes[nodeIndex].Count;
+
+    zTBBox3D nodeBox = EmptyBox();
+    zTBBox3D centroidBox = EmptyBox();
+    for ( unsigned int i = first; i < first + count; i++ ) {
+        GrowBox( nodeBox, bounds[order[i]] );
+        const XMFLOAT3& c = centroids[order[i]];
+        GrowBox( centroidBox, { c, c } );
+    }
+    Nodes[nodeIndex].Min = nodeBox.Min;
+    Nodes[nodeIndex].Max = nodeBox.Max;
+
+    if ( count <= 1 || depth >= MAX_DEPTH )
+        return false;
+
+    // Find the cheapest split between two bins along any axis
+    const float* centroidMin = &centroidBox.Min.x;
+    const float* centroidMax = &centroidBox.Max.x;
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    unsigned int bestSplit = 0;
+    for ( int axis = 0; axis < 3; axis++ ) {
+        const float extent = centroidMax[axis] - centroidMin[axis];
+        if ( !(extent > 0.0f) )
+            continue;
+
+        const float binScale = NUM_BINS / extent;
+        zTBBox3D binBoxes[NUM_BINS];
+        unsigned int binCounts[NUM_BINS] = {};
+        for ( zTBBox3D& box : binBoxes ) {
+            box = EmptyBox();
+        }
+
+        for ( unsigned int i = first; i < first + count; i++ ) {
+            const unsigned int t = order[i];
+            const unsigned int bin = std::min( static_cast<unsigned int>(((&centroids[t].x)[axis] - centroidMin[axis]) * binScale), NUM_BINS - 1 );
+            binCounts[bin]++;
+            GrowBox( binBoxes[bin], bounds[t] );
+        }
+
+        // Sweep from the right to get the cost of everything right of each split, then from the left
+        float rightCosts[NUM_BINS];
+        zTBBox3D rightBox = EmptyBox();
+        unsigned int rightCount = 0;
+        for ( unsigned int b = NUM_BINS - 1; b > 0; b-- ) {
+            GrowBox( rightBox, binBoxes[b] );
+            rightCount += binCounts[b];
+            rightCosts[b] = rightCount ? BoxCost( rightBox ) * rightCount : 0.0f;
+        }
+
+        zTBBox3D leftBox = EmptyBox();
+        unsigned int leftCount = 0;
+        for ( unsigned int split = 1; split < NUM_BINS; split++ ) {
+            GrowBox( leftBox, binBoxes[split - 1] );
+            leftCount += binCounts[split - 1];
+            if ( leftCount == 0 || leftCount == count )
+                continue;
+
+            const float cost = BoxCost( leftBox ) * leftCount + rightCosts[split];
+            if ( cost < bestCost ) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    // All centroids in one spot, there is nothing to split them by
+    if ( bestAxis < 0 )
+        return false;
+
+    const float nodeCost = BoxCost( nodeBox );
+    const float splitCost = TRAVERSAL_COST + (nodeCost > 0.0f ? bestCost / nodeCost : 0.0f);
+    if ( splitCost >= static_cast<float>(count) && count <= MAX_LEAF_TRIANGLES )
+        return false;
+
+    const float binScale = NUM_BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+    unsigned int* middle = std::partition( order.data() + first, order.data() + first + count, [&]( unsigned int t ) {
+        return std::min( static_cast<unsigned int>(((&centroids[t].x)[bestAxis] - centroidMin[bestAxis]) * binScale), NUM_BINS - 1 ) < bestSplit;
+    } );
+    const unsigned int leftCount = static_cast<unsigned int>(middle - (order.data() + first));
+
+    const unsigned int left = static_cast<unsigned int>(Nodes.size());
+    Nodes.push_back( { XMFLOAT3(), first, XMFLOAT3(), leftCount } );
+    Nodes.push_back( { XMFLOAT3(), first + leftCount, XMFLOAT3(), count - leftCount } );
+    Nodes[nodeIndex].LeftOrFirst = left;
+    Nodes[nodeIndex].Count = 0;
+    return true;
+}
+
+/** Finds the closest triangle hit by the ray */
+bool TriangleBvh::TraceRay( const XMFLOAT3& origin, const XMFLOAT3& dir, float maxDistance, RayHit& outHit ) const {
+    return Trace( origin, dir, maxDistance, false, outHit );
+}
+
+/** Returns whether any triangle is hit before maxDistance */
+bool TriangleBvh::TraceRayAny( const XMFLOAT3& origin, const XMFLOAT3& dir, float maxDistance ) const {
+    RayHit hit;
+    return Trace( origin, dir, maxDistance, true, hit );
+}
+
+bool TriangleBvh::Trace( const XMFLOAT3& origin, const XMFLOAT3& dir, float maxDistance, bool anyHit, RayHit& outHit ) const {
+    if ( Nodes.empty() )
+        return false;
+
+    const BvhRay ray( origin, dir );
+    if ( ray.IntersectBox( Nodes[0].Min, Nodes[0].Max, maxDistance ) == FLT_MAX )
+        return false;
+
+    float closest = maxDistance;
+    bool found = false;
+
+    // Every node on the stack was entered before closest when it was pushed, which may have changed since
+    std::pair<unsigned int, float> stack[MAX_DEPTH + 1];
+    unsigned int stackSize = 0;
+    stack[stackSize++] = { 0u, 0.0f };
+
+    while ( stackSize ) {
+        const unsigned int index = stack[--stackSize].first;
+        if ( stack[stackSize].second >= closest )
+            continue;
+
+        const Node& node = Nodes[index];
+        if ( node.Count ) {
+            for ( unsigned int i = node.LeftOrFirst; i < node.LeftOrFirst + node.Count; i++ ) {
+                const Triangle& triangle = Triangles[i];
+
+                // Moeller-Trumbore
+                const XMFLOAT3 pvec = Cross( dir, triangle.Edge2 );
+                const float det = Dot( triangle.Edge1, pvec );
+                if ( det > -PARALLEL_EPSILON && det < PARALLEL_EPSILON )
+                    continue;
+
+                const float invDet = 1.0f / det;
+                const XMFLOAT3 tvec = Sub( origin, triangle.V0 );
+                const float u = Dot( tvec, pvec ) * invDet;
+                if ( u < 0.0f || u > 1.0f )
+                    continue;
+
+                const XMFLOAT3 qvec = Cross( tvec, triangle.Edge1 );
+                const float v = Dot( dir, qvec ) * invDet;
+                if ( v < 0.0f || u + v > 1.0f )
+                    continue;
+
+                const float t = Dot( triangle.Edge2, qvec ) * invDet;
+                if ( t > 0.0f && t < closest ) {
+                    closest = t;
+                    outHit = { triangle.Index, t, u, v };
+                    found = true;
+
+                    if ( anyHit )
+                        return true;
+                }
+            }
+            continue;
+        }
+
+        // The nearer child goes on top, so it is walked first and can make the other one obsolete
+        const unsigned int left = node.LeftOrFirst;
+        const float tLeft = ray.IntersectBox( Nodes[left].Min, Nodes[left].Max, closest );
+        const float tRight = ray.IntersectBox( Nodes[left + 1].Min, Nodes[left + 1].Max, closest );
+        if ( tLeft <= tRight ) {
+            if ( tRight != FLT_MAX )
+                stack[stackSize++] = { left + 1, tRight };
+            if ( tLeft != FLT_MAX )
+                stack[stackSize++] = { left, tLeft };
+        } else {
+            if ( tLeft != FLT_MAX )
+                stack[stackSize++] = { left, tLeft };
+            stack[stackSize++] = { left + 1, tRight };
+        }
+    }
+
+    return found;
+}
+
+/** TraceRay for many rays at once */
+void TriangleBvh::TraceRays( const XMFLOAT3* origins, const XMFLOAT3* dirs, unsigned int numRays, float maxDistance, RayHit* outHits ) const {
+    if ( numRays == 0 )
+        return;
+
+    // Sorted by the octant of the direction, then along a Morton curve through the origins
+    zTBBox3D originBox = EmptyBox();
+    for ( unsigned int i = 0; i < numRays; i++ ) {
+        GrowBox( originBox, { origins[i], origins[i] } );
+    }
+
+    const float* boxMin = &originBox.Min.x;
+    const float* boxMax = &originBox.Max.x;
+    float cellScale[3];
+    for ( int axis = 0; axis < 3; axis++ ) {
+        const float extent = boxMax[axis] - boxMin[axis];
+        cellScale[axis] = extent > 0.0f ? 1023.0f / extent : 0.0f;
+    }
+
+    std::vector<std::pair<uint64_t, unsigned int>> keys( numRays );
+    for ( unsigned int i = 0; i < numRays; i++ ) {
+        const float* o = &origins[i].x;
+        const float* d = &dirs[i].x;
+        uint32_t morton = 0;
+        uint32_t octant = 0;
+        for ( int axis = 0; axis < 3; axis++ ) {
+            const uint32_t cell = static_cast<uint32_t>((o[axis] - boxMin[axis]) * cellScale[axis]);
+            morton |= SpreadBits10( cell ) << axis;
+            octant |= (d[axis] < 0.0f ? 1u : 0u) << axis;
+        }
+        keys[i] = { (static_cast<uint64_t>(octant) << 32) | morton, i };
+    }
+    std::sort( keys.begin(), keys.end() );
+
+    unsigned int packet[4];
+    for ( unsigned int first = 0; first < numRays; first += 4 ) {
+        const unsigned int count = std::min( 4u, numRays - first );
+        for ( unsigned int lane = 0; lane < count; lane++ ) {
+            packet[lane] = keys[first + lane].second;
+        }
+        TracePacket( origins, dirs, packet, count, maxDistance, outHits );
+    }
+}
+
+/** Traces up to 4 rays together */
+void TriangleBvh::TracePacket( const XMFLOAT3* origins, const XMFLOAT3* dirs, const unsigned int* rays, unsigned int numRays, float maxDistance, RayHit* outHits ) const {
+    // Unused lanes repeat the last ray, but can't hit anything closer than -1
+    alignas(16) float lanes[7][4];
+    for ( unsigned int lane = 0; lane < 4; lane++ ) {
+        const unsigned int ray = rays[std::min( lane, numRays - 1 )];
+        const float* o = &origins[ray].x;
+        const float* d = &dirs[ray].x;
+        for ( int axis = 0; axis < 3; axis++ ) {
+            lanes[axis][lane] = o[axis];
+            lanes[3 + axis][lane] = d[axis];
+        }
+        lanes[6][lane] = lane < numRays ? maxDistance : -1.0f;
+    }
+
+    __m128 origin[3], dir[3], invDir[3];
+    float packetDir[3];
+    for ( int axis = 0; axis < 3; axis++ ) {
+        origin[axis] = _mm_load_ps( lanes[axis] );
+        dir[axis] = _mm_load_ps( lanes[3 + axis] );
+
+        // Parallel axes get a huge factor instead of infinity, so origins right on a slab don't give 0 * inf.
+        // The box test stays conservative, it only lets more boxes through in that case.
+        float inv[4];
+        for ( int lane = 0; lane < 4; lane++ ) {
+            const float d = lanes[3 + axis][lane];
+            inv[lane] = 1.0f / (d != 0.0f ? d : 1e-30f);
+        }
+        invDir[axis] = _mm_loadu_ps( inv );
+        packetDir[axis] = lanes[3 + axis][0] + lanes[3 + axis][1] + lanes[3 + axis][2] + lanes[3 + axis][3];
+    }
+
+    __m128 closest = _mm_load_ps( lanes[6] );
+    __m128 hitU = _mm_setzero_ps();
+    __m128 hitV = _mm_setzero_ps();
+    __m128 hitTriangle = _mm_castsi128_ps( _mm_set1_epi32( static_cast<int>(NO_TRIANGLE) ) );
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps( 1.0f );
+    const __m128 epsilon = _mm_set1_ps( PARALLEL_EPSILON );
+    const __m128 negEpsilon = _mm_set1_ps( -PARALLEL_EPSILON );
+
+    unsigned int stack[MAX_DEPTH + 1];
+    unsigned int stackSize = 0;
+    if ( !Nodes.empty() ) {
+        stack[stackSize++] = 0;
+    }
+
+    while ( stackSize ) {
+        const Node& node = Nodes[stack[--stackSize]];
+
+        // Slab test of all lanes against the box, up to what each of them has hit so far
+        const float* boxMin = &node.Min.x;
+        const float* boxMax = &node.Max.x;
+        __m128 tEnter = zero;
+        __m128 tExit = closest;
+        for ( int axis = 0; axis < 3; axis++ ) {
+            const __m128 t1 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( boxMin[axis] ), origin[axis] ), invDir[axis] );
+            const __m128 t2 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( boxMax[axis] ), origin[axis] ), invDir[axis] );
+            tEnter = _mm_max_ps( tEnter, _mm_min_ps( t1, t2 ) );
+            tExit = _mm_min_ps( tExit, _mm_max_ps( t1, t2 ) );
+        }
+        if ( !_mm_movemask_ps( _mm_cmple_ps( tEnter, tExit ) ) )
+            continue;
+
+        if ( !node.Count ) {
+            // Walk the child first that lies further along the directions of the rays
+            const Node& left = Nodes[node.LeftOrFirst];
+            const Node& right = Nodes[node.LeftOrFirst + 1];
+            float bestSeparation = -1.0f;
+            bool leftFirst = true;
+            for ( int axis = 0; axis < 3; axis++ ) {
+                const float leftCenter = (&left.Min.x)[axis] + (&left.Max.x)[axis];
+                const float rightCenter = (&right.Min.x)[axis] + (&right.Max.x)[axis];
+                if ( fabsf( leftCenter - rightCenter ) > bestSeparation ) {
+                    bestSeparation = fabsf( leftCenter - rightCenter );
+                    leftFirst = (leftCenter <= rightCenter) == (packetDir[axis] >= 0.0f);
+                }
+            }
+
+            stack[stackSize++] = leftFirst ? node.LeftOrFirst + 1 : node.LeftOrFirst;
+            stack[stackSize++] = leftFirst ? node.LeftOrFirst : node.LeftOrFirst + 1;
+            continue;
+        }
+
+        // Moeller-Trumbore on all lanes, the same operations in the same order as in Trace
+        for ( unsigned int i = node.LeftOrFirst; i < node.LeftOrFirst + node.Count; i++ ) {
+            const Triangle& triangle = Triangles[i];
+            const __m128 e1x = _mm_set1_ps( triangle.Edge1.x ), e1y = _mm_set1_ps( triangle.Edge1.y ), e1z = _mm_set1_ps( triangle.Edge1.z );
+            const __m128 e2x = _mm_set1_ps( triangle.Edge2.x ), e2y = _mm_set1_ps( triangle.Edge2.y ), e2z = _mm_set1_ps( triangle.Edge2.z );
+
+            const __m128 px = _mm_sub_ps( _mm_mul_ps( dir[1], e2z ), _mm_mul_ps( dir[2], e2y ) );
+            const __m128 py = _mm_sub_ps( _mm_mul_ps( dir[2], e2x ), _mm_mul_ps( dir[0], e2z ) );
+            const __m128 pz = _mm_sub_ps( _mm_mul_ps( dir[0], e2y ), _mm_mul_ps( dir[1], e2x ) );
+            const __m128 det = _mm_add_ps( _mm_add_ps( _mm_mul_ps( e1x, px ), _mm_mul_ps( e1y, py ) ), _mm_mul_ps( e1z, pz ) );
+            const __m128 parallel = _mm_and_ps( _mm_cmpgt_ps( det, negEpsilon ), _mm_cmplt_ps( det, epsilon ) );
+            const __m128 invDet = _mm_div_ps( one, det );
+
+            const __m128 tx = _mm_sub_ps( origin[0], _mm_set1_ps( triangle.V0.x ) );
+            const __m128 ty = _mm_sub_ps( origin[1], _mm_set1_ps( triangle.V0.y ) );
+            const __m128 tz = _mm_sub_ps( origin[2], _mm_set1_ps( triangle.V0.z ) );
+            const __m128 u = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( tx, px ), _mm_mul_ps( ty, py ) ), _mm_mul_ps( tz, pz ) ), invDet );
+
+            const __m128 qx = _mm_sub_ps( _mm_mul_ps( ty, e1z ), _mm_mul_ps( tz, e1y ) );
+            const __m128 qy = _mm_sub_ps( _mm_mul_ps( tz, e1x ), _mm_mul_ps( tx, e1z ) );
+            const __m128 qz = _mm_sub_ps( _mm_mul_ps( tx, e1y ), _mm_mul_ps( ty, e1x ) );
+            const __m128 v = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( dir[0], qx ), _mm_mul_ps( dir[1], qy ) ), _mm_mul_ps( dir[2], qz ) ), invDet );
+            const __m128 t = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( e2x, qx ), _mm_mul_ps( e2y, qy ) ), _mm_mul_ps( e2z, qz ) ), invDet );
+
+            __m128 hit = _mm_and_ps( _mm_cmpge_ps( u, zero ), _mm_cmple_ps( u, one ) );
+            hit = _mm_and_ps( hit, _mm_and_ps( _mm_cmpge_ps( v, zero ), _mm_cmple_ps( _mm_add_ps( u, v ), one ) ) );
+            hit = _mm_and_ps( hit, _mm_and_ps( _mm_cmpgt_ps( t, zero ), _mm_cmplt_ps( t, closest ) ) );
+            hit = _mm_andnot_ps( parallel, hit );
+            if ( !_mm_movemask_ps( hit ) )
+                continue;
+
+            closest = Select( hit, t, closest );
+            hitU = Select( hit, u, hitU );
+            hitV = Select( hit, v, hitV );
+            hitTriangle = Select( hit, _mm_castsi128_ps( _mm_set1_epi32( static_cast<int>(triangle.Index) ) ), hitTriangle );
+        }
+    }
+
+    alignas(16) float distances[4], us[4], vs[4];
+    alignas(16) unsigned int triangles[4];
+    _mm_store_ps( distances, closest );
+    _mm_store_ps( us, hitU );
+    _mm_store_ps( vs, hitV );
+    _mm_store_si128( reinterpret_cast<__m128i*>(triangles), _mm_castps_si128( hitTriangle ) );
+    for ( unsigned int lane = 0; lane < numRays; lane++ ) {
+        outHits[rays[lane]] = { triangles[lane], distances[lane], us[lane], vs[lane] };
+    }
+}
+
+/** Appends all triangles whose bounding boxes overlap the box */
+void TriangleBvh::QueryBox( const zTBBox3D& box, std::vector<unsigned int>& outTriangles ) const {
+    if ( Nodes.empty() )
+        return;
+
+    auto overlaps = [&box]( const XMFLOAT3& min, const XMFLOAT3& max ) {
+        return min.x <= box.Max.x && max.x >= box.Min.x &&
+            min.y <= box.Max.y && max.y >= box.Min.y &&
+            min.z <= box.Max.z && max.z >= box.Min.z;
+    };
+
+    unsigned int stack[MAX_DEPTH + 1];
+    unsigned int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while ( stackSize ) {
+        const Node& node = Nodes[stack[--stackSize]];
+        if ( !overlaps( node.Min, node.Max ) )
+            continue;
+
+        if ( !node.Count ) {
+            stack[stackSize++] = node.LeftOrFirst;
+            stack[stackSize++] = node.LeftOrFirst + 1;
+            continue;
+        }
+
+        for ( unsigned int i = node.LeftOrFirst; i < node.LeftOrFirst + node.Count; i++ ) {
+            const Triangle& triangle = Triangles[i];
+            const XMFLOAT3& v0 = triangle.V0;
+            const XMFLOAT3 v1( v0.x + triangle.Edge1.x, v0.y + triangle.Edge1.y, v0.z + triangle.Edge1.z );
+            const XMFLOAT3 v2( v0.x + triangle.Edge2.x, v0.y + triangle.Edge2.y, v0.z + triangle.Edge2.z );
+            const XMFLOAT3 min( std::min( { v0.x, v1.x, v2.x } ), std::min( { v0.y, v1.y, v2.y } ), std::min( { v0.z, v1.z, v2.z } ) );
+            const XMFLOAT3 max( std::max( { v0.x, v1.x, v2.x } ), std::max( { v0.y, v1.y, v2.y } ), std::max( { v0.z, v1.z, v2.z } ) );
+            if ( overlaps( min, max ) ) {
+                outTriangles.push_back( triangle.Index );
+            }
+        }
+    }
+}
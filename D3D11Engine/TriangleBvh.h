@@ -0,0 +1,88 @@
+#pragma once
+#include "pch.h"
+
+/** Bounding volume hierarchy over a fixed set of triangles, like the world mesh. Built once with the surface area
+    heuristic on binned centroids, which keeps rays from visiting much more than the nodes along their way.
+    Nodes are 32 bytes with their children next to each other, the triangles are stored in the order of the leaves. */
+class TriangleBvh {
+public:
+    static const unsigned int NO_TRIANGLE = 0xFFFFFFFF;
+
+    /** Most triangles a leaf gets if splitting it would be cheaper, and the most nodes a path from the root has */
+    static const unsigned int MAX_LEAF_TRIANGLES = 8;
+    static const unsigned int MAX_DEPTH = 64;
+
+    TriangleBvh();
+
+    /** Removes all triangles */
+    void Clear();
+
+    /** Builds the tree, every three positions are one triangle. The queries refer to triangles by their index in there. */
+    void Build( const std::vector<XMFLOAT3>& positions );
+
+    bool IsEmpty() const { return Nodes.empty(); }
+    unsigned int GetNumTriangles() const { return static_cast<unsigned int>(Triangles.size()); }
+    unsigned int GetNumNodes() const { return static_cast<unsigned int>(Nodes.size()); }
+    unsigned int GetDepth() const { return Depth; }
+
+    struct RayHit {
+        /** NO_TRIANGLE if nothing was hit */
+        unsigned int Triangle;
+
+        /** Distance along the ray in multiples of dir */
+        float Distance;
+
+        /** Barycentric coordinates of the hit, weights of the second and third corner */
+        float U;
+        float V;
+    };
+
+    /** Finds the closest triangle hit by the ray from origin along dir, between 0 and maxDistance (in multiples of dir).
+        Uses the same test as Toolbox::IntersectTri, so both sides of a triangle are hit. */
+    bool TraceRay( const XMFLOAT3& origin, const XMFLOAT3& dir, float maxDistance, RayHit& outHit ) const;
+
+    /** Returns whether any triangle is hit before maxDistance. Stops at the first one found, so it is cheaper than TraceRay. */
+    bool TraceRayAny( const XMFLOAT3& origin, const XMFLOAT3& dir, float maxDistance ) const;
+
+    /** TraceRay for many rays at once, hit i belongs to ray i. The rays are sorted so ones starting close to each
+        other in the same direction end up together, then traced 4 at a time so each node test and triangle test
+        covers the whole packet. Only reads the tree, so it can be used from several threads at once. */
+    void TraceRays( const XMFLOAT3* origins, const XMFLOAT3* dirs, unsigned int numRays, float maxDistance, RayHit* outHits ) const;
+
+    /** Appends all triangles whose bounding boxes overlap the box, unsorted */
+    void QueryBox( const zTBBox3D& box, std::vector<unsigned int>& outTriangles ) const;
+
+private:
+    struct Node {
+        XMFLOAT3 Min;
+
+        /** First child for interior nodes, the second one follows it. First triangle for leaves. */
+        unsigned int LeftOrFirst;
+
+        XMFLOAT3 Max;
+
+        /** Number of triangles, 0 for interior nodes */
+        unsigned int Count;
+    };
+
+    /** Corner and edges, which is what the intersection test needs */
+    struct Triangle {
+        XMFLOAT3 V0;
+        XMFLOAT3 Edge1;
+        XMFLOAT3 Edge2;
+        unsigned int Index;
+    };
+
+    /** Splits the node where the surface area heuristic says so. Returns false if it stays a leaf. */
+    bool SplitNode( unsigned int node, unsigned int depth, const std::vector<zTBBox3D>& bounds, const std::vector<XMFLOAT3>& centroids, std::vector<unsigned int>& order );
+
+    /** Walks all nodes the ray passes closer than maxDistance, nearest first. Stops at the first hit if anyHit is set. */
+    bool Trace( const XMFLOAT3& origin, const XMFLOAT3& dir, float maxDistance, bool anyHit, RayHit& outHit ) const;
+
+    /** Traces up to 4 rays together, lanes past numRays stay unused */
+    void TracePacket( const XMFLOAT3* origins, const XMFLOAT3* dirs, const unsigned int* rays, unsigned int numRays, float maxDistance, RayHit* outHits ) const;
+
+    std::vector<Node> Nodes;
+    std::vector<Triangle> Triangles;
+    unsigned int Depth;
+};
@@ -0,0 +1,231 @@
+#include "pch.h"
+#include "VertexNormals.h"
+#include <immintrin.h>
+
+ZAccumulateVertexNormals AccumulateVertexNormals = AccumulateVertexNormals_SSE2;
+
+namespace {
+    /** Coefficients of acos(x) ~ sqrt(1 - x) * (c0 + c1 * x + c2 * x^2 + c3 * x^3) for x in [0, 1] */
+    const float ACOS_C0 = 1.5707288f;
+    const float ACOS_C1 = -0.2121144f;
+    const float ACOS_C2 = 0.0742610f;
+    const float ACOS_C3 = -0.0187293f;
+
+    /** Floats between two vertices, used as stride when gathering positions */
+    const int VERTEX_STRIDE_FLOATS = sizeof( ExVertexStruct ) / sizeof( float );
+    static_assert(sizeof( ExVertexStruct ) % sizeof( float ) == 0, "Positions must be float aligned");
+
+    /** Thin overloads so the triangle math below can be written once for every vector width */
+    inline __m128 Add( __m128 a, __m128 b ) { return _mm_add_ps( a, b ); }
+    inline __m128 Sub( __m128 a, __m128 b ) { return _mm_sub_ps( a, b ); }
+    inline __m128 Mul( __m128 a, __m128 b ) { return _mm_mul_ps( a, b ); }
+    inline __m128 Div( __m128 a, __m128 b ) { return _mm_div_ps( a, b ); }
+    inline __m128 Sqrt( __m128 a ) { return _mm_sqrt_ps( a ); }
+    inline __m128 Min( __m128 a, __m128 b ) { return _mm_min_ps( a, b ); }
+    inline __m128 Max( __m128 a, __m128 b ) { return _mm_max_ps( a, b ); }
+    inline __m128 Abs( __m128 a ) { return _mm_andnot_ps( _mm_set1_ps( -0.0f ), a ); }
+    inline __m128 Select( __m128 mask, __m128 a, __m128 b ) { return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) ); }
+    inline __m128 IsNegative( __m128 a ) { return _mm_cmplt_ps( a, _mm_setzero_ps() ); }
+    inline __m128 Splat( __m128, float f ) { return _mm_set1_ps( f ); }
+
+#ifdef _XM_AVX2_INTRINSICS_
+    inline __m256 Add( __m256 a, __m256 b ) { return _mm256_add_ps( a, b ); }
+    inline __m256 Sub( __m256 a, __m256 b ) { return _mm256_sub_ps( a, b ); }
+    inline __m256 Mul( __m256 a, __m256 b ) { return _mm256_mul_ps( a, b ); }
+    inline __m256 Div( __m256 a, __m256 b ) { return _mm256_div_ps( a, b ); }
+    inline __m256 Sqrt( __m256 a ) { return _mm256_sqrt_ps( a ); }
+    inline __m256 Min( __m256 a, __m256 b ) { return _mm256_min_ps( a, b ); }
+    inline __m256 Max( __m256 a, __m256 b ) { return _mm256_max_ps( a, b ); }
+    inline __m256 Abs( __m256 a ) { return _mm256_andnot_ps( _mm256_set1_ps( -0.0f ), a ); }
+    inline __m256 Select( __m256 mask, __m256 a, __m256 b ) { return _mm256_blendv_ps( b, a, mask ); }
+    inline __m256 IsNegative( __m256 a ) { return _mm256_cmp_ps( a, _mm256_setzero_ps(), _CMP_LT_OQ ); }
+    inline __m256 Splat( __m256, float f ) { return _mm256_set1_ps( f ); }
+#endif
+
+    template<typename V>
+    inline V FastACosV( V x ) {
+        V ax = Abs( x );
+        V p = Add( Mul( Splat( x, ACOS_C3 ), ax ), Splat( x, ACOS_C2 ) );
+        p = Add( Mul( p, ax ), Splat( x, ACOS_C1 ) );
+        p = Add( Mul( p, ax ), Splat( x, ACOS_C0 ) );
+        V r = Mul( Sqrt( Sub( Splat( x, 1.0f ), ax ) ), p );
+
+        // acos(-x) = pi - acos(x)
+        return Select( IsNegative( x ), Sub( Splat( x, XM_PI ), r ), r );
+    }
+
+    /** Cosine of the angle between a and b, clamped to [-1, 1]. Degenerate edges give NaN, which the
+        max turns into -1. Their face normal is zero anyway, so the weight doesn't matter. */
+    template<typename V>
+    inline V ClampedCos( V dot, V lenSqA, V lenSqB ) {
+        V c = Div( dot, Sqrt( Mul( lenSqA, lenSqB ) ) );
+        return Min( Max( c, Splat( c, -1.0f ) ), Splat( c, 1.0f ) );
+    }
+
+    template<typename V>
+    inline V Dot( const V* a, const V* b ) {
+        return Add( Add( Mul( a[0], b[0] ), Mul( a[1], b[1] ) ), Mul( a[2], b[2] ) );
+    }
+
+    /** Computes the face normals (unnormalized) and the corner weights of a batch of triangles
+        given as SoA positions p[corner][axis] */
+    template<typename V>
+    inline void ComputeTriangleWeights( const V p[3][3], V n[3], V w[3] ) {
+        V e01[3], e02[3], e12[3];
+        for ( int a = 0; a < 3; a++ ) {
+            e01[a] = Sub( p[1][a], p[0][a] );
+            e02[a] = Sub( p[2][a], p[0][a] );
+            e12[a] = Sub( p[2][a], p[1][a] );
+        }
+
+        n[0] = Sub( Mul( e01[1], e02[2] ), Mul( e01[2], e02[1] ) );
+        n[1] = Sub( Mul( e01[2], e02[0] ), Mul( e01[0], e02[2] ) );
+        n[2] = Sub( Mul( e01[0], e02[1] ), Mul( e01[1], e02[0] ) );
+
+        V l01 = Dot( e01, e01 );
+        V l02 = Dot( e02, e02 );
+        V l12 = Dot( e12, e12 );
+
+        // Corner 1 looks along e12 and -e01, corner 2 along -e02 and -e12
+        w[0] = FastACosV( ClampedCos( Dot( e01, e02 ), l01, l02 ) );
+        w[1] = FastACosV( ClampedCos( Sub( Splat( l01, 0.0f ), Dot( e01, e12 ) ), l01, l12 ) );
+        w[2] = FastACosV( ClampedCos( Dot( e02, e12 ), l02, l12 ) );
+    }
+
+    /** Adds the weighted normals of numTriangles triangles back to their vertices. Scattering stays
+        scalar, triangles of the same batch may share vertices. */
+    inline void ScatterNormals( const VERTEX_INDEX* indices, unsigned int numTriangles, const float* n, const float* w, unsigned int width, XMFLOAT3* normals ) {
+        for ( unsigned int t = 0; t < numTriangles; t++ ) {
+            const float nx = n[t];
+            const float ny = n[width + t];
+            const float nz = n[2 * width + t];
+
+            for ( unsigned int c = 0; c < 3; c++ ) {
+                const float weight = w[c * width + t];
+                XMFLOAT3& out = normals[indices[t * 3 + c]];
+                out.x += weight * nx;
+                out.y += weight * ny;
+                out.z += weight * nz;
+            }
+        }
+    }
+
+    /** Processes 4 triangles, of which numTriangles are valid and the rest is padding */
+    void AccumulateBatch_SSE2( const ExVertexStruct* vertices, const VERTEX_INDEX* indices, unsigned int numTriangles, XMFLOAT3* normals ) {
+        __m128 p[3][3];
+        for ( int c = 0; c < 3; c++ ) {
+            // Loads 16 bytes from the position, the 4th float is the next member and gets dropped
+            __m128 r0 = _mm_loadu_ps( &vertices[indices[c]].Position.x );
+            __m128 r1 = _mm_loadu_ps( &vertices[indices[3 + c]].Position.x );
+            __m128 r2 = _mm_loadu_ps( &vertices[indices[6 + c]].Position.x );
+            __m128 r3 = _mm_loadu_ps( &vertices[indices[9 + c]].Position.x );
+            _MM_TRANSPOSE4_PS( r0, r1, r2, r3 );
+            p[c][0] = r0;
+            p[c][1] = r1;
+            p[c][2] = r2;
+        }
+
+        __m128 n[3], w[3];
+        ComputeTriangleWeights( p, n, w );
+
+        alignas(16) float nOut[12];
+        alignas(16) float wOut[12];
+        for ( int i = 0; i < 3; i++ ) {
+            _mm_store_ps( &nOut[i * 4], n[i] );
+            _mm_store_ps( &wOut[i * 4], w[i] );
+        }
+
+        ScatterNormals( indices, numTriangles, nOut, wOut, 4, normals );
+    }
+
+#ifdef _XM_AVX2_INTRINSICS_
+    /** Processes 8 triangles, of which numTriangles are valid and the rest is padding */
+    void AccumulateBatch_AVX2( const ExVertexStruct* vertices, const VERTEX_INDEX* indices, unsigned int numTriangles, XMFLOAT3* normals ) {
+        const __m256i stride = _mm256_set1_epi32( VERTEX_STRIDE_FLOATS );
+        const float* base = &vertices[0].Position.x;
+
+        __m256 p[3][3];
+        for ( int c = 0; c < 3; c++ ) {
+            __m256i offsets = _mm256_mullo_epi32( _mm256_setr_epi32(
+                indices[c], indices[3 + c], indices[6 + c], indices[9 + c],
+                indices[12 + c], indices[15 + c], indices[18 + c], indices[21 + c] ), stride );
+
+            p[c][0] = _mm256_i32gather_ps( base, offsets, 4 );
+            p[c][1] = _mm256_i32gather_ps( base + 1, offsets, 4 );
+            p[c][2] = _mm256_i32gather_ps( base + 2, offsets, 4 );
+        }
+
+        __m256 n[3], w[3];
+        ComputeTriangleWeights( p, n, w );
+
+        alignas(32) float nOut[24];
+        alignas(32) float wOut[24];
+        for ( int i = 0; i < 3; i++ ) {
+            _mm256_store_ps( &nOut[i * 8], n[i] );
+            _mm256_store_ps( &wOut[i * 8], w[i] );
+        }
+
+        ScatterNormals( indices, numTriangles, nOut, wOut, 8, normals );
+    }
+#endif
+
+    typedef void (*AccumulateBatchFn)(const ExVertexStruct*, const VERTEX_INDEX*, unsigned int, XMFLOAT3*);
+
+    /** Runs the given batch function over all triangles. The last batch is padded by repeating the last triangle. */
+    template<unsigned int BATCH_SIZE>
+    void AccumulateBatched( AccumulateBatchFn batch, const ExVertexStruct* vertices, const VERTEX_INDEX* indices, unsigned int numIndices, XMFLOAT3* normals ) {
+        const unsigned int numTriangles = numIndices / 3;
+
+        unsigned int t = 0;
+        for ( ; t + BATCH_SIZE <= numTriangles; t += BATCH_SIZE ) {
+            batch( vertices, &indices[t * 3], BATCH_SIZE, normals );
+        }
+
+        if ( t < numTriangles ) {
+            VERTEX_INDEX tail[BATCH_SIZE * 3];
+            for ( unsigned int i = 0; i < BATCH_SIZE; i++ ) {
+                unsigned int src = std::min( t + i, numTriangles - 1 ) * 3;
+                tail[i * 3 + 0] = indices[src + 0];
+                tail[i * 3 + 1] = indices[src + 1];
+                tail[i * 3 + 2] = indices[src + 2];
+            }
+
+            batch( vertices, tail, numTriangles - t, normals );
+        }
+    }
+}
+
+/** Reference implementation, one triangle at a time with an exact acos */
+void AccumulateVertexNormals_Scalar( const ExVertexStruct* vertices, const VERTEX_INDEX* indices, unsigned int numIndices, XMFLOAT3* normals ) {
+    for ( unsigned int i = 0; i + 2 < numIndices; i += 3 ) {
+        XMFLOAT3 v[3] = { *vertices[indices[i]].Position.toXMFLOAT3(), *vertices[indices[i + 1]].Position.toXMFLOAT3(), *vertices[indices[i + 2]].Position.toXMFLOAT3() };
+        FXMVECTOR normal = XMVector3Cross( (XMLoadFloat3( &v[1] ) - XMLoadFloat3( &v[0] )), (XMLoadFloat3( &v[2] ) - XMLoadFloat3( &v[0] )) );
+
+        for ( int j = 0; j < 3; ++j ) {
+            FXMVECTOR a = XMLoadFloat3( &v[(j + 1) % 3] ) - XMLoadFloat3( &v[j] );
+            FXMVECTOR b = XMLoadFloat3( &v[(j + 2) % 3] ) - XMLoadFloat3( &v[j] );
+            FXMVECTOR cosAngle = XMVectorClamp( XMVector3Dot( a, b ) / (XMVector3Length( a ) * XMVector3Length( b )), g_XMNegativeOne, g_XMOne );
+            FXMVECTOR weight = XMVectorACos( cosAngle );
+            XMVECTOR XMV_normals_indices = XMLoadFloat3( &normals[indices[(i + j)]] );
+            XMV_normals_indices += weight * normal;
+            XMStoreFloat3( &normals[indices[(i + j)]], XMV_normals_indices );
+        }
+    }
+}
+
+/** Processes 4 triangles at once */
+void AccumulateVertexNormals_SSE2( const ExVertexStruct* vertices, const VERTEX_INDEX* indices, unsigned int numIndices, XMFLOAT3* normals ) {
+    AccumulateBatched<4>( AccumulateBatch_SSE2, vertices, indices, numIndices, normals );
+}
+
+#ifdef _XM_AVX2_INTRINSICS_
+/** Processes 8 triangles at once and gathers the positions directly */
+void AccumulateVertexNormals_AVX2( const ExVertexStruct* vertices, const VERTEX_INDEX* indices, unsigned int numIndices, XMFLOAT3* normals ) {
+    AccumulateBatched<8>( AccumulateBatch_AVX2, vertices, indices, numIndices, normals );
+}
+#endif
+
+/** acos approximation used by the SIMD kernels */
+float FastACos( float x ) {
+    return _mm_cvtss_f32( FastACosV( _mm_set_ss( x ) ) );
+}
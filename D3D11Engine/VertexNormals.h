@@ -0,0 +1,25 @@
+#pragma once
+#include "pch.h"
+
+/** Adds the face normal of every triangle, weighted by its area and the angle at the corner, to the
+    normals of its three vertices. normals must have one entry per vertex. */
+typedef void (*ZAccumulateVertexNormals)(const ExVertexStruct* vertices, const VERTEX_INDEX* indices, unsigned int numIndices, XMFLOAT3* normals);
+
+/** Best kernel for this CPU, selected in CheckPlatformSupport */
+extern ZAccumulateVertexNormals AccumulateVertexNormals;
+
+/** Reference implementation, one triangle at a time with an exact acos */
+void AccumulateVertexNormals_Scalar( const ExVertexStruct* vertices, const VERTEX_INDEX* indices, unsigned int numIndices, XMFLOAT3* normals );
+
+/** Processes 4 triangles at once */
+void AccumulateVertexNormals_SSE2( const ExVertexStruct* vertices, const VERTEX_INDEX* indices, unsigned int numIndices, XMFLOAT3* normals );
+
+#ifdef _XM_AVX2_INTRINSICS_
+/** Processes 8 triangles at once and gathers the positions directly */
+void AccumulateVertexNormals_AVX2( const ExVertexStruct* vertices, const VERTEX_INDEX* indices, unsigned int numIndices, XMFLOAT3* normals );
+#endif
+
+/** acos approximation used by the SIMD kernels (Abramowitz & Stegun 4.4.45). Off by at most 7e-5 radians
+    for inputs in [-1, 1]. Only the corner weights go through it, so the normals stay very close to the
+    scalar ones, but not bit exact. */
+float FastACos( float x );
@@ -13,6 +13,40 @@ struct ExVertexStruct {
     DWORD Color;
 };
 
+/** Packed version of ExVertexStruct, 28 instead of 44 bytes. Positions are 21 bits per axis on a grid shared
+    by the whole world, normals are octahedral encoded 16-bit snorm, the lightmap texcoords are halfs and the
+    rest is kept as is. The vertex shaders compiled with COMPACT_VERTICES read this directly.
+    See WorldConverter::EncodeCompactVertices */
+struct ExVertexStructCompact {
+    /** Grid cell of the position: x in the low 21 bits of the first word, y in the 11 bits above it and the
+        low 10 bits of the second word, z in the 21 bits above that */
+    unsigned int Position[2];
+    short Normal[2];
+    float2 TexCoord;
+    unsigned short TexCoord2[2];
+    DWORD Color;
+};
+
+/** Grid of the positions of ExVertexStructCompact: Offset + Cell * Scale. Scale is a power of two and Offset a
+    multiple of it, so every cell turns into the same float position everywhere. Also the layout of the
+    constant buffer of the COMPACT_VERTICES shaders. */
+struct CompactVertexQuantization {
+    float3 Offset;
+    float Scale;
+};
+
+/** Largest differences between a mesh and its compact version */
+struct CompactVertexError {
+    /** Distance in world units */
+    float Position;
+
+    /** Angle in radians */
+    float Normal;
+
+    /** Largest difference of a single texcoord component */
+    float TexCoord;
+};
+
 struct SimpleObjectVertexStruct {
     float3 Position;
     float2 TexCoord;
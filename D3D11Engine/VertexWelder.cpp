@@ -0,0 +1,293 @@
+#include "pch.h"
+#include "VertexWelder.h"
+
+namespace {
+    const uint32_t EMPTY_SLOT = 0xFFFFFFFF;
+    const uint64_t EMPTY_TRIANGLE_SLOT = 0xFFFFFFFFFFFFFFFFull;
+
+    /** Moves the cell borders away from round values (and halves of them), which are very common in hand made meshes */
+    const double CELL_OFFSET = 0.3183098861837907;
+
+    /** Finalizer of splitmix64, gives us a well distributed hash from any 64-bit value */
+    FORCEINLINE uint64_t MixBits( uint64_t x ) {
+        x ^= x >> 30;
+        x *= 0xBF58476D1CE4E5B9ull;
+        x ^= x >> 27;
+        x *= 0x94D049BB133111EBull;
+        x ^= x >> 31;
+        return x;
+    }
+
+    FORCEINLINE uint64_t HashCombine( uint64_t seed, uint64_t value ) {
+        return MixBits( seed ^ (value + 0x9E3779B97F4A7C15ull + (seed << 6) + (seed >> 2)) );
+    }
+
+    FORCEINLINE uint32_t FloatBits( float f ) {
+        // Adding 0 turns -0 into +0, so both hash the same as they compare equal
+        f += 0.0f;
+
+        uint32_t bits;
+        memcpy( &bits, &f, sizeof( bits ) );
+        return bits;
+    }
+
+    /** Gets the components the vertices are compared by */
+    FORCEINLINE void GetKeyComponents( const ExVertexStruct& v, float* out ) {
+        out[0] = v.Position.x;
+        out[1] = v.Position.y;
+        out[2] = v.Position.z;
+        out[3] = v.TexCoord.x;
+        out[4] = v.TexCoord.y;
+    }
+
+    FORCEINLINE uint32_t HashExact( const ExVertexStruct& v ) {
+        float c[5];
+        GetKeyComponents( v, c );
+
+        uint64_t h = 0;
+        for ( int i = 0; i < 5; i++ ) {
+            h = HashCombine( h, FloatBits( c[i] ) );
+        }
+        return static_cast<uint32_t>(h);
+    }
+
+    FORCEINLINE uint32_t HashCell( const int64_t* cell ) {
+        // Called up to 32 times per vertex, so only mix once at the end
+        uint64_t h = 0;
+        for ( int i = 0; i < 5; i++ ) {
+            h = (h ^ static_cast<uint64_t>(cell[i])) * 0x100000001B3ull;
+        }
+        return static_cast<uint32_t>(MixBits( h ));
+    }
+
+    FORCEINLINE bool IsEqualExact( const ExVertexStruct& a, const ExVertexStruct& b ) {
+        return a.Position.x == b.Position.x
+            && a.Position.y == b.Position.y
+            && a.Position.z == b.Position.z
+            && a.TexCoord.x == b.TexCoord.x
+            && a.TexCoord.y == b.TexCoord.y;
+    }
+
+    /** Returns the smallest power of two which can hold the given amount of entries at a load factor of 0.5 */
+    uint32_t GetTableSize( unsigned int numEntries ) {
+        uint32_t size = 16;
+        while ( size < numEntries * 2 ) {
+            size <<= 1;
+        }
+        return size;
+    }
+}
+
+VertexWelder::VertexWelder( EWeldMode mode, float epsilon ) {
+    VertexSlotMask = 0;
+    SetMode( mode, epsilon );
+}
+
+/** Sets how vertices are compared */
+void VertexWelder::SetMode( EWeldMode mode, float epsilon ) {
+    Mode = mode;
+    Epsilon = epsilon;
+    InvCellSize = 1.0 / (static_cast<double>(epsilon) * CELL_SIZE_IN_EPSILONS);
+}
+
+/** Welds the given vertices */
+void VertexWelder::Weld( const ExVertexStruct* input, unsigned int numInputVertices, std::vector<ExVertexStruct>& outVertices, std::vector<VERTEX_INDEX>& outIndices ) {
+    WeldInternal( input, numInputVertices, outVertices, outIndices );
+}
+
+void VertexWelder::Weld( const ExVertexStruct* input, unsigned int numInputVertices, std::vector<ExVertexStruct>& outVertices, std::vector<unsigned int>& outIndices ) {
+    WeldInternal( input, numInputVertices, outVertices, outIndices );
+}
+
+template<typename T>
+void VertexWelder::WeldInternal( const ExVertexStruct* input, unsigned int numInputVertices, std::vector<ExVertexStruct>& outVertices, std::vector<T>& outIndices ) {
+    outVertices.clear();
+    outIndices.reserve( outIndices.size() + numInputVertices );
+
+    ResetVertexTables( numInputVertices );
+
+    for ( unsigned int i = 0; i < numInputVertices; i++ ) {
+        const ExVertexStruct& v = input[i];
+
+        // Bit-exact duplicates are by far the most common case, so always check for those first.
+        // If there is one, it's also the earliest vertex within epsilon, since any earlier one
+        // would have been merged with the exact duplicate already.
+        uint32_t hash = HashExact( v );
+        uint32_t freeSlot;
+        uint32_t index = FindExact( v, hash, outVertices, freeSlot );
+
+        if ( index == EMPTY_SLOT && Mode == WM_EPSILON ) {
+            index = FindEpsilon( v, outVertices );
+        }
+
+        if ( index == EMPTY_SLOT ) {
+            index = static_cast<uint32_t>(outVertices.size());
+            VertexSlots[freeSlot] = index;
+            SlotHashes[freeSlot] = hash;
+
+            if ( Mode == WM_EPSILON ) {
+                InsertIntoCell( v, index );
+            }
+
+            outVertices.emplace_back( v );
+        }
+
+        outIndices.emplace_back( static_cast<T>(index) );
+    }
+}
+
+/** Returns the index of the already welded vertex matching v, or EMPTY_SLOT */
+uint32_t VertexWelder::FindExact( const ExVertexStruct& v, uint32_t hash, const std::vector<ExVertexStruct>& welded, uint32_t& outFreeSlot ) const {
+    uint32_t slot = hash & VertexSlotMask;
+    while ( VertexSlots[slot] != EMPTY_SLOT ) {
+        if ( SlotHashes[slot] == hash && IsEqualExact( welded[VertexSlots[slot]], v ) ) {
+            return VertexSlots[slot];
+        }
+
+        slot = (slot + 1) & VertexSlotMask;
+    }
+
+    outFreeSlot = slot;
+    return EMPTY_SLOT;
+}
+
+uint32_t VertexWelder::FindEpsilon( const ExVertexStruct& v, const std::vector<ExVertexStruct>& welded ) const {
+    float c[NUM_KEY_COMPONENTS];
+    GetKeyComponents( v, c );
+
+    // Every vertex is stored in the cell its components fall into. A vertex within epsilon
+    // can only be in a neighbouring cell if we are closer than epsilon to that border.
+    int64_t cells[NUM_KEY_COMPONENTS][2];
+    int numCells[NUM_KEY_COMPONENTS];
+    for ( int d = 0; d < NUM_KEY_COMPONENTS; d++ ) {
+        // World positions are too big to get the fraction right in single precision
+        double scaled = c[d] * InvCellSize + CELL_OFFSET;
+        double cellStart = floor( scaled );
+        double frac = scaled - cellStart;
+
+        cells[d][0] = static_cast<int64_t>(cellStart);
+        numCells[d] = 1;
+
+        const double border = 1.0 / CELL_SIZE_IN_EPSILONS;
+        if ( frac < border ) {
+            cells[d][numCells[d]++] = cells[d][0] - 1;
+        } else if ( frac > 1.0 - border ) {
+            cells[d][numCells[d]++] = cells[d][0] + 1;
+        }
+    }
+
+    // Go through all combinations of candidate cells and take the earliest matching vertex,
+    // which is what a sequential search over the welded vertices would have found as well
+    uint32_t found = EMPTY_SLOT;
+    for ( int combination = 0; combination < (1 << NUM_KEY_COMPONENTS); combination++ ) {
+        int64_t cell[NUM_KEY_COMPONENTS];
+        bool valid = true;
+        for ( int d = 0; d < NUM_KEY_COMPONENTS; d++ ) {
+            int pick = (combination >> d) & 1;
+            if ( pick >= numCells[d] ) {
+                valid = false;
+                break;
+            }
+            cell[d] = cells[d][pick];
+        }
+
+        if ( !valid ) {
+            continue;
+        }
+
+        uint32_t hash = HashCell( cell );
+        uint32_t slot = hash & VertexSlotMask;
+        while ( CellSlots[slot] != EMPTY_SLOT ) {
+            uint32_t index = CellSlots[slot];
+            if ( CellHashes[slot] == hash && index < found && IsEqualEpsilon( welded[index], v ) ) {
+                found = index;
+            }
+
+            slot = (slot + 1) & VertexSlotMask;
+        }
+    }
+
+    return found;
+}
+
+/** Prepares the vertex tables for the given number of entries */
+void VertexWelder::ResetVertexTables( unsigned int numEntries ) {
+    uint32_t size = GetTableSize( numEntries );
+
+    // assign() keeps the capacity, so we only allocate when a bigger mesh comes along
+    VertexSlots.assign( size, EMPTY_SLOT );
+    SlotHashes.resize( size );
+
+    if ( Mode == WM_EPSILON ) {
+        CellSlots.assign( size, EMPTY_SLOT );
+        CellHashes.resize( size );
+    }
+
+    VertexSlotMask = size - 1;
+}
+
+/** Inserts the welded vertex into the table of its quantization cell */
+void VertexWelder::InsertIntoCell( const ExVertexStruct& v, uint32_t index ) {
+    float c[NUM_KEY_COMPONENTS];
+    GetKeyComponents( v, c );
+
+    int64_t cell[NUM_KEY_COMPONENTS];
+    for ( int d = 0; d < NUM_KEY_COMPONENTS; d++ ) {
+        cell[d] = static_cast<int64_t>(floor( c[d] * InvCellSize + CELL_OFFSET ));
+    }
+
+    uint32_t hash = HashCell( cell );
+    uint32_t slot = hash & VertexSlotMask;
+    while ( CellSlots[slot] != EMPTY_SLOT ) {
+        slot = (slot + 1) & VertexSlotMask;
+    }
+
+    CellSlots[slot] = index;
+    CellHashes[slot] = hash;
+}
+
+/** Returns whether the two vertices should be merged */
+bool VertexWelder::IsEqualEpsilon( const ExVertexStruct& a, const ExVertexStruct& b ) const {
+    return fabs( a.Position.x - b.Position.x ) <= Epsilon
+        && fabs( a.Position.y - b.Position.y ) <= Epsilon
+        && fabs( a.Position.z - b.Position.z ) <= Epsilon
+        && fabs( a.TexCoord.x - b.TexCoord.x ) <= Epsilon
+        && fabs( a.TexCoord.y - b.TexCoord.y ) <= Epsilon;
+}
+
+/** Throws out triangles which use the exact same indices as a previous one */
+void VertexWelder::RemoveDuplicateTriangles( std::vector<VERTEX_INDEX>& indices ) {
+    size_t numTriangles = indices.size() / 3;
+    uint32_t size = GetTableSize( static_cast<unsigned int>(numTriangles) );
+    uint32_t mask = size - 1;
+
+    TriangleSlots.assign( size, EMPTY_TRIANGLE_SLOT );
+    UniqueTriangles.clear();
+    UniqueTriangles.reserve( numTriangles );
+
+    for ( size_t i = 0; i < numTriangles * 3; i += 3 ) {
+        // Packed so that sorting the keys gives the same order as sorting the index tuples
+        uint64_t key = (static_cast<uint64_t>(indices[i + 0]) << 32)
+            | (static_cast<uint64_t>(indices[i + 1]) << 16)
+            | static_cast<uint64_t>(indices[i + 2]);
+
+        uint32_t slot = static_cast<uint32_t>(MixBits( key )) & mask;
+        while ( TriangleSlots[slot] != EMPTY_TRIANGLE_SLOT && TriangleSlots[slot] != key ) {
+            slot = (slot + 1) & mask;
+        }
+
+        if ( TriangleSlots[slot] == EMPTY_TRIANGLE_SLOT ) {
+            TriangleSlots[slot] = key;
+            UniqueTriangles.emplace_back( key );
+        }
+    }
+
+    std::sort( UniqueTriangles.begin(), UniqueTriangles.end() );
+
+    indices.clear();
+    for ( uint64_t key : UniqueTriangles ) {
+        indices.emplace_back( static_cast<VERTEX_INDEX>(key >> 32) );
+        indices.emplace_back( static_cast<VERTEX_INDEX>(key >> 16) );
+        indices.emplace_back( static_cast<VERTEX_INDEX>(key) );
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "pch.h"
+
+/** Welds unindexed vertex lists into indexed meshes using an open-addressing hash table.
+    The hash tables are kept between calls, so a welder should be reused (one per thread). */
+class VertexWelder {
+public:
+    enum EWeldMode {
+        /** Vertices are only merged if position and texcoord are bit-exact the same */
+        WM_BIT_EXACT,
+
+        /** Vertices are merged if position and texcoord are within the given epsilon */
+        WM_EPSILON
+    };
+
+    VertexWelder( EWeldMode mode = WM_EPSILON, float epsilon = 0.001f );
+
+    /** Sets how vertices are compared */
+    void SetMode( EWeldMode mode, float epsilon = 0.001f );
+
+    /** Welds the given vertices. The output vertices are in the order of their first occurrence,
+        indices are appended to outIndices */
+    void Weld( const ExVertexStruct* input, unsigned int numInputVertices, std::vector<ExVertexStruct>& outVertices, std::vector<VERTEX_INDEX>& outIndices );
+    void Weld( const ExVertexStruct* input, unsigned int numInputVertices, std::vector<ExVertexStruct>& outVertices, std::vector<unsigned int>& outIndices );
+
+    /** Throws out triangles which use the exact same indices as a previous one.
+        The remaining triangles are sorted by their indices. */
+    void RemoveDuplicateTriangles( std::vector<VERTEX_INDEX>& indices );
+
+private:
+    /** Number of epsilons a single quantization cell spans. Bigger cells mean fewer
+        vertices close to a cell border, which have to look into the neighbouring cells as well */
+    static constexpr double CELL_SIZE_IN_EPSILONS = 16.0;
+
+    /** Number of compared components (Position xyz + TexCoord xy) */
+    static constexpr int NUM_KEY_COMPONENTS = 5;
+
+    template<typename T>
+    void WeldInternal( const ExVertexStruct* input, unsigned int numInputVertices, std::vector<ExVertexStruct>& outVertices, std::vector<T>& outIndices );
+
+    /** Returns the index of the already welded vertex matching v, or EMPTY_SLOT */
+    uint32_t FindExact( const ExVertexStruct& v, uint32_t hash, const std::vector<ExVertexStruct>& welded, uint32_t& outFreeSlot ) const;
+    uint32_t FindEpsilon( const ExVertexStruct& v, const std::vector<ExVertexStruct>& welded ) const;
+
+    /** Prepares the vertex tables for the given number of entries */
+    void ResetVertexTables( unsigned int numEntries );
+
+    /** Inserts the welded vertex into the table of its quantization cell */
+    void InsertIntoCell( const ExVertexStruct& v, uint32_t index );
+
+    /** Returns whether the two vertices should be merged */
+    bool IsEqualEpsilon( const ExVertexStruct& a, const ExVertexStruct& b ) const;
+
+    EWeldMode Mode;
+    float Epsilon;
+    double InvCellSize;
+
+    /** Welded vertex index per slot, EMPTY_SLOT if unused. Keyed by the exact vertex bits. */
+    std::vector<uint32_t> VertexSlots;
+
+    /** Full hash of the entry in the same slot, to skip most of the vertex compares */
+    std::vector<uint32_t> SlotHashes;
+
+    /** Same as above, but keyed by the quantization cell. Only used for WM_EPSILON. */
+    std::vector<uint32_t> CellSlots;
+    std::vector<uint32_t> CellHashes;
+    uint32_t VertexSlotMask;
+
+    /** Packed triangles per slot */
+    std::vector<uint64_t> TriangleSlots;
+    std::vector<uint64_t> UniqueTriangles;
+};
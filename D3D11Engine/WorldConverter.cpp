@@ -17,11 +17,20 @@
 #include "D3D11ConstantBuffer.h"
 #include "zCMesh.h"
 #include "zCLightmap.h"
-#include "GMesh.h"
+#include "CustomWorldImport.h"
 #include "MeshModifier.h"
 #include "D3D11Texture.h"
 #include "D3D7\MyDirectDrawSurface7.h"
 #include "zCQuadMark.h"
+#include "VertexWelder.h"
+#include "BasicTimer.h"
+#include "MeshCacheFormat.h"
+#include "ParallelFor.h"
+#include "MeshSimplifier.h"
+#include "VertexNormals.h"
+#include <DirectXMesh.h>
+#include "MeshletBuilder.h"
+#include <DirectXPackedVector.h>
 
 WorldConverter::WorldConverter() {}
 
@@ -40,41 +49,37 @@ void WorldConverter::WorldMeshCollectPolyRange( const float3& position, float ra
 
     FXMVECTOR xmPosition = XMLoadFloat3( position.toXMFLOAT3() );
 
-    // Generate the meshes
-    for ( auto const& itx : Engine::GAPI->GetWorldSections() ) {
-        for ( auto const& ity : itx.second ) {
-            float px = static_cast<float>(itx.first - s.x);
-            float py = static_cast<float>(ity.first - s.y);
-            float len = sqrtf((px * px) + (py * py));
-            if ( len < 2 ) {
-                // Check all polys from all meshes
-                for ( auto const& it : ity.second.WorldMeshes ) {
-                    WorldMeshInfo* m;
-
-                    // Create new mesh-part for alphatested surfaces
-                    if ( it.first.Texture && it.first.Texture->HasAlphaChannel() ) {
-                        m = new WorldMeshInfo;
-                        outMeshes[it.first] = m;
-                    } else {
-                        // Just use the same mesh for opaque surfaces
-                        m = opaqueMesh;
-                    }
-
-                    for ( unsigned int i = 0; i < it.second->Indices.size(); i += 3 ) {
-                        // Check if one of them is in range
-
-                        const float range2 = range * range;
-                        if ( Toolbox::XMVector3LengthSqFloat( xmPosition - XMLoadFloat3( it.second->Vertices[it.second->Indices[i + 0]].Position.toXMFLOAT3() ) ) < range2
-                            || Toolbox::XMVector3LengthSqFloat( xmPosition - XMLoadFloat3( it.second->Vertices[it.second->Indices[i + 1]].Position.toXMFLOAT3() ) ) < range2
-                            || Toolbox::XMVector3LengthSqFloat( xmPosition - XMLoadFloat3( it.second->Vertices[it.second->Indices[i + 2]].Position.toXMFLOAT3() ) ) < range2 ) {
-                            for ( int v = 0; v < 3; v++ )
-                                m->Vertices.emplace_back( it.second->Vertices[it.second->Indices[i + v]] );
-                        }
-                    }
+    // Generate the meshes from the 3x3 sections around the position
+    Engine::GAPI->GetWorldSectionGrid().ForEachAround( s, 1, [&]( const INT2&, WorldMeshSectionInfo& section ) {
+        // Check all polys from all meshes
+        for ( auto const& it : section.WorldMeshes ) {
+            WorldMeshInfo* m;
+
+            // Create new mesh-part for alphatested surfaces, once for all meshes sharing the material
+            if ( it.first.Texture && it.first.Texture->HasAlphaChannel() ) {
+                WorldMeshInfo*& part = outMeshes[it.first];
+                if ( !part ) {
+                    part = new WorldMeshInfo;
+                }
+                m = part;
+            } else {
+                // Just use the same mesh for opaque surfaces
+                m = opaqueMesh;
+            }
+
+            for ( unsigned int i = 0; i < it.second->Indices.size(); i += 3 ) {
+                // Check if one of them is in range
+
+                const float range2 = range * range;
+                if ( Toolbox::XMVector3LengthSqFloat( xmPosition - XMLoadFloat3( it.second->Vertices[it.second->Indices[i + 0]].Position.toXMFLOAT3() ) ) < range2
+                    || Toolbox::XMVector3LengthSqFloat( xmPosition - XMLoadFloat3( it.second->Vertices[it.second->Indices[i + 1]].Position.toXMFLOAT3() ) ) < range2
+                    || Toolbox::XMVector3LengthSqFloat( xmPosition - XMLoadFloat3( it.second->Vertices[it.second->Indices[i + 2]].Position.toXMFLOAT3() ) ) < range2 ) {
+                    for ( int v = 0; v < 3; v++ )
+                        m->Vertices.emplace_back( it.second->Vertices[it.second->Indices[i + v]] );
                 }
             }
         }
-    }
+    } );
 
     // Index all meshes
     for ( auto it = outMeshes.begin(); it != outMeshes.end();) {
@@ -102,232 +107,14 @@ void WorldConverter::WorldMeshCollectPolyRange( const float3& position, float ra
     }
 }
 
-/** Converts a loaded custommesh to be the worldmesh */
+/** Converts a loaded custommesh to be the worldmesh. Blocks until done, see CustomWorldImport for doing it in the background. */
 XRESULT WorldConverter::LoadWorldMeshFromFile( const std::string& file, std::map<int, std::map<int, WorldMeshSectionInfo>>* outSections, WorldInfo* info, MeshInfo** outWrappedMesh ) {
-    GMesh* mesh = new GMesh();
-
-    const float worldScale = 100.0f;
-
-    // Check if we have this file cached
-    if ( Toolbox::FileExists( (file + ".mcache").c_str() ) ) {
-        // Load the meshfile, cached
-        mesh->LoadMesh( (file + ".mcache").c_str(), worldScale );
-    } else {
-        // Create cache-file
-        mesh->LoadMesh( file, worldScale );
-
-        std::vector<MeshInfo*>& meshes = mesh->GetMeshes();
-        std::vector<std::string>& textures = mesh->GetTextures();
-        std::map<std::string, std::vector<std::pair<std::vector<ExVertexStruct>, std::vector<VERTEX_INDEX>>>> gm;
-
-        for ( unsigned int m = 0; m < meshes.size(); m++ ) {
-            auto& meshData = gm[textures[m]];
-
-            meshData.emplace_back( std::make_pair( meshes[m]->Vertices, meshes[m]->Indices ) );
-        }
-
-        CacheMesh( gm, file + ".mcache" );
-    }
-
-
-    std::vector<MeshInfo*>& meshes = mesh->GetMeshes();
-    std::vector<std::string>& textures = mesh->GetTextures();
-    std::map<std::string, D3D11Texture*> loadedTextures;
-    std::set<std::string> missingTextures;
-
-    // run through meshes and pack them into sections
-    for ( unsigned int m = 0; m < meshes.size(); m++ ) {
-        D3D11Texture* customTexture = nullptr;
-        zCMaterial* mat = Engine::GAPI->GetMaterialByTextureName( textures[m] );
-        MeshKey key;
-        key.Material = mat;
-        key.Texture = mat != nullptr ? mat->GetTextureSingle() : nullptr;
-
-        // Save missing textures
-        if ( !mat ) {
-            missingTextures.insert( textures[m] );
-        } else {
-            if ( mat->GetMatGroup() == zMAT_GROUP_WATER ) {
-                // Give water surfaces a water-shader
-                MaterialInfo* info = Engine::GAPI->GetMaterialInfoFrom( mat->GetTextureSingle() );
-                if ( info ) {
-                    info->PixelShader = "PS_Water";
-                    info->MaterialType = MaterialInfo::MT_Water;
-                }
-            }
-        }
-
-        //key.Lightmap = poly->GetLightmap();
-
-        for ( unsigned int i = 0; i < meshes[m]->Vertices.size(); i++ ) {
-            // Mesh needs to be rotated differently
-            meshes[m]->Vertices[i].Position = float3( meshes[m]->Vertices[i].Position.x,
-                meshes[m]->Vertices[i].Position.y,
-                -meshes[m]->Vertices[i].Position.z );
-
-            // Fix disoriented texcoords
-            meshes[m]->Vertices[i].TexCoord = float2( meshes[m]->Vertices[i].TexCoord.x, -meshes[m]->Vertices[i].TexCoord.y );
-        }
-
-        for ( unsigned int i = 0; i < meshes[m]->Indices.size(); i += 3 ) {
-
-            if ( meshes[m]->Indices[i] > meshes[m]->Vertices.size() ||
-                meshes[m]->Indices[i + 1] > meshes[m]->Vertices.size() ||
-                meshes[m]->Indices[i + 2] > meshes[m]->Vertices.size() )
-                break; // Catch broken meshes
-
-            ExVertexStruct* v[3] = { &meshes[m]->Vertices[meshes[m]->Indices[i]],
-                                        &meshes[m]->Vertices[meshes[m]->Indices[i + 2]],
-                                        &meshes[m]->Vertices[meshes[m]->Indices[i + 1]] };
-
-
-            // Calculate midpoint of this triange to get the section
-            XMFLOAT3 avgPos;
-            XMStoreFloat3( &avgPos, XMLoadFloat3( &*v[0]->Position.toXMFLOAT3() ) + XMLoadFloat3( &*v[1]->Position.toXMFLOAT3() ) + XMLoadFloat3( &*v[2]->Position.toXMFLOAT3() ) / 3.0f );
-            INT2 sxy = GetSectionOfPos( avgPos );
-
-            WorldMeshSectionInfo& section = (*outSections)[sxy.x][sxy.y];
-            section.WorldCoordinates = sxy;
-
-            XMFLOAT3& bbmin = section.BoundingBox.Min;
-            XMFLOAT3& bbmax = section.BoundingBox.Max;
-
-            // Check bounding box
-            bbmin.x = bbmin.x > v[0]->Position.x ? v[0]->Position.x : bbmin.x;
-            bbmin.y = bbmin.y > v[0]->Position.y ? v[0]->Position.y : bbmin.y;
-            bbmin.z = bbmin.z > v[0]->Position.z ? v[0]->Position.z : bbmin.z;
-
-            bbmax.x = bbmax.x < v[0]->Position.x ? v[0]->Position.x : bbmax.x;
-            bbmax.y = bbmax.y < v[0]->Position.y ? v[0]->Position.y : bbmax.y;
-            bbmax.z = bbmax.z < v[0]->Position.z ? v[0]->Position.z : bbmax.z;
-
-            if ( section.WorldMeshes.find( key ) == section.WorldMeshes.end() ) {
-                key.Info = Engine::GAPI->GetMaterialInfoFrom( key.Texture );
-
-                section.WorldMeshes[key] = new WorldMeshInfo;
-
-            }
-
-            for ( int i = 0; i < 3; i++ ) {
-                section.WorldMeshes[key]->Vertices.emplace_back( *v[i] );
-            }
-        }
-    }
-
-    // Print textures we couldn't find any materials for if there are any
-    if ( !missingTextures.empty() ) {
-        std::string ms = "\nMissing materials for custom-mesh:\n";
-
-        for ( auto it = missingTextures.begin(); it != missingTextures.end(); it++ ) {
-            ms += "\t" + (*it) + "\n";
-        }
-
-        LogWarn() << ms;
-    }
-
-    // Dont need that anymore
-    delete mesh;
-
-    XMVECTOR avgSections = XMVectorZero();
-    int numSections = 0;
-
-    std::list<std::vector<ExVertexStruct>*> vertexBuffers;
-    std::list<std::vector<VERTEX_INDEX>*> indexBuffers;
-
-    // Create the vertexbuffers for every material
-    for ( auto const& itx : *outSections ) {
-        for ( auto const& ity : itx.second ) {
-            numSections++;
-            avgSections += XMVectorSet( static_cast<float>(itx.first), static_cast<float>(ity.first), 0, 0 );
-
-            for ( auto const& it : ity.second.WorldMeshes ) {
-                std::vector<ExVertexStruct> indexedVertices;
-                std::vector<VERTEX_INDEX> indices;
-                IndexVertices( &it.second->Vertices[0], it.second->Vertices.size(), indexedVertices, indices );
-
-                it.second->Vertices = indexedVertices;
-                it.second->Indices = indices;
-
-                // Create the buffers
-                Engine::GraphicsEngine->CreateVertexBuffer( &it.second->MeshVertexBuffer );
-                Engine::GraphicsEngine->CreateVertexBuffer( &it.second->MeshIndexBuffer );
-
-                // Optimize faces
-                it.second->MeshVertexBuffer->OptimizeFaces( &it.second->Indices[0],
-                    reinterpret_cast<byte*>(&it.second->Vertices[0]),
-                    it.second->Indices.size(),
-                    it.second->Vertices.size(),
-                    sizeof( ExVertexStruct ) );
-
-                // Then optimize vertices
-                it.second->MeshVertexBuffer->OptimizeVertices( &it.second->Indices[0],
-                    reinterpret_cast<byte*>(&it.second->Vertices[0]),
-                    it.second->Indices.size(),
-                    it.second->Vertices.size(),
-                    sizeof( ExVertexStruct ) );
-
-                // Init and fill them
-                it.second->MeshVertexBuffer->Init( &it.second->Vertices[0], it.second->Vertices.size() * sizeof( ExVertexStruct ), D3D11VertexBuffer::B_VERTEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
-                it.second->MeshIndexBuffer->Init( &it.second->Indices[0], it.second->Indices.size() * sizeof( VERTEX_INDEX ), D3D11VertexBuffer::B_INDEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
-
-                // Remember them, to wrap then up later
-                vertexBuffers.emplace_back( &it.second->Vertices );
-                indexBuffers.emplace_back( &it.second->Indices );
-            }
-        }
-    }
-
-    std::vector<ExVertexStruct> wrappedVertices;
-    std::vector<unsigned int> wrappedIndices;
-    std::vector<unsigned int> offsets;
-
-    // Calculate fat vertexbuffer
-    WorldConverter::WrapVertexBuffers( vertexBuffers, indexBuffers, wrappedVertices, wrappedIndices, offsets );
-
-    // Propergate the offsets
-    int i = 0;
-    for ( auto& itx : *outSections ) {
-        for ( auto& ity : itx.second ) {
-            int numIndices = 0;
-            for ( auto const& it : ity.second.WorldMeshes ) {
-                it.second->BaseIndexLocation = offsets[i];
-                numIndices += it.second->Indices.size();
-
-                i++;
-            }
-
-            ity.second.NumIndices = numIndices;
-
-            if ( !ity.second.WorldMeshes.empty() )
-                ity.second.BaseIndexLocation = (*ity.second.WorldMeshes.begin()).second->BaseIndexLocation;
-        }
-    }
-
-    // Create the buffers for wrapped mesh
-    MeshInfo* wmi = new MeshInfo;
-    Engine::GraphicsEngine->CreateVertexBuffer( &wmi->MeshVertexBuffer );
-    Engine::GraphicsEngine->CreateVertexBuffer( &wmi->MeshIndexBuffer );
-
-    // Init and fill them
-    wmi->MeshVertexBuffer->Init( &wrappedVertices[0], wrappedVertices.size() * sizeof( ExVertexStruct ), D3D11VertexBuffer::B_VERTEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
-    wmi->MeshIndexBuffer->Init( &wrappedIndices[0], wrappedIndices.size() * sizeof( unsigned int ), D3D11VertexBuffer::B_INDEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
-
-    *outWrappedMesh = wmi;
-
-    // Calculate the approx midpoint of the world
-    avgSections /= static_cast<float>(numSections);
-
-    if ( info ) {
-        WorldInfo i;
-        XMStoreFloat2( &i.MidPoint, avgSections * WORLD_SECTION_SIZE );
-        i.LowestVertex = 0;
-        i.HighestVertex = 0;
-
-        memcpy( info, &i, sizeof( WorldInfo ) );
+    CustomWorldImport import;
+    if ( XR_SUCCESS != import.Start( file ) ) {
+        return XR_FAILED;
     }
 
-
-    return XR_SUCCESS;
+    return import.Finalize( outSections, info, outWrappedMesh );
 }
 
 bool AdditionalCheckWaterFall(zCTexture* texture)
@@ -350,8 +137,49 @@ bool AdditionalCheckWaterFall(zCTexture* texture)
     return false;
 }
 
-/** Converts the worldmesh into a more usable format */
-HRESULT WorldConverter::ConvertWorldMesh( zCPolygon** polys, unsigned int numPolygons, std::map<int, std::map<int, WorldMeshSectionInfo>>* outSections, WorldInfo* info, MeshInfo** outWrappedMesh, bool indoorLocation ) {
+namespace {
+    /** Time spent in the single steps of the CPU stage of ConvertWorldMesh, in seconds */
+    struct WorldMeshConversionTimings {
+        float Index = 0.0f;
+        float Normals = 0.0f;
+        float Optimize = 0.0f;
+    };
+
+    /** Runs the CPU side of the world mesh conversion on the given mesh. Only touches the mesh,
+        so different meshes can be converted on different threads at once. */
+    void ConvertWorldMeshOnCpu( WorldMeshInfo* mesh, bool buildMeshlets, WorldMeshConversionTimings& timings ) {
+        BASIC_TIMING( timer );
+
+        std::vector<ExVertexStruct> indexedVertices;
+        std::vector<VERTEX_INDEX> indices;
+        WorldConverter::IndexVertices( &mesh->Vertices[0], mesh->Vertices.size(), indexedVertices, indices );
+
+        mesh->Vertices = std::move( indexedVertices );
+        mesh->Indices = std::move( indices );
+        timer.Update();
+        timings.Index += timer.GetDelta();
+
+        // Generate normals
+        WorldConverter::GenerateVertexNormals( mesh->Vertices, mesh->Indices );
+        timer.Update();
+        timings.Normals += timer.GetDelta();
+
+        WorldConverter::OptimizeWorldMesh( mesh->Vertices, mesh->Indices, buildMeshlets, mesh->Meshlets );
+        timer.Update();
+        timings.Optimize += timer.GetDelta();
+    }
+}
+
+/** Returns whether portal polygons with this texture aren't real portals */
+bool WorldConverter::IsFakePortalTexture( const std::string& textureName ) {
+    // This is a ground texture that is sometimes re-used for visual tricks to darken tunnels, etc.
+    return textureName == "OWODFLWOODGROUND";
+}
+
+/** Puts the given polygons into their sections and creates a WorldMeshInfo for every material in there.
+    Also applies the material flags the world polygons need (portals, water). The vertices are
+    only extracted if extractVertices is set, otherwise the meshes and bounding boxes stay empty. */
+void WorldConverter::BucketWorldPolygons( zCPolygon** polys, unsigned int numPolygons, std::map<int, std::map<int, WorldMeshSectionInfo>>* outSections, bool indoorLocation, bool extractVertices ) {
     // Go through every polygon and put it into its section
     for ( unsigned int i = 0; i < numPolygons; i++ ) {
         zCPolygon* poly = polys[i];
@@ -367,8 +195,8 @@ HRESULT WorldConverter::ConvertWorldMesh( zCPolygon** polys, unsigned int numPol
             zCMaterial* polymat = poly->GetMaterial();
             if ( zCTexture* tex = polymat->GetTextureSingle() ) {
                 std::string textureName = tex->GetNameWithoutExt();
-                if ( textureName == "OWODFLWOODGROUND" ) {
-                    continue; // this is a ground texture that is sometimes re-used for visual tricks to darken tunnels, etc. We don't want to treat this as a portal.
+                if ( IsFakePortalTexture( textureName ) ) {
+                    continue;
                 } else {
                     // unsafe hack to avoid portal polys assigning material for valid normal polygons
                     // it only work because DrawMeshInfoListAlphablended use texture from material
@@ -421,6 +249,37 @@ HRESULT WorldConverter::ConvertWorldMesh( zCPolygon** polys, unsigned int numPol
         }
 #endif
 
+        if ( matGroup == zMAT_GROUP_WATER && !mat->HasAlphaTest() ) {
+#ifdef BUILD_GOTHIC_1_08k
+            MaterialInfo* info = Engine::GAPI->GetMaterialInfoFrom( key.Texture );
+            if ( !(AdditionalCheckWaterFall( key.Texture )) ) { 
+                // Give water surfaces a water-shader
+                if ( info ) {
+                    info->PixelShader = "PS_Water";
+                    info->MaterialType = MaterialInfo::MT_Water;
+                }
+            }
+            else {
+                //apply alpha blend to waterfall foam and flag it as water fall foam to apply shader later
+                if ( info ) {
+                    poly->GetMaterial()->SetAlphaFunc( zMAT_ALPHA_FUNC_BLEND );
+                    info->MaterialType = MaterialInfo::MT_WaterfallFoam;
+                }
+            }
+#else
+            // Give water surfaces a water-shader
+            MaterialInfo* info = Engine::GAPI->GetMaterialInfoFrom( key.Texture );
+            if ( info ) {
+                info->PixelShader = "PS_Water";
+                info->MaterialType = MaterialInfo::MT_Water;
+            }
+#endif
+        }
+
+        if ( !extractVertices ) {
+            continue;
+        }
+
         // Extract poly vertices
         std::vector<ExVertexStruct> polyVertices;
         polyVertices.reserve( poly->GetNumPolyVertices() );
@@ -475,34 +334,64 @@ HRESULT WorldConverter::ConvertWorldMesh( zCPolygon** polys, unsigned int numPol
         }
 
         TriangleFanToList( &polyVertices[0], polyVertices.size(), &it->second->Vertices );
-        if ( matGroup == zMAT_GROUP_WATER && !mat->HasAlphaTest() ) {
-#ifdef BUILD_GOTHIC_1_08k
-            MaterialInfo* info = Engine::GAPI->GetMaterialInfoFrom( key.Texture );
-            if ( !(AdditionalCheckWaterFall( key.Texture )) ) { 
-                // Give water surfaces a water-shader
-                if ( info ) {
-                    info->PixelShader = "PS_Water";
-                    info->MaterialType = MaterialInfo::MT_Water;
-                }
-            }
-            else {
-                //apply alpha blend to waterfall foam and flag it as water fall foam to apply shader later
-                if ( info ) {
-                    poly->GetMaterial()->SetAlphaFunc( zMAT_ALPHA_FUNC_BLEND );
-                    info->MaterialType = MaterialInfo::MT_WaterfallFoam;
-                }
-            }
-#else
-            // Give water surfaces a water-shader
-            MaterialInfo* info = Engine::GAPI->GetMaterialInfoFrom( key.Texture );
-            if ( info ) {
-                info->PixelShader = "PS_Water";
-                info->MaterialType = MaterialInfo::MT_Water;
+    }
+}
+
+/** Converts the worldmesh into a more usable format */
+HRESULT WorldConverter::ConvertWorldMesh( zCPolygon** polys, unsigned int numPolygons, std::map<int, std::map<int, WorldMeshSectionInfo>>* outSections, WorldInfo* info, MeshInfo** outWrappedMesh, bool indoorLocation ) {
+    BASIC_TIMING( polygonTimer );
+
+    BucketWorldPolygons( polys, numPolygons, outSections, indoorLocation, true );
+
+    polygonTimer.Update();
+
+    // Flatten the meshes in map order, so the work is spread over the threads by mesh
+    std::vector<WorldMeshInfo*> meshes;
+    for ( auto const& itx : *outSections ) {
+        for ( auto const& ity : itx.second ) {
+            for ( auto const& it : ity.second.WorldMeshes ) {
+                meshes.emplace_back( it.second );
             }
-#endif
         }
     }
 
+    // CPU stage: Index, generate normals and optimize every mesh on the worker threads
+    BASIC_TIMING( cpuStageTimer );
+    // Meshlets only get built when they are used, they dictate the triangle order
+    const bool buildMeshlets = Engine::GAPI->GetRendererState().RendererSettings.EnableWorldMeshletCulling;
+    const unsigned int numSlots = GetParallelForSlots();
+    std::vector<WorldMeshConversionTimings> slotTimings( numSlots );
+    ParallelFor( meshes.size(), [&]( size_t m, unsigned int slot ) {
+        ConvertWorldMeshOnCpu( meshes[m], buildMeshlets, slotTimings[slot] );
+    } );
+    cpuStageTimer.Update();
+
+    // Serial stage: Create the GPU resources in map order
+    BASIC_TIMING( bufferTimer );
+    CreateWorldMeshBuffers( *outSections, info, outWrappedMesh );
+    bufferTimer.Update();
+
+    WorldMeshConversionTimings cpuTimings;
+    for ( const WorldMeshConversionTimings& t : slotTimings ) {
+        cpuTimings.Index += t.Index;
+        cpuTimings.Normals += t.Normals;
+        cpuTimings.Optimize += t.Optimize;
+    }
+
+    LogInfo() << "World conversion of " << meshes.size() << " meshes took: polygons " << static_cast<int>(polygonTimer.GetDelta() * 1000.0f) << "ms"
+        << ", cpu stage " << static_cast<int>(cpuStageTimer.GetDelta() * 1000.0f) << "ms on " << numSlots << " threads"
+        << " (index " << static_cast<int>(cpuTimings.Index * 1000.0f) << "ms"
+        << ", normals " << static_cast<int>(cpuTimings.Normals * 1000.0f) << "ms"
+        << ", optimize " << static_cast<int>(cpuTimings.Optimize * 1000.0f) << "ms summed over threads)"
+        << ", buffers " << static_cast<int>(bufferTimer.GetDelta() * 1000.0f) << "ms";
+
+    //SaveSectionsToObjUnindexed("Test.obj", (*outSections));
+
+    return XR_SUCCESS;
+}
+
+/** Creates the buffers of every world mesh in the sections and the wrapped mesh holding all of them */
+void WorldConverter::CreateWorldMeshBuffers( std::map<int, std::map<int, WorldMeshSectionInfo>>& sections, WorldInfo* info, MeshInfo** outWrappedMesh ) {
     XMVECTOR avgSections = XMVectorZero();
     int numSections = 0;
 
@@ -510,40 +399,16 @@ HRESULT WorldConverter::ConvertWorldMesh( zCPolygon** polys, unsigned int numPol
     std::list<std::vector<VERTEX_INDEX>*> indexBuffers;
 
     // Create the vertexbuffers for every material
-    for ( auto const& itx : *outSections ) {
+    for ( auto const& itx : sections ) {
         for ( auto const& ity : itx.second ) {
             numSections++;
-            avgSections += XMVectorSet( (float)itx.first, (float)ity.first, 0, 0 );
+            avgSections += XMVectorSet( static_cast<float>(itx.first), static_cast<float>(ity.first), 0, 0 );
 
             for ( auto const& it : ity.second.WorldMeshes ) {
-                std::vector<ExVertexStruct> indexedVertices;
-                std::vector<VERTEX_INDEX> indices;
-                IndexVertices( &it.second->Vertices[0], it.second->Vertices.size(), indexedVertices, indices );
-
-                it.second->Vertices = indexedVertices;
-                it.second->Indices = indices;
-
                 // Create the buffers
                 Engine::GraphicsEngine->CreateVertexBuffer( &it.second->MeshVertexBuffer );
                 Engine::GraphicsEngine->CreateVertexBuffer( &it.second->MeshIndexBuffer );
 
-                // Generate normals
-                GenerateVertexNormals( it.second->Vertices, it.second->Indices );
-
-                // Optimize faces
-                it.second->MeshVertexBuffer->OptimizeFaces( &it.second->Indices[0],
-                    reinterpret_cast<byte*>(&it.second->Vertices[0]),
-                    it.second->Indices.size(),
-                    it.second->Vertices.size(),
-                    sizeof( ExVertexStruct ) );
-
-                // Then optimize vertices
-                it.second->MeshVertexBuffer->OptimizeVertices( &it.second->Indices[0],
-                    reinterpret_cast<byte*>(&it.second->Vertices[0]),
-                    it.second->Indices.size(),
-                    it.second->Vertices.size(),
-                    sizeof( ExVertexStruct ) );
-
                 // Init and fill them
                 it.second->MeshVertexBuffer->Init( &it.second->Vertices[0], it.second->Vertices.size() * sizeof( ExVertexStruct ), D3D11VertexBuffer::B_VERTEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
                 it.second->MeshIndexBuffer->Init( &it.second->Indices[0], it.second->Indices.size() * sizeof( VERTEX_INDEX ), D3D11VertexBuffer::B_INDEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
@@ -560,17 +425,24 @@ HRESULT WorldConverter::ConvertWorldMesh( zCPolygon** polys, unsigned int numPol
     std::vector<unsigned int> offsets;
 
     // Calculate fat vertexbuffer
-    WorldConverter::WrapVertexBuffers( vertexBuffers, indexBuffers, wrappedVertices, wrappedIndices, offsets );
+    WrapVertexBuffers( vertexBuffers, indexBuffers, wrappedVertices, wrappedIndices, offsets );
 
     // Propergate the offsets
     int i = 0;
-    for ( auto const& itx : *outSections ) {
-        for ( auto const& ity : itx.second ) {
+    for ( auto& itx : sections ) {
+        for ( auto& ity : itx.second ) {
+            int numIndices = 0;
             for ( auto const& it : ity.second.WorldMeshes ) {
                 it.second->BaseIndexLocation = offsets[i];
+                numIndices += it.second->Indices.size();
 
                 i++;
             }
+
+            ity.second.NumIndices = numIndices;
+
+            if ( !ity.second.WorldMeshes.empty() )
+                ity.second.BaseIndexLocation = (*ity.second.WorldMeshes.begin()).second->BaseIndexLocation;
         }
     }
 
@@ -586,23 +458,13 @@ HRESULT WorldConverter::ConvertWorldMesh( zCPolygon** polys, unsigned int numPol
     *outWrappedMesh = wmi;
 
     // Calculate the approx midpoint of the world
-    avgSections /= (float)numSections;
+    avgSections /= static_cast<float>(numSections);
 
     if ( info ) {
-        /*WorldInfo i;
-        i.MidPoint = avgSections * WORLD_SECTION_SIZE;
-        i.LowestVertex = 0;
-        i.HighestVertex = 0;
-
-        memcpy(info, &i, sizeof(WorldInfo));*/
-
         XMStoreFloat2( &info->MidPoint, avgSections * WORLD_SECTION_SIZE );
         info->LowestVertex = 0;
         info->HighestVertex = 0;
     }
-    //SaveSectionsToObjUnindexed("Test.obj", (*outSections));
-
-    return XR_SUCCESS;
 }
 
 /** Creates the FullSectionMesh for the given section */
@@ -1280,6 +1142,26 @@ void WorldConverter::Extract3DSMeshFromVisual2( zCProgMeshProto* visual, MeshVis
                 mi->Vertices.size(),
                 sizeof( ExVertexStruct ) );
 
+            if ( Engine::GAPI->GetRendererState().RendererSettings.EnableVobLods ) {
+                const int MAX_VOB_LOD_LEVELS = 3;
+
+                std::vector<MeshSimplifier::LodLevel> lods;
+                MeshSimplifier::BuildLodChain( mi->Vertices, mi->Indices, MAX_VOB_LOD_LEVELS, lods );
+                for ( MeshSimplifier::LodLevel& lod : lods ) {
+                    mi->MeshVertexBuffer->OptimizeFaces( &lod.Indices[0], reinterpret_cast<byte*>(&lod.Vertices[0]),
+                        lod.Indices.size(), lod.Vertices.size(), sizeof( ExVertexStruct ) );
+                    mi->MeshVertexBuffer->OptimizeVertices( &lod.Indices[0], reinterpret_cast<byte*>(&lod.Vertices[0]),
+                        lod.Indices.size(), lod.Vertices.size(), sizeof( ExVertexStruct ) );
+
+                    MeshLodLevel level;
+                    level.Mesh = new MeshInfo;
+                    level.Mesh->MeshIndex = i;
+                    level.Mesh->Create( &lod.Vertices[0], lod.Vertices.size(), &lod.Indices[0], lod.Indices.size() );
+                    level.Error = lod.Error;
+                    mi->LodLevels.emplace_back( level );
+                }
+            }
+
             // Init and fill it
             mi->MeshVertexBuffer->Init( &mi->Vertices[0], mi->Vertices.size() * sizeof( ExVertexStruct ), D3D11VertexBuffer::B_VERTEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
         }
@@ -1339,123 +1221,73 @@ void WorldConverter::Extract3DSMeshFromVisual2( zCProgMeshProto* visual, MeshVis
     meshInfo->VisualName = visual->GetObjectName();
 }
 
-const float eps = 0.001f;
-
-struct CmpClass // class comparing vertices in the set
-{
-    bool operator() ( const std::pair<ExVertexStruct, int>& p1, const std::pair<ExVertexStruct, int>& p2 ) const {
-        if ( fabs( p1.first.Position.x - p2.first.Position.x ) > eps ) return p1.first.Position.x < p2.first.Position.x;
-        if ( fabs( p1.first.Position.y - p2.first.Position.y ) > eps ) return p1.first.Position.y < p2.first.Position.y;
-        if ( fabs( p1.first.Position.z - p2.first.Position.z ) > eps ) return p1.first.Position.z < p2.first.Position.z;
-
-        if ( fabs( p1.first.TexCoord.x - p2.first.TexCoord.x ) > eps ) return p1.first.TexCoord.x < p2.first.TexCoord.x;
-        if ( fabs( p1.first.TexCoord.y - p2.first.TexCoord.y ) > eps ) return p1.first.TexCoord.y < p2.first.TexCoord.y;
-
-        return false;
-    }
-};
+/** Welder used by IndexVertices. One per thread, so its scratch memory can be reused across calls */
+static thread_local VertexWelder s_VertexWelder;
 
 /** Indexes the given vertex array */
 void WorldConverter::IndexVertices( ExVertexStruct* input, unsigned int numInputVertices, std::vector<ExVertexStruct>& outVertices, std::vector<VERTEX_INDEX>& outIndices ) {
-    std::set<std::pair<ExVertexStruct, int>, CmpClass> vertices;
-    int index = 0;
-
-    for ( unsigned int i = 0; i < numInputVertices; i++ ) {
-        std::set<std::pair<ExVertexStruct, int>>::iterator it = vertices.find( std::make_pair( input[i], 0/*this value doesn't matter*/ ) );
-        if ( it != vertices.end() ) outIndices.emplace_back( it->second );
-        else {
-            vertices.insert( std::make_pair( input[i], index ) );
-            outIndices.emplace_back( index++ );
-        }
-    }
-
-    // TODO: Remove this and fix it properly!
-    /*for (std::set<std::pair<ExVertexStruct, int>>::iterator it=vertices.begin(); it!=vertices.end(); it++)
-    {
-        if ( static_cast<size_t>(it->second) >= vertices.size() )
-        {
-             // TODO: Investigate!
-            it = vertices.erase(it);
-            continue;
-        }
-    }
-
-    for (std::vector<VERTEX_INDEX>::iterator it=outIndices.begin(); it!=outIndices.end(); it++)
-    {
-        if ( static_cast<size_t>(*it) >= vertices.size() )
-        {
-             // TODO: Investigate!
-            it = outIndices.erase(it);
-            continue;
-        }
-    }*/
+    s_VertexWelder.Weld( input, numInputVertices, outVertices, outIndices );
 
     // Check for overlaying triangles and throw them out
     // Some mods do that for the worldmesh for example
-    std::set<std::tuple<VERTEX_INDEX, VERTEX_INDEX, VERTEX_INDEX>> triangles;
-    for ( size_t i = 0; i < outIndices.size(); i += 3 ) {
-        // Insert every combination of indices here. Duplicates will be ignored
-        triangles.insert( std::make_tuple( outIndices[i + 0], outIndices[i + 1], outIndices[i + 2] ) );
+    s_VertexWelder.RemoveDuplicateTriangles( outIndices );
+}
+
+void WorldConverter::IndexVertices( ExVertexStruct* input, unsigned int numInputVertices, std::vector<ExVertexStruct>& outVertices, std::vector<unsigned int>& outIndices ) {
+    s_VertexWelder.Weld( input, numInputVertices, outVertices, outIndices );
+}
+
+/** Reorders an indexed world mesh for the vertex cache */
+void WorldConverter::OptimizeWorldMesh( std::vector<ExVertexStruct>& vertices, std::vector<VERTEX_INDEX>& indices, bool buildMeshlets, std::vector<Meshlet>& outMeshlets ) {
+    outMeshlets.clear();
+    if ( indices.empty() ) {
+        return;
     }
 
-    // Extract the cleaned triangles to the indices vector
-    outIndices.clear();
-    for ( auto const& it : triangles ) {
-        outIndices.emplace_back( std::get<0>( it ) );
-        outIndices.emplace_back( std::get<1>( it ) );
-        outIndices.emplace_back( std::get<2>( it ) );
+    const size_t numFaces = indices.size() / 3;
+    std::vector<MeshletRange> ranges;
+    if ( buildMeshlets ) {
+        // Group neighbouring triangles, this decides what ends up in which meshlet
+        MeshletBuilder::SortTrianglesSpatially( vertices, indices );
+        MeshletBuilder::GetMeshletRanges( static_cast<unsigned int>(numFaces), ranges );
+    } else {
+        ranges.push_back( { 0, static_cast<unsigned int>(numFaces * 3) } );
     }
 
-    // Notice that the vertices in the set are not sorted by the index
-    // so you'll have to rearrange them like this:
-    outVertices.clear();
-    outVertices.resize( vertices.size() );
-    for ( auto const& it : vertices ) {
-        if ( static_cast<size_t>(it.second) >= vertices.size() ) {
-            continue;
+    // Triangles only move inside of their meshlet, so the meshlets keep what the spatial sort put into them
+    std::vector<uint32_t> faceRemap( numFaces );
+    for ( const MeshletRange& range : ranges ) {
+        VERTEX_INDEX* rangeIndices = &indices[range.FirstIndex];
+        const size_t rangeFaces = range.NumIndices / 3;
+        if ( FAILED( DirectX::OptimizeFacesLRU( rangeIndices, rangeFaces, &faceRemap[0] ) )
+            || FAILED( DirectX::ReorderIB( rangeIndices, rangeFaces, &faceRemap[0] ) ) ) {
+            LogWarn() << "Failed to optimize the triangle order of a world mesh";
         }
-
-        outVertices[it.second] = it.first;
     }
-}
 
-void WorldConverter::IndexVertices( ExVertexStruct* input, unsigned int numInputVertices, std::vector<ExVertexStruct>& outVertices, std::vector<unsigned int>& outIndices ) {
-    std::set<std::pair<ExVertexStruct, int>, CmpClass> vertices;
-    unsigned int index = 0;
-
-    for ( unsigned int i = 0; i < numInputVertices; i++ ) {
-        std::set<std::pair<ExVertexStruct, int>>::iterator it = vertices.find( std::make_pair( input[i], 0/*this value doesn't matter*/ ) );
-        if ( it != vertices.end() ) outIndices.emplace_back( it->second );
-        else {
-            vertices.insert( std::make_pair( input[i], index ) );
-            outIndices.emplace_back( index++ );
-        }
+    // Renumbers the vertices in the order the triangles use them and drops the ones no triangle uses anymore
+    std::vector<uint32_t> vertexRemap( vertices.size() );
+    size_t trailingUnused = 0;
+    if ( FAILED( DirectX::OptimizeVertices( &indices[0], numFaces, vertices.size(), &vertexRemap[0], &trailingUnused ) ) ) {
+        LogWarn() << "Failed to optimize the vertex order of a world mesh";
+    } else if ( SUCCEEDED( DirectX::FinalizeVB( &vertices[0], sizeof( ExVertexStruct ), vertices.size(), &vertexRemap[0] ) ) ) {
+        DirectX::FinalizeIB( &indices[0], numFaces, &vertexRemap[0], vertices.size() );
+        vertices.resize( vertices.size() - trailingUnused );
     }
 
-    // Notice that the vertices in the set are not sorted by the index
-    // so you'll have to rearrange them like this:
-    outVertices.clear();
-    outVertices.resize( vertices.size() );
-    for ( auto const& it : vertices )
-        outVertices[it.second] = it.first;
+    if ( buildMeshlets ) {
+        MeshletBuilder::BuildMeshlets( vertices, indices, outMeshlets );
+    }
 }
 
 /** Computes vertex normals for a mesh with face normals */
 void WorldConverter::GenerateVertexNormals( std::vector<ExVertexStruct>& vertices, std::vector<VERTEX_INDEX>& indices ) {
-    std::vector<XMFLOAT3> normals( vertices.size(), XMFLOAT3( 0, 0, 0 ) );
-
-    for ( unsigned int i = 0; i < indices.size(); i += 3 ) {
-        XMFLOAT3 v[3] = { *vertices[indices[i]].Position.toXMFLOAT3(), *vertices[indices[i + 1]].Position.toXMFLOAT3(), *vertices[indices[i + 2]].Position.toXMFLOAT3() };
-        FXMVECTOR normal = XMVector3Cross( (XMLoadFloat3( &v[1] ) - XMLoadFloat3( &v[0] )), (XMLoadFloat3( &v[2] ) - XMLoadFloat3( &v[0] )) );
-
-        for ( int j = 0; j < 3; ++j ) {
-            FXMVECTOR a = XMLoadFloat3( &v[(j + 1) % 3] ) - XMLoadFloat3( &v[j] );
-            FXMVECTOR b = XMLoadFloat3( &v[(j + 2) % 3] ) - XMLoadFloat3( &v[j] );
-            FXMVECTOR weight = XMVectorACos( XMVector3Dot( a, b ) / (XMVector3Length( a ) * XMVector3Length( b )) );
-            XMVECTOR XMV_normals_indices = XMLoadFloat3( &normals[indices[(i + j)]] );
-            XMV_normals_indices += weight * normal;
-            XMStoreFloat3( &normals[indices[(i + j)]], XMV_normals_indices );
-        }
+    // Sections are converted in parallel, so every worker accumulates into its own buffer
+    static thread_local std::vector<XMFLOAT3> normals;
+    normals.assign( vertices.size(), XMFLOAT3( 0, 0, 0 ) );
+
+    if ( !indices.empty() ) {
+        AccumulateVertexNormals( &vertices[0], &indices[0], indices.size(), &normals[0] );
     }
 
     // Normalize everything and store it into the vertices
@@ -1502,38 +1334,16 @@ void WorldConverter::WrapVertexBuffers( const std::list<std::vector<ExVertexStru
 
 /** Caches a mesh */
 void WorldConverter::CacheMesh( const std::map<std::string, std::vector<std::pair<std::vector<ExVertexStruct>, std::vector<VERTEX_INDEX>>>> geometry, const std::string& file ) {
+    std::vector<uint8_t> data;
+    MeshCacheFormat::WriteVersion2( geometry, data );
+
     FILE* f = fopen( file.c_str(), "wb" );
-    // Write version
-    int Version = 1;
-    fwrite( &Version, sizeof( Version ), 1, f );
-
-    // Write num textures
-    size_t numTextures = geometry.size();
-    fwrite( &numTextures, sizeof( numTextures ), 1, f );
-
-    for ( auto const& it : geometry ) {
-        // Save texture name
-        uint8_t numTxNameChars = static_cast<uint8_t>(it.first.size());
-        fwrite( &numTxNameChars, sizeof( numTxNameChars ), 1, f );
-        fwrite( &it.first[0], numTxNameChars, 1, f );
-
-        // Save num submeshes
-        uint8_t numSubmeshes = static_cast<uint8_t>(it.second.size());
-        fwrite( &numSubmeshes, sizeof( numSubmeshes ), 1, f );
-
-        for ( uint8_t i = 0; i < numSubmeshes; i++ ) {
-            // Save vertices
-            size_t numVertices = it.second[i].first.size();
-            fwrite( &numVertices, sizeof( numVertices ), 1, f );
-            fwrite( &it.second[i].first[0], sizeof( ExVertexStruct ) * it.second[i].first.size(), 1, f );
-
-            // Save indices
-            size_t numIndices = it.second[i].second.size();
-            fwrite( &numIndices, sizeof( numIndices ), 1, f );
-            fwrite( &it.second[i].second[0], sizeof( VERTEX_INDEX ) * it.second[i].second.size(), 1, f );
-        }
+    if ( !f ) {
+        LogWarn() << "Failed to create mesh cache file: " << file;
+        return;
     }
 
+    fwrite( &data[0], data.size(), 1, f );
     fclose( f );
 }
 
@@ -1625,3 +1435,145 @@ void WorldConverter::ConvertExVerticesTozCPolygons( const std::vector<ExVertexSt
         polyArray.emplace_back( poly );
     }
 }
+
+namespace {
+    /** Largest angle between a unit vector and its octahedral encoding with 16-bit snorm components */
+    const float COMPACT_NORMAL_ERROR_BOUND = 0.0002f;
+
+    /** Positions of compact vertices have 21 bits per axis */
+    const unsigned int COMPACT_POSITION_MAX_CELL = (1u << 21) - 1;
+
+    /** Octahedral encoding of a unit vector, the result is in [-1, 1] */
+    XMVECTOR XM_CALLCONV EncodeOctahedral( FXMVECTOR n ) {
+        XMVECTOR l1 = XMVector3Dot( XMVectorAbs( n ), XMVectorSplatOne() );
+        XMVECTOR p = n / XMVectorMax( l1, XMVectorReplicate( FLT_MIN ) );
+
+        // The lower hemisphere gets folded over the diagonals
+        XMVECTOR signs = XMVectorSelect( XMVectorSplatOne(), -XMVectorSplatOne(), XMVectorLess( p, XMVectorZero() ) );
+        XMVECTOR folded = (XMVectorSplatOne() - XMVectorAbs( XMVectorSwizzle<1, 0, 2, 3>( p ) )) * signs;
+        return XMVectorSelect( p, folded, XMVectorLess( XMVectorSplatZ( p ), XMVectorZero() ) );
+    }
+
+    XMVECTOR XM_CALLCONV DecodeOctahedral( FXMVECTOR e ) {
+        XMVECTOR absE = XMVectorAbs( e );
+        XMVECTOR z = XMVectorSplatOne() - XMVectorSplatX( absE ) - XMVectorSplatY( absE );
+
+        // Unfold the lower hemisphere
+        XMVECTOR t = XMVectorSaturate( -z );
+        XMVECTOR xy = e + XMVectorSelect( -t, t, XMVectorLess( e, XMVectorZero() ) );
+        return XMVector3Normalize( XMVectorSelect( xy, z, g_XMSelect0010 ) );
+    }
+}
+
+/** Computes the position grid for everything inside the given box */
+CompactVertexQuantization WorldConverter::ComputeCompactVertexQuantization( const zTBBox3D& bounds ) {
+    XMVECTOR bbmin = XMLoadFloat3( &bounds.Min );
+    XMVECTOR bbmax = XMLoadFloat3( &bounds.Max );
+
+    // Power of two cells with the grid origin on a cell, so cell * Scale and Offset + cell * Scale are exact
+    CompactVertexQuantization quantization;
+    quantization.Scale = 1.0f / 1024.0f;
+    for ( ;; ) {
+        XMVECTOR offset = XMVectorFloor( bbmin / quantization.Scale ) * quantization.Scale;
+        XMStoreFloat3( quantization.Offset.toXMFLOAT3(), offset );
+
+        XMVECTOR cells = (bbmax - offset) / quantization.Scale;
+        if ( XMVector3LessOrEqual( cells, XMVectorReplicate( static_cast<float>(COMPACT_POSITION_MAX_CELL) ) ) ) {
+            break;
+        }
+        quantization.Scale *= 2.0f;
+    }
+
+    return quantization;
+}
+
+/** Packs the given vertices into the compact vertex format */
+void WorldConverter::EncodeCompactVertices( const ExVertexStruct* input, unsigned int numVertices, const CompactVertexQuantization& quantization, ExVertexStructCompact* output ) {
+    XMVECTOR offset = XMLoadFloat3( quantization.Offset.toXMFLOAT3() );
+    XMVECTOR invScale = XMVectorReplicate( 1.0f / quantization.Scale );
+    XMVECTOR maxCell = XMVectorReplicate( static_cast<float>(COMPACT_POSITION_MAX_CELL) );
+
+    for ( unsigned int i = 0; i < numVertices; i++ ) {
+        const ExVertexStruct& v = input[i];
+        ExVertexStructCompact& c = output[i];
+
+        XMUINT3 cell;
+        XMStoreUInt3( &cell, XMVectorClamp( XMVectorRound( (XMLoadFloat3( v.Position.toXMFLOAT3() ) - offset) * invScale ), XMVectorZero(), maxCell ) );
+        c.Position[0] = cell.x | (cell.y << 21);
+        c.Position[1] = (cell.y >> 11) | (cell.z << 10);
+
+        XMVECTOR n = EncodeOctahedral( XMLoadFloat3( v.Normal.toXMFLOAT3() ) );
+        PackedVector::XMStoreShortN2( reinterpret_cast<PackedVector::XMSHORTN2*>(c.Normal), n );
+
+        c.TexCoord = v.TexCoord;
+        c.Color = v.Color;
+    }
+
+    // The lightmap texcoords of two vertices go through one call of the half conversion
+    alignas(16) float texCoords[4];
+    alignas(16) unsigned short halfs[4];
+    unsigned int i = 0;
+    for ( ; i + 2 <= numVertices; i += 2 ) {
+        memcpy( &texCoords[0], &input[i].TexCoord2, sizeof( float2 ) );
+        memcpy( &texCoords[2], &input[i + 1].TexCoord2, sizeof( float2 ) );
+        QuantizeHalfFloat_X4( texCoords, halfs );
+        memcpy( output[i].TexCoord2, &halfs[0], sizeof( output[i].TexCoord2 ) );
+        memcpy( output[i + 1].TexCoord2, &halfs[2], sizeof( output[i + 1].TexCoord2 ) );
+    }
+
+    if ( i < numVertices ) {
+        output[i].TexCoord2[0] = QuantizeHalfFloat( input[i].TexCoord2.x );
+        output[i].TexCoord2[1] = QuantizeHalfFloat( input[i].TexCoord2.y );
+    }
+}
+
+/** Unpacks vertices of the compact vertex format */
+void WorldConverter::DecodeCompactVertices( const ExVertexStructCompact* input, unsigned int numVertices, const CompactVertexQuantization& quantization, ExVertexStruct* output ) {
+    XMVECTOR offset = XMLoadFloat3( quantization.Offset.toXMFLOAT3() );
+    XMVECTOR scale = XMVectorReplicate( quantization.Scale );
+
+    for ( unsigned int i = 0; i < numVertices; i++ ) {
+        const ExVertexStructCompact& c = input[i];
+        ExVertexStruct& v = output[i];
+
+        XMUINT3 cell(
+            c.Position[0] & COMPACT_POSITION_MAX_CELL,
+            ((c.Position[0] >> 21) | (c.Position[1] << 11)) & COMPACT_POSITION_MAX_CELL,
+            c.Position[1] >> 10 );
+        XMStoreFloat3( v.Position.toXMFLOAT3(), XMVectorMultiplyAdd( XMLoadUInt3( &cell ), scale, offset ) );
+
+        XMVECTOR n = PackedVector::XMLoadShortN2( reinterpret_cast<const PackedVector::XMSHORTN2*>(c.Normal) );
+        XMStoreFloat3( v.Normal.toXMFLOAT3(), DecodeOctahedral( n ) );
+
+        v.TexCoord = c.TexCoord;
+        v.Color = c.Color;
+    }
+
+    // The lightmap texcoords of four vertices go through one call of the half conversion
+    alignas(16) unsigned short halfs[8];
+    alignas(16) float texCoords[8];
+    unsigned int i = 0;
+    for ( ; i + 4 <= numVertices; i += 4 ) {
+        for ( unsigned int k = 0; k < 4; k++ ) {
+            memcpy( &halfs[k * 2], input[i + k].TexCoord2, sizeof( input[i + k].TexCoord2 ) );
+        }
+        UnquantizeHalfFloat_X8( halfs, texCoords );
+        for ( unsigned int k = 0; k < 4; k++ ) {
+            memcpy( &output[i + k].TexCoord2, &texCoords[k * 2], sizeof( float2 ) );
+        }
+    }
+
+    for ( ; i < numVertices; i++ ) {
+        output[i].TexCoord2 = float2( UnquantizeHalfFloat( input[i].TexCoord2[0] ), UnquantizeHalfFloat( input[i].TexCoord2[1] ) );
+    }
+}
+
+/** Returns the worst case error the compact vertex format can introduce */
+CompactVertexError WorldConverter::GetCompactVertexErrorBound( const CompactVertexQuantization& quantization, float maxTexCoord2 ) {
+    // Half a cell on every axis, the decoded positions themselves are exact
+    CompactVertexError bound;
+    bound.Position = quantization.Scale * 0.5f * sqrtf( 3.0f );
+    bound.Normal = COMPACT_NORMAL_ERROR_BOUND;
+    bound.TexCoord = std::max( maxTexCoord2 * (1.0f / 2048.0f), 1.0f / 16384.0f );
+    return bound;
+}
@@ -33,7 +33,13 @@ public:
     /** Converts the worldmesh into a more usable format */
     static HRESULT ConvertWorldMesh( zCPolygon** polys, unsigned int numPolygons, std::map<int, std::map<int, WorldMeshSectionInfo>>* outSections, WorldInfo* info, MeshInfo** outWrappedMesh, bool indoorLocation );
 
-    /** Converts a loaded custommesh to be the worldmesh */
+    /** Puts the given polygons into their sections and creates a WorldMeshInfo for every material in there */
+    static void BucketWorldPolygons( zCPolygon** polys, unsigned int numPolygons, std::map<int, std::map<int, WorldMeshSectionInfo>>* outSections, bool indoorLocation, bool extractVertices );
+
+    /** Returns whether portal polygons with this texture aren't real portals */
+    static bool IsFakePortalTexture( const std::string& textureName );
+
+    /** Converts a loaded custommesh to be the worldmesh. Blocks until done, see CustomWorldImport for doing it in the background. */
     static XRESULT LoadWorldMeshFromFile( const std::string& file, std::map<int, std::map<int, WorldMeshSectionInfo>>* outSections, WorldInfo* info, MeshInfo** outWrappedMesh );
 
     /** Returns what section the given position is in */
@@ -82,9 +88,17 @@ public:
     /** Computes vertex normals for a mesh with face normals */
     static void GenerateVertexNormals( std::vector<ExVertexStruct>& vertices, std::vector<VERTEX_INDEX>& indices );
 
+    /** Reorders an indexed world mesh for the vertex cache and drops unused vertices. With buildMeshlets the triangles
+        get grouped into meshlets first and are only reordered inside of them, otherwise outMeshlets stays empty. */
+    static void OptimizeWorldMesh( std::vector<ExVertexStruct>& vertices, std::vector<VERTEX_INDEX>& indices, bool buildMeshlets, std::vector<Meshlet>& outMeshlets );
+
     /** Creates the FullSectionMesh for the given section */
     static void GenerateFullSectionMesh( WorldMeshSectionInfo& section );
 
+    /** Creates the buffers of every world mesh in the sections and the wrapped mesh holding all of them, in map order.
+        Sets the index ranges of the meshes and sections and the midpoint of the world in info, if given. */
+    static void CreateWorldMeshBuffers( std::map<int, std::map<int, WorldMeshSectionInfo>>& sections, WorldInfo* info, MeshInfo** outWrappedMesh );
+
     /** Builds a big vertexbuffer from the world sections */
     static void WrapVertexBuffers( const std::list<std::vector<ExVertexStruct>*>& vertexBuffers, const std::list<std::vector<VERTEX_INDEX>*>& indexBuffers, std::vector<ExVertexStruct>& outVertices, std::vector<unsigned int>& outIndices, std::vector<unsigned int>& outOffsets );
 
@@ -93,5 +107,21 @@ public:
 
     /** Converts ExVertexStruct into a zCPolygon*-Attay */
     static void ConvertExVerticesTozCPolygons( const std::vector<ExVertexStruct>& vertices, const std::vector<VERTEX_INDEX>& indices, zCMaterial* material, std::vector<zCPolygon*>& polyArray );
+
+    /** Computes the position grid for everything inside the given box, the finest one which still has enough
+        cells for the whole box */
+    static CompactVertexQuantization ComputeCompactVertexQuantization( const zTBBox3D& bounds );
+
+    /** Packs the given vertices into the compact vertex format */
+    static void EncodeCompactVertices( const ExVertexStruct* input, unsigned int numVertices, const CompactVertexQuantization& quantization, ExVertexStructCompact* output );
+
+    /** Unpacks vertices of the compact vertex format */
+    static void DecodeCompactVertices( const ExVertexStructCompact* input, unsigned int numVertices, const CompactVertexQuantization& quantization, ExVertexStruct* output );
+
+    /** Returns the worst case error the compact vertex format can introduce for positions inside the grid and
+        lightmap texcoords up to maxTexCoord2. Positions are off by at most half a cell per axis, normals by less
+        than 0.0002 radians, the lightmap texcoords lose up to 2^-11 of their magnitude and values below 2^-14 can
+        come back as up to 2^-14. The other texcoords are exact. */
+    static CompactVertexError GetCompactVertexErrorBound( const CompactVertexQuantization& quantization, float maxTexCoord2 );
 };
 
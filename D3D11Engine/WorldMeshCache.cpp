@@ -0,0 +1,616 @@
+#include "pch.h"
+#include "WorldMeshCache.h"
+#include "WorldConverter.h"
+#include "Engine.h"
+#include "BaseGraphicsEngine.h"
+#include "D3D11VertexBuffer.h"
+#include "zCPolygon.h"
+#include "zCMaterial.h"
+#include "zCTexture.h"
+#include "zCLightmap.h"
+#include "MemoryMappedFile.h"
+#include "MeshCacheFormat.h"
+#include "MeshletBuilder.h"
+#include "Toolbox.h"
+
+namespace {
+    const uint32_t WORLD_CACHE_MAGIC = 0x43535747; // "GWSC"
+
+    /** Increase this whenever the file layout or the output of ConvertWorldMesh changes */
+    const uint32_t WORLD_CACHE_VERSION = 4;
+
+    enum EWorldCacheFlags {
+        /** Written with CompactWorldCache, even if the world didn't fit into the compact format */
+        WCF_COMPACT_REQUESTED = 1,
+
+        /** All vertices are stored as ExVertexStructCompact */
+        WCF_COMPACT_VERTICES = 2,
+
+        /** The triangles are in meshlet order, see WorldConverter::OptimizeWorldMesh */
+        WCF_MESHLETS = 4
+    };
+
+    enum EWorldCacheMeshFlags {
+        /** The mesh key uses the flagged portal texture pointer, see BucketWorldPolygons */
+        WCMF_PORTAL = 1
+    };
+
+    /** Worlds which could be off by more than this are stored with full precision */
+    const float MAX_COMPACT_POSITION_ERROR = 0.5f;
+    const float MAX_COMPACT_NORMAL_ERROR = 0.002f;
+    const float MAX_COMPACT_TEXCOORD_ERROR = 1.0f / 512.0f;
+
+#pragma pack(push, 1)
+    struct WorldCacheHeader {
+        uint32_t Magic;
+        uint32_t Version;
+        uint64_t Key;
+        uint64_t FileSize;
+        uint32_t Flags;
+
+        uint32_t NumSections;
+        uint32_t NumMeshes;
+        uint32_t NumVertices;
+        uint32_t NumCompactVertices;
+        uint32_t NumIndices;
+        uint32_t NumWrappedIndices;
+        uint32_t StringTableSize;
+
+        uint64_t SectionsOffset;
+        uint64_t MeshesOffset;
+        uint64_t StringTableOffset;
+        uint64_t VerticesOffset;
+        uint64_t CompactVerticesOffset;
+        uint64_t IndicesOffset;
+        uint64_t WrappedIndicesOffset;
+
+        /** Only used for compact vertices */
+        CompactVertexQuantization Quantization;
+    };
+
+    struct WorldCacheSection {
+        int32_t X;
+        int32_t Y;
+        float3 BoundingBoxMin;
+        float3 BoundingBoxMax;
+        uint32_t FirstMesh;
+        uint32_t NumMeshes;
+    };
+
+    struct WorldCacheMesh {
+        uint32_t TextureNameOffset;
+        uint32_t TextureNameLength;
+        uint32_t Flags;
+        uint32_t FirstVertex;
+        uint32_t NumVertices;
+        uint32_t FirstIndex;
+        uint32_t NumIndices;
+        uint32_t BaseIndexLocation;
+    };
+#pragma pack(pop)
+
+    /** Simple 64-bit hash over 32-bit words. Every changed word changes the result. */
+    class WorldCacheHasher {
+    public:
+        WorldCacheHasher() {
+            Hash = 0xCBF29CE484222325ull;
+        }
+
+        void Add( uint32_t value ) {
+            Hash = (Hash ^ value) * 0x100000001B3ull;
+        }
+
+        void Add( float value ) {
+            uint32_t bits;
+            memcpy( &bits, &value, sizeof( bits ) );
+            Add( bits );
+        }
+
+        void Add( const float3& value ) {
+            Add( value.x );
+            Add( value.y );
+            Add( value.z );
+        }
+
+        void Add( const std::string& value ) {
+            Add( static_cast<uint32_t>(value.size()) );
+            for ( char c : value ) {
+                Add( static_cast<uint32_t>(static_cast<unsigned char>(c)) );
+            }
+        }
+
+        uint64_t Get() const {
+            // Finalizer of splitmix64
+            uint64_t x = Hash;
+            x ^= x >> 30;
+            x *= 0xBF58476D1CE4E5B9ull;
+            x ^= x >> 27;
+            x *= 0x94D049BB133111EBull;
+            x ^= x >> 31;
+            return x;
+        }
+
+    private:
+        uint64_t Hash;
+    };
+
+    /** Hashes everything of the material BucketWorldPolygons looks at */
+    uint64_t HashMaterial( zCMaterial* mat ) {
+        WorldCacheHasher h;
+        zCTexture* tex = mat->GetTextureSingle();
+        h.Add( tex ? tex->GetName() : std::string() );
+        h.Add( static_cast<uint32_t>(mat->GetMatGroup()) );
+        h.Add( static_cast<uint32_t>(mat->GetAlphaFunc()) );
+        h.Add( static_cast<uint32_t>(mat->HasTexAniMap()) );
+
+        XMFLOAT2 aniDelta = mat->GetTexAniMapDelta();
+        h.Add( aniDelta.x );
+        h.Add( aniDelta.y );
+        h.Add( static_cast<uint32_t>(mat->GetWaveMode()) );
+        h.Add( mat->GetWaveSpeed() );
+        h.Add( mat->GetWaveMaxAmplitude() );
+        return h.Get();
+    }
+
+    uint64_t HashLightmap( zCLightmap* lightmap ) {
+        WorldCacheHasher h;
+        h.Add( float3( lightmap->LightmapOrigin ) );
+        h.Add( float3( lightmap->LightmapUVUp ) );
+        h.Add( float3( lightmap->LightmapUVRight ) );
+        return h.Get();
+    }
+
+    /** Returns the name of the texture the mesh key was made for */
+    std::string GetMeshKeyTextureName( const MeshKey& key, uint32_t& outFlags ) {
+        outFlags = 0;
+
+        zCTexture* tex = key.Material ? key.Material->GetTextureSingle() : nullptr;
+        if ( key.Texture && key.Texture != tex ) {
+            // Portals use the pointer of their materials texture + 1 as key, so we must not touch it
+            outFlags |= WCMF_PORTAL;
+        } else {
+            tex = key.Texture;
+        }
+
+        return tex ? tex->GetName() : std::string();
+    }
+}
+
+/** Computes the key for the given world geometry */
+uint64_t WorldMeshCache::ComputeKey( zCPolygon** polys, unsigned int numPolygons, bool indoorLocation ) {
+    std::unordered_map<zCMaterial*, uint64_t> materialHashes;
+    std::unordered_map<zCLightmap*, uint64_t> lightmapHashes;
+
+    WorldCacheHasher h;
+    h.Add( WORLD_CACHE_VERSION );
+#ifdef BUILD_GOTHIC_1_08k
+    h.Add( 1u );
+#else
+    h.Add( 2u );
+#endif
+    h.Add( static_cast<uint32_t>(indoorLocation) );
+    h.Add( static_cast<uint32_t>(DEFAULT_LIGHTMAP_POLY_COLOR) );
+    h.Add( numPolygons );
+
+    for ( unsigned int i = 0; i < numPolygons; i++ ) {
+        zCPolygon* poly = polys[i];
+
+        h.Add( static_cast<uint32_t>(poly->GetPolyFlags()->GhostOccluder) );
+        h.Add( static_cast<uint32_t>(poly->GetPolyFlags()->PortalPoly) );
+
+        uint64_t materialHash = 0;
+        if ( zCMaterial* mat = poly->GetMaterial() ) {
+            auto it = materialHashes.find( mat );
+            if ( it == materialHashes.end() ) {
+                it = materialHashes.emplace( mat, HashMaterial( mat ) ).first;
+            }
+            materialHash = it->second;
+        }
+        h.Add( static_cast<uint32_t>(materialHash) );
+        h.Add( static_cast<uint32_t>(materialHash >> 32) );
+
+        uint64_t lightmapHash = 0;
+        if ( zCLightmap* lightmap = poly->GetLightmap() ) {
+            auto it = lightmapHashes.find( lightmap );
+            if ( it == lightmapHashes.end() ) {
+                it = lightmapHashes.emplace( lightmap, HashLightmap( lightmap ) ).first;
+            }
+            lightmapHash = it->second;
+        }
+        h.Add( static_cast<uint32_t>(lightmapHash) );
+        h.Add( static_cast<uint32_t>(lightmapHash >> 32) );
+
+        h.Add( static_cast<uint32_t>(poly->GetNumPolyVertices()) );
+        for ( int v = 0; v < poly->GetNumPolyVertices(); v++ ) {
+            zCVertFeature* feature = poly->getFeatures()[v];
+
+            h.Add( poly->getVertices()[v]->Position );
+            h.Add( feature->normal );
+            h.Add( static_cast<uint32_t>(feature->lightStatic) );
+            h.Add( feature->texCoord.x );
+            h.Add( feature->texCoord.y );
+        }
+    }
+
+    return h.Get();
+}
+
+/** Loads the converted sections from the given cache file */
+XRESULT WorldMeshCache::LoadSections( const std::string& file, uint64_t key, bool useCompactVertices, bool useMeshlets, zCPolygon** polys, unsigned int numPolygons, bool indoorLocation,
+    std::map<int, std::map<int, WorldMeshSectionInfo>>* outSections, WorldInfo* info, MeshInfo** outWrappedMesh ) {
+    MemoryMappedFile mapped;
+    if ( XR_SUCCESS != mapped.Open( file ) ) {
+        return XR_FAILED;
+    }
+
+    const uint8_t* data = mapped.GetData();
+    uint64_t fileSize = mapped.GetSize();
+    if ( fileSize < sizeof( WorldCacheHeader ) ) {
+        LogWarn() << "World cache " << file << " is too small, ignoring it";
+        return XR_FAILED;
+    }
+
+    const WorldCacheHeader& header = *reinterpret_cast<const WorldCacheHeader*>(data);
+    if ( header.Magic != WORLD_CACHE_MAGIC || header.Version != WORLD_CACHE_VERSION ) {
+        LogInfo() << "World cache " << file << " has an old version, rebuilding it";
+        return XR_FAILED;
+    }
+
+    if ( header.Key != key ) {
+        LogInfo() << "World cache " << file << " was made for different geometry, rebuilding it";
+        return XR_FAILED;
+    }
+
+    if ( ((header.Flags & WCF_COMPACT_REQUESTED) != 0) != useCompactVertices ) {
+        LogInfo() << "World cache " << file << " uses a different vertex format, rebuilding it";
+        return XR_FAILED;
+    }
+
+    if ( ((header.Flags & WCF_MESHLETS) != 0) != useMeshlets ) {
+        LogInfo() << "World cache " << file << " uses a different triangle order, rebuilding it";
+        return XR_FAILED;
+    }
+
+    if ( header.FileSize != fileSize
+        || !MeshCacheFormat::IsArrayInFile( header.SectionsOffset, header.NumSections, sizeof( WorldCacheSection ), fileSize )
+        || !MeshCacheFormat::IsArrayInFile( header.MeshesOffset, header.NumMeshes, sizeof( WorldCacheMesh ), fileSize )
+        || !MeshCacheFormat::IsArrayInFile( header.StringTableOffset, header.StringTableSize, 1, fileSize )
+        || !MeshCacheFormat::IsArrayInFile( header.VerticesOffset, header.NumVertices, sizeof( ExVertexStruct ), fileSize )
+        || !MeshCacheFormat::IsArrayInFile( header.CompactVerticesOffset, header.NumCompactVertices, sizeof( ExVertexStructCompact ), fileSize )
+        || !MeshCacheFormat::IsArrayInFile( header.IndicesOffset, header.NumIndices, sizeof( VERTEX_INDEX ), fileSize )
+        || !MeshCacheFormat::IsArrayInFile( header.WrappedIndicesOffset, header.NumWrappedIndices, sizeof( unsigned int ), fileSize ) ) {
+        LogWarn() << "World cache " << file << " is damaged, ignoring it";
+        return XR_FAILED;
+    }
+
+    const WorldCacheSection* sections = reinterpret_cast<const WorldCacheSection*>(data + header.SectionsOffset);
+    const WorldCacheMesh* meshes = reinterpret_cast<const WorldCacheMesh*>(data + header.MeshesOffset);
+    const char* strings = reinterpret_cast<const char*>(data + header.StringTableOffset);
+    const ExVertexStruct* vertices = reinterpret_cast<const ExVertexStruct*>(data + header.VerticesOffset);
+    const ExVertexStructCompact* compactVertices = reinterpret_cast<const ExVertexStructCompact*>(data + header.CompactVerticesOffset);
+    const VERTEX_INDEX* indices = reinterpret_cast<const VERTEX_INDEX*>(data + header.IndicesOffset);
+    const unsigned int* wrappedIndices = reinterpret_cast<const unsigned int*>(data + header.WrappedIndicesOffset);
+
+    // Recreate the sections and mesh keys. This also sets up the materials just like a full conversion would.
+    WorldConverter::BucketWorldPolygons( polys, numPolygons, outSections, indoorLocation, false );
+
+    size_t numSections = 0;
+    for ( auto const& itx : *outSections ) {
+        numSections += itx.second.size();
+    }
+
+    // Meshes in file order, which is also their order in the wrapped vertex buffer
+    std::vector<WorldMeshInfo*> cachedMeshInfos( header.NumMeshes, nullptr );
+    const bool compact = (header.Flags & WCF_COMPACT_VERTICES) != 0;
+    const uint32_t numVertices = compact ? header.NumCompactVertices : header.NumVertices;
+
+    bool valid = numSections == header.NumSections;
+    for ( uint32_t s = 0; valid && s < header.NumSections; s++ ) {
+        const WorldCacheSection& cachedSection = sections[s];
+
+        auto itx = outSections->find( cachedSection.X );
+        if ( itx == outSections->end() ) {
+            valid = false;
+            break;
+        }
+
+        auto ity = itx->second.find( cachedSection.Y );
+        if ( ity == itx->second.end()
+            || ity->second.WorldMeshes.size() != cachedSection.NumMeshes
+            || cachedSection.FirstMesh > header.NumMeshes
+            || cachedSection.NumMeshes > header.NumMeshes - cachedSection.FirstMesh ) {
+            valid = false;
+            break;
+        }
+
+        WorldMeshSectionInfo& section = ity->second;
+        section.BoundingBox.Min = *cachedSection.BoundingBoxMin.toXMFLOAT3();
+        section.BoundingBox.Max = *cachedSection.BoundingBoxMax.toXMFLOAT3();
+
+        // The mesh order inside a section depends on texture pointers, so match them by name
+        std::vector<std::pair<std::string, uint32_t>> names;
+        std::vector<WorldMeshInfo*> sectionMeshes;
+        for ( auto const& it : section.WorldMeshes ) {
+            uint32_t flags;
+            std::string name = GetMeshKeyTextureName( it.first, flags );
+            names.emplace_back( std::move( name ), flags );
+            sectionMeshes.emplace_back( it.second );
+        }
+
+        std::vector<bool> matched( sectionMeshes.size(), false );
+        for ( uint32_t m = cachedSection.FirstMesh; valid && m < cachedSection.FirstMesh + cachedSection.NumMeshes; m++ ) {
+            const WorldCacheMesh& cachedMesh = meshes[m];
+            if ( cachedMeshInfos[m]
+                || cachedMesh.TextureNameOffset > header.StringTableSize
+                || cachedMesh.TextureNameLength > header.StringTableSize - cachedMesh.TextureNameOffset
+                || cachedMesh.FirstVertex > numVertices
+                || cachedMesh.NumVertices > numVertices - cachedMesh.FirstVertex
+                || cachedMesh.FirstIndex > header.NumIndices
+                || cachedMesh.NumIndices > header.NumIndices - cachedMesh.FirstIndex ) {
+                valid = false;
+                break;
+            }
+
+            std::string name( strings + cachedMesh.TextureNameOffset, cachedMesh.TextureNameLength );
+
+            size_t found = sectionMeshes.size();
+            for ( size_t i = 0; i < sectionMeshes.size(); i++ ) {
+                if ( !matched[i] && names[i].second == (cachedMesh.Flags & WCMF_PORTAL) && names[i].first == name ) {
+                    found = i;
+                    break;
+                }
+            }
+
+            if ( found == sectionMeshes.size() ) {
+                valid = false;
+                break;
+            }
+
+            matched[found] = true;
+
+            WorldMeshInfo* mesh = sectionMeshes[found];
+            cachedMeshInfos[m] = mesh;
+            if ( compact ) {
+                mesh->Vertices.resize( cachedMesh.NumVertices );
+                WorldConverter::DecodeCompactVertices( compactVertices + cachedMesh.FirstVertex, cachedMesh.NumVertices, header.Quantization, mesh->Vertices.data() );
+            } else {
+                mesh->Vertices.assign( vertices + cachedMesh.FirstVertex, vertices + cachedMesh.FirstVertex + cachedMesh.NumVertices );
+            }
+            mesh->Indices.assign( indices + cachedMesh.FirstIndex, indices + cachedMesh.FirstIndex + cachedMesh.NumIndices );
+            mesh->BaseIndexLocation = cachedMesh.BaseIndexLocation;
+
+            // The triangles were stored in meshlet order, so splitting them again gives the same meshlets
+            if ( useMeshlets ) {
+                MeshletBuilder::BuildMeshlets( mesh->Vertices, mesh->Indices, mesh->Meshlets );
+            }
+        }
+    }
+
+    if ( valid && std::find( cachedMeshInfos.begin(), cachedMeshInfos.end(), nullptr ) != cachedMeshInfos.end() ) {
+        valid = false;
+    }
+
+    if ( !valid ) {
+        LogWarn() << "World cache " << file << " doesn't match the loaded world, rebuilding it";
+        outSections->clear();
+        return XR_FAILED;
+    }
+
+    XMVECTOR avgSections = XMVectorZero();
+    for ( auto const& itx : *outSections ) {
+        for ( auto const& ity : itx.second ) {
+            avgSections += XMVectorSet( static_cast<float>(itx.first), static_cast<float>(ity.first), 0, 0 );
+        }
+    }
+
+    // The GPU gets the vertices as they are in the file, compact ones get decoded by the vertex shaders
+    const uint8_t* vertexData = compact ? reinterpret_cast<const uint8_t*>(compactVertices) : reinterpret_cast<const uint8_t*>(vertices);
+    const unsigned int vertexStride = compact ? sizeof( ExVertexStructCompact ) : sizeof( ExVertexStruct );
+    for ( uint32_t m = 0; m < header.NumMeshes; m++ ) {
+        WorldMeshInfo* mesh = cachedMeshInfos[m];
+        Engine::GraphicsEngine->CreateVertexBuffer( &mesh->MeshVertexBuffer );
+        Engine::GraphicsEngine->CreateVertexBuffer( &mesh->MeshIndexBuffer );
+
+        mesh->MeshVertexBuffer->Init( const_cast<uint8_t*>(vertexData + static_cast<size_t>(meshes[m].FirstVertex) * vertexStride), meshes[m].NumVertices * vertexStride, D3D11VertexBuffer::B_VERTEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
+        mesh->MeshIndexBuffer->Init( &mesh->Indices[0], mesh->Indices.size() * sizeof( VERTEX_INDEX ), D3D11VertexBuffer::B_INDEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
+    }
+
+    // The wrapped mesh is just all vertices in file order, so it can be created straight from the mapped file
+    MeshInfo* wmi = new MeshInfo();
+    Engine::GraphicsEngine->CreateVertexBuffer( &wmi->MeshVertexBuffer );
+    Engine::GraphicsEngine->CreateVertexBuffer( &wmi->MeshIndexBuffer );
+    wmi->MeshVertexBuffer->Init( const_cast<uint8_t*>(vertexData), numVertices * vertexStride, D3D11VertexBuffer::B_VERTEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
+    wmi->MeshIndexBuffer->Init( const_cast<unsigned int*>(wrappedIndices), header.NumWrappedIndices * sizeof( unsigned int ), D3D11VertexBuffer::B_INDEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
+    *outWrappedMesh = wmi;
+
+    if ( info ) {
+        // Calculate the approx midpoint of the world
+        avgSections /= static_cast<float>(numSections);
+        XMStoreFloat2( &info->MidPoint, avgSections * WORLD_SECTION_SIZE );
+        info->LowestVertex = 0;
+        info->HighestVertex = 0;
+        info->CompactVertices = compact;
+        info->CompactQuantization = header.Quantization;
+    }
+
+    return XR_SUCCESS;
+}
+
+/** Writes the sections created by ConvertWorldMesh into the given cache file */
+XRESULT WorldMeshCache::SaveSections( const std::string& file, uint64_t key, bool useCompactVertices, bool useMeshlets, const std::map<int, std::map<int, WorldMeshSectionInfo>>& sections ) {
+    std::vector<WorldCacheSection> cachedSections;
+    std::vector<WorldCacheMesh> cachedMeshes;
+    std::string strings;
+    std::vector<ExVertexStruct> vertices;
+    std::vector<ExVertexStructCompact> compactVertices;
+    std::vector<VERTEX_INDEX> indices;
+    std::vector<unsigned int> wrappedIndices;
+    unsigned int numWrappedVertices = 0;
+
+    // The whole world goes into one vertex buffer, so either all of it uses the compact format or nothing
+    bool compact = false;
+    CompactVertexQuantization quantization = {};
+    CompactVertexError errorBound = {};
+    if ( useCompactVertices ) {
+        XMVECTOR bbmin = XMVectorReplicate( FLT_MAX );
+        XMVECTOR bbmax = XMVectorReplicate( -FLT_MAX );
+        float maxTexCoord2 = 0.0f;
+        size_t numVertices = 0;
+        for ( auto const& itx : sections ) {
+            for ( auto const& ity : itx.second ) {
+                for ( auto const& it : ity.second.WorldMeshes ) {
+                    for ( const ExVertexStruct& v : it.second->Vertices ) {
+                        XMVECTOR p = XMLoadFloat3( v.Position.toXMFLOAT3() );
+                        bbmin = XMVectorMin( bbmin, p );
+                        bbmax = XMVectorMax( bbmax, p );
+                        maxTexCoord2 = std::max( maxTexCoord2, std::max( fabsf( v.TexCoord2.x ), fabsf( v.TexCoord2.y ) ) );
+                    }
+                    numVertices += it.second->Vertices.size();
+                }
+            }
+        }
+
+        if ( numVertices ) {
+            zTBBox3D bounds;
+            XMStoreFloat3( &bounds.Min, bbmin );
+            XMStoreFloat3( &bounds.Max, bbmax );
+            quantization = WorldConverter::ComputeCompactVertexQuantization( bounds );
+
+            // Worlds too large for the grid, or with huge lightmap texcoords, are kept as they are
+            errorBound = WorldConverter::GetCompactVertexErrorBound( quantization, maxTexCoord2 );
+            compact = errorBound.Position <= MAX_COMPACT_POSITION_ERROR && errorBound.Normal <= MAX_COMPACT_NORMAL_ERROR && errorBound.TexCoord <= MAX_COMPACT_TEXCOORD_ERROR;
+        }
+    }
+
+    // Same layout WrapVertexBuffers creates, so the BaseIndexLocations stay valid
+    for ( auto const& itx : sections ) {
+        for ( auto const& ity : itx.second ) {
+            const WorldMeshSectionInfo& section = ity.second;
+
+            WorldCacheSection cachedSection = {};
+            cachedSection.X = itx.first;
+            cachedSection.Y = ity.first;
+            cachedSection.BoundingBoxMin = section.BoundingBox.Min;
+            cachedSection.BoundingBoxMax = section.BoundingBox.Max;
+            cachedSection.FirstMesh = static_cast<uint32_t>(cachedMeshes.size());
+            cachedSection.NumMeshes = static_cast<uint32_t>(section.WorldMeshes.size());
+
+            std::set<std::pair<std::string, uint32_t>> sectionNames;
+            for ( auto const& it : section.WorldMeshes ) {
+                const WorldMeshInfo* mesh = it.second;
+
+                uint32_t flags;
+                std::string name = GetMeshKeyTextureName( it.first, flags );
+                if ( !sectionNames.emplace( name, flags ).second ) {
+                    // Two different textures with the same name, we couldn't tell them apart when loading
+                    LogWarn() << "Not caching the world, texture " << name << " is used twice in section " << itx.first << ", " << ity.first;
+                    return XR_FAILED;
+                }
+
+                WorldCacheMesh cachedMesh = {};
+                cachedMesh.TextureNameOffset = static_cast<uint32_t>(strings.size());
+                cachedMesh.TextureNameLength = static_cast<uint32_t>(name.size());
+                strings += name;
+
+                cachedMesh.NumVertices = static_cast<uint32_t>(mesh->Vertices.size());
+                cachedMesh.FirstIndex = static_cast<uint32_t>(indices.size());
+                cachedMesh.NumIndices = static_cast<uint32_t>(mesh->Indices.size());
+                cachedMesh.BaseIndexLocation = static_cast<uint32_t>(wrappedIndices.size());
+
+                if ( compact ) {
+                    cachedMesh.FirstVertex = static_cast<uint32_t>(compactVertices.size());
+                    compactVertices.resize( compactVertices.size() + mesh->Vertices.size() );
+                    WorldConverter::EncodeCompactVertices( mesh->Vertices.data(), cachedMesh.NumVertices, quantization, compactVertices.data() + cachedMesh.FirstVertex );
+                } else {
+                    cachedMesh.FirstVertex = static_cast<uint32_t>(vertices.size());
+                    vertices.insert( vertices.end(), mesh->Vertices.begin(), mesh->Vertices.end() );
+                }
+
+                cachedMesh.Flags = flags;
+                cachedMeshes.emplace_back( cachedMesh );
+
+                indices.insert( indices.end(), mesh->Indices.begin(), mesh->Indices.end() );
+                for ( VERTEX_INDEX index : mesh->Indices ) {
+                    wrappedIndices.emplace_back( index + numWrappedVertices );
+                }
+                numWrappedVertices += static_cast<unsigned int>(mesh->Vertices.size());
+            }
+
+            cachedSections.emplace_back( cachedSection );
+        }
+    }
+
+    WorldCacheHeader header = {};
+    header.Magic = WORLD_CACHE_MAGIC;
+    header.Version = WORLD_CACHE_VERSION;
+    header.Key = key;
+    header.Flags = (useCompactVertices ? WCF_COMPACT_REQUESTED : 0) | (compact ? WCF_COMPACT_VERTICES : 0) | (useMeshlets ? WCF_MESHLETS : 0);
+    header.NumSections = static_cast<uint32_t>(cachedSections.size());
+    header.NumMeshes = static_cast<uint32_t>(cachedMeshes.size());
+    header.NumVertices = static_cast<uint32_t>(vertices.size());
+    header.NumCompactVertices = static_cast<uint32_t>(compactVertices.size());
+    header.NumIndices = static_cast<uint32_t>(indices.size());
+    header.NumWrappedIndices = static_cast<uint32_t>(wrappedIndices.size());
+    header.StringTableSize = static_cast<uint32_t>(strings.size());
+    header.Quantization = quantization;
+
+    header.SectionsOffset = MeshCacheFormat::AlignBlob( sizeof( WorldCacheHeader ) );
+    header.MeshesOffset = MeshCacheFormat::AlignBlob( header.SectionsOffset + cachedSections.size() * sizeof( WorldCacheSection ) );
+    header.StringTableOffset = MeshCacheFormat::AlignBlob( header.MeshesOffset + cachedMeshes.size() * sizeof( WorldCacheMesh ) );
+    header.VerticesOffset = MeshCacheFormat::AlignBlob( header.StringTableOffset + strings.size() );
+    header.CompactVerticesOffset = MeshCacheFormat::AlignBlob( header.VerticesOffset + vertices.size() * sizeof( ExVertexStruct ) );
+    header.IndicesOffset = MeshCacheFormat::AlignBlob( header.CompactVerticesOffset + compactVertices.size() * sizeof( ExVertexStructCompact ) );
+    header.WrappedIndicesOffset = MeshCacheFormat::AlignBlob( header.IndicesOffset + indices.size() * sizeof( VERTEX_INDEX ) );
+    header.FileSize = header.WrappedIndicesOffset + wrappedIndices.size() * sizeof( unsigned int );
+
+    std::string folder = file.substr( 0, file.find_last_of( "\\/" ) + 1 );
+    if ( !folder.empty() && !Toolbox::FolderExists( folder ) && !Toolbox::CreateDirectoryRecursive( folder ) ) {
+        LogWarn() << "Could not create world cache directory: " << folder;
+        return XR_FAILED;
+    }
+
+    // Write to a temporary file first, so a crash while saving can't leave a broken cache behind
+    std::string tmpFile = file + ".tmp";
+    FILE* f;
+    if ( fopen_s( &f, tmpFile.c_str(), "wb" ) != 0 || !f ) {
+        LogWarn() << "Could not open world cache file for writing: " << tmpFile;
+        return XR_FAILED;
+    }
+
+    const uint8_t padding[MeshCacheFormat::BLOB_ALIGNMENT] = {};
+    uint64_t written = 0;
+    auto writeBlob = [&]( uint64_t offset, const void* blob, size_t size ) {
+        fwrite( padding, 1, static_cast<size_t>(offset - written), f );
+        if ( size ) {
+            fwrite( blob, 1, size, f );
+        }
+        written = offset + size;
+    };
+
+    writeBlob( 0, &header, sizeof( header ) );
+    writeBlob( header.SectionsOffset, cachedSections.data(), cachedSections.size() * sizeof( WorldCacheSection ) );
+    writeBlob( header.MeshesOffset, cachedMeshes.data(), cachedMeshes.size() * sizeof( WorldCacheMesh ) );
+    writeBlob( header.StringTableOffset, strings.data(), strings.size() );
+    writeBlob( header.VerticesOffset, vertices.data(), vertices.size() * sizeof( ExVertexStruct ) );
+    writeBlob( header.CompactVerticesOffset, compactVertices.data(), compactVertices.size() * sizeof( ExVertexStructCompact ) );
+    writeBlob( header.IndicesOffset, indices.data(), indices.size() * sizeof( VERTEX_INDEX ) );
+    writeBlob( header.WrappedIndicesOffset, wrappedIndices.data(), wrappedIndices.size() * sizeof( unsigned int ) );
+
+    bool failed = ferror( f ) != 0;
+    fclose( f );
+
+    if ( failed || !MoveFileExA( tmpFile.c_str(), file.c_str(), MOVEFILE_REPLACE_EXISTING ) ) {
+        LogWarn() << "Could not write world cache file: " << file;
+        DeleteFileA( tmpFile.c_str() );
+        return XR_FAILED;
+    }
+
+    if ( compact ) {
+        LogInfo() << "World cache stores " << header.NumCompactVertices << " compact vertices, positions are off by at most " << errorBound.Position << " units";
+    } else if ( useCompactVertices ) {
+        LogInfo() << "World doesn't fit into the compact vertex format (positions off by up to " << errorBound.Position
+            << " units, lightmap texcoords by " << errorBound.TexCoord << "), world cache keeps full precision";
+    }
+
+    return XR_SUCCESS;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "pch.h"
+#include "WorldObjects.h"
+
+class zCPolygon;
+
+/** Persistent cache of the converted world sections. Loading a world which is in the cache
+    only needs to put the polygons into their sections again, without touching any vertices. */
+class WorldMeshCache {
+public:
+    /** Computes the key for the given world geometry. Covers everything ConvertWorldMesh depends on,
+        so a cache with a matching key holds exactly what the conversion would produce. */
+    static uint64_t ComputeKey( zCPolygon** polys, unsigned int numPolygons, bool indoorLocation );
+
+    /** Loads the converted sections from the given cache file. Fails if the file doesn't exist, was made
+        for different geometry or doesn't match useCompactVertices and useMeshlets, in which case outSections is left empty. */
+    static XRESULT LoadSections( const std::string& file, uint64_t key, bool useCompactVertices, bool useMeshlets, zCPolygon** polys, unsigned int numPolygons, bool indoorLocation,
+        std::map<int, std::map<int, WorldMeshSectionInfo>>* outSections, WorldInfo* info, MeshInfo** outWrappedMesh );
+
+    /** Writes the sections created by ConvertWorldMesh into the given cache file. With useCompactVertices
+        the world is stored as ExVertexStructCompact, unless that could move it too far from the original.
+        useMeshlets tells whether the sections were converted with meshlets, which changes the triangle order. */
+    static XRESULT SaveSections( const std::string& file, uint64_t key, bool useCompactVertices, bool useMeshlets, const std::map<int, std::map<int, WorldMeshSectionInfo>>& sections );
+};
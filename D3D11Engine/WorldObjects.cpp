@@ -57,6 +57,10 @@ MeshInfo::~MeshInfo() {
 
     delete MeshVertexBuffer;
     delete MeshIndexBuffer;
+
+    for ( MeshLodLevel& lod : LodLevels ) {
+        delete lod.Mesh;
+    }
 }
 
 SkeletalMeshInfo::~SkeletalMeshInfo() {
@@ -70,6 +70,16 @@ struct cmpMeshKey {
     }
 };*/
 
+struct MeshInfo;
+
+/** A simplified version of a mesh, see MeshSimplifier */
+struct MeshLodLevel {
+    MeshInfo* Mesh;
+
+    /** Geometric error in object space units */
+    float Error;
+};
+
 /** Holds information about a mesh, ready to be loaded into the renderer */
 struct MeshInfo {
     MeshInfo() {
@@ -91,6 +101,26 @@ struct MeshInfo {
 
     unsigned int BaseIndexLocation;
     unsigned int MeshIndex;
+
+    /** Simplified versions of this mesh with growing error, owned by this */
+    std::vector<MeshLodLevel> LodLevels;
+};
+
+/** A short run of neighbouring triangles of a world mesh that can be culled on its own, see MeshletBuilder */
+struct Meshlet {
+    /** Range inside the Indices of the owning mesh */
+    unsigned int FirstIndex;
+    unsigned int NumIndices;
+
+    XMFLOAT3 SphereCenter;
+    float SphereRadius;
+    zTBBox3D BoundingBox;
+
+    /** All triangles face away from a viewer at p if dot( normalize( ConeApex - p ), ConeAxis ) >= ConeCutoff.
+        ConeCutoff is greater than 1 if the normals spread too much for that to ever happen. */
+    XMFLOAT3 ConeApex;
+    XMFLOAT3 ConeAxis;
+    float ConeCutoff;
 };
 
 struct WorldMeshInfo : public MeshInfo {
@@ -100,6 +130,9 @@ struct WorldMeshInfo : public MeshInfo {
 
     /** If true we will save an info-file on next zen-resource-save */
     bool SaveInfo;
+
+    /** Consecutive parts of Indices, in order and covering all of them */
+    std::vector<Meshlet> Meshlets;
 };
 
 struct QuadMarkInfo {
@@ -171,6 +204,14 @@ struct BaseVisualInfo {
     std::string VisualName;
 };
 
+/** What picking the LOD of a visual needs to know about one of its instances */
+struct VobInstanceLodInfo {
+    XMFLOAT3 Position;
+
+    /** One over the squared length of the longest axis of the world matrix */
+    float InvScaleSq;
+};
+
 /** Holds the converted mesh of a VOB */
 class zCProgMeshProto;
 class zCTexture;
@@ -192,7 +233,8 @@ struct MeshVisualInfo : public BaseVisualInfo {
 
     /** Starts a new frame for this mesh */
     void StartNewFrame() {
-        Instances.clear();
+        InstanceSlots.clear();
+        InstanceLods.clear();
     }
 
     std::map<MeshKey, std::vector<MeshInfo*>, cmpMeshKey> MeshesByTexture;
@@ -201,9 +243,14 @@ struct MeshVisualInfo : public BaseVisualInfo {
     std::vector<std::pair<MeshKey, std::vector<MeshInfo*>>> MeshesCached;
 
     //zCProgMeshProto* Visual;
-    std::vector<VobInstanceInfo> Instances;
     unsigned int StartInstanceNum;
 
+    /** Slots of this frames instances in the static instance store, which holds their data */
+    std::vector<unsigned int> InstanceSlots;
+
+    /** Position and scale of the instances added by GothicAPI::AddStaticMeshInstance, for the LOD selection */
+    std::vector<VobInstanceLodInfo> InstanceLods;
+
     /** Full mesh of this */
     MeshInfo* FullMesh;
 
@@ -261,6 +308,10 @@ struct VobInfo : public BaseVobInfo {
         VobConstantBuffer = nullptr;
         IsIndoorVob = false;
         VisibleInRenderPass = false;
+        CollectionId = NO_COLLECTION_ID;
+        DynamicTreeProxy = NO_TREE_PROXY;
+        PickingTreeProxy = NO_TREE_PROXY;
+        InstanceSlot = NO_INSTANCE_SLOT;
         VobSection = nullptr;
     }
 
@@ -284,6 +335,21 @@ struct VobInfo : public BaseVobInfo {
     /** Flag to see if this vob was drawn in the current render pass. Used to collect the same vob only once. */
     bool VisibleInRenderPass;
 
+    /** Number of this vob among the vobs of the BSP-tree, so collecting it on several threads can dedupe it
+        without writing to it */
+    static const unsigned int NO_COLLECTION_ID = 0xFFFFFFFF;
+    unsigned int CollectionId;
+
+    /** Proxies of this vob in the vob trees of GothicAPI, NO_TREE_PROXY (same as DynamicAabbTree::NO_PROXY) if not in there */
+    static const unsigned int NO_TREE_PROXY = 0xFFFFFFFF;
+    unsigned int DynamicTreeProxy;
+    unsigned int PickingTreeProxy;
+
+    /** Slot of this vobs instance data in the static instance store of GothicAPI, NO_INSTANCE_SLOT (same as
+        StaticInstanceStore::NO_SLOT) until it was drawn for the first time */
+    static const unsigned int NO_INSTANCE_SLOT = 0xFFFFFFFF;
+    unsigned int InstanceSlot;
+
     /** Section this vob is in */
     WorldMeshSectionInfo* VobSection;
 
@@ -449,10 +515,12 @@ struct WorldMeshSectionInfo {
     /** Saves this sections mesh to a file */
     void SaveSectionMeshToFile( const std::string& name );
 
-    std::map<MeshKey, WorldMeshInfo*, cmpMeshKey> WorldMeshes;
+    /** Meshes of the section by material. A custom world mesh can have several meshes for one material if
+        their vertices didn't fit into one, see CustomWorldImport::SplitMesh. */
+    std::multimap<MeshKey, WorldMeshInfo*, cmpMeshKey> WorldMeshes;
     std::map<D3D11Texture*, std::vector<MeshInfo*>> WorldMeshesByCustomTexture;
     std::map<zCMaterial*, std::vector<MeshInfo*>> WorldMeshesByCustomTextureOriginal;
-    std::map<MeshKey, MeshInfo*, cmpMeshKey> SuppressedMeshes;
+    std::multimap<MeshKey, MeshInfo*, cmpMeshKey> SuppressedMeshes;
     std::list<VobInfo*> Vobs;
 
     // This is filled in case we have loaded a custom worldmesh
@@ -479,6 +547,7 @@ struct WorldInfo {
     WorldInfo() {
         BspTree = nullptr;
         CustomWorldLoaded = false;
+        CompactVertices = false;
     }
 
     XMFLOAT2 MidPoint;
@@ -488,6 +557,11 @@ struct WorldInfo {
     zCWorld* MainWorld;
     std::string WorldName;
     bool CustomWorldLoaded;
+
+    /** The vertex buffers of the world mesh hold ExVertexStructCompact on this grid, the CPU copies are always
+        ExVertexStruct */
+    bool CompactVertices;
+    CompactVertexQuantization CompactQuantization;
 };
 
 #pragma warning( pop )
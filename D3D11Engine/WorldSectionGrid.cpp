@@ -0,0 +1,125 @@
+#include "pch.h"
+#include "WorldSectionGrid.h"
+#include "WorldConverter.h"
+
+WorldSectionGrid::WorldSectionGrid() {
+    Clear();
+}
+
+/** Rebuilds the grid from the given sections */
+void WorldSectionGrid::Build( std::map<int, std::map<int, WorldMeshSectionInfo>>& sections ) {
+    Clear();
+
+    // Find the covered area first, so the cells only have to be allocated once
+    INT2 min( INT_MAX, INT_MAX );
+    INT2 max( INT_MIN, INT_MIN );
+    size_t numSections = 0;
+    for ( auto const& [x, column] : sections ) {
+        for ( auto const& [y, section] : column ) {
+            min = INT2( std::min( min.x, x ), std::min( min.y, y ) );
+            max = INT2( std::max( max.x, x ), std::max( max.y, y ) );
+            numSections++;
+        }
+    }
+
+    if ( numSections == 0 ) {
+        return;
+    }
+
+    Resize( min, max );
+    Sections.reserve( numSections );
+    Coords.reserve( numSections );
+    Bounds.reserve( numSections );
+    CullingBounds.Reserve( numSections );
+
+    for ( auto& [x, column] : sections ) {
+        for ( auto& [y, section] : column ) {
+            Insert( INT2( x, y ), &section );
+        }
+    }
+}
+
+/** Removes all sections */
+void WorldSectionGrid::Clear() {
+    Origin = INT2( 0, 0 );
+    Width = 0;
+    Height = 0;
+    MaxCellOverhang = 0;
+
+    Cells.clear();
+    Sections.clear();
+    Coords.clear();
+    Bounds.clear();
+    CullingBounds.Clear();
+}
+
+/** Adds a section, growing the grid if needed */
+void WorldSectionGrid::Insert( const INT2& coords, WorldMeshSectionInfo* section ) {
+    int cell = GetCellIndex( coords );
+    if ( cell < 0 ) {
+        if ( Width == 0 ) {
+            Resize( coords, coords );
+        } else {
+            Resize( INT2( std::min( coords.x, Origin.x ), std::min( coords.y, Origin.y ) ),
+                INT2( std::max( coords.x, Origin.x + Width - 1 ), std::max( coords.y, Origin.y + Height - 1 ) ) );
+        }
+        cell = GetCellIndex( coords );
+    }
+
+    if ( Cells[cell] >= 0 ) {
+        // Already known, only refresh the pointer
+        Sections[Cells[cell]] = section;
+        Bounds[Cells[cell]] = section->BoundingBox;
+        CullingBounds.Set( Cells[cell], section->BoundingBox );
+        AddOverhang( coords, section->BoundingBox );
+        return;
+    }
+
+    Cells[cell] = static_cast<int>(Sections.size());
+    Sections.push_back( section );
+    Coords.push_back( coords );
+    Bounds.push_back( section->BoundingBox );
+    CullingBounds.Add( section->BoundingBox, BOX_DISTANCE_OUTDOOR );
+    AddOverhang( coords, section->BoundingBox );
+}
+
+/** Returns the range of cells whose sections could overlap the given box on the XZ-plane */
+void WorldSectionGrid::GetCellRangeOfBox( const XMFLOAT3& min, const XMFLOAT3& max, INT2& outMin, INT2& outMax ) const {
+    // GetSectionOfPos never decreases along an axis, so a section can only overlap the box
+    // if its cell is within the overhang of the cells of the box corners
+    INT2 cellMin = WorldConverter::GetSectionOfPos( float3( min ) );
+    INT2 cellMax = WorldConverter::GetSectionOfPos( float3( max ) );
+
+    outMin = INT2( cellMin.x - MaxCellOverhang, cellMin.y - MaxCellOverhang );
+    outMax = INT2( cellMax.x + MaxCellOverhang, cellMax.y + MaxCellOverhang );
+}
+
+/** Resizes the cell array so it covers min to max */
+void WorldSectionGrid::Resize( const INT2& min, const INT2& max ) {
+    const int width = max.x - min.x + 1;
+    const int height = max.y - min.y + 1;
+
+    std::vector<int> cells( static_cast<size_t>(width) * height, -1 );
+    for ( size_t i = 0; i < Coords.size(); i++ ) {
+        cells[(Coords[i].x - min.x) * height + (Coords[i].y - min.y)] = static_cast<int>(i);
+    }
+
+    Cells = std::move( cells );
+    Origin = min;
+    Width = width;
+    Height = height;
+}
+
+/** Grows MaxCellOverhang to fit the given section */
+void WorldSectionGrid::AddOverhang( const INT2& coords, const zTBBox3D& box ) {
+    // Sections without geometry have an inverted box and can't overlap anything
+    if ( box.Min.x > box.Max.x || box.Min.z > box.Max.z ) {
+        return;
+    }
+
+    INT2 cellMin = WorldConverter::GetSectionOfPos( float3( box.Min ) );
+    INT2 cellMax = WorldConverter::GetSectionOfPos( float3( box.Max ) );
+
+    MaxCellOverhang = std::max( MaxCellOverhang, std::max( coords.x - cellMin.x, coords.y - cellMin.y ) );
+    MaxCellOverhang = std::max( MaxCellOverhang, std::max( cellMax.x - coords.x, cellMax.y - coords.y ) );
+}
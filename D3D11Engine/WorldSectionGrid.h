@@ -0,0 +1,104 @@
+#pragma once
+#include "pch.h"
+#include "WorldObjects.h"
+#include "BoxCulling.h"
+
+/** Dense lookup structure over the world sections. The sections themselves stay owned by
+    GothicAPI's section map, this only indexes them by their INT2-coordinates so lookups are O(1)
+    and range queries only touch the cells inside the range. */
+class WorldSectionGrid {
+public:
+    WorldSectionGrid();
+
+    /** Rebuilds the grid from the given sections */
+    void Build( std::map<int, std::map<int, WorldMeshSectionInfo>>& sections );
+
+    /** Removes all sections */
+    void Clear();
+
+    /** Returns the section at the given coordinates or nullptr if there is none */
+    WorldMeshSectionInfo* Get( const INT2& coords ) const {
+        int cell = GetCellIndex( coords );
+        return cell < 0 || Cells[cell] < 0 ? nullptr : Sections[Cells[cell]];
+    }
+
+    /** Adds a section, growing the grid if needed. Takes the bounding box as it is now, so sections have to be
+        complete before they get added. The pointer must stay valid until the next Clear/Build. */
+    void Insert( const INT2& coords, WorldMeshSectionInfo* section );
+
+    /** Calls f( const INT2& coords, WorldMeshSectionInfo& section ) for every section with min <= coords <= max,
+        ordered by x, then y like the section map */
+    template<typename F>
+    void ForEachInRange( const INT2& min, const INT2& max, F&& f ) const {
+        const int x0 = std::max( min.x, Origin.x );
+        const int y0 = std::max( min.y, Origin.y );
+        const int x1 = std::min( max.x, Origin.x + Width - 1 );
+        const int y1 = std::min( max.y, Origin.y + Height - 1 );
+
+        for ( int x = x0; x <= x1; x++ ) {
+            const int* column = &Cells[(x - Origin.x) * Height];
+            for ( int y = y0; y <= y1; y++ ) {
+                int idx = column[y - Origin.y];
+                if ( idx >= 0 ) {
+                    f( Coords[idx], *Sections[idx] );
+                }
+            }
+        }
+    }
+
+    /** Calls f for every section within radius cells of center, see ForEachInRange */
+    template<typename F>
+    void ForEachAround( const INT2& center, int radius, F&& f ) const {
+        ForEachInRange( INT2( center.x - radius, center.y - radius ), INT2( center.x + radius, center.y + radius ), std::forward<F>( f ) );
+    }
+
+    /** Returns the range of cells whose sections could overlap the given box on the XZ-plane.
+        Accounts for polygons reaching over the border of their cell. */
+    void GetCellRangeOfBox( const XMFLOAT3& min, const XMFLOAT3& max, INT2& outMin, INT2& outMax ) const;
+
+    /** How many cells the bounding box of a section reaches over the border of its own cell at most */
+    int GetMaxCellOverhang() const { return MaxCellOverhang; }
+
+    /** All sections, their coordinates and their bounding boxes in matching order */
+    const std::vector<WorldMeshSectionInfo*>& GetSections() const { return Sections; }
+    const std::vector<INT2>& GetCoords() const { return Coords; }
+    const std::vector<zTBBox3D>& GetBounds() const { return Bounds; }
+
+    /** Appends the indices (into GetSections) of all sections inside the frustum and within distances.Radius[BOX_DISTANCE_OUTDOOR] */
+    void Cull( const CullingFrustum& frustum, const CullingDistances& distances, std::vector<unsigned int>& outIndices ) const {
+        CullingBounds.Cull( frustum, distances, outIndices );
+    }
+
+private:
+    int GetCellIndex( const INT2& coords ) const {
+        int x = coords.x - Origin.x;
+        int y = coords.y - Origin.y;
+        if ( x < 0 || y < 0 || x >= Width || y >= Height ) {
+            return -1;
+        }
+        return x * Height + y;
+    }
+
+    /** Resizes the cell array so it covers min to max */
+    void Resize( const INT2& min, const INT2& max );
+
+    /** Grows MaxCellOverhang to fit the given section */
+    void AddOverhang( const INT2& coords, const zTBBox3D& box );
+
+    /** Lowest coordinates covered by the grid and its size in cells */
+    INT2 Origin;
+    int Width;
+    int Height;
+
+    /** Index into Sections for every cell, -1 for empty cells. Stored column by column (x major) */
+    std::vector<int> Cells;
+
+    std::vector<WorldMeshSectionInfo*> Sections;
+    std::vector<INT2> Coords;
+    std::vector<zTBBox3D> Bounds;
+
+    /** The same bounds again, for culling many sections at once */
+    BoxCullingSet CullingBounds;
+
+    int MaxCellOverhang;
+};